@@ -28,12 +28,11 @@
  */
 
 
-
 /* For a module overview, see the header file
  */
 
 
-#ifdef __APPLE__
+#if defined(__APPLE__) || defined(ZUL_HIDAPI)
 
 #include <stdarg.h>
 #include <stdio.h>
@@ -41,802 +40,785 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <string.h>
+#include <pthread.h>
+#include <hidapi.h>
 
+#include "dbg2console.h"
 #include "comms.h"
+#include "transport.h"
+#include "protocol.h"
 #include "debug.h"
 
-#define DEV_ENTRY_SZ        (140)
-#define DEV_LIST_SZ         (20*DEV_ENTRY_SZ)
-
-//
-// --- Module Static Variables (msv_) ---
-//
-
-static char                     msv_usbLibStr[40 + 1]   = "unopened";
-static bool                     msv_libInitialised      = false;
-
-
-/*@null@*/
-static struct hid_device_info * msv_device_list         = NULL;      // pointer to hold list of devices
-
-
-/* persistent list of Zytronic devices. This list should be consistent for a
- * given population of USB devices.  The list is defined and updated during
- * a call to zul_getDeviceList()                                            */
-
-static char                     msv_DevStrArray [DEV_LIST_SZ];
-
-
-/* This variable holds the entry in msv_DevStrArray which is currently
- * connected                                                                */
-static int                      msv_device_index        = -1;
+#define BUF_LEN                     (64)
 
+// the Zytronic protocol uses feature report 5 (ZCC) in the application, and
+// the unnumbered report in the bootloader
+#define APP_REPORT_ID               (0x05)
 
-/* This variable holds the PID of the device which is currently connected   */
-static int16_t                  msv_device_pid          = -1;
+#define     DEF_CTRL_DELAY          (5)
+#define     DEF_CTRL_RETRY          (10)
+#define     DEF_CTRL_TIMEOUT        (1000)
 
+// input reports are read with this timeout, so that control requests, which
+// share the device handle, are not held up for long
+#define     IN_READ_TIMEOUT_MS      (10)
 
-/* This variable is the opaque handle to the connected HID device           */
-/*@null@*/
-static hid_device              *msv_dev_handle          = NULL;
-
+// error codes, as returned by the libusb backend
+#define     HA_ERROR_IO             (-1)
+#define     HA_ERROR_NO_DEVICE      (-4)
+#define     HA_ERROR_NOT_FOUND      (-5)
+#define     HA_ERROR_BUSY           (-6)
+#define     HA_ERROR_TIMEOUT        (-7)
+#define     HA_ERROR_NO_MEM         (-11)
 
 /**
- * Boolean to indicate device connected is a BOOTLOADER */
-static bool                     msv_bootloader          = false;
-
+ * The HID-API paths of one Zytronic device, one per HID interface
+ */
+#define HIDAPI_TABLE_LEN            (16)
+#define HIDAPI_MAX_IFACE            (4)
+#define HIDAPI_PATH_LEN             (256)
 
+typedef struct
+{
+    int                         index;
+    char                        addr[7];        // "HH_HH" - hash of the path
+    int16_t                     pid;
+    char                        serial[64];
+    int                         numPaths;
+    uint8_t                     iface[HIDAPI_MAX_IFACE];
+    char                        path[HIDAPI_MAX_IFACE][HIDAPI_PATH_LEN];
+} HidapiEntry_t;
+
+struct hidapi_device
+{
+    /*@null@*/
+    struct hidapi_device *      next;           // list of open devices
+    hid_device *                handle;
+    HidapiEntry_t               entry;
+    int16_t                     pid;
+    uint8_t                     activeInterface;
+    bool                        bootloader;
+
+    // control request parameters; the mutex serialises use of the handle
+    int                         ctrlDelay;
+    int                         ctrlRetry;
+    unsigned int                ctrlTimeout;
+    pthread_mutex_t             ctrlMutex;
+
+    // input report service
+    usb_in_handler_t            IN_handler[MAX_REPORT_ID];
+    void *                      IN_context[MAX_REPORT_ID];
+    usb_in_stats_t              inStats;
+    pthread_t                   reader;
+    bool                        readerRunning;
+    volatile bool               stopReader;
+};
 
 //
-// === Private Prototypes ========================
+// --- Module Global Variables ---
 //
 
+static bool                     msv_libOpen             = false;
+static char                     msv_libStr[40 + 1]      = "unopened";
 
+// devices opened, and not yet closed
+/*@null@*/
+static hidapi_device_t *        msv_openDevices         = NULL;
+static pthread_mutex_t          msv_devListMutex        = PTHREAD_MUTEX_INITIALIZER;
 
-/* given an index in the msv_DevStrArray, set the provided path variable
- * and return true.
- * If the index is missing, return false.
- */
-static
-bool                getDevPathByIndex   (int index, char *path, int len);
-
-static struct
-hid_device_info    *getDevInfoByPath    (char *path);
+//
+// --- Private Prototypes ---
+//
 
-// Test if data holds non-zero bytes
-static
-bool                nonZeroData         (uint8_t *data, int len);
+static int      hidapi_scan             (HidapiEntry_t *table, int maxEntries);
+static bool     hidapi_lookup           (int index, char const *addrStr,
+                                            HidapiEntry_t *out);
+static int      hidapi_devPrepare       (HidapiEntry_t const *entry,
+                                            hidapi_device_t **pdev);
+static hid_device * hidapi_openIFace    (HidapiEntry_t const *entry,
+                                            uint8_t iface);
+static bool     hidapi_devIsOpen        (char const *addr);
+static int      hidapi_pollReply        (hidapi_device_t *dev, uint8_t *reply,
+                                            int retries, long int budgetMs);
+static bool     nonZeroData             (uint8_t *data, int len);
+static void *   hidapi_inputWorker      (void *arg);
 
 
 // ============================================================================
 // --- Public Implementation ---
 // ============================================================================
 
-
 /**
- * given a USB Product ID, return a device name string :
- *      ZXY100, ZXY110, ZXY150, ZXY200, ZXY300
+ * Open the library, initialising all internal states
+ * return zero on success, else a negative error code
  */
-char const * zul_getDevStrByPID  (int16_t pid)
+int hidapi_openLib(void)
 {
-    switch (pid)
-    {
-        case ZXY100_PRODUCT_ID:
-        case ZXY100_BOOTLDR_ID:
-            return "ZXY100";
+    int retVal;
 
-        case ZXY110_PRODUCT_ID:
-        case ZXY110_BOOTLDR_ID:
-            return "ZXY110";
+    if (msv_libOpen) return 0;
 
-        case ZXY150_PRODUCT_ID:
-        case ZXY150_BOOTLDR_ID:
-            return "ZXY150";
+#ifdef HID_API_VERSION_STR
+    (void)snprintf ( msv_libStr, 40, "HID-API Version: %s", HID_API_VERSION_STR);
+#else
+    (void)snprintf ( msv_libStr, 40, "HID-API Version Unknown");
+#endif
+    msv_libStr[40] = '\0';     // force null termination
 
-        case ZXY200_PRODUCT_ID:
-        case ZXY200_BOOTLDR_ID:
-            return "ZXY200";
-
-        case ZXY300_PRODUCT_ID:
-        case ZXY300_BOOTLDR_ID:
-            return "ZXY300";
-
-        default:
-            return "UNKNOWN";
+    retVal = hid_init(); //initialize a hid-api session
+    if (retVal < 0)
+    {
+        zul_logf (0, "Init Error %d\n", retVal);
+        return -1;  // Failure
     }
-}
 
+    msv_libOpen = true;
+    return 0;
+}
 
 /**
- * Given a ZXYxxx device name, return a device number {100, 110, 150, ...}
- * This service can remove (path) chars before the first 'ZXY' string.
- * If we fail, return -1
+ * Close any open devices, and the library
  */
-int zul_getProdNumFromDevS(char const *devName)
+void hidapi_closeLib(void)
 {
-    int         retVal = -1;    // failure indication
-    char const *startLoc;
-    char const *zxyLoc;
+    if (!msv_libOpen) return;
 
-    // if a path is provided, it might also hold 'ZXYxxx' str. Skip any path!
-    startLoc = strrchr(devName, '/');
-    if (startLoc == NULL) startLoc = devName;
+    while (msv_openDevices != NULL)
+    {
+        (void)hidapi_devClose(msv_openDevices);
+    }
 
-    zxyLoc = strstr(startLoc, "ZXY");
-    if (zxyLoc == NULL) return retVal;
+    (void)hid_exit(); //close the session
+    msv_libOpen = false;
+}
 
-    return atoi(zxyLoc+3);
+char * hidapi_libStr(void)
+{
+    return msv_libStr;
 }
 
 /**
- * Given a ZXYxxx device name, return a bootloader USB PID.
- * This service can remove (path) chars before the first 'ZXY' string.
- * If we fail, return -1
+ * List the Zytronic devices, one per line, as usb_getDeviceList().
+ * Return the count, or a negative error code.
  */
-int16_t zul_getBLPIDByDevS(char const *devName)
+int hidapi_getDeviceList(char *buf, int len)
 {
-    // example devName: .path/to/file/ZXY100...
-    //                  ZXY100-U-OFF-23123
+    HidapiEntry_t   table[HIDAPI_TABLE_LEN];
+    char            result[2002] = "";
+    int             cnt, i;
+
+    if (!msv_libOpen) return -11;
 
-    int16_t retVal = -1;    // failure indication
-    int     devNum = zul_getProdNumFromDevS(devName);
+    cnt = hidapi_scan(table, HIDAPI_TABLE_LEN);
+    if (cnt == 0)
+    {
+        zul_log(0, "No Devices");
+    }
 
-    switch (devNum)
+    for (i = 0; i < cnt; i++)
     {
-        case 100:    retVal = ZXY100_BOOTLDR_ID;  break;
-        case 110:    retVal = ZXY110_BOOTLDR_ID;  break;
-        case 150:    retVal = ZXY150_BOOTLDR_ID;  break;
-        case 200:    retVal = ZXY200_BOOTLDR_ID;  break;
-        case 300:    retVal = ZXY300_BOOTLDR_ID;  break;
+        char newDevice[120];
+
+        /* room is left at the end of the strings for the device name string
+         * and APP/BL marker, which are filled in by zul_getDeviceList() */
+        (void)snprintf(newDevice, 120,
+                     "  %d. VID:%04X PID:%04X Addr=%s NNNNNN MMM\n",
+                        table[i].index, ZYTRONIC_VENDOR_ID,
+                        (uint)(uint16_t)table[i].pid, table[i].addr
+                      );
+        strncat(result, newDevice, 2000);
     }
 
-    return retVal;
+    zul_logf ( 3, " >> Found %d Zytronic HID-API devices\n", cnt);
+
+    strncpy(buf, result, (size_t)len);
+    buf[len] = '\0';
+    return cnt;
 }
 
-/**
- * Given a ZXYxxx device name, return the application USB PID.
- * This service can remove (path) chars before the first 'ZXY' string.
- * If we fail, return -1
- */
-int16_t zul_getAppPIDByDevS (char const *devName)
+int hidapi_devOpen(int index, hidapi_device_t **dev)
 {
-    int16_t retVal = -1;    // failure indication
-    int     devNum = zul_getProdNumFromDevS(devName);
+    HidapiEntry_t entry;
 
-    switch (devNum)
-    {
-        case 100:    retVal = ZXY100_PRODUCT_ID;  break;
-        case 110:    retVal = ZXY110_PRODUCT_ID;  break;
-        case 150:    retVal = ZXY150_PRODUCT_ID;  break;
-        case 200:    retVal = ZXY200_PRODUCT_ID;  break;
-        case 300:    retVal = ZXY300_PRODUCT_ID;  break;
-    }
+    if (dev == NULL) return -20;
+    if (!msv_libOpen) return -11;
+    if (!hidapi_lookup(index, NULL, &entry)) return HA_ERROR_NOT_FOUND;
 
-    return retVal;
+    return hidapi_devPrepare(&entry, dev);
+}
+
+int hidapi_devOpenByAddr(char const *addrStr, hidapi_device_t **dev)
+{
+    HidapiEntry_t entry;
+
+    if ((dev == NULL) || (addrStr == NULL)) return -20;
+    if (!msv_libOpen) return -11;
+    if (!hidapi_lookup(-1, addrStr, &entry)) return HA_ERROR_NOT_FOUND;
+
+    return hidapi_devPrepare(&entry, dev);
 }
 
 /**
- * Open the library, initialising all internal states
- * return zero on success, else a negative error code
+ * Stop the device's input thread, close it and free the handle
  */
-int zul_openLib(void)
+int hidapi_devClose(hidapi_device_t *dev)
 {
-    int retVal = 0;
+    hidapi_device_t **link;
+
+    if (dev == NULL) return -2;
 
-    if (msv_libInitialised)
+    (void)pthread_mutex_lock(&msv_devListMutex);
+    for (link = &msv_openDevices; *link != NULL; link = &(*link)->next)
     {
-        zul_log(0, "Already Initialised\n");
-        return -1;
+        if (*link == dev)
+        {
+            *link = dev->next;
+            break;
+        }
     }
+    (void)pthread_mutex_unlock(&msv_devListMutex);
 
-    memset(msv_DevStrArray, 0, 2000);
-
-    (void)snprintf ( msv_usbLibStr, 40, "HID-API Version Unknown");
-    msv_usbLibStr[40] = '\0';     // force null termination
-
-    retVal = hid_init(); //initialize a hid-api session
-    if(retVal < 0)
+    if (dev->readerRunning)
     {
-        zul_logf (0, "Init Error %d\n", retVal);
-        return -1;  // Failure
+        dev->stopReader = true;
+        (void)pthread_join(dev->reader, NULL);
     }
 
-    msv_libInitialised = true;
-
-    return retVal;
+    if (dev->handle != NULL) hid_close(dev->handle);
+    (void)pthread_mutex_destroy(&dev->ctrlMutex);
+    free(dev);
+    return 0;
 }
 
+bool hidapi_devGetPID(hidapi_device_t *dev, int16_t *pid)
+{
+    if ((dev == NULL) || (pid == NULL)) return false;
+    *pid = dev->pid;
+    return true;
+}
 
-/**
- * provide access to the underlying HID-API version
- */
-char *      zul_usbLibStr(void)
+int hidapi_devGetAddrStr(hidapi_device_t *dev, char *addrStr)
 {
-    return msv_usbLibStr;
+    if ((dev == NULL) || (addrStr == NULL)) return -1;
+    strcpy(addrStr, dev->entry.addr);
+    return SUCCESS;
 }
 
 /**
- * Close library and free any resources
+ * Open the path of another interface of the device.  If it can't be opened,
+ * the current interface remains in use and false is returned.
  */
-void zul_closeLib(void)
+bool hidapi_devSwitchIFace(hidapi_device_t *dev, uint8_t iface)
 {
-    if (!msv_libInitialised) return;
+    hid_device *handle;
 
-    if (msv_device_list != NULL)
-    {
-        hid_free_enumeration(msv_device_list);
-        msv_device_list = NULL;
-    }
+    if (dev == NULL) return false;
+    if (iface == dev->activeInterface) return true;
 
-    // if a device is open - close it
-    if (msv_dev_handle != NULL)
-    {
-        zul_closeDevice();
-    }
+    handle = hidapi_openIFace(&dev->entry, iface);
+    if (handle == NULL) return false;
 
-    hid_exit(); //close the session
+    (void)pthread_mutex_lock(&dev->ctrlMutex);
+    hid_close(dev->handle);
+    dev->handle             = handle;
+    dev->activeInterface    = iface;
+    (void)pthread_mutex_unlock(&dev->ctrlMutex);
 
-    msv_libInitialised = false;
+    return true;
 }
 
-int myComparitor(const void *s1, const void *s2)
+void hidapi_devSetCtrlParams(hidapi_device_t *dev, int delay, int retries, int timeout)
 {
-    return strcmp((const char *)s1, (const char *)s2);
+    if (dev == NULL) return;
+
+    (void)pthread_mutex_lock(&dev->ctrlMutex);
+    dev->ctrlDelay      = (delay   < 0) ? DEF_CTRL_DELAY : delay;
+    dev->ctrlRetry      = (retries < 0) ? DEF_CTRL_RETRY : retries;
+    dev->ctrlTimeout    = (timeout < 0) ? DEF_CTRL_TIMEOUT : (unsigned int)timeout;
+    (void)pthread_mutex_unlock(&dev->ctrlMutex);
 }
 
 /**
- * return a string listing the connected Zytronic Touchscreens, one per line
- * return count is the number of devices
- * negative return values indicate a fault
- *
- * The string is sorted so that the indexing is reliable when devices are
- * neither disconnected nor connected.
+ * Send a request as a feature report and, if reply is not NULL, poll the
+ * feature report for the reply, as hidraw_devControlRequest()
  */
-int zul_getDeviceList(char *buf, int len)
+int hidapi_devControlRequest(hidapi_device_t *dev, uint8_t *request,
+                                    uint16_t reqLen, /*@null@*/ uint8_t *reply)
 {
-    int                     numFound = 0;
-    int                     i = 0;
-    char                    zyDevStrList[DEV_LIST_SZ+1];
+    // HID-API puts the report ID in byte 0; for the bootloader's unnumbered
+    // report this is an extra, zero, byte before the data
+    uint8_t     buf[BUF_LEN + 1];
+    int         skip;
+    int         res;
 
-    struct hid_device_info *cur_dev;
+    if ((dev == NULL) || (dev->handle == NULL))
+    {
+        zul_logf (0, "%s - no device", __FUNCTION__);
+        return HA_ERROR_NO_DEVICE;
+    }
+    if (request == NULL) return -20;
+    if ((reqLen == 0) || (reqLen > BUF_LEN)) return -21;
 
-    memset(msv_DevStrArray, 0, DEV_LIST_SZ);
+    zul_log_hex(4, "  CTRL req : ", request, (int)reqLen);
 
-    zyDevStrList[0] = '\0';
+    skip = (dev->bootloader) ? 1 : 0;
 
-    if (!msv_libInitialised)
-    {
-        zul_logf(0, "Call zul_openLib before %s", __FUNCTION__);
-        return -11;
-    }
+    (void)pthread_mutex_lock(&dev->ctrlMutex);
 
-    // list all connected devices with a Zytronic Vendor ID
-    //ZYTRONIC_VENDOR_ID
-    msv_device_list = hid_enumerate(0x0, 0x0);
+    // always send 64 byte packets, the rest of the packet is zero
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf + skip, request, reqLen);
 
-    if(msv_device_list == NULL)
+    res = hid_send_feature_report(dev->handle, buf, (size_t)(BUF_LEN + skip));
+    if (res < 0)
     {
-        zul_log(0, "Get Device Error, or no devices");
-        return -12;
+        res = HA_ERROR_IO;
+        zul_logf(1, "Control TX error %d", res);
+        zul_log_hex (3, "TXReq:", request, 8 );
     }
-
-    /*  NB: for each call to hid_enumerate, even with no USB conections
-     *      or disconnections, a particular device can move about in
-     *      the list. Therefore, we sort them by PID and SerialNumber
-     *      before returning a list to the users */
-
-    cur_dev = msv_device_list;
-    while (cur_dev && (i < 20))
+    else
     {
-        i++;
-
+        res -= skip;
+        if (reply != NULL)
         {
-            char newDevice[DEV_ENTRY_SZ+1];
+            zul_log(5, "Reply expected");
+            res = hidapi_pollReply(dev, reply, dev->ctrlRetry,
+                                (long int)dev->ctrlRetry * dev->ctrlDelay);
+        }
+    }
 
-            zul_logf(4, " >> Instance:%d. ProductID:%04X SerialNo:%ls",
-                            i, cur_dev->product_id, cur_dev->serial_number );
+    (void)pthread_mutex_unlock(&dev->ctrlMutex);
+    return res;
+}
 
-            if (ZYTRONIC_VENDOR_ID == cur_dev->vendor_id)
-            {
-                (void)snprintf(newDevice, DEV_ENTRY_SZ,
-                            "VID:%04X PID:%04X SN:%-24ls Path:%s",
-                            cur_dev->vendor_id, cur_dev->product_id,
-                            cur_dev->serial_number, cur_dev->path );
+int hidapi_devControlReply(hidapi_device_t *dev, uint8_t *reply)
+{
+    int res;
 
-                newDevice[DEV_ENTRY_SZ] = '\0';
+    if ((dev == NULL) || (dev->handle == NULL)) return HA_ERROR_NO_DEVICE;
+    if (reply == NULL) return -20;
 
-                /* example entry from Apple:
-                "VID:14C8 PID:0005 SN:49FF74064983545624430987 Path:USB_14c8_0005_0x7fe56bd0a4a0"
-                */
+    (void)pthread_mutex_lock(&dev->ctrlMutex);
+    res = hidapi_pollReply(dev, reply, 2, 2L * dev->ctrlDelay);
+    (void)pthread_mutex_unlock(&dev->ctrlMutex);
 
-                memcpy(msv_DevStrArray+100*numFound, newDevice, DEV_ENTRY_SZ);
-                numFound ++;
-            }
-        }
+    return res;
+}
 
-        cur_dev = cur_dev->next;
-    }
+void hidapi_devRegisterHandler(hidapi_device_t *dev, UsbReportID_t ReportID,
+                                    usb_in_handler_t handler, void *context)
+{
+    if (dev == NULL) return;
+    if ((int)ReportID >= MAX_REPORT_ID) return;
 
-    if (i == 20) zul_log( 1, "Too many devices to list");
+    (void)pthread_mutex_lock(&msv_devListMutex);
+    dev->IN_handler[ReportID] = handler;
+    dev->IN_context[ReportID] = context;
+    (void)pthread_mutex_unlock(&msv_devListMutex);
+}
 
-    zul_logf( 3, "%d Devices in list", numFound);
-    qsort(msv_DevStrArray, numFound, DEV_ENTRY_SZ, myComparitor);
-    for (i=0; i<numFound; i++)
-    {
-        char deviceEntry[DEV_ENTRY_SZ+1];
-        snprintf(deviceEntry, DEV_ENTRY_SZ, "%d) %s\n",
-                    i+1, msv_DevStrArray+DEV_ENTRY_SZ*i);
-        zul_log(4, deviceEntry);
-        strncat(zyDevStrList, deviceEntry, (size_t)DEV_LIST_SZ);
-    }
+bool hidapi_devGetInStats(hidapi_device_t *dev, usb_in_stats_t *stats)
+{
+    if ((dev == NULL) || (stats == NULL)) return false;
+    *stats = dev->inStats;
+    return true;
+}
 
-    strncpy(buf, zyDevStrList, (size_t)len);
-    buf[len] = '\0';
 
-    return numFound;
-}
+// ============================================================================
+// --- Private Implementation ---
+// ============================================================================
 
-/**
- * return true if the supplied Product ID is a bootloader device
- */
-bool zul_isBLDevicePID(int16_t pid)
+static int hidapiAddrCompare(const void *a, const void *b)
 {
-    switch (pid)
-    {
-        case ZXY100_BOOTLDR_ID:
-        case ZXY110_BOOTLDR_ID:
-        case ZXY150_BOOTLDR_ID:
-        case ZXY200_BOOTLDR_ID:
-        case ZXY300_BOOTLDR_ID:
-            return true;
-        default:
-            return false;
-    }
+    return strcmp(((HidapiEntry_t const *)a)->addr,
+                  ((HidapiEntry_t const *)b)->addr);
 }
 
 /**
- * return true if the indexed device in the list is a bootloader device
+ * Enumerate the Zytronic HID interfaces, grouped into devices by PID and
+ * serial number, sorted by address so that the indices are stable
  */
-bool zul_isBLDevice(int index, char * list)
+static int hidapi_scan(HidapiEntry_t *table, int maxEntries)
 {
-    char    copy[1001];
-    char   *devToken = copy;
-    int     devIndex;
-    bool    keepGoing = true;
+    struct hid_device_info *list, *cur;
+    int                     cnt = 0;
+    int                     i;
 
-    strncpy(copy, list, 1000);
-    copy[1000] = '\0';
-    do
+    list = hid_enumerate(ZYTRONIC_VENDOR_ID, 0x0);
+
+    for (cur = list; cur != NULL; cur = cur->next)
     {
-        devToken = strtok(devToken, "\n");
-        if (devToken == NULL)
+        HidapiEntry_t  *entry = NULL;
+        char            serial[64] = "";
+        uint8_t         iface = (uint8_t)((cur->interface_number < 0) ?
+                                                0 : cur->interface_number);
+
+        if (cur->serial_number != NULL)
         {
-            keepGoing = false;
-            break;
+            (void)snprintf(serial, sizeof(serial), "%ls", cur->serial_number);
         }
 
-        devIndex = atoi(devToken);
-        if (devIndex == index)
+        for (i = 0; i < cnt; i++)
         {
-            int16_t pid = 0;
-            char *p = strstr(devToken, "PID:");
-            if (p != NULL)
+            if ( (table[i].pid == (int16_t)cur->product_id) &&
+                 (strcmp(table[i].serial, serial) == 0) )
             {
-                pid = (int16_t)strtol((p+4), NULL, 16);
+                entry = &table[i];
+                break;
+            }
+        }
 
-                return zul_isBLDevicePID(pid);
+        if (entry == NULL)
+        {
+            if (cnt >= maxEntries)
+            {
+                zul_log(1, "Too many devices to list");
+                continue;
             }
+            entry = &table[cnt++];
+            memset(entry, 0, sizeof(HidapiEntry_t));
+            entry->pid = (int16_t)cur->product_id;
+            strcpy(entry->serial, serial);
+        }
+
+        if (entry->numPaths < HIDAPI_MAX_IFACE)
+        {
+            entry->iface[entry->numPaths] = iface;
+            strncpy(entry->path[entry->numPaths], cur->path, HIDAPI_PATH_LEN - 1);
+            entry->numPaths++;
         }
-        devToken = NULL;
     }
-    while (keepGoing);
-    return false;
-}
 
-/**
- * if the list contains a particular PID, then return the index
- */
-int zul_selectPIDFromList(int16_t pid, char * list)
-{
-    char    copy[1001];
-    char   *devToken = copy;
-    int     devIndex;
-    int16_t linePid;
-    char   *pidToken;
+    hid_free_enumeration(list);
 
-    strncpy(copy, list, 1000); copy[1000] = '\0';
-    do
+    for (i = 0; i < cnt; i++)
     {
-        devToken = strtok(devToken, "\n");
-        if (devToken == NULL) return -1;
-
-        devIndex = atoi(devToken);
+        // hash the path of the lowest interface
+        int         j, first = 0;
+        uint16_t    crc;
 
-        linePid = 0;
-        pidToken = strstr(devToken, "PID:");
-        if (pidToken != NULL)
+        for (j = 1; j < table[i].numPaths; j++)
         {
-            linePid = (int16_t)strtol((pidToken+4), NULL, 16);
-
-            if (pid == linePid) return devIndex;
+            if (table[i].iface[j] < table[i].iface[first]) first = j;
         }
+        crc = zul_getCRC((uint8_t *)table[i].path[first],
+                                        strlen(table[i].path[first]));
+        (void)snprintf(table[i].addr, sizeof(table[i].addr), "%02X_%02X",
+                            (uint)(crc >> 8), (uint)(crc & 0xff));
+    }
 
-        devToken = NULL;
+    qsort(table, (size_t)cnt, sizeof(HidapiEntry_t), hidapiAddrCompare);
+    for (i = 0; i < cnt; i++)
+    {
+        table[i].index = i;
     }
-    while (true);
-    return -1;
+
+    return cnt;
 }
 
-/**
- * Open a particular device for interactions, based on the indices
- * provided by zul_getDeviceList().
- * Return 0 on success, else a negative error code.
- */
-int zul_openDevice(int index)
+static bool hidapi_lookup(int index, char const *addrStr, HidapiEntry_t *out)
 {
-    char    iPath[100+1];
-
-    if (msv_device_list == NULL) return -1;
+    HidapiEntry_t   table[HIDAPI_TABLE_LEN];
+    int             cnt, i;
 
-    if (!getDevPathByIndex(index, iPath, 100)) return -2;
-    zul_logf(3, "Dev Path: %s", iPath);
-    // ### write test func for the above service  !!  ###
-
-    msv_dev_handle = hid_open_path(iPath);
-
-    if (msv_dev_handle != NULL)
+    cnt = hidapi_scan(table, HIDAPI_TABLE_LEN);
+    for (i = 0; i < cnt; i++)
     {
-        wchar_t reply[255];
-        struct  hid_device_info * iDev;
-
-        msv_device_index = index;
-
-        iDev = getDevInfoByPath(iPath);
-        if (iDev != NULL)
+        if ( ((addrStr != NULL) && (strcmp(table[i].addr, addrStr) == 0)) ||
+             ((addrStr == NULL) && (table[i].index == index)) )
         {
-            msv_device_pid = iDev->product_id;
-            msv_bootloader = zul_isBLDevicePID(msv_device_pid);
-
-            if (0)
-            {
-                zul_logf(4, "Device Handle : %p\n", msv_dev_handle);
-
-                hid_get_manufacturer_string(msv_dev_handle, reply, 255);
-                zul_logf(3, "Device Manufacturer: %ls", reply);
-
-                hid_get_product_string(msv_dev_handle, reply, 255);
-                zul_logf(3, "Device Product: %ls", reply);
-
-                hid_get_serial_number_string(msv_dev_handle, reply, 255);
-                zul_logf(3, "Device SerialNo: %ls", reply);
-            }
-
-            hid_set_nonblocking(msv_dev_handle, 1);
-
-            return 0;
+            *out = table[i];
+            return true;
         }
-
-        hid_close(msv_dev_handle);
-        msv_dev_handle = NULL;
-        msv_device_index = -1;
-
-        return -3;
     }
-    return -4;
+    return false;
 }
 
-/**
- * If a device is open, set the supplied pid and return 1;
- * Else, return 0
- */
-bool zul_getDevicePID(int16_t *pid)
+static bool hidapi_devIsOpen(char const *addr)
 {
-    if (msv_device_pid < 0) return false;
+    hidapi_device_t *dev;
+    bool             found = false;
 
-    *pid = msv_device_pid;
-    return true;
+    (void)pthread_mutex_lock(&msv_devListMutex);
+    for (dev = msv_openDevices; dev != NULL; dev = dev->next)
+    {
+        if (strcmp(dev->entry.addr, addr) == 0)
+        {
+            found = true;
+            break;
+        }
+    }
+    (void)pthread_mutex_unlock(&msv_devListMutex);
+    return found;
 }
 
-/**
- * Close an open device
- */
-int zul_closeDevice(void)
+static hid_device * hidapi_openIFace(HidapiEntry_t const *entry, uint8_t iface)
 {
-    if (msv_device_index == -1) return -1;
-    if (msv_dev_handle == NULL) return -2;
-
-    hid_close(msv_dev_handle);
-
-    msv_device_index = -1;
-    msv_device_pid = -1;
+    int i;
 
-    return 0;
+    for (i = 0; i < entry->numPaths; i++)
+    {
+        if (entry->iface[i] == iface)
+        {
+            zul_logf(3, "Dev Path: %s", entry->path[i]);
+            return hid_open_path(entry->path[i]);
+        }
+    }
+    return NULL;
 }
 
-/*
- * The request of reqLen bytes is sent to the Zytronic USB device, and if
- * the handle_reply pointer-to-function is not null, the supplied function is
- * called to handle the response.
+/**
+ * Open interface 0 of the device, and start its input thread
  */
-#define BUF_LEN                     (64)
-int usb_ControlRequest(uint8_t *request, uint16_t reqLen,
-                                            response_handler_t handle_reply)
+static int hidapi_devPrepare(HidapiEntry_t const *entry, hidapi_device_t **pdev)
 {
-    /*  libUSB data :
-    const uint8_t   txRmReqType     = 0x21;
-    const uint8_t   txBReq          = 0x09;
-
-    const uint8_t   rxRmReqType     = 0xA1;
-    const uint8_t   rxBReq          = 0x01;
-
-    const uint16_t  wIndex          = 0x0000;
-    const uint16_t  wLength         = BUF_LEN;
-    */
-
+    hidapi_device_t *dev;
 
-    // general result var
-    int             res             = 0;
+    if (hidapi_devIsOpen(entry->addr)) return HA_ERROR_BUSY;
 
-    // bootloader or application comms?
-    // uint16_t        wValue          =
-    //            (uint16_t)((msv_bootloader) ? 0x0300 : 0x0305);
+    dev = (hidapi_device_t *)calloc(1, sizeof(hidapi_device_t));
+    if (dev == NULL) return HA_ERROR_NO_MEM;
 
-    // msecs - BL Program DataBlock takes  ~ 2500 mS !
-    // const unsigned  timeout         = 3000;
+    dev->entry          = *entry;
+    dev->pid            = entry->pid;
+    dev->bootloader     = usb_isBLDevicePID(entry->pid);
+    dev->ctrlDelay      = DEF_CTRL_DELAY;
+    dev->ctrlRetry      = DEF_CTRL_RETRY;
+    dev->ctrlTimeout    = DEF_CTRL_TIMEOUT;
+    (void)pthread_mutex_init(&dev->ctrlMutex, NULL);
 
-
-    zul_logf(3, "Device Handle : %p\n", msv_dev_handle);
-    zul_logf(4, "  CTRL req %d bytes", (int)reqLen);
-
-    if (msv_dev_handle == NULL)
+    dev->handle = hidapi_openIFace(entry, 0);
+    if (dev->handle == NULL)
     {
-        zul_logf (0, "%s - no device", __FUNCTION__);
-        return -1;
+        (void)pthread_mutex_destroy(&dev->ctrlMutex);
+        free(dev);
+        return HA_ERROR_IO;
     }
 
-    if (request == NULL)
-        return -20;
-
-    if (reqLen == 0)
-        return -21;
-
+    (void)pthread_mutex_lock(&msv_devListMutex);
+    dev->next       = msv_openDevices;
+    msv_openDevices = dev;
+    (void)pthread_mutex_unlock(&msv_devListMutex);
 
-    zul_log_hex(4, "  CTRL req : ", request, (int)reqLen);
-
-    //res = libusb_control_transfer ( msv_dev_handle,  txRmReqType, txBReq,
-    //        wValue, wIndex,       (unsigned char*)request, reqLen, timeout );
-    res = hid_send_feature_report(msv_dev_handle, request, (size_t)reqLen);
-
-    if (res < 0)
+    dev->readerRunning =
+        (pthread_create(&dev->reader, NULL, hidapi_inputWorker, dev) == 0);
+    if (!dev->readerRunning)
     {
-        zul_logf(1, "CTRL-TX unknown error %d", res);
+        zul_log(1, "HID-API input thread not started");
     }
 
+    *pdev = dev;
+    return 0;
+}
 
-    if (NULL == handle_reply) return res;
-
-    zul_log(3, "Reply expected");
+/**
+ * Fetch the reply feature report, re-polling while it is empty, for at least
+ * retries attempts or budgetMs, but no longer than the ctrlTimeout.  Called
+ * with the ctrlMutex held.
+ */
+static int hidapi_pollReply(hidapi_device_t *dev, uint8_t *reply,
+                                            int retries, long int budgetMs)
+{
+    uint8_t     buf[BUF_LEN + 1];
+    int         skip        = (dev->bootloader) ? 1 : 0;
+    int         res         = 0;
+    int         attempts    = 0;
+    bool        replied     = false;
+    uint64_t    start       = zul_monotonicMs();
+    uint64_t    deadline    = start + (uint64_t)((budgetMs > 0) ? budgetMs : 0);
+    uint64_t    limit       = start + dev->ctrlTimeout;
 
+    do
     {
-        bool validResp = false;
-        int rxTransferAttempts = 100;        // ############# 100 for FW update
+        memset(buf, 0, sizeof(buf));
+        buf[0] = (uint8_t)((dev->bootloader) ? 0 : APP_REPORT_ID);
 
-        // buffer to hold possible replies
-        uint8_t data[BUF_LEN];
-        memset (data, 0, BUF_LEN);
+        res = hid_get_feature_report(dev->handle, buf, (size_t)(BUF_LEN + skip));
+        attempts++;
 
-        while ((!validResp) && (rxTransferAttempts-- > 0))
+        if (res > skip)
         {
-            data[0] = 0x05;
-            (void)usleep(50000);      // ##### TBC - see NACK issue ####
-
-            /* ToDo - there exists a high likelihood that we can accelerate
-             * the comms by better handling the above delay.  CFM April 2016
-             */
-
-            zul_log(4, "  CTRL RX attempt...");
-            res = hid_get_feature_report(msv_dev_handle, data, BUF_LEN);
-
-            if (res > 0)
+            res -= skip;
+            zul_log_hex(4, "  CTRL resp: ", buf + skip, res);
+            if (nonZeroData(buf + skip, res))
             {
-                zul_log_hex(4, "  CTRL resp: ", data, res);
-                if (nonZeroData(data, res))
-                {
-                    (void)handle_reply(data);
-                    validResp = true;
-                }
+                memset(reply, 0, BUF_LEN);
+                memcpy(reply, buf + skip, (size_t)res);
+                replied = true;
+                break;
             }
-
-            if (res < 0)
-            {
-                zul_logf(1, "CTRL-RX unknown error %d", res);
-                // return res;
-
-                /* ToDo consider - wrt normal usage, and FW usage as we do not
-                 * (yet) suport FW transfers with hid-api, should we remove all
-                 * this support to simplify the code?
-                 */
-            }
-
-            // if (res == 0) ... ?
-
         }
-        if (rxTransferAttempts == 0) zul_logf(1, "\n\nControl RX retries failed\n");
+        else if (res < 0)
+        {
+            res = HA_ERROR_IO;
+            zul_logf(1, "Control RX error %d", res);
+        }
+    }
+    while ( ( (attempts < retries) ||
+              (zul_monotonicMs() < deadline) ) &&
+            (zul_monotonicMs() < limit) );
+
+    if (!replied)
+    {
+        zul_logf(1, "\n\nControl RX retries failed\n");
+        if (res >= 0) res = HA_ERROR_TIMEOUT;
     }
 
     return res;
 }
 
-int usb_ControlRequestMR(uint8_t *request, uint16_t reqLen,
-                                response_handler_t handle_reply, int replies)
+/**
+ * Test if data holds non-zero bytes
+ */
+static bool nonZeroData(uint8_t *data, int len)
 {
-    // general result var
-    int res;
-
-    if (replies < 1) return -1;
-
-    res = usb_ControlRequest(request, reqLen, handle_reply);
-
-    if (replies == 1) return res;
-
-    while (--replies>0)
+    int i;
+    for (i = 0; i < len; i++)
     {
-        zul_logf(3, "Multi-Reply expected [%d]", replies);
-
-        {
-            bool validResp = false;
-            int rxTransferAttempts = 2;
-
-            // buffer to hold possible replies
-            uint8_t data[BUF_LEN];
-            memset (data, 0, BUF_LEN);
-
-            while ((!validResp) && (rxTransferAttempts-- > 0))
-            {
-                data[0] = 0x05;
-                (void)usleep(50000);      // ##### TBC - see NACK issue ####
-
-                zul_log(4, "  CTRL M-RX attempt...");
-                res = hid_get_feature_report(msv_dev_handle, data, BUF_LEN);
-
-                if (res > 0)
-                {
-                    zul_log_hex(4, "    CTRL resp: ", data, res);
-                    if (nonZeroData(data, res))
-                    {
-                        (void)handle_reply(data);
-                        validResp = true;
-                    }
-                }
-
-                if (res < 0)
-                {
-                    zul_logf(1, "CTRL-RX unknown error %d", res);
-                    // return res;
-                }
-            }
-            if (rxTransferAttempts == 0) zul_logf(1, "\n\nControl RX retries failed\n");
-        }
-
+        if (data[i] != 0) return true;
     }
-    return res;
-
+    return false;
 }
 
-
 /**
- * Attempt a USB Interrupt transfer to get touch information
+ * Read the input reports of one device, and pass them to its handlers
  */
-int zul_InterruptCheck(interrupt_handler_t data_handler)
+static void *hidapi_inputWorker(void *arg)
 {
-    static uint8_t          data[64];
-    static int              x = 0;
-    int                     res = -1;
+    hidapi_device_t *dev = (hidapi_device_t *)arg;
+    uint8_t          data[BUF_LEN];
 
-    if (msv_dev_handle == NULL)
+    while (!dev->stopReader)
     {
-        zul_logf (0, "%s - no device", __FUNCTION__);
-        return -1;
-    }
+        usb_in_handler_t    handler = NULL;
+        void *              context = NULL;
+        int                 res;
 
-    // using a 10 ms timeout
-    res = hid_read_timeout(msv_dev_handle, data, 64, 10);
+        (void)pthread_mutex_lock(&dev->ctrlMutex);
+        res = hid_read_timeout(dev->handle, data, BUF_LEN, IN_READ_TIMEOUT_MS);
+        (void)pthread_mutex_unlock(&dev->ctrlMutex);
 
-    if (res > 0)
-    {
-        zul_logf(4, "%s Iteration %06x, transferred %d ", __FUNCTION__, x, res);
-        x++;
-        zul_log_hex(4,  "| ", data, res);
-
-        if (data_handler != NULL)
-            data_handler(data);
+        if (res < 0)
+        {
+            dev->inStats.errors++;
+            (void)usleep(IN_READ_TIMEOUT_MS * 1000);
+            continue;
+        }
+        if (res == 0)
+        {
+            // let any waiting control request have the handle
+            (void)sched_yield();
+            continue;
+        }
 
-        return res;
-    }
+        dev->inStats.received++;
+        if (res < BUF_LEN) memset(data + res, 0, (size_t)(BUF_LEN - res));
+        if (data[0] >= MAX_REPORT_ID)
+        {
+            dev->inStats.errors++;
+            continue;
+        }
 
-    if (res < 0)
-    {
-        zul_logf(1, "%s unknown error %d", __FUNCTION__, res);
-    }
+        (void)pthread_mutex_lock(&msv_devListMutex);
+        handler = dev->IN_handler[data[0]];
+        context = dev->IN_context[data[0]];
+        (void)pthread_mutex_unlock(&msv_devListMutex);
 
-    if (res == 0)
-    {
-        zul_logf(4, "%s NO DATA", __FUNCTION__);
+        if (handler == NULL)
+        {
+            zul_log_hex(3, "IntXfr", data, 16);
+            continue;
+        }
+        handler(context, data);
     }
 
-
-    return res;
+    return NULL;
 }
 
 
-
-
 // ============================================================================
-// --- Private Implementation ---
+// --- Transport Operations ---
+//     The HID-API backend of transport.h
 // ============================================================================
 
-
-/**
- * Given an index in the msv_DevStrArray, set the provided path variable
- * and return true.
- * If the index is missing, return false.
- */
-bool getDevPathByIndex (int index, char *path, int len)
+static int tpOpen(int index, void **dev)
 {
-    int listLocation = 1;
-    char *p = msv_DevStrArray;
+    return hidapi_devOpen(index, (hidapi_device_t **)dev);
+}
 
-    while (p[0] != '\0')
-    {
-        if (listLocation == index)
-        {
-            char *loc = strstr(p, "Path:");
-            if (loc != NULL)
-            {
-                strncpy(path, loc+strlen("Path:"), len);
-                path[len-1] = '\0';
-                return true;
-            }
-            else
-            {
-                return false;
-            }
-        }
+static int tpOpenByAddr(char const *addrStr, void **dev)
+{
+    return hidapi_devOpenByAddr(addrStr, (hidapi_device_t **)dev);
+}
 
-        p += DEV_ENTRY_SZ;
-        listLocation ++;
-    }
+static int tpClose(void *dev)
+{
+    return hidapi_devClose((hidapi_device_t *)dev);
+}
 
-    return false;
+static bool tpGetPID(void *dev, int16_t *pid)
+{
+    return hidapi_devGetPID((hidapi_device_t *)dev, pid);
 }
 
+static int tpGetAddrStr(void *dev, char *addrStr)
+{
+    return hidapi_devGetAddrStr((hidapi_device_t *)dev, addrStr);
+}
 
-struct hid_device_info *getDevInfoByPath(char *path)
+static bool tpSwitchIFace(void *dev, uint8_t iface)
 {
-    struct hid_device_info *returnDevice = msv_device_list;
+    return hidapi_devSwitchIFace((hidapi_device_t *)dev, iface);
+}
 
-    while (returnDevice)
-    {
-        if (!strcmp(returnDevice->path, path)) return returnDevice;
+static void tpSetCtrlParams(void *dev, int delay, int retries, int timeout)
+{
+    hidapi_devSetCtrlParams((hidapi_device_t *)dev, delay, retries, timeout);
+}
 
-        returnDevice = returnDevice->next;
-    }
+static int tpControlRequest(void *dev, uint8_t *request, uint16_t reqLen,
+                                                            uint8_t *reply)
+{
+    return hidapi_devControlRequest((hidapi_device_t *)dev, request, reqLen,
+                                                                    reply);
+}
 
-    return NULL;
+static int tpControlReply(void *dev, uint8_t *reply)
+{
+    return hidapi_devControlReply((hidapi_device_t *)dev, reply);
 }
 
+static void tpRegisterHandler(void *dev, UsbReportID_t ReportID,
+                                    usb_in_handler_t handler, void *context)
+{
+    hidapi_devRegisterHandler((hidapi_device_t *)dev, ReportID, handler,
+                                                                context);
+}
 
-/**
- * return true if some of the array is != 0
- */
-bool nonZeroData(uint8_t *data, int len)
+static bool tpGetInStats(void *dev, usb_in_stats_t *stats)
 {
-    int i;
-    for (i=0; i<len; i++)
-    {
-        if (data[i] != 0x00) return true;
-    }
-    return false;
+    return hidapi_devGetInStats((hidapi_device_t *)dev, stats);
 }
 
-#endif // ifdef __APPLE__
+zul_transport_t const hidapi_transport =
+{
+    .name               = "hidapi",
+    .openLib            = hidapi_openLib,
+    .closeLib           = hidapi_closeLib,
+    .libStr             = hidapi_libStr,
+    .getDeviceList      = hidapi_getDeviceList,
+    .devOpen            = tpOpen,
+    .devOpenByAddr      = tpOpenByAddr,
+    .devClose           = tpClose,
+    .devGetPID          = tpGetPID,
+    .devGetAddrStr      = tpGetAddrStr,
+    .devSwitchIFace     = tpSwitchIFace,
+    .devSetCtrlParams   = tpSetCtrlParams,
+    .devControlRequest  = tpControlRequest,
+    .devControlReply    = tpControlReply,
+    .devRegisterHandler = tpRegisterHandler,
+    .devGetInStats      = tpGetInStats,
+};
+
+#endif // defined(__APPLE__) || defined(ZUL_HIDAPI)
@@ -1,5 +1,5 @@
 /*
- *  Copyright (c) 2016 Zytronic Displays Limited. All rights reserved.
+ *  Copyright (c) 2019 Zytronic Displays Limited. All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -22,13 +22,22 @@
 
 
 
+
+
+
 /* Module Overview
    ===============
-   This code should provide the basic communication services required
-   to:
-    - discover Zytronic (USB) products connected to the system
-    - connect/disconnect to/from one of the available devices
-    - manage that device
+   This code provides the "hidapi" transport of transport.h: the device
+   communication services of usb.h through HID-API, for hosts (Apple) where
+   neither libusb nor hidraw is suitable.
+
+   Control requests are carried by the feature report calls of HID-API, and
+   input reports are read by a thread per open device.  Devices are listed
+   in the format of usb_getDeviceList(); as HID-API does not report the bus
+   address, the "BB_AA" address string is a hash of the device path, which
+   is stable while the device remains connected.
+
+   Built on Apple hosts, or elsewhere when ZUL_HIDAPI is defined.
 
     Dependancies:
 
@@ -37,124 +46,68 @@
  */
 
 
-#ifndef _ZY_USB_H
-#define _ZY_USB_H
+#ifndef _ZY_COMMS_H
+#define _ZY_COMMS_H
+
+#include "zytypes.h"
+#include "usb.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#include "zytypes.h"
-
-#define ZYTRONIC_VENDOR_ID          (0x14C8)
-
-#define ZXY100_PRODUCT_ID           (0x0005)
-#define ZXY100_BOOTLDR_ID           (0x000A)
-
-#define ZXY110_PRODUCT_ID           (0x0009)
-#define ZXY110_BOOTLDR_ID           (0x000D)
+// an open HID-API device
+typedef struct hidapi_device hidapi_device_t;
 
-#define ZXY150_PRODUCT_ID           (0x0014)
-#define ZXY150_BOOTLDR_ID           (0x0015)
-
-#define ZXY200_PRODUCT_ID           (0x0006)
-#define ZXY200_BOOTLDR_ID           (0x000B)
-
-#define ZXY300_PRODUCT_ID           (0x0007)
-#define ZXY300_BOOTLDR_ID           (0x000C)
-
-#define ZXY500_PRODUCT_ID           (0x0016)
-#define ZXY500_BOOTLDR_ID           (0x0017)
-
-// pointer to touch data handler
-typedef void(*interrupt_handler_t)(uint8_t *d);
-
-// pointer to control data handler
-typedef int(*response_handler_t)(uint8_t *d);
-
-// periodic call to service USB needs
-// void service_zxy100(interrupt_handler_t th);
 
+int         hidapi_openLib              (void);
+void        hidapi_closeLib             (void);
+char *      hidapi_libStr               (void);
 
 /**
- * Call to initialise the library. Zero returned on success.
- * Returns: USB lib error code on failures
+ * List the Zytronic devices, in the format of usb_getDeviceList().
+ * Return the number of devices, or a negative code.
  */
-int         zul_openLib         (void);
-void        zul_closeLib        (void);
-char *      zul_usbLibStr       (void);
+int         hidapi_getDeviceList        (char *buf, int len);
 
 /**
- * This service lists the available devices on the system
+ * Open a device, based on the indices provided by hidapi_getDeviceList(),
+ * or on the address string.  Return zero and set *dev, else a negative code.
  */
-int         zul_getDeviceList   (char *buf, int len);
+int         hidapi_devOpen              (int index, hidapi_device_t **dev);
+int         hidapi_devOpenByAddr        (char const *addrStr,
+                                            hidapi_device_t **dev);
+int         hidapi_devClose             (hidapi_device_t *dev);
 
-/**
- * return true if the connected device is a bootloader
- */
-bool        zul_isBLDevice      (int index, char * list);
-bool        zul_isBLDevicePID   (int16_t pid);
+bool        hidapi_devGetPID            (hidapi_device_t *dev, int16_t *pid);
+int         hidapi_devGetAddrStr        (hidapi_device_t *dev, char *addrStr);
+bool        hidapi_devSwitchIFace       (hidapi_device_t *dev, uint8_t iface);
+void        hidapi_devSetCtrlParams     (hidapi_device_t *dev, int delay,
+                                            int retries, int timeout);
 
 /**
- * if the list contains a particular PID, then return the index
+ * As usb_devControlRequest() and usb_devControlReply()
  */
-int         zul_selectPIDFromList(int16_t pid, char * list);
+int         hidapi_devControlRequest    (hidapi_device_t *dev,
+                                            uint8_t *request, uint16_t reqLen,
+                                            /*@null@*/ uint8_t *reply);
+int         hidapi_devControlReply      (hidapi_device_t *dev, uint8_t *reply);
 
 /**
- * given a USB Product ID, return a device name string :
- *      ZXY100, ZXY110, ZXY150, ZXY200, ZXY300
-   and vice versa
+ * Register a handler, and its context, for a reportID of a device.  Handlers
+ * are called from the device's input thread.
  */
-char const *zul_getDevStrByPID  (int16_t pid);
-int16_t     zul_getBLPIDByDevS  (char const *devName);
-int16_t     zul_getAppPIDByDevS (char const *devName);
-
-/**
- * Open a particular device, based on the indices provided by zul_getDeviceList()
- * NB: only open one at a time
- */
-int         zul_openDevice      (int index);
-
-/**
- * If a device is open, set the supplied pid and return 1;
- * Else, return 0
- */
-bool        zul_getDevicePID    (int16_t *pid);
-
-/**
- * Close an open device
- */
-int         zul_closeDevice     ();
-
-/**
- * Make a control-request to the connected device
- * Returns the number of bytes sent or on an error a negative code.
- */
-int         zul_ControlRequest  (uint8_t *request, uint16_t reqLen,
-                                 /*@null@*/ response_handler_t handle_reply);
-
-/**
- * Make a control-request to the connected device, which expects more than
- * one control-response from the device.
- * Returns the number of bytes sent or on an error a negative code.
- */
-int         zul_ControlRequestMR(uint8_t *request, uint16_t reqLen,
-                                 /*@null@*/ response_handler_t handle_reply,
-                                 int replyCount);
-
-
-/**
- * Attempt an interrupt transfer to the connected device
- *    ...
- */
-// int         zul_InterruptCheck  (interrupt_handler_t data_handler);
+void        hidapi_devRegisterHandler   (hidapi_device_t *dev,
+                                            UsbReportID_t ReportID,
+                                            /*@null@*/
+                                            usb_in_handler_t handler,
+                                            void *context);
+bool        hidapi_devGetInStats        (hidapi_device_t *dev,
+                                            usb_in_stats_t *stats);
 
 
 #ifdef __cplusplus
 }
 #endif
 
-
-#endif // _ZY_USB_H
-
-
+#endif // _ZY_COMMS_H
@@ -42,6 +42,7 @@
 #include <sys/time.h>
 #include <sys/timeb.h>
 #include <syslog.h>
+#include <time.h>
 
 #include "zytypes.h"
 #include "debug.h"
@@ -143,6 +144,26 @@ long int zul_getLongTS(void)
                                nowTtimeMs.millitm );
 }
 
+/**
+ * milliseconds from an arbitrary start, unaffected by wall clock changes
+ */
+uint64_t zul_monotonicMs(void)
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)(ts.tv_nsec / 1000000);
+}
+
+/**
+ * microseconds from an arbitrary start, unaffected by wall clock changes
+ */
+uint64_t zul_monotonicUs(void)
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)(ts.tv_nsec / 1000);
+}
+
 /*
  * get a timestamp as a string
  */
@@ -213,17 +234,17 @@ void zul_log_hex(int level, const char *header, uint8_t *d, int len)
  */
 void zul_logf(int level, const char *format, ...)
 {
-    static char buffer[201];
+    char    buffer[201];    // on the stack: zul_logf() is called from several threads
     va_list ap;
 
-    va_start(ap, format);
-
     if (level > msv_log_level) return;
+
+    va_start(ap, format);
     (void)vsnprintf(buffer, 200, format, ap);
+    va_end(ap);
+
     buffer[200]='\0';
     zul_log(level, buffer);
-
-    va_end(ap);
 }
 
 
@@ -254,7 +275,7 @@ char const * zul_hex2String(uint8_t *d, int len)
     const int   bytes_per_line = 16;
     int         i;
     char        buffer[101];
-    static char retBuf[400];
+    static __thread char retBuf[400];   // one per thread
 
     retBuf[0]='\0';
 
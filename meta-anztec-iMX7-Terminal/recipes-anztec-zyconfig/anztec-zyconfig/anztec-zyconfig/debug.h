@@ -4,6 +4,7 @@
    to:
     - print hex strings
     - print timestamped events
+    - read the monotonic clock, for intervals and deadlines
     - log to files
  */
 
@@ -32,6 +33,12 @@ long int        zul_getLongTS           (void);
 
 void            zul_getStringTS         (char *string, size_t length);
 
+/**
+ * time from an arbitrary start, unaffected by wall clock changes
+ */
+uint64_t        zul_monotonicMs         (void);
+uint64_t        zul_monotonicUs         (void);
+
 
 /**
  * General logging services
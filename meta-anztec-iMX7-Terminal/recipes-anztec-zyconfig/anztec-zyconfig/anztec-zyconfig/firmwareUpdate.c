@@ -263,8 +263,8 @@ int main (int argCount, char **argStrings)
         printf("Device is already in bootloader mode [HW:%s PID:%04X] \n\t %s\n",
                 hwID, bootDevicePID, g_zyfFile);
 
+        // the device stays attached, so it can be re-opened without delay
         zul_closeDevice();
-        zy_msleep(BL_RESET_DELAY_MS);
 
         reconnect = zul_checkZYFmatchesHW(hwID, g_zyfFile);
     }
@@ -335,11 +335,15 @@ int main (int argCount, char **argStrings)
 
         if (reboot2BL)
         {
+            char appAddr[7] = "";
+
             printf("Restart to BL ... \n");
+            (void)zul_getAddrStr(appAddr);
             zul_StartBootLoader();
             zul_closeDevice();
-            // allow the device time to reboot and re-connect to the OS
-            zy_msleep(BL_RESET_DELAY_MS);
+            // wait for the application device to leave the bus; the
+            // bootloader device is awaited below
+            (void)zul_waitForDeviceLeft(appAddr, BL_RESET_DELAY_MS);
         }
         else
         {
@@ -350,20 +354,15 @@ int main (int argCount, char **argStrings)
         }
 
         // now, we should be in Bootloader Mode !   Reconnect
-        int findDevLoopCount = 20;
-        numDevs = zul_getDeviceList(tempBuffer, TEMP_BUF_LEN);
-
-        while (findDevLoopCount-- > 0)
+        // returns as soon as the BL device is enumerated by the OS
+        printf("Waiting for BL device ...\n");
+        if (SUCCESS != zul_waitForDevice(bootDevicePID, 5 * BL_RESET_DELAY_MS, NULL))
         {
-            numDevs = zul_getDeviceList(tempBuffer, TEMP_BUF_LEN);
-
-            g_deviceIndex = zul_selectPIDFromList(bootDevicePID, tempBuffer);
-            if (g_deviceIndex >= 0) break;
-
-            printf("Waiting for BL device %c\n", zul_spinner());
-            zul_CursorUp(1);
-            zy_msleep(BL_RESET_DELAY_MS/4);
+            printf("BL device [PID:%04X] did not appear\n", bootDevicePID);
         }
+
+        numDevs = zul_getDeviceList(tempBuffer, TEMP_BUF_LEN);
+        g_deviceIndex = zul_selectPIDFromList(bootDevicePID, tempBuffer);
         printf("\n");
 
         if (numDevs > 0)
@@ -0,0 +1,1200 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* For a module overview, see the header file
+ */
+
+
+#ifdef __linux__
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <linux/hidraw.h>
+
+#include "dbg2console.h"
+#include "hidraw.h"
+#include "transport.h"
+#include "debug.h"
+
+#define BUF_LEN                     (64)
+#define HIDRAW_SYSFS_DIR            "/sys/class/hidraw"
+#define HIDRAW_DEV_DIR              "/dev"
+
+// the Zytronic protocol uses feature report 5 (ZCC) in the application, and
+// the unnumbered report in the bootloader
+#define APP_REPORT_ID               (0x05)
+
+#define     DEF_CTRL_DELAY          (5)
+#define     DEF_CTRL_RETRY          (10)
+#define     DEF_CTRL_TIMEOUT        (1000)
+
+// error codes, as returned by the libusb backend
+#define     HR_ERROR_IO             (-1)
+#define     HR_ERROR_NO_DEVICE      (-4)
+#define     HR_ERROR_BUSY           (-6)
+#define     HR_ERROR_TIMEOUT        (-7)
+#define     HR_ERROR_PIPE           (-9)
+#define     HR_ERROR_NO_MEM         (-11)
+
+/**
+ * The hidraw nodes of one Zytronic device, one per HID interface
+ */
+#define HIDRAW_TABLE_LEN            (16)
+#define HIDRAW_MAX_IFACE            (4)
+
+typedef struct
+{
+    int                         index;
+    char                        addr[7];        // "BB_AA" - values in HEX
+    int16_t                     pid;
+    int                         numNodes;
+    uint8_t                     iface[HIDRAW_MAX_IFACE];
+    int                         minor[HIDRAW_MAX_IFACE];    // /dev/hidrawN
+} HidrawEntry_t;
+
+struct hidraw_device
+{
+    /*@null@*/
+    struct hidraw_device *      next;           // list of open devices
+    int                         fd;
+    HidrawEntry_t               entry;
+    int16_t                     pid;
+    uint8_t                     activeInterface;
+    bool                        bootloader;
+
+    // control request parameters, and serialisation of feature reports
+    int                         ctrlDelay;
+    int                         ctrlRetry;
+    unsigned int                ctrlTimeout;
+    pthread_mutex_t             ctrlMutex;
+
+    // input report service
+    usb_in_handler_t            IN_handler[MAX_REPORT_ID];
+    void *                      IN_context[MAX_REPORT_ID];
+    usb_in_stats_t              inStats;
+    bool                        inWatched;      // fd is in msv_epollFd
+    bool                        inBusy;         // being serviced, unlocked
+};
+
+//
+// --- Module Global Variables ---
+//
+
+static bool                     msv_libOpen             = false;
+
+/*@null@*/
+static hidraw_device_t *        msv_openDevices         = NULL;
+static pthread_mutex_t          msv_devListMutex        = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t           msv_inputIdle           = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Input thread - epoll set of the open device fds, and an eventfd to wake
+ * the thread for shutdown.  msv_externalEvents => the host application calls
+ * hidraw_devHandleInput() instead. */
+static int                      msv_epollFd             = -1;
+static int                      msv_wakeFd              = -1;
+static pthread_t                msv_inputThread;
+static bool                     msv_inputThreadRunning  = false;
+static volatile bool            msv_stopInput           = false;
+static bool                     msv_externalEvents      = false;
+
+
+//
+// --- Private Prototypes ---
+//
+
+static int      hidraw_scan             (HidrawEntry_t *table, int maxEntries);
+static bool     hidraw_readNode         (int minor, HidrawEntry_t *out);
+static bool     hidraw_readSysAttr      (char const *dir, char const *attr,
+                                         char *value, int len);
+static bool     hidraw_lookup           (int index, char const *addrStr,
+                                         HidrawEntry_t *out);
+static int      hidraw_devPrepare       (HidrawEntry_t const *entry,
+                                         hidraw_device_t **pdev);
+static int      hidraw_openNode         (hidraw_device_t *dev, uint8_t iface);
+static void     hidraw_watch            (hidraw_device_t *dev, bool watch);
+static bool     hidraw_awaitIdle        (hidraw_device_t *dev);
+static bool     hidraw_devIsOpen        (char const *addr);
+static int      hidraw_errnoToError     (int err);
+static int      hidraw_pollReply        (hidraw_device_t *dev, uint8_t *reply,
+                                            int retries, long int budgetMs);
+static bool     nonZeroData             (uint8_t *data, int len);
+
+static void     hidraw_startInputThread (void);
+static void     hidraw_stopInputThread  (void);
+static void *   hidraw_inputWorker      (void *arg);
+
+
+// ============================================================================
+// --- Public Implementation ---
+// ============================================================================
+
+/**
+ * Open the backend, creating the input epoll set.
+ * return zero on success, else a negative error code
+ */
+int hidraw_openLib(void)
+{
+    struct epoll_event  ev;
+
+    if (msv_libOpen) return 0;
+
+    msv_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    msv_wakeFd  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((msv_epollFd < 0) || (msv_wakeFd < 0))
+    {
+        zul_logf (0, "ERROR @ %s %d %s", __FUNCTION__, __LINE__, strerror(errno));
+        hidraw_closeLib();
+        return -1;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = EPOLLIN;
+    ev.data.ptr = NULL;                 // NULL => the wake eventfd
+    if (epoll_ctl(msv_epollFd, EPOLL_CTL_ADD, msv_wakeFd, &ev) != 0)
+    {
+        zul_logf (0, "ERROR @ %s %d %s", __FUNCTION__, __LINE__, strerror(errno));
+        hidraw_closeLib();
+        return -1;
+    }
+
+    msv_libOpen = true;
+    return 0;
+}
+
+/**
+ * Close any open devices, and free the backend's resources
+ */
+void hidraw_closeLib(void)
+{
+    while (msv_openDevices != NULL)
+    {
+        (void)hidraw_devClose(msv_openDevices);
+    }
+
+    hidraw_stopInputThread();
+
+    if (msv_wakeFd >= 0)
+    {
+        (void)close(msv_wakeFd);
+        msv_wakeFd = -1;
+    }
+    if (msv_epollFd >= 0)
+    {
+        (void)close(msv_epollFd);
+        msv_epollFd = -1;
+    }
+    msv_libOpen = false;
+}
+
+/**
+ * List the Zytronic devices with hidraw nodes, one per line, as
+ * usb_getDeviceList().  Return the count, or a negative error code.
+ */
+int hidraw_getDeviceList(char *buf, int len)
+{
+    HidrawEntry_t   table[HIDRAW_TABLE_LEN];
+    char            result[2002] = "";
+    int             cnt, i;
+
+    if (!msv_libOpen) return -11;
+    if ((buf == NULL) || (len < 1)) return -1;
+
+    cnt = hidraw_scan(table, HIDRAW_TABLE_LEN);
+    if (cnt < 0)
+    {
+        zul_log(0, "Get Device Error");
+        return -12;
+    }
+
+    if (cnt == 0)
+    {
+        zul_log(0, "No Devices");
+    }
+
+    for (i = 0; i < cnt; i++)
+    {
+        char newDevice[120];
+
+        /* room is left at the end of the strings for the device name string
+         * and APP/BL marker, which are filled in by zul_getDeviceList() */
+        (void)snprintf(newDevice, 120,
+                     "  %d. VID:%04X PID:%04X Addr=%s NNNNNN MMM\n",
+                        table[i].index, ZYTRONIC_VENDOR_ID,
+                        (uint)(uint16_t)table[i].pid, table[i].addr
+                      );
+        strncat(result, newDevice, 2000);
+    }
+
+    zul_logf ( 3, " >> Found %d Zytronic hidraw devices\n", cnt);
+
+    strncpy(buf, result, (size_t)len - 1);
+    buf[len - 1] = '\0';
+    return cnt;
+}
+
+/**
+ * Open a device by its index in the device list
+ */
+int hidraw_devOpen(int index, hidraw_device_t **dev)
+{
+    HidrawEntry_t   entry;
+
+    if (dev == NULL) return -20;
+    if (!msv_libOpen) return -11;
+
+    if (!hidraw_lookup(index, NULL, &entry))
+    {
+        zul_logf ( 3, "Device index %d not found\n", index);
+        return -2;
+    }
+    return hidraw_devPrepare(&entry, dev);
+}
+
+/**
+ * Open a device by its bus address string
+ */
+int hidraw_devOpenByAddr(char const *addrStr, hidraw_device_t **dev)
+{
+    HidrawEntry_t   entry;
+
+    if ((dev == NULL) || (addrStr == NULL)) return -20;
+    if (!msv_libOpen) return -11;
+
+    if (!hidraw_lookup(-1, addrStr, &entry))
+    {
+        zul_logf ( 3, "Device %s not found\n", addrStr);
+        return -2;
+    }
+    return hidraw_devPrepare(&entry, dev);
+}
+
+/**
+ * Close a device.  The kernel HID driver was never detached, so there is
+ * nothing to re-attach and no settling delay.
+ */
+int hidraw_devClose(hidraw_device_t *dev)
+{
+    hidraw_device_t   **link;
+
+    if (dev == NULL) return -1;
+
+    (void)pthread_mutex_lock(&msv_devListMutex);
+    if (!hidraw_awaitIdle(dev))
+    {
+        (void)pthread_mutex_unlock(&msv_devListMutex);
+        zul_logf(1, "%s %s - from its own IN handler", __FUNCTION__,
+                                                        dev->entry.addr);
+        return HR_ERROR_BUSY;
+    }
+    hidraw_watch(dev, false);
+    for (link = &msv_openDevices; *link != NULL; link = &(*link)->next)
+    {
+        if (*link == dev)
+        {
+            *link = dev->next;
+            break;
+        }
+    }
+    (void)pthread_mutex_unlock(&msv_devListMutex);
+
+    (void)pthread_mutex_lock(&dev->ctrlMutex);
+    if (dev->fd >= 0)
+    {
+        (void)close(dev->fd);
+        dev->fd = -1;
+    }
+    (void)pthread_mutex_unlock(&dev->ctrlMutex);
+
+    zul_logf(3, "%s %s", __FUNCTION__, dev->entry.addr);
+    (void)pthread_mutex_destroy(&dev->ctrlMutex);
+    free(dev);
+    return 0;
+}
+
+bool hidraw_devGetPID(hidraw_device_t *dev, int16_t *pid)
+{
+    if ((dev == NULL) || (pid == NULL)) return false;
+
+    *pid = dev->pid;
+    return true;
+}
+
+int hidraw_devGetAddrStr(hidraw_device_t *dev, char *addrStr)
+{
+    if (dev == NULL) return -1;
+    if (addrStr == NULL) return -2;
+
+    memcpy(addrStr, dev->entry.addr, 7);
+    return SUCCESS;
+}
+
+/**
+ * Move to the hidraw node of another interface of the same device
+ */
+bool hidraw_devSwitchIFace(hidraw_device_t *dev, uint8_t iface)
+{
+    bool    ok;
+
+    if (dev == NULL) return false;
+    if (iface == dev->activeInterface) return true;
+
+    (void)pthread_mutex_lock(&msv_devListMutex);
+    if (!hidraw_awaitIdle(dev))
+    {
+        (void)pthread_mutex_unlock(&msv_devListMutex);
+        return false;
+    }
+    hidraw_watch(dev, false);
+    (void)pthread_mutex_lock(&dev->ctrlMutex);
+    ok = (hidraw_openNode(dev, iface) == 0);
+    (void)pthread_mutex_unlock(&dev->ctrlMutex);
+    hidraw_watch(dev, true);
+    (void)pthread_mutex_unlock(&msv_devListMutex);
+
+    return ok;
+}
+
+void hidraw_devSetCtrlParams(hidraw_device_t *dev, int delay, int retries, int timeout)
+{
+    if (dev == NULL) return;
+
+    dev->ctrlDelay   = (delay   < 0) ? DEF_CTRL_DELAY   : delay;
+    dev->ctrlRetry   = (retries < 0) ? DEF_CTRL_RETRY   : retries;
+    dev->ctrlTimeout = (timeout < 0) ? DEF_CTRL_TIMEOUT : (unsigned int)timeout;
+
+    zul_logf (4, "%s %s - %d(ms) %d Retries %u(ms)", __FUNCTION__,
+                dev->entry.addr, dev->ctrlDelay, dev->ctrlRetry, dev->ctrlTimeout);
+}
+
+/**
+ * Send the request as a feature report, and poll the feature report for a
+ * non-empty reply.  As with the libusb backend, polling continues while
+ * fewer than ctrlRetry replies have been seen, or until (ctrlRetry *
+ * ctrlDelay) ms have passed, but is abandoned after ctrlTimeout ms.  The
+ * kernel applies its own timeout to each transfer.
+ */
+int hidraw_devControlRequest(hidraw_device_t *dev, uint8_t *request,
+                                    uint16_t reqLen, /*@null@*/ uint8_t *reply)
+{
+    // the kernel puts the report ID in byte 0; for the bootloader's
+    // unnumbered report this is an extra, zero, byte before the data
+    uint8_t     buf[BUF_LEN + 1];
+    int         skip;
+    int         xfrLen;
+    int         res;
+
+    if ((dev == NULL) || (dev->fd < 0))
+    {
+        zul_logf (0, "%s - no device", __FUNCTION__);
+        return HR_ERROR_NO_DEVICE;
+    }
+    if (request == NULL) return -20;
+    if ((reqLen == 0) || (reqLen > BUF_LEN)) return -21;
+
+    zul_log_hex(4, "  CTRL req : ", request, (int)reqLen);
+
+    skip    = (dev->bootloader) ? 1 : 0;
+    xfrLen  = BUF_LEN + skip;
+
+    (void)pthread_mutex_lock(&dev->ctrlMutex);
+
+    // always send 64 byte packets, the rest of the packet is zero
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf + skip, request, reqLen);
+
+    res = ioctl(dev->fd, HIDIOCSFEATURE(xfrLen), buf);
+    if (res < 0)
+    {
+        res = hidraw_errnoToError(errno);
+        zul_logf(1, "Control TX error %d", res);
+        zul_log_hex (3, "TXReq:", request, 8 );
+        goto exit;
+    }
+    res -= skip;
+
+    if (reply == NULL) goto exit;
+
+    zul_log(5, "Reply expected");
+    res = hidraw_pollReply(dev, reply, dev->ctrlRetry,
+                            (long int)dev->ctrlRetry * dev->ctrlDelay);
+
+exit:
+    (void)pthread_mutex_unlock(&dev->ctrlMutex);
+    return res;
+}
+
+/**
+ * Poll for a further reply to the last request, without sending a request.
+ * [ZXY100 get single raw data]  Briefly retried, as usb_devControlReply().
+ */
+int hidraw_devControlReply(hidraw_device_t *dev, uint8_t *reply)
+{
+    int res;
+
+    if ((dev == NULL) || (dev->fd < 0)) return HR_ERROR_NO_DEVICE;
+    if (reply == NULL) return -20;
+
+    (void)pthread_mutex_lock(&dev->ctrlMutex);
+    res = hidraw_pollReply(dev, reply, 2, 2L * dev->ctrlDelay);
+    (void)pthread_mutex_unlock(&dev->ctrlMutex);
+
+    return res;
+}
+
+void hidraw_devRegisterHandler(hidraw_device_t *dev, UsbReportID_t ReportID,
+                                    usb_in_handler_t handler, void *context)
+{
+    if (dev == NULL) return;
+    if ((int)ReportID >= MAX_REPORT_ID) return;
+
+    (void)pthread_mutex_lock(&msv_devListMutex);
+    dev->IN_handler[ReportID] = handler;
+    dev->IN_context[ReportID] = context;
+    (void)pthread_mutex_unlock(&msv_devListMutex);
+}
+
+bool hidraw_devGetInStats(hidraw_device_t *dev, usb_in_stats_t *stats)
+{
+    if ((dev == NULL) || (stats == NULL)) return false;
+
+    *stats = dev->inStats;
+    return true;
+}
+
+void hidraw_useExternalEventLoop(bool external)
+{
+    bool    anyOpen;
+
+    msv_externalEvents = external;
+    if (external)
+    {
+        hidraw_stopInputThread();
+        return;
+    }
+
+    (void)pthread_mutex_lock(&msv_devListMutex);
+    anyOpen = (msv_openDevices != NULL);
+    (void)pthread_mutex_unlock(&msv_devListMutex);
+
+    if (anyOpen) hidraw_startInputThread();
+}
+
+int hidraw_devGetFd(hidraw_device_t *dev)
+{
+    return (dev == NULL) ? -1 : dev->fd;
+}
+
+/**
+ * Read each pending input report, and pass it to the handler registered for
+ * its report ID.  Reports are zero padded to 64 bytes.  The handler is
+ * called without any lock held, so it may register handlers, or issue
+ * control requests.
+ */
+int hidraw_devHandleInput(hidraw_device_t *dev)
+{
+    uint8_t     data[BUF_LEN];
+    int         count = 0;
+
+    if ((dev == NULL) || (dev->fd < 0)) return HR_ERROR_NO_DEVICE;
+
+    while (true)
+    {
+        ssize_t             n;
+        uint8_t             id;
+        usb_in_handler_t    handler = NULL;
+        void               *context = NULL;
+
+        memset(data, 0, BUF_LEN);
+        n = read(dev->fd, data, BUF_LEN);
+        if (n < 0)
+        {
+            if ((errno == EAGAIN) || (errno == EINTR)) break;
+
+            dev->inStats.errors++;
+            zul_logf(1, "%s %s - %s", __FUNCTION__, dev->entry.addr, strerror(errno));
+            return hidraw_errnoToError(errno);
+        }
+        if (n == 0) break;
+
+        dev->inStats.received++;
+        count++;
+
+        id = data[0];
+        if (id < MAX_REPORT_ID)
+        {
+            (void)pthread_mutex_lock(&msv_devListMutex);
+            handler = dev->IN_handler[id];
+            context = dev->IN_context[id];
+            (void)pthread_mutex_unlock(&msv_devListMutex);
+        }
+
+        if (handler != NULL)
+        {
+            handler(context, data);
+        }
+        else
+        {
+            if (id >= MAX_REPORT_ID) dev->inStats.errors++;
+            zul_log_hex(4, "IN: ", data, (int)n);
+        }
+    }
+    return count;
+}
+
+
+// ============================================================================
+// --- Private Implementation ---
+// ============================================================================
+
+/**
+ * Read one sysfs attribute, stripping the trailing newline
+ */
+static bool hidraw_readSysAttr(char const *dir, char const *attr,
+                                                        char *value, int len)
+{
+    char    path[PATH_MAX];
+    FILE   *f;
+    bool    ok = false;
+
+    (void)snprintf(path, sizeof(path), "%s/%s", dir, attr);
+    f = fopen(path, "r");
+    if (f == NULL) return false;
+
+    if (fgets(value, len, f) != NULL)
+    {
+        value[strcspn(value, "\n")] = '\0';
+        ok = true;
+    }
+    (void)fclose(f);
+    return ok;
+}
+
+/**
+ * Describe /dev/hidraw<minor>, if it is a Zytronic device.  The HID device
+ * directory sits below the USB interface, which sits below the USB device.
+ */
+static bool hidraw_readNode(int minor, HidrawEntry_t *out)
+{
+    char            link[PATH_MAX + sizeof("/uevent")];
+    char            hidDir[PATH_MAX];
+    char            line[128];
+    char           *cut;
+    unsigned int    bus = 0, vid = 0, pid = 0;
+    unsigned int    usbBus = 0, usbDev = 0, iface = 0;
+    FILE           *f;
+    bool            found = false;
+
+    (void)snprintf(link, sizeof(link), HIDRAW_SYSFS_DIR "/hidraw%d/device", minor);
+    if (realpath(link, hidDir) == NULL) return false;
+
+    (void)snprintf(link, sizeof(link), "%s/uevent", hidDir);
+    f = fopen(link, "r");
+    if (f == NULL) return false;
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        if (sscanf(line, "HID_ID=%x:%x:%x", &bus, &vid, &pid) == 3)
+        {
+            found = true;
+            break;
+        }
+    }
+    (void)fclose(f);
+
+    if (!found || (vid != ZYTRONIC_VENDOR_ID)) return false;
+
+    memset(out, 0, sizeof(HidrawEntry_t));
+    out->pid        = (int16_t)pid;
+    out->numNodes   = 1;
+    out->minor[0]   = minor;
+
+    // interface directory, then USB device directory
+    cut = strrchr(hidDir, '/');
+    if (cut != NULL) *cut = '\0';
+    if (hidraw_readSysAttr(hidDir, "bInterfaceNumber", line, sizeof(line)))
+    {
+        (void)sscanf(line, "%x", &iface);
+    }
+    cut = strrchr(hidDir, '/');
+    if (cut != NULL) *cut = '\0';
+
+    if ( hidraw_readSysAttr(hidDir, "busnum", line, sizeof(line)) &&
+         (sscanf(line, "%u", &usbBus) == 1) &&
+         hidraw_readSysAttr(hidDir, "devnum", line, sizeof(line)) &&
+         (sscanf(line, "%u", &usbDev) == 1) )
+    {
+        snprintf(out->addr, 7, "%02X_%02X", usbBus & 0xFF, usbDev & 0xFF);
+    }
+    else
+    {
+        // no USB parent (eg /dev/uhid) - bus 00 is never a USB bus
+        snprintf(out->addr, 7, "00_%02X", (unsigned)minor & 0xFF);
+        iface = 0;
+    }
+    out->iface[0] = (uint8_t)iface;
+
+    zul_logf(4, "hidraw%d PID:%04X Addr=%s IFace:%u", minor, pid, out->addr, iface);
+    return true;
+}
+
+static int hidrawAddrCompare(const void *a, const void *b)
+{
+    return strcmp(((HidrawEntry_t const *)a)->addr,
+                  ((HidrawEntry_t const *)b)->addr);
+}
+
+/**
+ * Fill the table with the Zytronic devices, merging the nodes of each
+ * device's interfaces.  The table is sorted by address, so indices are
+ * stable while devices are neither connected nor disconnected.
+ */
+static int hidraw_scan(HidrawEntry_t *table, int maxEntries)
+{
+    DIR            *dir;
+    struct dirent  *de;
+    int             count = 0;
+    int             i;
+
+    dir = opendir(HIDRAW_SYSFS_DIR);
+    if (dir == NULL)
+    {
+        zul_logf(1, "%s - %s", HIDRAW_SYSFS_DIR, strerror(errno));
+        return (errno == ENOENT) ? 0 : -1;
+    }
+
+    while ((de = readdir(dir)) != NULL)
+    {
+        HidrawEntry_t   node;
+        int             minor;
+
+        if (sscanf(de->d_name, "hidraw%d", &minor) != 1) continue;
+        if (!hidraw_readNode(minor, &node)) continue;
+
+        for (i = 0; i < count; i++)
+        {
+            if (0 == strcmp(table[i].addr, node.addr)) break;
+        }
+
+        if (i < count)
+        {
+            if (table[i].numNodes < HIDRAW_MAX_IFACE)
+            {
+                table[i].iface[table[i].numNodes] = node.iface[0];
+                table[i].minor[table[i].numNodes] = node.minor[0];
+                table[i].numNodes++;
+            }
+        }
+        else if (count < maxEntries)
+        {
+            table[count++] = node;
+        }
+    }
+    (void)closedir(dir);
+
+    qsort(table, (size_t)count, sizeof(HidrawEntry_t), hidrawAddrCompare);
+    for (i = 0; i < count; i++)
+    {
+        table[i].index = i;
+    }
+    return count;
+}
+
+/**
+ * Find a device by list index, or (if addrStr is not NULL) by address
+ */
+static bool hidraw_lookup(int index, char const *addrStr, HidrawEntry_t *out)
+{
+    HidrawEntry_t   table[HIDRAW_TABLE_LEN];
+    int             cnt, i;
+
+    cnt = hidraw_scan(table, HIDRAW_TABLE_LEN);
+    for (i = 0; i < cnt; i++)
+    {
+        if ( ((addrStr != NULL) && (0 == strcmp(table[i].addr, addrStr))) ||
+             ((addrStr == NULL) && (table[i].index == index)) )
+        {
+            *out = table[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool hidraw_devIsOpen(char const *addr)
+{
+    hidraw_device_t    *dev;
+    bool                open = false;
+
+    (void)pthread_mutex_lock(&msv_devListMutex);
+    for (dev = msv_openDevices; dev != NULL; dev = dev->next)
+    {
+        if (0 == strcmp(dev->entry.addr, addr))
+        {
+            open = true;
+            break;
+        }
+    }
+    (void)pthread_mutex_unlock(&msv_devListMutex);
+    return open;
+}
+
+/**
+ * Open the node of the requested interface, replacing any open node
+ */
+static int hidraw_openNode(hidraw_device_t *dev, uint8_t iface)
+{
+    char    path[64];
+    int     i, fd;
+
+    for (i = 0; i < dev->entry.numNodes; i++)
+    {
+        if (dev->entry.iface[i] == iface) break;
+    }
+    if (i >= dev->entry.numNodes)
+    {
+        zul_logf(1, "%s - interface %d not available", dev->entry.addr, iface);
+        return -22;
+    }
+
+    (void)snprintf(path, sizeof(path), HIDRAW_DEV_DIR "/hidraw%d", dev->entry.minor[i]);
+    fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    {
+        zul_logf(0, "%s - %s", path, strerror(errno));
+        return (errno == EACCES) ? -23 : -4;
+    }
+
+    if (dev->fd >= 0)
+    {
+        (void)close(dev->fd);
+    }
+    dev->fd              = fd;
+    dev->activeInterface = iface;
+    zul_logf(3, "%s opened, interface %d", path, iface);
+    return 0;
+}
+
+/**
+ * Allocate, open and list a device.  Interface 0 is used if it has a node,
+ * else the first interface found.
+ */
+static int hidraw_devPrepare(HidrawEntry_t const *entry, hidraw_device_t **pdev)
+{
+    hidraw_device_t    *dev;
+    uint8_t             iface = entry->iface[0];
+    int                 i, res;
+
+    if (entry->pid <= USB32C_PRODUCT_ID)
+    {
+        zul_logf ( 0, " Device is too old for this library!\n");
+        return -5;
+    }
+
+    if (hidraw_devIsOpen(entry->addr))
+    {
+        return -1;                  // busy !! one connection per device
+    }
+
+    dev = (hidraw_device_t *)calloc(1, sizeof(hidraw_device_t));
+    if (dev == NULL) return -4;
+
+    dev->fd          = -1;
+    dev->entry       = *entry;
+    dev->pid         = entry->pid;
+    dev->bootloader  = usb_isBLDevicePID(entry->pid);
+    dev->ctrlDelay   = DEF_CTRL_DELAY;
+    dev->ctrlRetry   = DEF_CTRL_RETRY;
+    dev->ctrlTimeout = DEF_CTRL_TIMEOUT;
+    (void)pthread_mutex_init(&dev->ctrlMutex, NULL);
+
+    for (i = 0; i < entry->numNodes; i++)
+    {
+        if (entry->iface[i] == 0) iface = 0;
+    }
+
+    res = hidraw_openNode(dev, iface);
+    if (res != 0)
+    {
+        (void)pthread_mutex_destroy(&dev->ctrlMutex);
+        free(dev);
+        return res;
+    }
+
+    (void)pthread_mutex_lock(&msv_devListMutex);
+    dev->next       = msv_openDevices;
+    msv_openDevices = dev;
+    hidraw_watch(dev, true);
+    (void)pthread_mutex_unlock(&msv_devListMutex);
+
+    hidraw_startInputThread();
+
+    zul_logf(3, "Opened hidraw device %s PID:%04X BL:%d",
+                            dev->entry.addr, (uint)(uint16_t)dev->pid, dev->bootloader);
+    *pdev = dev;
+    return 0;
+}
+
+/**
+ * Add or remove the device fd from the input epoll set.  Call with
+ * msv_devListMutex held, so the input thread is not using the device.
+ */
+static void hidraw_watch(hidraw_device_t *dev, bool watch)
+{
+    struct epoll_event  ev;
+
+    if ((msv_epollFd < 0) || (dev->fd < 0)) return;
+    if (watch == dev->inWatched) return;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = EPOLLIN;
+    ev.data.ptr = dev;
+
+    if (epoll_ctl(msv_epollFd, (watch) ? EPOLL_CTL_ADD : EPOLL_CTL_DEL,
+                                                        dev->fd, &ev) != 0)
+    {
+        zul_logf (0, "ERROR @ %s %d %s", __FUNCTION__, __LINE__, strerror(errno));
+        return;
+    }
+    dev->inWatched = watch;
+}
+
+/**
+ * Wait until the input thread is not servicing the device.  Call with
+ * msv_devListMutex held.  Return false if called from the input thread while
+ * it services the device, i.e. from one of the device's IN handlers.
+ */
+static bool hidraw_awaitIdle(hidraw_device_t *dev)
+{
+    if ( dev->inBusy && msv_inputThreadRunning &&
+         pthread_equal(pthread_self(), msv_inputThread) )
+    {
+        return false;
+    }
+    while (dev->inBusy)
+    {
+        (void)pthread_cond_wait(&msv_inputIdle, &msv_devListMutex);
+    }
+    return true;
+}
+
+static int hidraw_errnoToError(int err)
+{
+    switch (err)
+    {
+        case ENODEV:
+        case ENXIO:
+        case ESHUTDOWN:     return HR_ERROR_NO_DEVICE;
+        case ETIMEDOUT:     return HR_ERROR_TIMEOUT;
+        case EPIPE:         return HR_ERROR_PIPE;
+        case EBUSY:         return HR_ERROR_BUSY;
+        case ENOMEM:        return HR_ERROR_NO_MEM;
+        default:            return HR_ERROR_IO;
+    }
+}
+
+/**
+ * Fetch the reply feature report, re-polling while it is empty, for at least
+ * retries attempts or budgetMs, but no longer than the ctrlTimeout.  Called
+ * with the ctrlMutex held.
+ */
+static int hidraw_pollReply(hidraw_device_t *dev, uint8_t *reply,
+                                            int retries, long int budgetMs)
+{
+    uint8_t     buf[BUF_LEN + 1];
+    int         skip        = (dev->bootloader) ? 1 : 0;
+    int         xfrLen      = BUF_LEN + skip;
+    int         res         = 0;
+    int         attempts    = 0;
+    bool        replied     = false;
+    uint64_t    start       = zul_monotonicMs();
+    uint64_t    deadline    = start + (uint64_t)((budgetMs > 0) ? budgetMs : 0);
+    uint64_t    limit       = start + dev->ctrlTimeout;
+
+    do
+    {
+        memset(buf, 0, sizeof(buf));
+        buf[0] = (uint8_t)((dev->bootloader) ? 0 : APP_REPORT_ID);
+
+        res = ioctl(dev->fd, HIDIOCGFEATURE(xfrLen), buf);
+        attempts++;
+
+        if (res > skip)
+        {
+            res -= skip;
+            zul_log_hex(4, "  CTRL resp: ", buf + skip, res);
+            if (nonZeroData(buf + skip, res))
+            {
+                memset(reply, 0, BUF_LEN);
+                memcpy(reply, buf + skip, (size_t)res);
+                replied = true;
+                break;
+            }
+        }
+        else if (res < 0)
+        {
+            int err = errno;
+            res = hidraw_errnoToError(err);
+            zul_logf(1, "Control RX error %d", res);
+            if ((err != ETIMEDOUT) && (err != EAGAIN) && (err != EPIPE) &&
+                (err != EBUSY) && (err != EINTR))
+            {
+                break;                  // no point in continuing
+            }
+        }
+    }
+    while ( ( (attempts < retries) ||
+              (zul_monotonicMs() < deadline) ) &&
+            (zul_monotonicMs() < limit) );
+
+    if (!replied)
+    {
+        zul_logf(1, "\n\nControl RX retries failed\n");
+        if (res >= 0) res = HR_ERROR_TIMEOUT;
+    }
+
+    return res;
+}
+
+/**
+ * return true if some of the array is != 0
+ */
+static bool nonZeroData(uint8_t *data, int len)
+{
+    int i;
+    for (i=0; i<len; i++)
+    {
+        if (data[i] != 0x00) return true;
+    }
+    return false;
+}
+
+// ----------------------------------------------------------------------------
+// --- Input Thread ---
+// ----------------------------------------------------------------------------
+
+static void hidraw_startInputThread(void)
+{
+    (void)pthread_mutex_lock(&msv_devListMutex);
+    if (!msv_externalEvents && !msv_inputThreadRunning && (msv_epollFd >= 0))
+    {
+        msv_stopInput = false;
+        errno = pthread_create(&msv_inputThread, NULL, hidraw_inputWorker, NULL);
+        if (errno)
+        {
+            zul_logf(1, "ERROR: from pthread_create() is %s\n", strerror(errno));
+            perror("Create hidraw Input Thread");
+            exit(-1);
+        }
+        msv_inputThreadRunning = true;
+        zul_log_ts ( 3, "hidraw_inputWorker is running");
+    }
+    (void)pthread_mutex_unlock(&msv_devListMutex);
+}
+
+static void hidraw_stopInputThread(void)
+{
+    uint64_t    one = 1;
+
+    if (!msv_inputThreadRunning) return;
+
+    msv_stopInput = true;
+    if (write(msv_wakeFd, &one, sizeof(one)) != sizeof(one))
+    {
+        zul_logf(0, "ERROR @ %s %d %s", __FUNCTION__, __LINE__, strerror(errno));
+    }
+    (void)pthread_join(msv_inputThread, NULL);
+    msv_inputThreadRunning = false;
+}
+
+/**
+ * Sleep until a device has input, and dispatch it.  A device is marked busy
+ * while it is serviced, with the device list lock released, so handlers are
+ * not called with it held; closing the device waits until it is idle.
+ */
+static void *hidraw_inputWorker(void *arg)
+{
+    struct epoll_event  ev[8];
+    int                 n, i;
+    bool                gone;
+
+    (void)arg;
+    while (!msv_stopInput)
+    {
+        n = epoll_wait(msv_epollFd, ev, 8, -1);
+        if ((n < 0) && (errno != EINTR))
+        {
+            zul_logf (0, "ERROR @ %s %d %s", __FUNCTION__, __LINE__, strerror(errno));
+            break;
+        }
+        if (msv_stopInput) break;
+
+        (void)pthread_mutex_lock(&msv_devListMutex);
+        for (i = 0; i < n; i++)
+        {
+            hidraw_device_t *dev = (hidraw_device_t *)ev[i].data.ptr;
+            hidraw_device_t *open;
+
+            // the device may have been closed since epoll_wait() returned
+            for (open = msv_openDevices; open != NULL; open = open->next)
+            {
+                if (open == dev) break;
+            }
+            if ((open == NULL) || !dev->inWatched) continue;
+
+            gone = ((ev[i].events & (EPOLLERR | EPOLLHUP)) != 0);
+            if (!gone)
+            {
+                dev->inBusy = true;
+                (void)pthread_mutex_unlock(&msv_devListMutex);
+
+                gone = (hidraw_devHandleInput(dev) == HR_ERROR_NO_DEVICE);
+
+                (void)pthread_mutex_lock(&msv_devListMutex);
+                dev->inBusy = false;
+                (void)pthread_cond_broadcast(&msv_inputIdle);
+            }
+            if (gone)
+            {
+                zul_logf(1, "hidraw device %s has gone", dev->entry.addr);
+                hidraw_watch(dev, false);
+            }
+        }
+        (void)pthread_mutex_unlock(&msv_devListMutex);
+    }
+    zul_log(3, "hidraw Input Worker - Terminating");
+
+    pthread_exit(NULL);
+}
+
+
+// ============================================================================
+// --- Transport Operations ---
+//     The hidraw backend of transport.h
+// ============================================================================
+
+static char * hidraw_libStr(void)
+{
+    static char str[] = "Linux hidraw";
+    return str;
+}
+
+static int tpOpen(int index, void **dev)
+{
+    return hidraw_devOpen(index, (hidraw_device_t **)dev);
+}
+
+static int tpOpenByAddr(char const *addrStr, void **dev)
+{
+    return hidraw_devOpenByAddr(addrStr, (hidraw_device_t **)dev);
+}
+
+static int tpClose(void *dev)
+{
+    return hidraw_devClose((hidraw_device_t *)dev);
+}
+
+static bool tpGetPID(void *dev, int16_t *pid)
+{
+    return hidraw_devGetPID((hidraw_device_t *)dev, pid);
+}
+
+static int tpGetAddrStr(void *dev, char *addrStr)
+{
+    return hidraw_devGetAddrStr((hidraw_device_t *)dev, addrStr);
+}
+
+static bool tpSwitchIFace(void *dev, uint8_t iface)
+{
+    return hidraw_devSwitchIFace((hidraw_device_t *)dev, iface);
+}
+
+static void tpSetCtrlParams(void *dev, int delay, int retries, int timeout)
+{
+    hidraw_devSetCtrlParams((hidraw_device_t *)dev, delay, retries, timeout);
+}
+
+static int tpControlRequest(void *dev, uint8_t *request, uint16_t reqLen,
+                                                            uint8_t *reply)
+{
+    return hidraw_devControlRequest((hidraw_device_t *)dev, request, reqLen,
+                                                                    reply);
+}
+
+static int tpControlReply(void *dev, uint8_t *reply)
+{
+    return hidraw_devControlReply((hidraw_device_t *)dev, reply);
+}
+
+static void tpRegisterHandler(void *dev, UsbReportID_t ReportID,
+                                    usb_in_handler_t handler, void *context)
+{
+    hidraw_devRegisterHandler((hidraw_device_t *)dev, ReportID, handler,
+                                                                context);
+}
+
+static bool tpGetInStats(void *dev, usb_in_stats_t *stats)
+{
+    return hidraw_devGetInStats((hidraw_device_t *)dev, stats);
+}
+
+// hidraw nodes come and go with their devices, so arrival is polled for
+zul_transport_t const hidraw_transport =
+{
+    .name               = "hidraw",
+    .openLib            = hidraw_openLib,
+    .closeLib           = hidraw_closeLib,
+    .libStr             = hidraw_libStr,
+    .getDeviceList      = hidraw_getDeviceList,
+    .devOpen            = tpOpen,
+    .devOpenByAddr      = tpOpenByAddr,
+    .devClose           = tpClose,
+    .devGetPID          = tpGetPID,
+    .devGetAddrStr      = tpGetAddrStr,
+    .devSwitchIFace     = tpSwitchIFace,
+    .devSetCtrlParams   = tpSetCtrlParams,
+    .devControlRequest  = tpControlRequest,
+    .devControlReply    = tpControlReply,
+    .devRegisterHandler = tpRegisterHandler,
+    .devGetInStats      = tpGetInStats,
+};
+
+#endif // ifdef __linux__
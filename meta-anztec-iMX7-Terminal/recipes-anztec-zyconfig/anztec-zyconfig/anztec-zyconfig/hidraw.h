@@ -0,0 +1,150 @@
+/*
+ *  Copyright (c) 2019 Zytronic Displays Limited. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact Zytronic, you can do so either via the
+ * website <www.zytronic.co.uk> or by paper mail:
+ * Zytronic, Whiteley Road, Blaydon on Tyne, Tyne & Wear, NE21 5NJ, UK
+ */
+
+
+
+/* Module Overview
+   ===============
+   This code provides the device communication services of usb.h through the
+   Linux hidraw driver (/dev/hidrawN), rather than through libusb.
+
+   The kernel HID driver stays bound to the device, so touch input to the OS
+   continues while the device is managed or raw data is captured:
+    - control requests are carried by HIDIOCSFEATURE / HIDIOCGFEATURE on the
+      same feature reports as the libusb SET_REPORT / GET_REPORT requests
+    - input reports are read from the non-blocking hidraw node, which the
+      kernel feeds with a copy of every report sent to the HID driver
+
+   Devices are found through sysfs, and are given the same "BB_AA" bus
+   address string as the libusb backend.  A HID device with no USB parent,
+   such as one created through /dev/uhid, is listed with bus number 00 and
+   its hidraw minor as the address, so a uhid stand-in may be used in place
+   of a controller.
+
+   Dependancies:
+
+        Linux kernel hidraw support (CONFIG_HIDRAW)
+
+ */
+
+#ifndef _ZY_HIDRAW_H
+#define _ZY_HIDRAW_H
+
+#include "zytypes.h"
+#include "usb.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// an open hidraw device
+typedef struct hidraw_device hidraw_device_t;
+
+
+/**
+ * Call to initialise the backend. Zero returned on success, else a
+ * negative error code.
+ */
+int         hidraw_openLib              (void);
+void        hidraw_closeLib             (void);
+
+/**
+ * List the Zytronic devices that have hidraw nodes, in the format of
+ * usb_getDeviceList(), into buf of len bytes, including the terminator.
+ * Return the number of devices, or a negative code.
+ */
+int         hidraw_getDeviceList        (char *buf, int len);
+
+/**
+ * Open a device, based on the indices provided by hidraw_getDeviceList(),
+ * or on the supplied bus address string.  The hidraw node of interface 0
+ * is used.  Return zero and set *dev on success, else a negative error code.
+ */
+int         hidraw_devOpen              (int index, hidraw_device_t **dev);
+int         hidraw_devOpenByAddr        (char const *addrStr,
+                                            hidraw_device_t **dev);
+int         hidraw_devClose             (hidraw_device_t *dev);
+
+bool        hidraw_devGetPID            (hidraw_device_t *dev, int16_t *pid);
+int         hidraw_devGetAddrStr        (hidraw_device_t *dev, char *addrStr);
+
+/**
+ * Use the hidraw node of another interface of the device, if it has one.
+ * Return true => SUCCESS else failed (interface not available)
+ */
+bool        hidraw_devSwitchIFace       (hidraw_device_t *dev, uint8_t iface);
+
+/**
+ * Set the control comms delay (ms), retry count and timeout (ms) of one
+ * device, as usb_devSetCtrlParams().  A negative value selects the default.
+ */
+void        hidraw_devSetCtrlParams     (hidraw_device_t *dev, int delay,
+                                            int retries, int timeout);
+
+/**
+ * Make a control request, waiting for completion.  If reply is not NULL, a
+ * reply is expected and the USB_PACKET_LEN bytes received are copied to it.
+ * Returns the number of bytes transferred or, on an error, a negative code.
+ */
+int         hidraw_devControlRequest    (hidraw_device_t *dev,
+                                            uint8_t *request, uint16_t reqLen,
+                                            /*@null@*/ uint8_t *reply);
+/**
+ * Fetch a further reply to the last request, as usb_devControlReply()
+ */
+int         hidraw_devControlReply      (hidraw_device_t *dev, uint8_t *reply);
+
+/**
+ * Register a handler, and its context, for a reportID of a device.  Handlers
+ * are called from the hidraw input thread, or from hidraw_devHandleInput(),
+ * with no lock held.  A handler must not close its device, or switch its
+ * interface; those calls fail (the busy error code, or false) if it does.
+ */
+void        hidraw_devRegisterHandler   (hidraw_device_t *dev,
+                                            UsbReportID_t ReportID,
+                                            /*@null@*/
+                                            usb_in_handler_t handler,
+                                            void *context);
+
+bool        hidraw_devGetInStats        (hidraw_device_t *dev,
+                                            usb_in_stats_t *stats);
+
+/**
+ * Input reports are read by a thread of the backend, by default.  Instead,
+ * the host application may watch hidraw_devGetFd() in its own loop and call
+ * hidraw_devHandleInput() when it is readable.  Call before opening devices.
+ */
+void        hidraw_useExternalEventLoop (bool external);
+int         hidraw_devGetFd             (hidraw_device_t *dev);
+
+/**
+ * Read and dispatch the input reports pending on a device, without blocking.
+ * Return the number of reports handled, or a negative error code.
+ */
+int         hidraw_devHandleInput       (hidraw_device_t *dev);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ZY_HIDRAW_H
@@ -0,0 +1,403 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* This program tests the hidraw backend, see hidraw.h, against a stand-in
+ * controller created through /dev/uhid.  The stand-in answers each feature
+ * report request with an empty report, then with the request echoed, and
+ * sends input reports on request.  It needs the uhid and hidraw kernel
+ * drivers, and access to /dev/uhid (usually root).
+ *
+ * Exit status: 0 passed, 1 failed, 77 skipped (no /dev/uhid).
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+
+#include "zytypes.h"
+#include "debug.h"
+#include "usb.h"
+#include "hidraw.h"
+
+#include <linux/input.h>
+#include <linux/uhid.h>
+
+#define UHID_PATH           "/dev/uhid"
+#define TEST_PID            ZXY300_PRODUCT_ID
+#define REPORT_LEN          (64)
+#define NUM_IN_REPORTS      (20)
+#define WAIT_MS             (2000)
+
+#define SKIPPED             (77)
+
+// vendor page; feature report CONFIGURATION, input report RAW_DATA, 63 bytes each
+static uint8_t const g_reportDesc[] =
+{
+    0x06, 0x00, 0xFF,           // Usage Page (Vendor 0xFF00)
+    0x09, 0x01,                 // Usage (1)
+    0xA1, 0x01,                 // Collection (Application)
+    0x15, 0x00,                 //   Logical Minimum (0)
+    0x26, 0xFF, 0x00,           //   Logical Maximum (255)
+    0x75, 0x08,                 //   Report Size (8)
+    0x95, REPORT_LEN - 1,       //   Report Count (63)
+    0x85, CONFIGURATION,        //   Report ID
+    0x09, 0x02,                 //   Usage (2)
+    0xB1, 0x02,                 //   Feature (Data,Var,Abs)
+    0x85, RAW_DATA,             //   Report ID
+    0x09, 0x03,                 //   Usage (3)
+    0x81, 0x02,                 //   Input (Data,Var,Abs)
+    0xC0                        // End Collection
+};
+
+int                 g_uhidFd        = -1;
+pthread_t           g_uhidThread;
+volatile bool       g_stop          = false;
+int                 g_failures      = 0;
+
+// stand-in device state, owned by the uhid thread
+uint8_t             g_lastRequest[REPORT_LEN];
+bool                g_requested     = false;
+bool                g_answer        = false;    // the next GET_REPORT replies
+volatile bool       g_silent        = false;    // never reply
+int                 g_setReports    = 0;
+int                 g_getReports    = 0;
+
+// input reports seen by the handler
+int                 g_inCount       = 0;
+int                 g_inBad         = 0;
+pthread_mutex_t     g_inMutex       = PTHREAD_MUTEX_INITIALIZER;
+
+
+// ----------------------------------------------------------------------------
+
+void check(bool ok, char const *what)
+{
+    printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+    if (!ok) g_failures++;
+}
+
+void fillInReport(uint8_t *data, int n)
+{
+    int i;
+
+    data[0] = RAW_DATA;
+    for (i = 1; i < REPORT_LEN; i++)
+    {
+        data[i] = (uint8_t)(n * 7 + i);
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+bool uhidWrite(struct uhid_event *ev)
+{
+    ssize_t n = write(g_uhidFd, ev, sizeof(*ev));
+    if (n != (ssize_t)sizeof(*ev))
+    {
+        fprintf(stderr, "uhid write failed: %s\n", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool uhidCreate(void)
+{
+    struct uhid_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_CREATE2;
+    strcpy((char *)ev.u.create2.name, "Zytronic uhid test controller");
+    memcpy(ev.u.create2.rd_data, g_reportDesc, sizeof(g_reportDesc));
+    ev.u.create2.rd_size    = sizeof(g_reportDesc);
+    ev.u.create2.bus        = BUS_USB;
+    ev.u.create2.vendor     = ZYTRONIC_VENDOR_ID;
+    ev.u.create2.product    = TEST_PID;
+    return uhidWrite(&ev);
+}
+
+bool uhidSendInput(uint8_t const *data)
+{
+    struct uhid_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_INPUT2;
+    ev.u.input2.size = REPORT_LEN;
+    memcpy(ev.u.input2.data, data, REPORT_LEN);
+    return uhidWrite(&ev);
+}
+
+/**
+ * The stand-in controller: store each request, and answer the first poll
+ * after it with an all-zero report, so the backend must poll again.
+ */
+void *uhidWorker(void *arg)
+{
+    struct uhid_event   ev, reply;
+    struct pollfd       pfd;
+
+    (void)arg;
+    pfd.fd      = g_uhidFd;
+    pfd.events  = POLLIN;
+
+    while (!g_stop)
+    {
+        if (poll(&pfd, 1, 100) <= 0) continue;
+        if (read(g_uhidFd, &ev, sizeof(ev)) <= 0) continue;
+
+        memset(&reply, 0, sizeof(reply));
+        switch (ev.type)
+        {
+            case UHID_SET_REPORT:
+                g_setReports++;
+                memset(g_lastRequest, 0, REPORT_LEN);
+                memcpy(g_lastRequest, ev.u.set_report.data,
+                        (ev.u.set_report.size < REPORT_LEN) ? ev.u.set_report.size : REPORT_LEN);
+                g_requested = true;
+                g_answer    = false;
+
+                reply.type = UHID_SET_REPORT_REPLY;
+                reply.u.set_report_reply.id  = ev.u.set_report.id;
+                reply.u.set_report_reply.err = 0;
+                (void)uhidWrite(&reply);
+                break;
+
+            case UHID_GET_REPORT:
+                g_getReports++;
+                reply.type = UHID_GET_REPORT_REPLY;
+                reply.u.get_report_reply.id   = ev.u.get_report.id;
+                reply.u.get_report_reply.err  = 0;
+                reply.u.get_report_reply.size = REPORT_LEN;
+                if (g_requested && g_answer && !g_silent)
+                {
+                    // the request, with the second byte marked as a reply
+                    reply.u.get_report_reply.data[0] = ev.u.get_report.rnum;
+                    memcpy(reply.u.get_report_reply.data + 1, g_lastRequest + 1, REPORT_LEN - 1);
+                    reply.u.get_report_reply.data[1] |= 0x80;
+                    g_requested = false;
+                }
+                g_answer = g_requested;
+                (void)uhidWrite(&reply);
+                break;
+
+            default:
+                break;
+        }
+    }
+    return NULL;
+}
+
+// ----------------------------------------------------------------------------
+
+void inHandler(void *context, uint8_t *data)
+{
+    uint8_t expect[REPORT_LEN];
+
+    (void)context;
+    (void)pthread_mutex_lock(&g_inMutex);
+    fillInReport(expect, g_inCount);
+    if (memcmp(expect, data, REPORT_LEN) != 0) g_inBad++;
+    g_inCount++;
+    (void)pthread_mutex_unlock(&g_inMutex);
+}
+
+/**
+ * Find the stand-in in the device list; its address has bus number 00
+ */
+int findStandIn(void)
+{
+    char    list[2001];
+    char   *line;
+    int     index;
+    unsigned int pid;
+
+    if (hidraw_getDeviceList(list, 2000) <= 0) return -1;
+
+    for (line = strtok(list, "\n"); line != NULL; line = strtok(NULL, "\n"))
+    {
+        if ( (sscanf(line, " %d. VID:%*x PID:%x", &index, &pid) == 2) &&
+             (pid == TEST_PID) && (strstr(line, "Addr=00_") != NULL) )
+        {
+            return index;
+        }
+    }
+    return -1;
+}
+
+void cleanup(void)
+{
+    struct uhid_event ev;
+
+    hidraw_closeLib();
+    if (g_uhidFd >= 0)
+    {
+        g_stop = true;
+        (void)pthread_join(g_uhidThread, NULL);
+
+        memset(&ev, 0, sizeof(ev));
+        ev.type = UHID_DESTROY;
+        (void)uhidWrite(&ev);
+        (void)close(g_uhidFd);
+        g_uhidFd = -1;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    hidraw_device_t    *dev = NULL;
+    hidraw_device_t    *dev2 = NULL;
+    uint8_t             request[REPORT_LEN];
+    uint8_t             reply[REPORT_LEN];
+    uint8_t             data[REPORT_LEN];
+    usb_in_stats_t      stats;
+    int16_t             pid = 0;
+    char                addr[7];
+    uint64_t            deadline;
+    int                 index = -1;
+    int                 res, i;
+
+    if (argc > 1) zul_setLogLevel(atoi(argv[1]));
+
+    g_uhidFd = open(UHID_PATH, O_RDWR | O_CLOEXEC);
+    if (g_uhidFd < 0)
+    {
+        printf("SKIP: %s - %s\n", UHID_PATH, strerror(errno));
+        return SKIPPED;
+    }
+    if (atexit(cleanup) != 0)
+    {
+        fprintf(stderr, "cannot set exit function\n");
+        return 1;
+    }
+    if (!uhidCreate()) return 1;
+    if (pthread_create(&g_uhidThread, NULL, uhidWorker, NULL) != 0)
+    {
+        (void)close(g_uhidFd);
+        g_uhidFd = -1;
+        return 1;
+    }
+
+    check(hidraw_openLib() == 0, "open backend");
+
+    // the hidraw node, and its /dev entry, appear shortly after creation
+    deadline = zul_monotonicMs() + WAIT_MS;
+    do
+    {
+        index = findStandIn();
+        if (index >= 0)
+        {
+            res = hidraw_devOpen(index, &dev);
+            if (res == 0) break;
+        }
+        (void)usleep(20 * 1000);
+    }
+    while (zul_monotonicMs() < deadline);
+
+    check(dev != NULL, "list and open the uhid device");
+    if (dev == NULL) return 1;
+
+    check(hidraw_devGetPID(dev, &pid) && (pid == TEST_PID), "product ID");
+    check((hidraw_devGetAddrStr(dev, addr) == SUCCESS) &&
+                            (strncmp(addr, "00_", 3) == 0), "bus 00 address");
+    check(hidraw_devOpen(index, &dev2) != 0, "second open refused");
+
+    // a request with no reply
+    memset(request, 0, sizeof(request));
+    request[0] = CONFIGURATION;
+    request[1] = 0x11;
+    request[2] = 0x22;
+    res = hidraw_devControlRequest(dev, request, 8, NULL);
+    check(res == REPORT_LEN, "control request, no reply");
+
+    // a request whose reply needs a second poll
+    request[1] = 0x33;
+    memset(reply, 0, sizeof(reply));
+    res = hidraw_devControlRequest(dev, request, 8, reply);
+    check( (res == REPORT_LEN) && (reply[0] == CONFIGURATION) &&
+           (reply[1] == (0x33 | 0x80)) && (reply[2] == 0x22),
+           "control request, reply after an empty poll");
+    check(g_getReports >= 2, "empty reply polled again");
+
+    // no reply at all: the poll gives up within the timeout
+    hidraw_devSetCtrlParams(dev, 1, 3, 200);
+    g_silent = true;
+    request[1] = 0x44;
+    deadline = zul_monotonicMs();
+    res = hidraw_devControlRequest(dev, request, 8, reply);
+    check((res < 0) && (zul_monotonicMs() - deadline < 1000), "no reply times out");
+    check(hidraw_devControlReply(dev, reply) < 0, "no further reply");
+    g_silent = false;
+    hidraw_devSetCtrlParams(dev, -1, -1, -1);
+
+    // input reports, through the backend's input thread
+    hidraw_devRegisterHandler(dev, RAW_DATA, inHandler, NULL);
+    for (i = 0; i < NUM_IN_REPORTS; i++)
+    {
+        fillInReport(data, i);
+        if (!uhidSendInput(data)) break;
+    }
+    deadline = zul_monotonicMs() + WAIT_MS;
+    while ((g_inCount < NUM_IN_REPORTS) && (zul_monotonicMs() < deadline))
+    {
+        (void)usleep(10 * 1000);
+    }
+    (void)pthread_mutex_lock(&g_inMutex);
+    check((g_inCount == NUM_IN_REPORTS) && (g_inBad == 0), "input reports dispatched in order");
+    (void)pthread_mutex_unlock(&g_inMutex);
+    check(hidraw_devGetInStats(dev, &stats) && (stats.received >= NUM_IN_REPORTS),
+                                                        "input statistics");
+
+    // input reports, through the host's own event loop
+    hidraw_useExternalEventLoop(true);
+    g_inCount = 0;
+    for (i = 0; i < NUM_IN_REPORTS; i++)
+    {
+        fillInReport(data, i);
+        if (!uhidSendInput(data)) break;
+    }
+    deadline = zul_monotonicMs() + WAIT_MS;
+    while ((g_inCount < NUM_IN_REPORTS) && (zul_monotonicMs() < deadline))
+    {
+        struct pollfd pfd = { hidraw_devGetFd(dev), POLLIN, 0 };
+        if (poll(&pfd, 1, 50) > 0) (void)hidraw_devHandleInput(dev);
+    }
+    check((g_inCount == NUM_IN_REPORTS) && (g_inBad == 0), "input reports from an external loop");
+    hidraw_useExternalEventLoop(false);
+
+    check(hidraw_devClose(dev) == 0, "close");
+
+    printf("%s, %d failure(s)\n", (g_failures == 0) ? "PASSED" : "FAILED", g_failures);
+    return (g_failures == 0) ? 0 : 1;
+}
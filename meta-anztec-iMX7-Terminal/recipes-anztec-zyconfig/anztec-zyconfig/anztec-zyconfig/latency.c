@@ -0,0 +1,85 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* For a module overview, see the header file
+ */
+
+#include <string.h>
+
+#include "latency.h"
+
+
+// ============================================================================
+// --- Public Services ---
+// ============================================================================
+
+void lat_clear(lat_hist_t *lat)
+{
+    memset(lat, 0, sizeof(*lat));
+}
+
+void lat_add(lat_hist_t *lat, uint64_t us)
+{
+    uint32_t    v = (us > UINT32_MAX) ? UINT32_MAX : (uint32_t)us;
+    int         b;
+
+    lat->count++;
+    lat->lastUs   = v;
+    lat->totalUs += v;
+    if ((lat->count == 1) || (v < lat->minUs)) lat->minUs = v;
+    if (v > lat->maxUs) lat->maxUs = v;
+
+    for (b = 0; (b < LAT_BUCKETS - 1) && (v >= (2u << b)); b++);
+    lat->hist[b]++;
+}
+
+uint32_t lat_percentile(lat_hist_t const *lat, int percent)
+{
+    uint32_t    total = 0, want;
+    int         i;
+
+    if ((lat == NULL) || (percent < 0)) return 0;
+    if (percent > 100) percent = 100;
+
+    for (i = 0; i < LAT_BUCKETS; i++) total += lat->hist[i];
+    if (total == 0) return 0;
+
+    // the upper bound of the bucket holding the wanted sample, within the
+    // observed range
+    want = (uint32_t)(((uint64_t)total * (uint32_t)percent + 99u) / 100u);
+    if (want == 0) want = 1;
+    for (i = 0; i < LAT_BUCKETS - 1; i++)
+    {
+        if (lat->hist[i] >= want) break;
+        want -= lat->hist[i];
+    }
+    if (i == LAT_BUCKETS - 1) return lat->maxUs;
+    return ((2u << i) - 1u < lat->maxUs) ? (2u << i) - 1u : lat->maxUs;
+}
@@ -0,0 +1,83 @@
+/*
+ *  Copyright (c) 2019 Zytronic Displays Limited. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact Zytronic, you can do so either via the
+ * website <www.zytronic.co.uk> or by paper mail:
+ * Zytronic, Whiteley Road, Blaydon on Tyne, Tyne & Wear, NE21 5NJ, UK
+ */
+
+
+
+/* Module Overview
+   ===============
+   This code keeps a histogram of latencies, in microseconds, with the count,
+   minimum, mean and maximum, and estimates percentiles from it.  The buckets
+   are powers of two, so a sample is added in a few instructions and no
+   memory is allocated.  The caller provides any locking.
+
+   A percentile is given as the upper bound of the bucket holding it, but no
+   more than the largest latency seen: it is exact to within a factor of two.
+
+ */
+
+#ifndef _ZY_LATENCY_H
+#define _ZY_LATENCY_H
+
+#include "zytypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define  LAT_BUCKETS                (16)        // powers of two, in us
+
+// latency counts, since the start or since last cleared
+typedef struct lat_hist
+{
+    uint32_t    count;
+    uint32_t    minUs;              // zero while count is zero
+    uint32_t    maxUs;
+    uint32_t    lastUs;
+    uint64_t    totalUs;
+    uint32_t    hist[LAT_BUCKETS];  // [i]: latency < 2^(i+1) us
+                                    // the last: all the rest
+} lat_hist_t;
+
+
+/**
+ * Clear the counts
+ */
+void            lat_clear                   (lat_hist_t *lat);
+
+/**
+ * Add a latency of us microseconds; above UINT32_MAX counts as UINT32_MAX
+ */
+void            lat_add                     (lat_hist_t *lat, uint64_t us);
+
+/**
+ * Estimate a percentile (0..100) of the latencies, in microseconds.  Return
+ * zero if there are none.
+ */
+uint32_t        lat_percentile              (lat_hist_t const *lat,
+                                                int percent);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ZY_LATENCY_H
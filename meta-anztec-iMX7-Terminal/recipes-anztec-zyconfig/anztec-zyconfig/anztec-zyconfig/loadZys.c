@@ -104,7 +104,7 @@ void loadConfig()
                     lineBuffer[len-2] = '\0';               // crop "\r"
                 }
                 strcat(crcIn,lineBuffer);
-                if (NULL != strstr(lineBuffer, "CONFIG"))
+                if ((NULL != strstr(lineBuffer, "CONFIG")) && (cmdIndex < 256))
                 {
                     strncpy(setCommand[cmdIndex], lineBuffer+7, 10);
                     setCommand[cmdIndex][10] = '\0';
@@ -153,32 +153,35 @@ void loadConfig()
 
     if (loadData)
     {
-        const int numCmds = cmdIndex;
-        int x;
+        const int           numCmds = cmdIndex;
+        uint8_t             index[256];
+        uint16_t            value[256];
+        ConfigLoadResult    result;
+        int                 x;
 
-        // iterate through command list to program the target
+        // 'CONFIG 01 0002'
         for (x = 0; x<numCmds; x++)
         {
-            int percentDone = 100 * x / numCmds;
-            int index, value;
-
-            // 'CONFIG 01 0002'
             char *p = setCommand[x];    // 'CONFIG ' is not stored
-            index = strtol (p, &p, 16);
-            value = strtol (p, &p, 16);
+            index[x] = (uint8_t)strtol (p, &p, 16);
+            value[x] = (uint16_t)strtol (p, &p, 16);
+        }
 
-            fprintf (stdout, "%3d%% Index:%03d Value:%05d (0x%04X)\n",
-                        percentDone, index, value, value);
-            zul_CursorUp(1);
+        // only the values that differ from the controller's are written
+        (void)zul_loadConfigSet(numCmds, index, value, &result);
 
-            if (FAILURE == zul_setConfigParamByID( index, value))
-                    fprintf (stdout, "xx\n");
+        for (x = 0; x<numCmds; x++)
+        {
+            if (!ZUL_BITMAP_TEST(result.changed, index[x])) continue;
 
-            // zy_msleep(10);
+            fprintf (stdout, "Index:%03d Value:%05d (0x%04X) %s\n",
+                        index[x], value[x], value[x],
+                        ZUL_BITMAP_TEST(result.failures, index[x]) ? "xx" : "");
         }
+        fprintf (stdout, "%d unchanged, %d written, %d failed%s\n",
+                    result.unchanged, result.written, result.failed,
+                    result.flashInhibited ? " (flash writes inhibited)" : "");
         fprintf (stdout, "100%%\n");
-
-        // zy_msleep(200);
     }
     else
     {
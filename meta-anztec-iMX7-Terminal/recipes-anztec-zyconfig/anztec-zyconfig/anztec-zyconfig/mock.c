@@ -0,0 +1,1094 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* For a module overview, see the header file
+ */
+
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "dbg2console.h"
+#include "protocol.h"
+#include "mock.h"
+#include "transport.h"
+#include "zxymt.h"
+#include "debug.h"
+
+#define BUF_LEN                     (64)
+#define MOCK_BUS                    (0x01)
+#define MOCK_MAX_DEVNUM             (0x7F)
+#define MOCK_FW_MAX_SIZE            (1024 * 1024)
+#define MOCK_NUM_VER_STR            (5)
+#define MOCK_VER_STR_LEN            (VER_STR_REPLY_LEN - 6)
+
+// error codes, as returned by the libusb backend
+#define     MOCK_ERROR_INVALID      (-2)
+#define     MOCK_ERROR_NO_DEVICE    (-4)
+#define     MOCK_ERROR_NOT_FOUND    (-5)
+#define     MOCK_ERROR_BUSY         (-6)
+#define     MOCK_ERROR_TIMEOUT      (-7)
+#define     MOCK_ERROR_NO_MEM       (-11)
+
+// a re-enumeration, made once the reply to the current request is fetched
+typedef enum
+{
+    ENUM_NONE, ENUM_TO_APP, ENUM_TO_BL
+} MockEnum_t;
+
+/**
+ * A simulated controller
+ */
+typedef struct
+{
+    bool                        used;
+    char                        addr[7];        // "BB_AA" - values in HEX
+    int16_t                     appPid;
+    int16_t                     blPid;
+    bool                        bootloader;     // the current personality
+    uint32_t                    generation;     // incremented as it re-enumerates
+    MockEnum_t                  pendingEnum;
+
+    uint16_t                    config[256];
+    uint16_t                    defaults[256];
+    uint16_t                    status[256];
+    uint16_t                    spi[256];
+    char                        verStr[MOCK_NUM_VER_STR][MOCK_VER_STR_LEN];
+
+    bool                        flashInhibit;
+    uint8_t                     rawMode;
+
+    // a config value set as a side effect of writing another
+    bool                        linked;
+    uint8_t                     linkTrigger, linkDependent;
+    uint16_t                    linkValue;
+    uint8_t                     privateTouch;
+
+    // bootloader firmware transfer
+    bool                        programming;
+    uint32_t                    fwSize;
+    uint32_t                    fwReceived;
+
+    // the reply to the last request, as fetched by a GET_REPORT
+    uint8_t                     reply[BUF_LEN];
+    bool                        replyReady;
+
+    mock_counters_t             counters;
+} MockUnit_t;
+
+struct mock_device
+{
+    /*@null@*/
+    struct mock_device *        next;           // list of open devices
+    int                         unit;
+    uint32_t                    generation;     // of the unit, when opened
+    uint8_t                     activeInterface;
+    usb_in_handler_t            IN_handler[MAX_REPORT_ID];
+    void *                      IN_context[MAX_REPORT_ID];
+    usb_in_stats_t              inStats;
+};
+typedef struct mock_device mock_device_t;
+
+// the products simulated
+static const struct
+{
+    int16_t         appPid;
+    int16_t         blPid;
+    char const *    name;
+} msv_products[] =
+{
+    { ZXY100_PRODUCT_ID, ZXY100_BOOTLDR_ID, "ZXY100" },
+    { ZXY110_PRODUCT_ID, ZXY110_BOOTLDR_ID, "ZXY110" },
+    { ZXY150_PRODUCT_ID, ZXY150_BOOTLDR_ID, "ZXY150" },
+    { ZXY200_PRODUCT_ID, ZXY200_BOOTLDR_ID, "ZXY200" },
+    { ZXY300_PRODUCT_ID, ZXY300_BOOTLDR_ID, "ZXY300" },
+    { ZXY500_PRODUCT_ID, ZXY500_BOOTLDR_ID, "ZXY500" },
+};
+#define NUM_PRODUCTS    ((int)(sizeof(msv_products) / sizeof(msv_products[0])))
+
+//
+// --- Module Global Variables ---
+//
+
+static pthread_mutex_t          msv_mutex               = PTHREAD_MUTEX_INITIALIZER;
+static bool                     msv_libOpen             = false;
+static MockUnit_t               msv_units[MOCK_MAX_DEVICES];
+static int                      msv_nextDevnum          = 1;
+static int                      msv_latencyUs           = 0;
+static char                     msv_libStr[40 + 1]      = "Mock transport";
+
+// devices opened, and not yet closed
+/*@null@*/
+static mock_device_t *          msv_openDevices         = NULL;
+
+//
+// --- Private Prototypes ---
+//
+
+static int          mock_productIndex   (int16_t pid);
+static MockUnit_t * mock_findUnit       (char const *addrStr);
+static MockUnit_t * mock_unitByIndex    (int index);
+static void         mock_assignAddr     (MockUnit_t *u);
+static void         mock_initUnit       (MockUnit_t *u, int product, bool bootloader);
+static void         mock_reEnumerate    (MockUnit_t *u, bool bootloader);
+static bool         mock_isStale        (mock_device_t *dev);
+static void         mock_ack            (MockUnit_t *u, uint8_t msgCode);
+static void         mock_appRequest     (MockUnit_t *u, uint8_t const *request,
+                                                            uint16_t reqLen);
+static void         mock_blRequest      (MockUnit_t *u, uint8_t const *request,
+                                                            uint16_t reqLen);
+static void         mock_devicesFromEnv (void);
+
+
+// ============================================================================
+// --- Public Implementation ---
+// ============================================================================
+
+int mock_addDevice(int16_t pid, char *addrStr)
+{
+    int i, product = mock_productIndex(pid);
+
+    if (product < 0) return FAILURE;
+
+    (void)pthread_mutex_lock(&msv_mutex);
+    for (i = 0; i < MOCK_MAX_DEVICES; i++)
+    {
+        if (!msv_units[i].used)
+        {
+            mock_initUnit(&msv_units[i], product,
+                                    (pid == msv_products[product].blPid));
+            if (addrStr != NULL) strcpy(addrStr, msv_units[i].addr);
+            zul_logf(3, "Mock device PID:%04X Addr=%s", (uint)(uint16_t)pid,
+                                                        msv_units[i].addr);
+            (void)pthread_mutex_unlock(&msv_mutex);
+            return SUCCESS;
+        }
+    }
+    (void)pthread_mutex_unlock(&msv_mutex);
+
+    return FAILURE;
+}
+
+int mock_removeDevice(char const *addrStr)
+{
+    MockUnit_t *u;
+
+    (void)pthread_mutex_lock(&msv_mutex);
+    u = mock_findUnit(addrStr);
+    if (u != NULL)
+    {
+        // open handles are left to fail, as those of an unplugged device
+        u->used = false;
+        u->generation++;
+    }
+    (void)pthread_mutex_unlock(&msv_mutex);
+
+    return (u != NULL) ? SUCCESS : FAILURE;
+}
+
+void mock_reset(void)
+{
+    int i;
+
+    (void)pthread_mutex_lock(&msv_mutex);
+    for (i = 0; i < MOCK_MAX_DEVICES; i++)
+    {
+        msv_units[i].used = false;
+        msv_units[i].generation++;
+    }
+    msv_latencyUs = 0;
+    (void)pthread_mutex_unlock(&msv_mutex);
+}
+
+void mock_setLatency(int us)
+{
+    msv_latencyUs = (us > 0) ? us : 0;
+}
+
+int mock_setStatus(char const *addrStr, uint8_t index, uint16_t value)
+{
+    MockUnit_t *u;
+
+    (void)pthread_mutex_lock(&msv_mutex);
+    u = mock_findUnit(addrStr);
+    if (u != NULL) u->status[index] = value;
+    (void)pthread_mutex_unlock(&msv_mutex);
+
+    return (u != NULL) ? SUCCESS : FAILURE;
+}
+
+int mock_setConfig(char const *addrStr, uint8_t index, uint16_t value)
+{
+    MockUnit_t *u;
+
+    (void)pthread_mutex_lock(&msv_mutex);
+    u = mock_findUnit(addrStr);
+    if (u != NULL) u->config[index] = value;
+    (void)pthread_mutex_unlock(&msv_mutex);
+
+    return (u != NULL) ? SUCCESS : FAILURE;
+}
+
+int mock_setConfigLink(char const *addrStr, uint8_t trigger,
+                                        uint8_t dependent, uint16_t value)
+{
+    MockUnit_t *u;
+
+    (void)pthread_mutex_lock(&msv_mutex);
+    u = mock_findUnit(addrStr);
+    if (u != NULL)
+    {
+        u->linked           = (trigger != dependent);
+        u->linkTrigger      = trigger;
+        u->linkDependent    = dependent;
+        u->linkValue        = value;
+    }
+    (void)pthread_mutex_unlock(&msv_mutex);
+
+    return (u != NULL) ? SUCCESS : FAILURE;
+}
+
+int mock_getConfig(char const *addrStr, uint8_t index, uint16_t *value)
+{
+    MockUnit_t *u;
+
+    if (value == NULL) return FAILURE;
+
+    (void)pthread_mutex_lock(&msv_mutex);
+    u = mock_findUnit(addrStr);
+    if (u != NULL) *value = u->config[index];
+    (void)pthread_mutex_unlock(&msv_mutex);
+
+    return (u != NULL) ? SUCCESS : FAILURE;
+}
+
+int mock_setVersionStr(char const *addrStr, int verIndex, char const *str)
+{
+    MockUnit_t *u;
+
+    if ((verIndex < 0) || (verIndex >= MOCK_NUM_VER_STR) || (str == NULL))
+        return FAILURE;
+
+    (void)pthread_mutex_lock(&msv_mutex);
+    u = mock_findUnit(addrStr);
+    if (u != NULL)
+    {
+        strncpy(u->verStr[verIndex], str, MOCK_VER_STR_LEN - 1);
+        u->verStr[verIndex][MOCK_VER_STR_LEN - 1] = '\0';
+    }
+    (void)pthread_mutex_unlock(&msv_mutex);
+
+    return (u != NULL) ? SUCCESS : FAILURE;
+}
+
+int mock_getCounters(char const *addrStr, mock_counters_t *counters)
+{
+    MockUnit_t *u;
+
+    if (counters == NULL) return FAILURE;
+
+    (void)pthread_mutex_lock(&msv_mutex);
+    u = mock_findUnit(addrStr);
+    if (u != NULL) *counters = u->counters;
+    (void)pthread_mutex_unlock(&msv_mutex);
+
+    return (u != NULL) ? SUCCESS : FAILURE;
+}
+
+int mock_injectReport(char const *addrStr, uint8_t const *report)
+{
+    usb_in_handler_t    handler[MOCK_MAX_DEVICES];
+    void *              context[MOCK_MAX_DEVICES];
+    uint8_t             data[BUF_LEN];
+    int                 count = 0;
+    int                 i;
+    MockUnit_t         *u;
+    mock_device_t      *dev;
+
+    if (report == NULL) return MOCK_ERROR_INVALID;
+    if (report[0] >= MAX_REPORT_ID) return MOCK_ERROR_INVALID;
+    memcpy(data, report, BUF_LEN);
+
+    (void)pthread_mutex_lock(&msv_mutex);
+    u = mock_findUnit(addrStr);
+    if (u == NULL)
+    {
+        (void)pthread_mutex_unlock(&msv_mutex);
+        return MOCK_ERROR_NO_DEVICE;
+    }
+
+    for (dev = msv_openDevices; dev != NULL; dev = dev->next)
+    {
+        if (mock_isStale(dev) || (&msv_units[dev->unit] != u)) continue;
+
+        dev->inStats.received++;
+        if ((dev->IN_handler[data[0]] != NULL) && (count < MOCK_MAX_DEVICES))
+        {
+            handler[count] = dev->IN_handler[data[0]];
+            context[count] = dev->IN_context[data[0]];
+            count++;
+        }
+    }
+    (void)pthread_mutex_unlock(&msv_mutex);
+
+    // the handlers may make requests of the device
+    for (i = 0; i < count; i++)
+    {
+        handler[i](context[i], data);
+    }
+    return count;
+}
+
+
+// ============================================================================
+// --- Transport Operations ---
+// ============================================================================
+
+static int mock_openLib(void)
+{
+    char const *env = getenv(MOCK_ENV_LATENCY);
+    int         i, count = 0;
+
+    if (env != NULL) mock_setLatency(atoi(env));
+
+    (void)pthread_mutex_lock(&msv_mutex);
+    for (i = 0; i < MOCK_MAX_DEVICES; i++)
+    {
+        if (msv_units[i].used) count++;
+    }
+    (void)pthread_mutex_unlock(&msv_mutex);
+
+    // controllers added by the application are kept
+    if (count == 0)
+    {
+        mock_devicesFromEnv();
+    }
+
+    msv_libOpen = true;
+    return 0;
+}
+
+static void mock_closeLib(void)
+{
+    mock_device_t *dev;
+
+    (void)pthread_mutex_lock(&msv_mutex);
+    while (msv_openDevices != NULL)
+    {
+        dev = msv_openDevices;
+        msv_openDevices = dev->next;
+        free(dev);
+    }
+    msv_libOpen = false;
+    (void)pthread_mutex_unlock(&msv_mutex);
+}
+
+static char * mock_libStr(void)
+{
+    return msv_libStr;
+}
+
+/**
+ * List the simulated controllers, in the format of usb_getDeviceList()
+ */
+static int mock_getDeviceList(char *buf, int len)
+{
+    char    result[2002] = "";
+    int     i, cnt = 0;
+
+    if (!msv_libOpen) return -11;
+
+    (void)pthread_mutex_lock(&msv_mutex);
+    for (i = 0; i < MOCK_MAX_DEVICES; i++)
+    {
+        MockUnit_t *u = &msv_units[i];
+        char        newDevice[120];
+
+        if (!u->used) continue;
+
+        (void)snprintf(newDevice, 120,
+                     "  %d. VID:%04X PID:%04X Addr=%s NNNNNN MMM\n",
+                        cnt, ZYTRONIC_VENDOR_ID,
+                        (uint)(uint16_t)(u->bootloader ? u->blPid : u->appPid),
+                        u->addr
+                      );
+        strncat(result, newDevice, 2000);
+        cnt++;
+    }
+    (void)pthread_mutex_unlock(&msv_mutex);
+
+    if (cnt == 0)
+    {
+        zul_log(0, "No Devices");
+    }
+
+    strncpy(buf, result, (size_t)len);
+    buf[len] = '\0';
+    return cnt;
+}
+
+static int mock_open(MockUnit_t *u, void **pdev)
+{
+    mock_device_t *dev;
+
+    if (u == NULL) return MOCK_ERROR_NOT_FOUND;
+
+    for (dev = msv_openDevices; dev != NULL; dev = dev->next)
+    {
+        if (!mock_isStale(dev) && (&msv_units[dev->unit] == u))
+        {
+            return MOCK_ERROR_BUSY;
+        }
+    }
+
+    dev = (mock_device_t *)calloc(1, sizeof(mock_device_t));
+    if (dev == NULL) return MOCK_ERROR_NO_MEM;
+
+    dev->unit       = (int)(u - msv_units);
+    dev->generation = u->generation;
+    dev->next       = msv_openDevices;
+    msv_openDevices = dev;
+
+    *pdev = dev;
+    return 0;
+}
+
+static int mock_devOpen(int index, void **dev)
+{
+    int retVal;
+
+    if (!msv_libOpen) return -11;
+
+    (void)pthread_mutex_lock(&msv_mutex);
+    retVal = mock_open(mock_unitByIndex(index), dev);
+    (void)pthread_mutex_unlock(&msv_mutex);
+
+    return retVal;
+}
+
+static int mock_devOpenByAddr(char const *addrStr, void **dev)
+{
+    int retVal;
+
+    if (!msv_libOpen) return -11;
+
+    (void)pthread_mutex_lock(&msv_mutex);
+    retVal = mock_open(mock_findUnit(addrStr), dev);
+    (void)pthread_mutex_unlock(&msv_mutex);
+
+    return retVal;
+}
+
+static int mock_devClose(void *handle)
+{
+    mock_device_t *dev = (mock_device_t *)handle;
+    mock_device_t **link;
+
+    (void)pthread_mutex_lock(&msv_mutex);
+    for (link = &msv_openDevices; *link != NULL; link = &(*link)->next)
+    {
+        if (*link == dev)
+        {
+            *link = dev->next;
+            break;
+        }
+    }
+    (void)pthread_mutex_unlock(&msv_mutex);
+
+    free(dev);
+    return 0;
+}
+
+static bool mock_devGetPID(void *handle, int16_t *pid)
+{
+    mock_device_t  *dev = (mock_device_t *)handle;
+    bool            ok;
+
+    (void)pthread_mutex_lock(&msv_mutex);
+    ok = !mock_isStale(dev);
+    if (ok)
+    {
+        MockUnit_t *u = &msv_units[dev->unit];
+        *pid = u->bootloader ? u->blPid : u->appPid;
+    }
+    (void)pthread_mutex_unlock(&msv_mutex);
+
+    return ok;
+}
+
+static int mock_devGetAddrStr(void *handle, char *addrStr)
+{
+    mock_device_t  *dev = (mock_device_t *)handle;
+    int             retVal = MOCK_ERROR_NO_DEVICE;
+
+    (void)pthread_mutex_lock(&msv_mutex);
+    if (!mock_isStale(dev))
+    {
+        strcpy(addrStr, msv_units[dev->unit].addr);
+        retVal = SUCCESS;
+    }
+    (void)pthread_mutex_unlock(&msv_mutex);
+
+    return retVal;
+}
+
+/**
+ * ZXY500 applications offer a management interface (#1), as well as #0
+ */
+static bool mock_devSwitchIFace(void *handle, uint8_t iface)
+{
+    mock_device_t  *dev = (mock_device_t *)handle;
+    bool            ok = false;
+
+    (void)pthread_mutex_lock(&msv_mutex);
+    if (!mock_isStale(dev))
+    {
+        MockUnit_t *u = &msv_units[dev->unit];
+        ok = (iface == 0) ||
+             ((iface == 1) && !u->bootloader && (u->appPid == ZXY500_PRODUCT_ID));
+        if (ok) dev->activeInterface = iface;
+    }
+    (void)pthread_mutex_unlock(&msv_mutex);
+
+    return ok;
+}
+
+/**
+ * Replies are available as soon as the request is handled (after any
+ * simulated latency), so the polling parameters have no effect
+ */
+static void mock_devSetCtrlParams(void *dev, int delay, int retries, int timeout)
+{
+    (void)dev; (void)delay; (void)retries; (void)timeout;
+}
+
+/**
+ * Handle a request as the controller would.  If reply is not NULL, the
+ * controller's reply is copied to it; LIBUSB_ERROR_TIMEOUT is returned if
+ * the request is not one that is answered.
+ */
+static int mock_devControlRequest(void *handle, uint8_t *request,
+                                            uint16_t reqLen, uint8_t *reply)
+{
+    mock_device_t  *dev = (mock_device_t *)handle;
+    MockUnit_t     *u;
+    int             res = BUF_LEN;
+
+    if (request == NULL) return -20;
+    if ((reqLen == 0) || (reqLen > BUF_LEN)) return -21;
+
+    zul_log_hex(4, "  CTRL req : ", request, (int)reqLen);
+
+    if (msv_latencyUs > 0) (void)usleep((useconds_t)msv_latencyUs);
+
+    (void)pthread_mutex_lock(&msv_mutex);
+    if ((dev == NULL) || mock_isStale(dev))
+    {
+        (void)pthread_mutex_unlock(&msv_mutex);
+        zul_logf (0, "%s - no device", __FUNCTION__);
+        return MOCK_ERROR_NO_DEVICE;
+    }
+    u = &msv_units[dev->unit];
+
+    u->counters.requests++;
+    u->replyReady = false;
+    memset(u->reply, 0, BUF_LEN);
+
+    if (u->bootloader)
+    {
+        mock_blRequest(u, request, reqLen);
+    }
+    else
+    {
+        mock_appRequest(u, request, reqLen);
+    }
+
+    if (reply != NULL)
+    {
+        if (u->replyReady)
+        {
+            memcpy(reply, u->reply, BUF_LEN);
+            zul_log_hex(4, "  CTRL resp: ", reply, BUF_LEN);
+        }
+        else
+        {
+            res = MOCK_ERROR_TIMEOUT;
+        }
+    }
+
+    if (u->pendingEnum != ENUM_NONE)
+    {
+        mock_reEnumerate(u, (u->pendingEnum == ENUM_TO_BL));
+    }
+    (void)pthread_mutex_unlock(&msv_mutex);
+
+    return res;
+}
+
+/**
+ * Multi-reply messages are not simulated, so no further reply is available
+ */
+static int mock_devControlReply(void *handle, uint8_t *reply)
+{
+    bool stale;
+
+    (void)reply;
+    (void)pthread_mutex_lock(&msv_mutex);
+    stale = mock_isStale((mock_device_t *)handle);
+    (void)pthread_mutex_unlock(&msv_mutex);
+
+    return stale ? MOCK_ERROR_NO_DEVICE : MOCK_ERROR_TIMEOUT;
+}
+
+static void mock_devRegisterHandler(void *handle, UsbReportID_t ReportID,
+                                    usb_in_handler_t handler, void *context)
+{
+    mock_device_t *dev = (mock_device_t *)handle;
+
+    if ((dev == NULL) || ((int)ReportID >= MAX_REPORT_ID)) return;
+
+    (void)pthread_mutex_lock(&msv_mutex);
+    dev->IN_handler[ReportID] = handler;
+    dev->IN_context[ReportID] = context;
+    (void)pthread_mutex_unlock(&msv_mutex);
+}
+
+static bool mock_devGetInStats(void *handle, usb_in_stats_t *stats)
+{
+    mock_device_t *dev = (mock_device_t *)handle;
+
+    if ((dev == NULL) || (stats == NULL)) return false;
+
+    (void)pthread_mutex_lock(&msv_mutex);
+    *stats = dev->inStats;
+    (void)pthread_mutex_unlock(&msv_mutex);
+    return true;
+}
+
+// devices appear and leave synchronously, so arrival is polled for
+zul_transport_t const mock_transport =
+{
+    .name               = "mock",
+    .openLib            = mock_openLib,
+    .closeLib           = mock_closeLib,
+    .libStr             = mock_libStr,
+    .getDeviceList      = mock_getDeviceList,
+    .devOpen            = mock_devOpen,
+    .devOpenByAddr      = mock_devOpenByAddr,
+    .devClose           = mock_devClose,
+    .devGetPID          = mock_devGetPID,
+    .devGetAddrStr      = mock_devGetAddrStr,
+    .devSwitchIFace     = mock_devSwitchIFace,
+    .devSetCtrlParams   = mock_devSetCtrlParams,
+    .devControlRequest  = mock_devControlRequest,
+    .devControlReply    = mock_devControlReply,
+    .devRegisterHandler = mock_devRegisterHandler,
+    .devGetInStats      = mock_devGetInStats,
+};
+
+
+// ============================================================================
+// --- Private Implementation ---
+// ============================================================================
+
+static int mock_productIndex(int16_t pid)
+{
+    int i;
+
+    for (i = 0; i < NUM_PRODUCTS; i++)
+    {
+        if ((msv_products[i].appPid == pid) || (msv_products[i].blPid == pid))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Find a controller on the bus by address.  Called with msv_mutex held.
+ */
+static MockUnit_t * mock_findUnit(char const *addrStr)
+{
+    int i;
+
+    if (addrStr == NULL) return NULL;
+
+    for (i = 0; i < MOCK_MAX_DEVICES; i++)
+    {
+        if (msv_units[i].used && (strcmp(msv_units[i].addr, addrStr) == 0))
+        {
+            return &msv_units[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Find a controller by its index in the device list
+ */
+static MockUnit_t * mock_unitByIndex(int index)
+{
+    int i, cnt = 0;
+
+    for (i = 0; i < MOCK_MAX_DEVICES; i++)
+    {
+        if (!msv_units[i].used) continue;
+        if (cnt == index) return &msv_units[i];
+        cnt++;
+    }
+    return NULL;
+}
+
+/**
+ * Each appearance on the bus takes the next device number, as a USB host
+ * assigns them
+ */
+static void mock_assignAddr(MockUnit_t *u)
+{
+    (void)snprintf(u->addr, sizeof(u->addr), "%02X_%02X", MOCK_BUS,
+                                                        msv_nextDevnum);
+    msv_nextDevnum = (msv_nextDevnum % MOCK_MAX_DEVNUM) + 1;
+}
+
+/**
+ * Power up a controller of a product, with its factory configuration
+ */
+static void mock_initUnit(MockUnit_t *u, int product, bool bootloader)
+{
+    char const *name = msv_products[product].name;
+    uint32_t    generation = u->generation;
+    int         i;
+
+    memset(u, 0, sizeof(MockUnit_t));
+    u->used         = true;
+    u->generation   = generation + 1;
+    u->appPid       = msv_products[product].appPid;
+    u->blPid        = msv_products[product].blPid;
+    u->bootloader   = bootloader;
+    u->counters.enumerations = 1;
+    mock_assignAddr(u);
+
+    u->defaults[ZXYMT_CI_LOWER_THRESHOLD]   = 25;
+    u->defaults[ZXYMT_CI_UPPER_THRESHOLD]   = 30;
+    u->defaults[ZXYMT_CI_MAX_TOUCHES]       = 10;
+    memcpy(u->config, u->defaults, sizeof(u->config));
+
+    u->status[ZXYMT_SI_NUM_CONFIG_PARAMS]   = 253;
+    u->status[ZXYMT_SI_NUM_STATUS_VALUES]   = 250;
+    u->status[ZXYMT_SI_NUM_X_WIRES]         = 128;
+    u->status[ZXYMT_SI_NUM_Y_WIRES]         = 96;
+    u->status[ZXYMT_SI_FRAME_RATE]          = 120;
+    for (i = 0; i < 6; i++)
+    {
+        u->status[ZXYMT_SI_PROCESSOR_ID_BASE + i] = (uint16_t)(0x4D30 + i);
+    }
+    for (i = 0; i < 256; i++)
+    {
+        u->spi[i] = (uint16_t)(0x5A00 + i);
+    }
+
+    (void)snprintf(u->verStr[STR_BL],  MOCK_VER_STR_LEN, "%s-BL-01.00.00", name);
+    (void)snprintf(u->verStr[STR_FW],  MOCK_VER_STR_LEN, "%s-FW-04.04.19", name);
+    (void)snprintf(u->verStr[STR_HW],  MOCK_VER_STR_LEN, "%s-U-OFF-128-MOCK", name);
+    (void)snprintf(u->verStr[STR_AFC], MOCK_VER_STR_LEN, "AFC-MOCK");
+}
+
+/**
+ * The controller restarts: it leaves the bus and re-appears, with a new
+ * address, as the application or the bootloader.  Volatile state is lost.
+ * Called with msv_mutex held.
+ */
+static void mock_reEnumerate(MockUnit_t *u, bool bootloader)
+{
+    zul_logf(3, "Mock device %s re-enumerates as %s", u->addr,
+                                        bootloader ? "BL" : "APP");
+    u->bootloader   = bootloader;
+    u->pendingEnum  = ENUM_NONE;
+    u->generation++;
+    u->flashInhibit = false;
+    u->rawMode      = 0;
+    u->privateTouch = 0;
+    u->programming  = false;
+    u->replyReady   = false;
+    u->counters.enumerations++;
+    mock_assignAddr(u);
+}
+
+/**
+ * A handle is stale once its controller has restarted or been removed
+ */
+static bool mock_isStale(mock_device_t *dev)
+{
+    MockUnit_t *u;
+
+    if (dev == NULL) return true;
+    u = &msv_units[dev->unit];
+    return !u->used || (u->generation != dev->generation);
+}
+
+static void mock_ack(MockUnit_t *u, uint8_t msgCode)
+{
+    u->replyReady = zul_encodeValueReply(u->reply, BUF_LEN, msgCode, 0, 0);
+}
+
+/**
+ * Handle an application request: a framed message of protocol.h
+ */
+static void mock_appRequest(MockUnit_t *u, uint8_t const *request,
+                                                            uint16_t reqLen)
+{
+    uint8_t const  *p;
+    int             n;
+    uint16_t        value;
+
+    if (!zul_decodeRequest(request, (int)reqLen, &p, &n))
+    {
+        zul_log_hex(1, "Mock - invalid request:", (uint8_t *)request, (int)reqLen);
+        u->counters.badRequests++;
+        return;
+    }
+
+    switch (p[0])
+    {
+        case GetParam:
+            if (n < 2) break;
+            u->replyReady = zul_encodeValueReply(u->reply, BUF_LEN, p[0], p[1],
+                                                            u->config[p[1]]);
+            return;
+
+        case SetParam:
+            if (n < 4) break;
+            value = (uint16_t)(p[2] + 0x100 * p[3]);
+            u->config[p[1]] = value;
+            if (u->linked && (p[1] == u->linkTrigger))
+            {
+                u->config[u->linkDependent] = u->linkValue;
+            }
+            u->counters.configWrites++;
+            if (!u->flashInhibit) u->counters.flashWrites++;
+            u->replyReady = zul_encodeValueReply(u->reply, BUF_LEN, p[0], p[1],
+                                                                        value);
+            return;
+
+        case GetStatus:
+            if (n < 2) break;
+            u->replyReady = zul_encodeValueReply(u->reply, BUF_LEN, p[0], p[1],
+                                                            u->status[p[1]]);
+            return;
+
+        case ReadViaSpi:
+            if (n < 2) break;
+            u->replyReady = zul_encodeValueReply(u->reply, BUF_LEN, p[0], p[1],
+                                                            u->spi[p[1]]);
+            return;
+
+        case GetVersionString:
+            if (n < 2) break;
+            u->replyReady = zul_encodeVerStrReply(u->reply, BUF_LEN, p[1],
+                    (p[1] < MOCK_NUM_VER_STR) ? u->verStr[p[1]] : "");
+            return;
+
+        case RestoreDefaults:
+            memcpy(u->config, u->defaults, sizeof(u->config));
+            u->counters.flashWrites++;
+            mock_ack(u, p[0]);
+            return;
+
+        case DisableFlashWrite:
+            u->flashInhibit = true;
+            mock_ack(u, p[0]);
+            return;
+
+        case EnableFlashWrite:
+            u->flashInhibit = false;
+            mock_ack(u, p[0]);
+            return;
+
+        case ForceFlashWrite:
+            // which also re-enables flash writes
+            u->flashInhibit = false;
+            u->counters.flashWrites++;
+            mock_ack(u, p[0]);
+            return;
+
+        case SetRawMode:
+            if (n < 2) break;
+            u->rawMode = p[1];
+            mock_ack(u, p[0]);
+            return;
+
+        case SetTouchMode:
+        case SetSilentTouchMode:
+            if (n < 2) break;
+            u->privateTouch = p[1];
+            mock_ack(u, p[0]);
+            return;
+
+        case ResetController:
+            u->rawMode      = 0;
+            u->privateTouch = 0;
+            u->flashInhibit = false;
+            mock_ack(u, p[0]);
+            return;
+
+        case ForceEqualisation:
+            mock_ack(u, p[0]);
+            return;
+
+        case StartBootLoader:
+            mock_ack(u, p[0]);
+            u->pendingEnum = ENUM_TO_BL;
+            return;
+
+        default:
+            break;
+    }
+
+    zul_logf(1, "Mock - unsupported message code %d", (int)p[0]);
+    u->counters.badRequests++;
+}
+
+/**
+ * Handle a bootloader request: an unframed command, or during a firmware
+ * transfer, the next block of firmware data
+ */
+static void mock_blRequest(MockUnit_t *u, uint8_t const *request,
+                                                            uint16_t reqLen)
+{
+    uint32_t size;
+
+    if (u->programming)
+    {
+        uint32_t remaining = u->fwSize - u->fwReceived;
+
+        u->fwReceived += (reqLen < remaining) ? reqLen : remaining;
+        u->counters.fwBlocks++;
+        u->counters.flashWrites++;
+        u->replyReady = true;
+
+        if (u->fwReceived >= u->fwSize)
+        {
+            u->programming = false;
+            u->counters.fwComplete++;
+            u->reply[0] = BL_RSP_PROGRAMMING_COMPLETE;
+        }
+        else
+        {
+            u->reply[0] = BL_RSP_BLOCK_WRITTEN;
+        }
+        return;
+    }
+
+    u->replyReady = true;
+
+    switch (request[0])
+    {
+        case BLProgramStart:
+            size  = (reqLen > 4) ? request[4] : 0;
+            size  = (size << 8) + ((reqLen > 3) ? request[3] : 0);
+            size  = (size << 8) + ((reqLen > 2) ? request[2] : 0);
+            size  = (size << 8) + ((reqLen > 1) ? request[1] : 0);
+            if ((reqLen < 7) || (size == 0) || (size > MOCK_FW_MAX_SIZE))
+            {
+                u->reply[0] = BL_RSP_SIZE_ERROR;
+                break;
+            }
+            u->programming  = true;
+            u->fwSize       = size;
+            u->fwReceived   = 0;
+            u->reply[0]     = BL_RSP_Acknowledge;
+            break;
+
+        case BLPing:
+            u->reply[0] = BL_RSP_PING;
+            break;
+
+        case BLGetVersionStr:
+            u->reply[0] = BL_RSP_VersionStr;
+            u->reply[1] = (reqLen > 1) ? request[1] : 0;
+            if (u->reply[1] < MOCK_NUM_VER_STR)
+            {
+                strncpy((char *)u->reply + 2, u->verStr[u->reply[1]],
+                                                            BUF_LEN - 3);
+            }
+            break;
+
+        // no reply is sent to the reboot commands
+        case BLRebootToApp:
+            u->replyReady   = false;
+            u->pendingEnum  = ENUM_TO_APP;
+            break;
+
+        case BLRebootToBL:
+            u->replyReady   = false;
+            u->pendingEnum  = ENUM_TO_BL;
+            break;
+
+        default:
+            u->counters.badRequests++;
+            u->reply[0] = BL_RSP_COMMS_ERROR;
+            break;
+    }
+}
+
+/**
+ * Create the controllers listed by the environment, or a ZXY500
+ */
+static void mock_devicesFromEnv(void)
+{
+    char const *env = getenv(MOCK_ENV_DEVICES);
+    char        copy[120];
+    char       *tok, *save = NULL;
+
+    if ((env == NULL) || (env[0] == '\0'))
+    {
+        (void)mock_addDevice(ZXY500_PRODUCT_ID, NULL);
+        return;
+    }
+
+    strncpy(copy, env, sizeof(copy) - 1);
+    copy[sizeof(copy) - 1] = '\0';
+
+    for (tok = strtok_r(copy, ", ", &save); tok != NULL;
+         tok = strtok_r(NULL, ", ", &save))
+    {
+        int16_t pid = (int16_t)strtol(tok, NULL, 16);
+        if (mock_addDevice(pid, NULL) != SUCCESS)
+        {
+            zul_logf(0, "%s - PID %s not simulated", MOCK_ENV_DEVICES, tok);
+        }
+    }
+}
@@ -0,0 +1,145 @@
+/*
+ *  Copyright (c) 2019 Zytronic Displays Limited. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact Zytronic, you can do so either via the
+ * website <www.zytronic.co.uk> or by paper mail:
+ * Zytronic, Whiteley Road, Blaydon on Tyne, Tyne & Wear, NE21 5NJ, UK
+ */
+
+
+
+
+
+
+/* Module Overview
+   ===============
+   This code provides the "mock" transport of transport.h: simulated
+   controllers, so that the library services, and the applications built on
+   them (saveZys, loadZys, firmwareUpdate), may be exercised without a
+   touchscreen controller attached.
+
+   Each simulated controller holds configuration, status and SPI register
+   values and version strings, and answers the requests of protocol.h as a
+   multi-touch controller's application does.  Requests are CRC checked.
+   StartBootLoader and the bootloader reboot commands cause the controller
+   to leave the bus and re-appear at a new address with the bootloader (or
+   application) PID, as a real device re-enumerates, and the bootloader
+   accepts a firmware transfer.  Handles opened before a re-enumeration
+   report LIBUSB_ERROR_NO_DEVICE.
+
+   Not simulated: the ZXY100 multi-reply raw data and old system report
+   messages, virtual keys, and unsolicited IN reports other than those
+   supplied by mock_injectReport().
+
+   Select with ZUL_TRANSPORT=mock, or tp_select("mock").  The simulated
+   controllers are created by mock_addDevice(), or else, when the transport
+   is opened, from the environment:
+
+        ZUL_MOCK_DEVICES        comma separated hex PIDs, e.g. "0016,0017"
+                                (default: one ZXY500 application)
+        ZUL_MOCK_LATENCY_US     reply turnaround of each request (default 0)
+
+ */
+
+#ifndef _ZY_MOCK_H
+#define _ZY_MOCK_H
+
+#include "zytypes.h"
+#include "usb.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define  MOCK_ENV_DEVICES           "ZUL_MOCK_DEVICES"
+#define  MOCK_ENV_LATENCY           "ZUL_MOCK_LATENCY_US"
+#define  MOCK_MAX_DEVICES           (8)
+
+// activity counters of a simulated controller
+typedef struct mock_counters
+{
+    uint32_t    requests;       // control requests received
+    uint32_t    badRequests;    // framing or CRC errors, unknown messages
+    uint32_t    configWrites;   // SetParam requests
+    uint32_t    flashWrites;    // flash cycles (writes not inhibited, forced)
+    uint32_t    fwBlocks;       // bootloader data blocks received
+    uint32_t    fwComplete;     // firmware transfers completed
+    uint32_t    enumerations;   // times the controller (re)appeared
+} mock_counters_t;
+
+
+/**
+ * Add a simulated controller of the given PID (application or bootloader),
+ * which appears at the next free bus address.  If addrStr is not NULL, the
+ * address ("BB_AA") is copied to it.  Return SUCCESS or FAILURE (table full).
+ */
+int         mock_addDevice              (int16_t pid, /*@null@*/ char *addrStr);
+
+/**
+ * Unplug a simulated controller.  Return SUCCESS or FAILURE (not found).
+ */
+int         mock_removeDevice           (char const *addrStr);
+
+/**
+ * Remove all simulated controllers, and zero the reply latency
+ */
+void        mock_reset                  (void);
+
+/**
+ * Set the reply turnaround of each request, in microseconds
+ */
+void        mock_setLatency             (int us);
+
+/**
+ * Access the values held by a simulated controller.
+ * Return SUCCESS or FAILURE (not found).
+ */
+int         mock_setStatus              (char const *addrStr, uint8_t index,
+                                                            uint16_t value);
+int         mock_setConfig              (char const *addrStr, uint8_t index,
+                                                            uint16_t value);
+int         mock_getConfig              (char const *addrStr, uint8_t index,
+                                                            uint16_t *value);
+int         mock_setVersionStr          (char const *addrStr, int verIndex,
+                                                            char const *str);
+int         mock_getCounters            (char const *addrStr,
+                                                mock_counters_t *counters);
+
+/**
+ * Make a write of config value 'trigger' also set config value 'dependent'
+ * to 'value', as a controller that re-derives one parameter from another.
+ * A controller has one such link; trigger == dependent removes it.
+ * Return SUCCESS or FAILURE (not found).
+ */
+int         mock_setConfigLink          (char const *addrStr, uint8_t trigger,
+                                            uint8_t dependent, uint16_t value);
+
+/**
+ * Deliver a 64 byte IN report (report ID in byte 0) from a simulated
+ * controller to the handlers registered on its open devices.  The handlers
+ * are called before this returns, from the caller's thread.
+ * Return the number of handlers called, or a negative error code.
+ */
+int         mock_injectReport           (char const *addrStr,
+                                                uint8_t const *report);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ZY_MOCK_H
@@ -0,0 +1,635 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* This program tests the library services against a simulated controller,
+ * see mock.h, so it needs no hardware and may be run on the build host:
+ *  - get and set config values, and status values, through the shadow
+ *  - bulk reads of the config values, of the zul_openDevice() device and
+ *    of a second one opened with zul_devOpenByAddr(), whose CPU ID string
+ *    is read only once
+ *  - each device has its own request queue, so a slow request of one does
+ *    not hold up another's
+ *  - IN reports reach their handler, which may not make requests
+ *  - a touch-up wait is for its own contact, which may already be up
+ *  - a device's raw data reports are assembled into frames, numbered on
+ *    across a change of size
+ *  - the saveZys -> loadZys round trip: the config values are saved to a
+ *    ZYS file as saveZys does, the controller is changed, and the file is
+ *    loaded back as loadZys does, writing only the values that differ
+ *  - a config set is written in its own order, and a value changed as a
+ *    side effect of another write is written again
+ *  - latency percentiles are estimated from the histogram's buckets
+ *
+ * Exit status: 0 passed, 1 failed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "zytypes.h"
+#include "debug.h"
+#include "protocol.h"
+#include "services.h"
+#include "services_dev.h"
+#include "transport.h"
+#include "mock.h"
+#include "latency.h"
+
+#define TEMP_BUF_LEN        (1000)
+#define NUM_CHANGED         (5)
+#define QUEUE_LATENCY_US    (200000)
+
+char    g_addr[20]          = "";
+char    g_addr2[20]         = "";
+char    g_zysFile[100]      = "";
+int     g_failures          = 0;
+
+// seen by the IN handler
+int     g_inCount           = 0;
+int     g_inRequestResult   = -1;
+
+
+// ----------------------------------------------------------------------------
+
+void check(bool ok, char const *what)
+{
+    printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+    if (!ok) g_failures++;
+}
+
+void cleanup(void)
+{
+    if (g_zysFile[0] != '\0') (void)unlink(g_zysFile);
+    zul_EndServices();
+    mock_reset();
+}
+
+// ----------------------------------------------------------------------------
+
+void testGetSet(void)
+{
+    mock_counters_t before, after;
+    uint16_t        value = 0;
+
+    check((zul_getConfigParamByID(ZXYMT_CI_LOWER_THRESHOLD, &value) == SUCCESS) &&
+                    (value == 25), "get config");
+    check((zul_getStatusByID(ZXYMT_SI_NUM_X_WIRES, &value) == SUCCESS) &&
+                    (value == 128), "get status");
+
+    check(zul_setConfigParamByID(ZXYMT_CI_LOWER_THRESHOLD, 40) == SUCCESS, "set config");
+    (void)mock_getConfig(g_addr, ZXYMT_CI_LOWER_THRESHOLD, &value);
+    check(value == 40, "set config reaches the controller");
+
+    // answered from the shadow, without a request
+    (void)mock_getCounters(g_addr, &before);
+    check((zul_getConfigParamByID(ZXYMT_CI_LOWER_THRESHOLD, &value) == SUCCESS) &&
+                    (value == 40), "get config after set");
+    (void)mock_getCounters(g_addr, &after);
+    check(after.requests == before.requests, "get config answered from the shadow");
+
+    // changed behind the library's back
+    (void)mock_setConfig(g_addr, ZXYMT_CI_LOWER_THRESHOLD, 41);
+    zul_invalidateShadow();
+    check((zul_getConfigParamByID(ZXYMT_CI_LOWER_THRESHOLD, &value) == SUCCESS) &&
+                    (value == 41), "get config after invalidating the shadow");
+
+    // a mode change may change config values
+    (void)mock_setConfig(g_addr, ZXYMT_CI_LOWER_THRESHOLD, 42);
+    zul_SetRawMode(0);
+    check((zul_getConfigParamByID(ZXYMT_CI_LOWER_THRESHOLD, &value) == SUCCESS) &&
+                    (value == 42), "get config after a mode change");
+
+    check(zul_setConfigParamByID(ZXYMT_CI_LOWER_THRESHOLD, 25) == SUCCESS, "restore config");
+}
+
+/**
+ * Read every config value in one bulk read, and compare with the controller
+ */
+void testRange(void)
+{
+    uint16_t    num = 0;
+    uint16_t    values[256];
+    uint16_t    value;
+    uint8_t     okMap[ZUL_BITMAP_LEN(256)];
+    int         i, read;
+    bool        ok = true;
+
+    check(zul_getStatusByID(ZXYMT_SI_NUM_CONFIG_PARAMS, &num) == SUCCESS,
+                    "get the config value count");
+    num &= 0xff;
+
+    memset(okMap, 0, sizeof(okMap));
+    read = zul_getConfigRange(0, num, values, okMap);
+    for (i = 0; i < num; i++)
+    {
+        (void)mock_getConfig(g_addr, (uint8_t)i, &value);
+        if (ZUL_BITMAP_TEST(okMap, i) && (values[i] != value)) ok = false;
+    }
+    check(read == 253, "bulk read of every config value");
+    check(ok, "bulk read values match the controller");
+    check(zul_getConfigRange(200, 100, values, okMap) < 0, "bulk read beyond 256 refused");
+}
+
+/**
+ * As testRange(), for a device of its own
+ */
+void testDevRange(void)
+{
+    zul_device_t   *dev = NULL;
+    mock_counters_t before, after;
+    char            first[32], again[32];
+    uint16_t        values[256];
+    uint16_t        value;
+    uint8_t         okMap[ZUL_BITMAP_LEN(256)];
+    int             i, read;
+    bool            ok = true;
+
+    (void)mock_setConfig(g_addr2, ZXYMT_CI_LOWER_THRESHOLD, 33);
+
+    check(zul_devOpenByAddr(g_addr2, &dev) == 0, "open the second device");
+    if (dev == NULL) return;
+
+    read = zul_devGetConfigRange(dev, 0, 253, values, okMap);
+    for (i = 0; i < 253; i++)
+    {
+        (void)mock_getConfig(g_addr2, (uint8_t)i, &value);
+        if (!ZUL_BITMAP_TEST(okMap, i) || (values[i] != value)) ok = false;
+    }
+    check(read == 253, "device bulk read of every config value");
+    check(ok && (values[ZXYMT_CI_LOWER_THRESHOLD] == 33),
+                    "device bulk read values match its controller");
+    check(zul_devGetConfigRange(dev, 200, 100, values, okMap) < 0,
+                    "device bulk read beyond 256 refused");
+
+    // the CPU ID string is read once
+    (void)mock_setStatus(g_addr2, ZXYMT_SI_PROCESSOR_ID_BASE, 0x3412);
+    check((zul_devGetVersionStr(dev, STR_CPUID, first, sizeof(first)) == SUCCESS) &&
+                    (strncmp(first, "1234", 4) == 0), "device CPU ID string");
+    (void)mock_getCounters(g_addr2, &before);
+    check((zul_devGetVersionStr(dev, STR_CPUID, again, sizeof(again)) == SUCCESS) &&
+                    (strcmp(first, again) == 0), "device CPU ID string again");
+    (void)mock_getCounters(g_addr2, &after);
+    check(after.requests == before.requests, "device CPU ID string kept");
+
+    check(zul_devClose(dev) == 0, "close the second device");
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * One request of each device, submitted together, should take about as long
+ * as one request, not two
+ */
+void testQueues(void)
+{
+    tp_device_t    *dev2 = NULL;
+    tp_request_t    req1, req2;
+    uint8_t         msgBuf[DUAL_BYTE_MSG_LEN];
+    uint64_t        startUs, tookUs;
+
+    check(tp_devOpenByAddr(g_addr2, &dev2) == 0, "open the second device's link");
+    if (dev2 == NULL) return;
+
+    bzero(msgBuf, DUAL_BYTE_MSG_LEN);
+    (void)zul_encodeGetRequest(msgBuf, DUAL_BYTE_MSG_LEN, ZXYMT_CI_LOWER_THRESHOLD);
+    (void)tp_prepareRequest(&req1, tp_getDefaultDevice(), msgBuf, DUAL_BYTE_MSG_LEN, 1);
+    (void)tp_prepareRequest(&req2, dev2, msgBuf, DUAL_BYTE_MSG_LEN, 1);
+
+    mock_setLatency(QUEUE_LATENCY_US);
+    startUs = zul_monotonicUs();
+    check((tp_submitRequest(&req1) == 0) && (tp_submitRequest(&req2) == 0),
+                    "requests of two devices queued");
+    check((tp_waitRequest(&req1) > 0) && (tp_waitRequest(&req2) > 0),
+                    "requests of two devices answered");
+    tookUs = zul_monotonicUs() - startUs;
+    mock_setLatency(0);
+
+    check(tookUs < (QUEUE_LATENCY_US * 3) / 2, "requests of two devices overlap");
+    check(tp_devClose(dev2) == 0, "close the second device's link");
+}
+
+// ----------------------------------------------------------------------------
+
+void inHandler(uint8_t *data)
+{
+    uint16_t value;
+
+    (void)data;
+    g_inCount++;
+    g_inRequestResult = zul_getStatusByID(ZXYMT_SI_FRAME_RATE, &value);
+}
+
+void testInHandler(void)
+{
+    mock_counters_t before, after;
+    uint8_t         report[64];
+
+    memset(report, 0, sizeof(report));
+    report[0] = RAW_DATA;
+
+    zul_SetSpecialHandler(RAW_DATA, inHandler);
+    (void)mock_getCounters(g_addr, &before);
+    check(mock_injectReport(g_addr, report) == 1, "IN report delivered");
+    (void)mock_getCounters(g_addr, &after);
+
+    check(g_inCount == 1, "IN handler called");
+    check((g_inRequestResult == FAILURE) && (after.requests == before.requests),
+                                            "request from an IN handler refused");
+    zul_setRawDataHandler();
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * Set a contact record of a touch report: flags 3 down, 0 up
+ */
+void setContact(uint8_t *report, int slot, uint8_t flags, uint8_t ID, int x, int y)
+{
+    uint8_t *p = report + 1 + (slot * 6);
+
+    p[0] = flags;
+    p[1] = ID;
+    p[2] = (uint8_t)(x & 0xff);
+    p[3] = (uint8_t)(x >> 8);
+    p[4] = (uint8_t)(y & 0xff);
+    p[5] = (uint8_t)(y >> 8);
+}
+
+void testTouchUp(void)
+{
+    uint8_t         report[64];
+    Contact         c;
+
+    zul_SetupStandardInHandlers();
+
+    // contacts 2 and 3 down, then 3 released
+    memset(report, 0, sizeof(report));
+    report[0] = TOUCH_OS;
+    setContact(report, 0, 3, 2, 100, 200);
+    setContact(report, 1, 3, 3, 300, 400);
+    (void)mock_injectReport(g_addr, report);
+    setContact(report, 0, 3, 2, 110, 210);
+    setContact(report, 1, 0, 3, 300, 400);
+    (void)mock_injectReport(g_addr, report);
+
+    memset(&c, 0, sizeof(c));
+    c.ID = 2;
+    check(!zul_GetTouchUp(50, &c), "touch-up ignores another contact's release");
+
+    // contact 2 released before the wait
+    memset(report, 0, sizeof(report));
+    report[0] = TOUCH_OS;
+    setContact(report, 0, 0, 2, 120, 220);
+    (void)mock_injectReport(g_addr, report);
+
+    c.ID = 2;
+    check(zul_GetTouchUp(50, &c) && (c.ID == 2) && (c.x == 120) && (c.y == 220),
+                    "touch-up of a contact released before the wait");
+
+    zul_setRawDataHandler();
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * Send one whole frame of raw data, of x by y wires, in one report
+ */
+void sendRawFrame(char const *addr, int x, int y, uint8_t value)
+{
+    uint8_t report[64];
+
+    memset(report, 0, sizeof(report));
+    report[0] = RAW_DATA;
+    report[3] = (uint8_t)(x * y);
+    memset(report + 4, value, (size_t)(x * y));
+    (void)mock_injectReport(addr, report);
+}
+
+void testDevRawFrames(void)
+{
+    zul_device_t   *dev = NULL;
+    rf_frame_t      info;
+    uint8_t         cells[16];
+    int             n;
+
+    (void)mock_setStatus(g_addr2, ZXYMT_SI_NUM_X_WIRES, 4);
+    (void)mock_setStatus(g_addr2, ZXYMT_SI_NUM_Y_WIRES, 4);
+
+    check(zul_devOpenByAddr(g_addr2, &dev) == 0, "open the second device");
+    if (dev == NULL) return;
+
+    (void)zul_devSetRawMode(dev, 1);
+    check(zul_devStartRawFrames(dev) == SUCCESS, "device raw frames started");
+    sendRawFrame(g_addr2, 4, 4, 7);
+    n = zul_devWaitRawFrame(dev, 0, 100, &info, cells, NULL, (int)sizeof(cells));
+    check((n == 1) && (info.missing == 0) && (cells[15] == 7),
+                    "device raw frame assembled");
+
+    // a new size keeps the frame numbers, in a new generation
+    (void)mock_setStatus(g_addr2, ZXYMT_SI_NUM_Y_WIRES, 3);
+    zul_devInvalidateShadow(dev);
+    check(zul_devStartRawFrames(dev) == SUCCESS, "device raw frames resized");
+    check(zul_devWaitRawFrame(dev, 0, 0, &info, NULL, NULL, 0) == 0,
+                    "no frame of the new size yet");
+    sendRawFrame(g_addr2, 4, 3, 9);
+    check((zul_devWaitRawFrame(dev, 0, 100, &info, cells, NULL, (int)sizeof(cells)) == 2) &&
+                    (info.generation == 2) && (info.yWires == 3),
+                    "device raw frame numbers carry on");
+
+    zul_devStopRawFrames(dev);
+    (void)zul_devSetRawMode(dev, 0);
+    check(zul_devClose(dev) == 0, "close the second device");
+    (void)mock_setStatus(g_addr2, ZXYMT_SI_NUM_X_WIRES, 128);
+    (void)mock_setStatus(g_addr2, ZXYMT_SI_NUM_Y_WIRES, 96);
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * Save the config values as saveZys does, with the validation line that
+ * loadZys checks.  Return the number of CONFIG lines.
+ */
+int saveZys(char const *name)
+{
+    uint16_t    num = 0;
+    uint16_t    values[256];
+    uint8_t     okMap[ZUL_BITMAP_LEN(256)];
+    char        crcIn[10000] = "";
+    char        line[180];
+    char        verStr[100 + 1];
+    FILE       *fp;
+    int         i, count = 0;
+
+    fp = fopen(name, "w");
+    if (fp == NULL) return -1;
+
+    fprintf(fp, "# This information collected by mockTest\r\n");
+    if (zul_getVersionStr(STR_HW, verStr, 100) == SUCCESS)
+    {
+        snprintf(line, sizeof(line), "VERSION %02d %s", STR_HW, verStr);
+        fprintf(fp, "%s\r\n", line);
+        strcat(crcIn, line);
+    }
+
+    if (zul_getStatusByID(ZXYMT_SI_NUM_CONFIG_PARAMS, &num) == SUCCESS)
+    {
+        num &= 0xff;
+        (void)zul_getConfigRange(0, num, values, okMap);
+        for (i = 0; i < num; i++)
+        {
+            if (!ZUL_BITMAP_TEST(okMap, i)) continue;
+
+            snprintf(line, sizeof(line), "CONFIG %02X %04X", i, values[i]);
+            fprintf(fp, "%s\r\n", line);
+            strcat(crcIn, line);
+            count++;
+        }
+    }
+
+    fprintf(fp, "# Validation %04X\r\n", zul_getCRC((uint8_t *)crcIn, strlen(crcIn)));
+    fclose(fp);
+    return count;
+}
+
+/**
+ * Load the CONFIG lines of a ZYS file as loadZys does, if it validates.
+ * Return the number of CONFIG lines, or -1 if the file is rejected.
+ */
+int loadZys(char const *name, ConfigLoadResult *result)
+{
+    uint8_t     index[256];
+    uint16_t    value[256];
+    char        crcIn[10000] = "";
+    char        crcFromFile[5] = "", calculatedCRC[5] = "";
+    char        lineBuffer[180 + 1];
+    FILE       *fp;
+    int         count = 0;
+
+    fp = fopen(name, "r");
+    if (fp == NULL) return -1;
+
+    while (fgets(lineBuffer, 180, fp))
+    {
+        lineBuffer[strcspn(lineBuffer, "\r\n")] = '\0';
+
+        if (!strncmp(lineBuffer, "# Validation", 10))
+        {
+            char *p = strrchr(lineBuffer, ' ');
+            if (p != NULL) strncpy(crcFromFile, p + 1, 4);
+            crcFromFile[4] = '\0';
+        }
+        else if (strstr(lineBuffer, "VERSION") || strstr(lineBuffer, "CONFIG"))
+        {
+            strcat(crcIn, lineBuffer);
+            if ((strncmp(lineBuffer, "CONFIG", 6) == 0) && (count < 256))
+            {
+                char *p = lineBuffer + 7;
+                index[count] = (uint8_t)strtol(p, &p, 16);
+                value[count] = (uint16_t)strtol(p, &p, 16);
+                count++;
+            }
+        }
+    }
+    fclose(fp);
+
+    sprintf(calculatedCRC, "%04X", zul_getCRC((uint8_t *)crcIn, strlen(crcIn)));
+    if (strcmp(crcFromFile, calculatedCRC) != 0) return -1;
+
+    (void)zul_loadConfigSet(count, index, value, result);
+    return count;
+}
+
+void testZysRoundTrip(void)
+{
+    static uint8_t const changed[NUM_CHANGED] = { 0, 1, 8, 0x40, 0xFC };
+    mock_counters_t     before, after;
+    ConfigLoadResult    result;
+    uint16_t            saved[256];
+    uint16_t            value;
+    int                 i, numSaved, numLoaded;
+    bool                ok;
+    FILE               *fp;
+
+    numSaved = saveZys(g_zysFile);
+    check(numSaved == 253, "save every config value");
+
+    for (i = 0; i < 256; i++)
+    {
+        (void)mock_getConfig(g_addr, (uint8_t)i, &saved[i]);
+    }
+
+    // another controller state: some values differ from the file
+    for (i = 0; i < NUM_CHANGED; i++)
+    {
+        (void)mock_setConfig(g_addr, changed[i], (uint16_t)(saved[changed[i]] + 100 + i));
+    }
+    zul_invalidateShadow();
+
+    (void)mock_getCounters(g_addr, &before);
+    numLoaded = loadZys(g_zysFile, &result);
+    (void)mock_getCounters(g_addr, &after);
+
+    check(numLoaded == numSaved, "load every config value");
+    check((result.written == NUM_CHANGED) && (result.failed == 0) &&
+          (result.unchanged == numSaved - NUM_CHANGED), "only the changed values written");
+    check(after.configWrites - before.configWrites == NUM_CHANGED, "controller write count");
+
+    ok = true;
+    for (i = 0; i < numSaved; i++)
+    {
+        (void)mock_getConfig(g_addr, (uint8_t)i, &value);
+        if (value != saved[i]) ok = false;
+    }
+    check(ok, "controller config restored from the file");
+
+    // a file changed after saving is rejected, and nothing is written
+    fp = fopen(g_zysFile, "a");
+    if (fp != NULL)
+    {
+        fprintf(fp, "CONFIG 00 1234\r\n");
+        fclose(fp);
+    }
+    (void)mock_getCounters(g_addr, &before);
+    check(loadZys(g_zysFile, &result) < 0, "altered file rejected");
+    (void)mock_getCounters(g_addr, &after);
+    check(after.configWrites == before.configWrites, "nothing written from an altered file");
+}
+
+/**
+ * The simulated controller resets config 0x20 when 0x21 is written
+ */
+void testLoadOrder(void)
+{
+    uint8_t const       index1[2] = { 0x21, 0x20 };
+    uint16_t const      value1[2] = { 6, 9 };
+    uint8_t const       index2[2] = { 0x20, 0x21 };
+    uint16_t const      value2[2] = { 9, 7 };
+    ConfigLoadResult    result;
+    uint16_t            saved20, saved21, value20, value21;
+
+    (void)mock_getConfig(g_addr, 0x20, &saved20);
+    (void)mock_getConfig(g_addr, 0x21, &saved21);
+    (void)mock_setConfigLink(g_addr, 0x21, 0x20, 0);
+
+    // both differ: written in the order given, 0x21 then 0x20
+    check(zul_loadConfigSet(2, index1, value1, &result) == SUCCESS,
+                    "load a dependent pair");
+    (void)mock_getConfig(g_addr, 0x20, &value20);
+    (void)mock_getConfig(g_addr, 0x21, &value21);
+    check((value20 == 9) && (value21 == 6) && (result.written == 2),
+                    "dependent pair written in the order given");
+
+    // 0x20 is already right, until 0x21 is written
+    check(zul_loadConfigSet(2, index2, value2, &result) == SUCCESS,
+                    "load a value reset by another write");
+    (void)mock_getConfig(g_addr, 0x20, &value20);
+    (void)mock_getConfig(g_addr, 0x21, &value21);
+    check((value20 == 9) && (value21 == 7) && (result.written == 2) &&
+                    (result.unchanged == 0) && (result.failed == 0),
+                    "value reset by another write is written again");
+
+    (void)mock_setConfigLink(g_addr, 0x21, 0x21, 0);
+    (void)mock_setConfig(g_addr, 0x20, saved20);
+    (void)mock_setConfig(g_addr, 0x21, saved21);
+    zul_invalidateShadow();
+}
+
+/**
+ * The latency histogram shared by the touch bridge and the TUIO publisher
+ */
+void testLatency(void)
+{
+    lat_hist_t  lat;
+    int         i;
+
+    lat_clear(&lat);
+    check(lat_percentile(&lat, 50) == 0, "no latency percentile without samples");
+
+    for (i = 0; i < 98; i++) lat_add(&lat, 100);
+    lat_add(&lat, 3000);
+    lat_add(&lat, 5000000000ull);
+    check((lat.count == 100) && (lat.minUs == 100) && (lat.maxUs == UINT32_MAX),
+                                        "latency count, minimum and clamped maximum");
+    check(lat_percentile(&lat, 50) == 127, "latency p50 is its bucket's bound");
+    check(lat_percentile(&lat, 99) == 4095, "latency p99 is its bucket's bound");
+    check(lat_percentile(&lat, 100) == UINT32_MAX, "latency p100 is the maximum");
+
+    lat_clear(&lat);
+    lat_add(&lat, 20);
+    check(lat_percentile(&lat, 99) == 20, "latency percentile within the range seen");
+}
+
+// ----------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    char    tempBuffer[TEMP_BUF_LEN + 1];
+    int     res;
+
+    if (argc > 1) zul_setLogLevel(atoi(argv[1]));
+
+    snprintf(g_zysFile, sizeof(g_zysFile), "/tmp/mockTest_%d.zys", (int)getpid());
+    if (atexit(cleanup) != 0)
+    {
+        fprintf(stderr, "cannot set exit function\n");
+        return 1;
+    }
+
+    mock_reset();
+    check(mock_addDevice(ZXY500_PRODUCT_ID, g_addr) == SUCCESS, "add a simulated ZXY500");
+    check(mock_addDevice(ZXY500_PRODUCT_ID, g_addr2) == SUCCESS, "add a second ZXY500");
+    check(zul_selectTransport("mock") == SUCCESS, "select the mock transport");
+
+    res = zul_InitServices();
+    check(res == 0, "init services");
+    if (res != 0) return 1;
+
+    check(zul_getDeviceList(tempBuffer, TEMP_BUF_LEN) == 2, "list the devices");
+    res = zul_openDevice(0);
+    check(res == 0, "open the device");
+    if (res != 0) return 1;
+
+    testGetSet();
+    testRange();
+    testDevRange();
+    testQueues();
+    testInHandler();
+    testTouchUp();
+    testDevRawFrames();
+    testZysRoundTrip();
+    testLoadOrder();
+    testLatency();
+
+    check(zul_closeDevice() == 0, "close the device");
+
+    printf("%s, %d failure(s)\n", (g_failures == 0) ? "PASSED" : "FAILED", g_failures);
+    return (g_failures == 0) ? 0 : 1;
+}
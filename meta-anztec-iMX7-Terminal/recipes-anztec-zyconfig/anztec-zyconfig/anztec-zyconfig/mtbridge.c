@@ -0,0 +1,561 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* For a module overview, see the header file
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#include "mtbridge.h"
+#include "debug.h"
+
+// after zytypes.h: the KEY_ macros of the input headers would otherwise
+// clash with the key names of keycodes.h
+#include <linux/input.h>
+#include <linux/uinput.h>
+
+//
+// --- Module Types ---
+//
+
+// per slot: SLOT, TRACKING_ID, X, Y; then BTN_TOUCH, two tools, ABS_X/Y, SYN
+#define MAX_EVENTS                  (MTB_MAX_SLOTS * 4 + 8)
+#define NUM_TOOLS                   (5)
+
+struct zul_mtbridge
+{
+    int                 fd;
+    bool                device;         // false: events written to a file
+    zul_tracker_t *     trk;
+    mtb_transform_t     xf;
+
+    pthread_mutex_t     lock;
+
+    // the state written so far
+    int                 slotOf      [TRK_MAX_CONTACTS];     // -1: none
+    int                 slotID      [MTB_MAX_SLOTS];        // -1: free
+    uint64_t            slotDownUs  [MTB_MAX_SLOTS];
+    int                 slotX       [MTB_MAX_SLOTS];
+    int                 slotY       [MTB_MAX_SLOTS];
+    int                 curSlot;
+    uint16_t            nextTrackingID;
+    int                 pointerSlot;    // -1: not touching
+    int                 pointerX, pointerY;
+    int                 tool;           // contacts down, at most NUM_TOOLS
+
+    mtb_latency_t       lat;
+
+    trk_snapshot_t      snap;
+    struct input_event  ev          [MAX_EVENTS];
+    int                 numEv;
+};
+
+static uint16_t const       mtb_toolKeys[NUM_TOOLS] =
+{
+    BTN_TOOL_FINGER, BTN_TOOL_DOUBLETAP, BTN_TOOL_TRIPLETAP,
+    BTN_TOOL_QUADTAP, BTN_TOOL_QUINTTAP
+};
+
+
+//
+// --- Module Prototypes ---
+//
+
+static int      mtb_setupDevice         (zul_mtbridge_t *mtb, char const *name);
+static void     mtb_transform           (zul_mtbridge_t *mtb,
+                                            trk_contact_t const *c,
+                                            int *x, int *y);
+static void     mtb_event               (zul_mtbridge_t *mtb, uint16_t type,
+                                            uint16_t code, int32_t value);
+static void     mtb_selectSlot          (zul_mtbridge_t *mtb, int s);
+static void     mtb_releaseSlot         (zul_mtbridge_t *mtb, int s);
+static void     mtb_apply               (zul_mtbridge_t *mtb, bool *seen);
+static void     mtb_pointer             (zul_mtbridge_t *mtb);
+static int      mtb_flush               (zul_mtbridge_t *mtb, uint64_t rxUs);
+
+
+// ============================================================================
+// --- Public Services ---
+// ============================================================================
+
+zul_mtbridge_t * mtb_create(char const *node, char const *name,
+                                                    mtb_transform_t const *xf)
+{
+    zul_mtbridge_t *    mtb;
+    struct stat         st;
+    int                 i;
+
+    if (node == NULL) node = MTB_DEFAULT_NODE;
+    if (name == NULL) name = MTB_DEFAULT_NAME;
+
+    mtb = (zul_mtbridge_t *)calloc(1, sizeof(zul_mtbridge_t));
+    if (mtb == NULL) return NULL;
+
+    if (xf != NULL) mtb->xf = *xf;
+    if (mtb->xf.inMaxX <= 0)  mtb->xf.inMaxX  = MTB_IN_MAX;
+    if (mtb->xf.inMaxY <= 0)  mtb->xf.inMaxY  = MTB_IN_MAX;
+    if (mtb->xf.outMaxX <= 0) mtb->xf.outMaxX = (mtb->xf.swapXY) ?
+                                            mtb->xf.inMaxY : mtb->xf.inMaxX;
+    if (mtb->xf.outMaxY <= 0) mtb->xf.outMaxY = (mtb->xf.swapXY) ?
+                                            mtb->xf.inMaxX : mtb->xf.inMaxY;
+
+    for (i = 0; i < TRK_MAX_CONTACTS; i++) mtb->slotOf[i] = -1;
+    for (i = 0; i < MTB_MAX_SLOTS; i++)    mtb->slotID[i] = -1;
+    mtb->curSlot     = -1;
+    mtb->pointerSlot = -1;
+
+    mtb->trk = trk_create();
+    if (mtb->trk == NULL)
+    {
+        free(mtb);
+        return NULL;
+    }
+    (void)pthread_mutex_init(&mtb->lock, NULL);
+
+    errno = 0;
+    mtb->fd = open(node, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if ( (mtb->fd < 0) && (errno == ENOENT) && (strncmp(node, "/dev/", 5) != 0) )
+    {
+        // a capture file, for replay tests
+        mtb->fd = open(node, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+    if (mtb->fd < 0)
+    {
+        zul_logf(1, "%s: cannot open %s: %s", __FUNCTION__, node, strerror(errno));
+        mtb_destroy(mtb);
+        return NULL;
+    }
+
+    mtb->device = !( (fstat(mtb->fd, &st) == 0) && S_ISREG(st.st_mode) );
+    if (mtb->device)
+    {
+        if (mtb_setupDevice(mtb, name) != SUCCESS)
+        {
+            mtb_destroy(mtb);
+            return NULL;
+        }
+    }
+
+    zul_logf(3, "%s: %s %s, %dx%d%s%s%s", __FUNCTION__,
+                (mtb->device) ? "input device on" : "capture to", node,
+                mtb->xf.outMaxX, mtb->xf.outMaxY,
+                (mtb->xf.swapXY)  ? " swapXY" : "",
+                (mtb->xf.invertX) ? " invertX" : "",
+                (mtb->xf.invertY) ? " invertY" : "" );
+    return mtb;
+}
+
+void mtb_destroy(zul_mtbridge_t *mtb)
+{
+    if (mtb == NULL) return;
+
+    if (mtb->fd >= 0)
+    {
+        mtb_releaseAll(mtb);
+        if (mtb->device) (void)ioctl(mtb->fd, UI_DEV_DESTROY);
+        (void)close(mtb->fd);
+    }
+    trk_destroy(mtb->trk);
+    (void)pthread_mutex_destroy(&mtb->lock);
+    free(mtb);
+}
+
+int mtb_report(zul_mtbridge_t *mtb, uint8_t const *data, int len,
+                                                            uint64_t rxUs)
+{
+    bool    seen[MTB_MAX_SLOTS];
+    int     s;
+
+    if (mtb == NULL) return -1;
+
+    (void)trk_update(mtb->trk, data, len);
+
+    (void)pthread_mutex_lock(&mtb->lock);
+    trk_snapshot(mtb->trk, &mtb->snap);
+
+    memset(seen, 0, sizeof(seen));
+    mtb_apply(mtb, seen);
+
+    // contacts gone from the table altogether, e.g. on a reset
+    for (s = 0; s < MTB_MAX_SLOTS; s++)
+    {
+        if ( (mtb->slotID[s] >= 0) && (!seen[s]) ) mtb_releaseSlot(mtb, s);
+    }
+    mtb_pointer(mtb);
+
+    s = mtb_flush(mtb, rxUs);
+    (void)pthread_mutex_unlock(&mtb->lock);
+    return s;
+}
+
+void mtb_releaseAll(zul_mtbridge_t *mtb)
+{
+    int s;
+
+    if (mtb == NULL) return;
+
+    trk_reset(mtb->trk);
+
+    (void)pthread_mutex_lock(&mtb->lock);
+    for (s = 0; s < MTB_MAX_SLOTS; s++)
+    {
+        if (mtb->slotID[s] >= 0) mtb_releaseSlot(mtb, s);
+    }
+    mtb_pointer(mtb);
+    (void)mtb_flush(mtb, 0);
+    (void)pthread_mutex_unlock(&mtb->lock);
+}
+
+void mtb_getLatency(zul_mtbridge_t *mtb, mtb_latency_t *lat, bool clear)
+{
+    if ((mtb == NULL) || (lat == NULL)) return;
+
+    (void)pthread_mutex_lock(&mtb->lock);
+    *lat = mtb->lat;
+    if (clear)
+    {
+        memset(&mtb->lat, 0, sizeof(mtb->lat));
+    }
+    (void)pthread_mutex_unlock(&mtb->lock);
+}
+
+
+// ============================================================================
+// --- Private Functions ---
+// ============================================================================
+
+/**
+ * Declare the events and axes, and create the input device
+ */
+static int mtb_setupDevice(zul_mtbridge_t *mtb, char const *name)
+{
+    int const   abs[4] = { ABS_X, ABS_Y, ABS_MT_POSITION_X, ABS_MT_POSITION_Y };
+    int         i;
+    bool        ok = true;
+
+    ok = ok && (ioctl(mtb->fd, UI_SET_EVBIT, EV_SYN) == 0);
+    ok = ok && (ioctl(mtb->fd, UI_SET_EVBIT, EV_KEY) == 0);
+    ok = ok && (ioctl(mtb->fd, UI_SET_EVBIT, EV_ABS) == 0);
+    ok = ok && (ioctl(mtb->fd, UI_SET_KEYBIT, BTN_TOUCH) == 0);
+    for (i = 0; ok && (i < NUM_TOOLS); i++)
+    {
+        ok = (ioctl(mtb->fd, UI_SET_KEYBIT, mtb_toolKeys[i]) == 0);
+    }
+    for (i = 0; ok && (i < 4); i++)
+    {
+        ok = (ioctl(mtb->fd, UI_SET_ABSBIT, abs[i]) == 0);
+    }
+    ok = ok && (ioctl(mtb->fd, UI_SET_ABSBIT, ABS_MT_SLOT) == 0);
+    ok = ok && (ioctl(mtb->fd, UI_SET_ABSBIT, ABS_MT_TRACKING_ID) == 0);
+    ok = ok && (ioctl(mtb->fd, UI_SET_PROPBIT, INPUT_PROP_DIRECT) == 0);
+    if (!ok)
+    {
+        zul_logf(1, "%s: not a uinput node: %s", __FUNCTION__, strerror(errno));
+        return FAILURE;
+    }
+
+#ifdef UI_DEV_SETUP
+    {
+        struct uinput_setup         setup;
+        struct uinput_abs_setup     as;
+
+        memset(&setup, 0, sizeof(setup));
+        setup.id.bustype = BUS_USB;
+        setup.id.vendor  = ZYTRONIC_VENDOR_ID;
+        strncpy(setup.name, name, UINPUT_MAX_NAME_SIZE - 1);
+        ok = (ioctl(mtb->fd, UI_DEV_SETUP, &setup) == 0);
+
+        for (i = 0; ok && (i < 4); i++)
+        {
+            memset(&as, 0, sizeof(as));
+            as.code = (uint16_t)abs[i];
+            as.absinfo.maximum = (i & 1) ? mtb->xf.outMaxY : mtb->xf.outMaxX;
+            ok = (ioctl(mtb->fd, UI_ABS_SETUP, &as) == 0);
+        }
+        if (ok)
+        {
+            memset(&as, 0, sizeof(as));
+            as.code = ABS_MT_SLOT;
+            as.absinfo.maximum = MTB_MAX_SLOTS - 1;
+            ok = (ioctl(mtb->fd, UI_ABS_SETUP, &as) == 0);
+        }
+        if (ok)
+        {
+            memset(&as, 0, sizeof(as));
+            as.code = ABS_MT_TRACKING_ID;
+            as.absinfo.maximum = UINT16_MAX;
+            ok = (ioctl(mtb->fd, UI_ABS_SETUP, &as) == 0);
+        }
+    }
+#else
+    {
+        // uinput before version 5: the setup is written
+        struct uinput_user_dev      udev;
+
+        memset(&udev, 0, sizeof(udev));
+        udev.id.bustype = BUS_USB;
+        udev.id.vendor  = ZYTRONIC_VENDOR_ID;
+        strncpy(udev.name, name, UINPUT_MAX_NAME_SIZE - 1);
+        for (i = 0; i < 4; i++)
+        {
+            udev.absmax[abs[i]] = (i & 1) ? mtb->xf.outMaxY : mtb->xf.outMaxX;
+        }
+        udev.absmax[ABS_MT_SLOT]        = MTB_MAX_SLOTS - 1;
+        udev.absmax[ABS_MT_TRACKING_ID] = UINT16_MAX;
+        ok = (write(mtb->fd, &udev, sizeof(udev)) == (ssize_t)sizeof(udev));
+    }
+#endif
+
+    ok = ok && (ioctl(mtb->fd, UI_DEV_CREATE) == 0);
+    if (!ok)
+    {
+        zul_logf(1, "%s: cannot create the input device: %s", __FUNCTION__,
+                                                            strerror(errno));
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+/**
+ * Report coordinates to input device coordinates
+ */
+static void mtb_transform(zul_mtbridge_t *mtb, trk_contact_t const *c,
+                                                            int *x, int *y)
+{
+    mtb_transform_t const * xf = &mtb->xf;
+    int     inX = c->x, inY = c->y;
+    int     maxX = xf->inMaxX, maxY = xf->inMaxY;
+
+    if (inX > maxX) inX = maxX;
+    if (inY > maxY) inY = maxY;
+    if (xf->swapXY)
+    {
+        int t = inX; inX = inY; inY = t;
+        t = maxX; maxX = maxY; maxY = t;
+    }
+    if (xf->invertX) inX = maxX - inX;
+    if (xf->invertY) inY = maxY - inY;
+
+    *x = (int)(((int64_t)inX * xf->outMaxX + maxX / 2) / maxX);
+    *y = (int)(((int64_t)inY * xf->outMaxY + maxY / 2) / maxY);
+}
+
+static void mtb_event(zul_mtbridge_t *mtb, uint16_t type, uint16_t code,
+                                                            int32_t value)
+{
+    struct input_event *ev;
+
+    if (mtb->numEv >= MAX_EVENTS) return;
+    ev = &mtb->ev[mtb->numEv++];
+    memset(ev, 0, sizeof(*ev));
+    ev->type  = type;
+    ev->code  = code;
+    ev->value = value;
+}
+
+static void mtb_selectSlot(zul_mtbridge_t *mtb, int s)
+{
+    if (mtb->curSlot == s) return;
+    mtb_event(mtb, EV_ABS, ABS_MT_SLOT, s);
+    mtb->curSlot = s;
+}
+
+static void mtb_releaseSlot(zul_mtbridge_t *mtb, int s)
+{
+    mtb_selectSlot(mtb, s);
+    mtb_event(mtb, EV_ABS, ABS_MT_TRACKING_ID, -1);
+    mtb->slotOf[mtb->slotID[s]] = -1;
+    mtb->slotID[s] = -1;
+}
+
+/**
+ * Write the changes of the contacts of the snapshot, marking their slots seen
+ */
+static void mtb_apply(zul_mtbridge_t *mtb, bool *seen)
+{
+    int i, s;
+
+    for (i = 0; i < mtb->snap.count; i++)
+    {
+        trk_contact_t const *   c = &mtb->snap.contact[i];
+        bool                    isNew = false;
+        int                     x, y;
+
+        s = mtb->slotOf[c->ID];
+
+        if (c->state == TRK_UP)
+        {
+            if (s >= 0)
+            {
+                mtb_releaseSlot(mtb, s);
+                seen[s] = true;
+            }
+            continue;
+        }
+        if ((c->state != TRK_DOWN) && (c->state != TRK_MOVE)) continue;
+
+        if (s < 0)
+        {
+            for (s = 0; (s < MTB_MAX_SLOTS) && (mtb->slotID[s] >= 0); s++);
+            if (s == MTB_MAX_SLOTS)
+            {
+                mtb->lat.dropped++;
+                continue;
+            }
+            mtb->slotID[s]  = c->ID;
+            mtb->slotOf[c->ID] = s;
+            isNew = true;
+        }
+        else if (mtb->slotDownUs[s] != c->downUs)
+        {
+            // released and touched again, between reports
+            isNew = true;
+        }
+        seen[s] = true;
+
+        mtb_transform(mtb, c, &x, &y);
+        if (isNew)
+        {
+            mtb->slotDownUs[s] = c->downUs;
+            mtb_selectSlot(mtb, s);
+            mtb_event(mtb, EV_ABS, ABS_MT_TRACKING_ID, mtb->nextTrackingID++);
+            mtb_event(mtb, EV_ABS, ABS_MT_POSITION_X, x);
+            mtb_event(mtb, EV_ABS, ABS_MT_POSITION_Y, y);
+        }
+        else
+        {
+            if (x != mtb->slotX[s])
+            {
+                mtb_selectSlot(mtb, s);
+                mtb_event(mtb, EV_ABS, ABS_MT_POSITION_X, x);
+            }
+            if (y != mtb->slotY[s])
+            {
+                mtb_selectSlot(mtb, s);
+                mtb_event(mtb, EV_ABS, ABS_MT_POSITION_Y, y);
+            }
+        }
+        mtb->slotX[s] = x;
+        mtb->slotY[s] = y;
+    }
+}
+
+/**
+ * Single touch emulation: BTN_TOUCH, the tool by the number of contacts, and
+ * ABS_X/Y following the oldest contact
+ */
+static void mtb_pointer(zul_mtbridge_t *mtb)
+{
+    int     s, count = 0, oldest = -1;
+
+    for (s = 0; s < MTB_MAX_SLOTS; s++)
+    {
+        if (mtb->slotID[s] < 0) continue;
+        count++;
+        if ((oldest < 0) || (mtb->slotDownUs[s] < mtb->slotDownUs[oldest]))
+        {
+            oldest = s;
+        }
+    }
+    if (count > NUM_TOOLS) count = NUM_TOOLS;
+
+    if ((count > 0) != (mtb->tool > 0))
+    {
+        mtb_event(mtb, EV_KEY, BTN_TOUCH, (count > 0));
+    }
+    if (count != mtb->tool)
+    {
+        if (mtb->tool > 0) mtb_event(mtb, EV_KEY, mtb_toolKeys[mtb->tool - 1], 0);
+        if (count > 0)     mtb_event(mtb, EV_KEY, mtb_toolKeys[count - 1], 1);
+        mtb->tool = count;
+    }
+
+    if (oldest >= 0)
+    {
+        if ((oldest != mtb->pointerSlot) || (mtb->slotX[oldest] != mtb->pointerX))
+        {
+            mtb_event(mtb, EV_ABS, ABS_X, mtb->slotX[oldest]);
+        }
+        if ((oldest != mtb->pointerSlot) || (mtb->slotY[oldest] != mtb->pointerY))
+        {
+            mtb_event(mtb, EV_ABS, ABS_Y, mtb->slotY[oldest]);
+        }
+        mtb->pointerX = mtb->slotX[oldest];
+        mtb->pointerY = mtb->slotY[oldest];
+    }
+    mtb->pointerSlot = oldest;
+}
+
+/**
+ * Write the pending events, with a SYN_REPORT, and account the latency.
+ * Return the number of events written, or -1 on error.
+ */
+static int mtb_flush(zul_mtbridge_t *mtb, uint64_t rxUs)
+{
+    size_t      len;
+    ssize_t     written;
+    uint64_t    us;
+    int         num = mtb->numEv;
+
+    if (num == 0) return 0;
+    mtb_event(mtb, EV_SYN, SYN_REPORT, 0);
+    num = mtb->numEv;
+    mtb->numEv = 0;
+
+    len = (size_t)num * sizeof(struct input_event);
+    do
+    {
+        written = write(mtb->fd, mtb->ev, len);
+    } while ((written < 0) && (errno == EINTR));
+
+    if (written != (ssize_t)len)
+    {
+        if (mtb->lat.writeErrors++ == 0)
+        {
+            zul_logf(1, "%s: write failed: %s", __FUNCTION__,
+                            (written < 0) ? strerror(errno) : "short write");
+        }
+        return -1;
+    }
+
+    if (rxUs != 0)
+    {
+        us = zul_monotonicUs();
+        lat_add(&mtb->lat.latency, (us > rxUs) ? us - rxUs : 0);
+    }
+    return num;
+}
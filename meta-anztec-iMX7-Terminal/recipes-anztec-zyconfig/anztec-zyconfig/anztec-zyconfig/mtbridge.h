@@ -0,0 +1,147 @@
+/*
+ *  Copyright (c) 2019 Zytronic Displays Limited. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact Zytronic, you can do so either via the
+ * website <www.zytronic.co.uk> or by paper mail:
+ * Zytronic, Whiteley Road, Blaydon on Tyne, Tyne & Wear, NE21 5NJ, UK
+ */
+
+
+
+
+
+
+
+
+
+/* Module Overview
+   ===============
+   This code bridges the touch reports of a device to a Linux input device,
+   created through /dev/uinput.  It is intended for private touch mode (see
+   zul_SetPrivateTouchMode()), where the controller no longer feeds the
+   desktop itself: the application sees the touches first, and the bridge
+   passes them on.
+
+   Each report is decoded into all of its contacts by a tracker of the
+   bridge's own (see tracker.h), transformed (swap/invert axes, scale to the
+   output range), and written as multitouch protocol B events:
+
+        ABS_MT_SLOT, ABS_MT_TRACKING_ID, ABS_MT_POSITION_X/Y   per contact
+        BTN_TOUCH, BTN_TOOL_FINGER.., ABS_X/Y                  pointer emulation
+        SYN_REPORT
+
+   A contact is given a free slot when it goes down, and a new tracking ID;
+   the slot is released (tracking ID -1) when it goes up.  Contacts beyond
+   MTB_MAX_SLOTS are not passed on.  The events of a report are written with
+   one write().
+
+   mtb_report() is meant to be called from the report handler, on the input
+   thread, with the time the report arrived; the time from then until the
+   write() has returned is kept as the latency of the report.
+
+   When the node given to mtb_create() is a regular file (created if it is
+   not under /dev), no input device is created, and the events are written
+   to the file: a recorded report stream may be replayed through the bridge,
+   and its output compared.
+
+ */
+
+#ifndef _ZY_MTBRIDGE_H
+#define _ZY_MTBRIDGE_H
+
+#include "zytypes.h"
+#include "latency.h"
+#include "tracker.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define  MTB_DEFAULT_NODE           "/dev/uinput"
+#define  MTB_DEFAULT_NAME           "Zytronic Touch Bridge"
+#define  MTB_MAX_SLOTS              (20)
+#define  MTB_IN_MAX                 (4095)      // report coordinate range
+
+// the host-side transform, applied in this order
+typedef struct mtb_transform
+{
+    bool        swapXY;
+    bool        invertX;
+    bool        invertY;
+    int         inMaxX;             // report range, 0 => MTB_IN_MAX
+    int         inMaxY;
+    int         outMaxX;            // input device range, 0 => as inMaxX
+    int         outMaxY;
+} mtb_transform_t;
+
+// report latency, from arrival to the return of write()
+typedef struct mtb_latency
+{
+    lat_hist_t  latency;            // count: reports written
+    uint32_t    dropped;            // contacts without a free slot
+    uint32_t    writeErrors;
+} mtb_latency_t;
+
+typedef struct zul_mtbridge zul_mtbridge_t;
+
+
+/**
+ * Create an input device through node (MTB_DEFAULT_NODE if NULL), with the
+ * given name (MTB_DEFAULT_NAME if NULL) and transform (none if NULL).
+ * Return NULL on failure.
+ */
+/*@null@*/
+zul_mtbridge_t *    mtb_create              (/*@null@*/ char const *node,
+                                                /*@null@*/ char const *name,
+                                                /*@null@*/
+                                                mtb_transform_t const *xf);
+
+/**
+ * Release every contact still down, and remove the input device
+ */
+void                mtb_destroy             (/*@null@*/ zul_mtbridge_t *mtb);
+
+/**
+ * Decode a touch report and write the changes of its contacts.  rxUs is the
+ * time it arrived, from zul_monotonicUs(), or zero if not known.  Return the
+ * number of events written, or -1 on error.  Only one thread may call this.
+ *
+ * data may be NULL: the contacts whose release was lost (not reported for
+ * TRK_LOST_MS) are then released, e.g. when reports have stopped.
+ */
+int                 mtb_report              (zul_mtbridge_t *mtb,
+                                                uint8_t const *data, int len,
+                                                uint64_t rxUs);
+
+/**
+ * Release every contact, e.g. when the device goes away
+ */
+void                mtb_releaseAll          (zul_mtbridge_t *mtb);
+
+/**
+ * Copy the latency counts, and optionally clear them.  Any thread may call
+ * this.  lat_percentile() estimates a percentile (0..100) from them.
+ */
+void                mtb_getLatency          (zul_mtbridge_t *mtb,
+                                                mtb_latency_t *lat, bool clear);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ZY_MTBRIDGE_H
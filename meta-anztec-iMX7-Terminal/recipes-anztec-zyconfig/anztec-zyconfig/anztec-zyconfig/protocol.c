@@ -97,45 +97,6 @@ static const uint8_t ZCC       = 0x05;
 static const uint8_t STX       = 0x02;
 static const uint8_t ETX       = 0x03;
 
-enum messageCodes
-{
-    ReadViaSpi          =  37,  //  0x25
-    RestoreDefaults     =  41,  //  0x29
-    ResetController     =  61,  //  0x3D
-    ForceEqualisation   =  62,  //  0x3E
-    SetRawMode          =  64,  //  0x40
-    SetParam            =  77,  //  0x4D
-    GetParam            =  78,  //  0x4E
-    GetVersionString    =  79,  //  0x4F
-    SetSilentTouchMode  =  83,  //  0x53
-    StartBootLoader     =  99,  //  0x63
-    GetStatus           = 113,  //  0x71
-
-    // ZXY100 Only
-    SetTouchMode        =  63,  //  0x3F
-    GetSingleTouch100   =  65,  //  0x41 -- still required @ FW 501.36
-    GetSingleRawData100 =  66,  //  0x42 -- still required @ FW 501.36
-    OLD_GetVersions     =  73,  //  0x49 -- deprecated see GetVersionString
-    Old_GetSysReport    =  76,  //  0x4c -- still required @ FW 501.36
-
-    // the following may not be available in the ZXY100/110 ? TBD
-    DisableFlashWrite   =           0x82,
-    EnableFlashWrite    =           0x83,
-    ForceFlashWrite     =           0x84,
-
-    SetVirtualButton    = 151,  //  0x97
-    GetVirtualButton    = 152,  //  0x98
-    ClearVirtualButton  = 153,  //  0x99
-};
-
-
-enum packetIDs
-{
-    MasterRequest       =  102,  // 0x66
-    SlaveResponse       =  106,  // 0x6A
-};
-
-
 //
 // --- Private Prototypes ---
 //
@@ -378,6 +339,15 @@ bool  zul_encodeGetSpiRegister(/*@out@*/ uint8_t *buffer, int bufLen, uint8_t de
     return framePayload(buffer, bufLen, payload, payloadLen);
 }
 
+/**
+ * The message code of a framed request: ZCC, STX, length, MasterRequest, code
+ */
+uint8_t zul_requestMessageCode(uint8_t const *buffer)
+{
+    if (buffer == NULL) return 0;
+    return buffer[4];
+}
+
 /**
  * create a message in the supplied buffer to get a status value
 
@@ -731,6 +701,151 @@ bool  zul_encode_BL_ProgDataBlock(uint8_t *buffer, int bufLen,
 
 
 
+// ============================================================================
+// --- Reply Decoders ---
+// ============================================================================
+
+/*
+    Replies carry the same framing as requests, without the ZCC byte:
+
+        ||| STX || LEN | TYPE || MSG_CODE | index | LSB | MSB || CRC ...
+ */
+
+/**
+ * extract the 16 bit value from the reply to a get-config, get-status or SPI
+ * register request.   ToDo - check the CRC before making the value available
+ */
+bool zul_decodeValueReply(uint8_t *reply, uint16_t *value)
+{
+    if ((reply == NULL) || (value == NULL))
+        return false;
+
+    *value  = (uint16_t)reply[5];
+    *value += (uint16_t)reply[6]*0x100;
+    return true;
+}
+
+/**
+ * copy the string from the reply to a version string request
+ */
+bool zul_decodeVerStrReply(uint8_t *reply, char *str, int len)
+{
+    if ((reply == NULL) || (str == NULL) || (len < 1))
+        return false;
+
+    if (reply[0] != STX)                        return false;
+    if (reply[1] != 0x3e)                       return false;
+    if (reply[2] != (uint8_t)SlaveResponse)     return false;
+    if (reply[3] != (uint8_t)GetVersionString)  return false;
+
+    // the string can't extend beyond the 64 byte reply
+    if (len > 64 - 5) len = 64 - 5;
+
+    strncpy(str, (char *)reply + 5, (size_t)len);
+    str[len-1] = '\0';    // force string termination
+    return true;
+}
+
+
+// ============================================================================
+// --- Controller Side Codecs ---
+// ============================================================================
+
+/**
+ * check the framing and CRC of a request encoded above, and locate its
+ * payload
+ */
+bool zul_decodeRequest(uint8_t const *buffer, int bufLen,
+                        uint8_t const **payload, int *payloadLen)
+{
+    int         packetLen;
+    uint16_t    crcVal;
+
+    if ((buffer == NULL) || (bufLen < 8))       return false;
+    if (buffer[0] != ZCC)                       return false;
+    if (buffer[1] != STX)                       return false;
+    if (buffer[3] != (uint8_t)MasterRequest)    return false;
+
+    // LEN covers the length byte, the packet ID, the payload and the CRC
+    packetLen = buffer[2];
+    if ((packetLen < 5) || (packetLen + 3 > bufLen)) return false;
+    if (buffer[packetLen + 2] != ETX)           return false;
+
+    crcVal = zul_getCRC((uint8_t *)buffer + 2, (size_t)(packetLen - 2));
+    if ( (buffer[packetLen]     != lsb_16(crcVal)) ||
+         (buffer[packetLen + 1] != msb_16(crcVal)) )
+    {
+        return false;
+    }
+
+    if (payload != NULL)    *payload    = buffer + 4;
+    if (payloadLen != NULL) *payloadLen = packetLen - 4;
+    return true;
+}
+
+/**
+ * frame a reply, as a controller would: STX, LEN, SlaveResponse, payload, CRC
+ * and ETX, with the rest of the 64 byte report zeroed
+ */
+static bool frameReply(uint8_t *buffer, int bufLen, uint8_t const *payload,
+                                                            int payloadLen)
+{
+    int         packetLen = payloadLen + 4;
+    uint16_t    crcVal;
+
+    if ((buffer == NULL) || (bufLen < 64) || (packetLen + 2 > 64))
+        return false;
+
+    memset(buffer, 0, (size_t)bufLen);
+    buffer[0] = STX;
+    buffer[1] = lsb_int(packetLen);
+    buffer[2] = SlaveResponse;
+    memcpy(buffer + 3, payload, (size_t)payloadLen);
+
+    crcVal = zul_getCRC(buffer + 1, (size_t)(packetLen - 2));
+    buffer[packetLen - 1]   = lsb_16(crcVal);
+    buffer[packetLen]       = msb_16(crcVal);
+    buffer[packetLen + 1]   = ETX;
+    return true;
+}
+
+/**
+ * encode the reply to a get-config, get-status or SPI register request, or
+ * the acknowledgement of a set-config request
+ */
+bool zul_encodeValueReply(uint8_t *buffer, int bufLen, uint8_t msgCode,
+                                                uint8_t index, uint16_t value)
+{
+    uint8_t payload[4];
+
+    payload[0] = msgCode;
+    payload[1] = index;
+    payload[2] = lsb_16(value);
+    payload[3] = msb_16(value);
+
+    return frameReply(buffer, bufLen, payload, 4);
+}
+
+/**
+ * encode the reply to a version string request; the string field is of fixed
+ * length, as zul_decodeVerStrReply() expects
+ */
+bool zul_encodeVerStrReply(uint8_t *buffer, int bufLen, uint8_t index,
+                                                            char const *str)
+{
+    uint8_t payload[VER_STR_REPLY_LEN - 4];
+
+    memset(payload, 0, sizeof(payload));
+    payload[0] = (uint8_t)GetVersionString;
+    payload[1] = index;
+    if (str != NULL)
+    {
+        strncpy((char *)payload + 2, str, sizeof(payload) - 3);
+    }
+
+    return frameReply(buffer, bufLen, payload, (int)sizeof(payload));
+}
+
 // ============================================================================
 // --- Private Implementation ---
 // ============================================================================
@@ -52,6 +52,46 @@ extern "C" {
 #define  SINGLE_BYTE_MSG_LEN        (8)
 #define  DUAL_BYTE_MSG_LEN          (9)
 #define  BL_REPLY_BUF_LEN           (20)    // big enough for the BL Versions report (17 bytes)
+#define  VER_STR_REPLY_LEN          (0x3e)  // packet length of a version string reply
+
+
+enum messageCodes
+{
+    ReadViaSpi          =  37,  //  0x25
+    RestoreDefaults     =  41,  //  0x29
+    ResetController     =  61,  //  0x3D
+    ForceEqualisation   =  62,  //  0x3E
+    SetRawMode          =  64,  //  0x40
+    SetParam            =  77,  //  0x4D
+    GetParam            =  78,  //  0x4E
+    GetVersionString    =  79,  //  0x4F
+    SetSilentTouchMode  =  83,  //  0x53
+    StartBootLoader     =  99,  //  0x63
+    GetStatus           = 113,  //  0x71
+
+    // ZXY100 Only
+    SetTouchMode        =  63,  //  0x3F
+    GetSingleTouch100   =  65,  //  0x41 -- still required @ FW 501.36
+    GetSingleRawData100 =  66,  //  0x42 -- still required @ FW 501.36
+    OLD_GetVersions     =  73,  //  0x49 -- deprecated see GetVersionString
+    Old_GetSysReport    =  76,  //  0x4c -- still required @ FW 501.36
+
+    // the following may not be available in the ZXY100/110 ? TBD
+    DisableFlashWrite   =           0x82,
+    EnableFlashWrite    =           0x83,
+    ForceFlashWrite     =           0x84,
+
+    SetVirtualButton    = 151,  //  0x97
+    GetVirtualButton    = 152,  //  0x98
+    ClearVirtualButton  = 153,  //  0x99
+};
+
+
+enum packetIDs
+{
+    MasterRequest       =  102,  // 0x66
+    SlaveResponse       =  106,  // 0x6A
+};
 
 
 enum opCodesBL  // ToDo - move to Protocol.c, with the BL parsers
@@ -128,6 +168,12 @@ bool        zul_encodeGetStatus         (/*@out@*/ uint8_t *buffer, int bufLen,
 bool        zul_encodeGetSpiRegister    (/*@out@*/ uint8_t *buffer, int bufLen,
                                                      uint8_t device, uint8_t index);
 
+/**
+ * the message code of an (application) request encoded by the above, as
+ * used by usb_getCtrlLatency()
+ */
+uint8_t     zul_requestMessageCode      (uint8_t const *buffer);
+
 /**
  * create a message in the supplied buffer to set a a config value to a
  * given value
@@ -193,6 +239,47 @@ bool        zul_encode_BL_ProgDataBlock (/*@out@*/ uint8_t *buffer, int bufLen,
                                                 size_t fwSize, uint8_t *pinfo);
 
 
+// ========================================================================================
+//          Reply Decoders
+// ========================================================================================
+
+/**
+ * extract the 16 bit value from the reply to a get-config, get-status or SPI
+ * register request
+ */
+bool        zul_decodeValueReply        (uint8_t *reply, /*@out@*/ uint16_t *value);
+
+/**
+ * copy the string from the reply to a version string request, return false
+ * if the reply is not a version string
+ */
+bool        zul_decodeVerStrReply       (uint8_t *reply, /*@out@*/ char *str, int len);
+
+
+// ========================================================================================
+//          Controller Side Codecs - used to simulate a controller
+// ========================================================================================
+
+/**
+ * check the framing and CRC of a request, and locate its payload (the
+ * message code and its arguments).  Return false if the request is invalid.
+ */
+bool        zul_decodeRequest           (uint8_t const *buffer, int bufLen,
+                                                /*@out@*/ uint8_t const **payload,
+                                                /*@out@*/ int *payloadLen);
+
+/**
+ * create the reply a controller sends to a value request (get-config,
+ * get-status, SPI register or set-config), or to a version string request.
+ * The buffer must hold a 64 byte report.
+ */
+bool        zul_encodeValueReply        (/*@out@*/ uint8_t *buffer, int bufLen,
+                                                uint8_t msgCode, uint8_t index,
+                                                uint16_t value);
+bool        zul_encodeVerStrReply       (/*@out@*/ uint8_t *buffer, int bufLen,
+                                                uint8_t index, char const *str);
+
+
 // ========================================================================================
 //          general utilities
 // ========================================================================================
@@ -0,0 +1,399 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* This code is provided as an example only.
+ * It puts a Multitouch touchscreen controller into raw data mode, and
+ * publishes its complete raw data frames in shared memory, for any number
+ * of local viewers and loggers, see rawshm.h.  With -m it is instead such
+ * a client: it attaches to the frames and reports their rate and range.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <ctype.h>
+
+#include "zytypes.h"
+#include "debug.h"
+#include "usb.h"
+#include "protocol.h"
+#include "services.h"
+#include "rawshm.h"
+#include "rawstats.h"
+
+#define TEMP_BUF_LEN        (1000)
+#define WAIT_MS             (200)
+
+int     g_deviceIndex   = -1;
+char    g_name[100+1]   = RSH_DEFAULT_NAME;
+int     g_slots         = RSH_DEFAULT_SLOTS;
+int     g_statsPeriod   = 10;       // seconds, 0 => at exit only
+bool    g_monitor       = false;
+bool    g_deviceOpen    = false;
+
+zul_rshwriter_t *   g_writer    = NULL;
+zul_rshreader_t *   g_reader    = NULL;
+
+// counts, since the last report
+uint32_t    g_frames    = 0;
+uint32_t    g_skipped   = 0;        // published, but not seen
+uint32_t    g_overrun   = 0;        // overwritten as read
+uint64_t    g_latUs     = 0;
+uint32_t    g_latMaxUs  = 0;
+rs_range_t  g_range     = { 255, 0, 0 };
+
+
+// ----------------------------------------------------------------------------
+
+void printStats(char const *title)
+{
+    printf("%s: %u frames", title, g_frames);
+    if (g_monitor && (g_frames > 0))
+    {
+        printf(", %u skipped, %u overrun, latency us mean %llu max %u, cells %u..%u",
+                    g_skipped, g_overrun,
+                    (unsigned long long)(g_latUs / g_frames), g_latMaxUs,
+                    g_range.min, g_range.max);
+    }
+    printf("\n");
+
+    g_frames = g_skipped = g_overrun = 0;
+    g_latUs = 0;
+    g_latMaxUs = 0;
+    g_range.min = 255;
+    g_range.max = 0;
+}
+
+// ----------------------------------------------------------------------------
+
+void cleanup(void)
+{
+    printf("CleanUp .. \n");
+    printStats(g_monitor ? "client" : "published");
+    rsh_detach(g_reader);
+    g_reader = NULL;
+    if (g_deviceOpen)
+    {
+        zul_SetRawMode(0);
+        zul_stopRawFrames();
+        (void)zul_closeDevice();
+        g_deviceOpen = false;
+    }
+    rsh_destroy(g_writer);
+    g_writer = NULL;
+    zul_EndServices();
+    printf("Done !\n");
+}
+
+void sigHandler( int sig)
+{
+    printf("handling signal %d\n", sig);
+    exit(0);
+}
+
+void setupHandlers(void)
+{
+    if (atexit(cleanup) != 0)
+    {
+        fprintf(stderr, "cannot set exit function\n");
+        exit(-1);
+    }
+
+    if (SIG_ERR == signal( SIGHUP, sigHandler))
+        printf ("Error loading signal handler SIGHUP\n");
+
+    if (SIG_ERR == signal( SIGINT, sigHandler))
+        printf ("Error loading signal handler SIGINT\n");
+
+    if (SIG_ERR == signal( SIGQUIT, sigHandler))
+        printf ("Error loading signal handler SIGQUIT\n");
+
+    if (SIG_ERR == signal( SIGTERM, sigHandler))
+        printf ("Error loading signal handler SIGTERM\n");
+}
+
+// ----------------------------------------------------------------------------
+
+
+void handleCommandLineOptions(int argCount, char **argStrings)
+{
+    int c;
+    opterr = 0;
+
+    while ((c = getopt (argCount, argStrings, "hd:n:k:ms:v:")) != -1)
+    {
+        switch (c)
+        {
+            case 'h':
+                fprintf(stderr, "This console program publishes the raw data frames of a Zytronic Multitouch\ncontroller in shared memory, or (-m) reads them.\n");
+                fprintf(stderr, "The following options are accepted:\n");
+                fprintf(stderr, "-d\ta device index\n");
+                fprintf(stderr, "-n\tthe shared memory name (default %s)\n", RSH_DEFAULT_NAME);
+                fprintf(stderr, "-k\tthe frames held (default %d)\n", RSH_DEFAULT_SLOTS);
+                fprintf(stderr, "-m\tmonitor the frames published by another instance\n");
+                fprintf(stderr, "-s\tthe statistics period in seconds, 0 for at exit only (default %d)\n", g_statsPeriod);
+                fprintf(stderr, "-v\tthe log level\n");
+                fprintf(stderr, "Usage : %s <options>\n", argStrings[0] );
+
+                exit(0);
+
+            case 'd':
+                g_deviceIndex = abs(atoi(optarg));
+                break;
+
+            case 'n':
+                strncpy(g_name, optarg, 100);
+                g_name[100] = '\0';
+                break;
+
+            case 'k':
+                g_slots = abs(atoi(optarg));
+                break;
+
+            case 'm':
+                g_monitor = true;
+                break;
+
+            case 's':
+                g_statsPeriod = abs(atoi(optarg));
+                break;
+
+            case 'v':
+                zul_setLogLevel(atoi(optarg));
+                break;
+
+            case '?':
+                if (strchr("dnksv", optopt) != NULL)
+                    fprintf (stderr, "Option -%c requires an argument.\n", optopt);
+                else if (isprint (optopt))
+                    fprintf (stderr, "Unknown option `-%c'.\n", optopt);
+                else
+                    fprintf (stderr,
+                        "Unknown option character `\\x%x'.\n",
+                        optopt);
+                exit(1);
+            default:
+                abort();
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * Client: take each frame in place, as a viewer would
+ */
+void monitor(void)
+{
+    uint32_t    last = 0, pubNo;
+    uint64_t    lastStats = zul_monotonicUs();
+    rsh_view_t  v;
+    rs_range_t  r;
+    int         rc;
+
+    printf("reading %s, ^C to stop\n", g_name);
+    while (true)
+    {
+        if (g_reader == NULL)
+        {
+            g_reader = rsh_attach(g_name);
+            if (g_reader == NULL)
+            {
+                (void)usleep(WAIT_MS * 1000);
+                continue;
+            }
+            (void)rsh_wait(g_reader, 0, 0, &last);
+        }
+
+        rc = rsh_wait(g_reader, last, WAIT_MS, &pubNo);
+        if (rc < 0)
+        {
+            // the publisher has gone, or restarted with a new segment
+            printf("%s closed\n", g_name);
+            rsh_detach(g_reader);
+            g_reader = NULL;
+            continue;
+        }
+        if (rc > 0)
+        {
+            if (last != 0) g_skipped += pubNo - last - 1;
+            last = pubNo;
+
+            if (rsh_view(g_reader, pubNo, &v))
+            {
+                uint64_t lat = zul_monotonicUs() - v.info.endUs;
+
+                rs_range8(v.cells, v.info.xWires * v.info.yWires, &r);
+                if (rsh_viewValid(g_reader, &v))
+                {
+                    g_frames++;
+                    g_latUs += lat;
+                    if (lat > g_latMaxUs) g_latMaxUs = (uint32_t)lat;
+                    if (r.min < g_range.min) g_range.min = r.min;
+                    if (r.max > g_range.max) g_range.max = r.max;
+                }
+                else
+                {
+                    g_overrun++;
+                }
+            }
+            else
+            {
+                g_overrun++;
+            }
+        }
+
+        if ( (g_statsPeriod > 0) &&
+             (zul_monotonicUs() - lastStats >= (uint64_t)g_statsPeriod * 1000000u) )
+        {
+            printStats("client");
+            lastStats = zul_monotonicUs();
+        }
+    }
+}
+
+/**
+ * Publisher: copy each frame straight into its slot
+ */
+void publish(void)
+{
+    uint32_t        last = 0;
+    uint64_t        lastStats = zul_monotonicUs();
+    ZXY_identity    id;
+    rf_frame_t      info;
+    uint8_t *       cells;
+    uint8_t *       missing;
+    int             maxCells, n;
+
+    if ( (zul_getIdentity(&id) != SUCCESS) ||
+         (zul_startRawFrames() != SUCCESS) )
+    {
+        fprintf(stderr, "raw data frames are not available from this device\n");
+        exit(EXIT_FAILURE);
+    }
+    maxCells = id.xWires * id.yWires;
+
+    g_writer = rsh_create(g_name, g_slots, maxCells, id.pid);
+    if (g_writer == NULL)
+    {
+        fprintf(stderr, "cannot create %s\n", g_name);
+        exit(EXIT_FAILURE);
+    }
+    zul_SetRawMode(1);
+
+    printf("publishing %d x %d frames to %s, ^C to stop\n",
+                                        id.xWires, id.yWires, g_name);
+    while (true)
+    {
+        n = zul_waitRawFrame(last, WAIT_MS, &info, NULL, NULL, 0);
+        if ( (n > 0) &&
+             (rsh_beginFrame(g_writer, &cells, &missing) == SUCCESS) )
+        {
+            n = zul_waitRawFrame(last, 0, &info, cells, missing, maxCells);
+            if (n > 0)
+            {
+                (void)rsh_commitFrame(g_writer, &info);
+                last = (uint32_t)n;
+                g_frames++;
+            }
+            else
+            {
+                rsh_abortFrame(g_writer);
+            }
+        }
+
+        if ( (g_statsPeriod > 0) &&
+             (zul_monotonicUs() - lastStats >= (uint64_t)g_statsPeriod * 1000000u) )
+        {
+            printStats("published");
+            lastStats = zul_monotonicUs();
+        }
+    }
+}
+
+int main(int numArgs, char ** argv)
+{
+    int     i;
+    int     numDevs;
+    char    tempBuffer[TEMP_BUF_LEN +1];
+
+    handleCommandLineOptions(numArgs, argv);
+
+    i = zul_InitServices();
+    if (i!=0)
+    {
+        printf("zylibUSB open fail %d\n", i);
+        exit(EXIT_FAILURE);
+    }
+    setupHandlers();    // auto close library if interrupted
+
+    if (g_monitor)
+    {
+        monitor();
+        return 0;
+    }
+
+    numDevs = zul_getDeviceList(tempBuffer, TEMP_BUF_LEN);
+    if (numDevs > 0)
+    {
+        printf("Found Zytronic touchscreen devices:\n%s", tempBuffer);
+        if (g_deviceIndex == -1)
+        {
+            g_deviceIndex = atoi(tempBuffer);
+        }
+    }
+    if (numDevs == 0)
+    {
+        printf("No Zytronic devices found\n");
+        exit(EXIT_FAILURE);
+    }
+    if (numDevs < 0)
+    {
+        printf("ERROR %d\n", numDevs);
+        exit(EXIT_FAILURE);
+    }
+
+    printf( "Open device #%d ... ", g_deviceIndex );
+    i = zul_openDevice(g_deviceIndex);
+    if (i != 0)
+    {
+        printf( "Error [%d] opening device index %d.\n", i, g_deviceIndex );
+        exit(EXIT_FAILURE);
+    }
+    printf( "OPENED\n" );
+    g_deviceOpen = true;
+
+    publish();
+
+    //     zul_EndServices();   // see atexit(cleanup) !
+    return 0;
+}
@@ -0,0 +1,361 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* For a module overview, see the header file
+ */
+
+#include <string.h>
+
+// the vector paths load the LSB first wire values of a report as lanes
+#if (defined(__ARM_NEON) || defined(__ARM_NEON__)) && !defined(__ARM_BIG_ENDIAN)
+#define RDEC_NEON
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#define RDEC_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "rawdecode.h"
+#include "debug.h"
+
+//
+// --- Module Types ---
+//
+
+#define REPORT_LEN                  (64)
+#define SC_HEADER_LEN               (2)         // report ID, packet
+#define MT_HEADER_LEN               (4)         // report ID, column, row, cells
+
+namespace
+{
+
+// packet layouts of the self capacitance families, by packet number
+struct Zxy100Layout
+{
+    typedef uint8_t     sample_t;
+    enum { PACKETS = 3 };
+
+    static constexpr int wires      (int pkt) { return (pkt < 2) ? 62 : 4; }
+    static constexpr int firstWire  (int pkt) { return pkt * 62; }
+    // the X wire count for which the packet is the last
+    static constexpr int lastFor    (int pkt) { return 16 << pkt; }
+};
+
+struct Zxy110Layout
+{
+    typedef uint16_t    sample_t;
+    enum { PACKETS = 3 };
+
+    static constexpr int wires      (int pkt) { return (pkt < 2) ? 31 : 2; }
+    static constexpr int firstWire  (int pkt) { return pkt * 31; }
+    static constexpr int lastFor    (int pkt) { return (pkt == 0) ? -1 : (8 << pkt); }
+};
+
+// the wire values of a report
+template <typename S> struct Sample;
+
+template <> struct Sample<uint8_t>
+{
+    enum { BYTES = 1, CHECKED = 0 };
+    static uint8_t  load(uint8_t const *p, int i) { return p[i]; }
+};
+
+template <> struct Sample<uint16_t>
+{
+    enum { BYTES = 2, CHECKED = 1 };
+    // LSB first, whatever the host byte order
+    static uint16_t load(uint8_t const *p, int i)
+    {
+        return (uint16_t)(p[2 * i] | (p[2 * i + 1] << 8));
+    }
+};
+
+// clipping policies
+struct NoClip
+{
+    template <typename S> static S store(S v) { return v; }
+};
+
+struct ClipTo8
+{
+    static uint8_t store(uint16_t v) { return (uint8_t)((v > 255) ? 255 : v); }
+};
+
+
+//
+// --- Module Prototypes ---
+//
+
+template <class Layout, typename Out, class Clip, int PKT>
+void            rdec_packet             (uint8_t const *p, Out *wireSig);
+
+int             rdec_vector             (Sample<uint8_t>, uint8_t const *p,
+                                            uint8_t *wire, int n, unsigned *odd);
+template <typename Out>
+int             rdec_vector             (Sample<uint16_t>, uint8_t const *p,
+                                            Out *wire, int n, unsigned *odd);
+
+template <class Layout, typename Out, class Clip>
+void            rdec_decodeSC           (uint8_t const *data, Out *wireSig,
+                                            uint16_t xWires, bool *allValid);
+
+} // namespace
+
+
+// ============================================================================
+// --- Public Services ---
+// ============================================================================
+
+void rdec_decode100(uint8_t const *data, uint8_t *wireSig, uint16_t xWires,
+                                                            bool *allValid)
+{
+    rdec_decodeSC<Zxy100Layout, uint8_t, NoClip>(data, wireSig, xWires,
+                                                                allValid);
+}
+
+void rdec_decode110(uint8_t const *data, uint16_t *wireSig, uint16_t xWires,
+                                                            bool *allValid)
+{
+    rdec_decodeSC<Zxy110Layout, uint16_t, NoClip>(data, wireSig, xWires,
+                                                                allValid);
+}
+
+void rdec_decode110Clipped(uint8_t const *data, uint8_t *wireSig,
+                                            uint16_t xWires, bool *allValid)
+{
+    rdec_decodeSC<Zxy110Layout, uint8_t, ClipTo8>(data, wireSig, xWires,
+                                                                allValid);
+}
+
+int rdec_decodeMT(uint8_t const *data, uint8_t *image, uint16_t xWires,
+                                                            uint16_t yWires)
+{
+    uint8_t const * p       = data + MT_HEADER_LEN;
+    int             col     = data[1];
+    int             row     = data[2];
+    int             n       = data[3];
+    int             written = 0;
+
+    // there are invalid FF values for row and col coming from the controller!
+    if ((col >= xWires) && (row >= yWires)) return -1;
+    if ((col >= xWires) || (row >= yWires)) return 0;
+    if (n > REPORT_LEN - MT_HEADER_LEN) n = REPORT_LEN - MT_HEADER_LEN;
+
+    // the cells of a column are contiguous: a copy per column
+    while ((n > 0) && (col < xWires))
+    {
+        int run = yWires - row;
+        if (run > n) run = n;
+
+        memcpy(image + yWires * col + row, p, (size_t)run);
+        p       += run;
+        n       -= run;
+        written += run;
+        row      = 0;
+        col++;
+    }
+    return written;
+}
+
+
+// ============================================================================
+// --- Private Implementation ---
+// ============================================================================
+
+namespace
+{
+
+/**
+ * Decode the wires of packet PKT: the count and position are constants.
+ * The vector path takes what it can, and the scalar loop the rest.
+ */
+template <class Layout, typename Out, class Clip, int PKT>
+void rdec_packet(uint8_t const *p, Out *wireSig)
+{
+    typedef typename Layout::sample_t S;
+
+    static_assert(Layout::firstWire(PKT) + Layout::wires(PKT) <= RDEC_SC_WIRES,
+                                        "packet beyond the raw image");
+    static_assert(SC_HEADER_LEN + Layout::wires(PKT) * Sample<S>::BYTES
+                                        <= REPORT_LEN, "packet beyond the report");
+
+    Out *       wire = wireSig + Layout::firstWire(PKT);
+    unsigned    odd  = 0;
+    S           maxV = 0;
+    int         i;
+
+    for (i = rdec_vector(Sample<S>(), p, wire, Layout::wires(PKT), &odd);
+         i < Layout::wires(PKT); i++)
+    {
+        S v = Sample<S>::load(p, i);
+
+        if (Sample<S>::CHECKED)
+        {
+            odd += (v > RDEC_ODD_WIRE_VALUE) ? 1u : 0u;
+        }
+        wire[i] = Clip::store(v);
+    }
+
+    // the sanity check, once per packet; the largest value only if needed
+    if (Sample<S>::CHECKED && (odd != 0))
+    {
+        for (i = 0; i < Layout::wires(PKT); i++)
+        {
+            S v = Sample<S>::load(p, i);
+            maxV = (v > maxV) ? v : maxV;
+        }
+        zul_logf(0, "ODD WIRE-VALUE x%u, max %05d\n", odd, (int)maxV);
+    }
+}
+
+/**
+ * One byte wires are stored as they are
+ */
+int rdec_vector(Sample<uint8_t>, uint8_t const *p, uint8_t *wire, int n,
+                                                                unsigned *odd)
+{
+    (void)odd;
+    memcpy(wire, p, (size_t)n);
+    return n;
+}
+
+#if defined(RDEC_NEON)
+
+inline void rdec_store(uint16_t *wire, uint16x8_t v) { vst1q_u16(wire, v); }
+inline void rdec_store(uint8_t *wire, uint16x8_t v)  { vst1_u8(wire, vqmovn_u16(v)); }
+
+/**
+ * Two byte wires, eight at a time: count those above the sanity limit, and
+ * store them, clipped to 8 bits into a uint8_t buffer.  Return the wires
+ * done.
+ */
+template <typename Out>
+int rdec_vector(Sample<uint16_t>, uint8_t const *p, Out *wire, int n,
+                                                                unsigned *odd)
+{
+    uint16x8_t  limit = vdupq_n_u16(RDEC_ODD_WIRE_VALUE);
+    uint16x8_t  count = vdupq_n_u16(0);
+    uint64x2_t  sum;
+    int         i;
+
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        uint16x8_t v = vreinterpretq_u16_u8(vld1q_u8(p + 2 * i));
+
+        count = vsubq_u16(count, vcgtq_u16(v, limit));  // all ones: +1
+        rdec_store(wire + i, v);
+    }
+    sum   = vpaddlq_u32(vpaddlq_u16(count));
+    *odd += (unsigned)(vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1));
+    return i;
+}
+
+#elif defined(RDEC_SSE2)
+
+inline void rdec_store(uint16_t *wire, __m128i v)
+{
+    _mm_storeu_si128((__m128i *)wire, v);
+}
+
+inline void rdec_store(uint8_t *wire, __m128i v)
+{
+    // min(v, 255), then pack: packus would take large values as negative
+    v = _mm_sub_epi16(v, _mm_subs_epu16(v, _mm_set1_epi16(255)));
+    _mm_storel_epi64((__m128i *)wire, _mm_packus_epi16(v, v));
+}
+
+/**
+ * Two byte wires, eight at a time: count those above the sanity limit, and
+ * store them, clipped to 8 bits into a uint8_t buffer.  Return the wires
+ * done.
+ */
+template <typename Out>
+int rdec_vector(Sample<uint16_t>, uint8_t const *p, Out *wire, int n,
+                                                                unsigned *odd)
+{
+    __m128i limit = _mm_set1_epi16(RDEC_ODD_WIRE_VALUE);
+    __m128i zero  = _mm_setzero_si128();
+    int     i;
+
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        __m128i v     = _mm_loadu_si128((__m128i const *)(p + 2 * i));
+        __m128i sane  = _mm_cmpeq_epi16(_mm_subs_epu16(v, limit), zero);
+
+        // two mask bits per wire at or below the limit
+        *odd += 8u - (unsigned)__builtin_popcount(_mm_movemask_epi8(sane)) / 2u;
+        rdec_store(wire + i, v);
+    }
+    return i;
+}
+
+#else
+
+// no vector path: all by the scalar loop
+template <typename Out>
+int rdec_vector(Sample<uint16_t>, uint8_t const *, Out *, int, unsigned *)
+{
+    return 0;
+}
+
+#endif
+
+template <class Layout, typename Out, class Clip>
+void rdec_decodeSC(uint8_t const *data, Out *wireSig, uint16_t xWires,
+                                                            bool *allValid)
+{
+    uint8_t const * p   = data + SC_HEADER_LEN;
+    int             pkt = data[1];
+
+    static_assert(Layout::PACKETS == 3, "a case per packet");
+
+    switch (pkt)
+    {
+        case 0:
+            rdec_packet<Layout, Out, Clip, 0>(p, wireSig);
+            break;
+        case 1:
+            rdec_packet<Layout, Out, Clip, 1>(p, wireSig);
+            break;
+        case 2:
+            rdec_packet<Layout, Out, Clip, 2>(p, wireSig);
+            break;
+        default:
+            // error case - take no data
+            return;
+    }
+
+    if ((allValid != NULL) && ((int)xWires == Layout::lastFor(pkt)))
+    {
+        *allValid = true;   // no missing wire values
+    }
+}
+
+} // namespace
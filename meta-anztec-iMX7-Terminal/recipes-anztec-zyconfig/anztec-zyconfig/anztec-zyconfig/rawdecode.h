@@ -0,0 +1,91 @@
+/*
+ *  Copyright (c) 2019 Zytronic Displays Limited. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact Zytronic, you can do so either via the
+ * website <www.zytronic.co.uk> or by paper mail:
+ * Zytronic, Whiteley Road, Blaydon on Tyne, Tyne & Wear, NE21 5NJ, UK
+ */
+
+
+
+/* Module Overview
+   ===============
+   This code decodes the raw data reports (RAW_DATA) of all the controller
+   families into the application's raw data buffers, for the raw data
+   handlers of services.c and services_sc.c.
+
+   Report formats:
+        ZXY100  [1] packet 0..2, then one byte per wire; the packets carry
+                62, 62 and 4 wires, at wires 0, 62 and 124
+        ZXY110  [1] packet 0..2, then two bytes per wire, LSB first; the
+                packets carry 31, 31 and 2 wires, at wires 0, 31 and 62
+        MT      [1] column, [2] row, [3] number of cells, then one byte per
+                cell, in row order, wrapping to the next column; a column
+                and row both out of range mark a status report
+
+   A self capacitance buffer is marked allValid when the packet that is the
+   last for its X wire count arrives.  ZXY110 wire values above 100 are
+   reported once per packet, not once per wire.  The ZXY110 values may be
+   clipped to 8 bits, into a ZXY100 buffer, so that the ZXY100 tools run on
+   a ZXY110.
+
+   The decoder is one C++ template, instantiated per family, sample width
+   and clipping policy, so that each packet's wire count and position are
+   compile time constants.  ZXY110 wires are widened, clipped and checked
+   eight at a time with NEON or SSE2 where built for it, and ZXY100 wires
+   are copied; a scalar loop does the rest.  The entry points are plain C.
+
+ */
+
+#ifndef _ZY_RAWDECODE_H
+#define _ZY_RAWDECODE_H
+
+#include "zytypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define  RDEC_SC_WIRES              (128)       // wireSig entries
+#define  RDEC_ODD_WIRE_VALUE        (100)       // ZXY110 sanity limit
+
+/**
+ * Self capacitance: decode a report into wireSig (RDEC_SC_WIRES values),
+ * for a sensor of xWires X wires, setting *allValid as described above.
+ * A packet number out of range is ignored.
+ */
+void            rdec_decode100          (uint8_t const *data, uint8_t *wireSig,
+                                            uint16_t xWires, bool *allValid);
+void            rdec_decode110          (uint8_t const *data, uint16_t *wireSig,
+                                            uint16_t xWires, bool *allValid);
+void            rdec_decode110Clipped   (uint8_t const *data, uint8_t *wireSig,
+                                            uint16_t xWires, bool *allValid);
+
+/**
+ * Multitouch: decode a report into image, cell (col,row) at
+ * [yWires * col + row].  Return the cells written, or -1 for a status
+ * report.  Cells beyond the array are dropped.
+ */
+int             rdec_decodeMT           (uint8_t const *data, uint8_t *image,
+                                            uint16_t xWires, uint16_t yWires);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ZY_RAWDECODE_H
@@ -0,0 +1,170 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* This program times the raw data report decoders, see rawdecode.h: the
+ * mean time per report, and the reports per second, of each decoder on a
+ * stream of reports as the controllers send them.  The ZXY110 wire values
+ * are kept sane, so that no time goes on logging.
+ *
+ * Usage: rawdecodeBench [reports]
+ *   reports    reports decoded per decoder, default 10000000
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "zytypes.h"
+#include "rawdecode.h"
+
+#define REPORT_LEN          (64)
+#define RAW_DATA_ID         (6)
+#define NUM_REPORTS         (64)        // in the stream, cycled
+#define MT_X_WIRES          (80)
+#define MT_Y_WIRES          (48)
+
+uint8_t         g_reports[NUM_REPORTS][REPORT_LEN];
+uint8_t         g_wires8[RDEC_SC_WIRES];
+uint16_t        g_wires16[RDEC_SC_WIRES];
+uint8_t         g_image[MT_X_WIRES * MT_Y_WIRES];
+long            g_count     = 10000000;
+volatile int    g_sink;                 // keeps the results alive
+
+
+// ----------------------------------------------------------------------------
+
+uint64_t nowNs(void)
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Self capacitance reports: packets 0, 1, 2 in turn, with ZXY110 values
+ */
+void makeSCReports(void)
+{
+    int r, i;
+
+    for (r = 0; r < NUM_REPORTS; r++)
+    {
+        g_reports[r][0] = RAW_DATA_ID;
+        g_reports[r][1] = (uint8_t)(r % 3);
+        for (i = 2; i < REPORT_LEN; i += 2)
+        {
+            g_reports[r][i]     = (uint8_t)(rand() % (RDEC_ODD_WIRE_VALUE + 1));
+            g_reports[r][i + 1] = 0;
+        }
+    }
+}
+
+/**
+ * Multitouch reports: a frame of 60 cell reports, wrapping columns
+ */
+void makeMTReports(void)
+{
+    int r, i, cell = 0;
+
+    for (r = 0; r < NUM_REPORTS; r++)
+    {
+        if (cell + 60 > MT_X_WIRES * MT_Y_WIRES) cell = 0;
+        g_reports[r][0] = RAW_DATA_ID;
+        g_reports[r][1] = (uint8_t)(cell / MT_Y_WIRES);
+        g_reports[r][2] = (uint8_t)(cell % MT_Y_WIRES);
+        g_reports[r][3] = 60;
+        for (i = 4; i < REPORT_LEN; i++) g_reports[r][i] = (uint8_t)rand();
+        cell += 60;
+    }
+}
+
+void printRate(char const *name, uint64_t ns)
+{
+    double perReport = (double)ns / g_count;
+
+    printf("%-24s %8.1f ns/report %10.2f M reports/s\n", name, perReport,
+                                                        1000.0 / perReport);
+}
+
+// ----------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    uint64_t    start;
+    long        n;
+    bool        allValid = false;
+
+    if (argc > 1) g_count = atol(argv[1]);
+    if (g_count <= 0)
+    {
+        printf("usage: %s [reports]\n", argv[0]);
+        return 1;
+    }
+    printf("%ld reports per decoder\n", g_count);
+
+    srand(1);
+    makeSCReports();
+
+    start = nowNs();
+    for (n = 0; n < g_count; n++)
+    {
+        rdec_decode100(g_reports[n % NUM_REPORTS], g_wires8, 64, &allValid);
+    }
+    printRate("rdec_decode100", nowNs() - start);
+    g_sink += g_wires8[n % RDEC_SC_WIRES];
+
+    start = nowNs();
+    for (n = 0; n < g_count; n++)
+    {
+        rdec_decode110(g_reports[n % NUM_REPORTS], g_wires16, 32, &allValid);
+    }
+    printRate("rdec_decode110", nowNs() - start);
+    g_sink += g_wires16[n % RDEC_SC_WIRES];
+
+    start = nowNs();
+    for (n = 0; n < g_count; n++)
+    {
+        rdec_decode110Clipped(g_reports[n % NUM_REPORTS], g_wires8, 32, &allValid);
+    }
+    printRate("rdec_decode110Clipped", nowNs() - start);
+    g_sink += g_wires8[n % RDEC_SC_WIRES];
+
+    makeMTReports();
+
+    start = nowNs();
+    for (n = 0; n < g_count; n++)
+    {
+        g_sink += rdec_decodeMT(g_reports[n % NUM_REPORTS], g_image,
+                                                MT_X_WIRES, MT_Y_WIRES);
+    }
+    printRate("rdec_decodeMT", nowNs() - start);
+
+    return 0;
+}
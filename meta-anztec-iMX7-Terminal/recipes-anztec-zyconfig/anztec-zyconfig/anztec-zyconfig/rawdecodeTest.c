@@ -0,0 +1,546 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* This program tests the raw data report decoders, see rawdecode.h, against
+ * copies of the raw data handlers they replaced: every decoder must leave
+ * the raw data buffers byte for byte as the handler did, on random reports,
+ * every packet number and X wire count, and multitouch reports that wrap
+ * columns or run off the image.
+ *
+ * The handlers logged every ZXY110 wire value above 100; the decoders log
+ * once per packet, with the count and the largest value, which is checked
+ * by capturing stdout.  Where a handler wrote outside the image (a
+ * multitouch report with only the column or only the row out of range, or
+ * more cells than a report holds) the decoder drops the cells, and the test
+ * checks that instead.
+ *
+ * Usage: rawdecodeTest [seed]
+ * Exit status: 0 passed, 1 failed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "zytypes.h"
+#include "debug.h"
+#include "rawdecode.h"
+
+#define REPORT_LEN          (64)
+#define RAW_DATA_ID         (6)
+#define MAX_IMAGE           (256 * 256)
+#define NUM_RANDOM          (100000)
+#define UNTOUCHED           (0xA5)
+
+static uint16_t const   g_xWires[]  = { 0, 8, 16, 32, 64, 128 };
+
+uint8_t     g_report[256 + 4];      // the handlers could read beyond 64 bytes
+uint8_t     g_ref8[RDEC_SC_WIRES],  g_out8[RDEC_SC_WIRES];
+uint16_t    g_ref16[RDEC_SC_WIRES], g_out16[RDEC_SC_WIRES];
+uint8_t     g_refImage[MAX_IMAGE],  g_outImage[MAX_IMAGE];
+
+int         g_failures  = 0;
+int         g_checks    = 0;
+
+
+// ----------------------------------------------------------------------------
+// The self capacitance and multitouch RAW_DATA handlers, as they were, less
+// the checks on the report ID and raw data mode.  The ZXY110 ones count the
+// odd wire values, instead of logging each one.
+
+void ref_decode100(uint8_t *data, uint8_t *wireSig, uint16_t xWires, bool *allValid)
+{
+    uint8_t *p = data + 1;
+    uint8_t *wire;
+    int     wiresInPacket, i;
+
+    switch (*p)
+    {
+        case 0:
+            wire = &wireSig[0];
+            wiresInPacket = 62;
+            if (xWires == 16) *allValid = true;
+            break;
+        case 1:
+            wire = &wireSig[62];
+            wiresInPacket = 62;
+            if (xWires == 32) *allValid = true;
+            break;
+        case 2:
+            wire = &wireSig[124];
+            wiresInPacket = 4;
+            if (xWires == 64) *allValid = true;
+            break;
+        default:
+            wire = &wireSig[0];
+            wiresInPacket = 0;
+            break;
+    }
+
+    p++;
+    for (i = 0; i < wiresInPacket; i++)
+    {
+        *wire++ = *p++;
+    }
+}
+
+void ref_decode110(uint8_t *data, uint16_t *wireSig, uint16_t xWires, bool *allValid,
+                                                    unsigned *odd, int *maxOdd)
+{
+    uint8_t  *p = data + 1;
+    uint16_t *wire;
+    int      wiresInPacket, i;
+
+    switch (*p)
+    {
+        case 0:
+            wire = &wireSig[0];
+            wiresInPacket = 31;
+            break;
+        case 1:
+            wire = &wireSig[31];
+            wiresInPacket = 31;
+            if (xWires == 16) *allValid = true;
+            break;
+        case 2:
+            wire = &wireSig[62];
+            wiresInPacket = 2;
+            if (xWires == 32) *allValid = true;
+            break;
+        default:
+            wire = &wireSig[0];
+            wiresInPacket = 0;
+            break;
+    }
+
+    p++;
+    for (i = 0; i < wiresInPacket; i++)
+    {
+        uint16_t v = (*p++);
+        v += (0x100 * (*p++));
+        if (v > 100)
+        {
+            (*odd)++;
+            if (v > *maxOdd) *maxOdd = v;
+        }
+        *wire++ = v;
+    }
+}
+
+void ref_decode110Clipped(uint8_t *data, uint8_t *wireSig, uint16_t xWires, bool *allValid,
+                                                    unsigned *odd, int *maxOdd)
+{
+    uint8_t *p = data + 1;
+    uint8_t *wire;
+    int     wiresInPacket, i;
+
+    switch (*p)
+    {
+        case 0:
+            wire = &wireSig[0];
+            wiresInPacket = 31;
+            break;
+        case 1:
+            wire = &wireSig[31];
+            wiresInPacket = 31;
+            if (xWires == 16) *allValid = true;
+            break;
+        case 2:
+            wire = &wireSig[62];
+            wiresInPacket = 2;
+            if (xWires == 32) *allValid = true;
+            break;
+        default:
+            wire = &wireSig[0];
+            wiresInPacket = 0;
+            break;
+    }
+
+    p++;
+    for (i = 0; i < wiresInPacket; i++)
+    {
+        uint16_t v = (*p++);
+        v += (0x100 * (*p++));
+        if (v > 100)
+        {
+            (*odd)++;
+            if (v > *maxOdd) *maxOdd = v;
+        }
+        *wire++ = (v > 255) ? 255 : (uint8_t)v;
+    }
+}
+
+/**
+ * Return the cells written, or -1 for a status report
+ */
+int ref_decodeMT(uint8_t *data, uint8_t *image, uint16_t xWires, uint16_t yWires)
+{
+    uint8_t *p = data + 1;
+    uint8_t colIndex, rowIndex, numCells, i;
+
+    colIndex = *p++;
+    rowIndex = *p++;
+    numCells = *p++;
+
+    if ((colIndex >= xWires) && (rowIndex >= yWires))
+    {
+        return -1;
+    }
+
+    for (i = 0; i < numCells; i++)
+    {
+        image[yWires * colIndex + rowIndex] = *p++;
+        rowIndex++;
+        if (rowIndex == yWires)
+        {
+            rowIndex = 0; colIndex++;
+            if (colIndex == xWires) return i + 1;
+        }
+    }
+    return numCells;
+}
+
+// ----------------------------------------------------------------------------
+
+void check(bool ok, char const *what)
+{
+    g_checks++;
+    if (!ok)
+    {
+        printf("FAIL: %s\n", what);
+        g_failures++;
+    }
+}
+
+void randomReport(int packet, int maxWire)
+{
+    int i;
+
+    for (i = 0; i < (int)sizeof(g_report); i++) g_report[i] = (uint8_t)rand();
+    g_report[0] = RAW_DATA_ID;
+    g_report[1] = (uint8_t)packet;
+
+    // mostly sane ZXY110 values, so that the odd ones are few
+    if (maxWire > 0)
+    {
+        for (i = 2; i < REPORT_LEN; i += 2)
+        {
+            uint16_t v = (uint16_t)(rand() % maxWire);
+            g_report[i]     = (uint8_t)v;
+            g_report[i + 1] = (uint8_t)(v >> 8);
+        }
+    }
+}
+
+// stdout, while the decoder's logging is captured
+static int      g_stdout    = -1;
+static FILE *   g_capture   = NULL;
+
+void captureBegin(void)
+{
+    fflush(stdout);
+    g_capture = tmpfile();
+    g_stdout  = dup(STDOUT_FILENO);
+    if ((g_capture != NULL) && (g_stdout >= 0))
+    {
+        (void)dup2(fileno(g_capture), STDOUT_FILENO);
+    }
+}
+
+/**
+ * Return the captured output, in buf
+ */
+void captureEnd(char *buf, size_t len)
+{
+    size_t got = 0;
+
+    fflush(stdout);
+    if (g_stdout >= 0)
+    {
+        (void)dup2(g_stdout, STDOUT_FILENO);
+        close(g_stdout);
+        g_stdout = -1;
+    }
+    if (g_capture != NULL)
+    {
+        rewind(g_capture);
+        got = fread(buf, 1, len - 1, g_capture);
+        fclose(g_capture);
+        g_capture = NULL;
+    }
+    buf[got] = '\0';
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * Decode the report with each self capacitance decoder and its handler
+ */
+void compareSC(uint16_t xWires, bool checkLog)
+{
+    char        expected[80], logged[400];
+    unsigned    odd     = 0;
+    int         maxOdd  = 0;
+    bool        refValid, outValid;
+
+    refValid = outValid = false;
+    memset(g_ref8, UNTOUCHED, sizeof(g_ref8));
+    memset(g_out8, UNTOUCHED, sizeof(g_out8));
+    ref_decode100(g_report, g_ref8, xWires, &refValid);
+    rdec_decode100(g_report, g_out8, xWires, &outValid);
+    check( (memcmp(g_ref8, g_out8, sizeof(g_ref8)) == 0) && (refValid == outValid),
+                                                            "rdec_decode100");
+
+    refValid = outValid = false;
+    memset(g_ref16, UNTOUCHED, sizeof(g_ref16));
+    memset(g_out16, UNTOUCHED, sizeof(g_out16));
+    ref_decode110(g_report, g_ref16, xWires, &refValid, &odd, &maxOdd);
+    if (checkLog) captureBegin();
+    rdec_decode110(g_report, g_out16, xWires, &outValid);
+    if (checkLog) captureEnd(logged, sizeof(logged));
+    check( (memcmp(g_ref16, g_out16, sizeof(g_ref16)) == 0) && (refValid == outValid),
+                                                            "rdec_decode110");
+    if (checkLog)
+    {
+        // once per packet, or not at all
+        if (odd == 0) expected[0] = '\0';
+        else snprintf(expected, sizeof(expected), "ODD WIRE-VALUE x%u, max %05d\n\n",
+                                                            odd, maxOdd);
+        check(strcmp(logged, expected) == 0, "rdec_decode110 odd wire log");
+    }
+
+    odd = 0;
+    maxOdd = 0;
+    refValid = outValid = false;
+    memset(g_ref8, UNTOUCHED, sizeof(g_ref8));
+    memset(g_out8, UNTOUCHED, sizeof(g_out8));
+    ref_decode110Clipped(g_report, g_ref8, xWires, &refValid, &odd, &maxOdd);
+    if (checkLog) captureBegin();
+    rdec_decode110Clipped(g_report, g_out8, xWires, &outValid);
+    if (checkLog) captureEnd(logged, sizeof(logged));
+    check( (memcmp(g_ref8, g_out8, sizeof(g_ref8)) == 0) && (refValid == outValid),
+                                                            "rdec_decode110Clipped");
+    if (checkLog)
+    {
+        if (odd == 0) expected[0] = '\0';
+        else snprintf(expected, sizeof(expected), "ODD WIRE-VALUE x%u, max %05d\n\n",
+                                                            odd, maxOdd);
+        check(strcmp(logged, expected) == 0, "rdec_decode110Clipped odd wire log");
+    }
+}
+
+/**
+ * Decode the report with the multitouch decoder and its handler
+ */
+void compareMT(uint16_t xWires, uint16_t yWires)
+{
+    size_t  cells = (size_t)xWires * yWires;
+    int     refRes, outRes;
+
+    memset(g_refImage, UNTOUCHED, cells);
+    memset(g_outImage, UNTOUCHED, cells);
+    refRes = ref_decodeMT(g_report, g_refImage, xWires, yWires);
+    outRes = rdec_decodeMT(g_report, g_outImage, xWires, yWires);
+    check( (memcmp(g_refImage, g_outImage, cells) == 0) && (refRes == outRes),
+                                                            "rdec_decodeMT");
+}
+
+/**
+ * A report the decoder drops, or a status report: the image is untouched
+ */
+void checkDroppedMT(uint16_t xWires, uint16_t yWires, int expected, char const *what)
+{
+    size_t  cells = (size_t)xWires * yWires;
+    size_t  i;
+    bool    untouched = true;
+    int     res;
+
+    memset(g_outImage, UNTOUCHED, cells);
+    res = rdec_decodeMT(g_report, g_outImage, xWires, yWires);
+    for (i = 0; i < cells; i++) untouched = untouched && (g_outImage[i] == UNTOUCHED);
+    check(untouched && (res == expected), what);
+}
+
+// ----------------------------------------------------------------------------
+
+void testSelfCap(void)
+{
+    int packet, x, n;
+
+    // every packet number, including the invalid ones, and X wire count
+    for (packet = 0; packet < 256; packet++)
+    {
+        for (x = 0; x < (int)(sizeof(g_xWires) / sizeof(g_xWires[0])); x++)
+        {
+            randomReport(packet, 0);
+            compareSC(g_xWires[x], false);
+            randomReport(packet, 90);
+            compareSC(g_xWires[x], false);
+        }
+    }
+
+    for (n = 0; n < NUM_RANDOM; n++)
+    {
+        randomReport(rand() % 4, (rand() & 1) ? 120 : 0);
+        compareSC(g_xWires[rand() % (int)(sizeof(g_xWires) / sizeof(g_xWires[0]))], false);
+    }
+    printf("self capacitance decoders: %d checks\n", g_checks);
+}
+
+void testOddWireLog(void)
+{
+    int packet, n;
+
+    zul_setLogLevel(0);
+    for (packet = 0; packet < 4; packet++)
+    {
+        // none odd, all odd, and one just over the limit
+        randomReport(packet, RDEC_ODD_WIRE_VALUE + 1);
+        compareSC(32, true);
+        randomReport(packet, 0);
+        memset(g_report + 2, 0xFF, REPORT_LEN - 2);
+        compareSC(32, true);
+        randomReport(packet, RDEC_ODD_WIRE_VALUE + 1);
+        g_report[2] = RDEC_ODD_WIRE_VALUE + 1;
+        g_report[3] = 0;
+        compareSC(32, true);
+
+        for (n = 0; n < 100; n++)
+        {
+            randomReport(packet, (n & 1) ? 0x10000 : 120);
+            compareSC(16, true);
+        }
+    }
+    zul_setLogLevel(-1);
+    printf("odd wire logging: done\n");
+}
+
+void testMultitouch(void)
+{
+    uint16_t    xWires, yWires;
+    int         n;
+
+    // reports from every start cell of small images, wrapping columns and
+    // running off the last one
+    for (xWires = 1; xWires <= 8; xWires++)
+    {
+        for (yWires = 1; yWires <= 70; yWires += (yWires < 8) ? 1 : 31)
+        {
+            int col, row;
+
+            for (col = 0; col < xWires; col++)
+            {
+                for (row = 0; row < yWires; row++)
+                {
+                    randomReport(col, 0);
+                    g_report[2] = (uint8_t)row;
+                    g_report[3] = (uint8_t)(rand() % (REPORT_LEN - 3));
+                    compareMT(xWires, yWires);
+                }
+            }
+        }
+    }
+
+    for (n = 0; n < NUM_RANDOM; n++)
+    {
+        xWires = (uint16_t)(1 + rand() % 128);
+        yWires = (uint16_t)(1 + rand() % 128);
+        randomReport(rand() % xWires, 0);
+        g_report[2] = (uint8_t)(rand() % yWires);
+        g_report[3] = (uint8_t)(rand() % (REPORT_LEN - 3));
+        compareMT(xWires, yWires);
+    }
+
+    // the largest image, with a report ending on its last cell
+    randomReport(255, 0);
+    g_report[2] = 255 - 59;
+    g_report[3] = 60;
+    compareMT(256, 256);
+
+    // more cells than a report holds: the decoder stops at its end
+    randomReport(1, 0);
+    g_report[2] = 0;
+    g_report[3] = 200;
+    memset(g_refImage, UNTOUCHED, 64 * 64);
+    memset(g_outImage, UNTOUCHED, 64 * 64);
+    memcpy(g_refImage + 64, g_report + 4, REPORT_LEN - 4);
+    n = rdec_decodeMT(g_report, g_outImage, 64, 64);
+    check( (memcmp(g_refImage, g_outImage, 64 * 64) == 0) && (n == REPORT_LEN - 4),
+                                                            "rdec_decodeMT, long report");
+
+    // status reports: both out of range
+    randomReport(0xFF, 0);
+    g_report[2] = 0xFF;
+    g_report[3] = 60;
+    checkDroppedMT(32, 32, -1, "rdec_decodeMT, FF status report");
+    randomReport(32, 0);
+    g_report[2] = 40;
+    checkDroppedMT(32, 32, -1, "rdec_decodeMT, status report");
+
+    // only one out of range: the handler wrote outside the column or image,
+    // the decoder drops the report
+    randomReport(32, 0);
+    g_report[2] = 5;
+    g_report[3] = 60;
+    checkDroppedMT(32, 32, 0, "rdec_decodeMT, column only out of range");
+    randomReport(0xFF, 0);
+    g_report[2] = 0;
+    checkDroppedMT(32, 32, 0, "rdec_decodeMT, column FF only");
+    randomReport(5, 0);
+    g_report[2] = 32;
+    g_report[3] = 60;
+    checkDroppedMT(32, 32, 0, "rdec_decodeMT, row only out of range");
+    randomReport(0, 0);
+    g_report[2] = 0xFF;
+    checkDroppedMT(32, 32, 0, "rdec_decodeMT, row FF only");
+
+    printf("multitouch decoder: done\n");
+}
+
+// ----------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    unsigned int seed = (argc > 1) ? (unsigned int)strtoul(argv[1], NULL, 0) : 1;
+
+    printf("seed %u\n", seed);
+    srand(seed);
+
+    // the random reports are full of odd wire values
+    zul_setLogLevel(-1);
+
+    testSelfCap();
+    testOddWireLog();
+    testMultitouch();
+
+    printf("%s, %d checks, %d failure(s)\n",
+                (g_failures == 0) ? "PASSED" : "FAILED", g_checks, g_failures);
+    return (g_failures == 0) ? 0 : 1;
+}
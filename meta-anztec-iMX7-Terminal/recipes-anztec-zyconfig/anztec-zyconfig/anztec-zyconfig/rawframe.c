@@ -0,0 +1,373 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* For a module overview, see the header file
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "rawframe.h"
+#include "debug.h"
+
+//
+// --- Module Types ---
+//
+
+#define REPORT_HEADER_LEN           (4)
+
+// one frame buffer
+typedef struct rf_buffer
+{
+    uint32_t    frame;
+    uint32_t    generation;
+    uint64_t    startUs;
+    uint64_t    endUs;
+    int         written;                        // cells written
+    uint8_t     seen    [RF_BITMAP_LEN(RF_MAX_CELLS)];  // a bit per cell
+    uint8_t     cells   [RF_MAX_CELLS];
+} rf_buffer_t;
+
+struct zul_rawframe
+{
+    // guards front, the published counts, and the size
+    pthread_mutex_t     lock;
+    pthread_cond_t      published;
+
+    rf_buffer_t *       front;          // the latest frame, if frame != 0
+    rf_buffer_t *       back;           // the writer's
+    uint16_t            xWires;         // as published to the readers
+    uint16_t            yWires;
+    uint32_t            generation;     // of the size, see rf_configure()
+    rf_stats_t          stats;
+
+    // set by rf_configure(), taken by the writer
+    _Atomic bool        configPending;
+    uint16_t            newX, newY;
+
+    // the writer's copy of the size, and its generation
+    uint16_t            wx, wy;
+    uint32_t            wGeneration;
+    uint32_t            nextFrame;
+
+    rf_buffer_t         buf[2];
+};
+
+
+//
+// --- Module Prototypes ---
+//
+
+static void     rf_takeConfig           (zul_rawframe_t *rf);
+static void     rf_clearBuffer          (rf_buffer_t *b, int numCells);
+static void     rf_publish              (zul_rawframe_t *rf);
+
+
+// ============================================================================
+// --- Public Services ---
+// ============================================================================
+
+zul_rawframe_t * rf_create(void)
+{
+    zul_rawframe_t *    rf;
+    pthread_condattr_t  attr;
+
+    rf = (zul_rawframe_t *)calloc(1, sizeof(zul_rawframe_t));
+    if (rf == NULL) return NULL;
+
+    (void)pthread_mutex_init(&rf->lock, NULL);
+    (void)pthread_condattr_init(&attr);
+    (void)pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    (void)pthread_cond_init(&rf->published, &attr);
+    (void)pthread_condattr_destroy(&attr);
+
+    rf->front = &rf->buf[0];
+    rf->back  = &rf->buf[1];
+    atomic_init(&rf->configPending, false);
+    return rf;
+}
+
+void rf_destroy(zul_rawframe_t *rf)
+{
+    if (rf == NULL) return;
+
+    (void)pthread_cond_destroy(&rf->published);
+    (void)pthread_mutex_destroy(&rf->lock);
+    free(rf);
+}
+
+int rf_configure(zul_rawframe_t *rf, uint16_t xWires, uint16_t yWires)
+{
+    if (rf == NULL) return FAILURE;
+    if ((xWires > RF_MAX_WIRES) || (yWires > RF_MAX_WIRES))
+    {
+        zul_logf(1, "%s: %d x %d wires not supported", __FUNCTION__,
+                                                            xWires, yWires);
+        return FAILURE;
+    }
+
+    // readers wait for a frame of the new generation from now on
+    (void)pthread_mutex_lock(&rf->lock);
+    rf->newX = rf->xWires = xWires;
+    rf->newY = rf->yWires = yWires;
+    rf->generation++;
+    memset(&rf->stats, 0, sizeof(rf->stats));
+    atomic_store_explicit(&rf->configPending, true, memory_order_release);
+    (void)pthread_mutex_unlock(&rf->lock);
+
+    zul_logf(3, "%s: %d x %d", __FUNCTION__, xWires, yWires);
+    return SUCCESS;
+}
+
+bool rf_feed(zul_rawframe_t *rf, uint8_t const *data, int len)
+{
+    rf_buffer_t *   b;
+    uint8_t const * p;
+    uint8_t const * end;
+    int             col, row, num, i;
+    bool            done = false;
+
+    if ((rf == NULL) || (data == NULL) || (len < REPORT_HEADER_LEN)) return false;
+
+    if (atomic_load_explicit(&rf->configPending, memory_order_acquire))
+    {
+        rf_takeConfig(rf);
+    }
+    if ((rf->wx == 0) || (rf->wy == 0)) return false;
+
+    col = data[1];
+    row = data[2];
+    num = data[3];
+
+    // a status report
+    if ((col >= rf->wx) && (row >= rf->wy)) return false;
+    if ((col >= rf->wx) || (row >= rf->wy))
+    {
+        (void)pthread_mutex_lock(&rf->lock);
+        rf->stats.badReports++;
+        (void)pthread_mutex_unlock(&rf->lock);
+        return false;
+    }
+
+    // a scan started again before the last one ended: the end was lost
+    b = rf->back;
+    if ((col == 0) && (row == 0) && (b->written > 0))
+    {
+        rf_publish(rf);
+        b = rf->back;
+        done = true;
+    }
+
+    if (b->written == 0) b->startUs = zul_monotonicUs();
+
+    p   = data + REPORT_HEADER_LEN;
+    end = data + len;
+    for (i = 0; (i < num) && (p < end); i++)
+    {
+        int cell = rf->wy * col + row;
+
+        if ((b->seen[cell >> 3] & (1u << (cell & 7))) == 0)
+        {
+            b->seen[cell >> 3] |= (uint8_t)(1u << (cell & 7));
+            b->written++;
+        }
+        b->cells[cell] = *p++;
+
+        if (++row == rf->wy)
+        {
+            row = 0;
+            if (++col == rf->wx) break;
+        }
+    }
+    b->endUs = zul_monotonicUs();
+
+    // the last cell of the scan
+    if (col == rf->wx)
+    {
+        rf_publish(rf);
+        done = true;
+    }
+    return done;
+}
+
+int rf_waitFrame(zul_rawframe_t *rf, uint32_t after, int timeoutMs,
+                    rf_frame_t *info, uint8_t *cells, uint8_t *missing,
+                    int cellsLen)
+{
+    struct timespec deadline;
+    rf_buffer_t *   f;
+    int             numCells, i;
+    int             frame = 0;
+
+    if ((rf == NULL) || (info == NULL)) return 0;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &deadline);
+    if (timeoutMs > 0)
+    {
+        deadline.tv_sec  += timeoutMs / 1000;
+        deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_nsec -= 1000000000L;
+            deadline.tv_sec++;
+        }
+    }
+
+    (void)pthread_mutex_lock(&rf->lock);
+    while ( (rf->front->frame <= after) ||
+            (rf->front->generation != rf->generation) )
+    {
+        int rc;
+
+        if (timeoutMs == 0) break;
+        if (timeoutMs < 0)
+        {
+            rc = pthread_cond_wait(&rf->published, &rf->lock);
+        }
+        else
+        {
+            rc = pthread_cond_timedwait(&rf->published, &rf->lock, &deadline);
+        }
+        if (rc == ETIMEDOUT) break;
+    }
+
+    f = rf->front;
+    if ((f->frame > after) && (f->generation == rf->generation))
+    {
+        numCells = rf->xWires * rf->yWires;
+        if (((cells != NULL) || (missing != NULL)) && (cellsLen < numCells))
+        {
+            frame = -1;
+        }
+        else
+        {
+            info->frame      = f->frame;
+            info->generation = f->generation;
+            info->startUs    = f->startUs;
+            info->endUs      = f->endUs;
+            info->xWires     = rf->xWires;
+            info->yWires     = rf->yWires;
+            info->missing    = numCells - f->written;
+
+            if (cells != NULL) memcpy(cells, f->cells, (size_t)numCells);
+            if (missing != NULL)
+            {
+                for (i = 0; i < RF_BITMAP_LEN(numCells); i++)
+                {
+                    missing[i] = (uint8_t)~f->seen[i];
+                }
+                // no bits beyond the last cell
+                if (numCells & 7)
+                {
+                    missing[numCells >> 3] &= (uint8_t)((1u << (numCells & 7)) - 1u);
+                }
+            }
+            frame = (int)f->frame;
+        }
+    }
+    (void)pthread_mutex_unlock(&rf->lock);
+
+    return frame;
+}
+
+void rf_getStats(zul_rawframe_t *rf, rf_stats_t *stats)
+{
+    if ((rf == NULL) || (stats == NULL)) return;
+
+    (void)pthread_mutex_lock(&rf->lock);
+    *stats = rf->stats;
+    (void)pthread_mutex_unlock(&rf->lock);
+}
+
+
+// ============================================================================
+// --- Private Functions ---
+// ============================================================================
+
+/**
+ * Writer: take the size set by rf_configure(), and discard the frame being
+ * assembled.  The frame numbers carry on.
+ */
+static void rf_takeConfig(zul_rawframe_t *rf)
+{
+    (void)pthread_mutex_lock(&rf->lock);
+    atomic_store_explicit(&rf->configPending, false, memory_order_relaxed);
+    rf->wx          = rf->newX;
+    rf->wy          = rf->newY;
+    rf->wGeneration = rf->generation;
+    rf_clearBuffer(rf->back, RF_MAX_CELLS);
+    (void)pthread_mutex_unlock(&rf->lock);
+}
+
+static void rf_clearBuffer(rf_buffer_t *b, int numCells)
+{
+    memset(b->seen, 0, (size_t)RF_BITMAP_LEN(numCells));
+    b->written = 0;
+}
+
+/**
+ * Writer: zero the missing cells of the back buffer, and swap it to the
+ * front.  The old front becomes the new, empty, back buffer.  A frame of
+ * the previous size, assembled as the size changed, is discarded.
+ */
+static void rf_publish(zul_rawframe_t *rf)
+{
+    rf_buffer_t *   b = rf->back;
+    int             numCells = rf->wx * rf->wy;
+    int             i;
+
+    if (b->written < numCells)
+    {
+        for (i = 0; i < numCells; i++)
+        {
+            if ((b->seen[i >> 3] & (1u << (i & 7))) == 0) b->cells[i] = 0;
+        }
+    }
+    if (++rf->nextFrame == 0) rf->nextFrame = 1;       // 0: no frame
+    b->frame      = rf->nextFrame;
+    b->generation = rf->wGeneration;
+
+    (void)pthread_mutex_lock(&rf->lock);
+    if (!atomic_load_explicit(&rf->configPending, memory_order_relaxed))
+    {
+        rf->back  = rf->front;
+        rf->front = b;
+        rf->stats.published++;
+        if (b->written == numCells) rf->stats.complete++;
+        (void)pthread_cond_broadcast(&rf->published);
+    }
+    (void)pthread_mutex_unlock(&rf->lock);
+
+    rf_clearBuffer(rf->back, numCells);
+}
@@ -0,0 +1,142 @@
+/*
+ *  Copyright (c) 2019 Zytronic Displays Limited. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact Zytronic, you can do so either via the
+ * website <www.zytronic.co.uk> or by paper mail:
+ * Zytronic, Whiteley Road, Blaydon on Tyne, Tyne & Wear, NE21 5NJ, UK
+ */
+
+
+
+
+
+
+
+
+
+/* Module Overview
+   ===============
+   This code assembles the raw sensor data reports of a Multitouch device
+   (ZXY150/200/300/500) into whole frames, one cell per X/Y wire crossing,
+   and publishes each frame only once its scan is over, so that a reader
+   never sees a frame that mixes two scans.
+
+   Raw data report format (RAW_DATA):
+        [0]     report ID
+        [1]     column (X wire) of the first cell
+        [2]     row (Y wire) of the first cell
+        [3]     number of cells
+        [4..]   the cells, in row order, wrapping to the next column
+   A column and row both out of range mark a status report, which is not
+   part of the frame.
+
+   The assembler keeps two buffers: the back buffer is filled by the report
+   handler (the single writer) without a lock, and the front buffer holds
+   the latest published frame.  A scan ends when its last cell is written,
+   or when a report starts again at cell (0,0); the buffers are then swapped
+   under a lock, and the readers woken.
+
+   Each published frame carries a frame number (from 1, and rising for the
+   life of the assembler, so across changes of size), the generation of the
+   size it was assembled to (incremented by each rf_configure()), the times
+   of its first and last reports, and a bitmap of the cells no report
+   carried (they read as zero).  Cells are laid out as zul_SetRawDataBuffer() lays
+   them out: cell (col,row) at [yWires * col + row].
+
+ */
+
+#ifndef _ZY_RAWFRAME_H
+#define _ZY_RAWFRAME_H
+
+#include "zytypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define  RF_MAX_WIRES               (255)       // per axis, see the report
+#define  RF_MAX_CELLS               (RF_MAX_WIRES * RF_MAX_WIRES)
+#define  RF_BITMAP_LEN(cells)       (((cells) + 7) / 8)
+
+// a published frame
+typedef struct rf_frame
+{
+    uint32_t    frame;              // published frames, from 1
+    uint32_t    generation;         // rf_configure() calls, see above
+    uint64_t    startUs;            // CLOCK_MONOTONIC microseconds
+    uint64_t    endUs;
+    uint16_t    xWires;
+    uint16_t    yWires;
+    int         missing;            // cells not reported
+} rf_frame_t;
+
+// assembler counts, since configured
+typedef struct rf_stats
+{
+    uint32_t    published;
+    uint32_t    complete;           // published with no missing cell
+    uint32_t    badReports;         // outside the configured array
+} rf_stats_t;
+
+typedef struct zul_rawframe zul_rawframe_t;
+
+
+/*@null@*/
+zul_rawframe_t *    rf_create               (void);
+void                rf_destroy              (/*@null@*/ zul_rawframe_t *rf);
+
+/**
+ * Set the size of the sensor array (zero to stop assembling), discarding
+ * any frame being assembled, and start a new generation: readers wait for
+ * a frame of it.  Frame numbers carry on.  May be called from any thread;
+ * the writer takes the new size at its next report.  Return FAILURE if the
+ * size is too large.
+ */
+int                 rf_configure            (zul_rawframe_t *rf,
+                                                uint16_t xWires, uint16_t yWires);
+
+/**
+ * Writer: add a raw data report.  Only one thread may call this.
+ * Return true if it completed a frame.
+ */
+bool                rf_feed                 (zul_rawframe_t *rf,
+                                                uint8_t const *data, int len);
+
+/**
+ * Reader: wait for a frame later than after, and of the current generation,
+ * for up to timeoutMs (zero: do not wait, negative: wait indefinitely), and
+ * copy it.  cells (cellsLen
+ * bytes) and missing (RF_BITMAP_LEN(cellsLen) bytes, a set bit per missing
+ * cell) may each be NULL.  Any thread may call this.
+ * Return the frame number, zero on timeout, or -1 if cellsLen is too small
+ * for the frame.
+ */
+int                 rf_waitFrame            (zul_rawframe_t *rf, uint32_t after,
+                                                int timeoutMs, rf_frame_t *info,
+                                                /*@null@*/ uint8_t *cells,
+                                                /*@null@*/ uint8_t *missing,
+                                                int cellsLen);
+
+void                rf_getStats             (zul_rawframe_t *rf,
+                                                rf_stats_t *stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ZY_RAWFRAME_H
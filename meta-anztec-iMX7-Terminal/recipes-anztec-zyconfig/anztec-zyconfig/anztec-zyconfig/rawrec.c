@@ -0,0 +1,956 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* For a module overview, see the header file
+ */
+
+// 64 bit file offsets on the 32 bit targets too: recordings run to GBytes
+#define _FILE_OFFSET_BITS 64
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rawrec.h"
+#include "debug.h"
+
+//
+// --- Module Types ---
+//
+
+#define REC_WINDOW                  (16u << 20)     // mapped bytes of the log
+#define REPORT_HEADER_LEN           (4)
+#define REPORT_LEN                  (64)
+#define REPORT_MAX_CELLS            (REPORT_LEN - REPORT_HEADER_LEN)
+
+// a mapped part of the file
+typedef struct rec_window
+{
+    uint8_t *   base;
+    uint64_t    off;
+    size_t      len;
+} rec_window_t;
+
+struct zul_recwriter
+{
+    // guards all but the capture thread's state
+    pthread_mutex_t     lock;
+
+    int                 fd;
+    rec_header_t        header;
+    int                 numCells;
+    uint64_t            fileLen;        // allocated
+    uint64_t            chunk;
+    uint64_t            dataEnd;        // offset of the next record
+    uint64_t            syncedEnd;
+    uint64_t            lastSyncMs;
+    rec_window_t        win;
+    rec_indexEntry_t *  index;
+    uint64_t            indexCap;
+    rec_stats_t         stats;
+
+    // capture
+    zul_rawframe_t *    rf;
+    pthread_t           thread;
+    bool                capturing;
+    _Atomic bool        stop;
+    uint8_t *           cells;
+    uint8_t *           missing;
+};
+
+struct zul_recreader
+{
+    // guards the window
+    pthread_mutex_t     lock;
+
+    int                 fd;
+    rec_header_t        header;
+    int                 numCells;
+    uint64_t            fileLen;
+    uint32_t            count;
+    rec_indexEntry_t const * index;
+    void *              indexMap;       // the index mapped from the file, or
+    size_t              indexMapLen;    // NULL if rebuilt (index malloc'd)
+    rec_window_t        win;
+};
+
+struct zul_recplay
+{
+    zul_recreader_t *   rd;
+    uint32_t            first;
+    double              speed;
+    interrupt_handler_t handler;
+
+    pthread_t           thread;
+    pthread_mutex_t     runLock;
+    pthread_cond_t      runCond;
+    bool                stop;
+
+    _Atomic uint32_t    replayed;
+    _Atomic bool        done;
+    uint8_t *           cells;
+    uint8_t *           missing;
+};
+
+
+//
+// --- Module Prototypes ---
+//
+
+static uint32_t     rec_recordLen           (int numCells);
+static uint8_t *    rec_window              (rec_window_t *w, int fd, bool write,
+                                                uint64_t off, size_t need,
+                                                uint64_t fileLen);
+static void         rec_unmap               (rec_window_t *w, bool write);
+static bool         rec_grow                (zul_recwriter_t *w, uint64_t end);
+static int          rec_appendLocked        (zul_recwriter_t *w,
+                                                rf_frame_t const *info,
+                                                uint8_t const *cells,
+                                                uint8_t const *missing);
+static void         rec_sync                (zul_recwriter_t *w);
+static bool         rec_writeHeader         (int fd, rec_header_t const *h);
+static void *       rec_captureWorker       (void *arg);
+static bool         rec_loadIndex           (zul_recreader_t *rd);
+static void *       rec_replayWorker        (void *arg);
+static void         rec_sendFrame           (zul_recplay_t *rp,
+                                                rf_frame_t const *info);
+static uint64_t     rec_realtimeUs          (void);
+
+
+// ============================================================================
+// --- Public Services ---
+// ============================================================================
+
+// --- writer ---
+
+zul_recwriter_t * rec_create(char const *path, rec_info_t const *info,
+                                                        uint32_t chunkBytes)
+{
+    zul_recwriter_t *w;
+    int numCells;
+
+    if ((path == NULL) || (info == NULL)) return NULL;
+    if ( (info->xWires == 0) || (info->yWires == 0) ||
+         (info->xWires > RF_MAX_WIRES) || (info->yWires > RF_MAX_WIRES) )
+    {
+        zul_logf(1, "%s: %d x %d wires not supported", __FUNCTION__,
+                                                info->xWires, info->yWires);
+        return NULL;
+    }
+    numCells = info->xWires * info->yWires;
+
+    w = (zul_recwriter_t *)calloc(1, sizeof(zul_recwriter_t));
+    if (w == NULL) return NULL;
+
+    w->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (w->fd < 0)
+    {
+        zul_logf(1, "%s: %s: %s", __FUNCTION__, path, strerror(errno));
+        free(w);
+        return NULL;
+    }
+
+    memcpy(w->header.magic, REC_MAGIC, sizeof(w->header.magic));
+    w->header.formatVersion = REC_FORMAT_VERSION;
+    w->header.headerLen     = REC_HEADER_LEN;
+    w->header.recordLen     = rec_recordLen(numCells);
+    w->header.pid           = info->pid;
+    w->header.xWires        = info->xWires;
+    w->header.yWires        = info->yWires;
+    w->header.wallStartUs   = rec_realtimeUs();
+    w->header.monoStartUs   = zul_monotonicUs();
+    memcpy(w->header.version, info->version, sizeof(w->header.version));
+
+    w->numCells   = numCells;
+    w->chunk      = (chunkBytes != 0) ? chunkBytes : REC_DEFAULT_CHUNK;
+    w->dataEnd    = REC_HEADER_LEN;
+    w->syncedEnd  = REC_HEADER_LEN;
+    w->lastSyncMs = zul_monotonicMs();
+    w->cells      = (uint8_t *)malloc((size_t)numCells);
+    w->missing    = (uint8_t *)malloc((size_t)RF_BITMAP_LEN(numCells));
+
+    if ( (w->cells == NULL) || (w->missing == NULL) ||
+         (!rec_writeHeader(w->fd, &w->header)) ||
+         (!rec_grow(w, REC_HEADER_LEN + REC_WINDOW)) )
+    {
+        zul_logf(1, "%s: %s: cannot set up the file", __FUNCTION__, path);
+        (void)close(w->fd);
+        (void)unlink(path);
+        free(w->missing);
+        free(w->cells);
+        free(w);
+        return NULL;
+    }
+
+    (void)pthread_mutex_init(&w->lock, NULL);
+    zul_logf(3, "%s: %s, %d x %d, %u bytes per frame", __FUNCTION__, path,
+                        info->xWires, info->yWires, w->header.recordLen);
+    return w;
+}
+
+int rec_append(zul_recwriter_t *w, rf_frame_t const *info,
+                                uint8_t const *cells, uint8_t const *missing)
+{
+    int rc;
+
+    if ((w == NULL) || (info == NULL) || (cells == NULL)) return FAILURE;
+    if (w->capturing) return FAILURE;
+
+    (void)pthread_mutex_lock(&w->lock);
+    rc = rec_appendLocked(w, info, cells, missing);
+    (void)pthread_mutex_unlock(&w->lock);
+    return rc;
+}
+
+int rec_startCapture(zul_recwriter_t *w, zul_rawframe_t *rf)
+{
+    if ((w == NULL) || (rf == NULL) || (w->capturing)) return FAILURE;
+
+    w->rf = rf;
+    atomic_store(&w->stop, false);
+    if (pthread_create(&w->thread, NULL, rec_captureWorker, w) != 0)
+    {
+        zul_logf(1, "%s: no capture thread", __FUNCTION__);
+        return FAILURE;
+    }
+    w->capturing = true;
+    return SUCCESS;
+}
+
+void rec_getStats(zul_recwriter_t *w, rec_stats_t *stats)
+{
+    if ((w == NULL) || (stats == NULL)) return;
+
+    (void)pthread_mutex_lock(&w->lock);
+    *stats = w->stats;
+    (void)pthread_mutex_unlock(&w->lock);
+}
+
+int rec_close(zul_recwriter_t *w)
+{
+    uint64_t    indexLen;
+    int         rc = SUCCESS;
+
+    if (w == NULL) return FAILURE;
+
+    if (w->capturing)
+    {
+        atomic_store(&w->stop, true);
+        (void)pthread_join(w->thread, NULL);
+        w->capturing = false;
+    }
+
+    // the log, then the index after it, then the header that points to it
+    if (w->win.base != NULL)
+    {
+        if (msync(w->win.base, w->win.len, MS_SYNC) != 0) rc = FAILURE;
+        rec_unmap(&w->win, true);
+    }
+
+    indexLen = w->stats.frames * sizeof(rec_indexEntry_t);
+    if ( (indexLen != 0) &&
+         (pwrite(w->fd, w->index, (size_t)indexLen, (off_t)w->dataEnd)
+                                                    != (ssize_t)indexLen) )
+    {
+        rc = FAILURE;
+    }
+    if (rc == SUCCESS)
+    {
+        w->header.indexOffset = w->dataEnd;
+        w->header.indexCount  = w->stats.frames;
+        w->header.flags      |= REC_FLAG_CLOSED;
+    }
+    w->header.frames  = w->stats.frames;
+    w->header.dropped = w->stats.dropped;
+    if (!rec_writeHeader(w->fd, &w->header)) rc = FAILURE;
+    if (ftruncate(w->fd, (off_t)(w->dataEnd + indexLen)) != 0) rc = FAILURE;
+    if (fsync(w->fd) != 0) rc = FAILURE;
+    (void)close(w->fd);
+
+    zul_logf(3, "%s: %llu frames, %llu dropped%s", __FUNCTION__,
+                        (unsigned long long)w->stats.frames,
+                        (unsigned long long)w->stats.dropped,
+                        (rc == SUCCESS) ? "" : ", NOT completed");
+
+    (void)pthread_mutex_destroy(&w->lock);
+    free(w->index);
+    free(w->missing);
+    free(w->cells);
+    free(w);
+    return rc;
+}
+
+
+// --- reader ---
+
+zul_recreader_t * rec_open(char const *path)
+{
+    zul_recreader_t *rd;
+    struct stat st;
+
+    if (path == NULL) return NULL;
+
+    rd = (zul_recreader_t *)calloc(1, sizeof(zul_recreader_t));
+    if (rd == NULL) return NULL;
+
+    rd->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (rd->fd < 0)
+    {
+        zul_logf(1, "%s: %s: %s", __FUNCTION__, path, strerror(errno));
+        free(rd);
+        return NULL;
+    }
+
+    if ( (fstat(rd->fd, &st) != 0) ||
+         (pread(rd->fd, &rd->header, sizeof(rd->header), 0)
+                                            != (ssize_t)sizeof(rd->header)) ||
+         (memcmp(rd->header.magic, REC_MAGIC, sizeof(rd->header.magic)) != 0) ||
+         (rd->header.formatVersion != REC_FORMAT_VERSION) ||
+         (rd->header.headerLen < sizeof(rec_header_t)) ||
+         (rd->header.xWires == 0) || (rd->header.xWires > RF_MAX_WIRES) ||
+         (rd->header.yWires == 0) || (rd->header.yWires > RF_MAX_WIRES) ||
+         (rd->header.recordLen !=
+                rec_recordLen(rd->header.xWires * rd->header.yWires)) )
+    {
+        zul_logf(1, "%s: %s: not a raw data recording", __FUNCTION__, path);
+        (void)close(rd->fd);
+        free(rd);
+        return NULL;
+    }
+    rd->fileLen  = (uint64_t)st.st_size;
+    rd->numCells = rd->header.xWires * rd->header.yWires;
+
+    if (!rec_loadIndex(rd))
+    {
+        (void)close(rd->fd);
+        free(rd);
+        return NULL;
+    }
+
+    (void)pthread_mutex_init(&rd->lock, NULL);
+    zul_logf(3, "%s: %s, %u frames of %d x %d", __FUNCTION__, path,
+                        rd->count, rd->header.xWires, rd->header.yWires);
+    return rd;
+}
+
+void rec_closeReader(zul_recreader_t *rd)
+{
+    if (rd == NULL) return;
+
+    rec_unmap(&rd->win, false);
+    if (rd->indexMap != NULL)
+    {
+        (void)munmap(rd->indexMap, rd->indexMapLen);
+    }
+    else
+    {
+        free((void *)rd->index);
+    }
+    (void)close(rd->fd);
+    (void)pthread_mutex_destroy(&rd->lock);
+    free(rd);
+}
+
+void rec_getInfo(zul_recreader_t *rd, rec_header_t *header)
+{
+    if ((rd == NULL) || (header == NULL)) return;
+
+    *header = rd->header;
+    header->frames = rd->count;
+}
+
+uint32_t rec_frameCount(zul_recreader_t *rd)
+{
+    return (rd == NULL) ? 0 : rd->count;
+}
+
+int rec_readFrame(zul_recreader_t *rd, uint32_t pos, rf_frame_t *info,
+                        uint8_t *cells, uint8_t *missing, int cellsLen)
+{
+    rec_record_t    r;
+    uint8_t const * p;
+    uint64_t        off;
+
+    if ((rd == NULL) || (info == NULL) || (pos >= rd->count)) return 0;
+    if (((cells != NULL) || (missing != NULL)) && (cellsLen < rd->numCells))
+    {
+        return -1;
+    }
+
+    off = (uint64_t)rd->header.headerLen + (uint64_t)pos * rd->header.recordLen;
+
+    (void)pthread_mutex_lock(&rd->lock);
+    p = rec_window(&rd->win, rd->fd, false, off, rd->header.recordLen,
+                                                                rd->fileLen);
+    if (p == NULL)
+    {
+        (void)pthread_mutex_unlock(&rd->lock);
+        return -1;
+    }
+
+    memcpy(&r, p, sizeof(r));
+    p += sizeof(r);
+    if (cells != NULL) memcpy(cells, p, (size_t)rd->numCells);
+    p += rd->numCells;
+    if (missing != NULL) memcpy(missing, p, (size_t)RF_BITMAP_LEN(rd->numCells));
+    (void)pthread_mutex_unlock(&rd->lock);
+
+    info->frame      = r.frame;
+    info->generation = 0;           // a recording is of one size
+    info->startUs    = r.startUs;
+    info->endUs      = r.endUs;
+    info->xWires     = rd->header.xWires;
+    info->yWires     = rd->header.yWires;
+    info->missing    = r.missing;
+    return (int)r.frame;
+}
+
+long rec_findFrame(zul_recreader_t *rd, uint32_t frame)
+{
+    uint32_t lo = 0, hi;
+
+    if (rd == NULL) return -1;
+
+    // frame numbers increase through the recording, with gaps
+    hi = rd->count;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (rd->index[mid].frame < frame) lo = mid + 1;
+        else                              hi = mid;
+    }
+    if ((lo < rd->count) && (rd->index[lo].frame == frame)) return (long)lo;
+    return -1;
+}
+
+long rec_findTime(zul_recreader_t *rd, uint64_t offsetUs)
+{
+    uint64_t    t;
+    uint32_t    lo = 0, hi;
+
+    if (rd == NULL) return -1;
+
+    t  = rd->header.monoStartUs + offsetUs;
+    hi = rd->count;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (rd->index[mid].startUs < t) lo = mid + 1;
+        else                            hi = mid;
+    }
+    return (lo < rd->count) ? (long)lo : -1;
+}
+
+
+// --- replay ---
+
+zul_recplay_t * rec_startReplay(zul_recreader_t *rd, uint32_t first,
+                                    double speed, interrupt_handler_t handler)
+{
+    zul_recplay_t *     rp;
+    pthread_condattr_t  attr;
+
+    if ((rd == NULL) || (handler == NULL) || (first >= rd->count)) return NULL;
+
+    rp = (zul_recplay_t *)calloc(1, sizeof(zul_recplay_t));
+    if (rp == NULL) return NULL;
+
+    rp->rd      = rd;
+    rp->first   = first;
+    rp->speed   = (speed > 0.0) ? speed : 0.0;
+    rp->handler = handler;
+    rp->cells   = (uint8_t *)malloc((size_t)rd->numCells);
+    rp->missing = (uint8_t *)malloc((size_t)RF_BITMAP_LEN(rd->numCells));
+    if ((rp->cells == NULL) || (rp->missing == NULL))
+    {
+        free(rp->missing);
+        free(rp->cells);
+        free(rp);
+        return NULL;
+    }
+
+    (void)pthread_mutex_init(&rp->runLock, NULL);
+    (void)pthread_condattr_init(&attr);
+    (void)pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    (void)pthread_cond_init(&rp->runCond, &attr);
+    (void)pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&rp->thread, NULL, rec_replayWorker, rp) != 0)
+    {
+        zul_logf(1, "%s: no replay thread", __FUNCTION__);
+        (void)pthread_cond_destroy(&rp->runCond);
+        (void)pthread_mutex_destroy(&rp->runLock);
+        free(rp->missing);
+        free(rp->cells);
+        free(rp);
+        return NULL;
+    }
+
+    zul_logf(3, "%s: from frame %u at %.2fx", __FUNCTION__, first, speed);
+    return rp;
+}
+
+uint32_t rec_replayed(zul_recplay_t *rp)
+{
+    return (rp == NULL) ? 0 : atomic_load(&rp->replayed);
+}
+
+bool rec_replayDone(zul_recplay_t *rp)
+{
+    return (rp == NULL) || atomic_load(&rp->done);
+}
+
+void rec_stopReplay(zul_recplay_t *rp)
+{
+    if (rp == NULL) return;
+
+    (void)pthread_mutex_lock(&rp->runLock);
+    rp->stop = true;
+    (void)pthread_cond_signal(&rp->runCond);
+    (void)pthread_mutex_unlock(&rp->runLock);
+    (void)pthread_join(rp->thread, NULL);
+
+    (void)pthread_cond_destroy(&rp->runCond);
+    (void)pthread_mutex_destroy(&rp->runLock);
+    free(rp->missing);
+    free(rp->cells);
+    free(rp);
+}
+
+
+// ============================================================================
+// --- Private Implementation ---
+// ============================================================================
+
+/**
+ * Bytes of a frame record: header, cells, missing bitmap, to 8 bytes
+ */
+static uint32_t rec_recordLen(int numCells)
+{
+    uint32_t len = (uint32_t)(sizeof(rec_record_t) + (size_t)numCells +
+                                        (size_t)RF_BITMAP_LEN(numCells));
+    return (len + 7u) & ~7u;
+}
+
+/**
+ * Return the address of file offset off, mapping the window around it if
+ * [off, off + need) is not already mapped.  The window never extends
+ * beyond fileLen.
+ */
+static uint8_t *rec_window(rec_window_t *w, int fd, bool write, uint64_t off,
+                                                size_t need, uint64_t fileLen)
+{
+    uint64_t    page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t    base, len;
+    void *      p;
+
+    if ( (w->base != NULL) && (off >= w->off) &&
+         (off + need <= w->off + w->len) )
+    {
+        return w->base + (off - w->off);
+    }
+
+    rec_unmap(w, write);
+
+    base = off & ~(page - 1);
+    len  = REC_WINDOW;
+    if (len < off + need - base) len = off + need - base;
+    if (base + len > fileLen)    len = fileLen - base;
+    if ((off + need > fileLen) || (len == 0)) return NULL;
+
+    p = mmap(NULL, (size_t)len, write ? (PROT_READ | PROT_WRITE) : PROT_READ,
+                                            MAP_SHARED, fd, (off_t)base);
+    if (p == MAP_FAILED)
+    {
+        zul_logf(1, "%s: mmap: %s", __FUNCTION__, strerror(errno));
+        return NULL;
+    }
+    w->base = (uint8_t *)p;
+    w->off  = base;
+    w->len  = (size_t)len;
+    return w->base + (off - base);
+}
+
+static void rec_unmap(rec_window_t *w, bool write)
+{
+    if (w->base == NULL) return;
+
+    // the kernel writes the pages back; MS_ASYNC just starts it now
+    if (write) (void)msync(w->base, w->len, MS_ASYNC);
+    (void)munmap(w->base, w->len);
+    w->base = NULL;
+    w->len  = 0;
+}
+
+/**
+ * Allocate the file up to at least end, a chunk at a time
+ */
+static bool rec_grow(zul_recwriter_t *w, uint64_t end)
+{
+    uint64_t newLen;
+    int rc;
+
+    if (end <= w->fileLen) return true;
+
+    newLen = ((end + w->chunk - 1) / w->chunk) * w->chunk;
+
+    // blocks really allocated, so a full disk fails here and not with a
+    // SIGBUS on a store to the mapping
+    rc = posix_fallocate(w->fd, (off_t)w->fileLen, (off_t)(newLen - w->fileLen));
+    if ((rc == EOPNOTSUPP) || (rc == EINVAL))
+    {
+        rc = (ftruncate(w->fd, (off_t)newLen) == 0) ? 0 : errno;
+    }
+    if (rc != 0)
+    {
+        zul_logf(1, "%s: to %llu bytes: %s", __FUNCTION__,
+                                (unsigned long long)newLen, strerror(rc));
+        return false;
+    }
+    w->fileLen = newLen;
+    return true;
+}
+
+static int rec_appendLocked(zul_recwriter_t *w, rf_frame_t const *info,
+                                uint8_t const *cells, uint8_t const *missing)
+{
+    rec_record_t    r;
+    uint8_t *       p;
+    uint64_t        nowMs;
+
+    if ( (info->xWires != w->header.xWires) ||
+         (info->yWires != w->header.yWires) || (info->frame == 0) )
+    {
+        return FAILURE;
+    }
+
+    if (w->stats.frames == w->indexCap)
+    {
+        uint64_t cap = (w->indexCap != 0) ? 2 * w->indexCap : 4096;
+        rec_indexEntry_t *ix = (rec_indexEntry_t *)realloc(w->index,
+                                    (size_t)cap * sizeof(rec_indexEntry_t));
+        if (ix == NULL)
+        {
+            w->stats.errors++;
+            return FAILURE;
+        }
+        w->index    = ix;
+        w->indexCap = cap;
+    }
+
+    if (!rec_grow(w, w->dataEnd + w->header.recordLen + REC_WINDOW))
+    {
+        w->stats.errors++;
+        return FAILURE;
+    }
+    p = rec_window(&w->win, w->fd, true, w->dataEnd, w->header.recordLen,
+                                                                w->fileLen);
+    if (p == NULL)
+    {
+        w->stats.errors++;
+        return FAILURE;
+    }
+
+    // the record header last: a reader of an unclosed recording takes a
+    // record with a frame number as complete
+    memcpy(p + sizeof(r), cells, (size_t)w->numCells);
+    if (missing != NULL)
+    {
+        memcpy(p + sizeof(r) + w->numCells, missing,
+                                    (size_t)RF_BITMAP_LEN(w->numCells));
+    }
+    else
+    {
+        memset(p + sizeof(r) + w->numCells, 0,
+                                    (size_t)RF_BITMAP_LEN(w->numCells));
+    }
+    r.frame   = info->frame;
+    r.missing = info->missing;
+    r.startUs = info->startUs;
+    r.endUs   = info->endUs;
+    atomic_thread_fence(memory_order_release);
+    memcpy(p, &r, sizeof(r));
+
+    w->index[w->stats.frames].startUs  = info->startUs;
+    w->index[w->stats.frames].frame    = info->frame;
+    w->index[w->stats.frames].reserved = 0;
+    w->stats.frames++;
+    w->stats.bytes += w->header.recordLen;
+    w->dataEnd     += w->header.recordLen;
+
+    nowMs = zul_monotonicMs();
+    if (nowMs - w->lastSyncMs >= REC_SYNC_MS)
+    {
+        w->lastSyncMs = nowMs;
+        rec_sync(w);
+    }
+    return SUCCESS;
+}
+
+/**
+ * Start writing back the records since the last sync, and commit them in
+ * the header
+ */
+static void rec_sync(zul_recwriter_t *w)
+{
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t from = w->syncedEnd;
+
+    // earlier windows were written back as they were unmapped
+    if (from < w->win.off) from = w->win.off;
+    from &= ~(page - 1);
+    if ( (w->win.base != NULL) && (w->dataEnd > from) &&
+         (msync(w->win.base + (from - w->win.off),
+                        (size_t)(w->dataEnd - from), MS_ASYNC) != 0) )
+    {
+        w->stats.errors++;
+    }
+    w->syncedEnd = w->dataEnd;
+
+    w->header.frames  = w->stats.frames;
+    w->header.dropped = w->stats.dropped;
+    if (!rec_writeHeader(w->fd, &w->header)) w->stats.errors++;
+    w->stats.syncs++;
+}
+
+static bool rec_writeHeader(int fd, rec_header_t const *h)
+{
+    uint8_t block[REC_HEADER_LEN];
+
+    memset(block, 0, sizeof(block));
+    memcpy(block, h, sizeof(*h));
+    return pwrite(fd, block, sizeof(block), 0) == (ssize_t)sizeof(block);
+}
+
+/**
+ * Record each frame published by the assembler
+ */
+static void *rec_captureWorker(void *arg)
+{
+    zul_recwriter_t *   w = (zul_recwriter_t *)arg;
+    rf_frame_t          info;
+    uint32_t            last = 0;
+    int                 n;
+
+    while (!atomic_load(&w->stop))
+    {
+        n = rf_waitFrame(w->rf, last, 100, &info, w->cells, w->missing,
+                                                                w->numCells);
+        if (n == 0) continue;
+
+        (void)pthread_mutex_lock(&w->lock);
+        if (n < 0)
+        {
+            // a larger array than the recording's: not recordable
+            w->stats.dropped++;
+            (void)rf_waitFrame(w->rf, last, 0, &info, NULL, NULL, 0);
+            last = info.frame;
+        }
+        else
+        {
+            if ((last != 0) && ((uint32_t)n > last + 1))
+            {
+                w->stats.dropped += (uint32_t)n - last - 1;
+            }
+            last = (uint32_t)n;
+            if (rec_appendLocked(w, &info, w->cells, w->missing) != SUCCESS)
+            {
+                w->stats.dropped++;
+            }
+        }
+        (void)pthread_mutex_unlock(&w->lock);
+    }
+    return NULL;
+}
+
+/**
+ * Map the index of a closed recording, or rebuild it from the records
+ */
+static bool rec_loadIndex(zul_recreader_t *rd)
+{
+    rec_header_t const *h = &rd->header;
+    rec_indexEntry_t *  ix = NULL;
+    uint64_t            page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t            max, i, off;
+    uint32_t            prev = 0;
+
+    if ( (h->flags & REC_FLAG_CLOSED) && (h->indexCount <= UINT32_MAX) &&
+         (h->indexOffset + h->indexCount * sizeof(rec_indexEntry_t)
+                                                            <= rd->fileLen) )
+    {
+        uint64_t base = h->indexOffset & ~(page - 1);
+        void *   p;
+
+        rd->count = (uint32_t)h->indexCount;
+        if (rd->count == 0) return true;
+
+        rd->indexMapLen = (size_t)(h->indexOffset - base +
+                                h->indexCount * sizeof(rec_indexEntry_t));
+        p = mmap(NULL, rd->indexMapLen, PROT_READ, MAP_SHARED, rd->fd,
+                                                                (off_t)base);
+        if (p == MAP_FAILED)
+        {
+            zul_logf(1, "%s: mmap: %s", __FUNCTION__, strerror(errno));
+            return false;
+        }
+        rd->indexMap = p;
+        rd->index    = (rec_indexEntry_t const *)
+                                ((uint8_t *)p + (h->indexOffset - base));
+        return true;
+    }
+
+    // not closed: the records up to the first that was never completed
+    max = (rd->fileLen > h->headerLen) ?
+                        (rd->fileLen - h->headerLen) / h->recordLen : 0;
+    if (max > UINT32_MAX) max = UINT32_MAX;
+    if (max != 0)
+    {
+        ix = (rec_indexEntry_t *)malloc((size_t)max * sizeof(rec_indexEntry_t));
+        if (ix == NULL) return false;
+    }
+
+    for (i = 0, off = h->headerLen; i < max; i++, off += h->recordLen)
+    {
+        rec_record_t r;
+
+        if ( (pread(rd->fd, &r, sizeof(r), (off_t)off) != (ssize_t)sizeof(r)) ||
+             (r.frame <= prev) )
+        {
+            break;
+        }
+        ix[i].startUs  = r.startUs;
+        ix[i].frame    = r.frame;
+        ix[i].reserved = 0;
+        prev = r.frame;
+    }
+    rd->count = (uint32_t)i;
+    rd->index = ix;
+
+    zul_logf(2, "%s: recording not closed, %u frames found (%llu committed)",
+                        __FUNCTION__, rd->count, (unsigned long long)h->frames);
+    return true;
+}
+
+/**
+ * Pass the frames to the handler, at the times they were recorded
+ */
+static void *rec_replayWorker(void *arg)
+{
+    zul_recplay_t *     rp = (zul_recplay_t *)arg;
+    zul_recreader_t *   rd = rp->rd;
+    rf_frame_t          info;
+    uint64_t            t0 = zul_monotonicUs();
+    uint64_t            firstUs = 0;
+    uint32_t            pos;
+    bool                stop = false;
+
+    for (pos = rp->first; (pos < rd->count) && (!stop); pos++)
+    {
+        if (rec_readFrame(rd, pos, &info, rp->cells, rp->missing,
+                                                        rd->numCells) <= 0)
+        {
+            break;
+        }
+        if (pos == rp->first) firstUs = info.startUs;
+
+        (void)pthread_mutex_lock(&rp->runLock);
+        if (rp->speed > 0.0)
+        {
+            uint64_t        due = t0 + (uint64_t)((double)(info.startUs - firstUs)
+                                                                / rp->speed);
+            struct timespec ts;
+
+            ts.tv_sec  = (time_t)(due / 1000000);
+            ts.tv_nsec = (long)(due % 1000000) * 1000L;
+            while ( (!rp->stop) &&
+                    (pthread_cond_timedwait(&rp->runCond, &rp->runLock, &ts)
+                                                                != ETIMEDOUT) )
+            {
+            }
+        }
+        stop = rp->stop;
+        (void)pthread_mutex_unlock(&rp->runLock);
+
+        if (!stop)
+        {
+            rec_sendFrame(rp, &info);
+            atomic_fetch_add(&rp->replayed, 1);
+        }
+    }
+
+    atomic_store(&rp->done, true);
+    return NULL;
+}
+
+/**
+ * Encode a frame as the controller's raw data reports: a report per run of
+ * up to REPORT_MAX_CELLS recorded cells, in cell order
+ */
+static void rec_sendFrame(zul_recplay_t *rp, rf_frame_t const *info)
+{
+    uint8_t report[REPORT_LEN];
+    int     numCells = info->xWires * info->yWires;
+    int     i = 0;
+
+    while (i < numCells)
+    {
+        int n = 0;
+
+        // skip the cells no report carried
+        while ((i < numCells) && (rp->missing[i >> 3] & (1u << (i & 7)))) i++;
+        if (i == numCells) break;
+
+        memset(report, 0, sizeof(report));
+        report[0] = RAW_DATA;
+        report[1] = (uint8_t)(i / info->yWires);
+        report[2] = (uint8_t)(i % info->yWires);
+        while ( (i < numCells) && (n < REPORT_MAX_CELLS) &&
+                (!(rp->missing[i >> 3] & (1u << (i & 7)))) )
+        {
+            report[REPORT_HEADER_LEN + n++] = rp->cells[i++];
+        }
+        report[3] = (uint8_t)n;
+        rp->handler(report);
+    }
+}
+
+static uint64_t rec_realtimeUs(void)
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
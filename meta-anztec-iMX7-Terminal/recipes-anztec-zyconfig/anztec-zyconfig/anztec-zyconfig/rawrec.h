@@ -0,0 +1,246 @@
+/*
+ *  Copyright (c) 2019 Zytronic Displays Limited. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact Zytronic, you can do so either via the
+ * website <www.zytronic.co.uk> or by paper mail:
+ * Zytronic, Whiteley Road, Blaydon on Tyne, Tyne & Wear, NE21 5NJ, UK
+ */
+
+
+
+
+
+
+
+
+
+/* Module Overview
+   ===============
+   This code records the complete raw data frames of rawframe.h to a file,
+   for hours if need be, and reads them back: random access to any frame,
+   by position, frame number or time, and a replay that feeds the frames
+   back through the raw data handler path at real or accelerated speed.
+
+   File layout (host byte order, little endian on all our targets):
+        [0]             header (REC_HEADER_LEN bytes): the device PID, X/Y
+                        wire counts, version strings, start times, and the
+                        frames committed so far
+        [headerLen]     the frame log: fixed size records, one per frame,
+                        each a rec_record_t, the cells ([yWires * col + row],
+                        as rawframe.h) and the missing cell bitmap, padded
+                        to 8 bytes
+        [indexOffset]   the seek index, one rec_indexEntry_t per record,
+                        written when the recording is closed
+
+   The writer preallocates the file in large chunks and appends through a
+   shared mapping of a window of it (so a long recording fits a 32 bit
+   address space), from a capture thread of its own that waits for each
+   published frame.  Every REC_SYNC_MS the new records are flushed with
+   msync() and the header's frame count updated, so a recording that is
+   never closed (power loss, crash) is still readable up to its last sync;
+   the reader then rebuilds the index from the record headers.
+
+   The reader maps the index, and a window of the frame log around the
+   frame asked for, so a lookup touches neither the whole file nor the
+   frames it passes over.
+
+   Replay re-encodes each frame as the raw data reports the controller
+   sends (cells not recorded are not sent) and passes them to a handler,
+   from a thread of its own, paced by the recorded frame start times.
+
+ */
+
+#ifndef _ZY_RAWREC_H
+#define _ZY_RAWREC_H
+
+#include "zytypes.h"
+#include "protocol.h"
+#include "rawframe.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define  REC_MAGIC                  "ZYRAWREC"
+#define  REC_FORMAT_VERSION         (1)
+#define  REC_HEADER_LEN             (4096)
+#define  REC_VERSTR_LEN             (64)
+#define  REC_NUM_VERSIONS           (STR_CPUID + 1)
+#define  REC_DEFAULT_CHUNK          (64u << 20)     // file growth, bytes
+#define  REC_SYNC_MS                (1000)
+
+// flags of the header
+#define  REC_FLAG_CLOSED            (0x0001)        // index written
+
+// file header
+typedef struct rec_header
+{
+    char        magic[8];
+    uint32_t    formatVersion;
+    uint32_t    headerLen;
+    uint32_t    recordLen;              // bytes per frame record
+    int16_t     pid;
+    uint16_t    flags;
+    uint16_t    xWires;
+    uint16_t    yWires;
+    uint32_t    reserved;
+    uint64_t    wallStartUs;            // CLOCK_REALTIME at creation
+    uint64_t    monoStartUs;            // CLOCK_MONOTONIC, as frame times
+    uint64_t    frames;                 // records committed
+    uint64_t    dropped;                // frames published but not recorded
+    uint64_t    indexOffset;            // 0 if not closed
+    uint64_t    indexCount;
+    char        version[REC_NUM_VERSIONS][REC_VERSTR_LEN];  // by VerIndex
+} rec_header_t;
+
+// leading part of each frame record
+typedef struct rec_record
+{
+    uint32_t    frame;                  // as rf_frame_t, never 0
+    int32_t     missing;
+    uint64_t    startUs;
+    uint64_t    endUs;
+} rec_record_t;
+
+typedef struct rec_indexEntry
+{
+    uint64_t    startUs;
+    uint32_t    frame;
+    uint32_t    reserved;
+} rec_indexEntry_t;
+
+// what the recording is of
+typedef struct rec_info
+{
+    int16_t     pid;
+    uint16_t    xWires;
+    uint16_t    yWires;
+    char        version[REC_NUM_VERSIONS][REC_VERSTR_LEN];  // "" if unknown
+} rec_info_t;
+
+// writer counts
+typedef struct rec_stats
+{
+    uint64_t    frames;                 // recorded
+    uint64_t    dropped;                // frame numbers skipped by capture
+    uint64_t    bytes;                  // of the frame log
+    uint32_t    syncs;
+    uint32_t    errors;                 // mapping or file errors
+} rec_stats_t;
+
+typedef struct zul_recwriter zul_recwriter_t;
+typedef struct zul_recreader zul_recreader_t;
+typedef struct zul_recplay   zul_recplay_t;
+
+
+// --- writer ---
+
+/**
+ * Create (or truncate) a recording of frames of info's size, preallocating
+ * chunkBytes at a time (0: REC_DEFAULT_CHUNK).  Return NULL on error.
+ */
+/*@null@*/
+zul_recwriter_t *   rec_create              (char const *path,
+                                                rec_info_t const *info,
+                                                uint32_t chunkBytes);
+
+/**
+ * Append a frame, of the recording's size.  Return FAILURE on a file error.
+ * Not to be called while capturing.
+ */
+int                 rec_append              (zul_recwriter_t *w,
+                                                rf_frame_t const *info,
+                                                uint8_t const *cells,
+                                                /*@null@*/ uint8_t const *missing);
+
+/**
+ * Record the frames published by rf, from a capture thread, until
+ * rec_close().  rf must outlive the writer.
+ */
+int                 rec_startCapture        (zul_recwriter_t *w,
+                                                zul_rawframe_t *rf);
+
+void                rec_getStats            (zul_recwriter_t *w,
+                                                rec_stats_t *stats);
+
+/**
+ * Stop capturing, write the index and close the file.  Return FAILURE if
+ * the recording could not be completed (it is then readable up to its last
+ * sync).
+ */
+int                 rec_close               (/*@null@*/ zul_recwriter_t *w);
+
+
+// --- reader ---
+
+/*@null@*/
+zul_recreader_t *   rec_open                (char const *path);
+void                rec_closeReader         (/*@null@*/ zul_recreader_t *rd);
+
+void                rec_getInfo             (zul_recreader_t *rd,
+                                                rec_header_t *header);
+
+// frames in the recording
+uint32_t            rec_frameCount          (zul_recreader_t *rd);
+
+/**
+ * Copy the frame at position pos (from 0) as rf_waitFrame() does; cells
+ * and missing may each be NULL.  Return the frame number, 0 if pos is out
+ * of range, or -1 if cellsLen is too small or the file cannot be read.
+ * Any thread may call this.
+ */
+int                 rec_readFrame           (zul_recreader_t *rd, uint32_t pos,
+                                                rf_frame_t *info,
+                                                /*@null@*/ uint8_t *cells,
+                                                /*@null@*/ uint8_t *missing,
+                                                int cellsLen);
+
+/**
+ * Return the position of frame number frame, or -1 if it was not recorded
+ */
+long                rec_findFrame           (zul_recreader_t *rd, uint32_t frame);
+
+/**
+ * Return the position of the first frame started at or after offsetUs from
+ * the start of the recording, or -1 if there is none
+ */
+long                rec_findTime            (zul_recreader_t *rd, uint64_t offsetUs);
+
+
+// --- replay ---
+
+/**
+ * Pass the raw data reports of the frames from position first to handler,
+ * from a thread, at speed times the recorded rate (0: as fast as possible).
+ * rd must outlive the replay.
+ */
+/*@null@*/
+zul_recplay_t *     rec_startReplay         (zul_recreader_t *rd, uint32_t first,
+                                                double speed,
+                                                interrupt_handler_t handler);
+
+// frames replayed so far
+uint32_t            rec_replayed            (zul_recplay_t *rp);
+bool                rec_replayDone          (zul_recplay_t *rp);
+void                rec_stopReplay          (/*@null@*/ zul_recplay_t *rp);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ZY_RAWREC_H
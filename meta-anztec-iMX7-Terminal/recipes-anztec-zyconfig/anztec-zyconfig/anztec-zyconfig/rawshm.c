@@ -0,0 +1,456 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* For a module overview, see the header file
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "rawshm.h"
+#include "debug.h"
+
+//
+// --- Module Types ---
+//
+
+#define SLOT_HEAD_LEN               (64)        // the cells start a cache line
+#define READ_ATTEMPTS               (4)
+
+struct zul_rshwriter
+{
+    char                name[NAME_MAX + 1];
+    int                 fd;
+    uint8_t *           base;
+    size_t              len;
+    rsh_header_t *      h;
+    rsh_slot_t *        open;           // between begin and commit
+};
+
+struct zul_rshreader
+{
+    int                 fd;
+    uint8_t const *     base;
+    size_t              len;
+    rsh_header_t const *h;
+};
+
+
+//
+// --- Module Prototypes ---
+//
+
+static rsh_slot_t *     rsh_slot                (uint8_t const *base,
+                                                    rsh_header_t const *h,
+                                                    uint32_t pubNo);
+static void             rsh_wake                (rsh_header_t *h);
+
+
+// ============================================================================
+// --- Public Services ---
+// ============================================================================
+
+// --- publisher ---
+
+zul_rshwriter_t * rsh_create(char const *name, int slots, int maxCells,
+                                                                int16_t pid)
+{
+    zul_rshwriter_t *   w;
+    uint32_t            slotLen;
+    int                 size = 1;
+
+    if (name == NULL) name = RSH_DEFAULT_NAME;
+    if ((name[0] != '/') || (strlen(name) > NAME_MAX)) return NULL;
+    if ((maxCells < 1) || (maxCells > RF_MAX_CELLS)) return NULL;
+    if (slots < 2) slots = RSH_DEFAULT_SLOTS;
+    if (slots > RSH_MAX_SLOTS) slots = RSH_MAX_SLOTS;
+
+    // a power of two, so the slot of a frame stays put as the count wraps
+    while (size < slots) size <<= 1;
+    slots = size;
+
+    slotLen = (uint32_t)(SLOT_HEAD_LEN + maxCells + RF_BITMAP_LEN(maxCells));
+    slotLen = (slotLen + 63u) & ~63u;
+
+    w = (zul_rshwriter_t *)calloc(1, sizeof(zul_rshwriter_t));
+    if (w == NULL) return NULL;
+    strcpy(w->name, name);
+    w->len = RSH_HEADER_LEN + (size_t)slots * slotLen;
+
+    // a new segment: clients still attached to the last keep their mapping
+    (void)shm_unlink(name);
+    w->fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (w->fd < 0)
+    {
+        zul_logf(1, "%s: %s: %s", __FUNCTION__, name, strerror(errno));
+        free(w);
+        return NULL;
+    }
+    (void)fchmod(w->fd, 0644);      // whatever the umask
+
+    if (ftruncate(w->fd, (off_t)w->len) != 0)
+    {
+        zul_logf(1, "%s: %s: %s", __FUNCTION__, name, strerror(errno));
+        rsh_destroy(w);
+        return NULL;
+    }
+    w->base = (uint8_t *)mmap(NULL, w->len, PROT_READ | PROT_WRITE,
+                                                    MAP_SHARED, w->fd, 0);
+    if (w->base == (uint8_t *)MAP_FAILED)
+    {
+        zul_logf(1, "%s: mmap: %s", __FUNCTION__, strerror(errno));
+        w->base = NULL;
+        rsh_destroy(w);
+        return NULL;
+    }
+
+    // the segment is zero filled: every slot is even and empty
+    w->h = (rsh_header_t *)w->base;
+    w->h->formatVersion = RSH_FORMAT_VERSION;
+    w->h->headerLen     = RSH_HEADER_LEN;
+    w->h->slots         = (uint32_t)slots;
+    w->h->slotLen       = slotLen;
+    w->h->maxCells      = (uint32_t)maxCells;
+    w->h->pid           = pid;
+    w->h->writerPid     = (uint32_t)getpid();
+    __atomic_store_n(&w->h->state, RSH_LIVE, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(w->h->magic, RSH_MAGIC, sizeof(w->h->magic));
+
+    zul_logf(3, "%s: %s, %d slots of %d cells", __FUNCTION__, name, slots,
+                                                                    maxCells);
+    return w;
+}
+
+void rsh_destroy(zul_rshwriter_t *w)
+{
+    if (w == NULL) return;
+
+    if (w->h != NULL)
+    {
+        __atomic_store_n(&w->h->state, RSH_CLOSED, __ATOMIC_RELEASE);
+        // readers waiting on the count see the state as they wake
+        (void)__atomic_add_fetch(&w->h->published, 0, __ATOMIC_RELEASE);
+        rsh_wake(w->h);
+    }
+    if (w->base != NULL) (void)munmap(w->base, w->len);
+    (void)close(w->fd);
+    (void)shm_unlink(w->name);
+    free(w);
+}
+
+int rsh_beginFrame(zul_rshwriter_t *w, uint8_t **cells, uint8_t **missing)
+{
+    rsh_slot_t *s;
+    uint32_t    seq;
+
+    if ((w == NULL) || (w->open != NULL)) return FAILURE;
+
+    s   = rsh_slot(w->base, w->h,
+                __atomic_load_n(&w->h->published, __ATOMIC_RELAXED) + 1);
+    seq = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+
+    // odd, then the contents
+    __atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    s->pubNo = 0;
+
+    w->open = s;
+    if (cells != NULL)   *cells   = (uint8_t *)s + SLOT_HEAD_LEN;
+    if (missing != NULL) *missing = (uint8_t *)s + SLOT_HEAD_LEN + w->h->maxCells;
+    return SUCCESS;
+}
+
+int rsh_commitFrame(zul_rshwriter_t *w, rf_frame_t const *info)
+{
+    rsh_slot_t *s;
+    uint32_t    pubNo;
+
+    if ((w == NULL) || (w->open == NULL) || (info == NULL)) return FAILURE;
+    if ((uint32_t)(info->xWires * info->yWires) > w->h->maxCells)
+    {
+        rsh_abortFrame(w);
+        return FAILURE;
+    }
+
+    s     = w->open;
+    pubNo = __atomic_load_n(&w->h->published, __ATOMIC_RELAXED) + 1;
+    s->pubNo   = pubNo;
+    s->frame   = info->frame;
+    s->missing = info->missing;
+    s->startUs = info->startUs;
+    s->endUs   = info->endUs;
+    s->xWires  = info->xWires;
+    s->yWires  = info->yWires;
+    s->generation = info->generation;
+
+    // even again, then the count the readers wait on
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&w->h->published, pubNo, __ATOMIC_RELEASE);
+    w->open = NULL;
+
+    rsh_wake(w->h);
+    return SUCCESS;
+}
+
+void rsh_abortFrame(zul_rshwriter_t *w)
+{
+    if ((w == NULL) || (w->open == NULL)) return;
+
+    // the slot stays empty: pubNo 0 matches no frame
+    __atomic_store_n(&w->open->seq, w->open->seq + 1, __ATOMIC_RELEASE);
+    w->open = NULL;
+}
+
+
+// --- client ---
+
+zul_rshreader_t * rsh_attach(char const *name)
+{
+    zul_rshreader_t *   rd;
+    rsh_header_t const *h;
+    struct stat         st;
+
+    if (name == NULL) name = RSH_DEFAULT_NAME;
+
+    rd = (zul_rshreader_t *)calloc(1, sizeof(zul_rshreader_t));
+    if (rd == NULL) return NULL;
+
+    rd->fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if ((rd->fd < 0) || (fstat(rd->fd, &st) != 0) ||
+                                    ((size_t)st.st_size < RSH_HEADER_LEN))
+    {
+        zul_logf(3, "%s: %s: %s", __FUNCTION__, name,
+                                (rd->fd < 0) ? strerror(errno) : "too short");
+        if (rd->fd >= 0) (void)close(rd->fd);
+        free(rd);
+        return NULL;
+    }
+    rd->len  = (size_t)st.st_size;
+    rd->base = (uint8_t const *)mmap(NULL, rd->len, PROT_READ, MAP_SHARED,
+                                                                    rd->fd, 0);
+    if (rd->base == (uint8_t const *)MAP_FAILED)
+    {
+        zul_logf(1, "%s: mmap: %s", __FUNCTION__, strerror(errno));
+        (void)close(rd->fd);
+        free(rd);
+        return NULL;
+    }
+
+    // the magic is written last: a segment being set up is not attached
+    h = (rsh_header_t const *)rd->base;
+    if (memcmp(h->magic, RSH_MAGIC, sizeof(h->magic)) == 0)
+    {
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    }
+    else
+    {
+        h = NULL;
+    }
+    if ( (h == NULL) || (h->formatVersion != RSH_FORMAT_VERSION) ||
+         (h->slots == 0) || ((h->slots & (h->slots - 1)) != 0) ||
+         (h->maxCells > RF_MAX_CELLS) ||
+         (h->slotLen < SLOT_HEAD_LEN + h->maxCells + RF_BITMAP_LEN(h->maxCells)) ||
+         ((size_t)h->headerLen + (size_t)h->slots * h->slotLen > rd->len) )
+    {
+        zul_logf(3, "%s: %s: not a raw frame segment", __FUNCTION__, name);
+        rsh_detach(rd);
+        return NULL;
+    }
+    rd->h = h;
+    return rd;
+}
+
+void rsh_detach(zul_rshreader_t *rd)
+{
+    if (rd == NULL) return;
+
+    (void)munmap((void *)rd->base, rd->len);
+    (void)close(rd->fd);
+    free(rd);
+}
+
+void rsh_getInfo(zul_rshreader_t *rd, rsh_header_t *header)
+{
+    if ((rd == NULL) || (header == NULL)) return;
+
+    memcpy(header, rd->h, sizeof(rsh_header_t));
+}
+
+int rsh_wait(zul_rshreader_t *rd, uint32_t after, int timeoutMs,
+                                                            uint32_t *pubNo)
+{
+    struct timespec now, deadline;
+
+    if (rd == NULL) return -1;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec  += timeoutMs / 1000;
+    deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_nsec -= 1000000000L;
+        deadline.tv_sec++;
+    }
+
+    while (true)
+    {
+        uint32_t        p = __atomic_load_n(&rd->h->published, __ATOMIC_ACQUIRE);
+        struct timespec left;
+
+        if ((int32_t)(p - after) > 0)
+        {
+            if (pubNo != NULL) *pubNo = p;
+            return 1;
+        }
+        if (__atomic_load_n(&rd->h->state, __ATOMIC_ACQUIRE) == RSH_CLOSED)
+        {
+            return -1;
+        }
+        if (timeoutMs == 0) return 0;
+
+        if (timeoutMs > 0)
+        {
+            (void)clock_gettime(CLOCK_MONOTONIC, &now);
+            left.tv_sec  = deadline.tv_sec  - now.tv_sec;
+            left.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+            if (left.tv_nsec < 0)
+            {
+                left.tv_nsec += 1000000000L;
+                left.tv_sec--;
+            }
+            if (left.tv_sec < 0) return 0;
+        }
+
+        // sleeps only while the count is still p (FUTEX_WAIT reads, so the
+        // read-only mapping will do)
+        (void)syscall(SYS_futex, (uint32_t *)&rd->h->published, FUTEX_WAIT,
+                            p, (timeoutMs > 0) ? &left : NULL, NULL, 0);
+    }
+}
+
+bool rsh_view(zul_rshreader_t *rd, uint32_t pubNo, rsh_view_t *view)
+{
+    rsh_slot_t const *  s;
+    uint32_t            seq;
+
+    if ((rd == NULL) || (view == NULL) || (pubNo == 0)) return false;
+
+    s   = rsh_slot(rd->base, rd->h, pubNo);
+    seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+    if ((seq & 1u) || (s->pubNo != pubNo)) return false;
+
+    view->pubNo          = pubNo;
+    view->info.frame     = s->frame;
+    view->info.startUs   = s->startUs;
+    view->info.endUs     = s->endUs;
+    view->info.xWires    = s->xWires;
+    view->info.yWires    = s->yWires;
+    view->info.missing   = s->missing;
+    view->info.generation = s->generation;
+    view->cells          = (uint8_t const *)s + SLOT_HEAD_LEN;
+    view->missing        = view->cells + rd->h->maxCells;
+    view->seq            = seq;
+    view->slot           = pubNo & (rd->h->slots - 1);
+
+    // the info too must be of this frame
+    return rsh_viewValid(rd, view);
+}
+
+bool rsh_viewValid(zul_rshreader_t *rd, rsh_view_t const *view)
+{
+    rsh_slot_t const *s;
+
+    if ((rd == NULL) || (view == NULL)) return false;
+
+    s = rsh_slot(rd->base, rd->h, view->pubNo);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&s->seq, __ATOMIC_RELAXED) == view->seq;
+}
+
+int rsh_readLatest(zul_rshreader_t *rd, rf_frame_t *info, uint8_t *cells,
+                        uint8_t *missing, int cellsLen, uint32_t *pubNo)
+{
+    rsh_view_t  v;
+    int         i, numCells;
+
+    if ((rd == NULL) || (info == NULL)) return 0;
+
+    // the publisher may lap a slow copy: retry with the then latest
+    for (i = 0; i < READ_ATTEMPTS; i++)
+    {
+        uint32_t p = __atomic_load_n(&rd->h->published, __ATOMIC_ACQUIRE);
+
+        if (p == 0) return 0;
+        if (!rsh_view(rd, p, &v)) continue;
+
+        numCells = v.info.xWires * v.info.yWires;
+        if (((cells != NULL) || (missing != NULL)) && (cellsLen < numCells))
+        {
+            return -1;
+        }
+        if (cells != NULL)   memcpy(cells, v.cells, (size_t)numCells);
+        if (missing != NULL) memcpy(missing, v.missing,
+                                            (size_t)RF_BITMAP_LEN(numCells));
+        if (rsh_viewValid(rd, &v))
+        {
+            *info = v.info;
+            if (pubNo != NULL) *pubNo = p;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+// ============================================================================
+// --- Private Implementation ---
+// ============================================================================
+
+static rsh_slot_t *rsh_slot(uint8_t const *base, rsh_header_t const *h,
+                                                                uint32_t pubNo)
+{
+    return (rsh_slot_t *)(base + h->headerLen +
+                            (size_t)(pubNo & (h->slots - 1)) * h->slotLen);
+}
+
+static void rsh_wake(rsh_header_t *h)
+{
+    (void)syscall(SYS_futex, &h->published, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
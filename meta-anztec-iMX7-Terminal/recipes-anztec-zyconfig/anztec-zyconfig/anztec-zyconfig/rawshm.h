@@ -0,0 +1,208 @@
+/*
+ *  Copyright (c) 2019 Zytronic Displays Limited. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact Zytronic, you can do so either via the
+ * website <www.zytronic.co.uk> or by paper mail:
+ * Zytronic, Whiteley Road, Blaydon on Tyne, Tyne & Wear, NE21 5NJ, UK
+ */
+
+
+
+
+
+
+
+
+
+/* Module Overview
+   ===============
+   This code shares the complete raw data frames of rawframe.h with other
+   local processes through POSIX shared memory: one process holds the
+   controller and publishes each frame once into a ring of slots, and any
+   number of clients attach read-only and read the frames in place, with no
+   further USB traffic and no per-client copy.
+
+   Segment layout:
+        [0]             rsh_header_t (RSH_HEADER_LEN bytes): the ring size,
+                        the device PID, and the count of frames published
+        [headerLen]     slots of slotLen bytes: an rsh_slot_t, the cells
+                        ([yWires * col + row], as rawframe.h) and the
+                        missing cell bitmap
+
+   Frame n (from 1) is in slot n % slots.  Each slot is guarded by a
+   sequence lock: its sequence is odd while the publisher writes it, and a
+   reader takes a frame as read only if the sequence is even, and the same,
+   before and after it has read it.  A reader more than (slots - 1) frames
+   behind finds its frame overwritten, and moves to the latest.
+
+   The count of frames published is the futex word: the publisher wakes
+   the waiting readers of each new frame (a shared futex, as an eventfd
+   cannot be handed to unrelated processes by name).  The publisher marks
+   the segment closed, and wakes the readers, as it ends; it removes and
+   recreates the segment as it starts, so a client should re-attach once
+   rsh_wait() reports it closed.
+
+   The segment is created with mode 0644: clients need no write access.
+   Link with -lrt where the C library predates glibc 2.34.
+
+ */
+
+#ifndef _ZY_RAWSHM_H
+#define _ZY_RAWSHM_H
+
+#include "zytypes.h"
+#include "rawframe.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define  RSH_DEFAULT_NAME           "/zytronic-rawframes"
+#define  RSH_MAGIC                  "ZYRAWSHM"
+#define  RSH_FORMAT_VERSION         (1)
+#define  RSH_HEADER_LEN             (4096)
+#define  RSH_DEFAULT_SLOTS          (8)
+#define  RSH_MAX_SLOTS              (256)
+
+// writer states
+#define  RSH_LIVE                   (1)
+#define  RSH_CLOSED                 (2)
+
+// segment header
+typedef struct rsh_header
+{
+    char                magic[8];
+    uint32_t            formatVersion;
+    uint32_t            headerLen;
+    uint32_t            slots;
+    uint32_t            slotLen;
+    uint32_t            maxCells;           // per slot
+    int16_t             pid;
+    uint16_t            reserved;
+    uint32_t            writerPid;
+    uint32_t            state;              // atomic: RSH_LIVE, RSH_CLOSED
+    uint32_t            published;          // atomic: frames, the futex word
+} rsh_header_t;
+
+// leading part of each slot
+typedef struct rsh_slot
+{
+    uint32_t            seq;                // atomic: odd while written
+    uint32_t            pubNo;              // the frame's n
+    uint32_t            frame;              // rf_frame_t
+    int32_t             missing;
+    uint64_t            startUs;
+    uint64_t            endUs;
+    uint16_t            xWires;
+    uint16_t            yWires;
+    uint32_t            generation;         // rf_frame_t, in what was padding
+} rsh_slot_t;
+
+// a frame read in place, see rsh_view()
+typedef struct rsh_view
+{
+    rf_frame_t          info;
+    uint32_t            pubNo;
+    uint8_t const *     cells;
+    uint8_t const *     missing;
+    uint32_t            seq;                // private
+    uint32_t            slot;
+} rsh_view_t;
+
+typedef struct zul_rshwriter zul_rshwriter_t;
+typedef struct zul_rshreader zul_rshreader_t;
+
+
+// --- publisher ---
+
+/**
+ * (Re)create the segment name (NULL: RSH_DEFAULT_NAME), of slots frames
+ * (0: RSH_DEFAULT_SLOTS) of up to maxCells cells.  Return NULL on error.
+ */
+/*@null@*/
+zul_rshwriter_t *   rsh_create              (/*@null@*/ char const *name,
+                                                int slots, int maxCells,
+                                                int16_t pid);
+
+/**
+ * Mark the segment closed, wake the readers, and remove the segment name
+ */
+void                rsh_destroy             (/*@null@*/ zul_rshwriter_t *w);
+
+/**
+ * Publish a frame in two steps, so that it may be copied straight into its
+ * slot (by rf_waitFrame() or zul_waitRawFrame()):
+ *  - rsh_beginFrame() opens the next slot, and returns its cells and
+ *    missing bitmap (maxCells bytes, and RF_BITMAP_LEN(maxCells) bytes)
+ *  - rsh_commitFrame() publishes it, with the frame's info, and wakes the
+ *    readers; or rsh_abortFrame() gives it up (its previous frame is lost).
+ * Only one thread may publish.
+ */
+int                 rsh_beginFrame          (zul_rshwriter_t *w,
+                                                uint8_t **cells,
+                                                uint8_t **missing);
+int                 rsh_commitFrame         (zul_rshwriter_t *w,
+                                                rf_frame_t const *info);
+void                rsh_abortFrame          (zul_rshwriter_t *w);
+
+
+// --- client ---
+
+/*@null@*/
+zul_rshreader_t *   rsh_attach              (/*@null@*/ char const *name);
+void                rsh_detach              (/*@null@*/ zul_rshreader_t *rd);
+
+void                rsh_getInfo             (zul_rshreader_t *rd,
+                                                rsh_header_t *header);
+
+/**
+ * Wait for up to timeoutMs (zero: do not wait, negative: indefinitely) for
+ * a frame later than after (a pubNo, or zero), and set pubNo to the latest.
+ * Return 1, zero on timeout, or -1 if the publisher has closed the segment.
+ */
+int                 rsh_wait                (zul_rshreader_t *rd, uint32_t after,
+                                                int timeoutMs, uint32_t *pubNo);
+
+/**
+ * Read frame pubNo in place: rsh_view() fills view, with pointers into the
+ * segment, and rsh_viewValid() reports, after the cells have been used,
+ * whether the frame was overwritten meanwhile (the cells used are then to
+ * be discarded).  rsh_view() returns false if the frame is not in the ring.
+ */
+bool                rsh_view                (zul_rshreader_t *rd, uint32_t pubNo,
+                                                rsh_view_t *view);
+bool                rsh_viewValid           (zul_rshreader_t *rd,
+                                                rsh_view_t const *view);
+
+/**
+ * Copy the latest frame, as rf_waitFrame() does, and set pubNo (which may
+ * be NULL).  Return 1, zero if there is none (or it was overwritten as it
+ * was copied, repeatedly), or -1 if cellsLen is too small.
+ */
+int                 rsh_readLatest          (zul_rshreader_t *rd,
+                                                rf_frame_t *info,
+                                                /*@null@*/ uint8_t *cells,
+                                                /*@null@*/ uint8_t *missing,
+                                                int cellsLen,
+                                                /*@null@*/ uint32_t *pubNo);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ZY_RAWSHM_H
@@ -0,0 +1,920 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* For a module overview, see the header file
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define RS_NEON
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#define RS_SSE2
+#include <emmintrin.h>
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define RS_AVX2
+#include <immintrin.h>
+#define AVX2_FN                     __attribute__((target("avx2")))
+#endif
+#endif
+
+#include "rawstats.h"
+#include "debug.h"
+
+//
+// --- Module Types ---
+//
+
+// cells per call of the range and count kernels, so that their vector
+// accumulators cannot overflow
+#define BLOCK                       (65536)
+
+#define STATS_ALIGN                 (32)
+
+typedef struct rs_kernels
+{
+    char const *    name;
+    void    (*sub8)     (uint8_t *out, uint8_t const *f, uint8_t const *b, int n);
+    void    (*sub16)    (uint16_t *out, uint16_t const *f, uint16_t const *b, int n);
+    void    (*range8)   (uint8_t const *f, int n, rs_range_t *r);
+    void    (*range16)  (uint16_t const *f, int n, rs_range_t *r);
+    int     (*count8)   (uint8_t const *f, int n, uint8_t t);
+    int     (*count16)  (uint16_t const *f, int n, uint16_t t);
+    void    (*ewma8)    (int32_t *mean, int32_t *var, uint8_t const *x, int n,
+                                                                    int shift);
+} rs_kernels_t;
+
+
+//
+// --- Module Prototypes ---
+//
+
+static void     rs_select               (void);
+static rs_kernels_t const * rs_kernels  (void);
+
+// scalar, the reference
+static void     sc_sub8                 (uint8_t *out, uint8_t const *f,
+                                            uint8_t const *b, int n);
+static void     sc_sub16                (uint16_t *out, uint16_t const *f,
+                                            uint16_t const *b, int n);
+static void     sc_range8               (uint8_t const *f, int n, rs_range_t *r);
+static void     sc_range16              (uint16_t const *f, int n, rs_range_t *r);
+static int      sc_count8               (uint8_t const *f, int n, uint8_t t);
+static int      sc_count16              (uint16_t const *f, int n, uint16_t t);
+static void     sc_ewma8                (int32_t *mean, int32_t *var,
+                                            uint8_t const *x, int n, int shift);
+
+
+//
+// --- Module Variables ---
+//
+
+static rs_kernels_t const   msv_scalar =
+{
+    "scalar", sc_sub8, sc_sub16, sc_range8, sc_range16, sc_count8, sc_count16,
+    sc_ewma8
+};
+
+static pthread_once_t       msv_selectOnce = PTHREAD_ONCE_INIT;
+static rs_kernels_t const * msv_vector = &msv_scalar;
+/*@null@*/
+static rs_kernels_t const * volatile msv_forced = NULL;    // by rs_useKernels()
+
+
+// ============================================================================
+// --- Scalar Kernels ---
+// ============================================================================
+
+static void sc_sub8(uint8_t *out, uint8_t const *f, uint8_t const *b, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) out[i] = (uint8_t)((f[i] > b[i]) ? f[i] - b[i] : 0);
+}
+
+static void sc_sub16(uint16_t *out, uint16_t const *f, uint16_t const *b, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) out[i] = (uint16_t)((f[i] > b[i]) ? f[i] - b[i] : 0);
+}
+
+static void sc_range8(uint8_t const *f, int n, rs_range_t *r)
+{
+    uint32_t    lo = 0xFF, hi = 0;
+    uint64_t    sum = 0;
+    int         i;
+
+    for (i = 0; i < n; i++)
+    {
+        if (f[i] < lo) lo = f[i];
+        if (f[i] > hi) hi = f[i];
+        sum += f[i];
+    }
+    r->min = lo;
+    r->max = hi;
+    r->sum = sum;
+}
+
+static void sc_range16(uint16_t const *f, int n, rs_range_t *r)
+{
+    uint32_t    lo = 0xFFFF, hi = 0;
+    uint64_t    sum = 0;
+    int         i;
+
+    for (i = 0; i < n; i++)
+    {
+        if (f[i] < lo) lo = f[i];
+        if (f[i] > hi) hi = f[i];
+        sum += f[i];
+    }
+    r->min = lo;
+    r->max = hi;
+    r->sum = sum;
+}
+
+static int sc_count8(uint8_t const *f, int n, uint8_t t)
+{
+    int i, count = 0;
+
+    for (i = 0; i < n; i++) count += (f[i] >= t);
+    return count;
+}
+
+static int sc_count16(uint16_t const *f, int n, uint16_t t)
+{
+    int i, count = 0;
+
+    for (i = 0; i < n; i++) count += (f[i] >= t);
+    return count;
+}
+
+/**
+ * The running statistics of one frame.  The vector versions follow these
+ * steps exactly: the shifts are arithmetic, and (d >> 4)^2 cannot overflow.
+ */
+static void sc_ewma8(int32_t *mean, int32_t *var, uint8_t const *x, int n,
+                                                                    int shift)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        int32_t d = ((int32_t)x[i] << 8) - mean[i];
+        int32_t s = d >> 4;
+
+        mean[i] += d >> shift;
+        var[i]  += ((s * s) - var[i]) >> shift;
+    }
+}
+
+
+#ifdef RS_SSE2
+// ============================================================================
+// --- SSE2 Kernels ---
+// ============================================================================
+
+static inline uint32_t sse_hmin8(__m128i m)
+{
+    m = _mm_min_epu8(m, _mm_srli_si128(m, 8));
+    m = _mm_min_epu8(m, _mm_srli_si128(m, 4));
+    m = _mm_min_epu8(m, _mm_srli_si128(m, 2));
+    m = _mm_min_epu8(m, _mm_srli_si128(m, 1));
+    return (uint32_t)_mm_cvtsi128_si32(m) & 0xFF;
+}
+
+static inline uint32_t sse_hmax8(__m128i m)
+{
+    m = _mm_max_epu8(m, _mm_srli_si128(m, 8));
+    m = _mm_max_epu8(m, _mm_srli_si128(m, 4));
+    m = _mm_max_epu8(m, _mm_srli_si128(m, 2));
+    m = _mm_max_epu8(m, _mm_srli_si128(m, 1));
+    return (uint32_t)_mm_cvtsi128_si32(m) & 0xFF;
+}
+
+// of signed 16 bit lanes, biased by 0x8000 from the unsigned values
+static inline uint32_t sse_hmin16b(__m128i m)
+{
+    m = _mm_min_epi16(m, _mm_srli_si128(m, 8));
+    m = _mm_min_epi16(m, _mm_srli_si128(m, 4));
+    m = _mm_min_epi16(m, _mm_srli_si128(m, 2));
+    return ((uint32_t)_mm_cvtsi128_si32(m) & 0xFFFF) ^ 0x8000;
+}
+
+static inline uint32_t sse_hmax16b(__m128i m)
+{
+    m = _mm_max_epi16(m, _mm_srli_si128(m, 8));
+    m = _mm_max_epi16(m, _mm_srli_si128(m, 4));
+    m = _mm_max_epi16(m, _mm_srli_si128(m, 2));
+    return ((uint32_t)_mm_cvtsi128_si32(m) & 0xFFFF) ^ 0x8000;
+}
+
+static inline uint64_t sse_hsum64(__m128i s)
+{
+    uint64_t lanes[2];
+
+    _mm_storeu_si128((__m128i *)lanes, s);
+    return lanes[0] + lanes[1];
+}
+
+static inline uint64_t sse_hsum32(__m128i s)
+{
+    uint32_t lanes[4];
+
+    _mm_storeu_si128((__m128i *)lanes, s);
+    return (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+static void sse_sub8(uint8_t *out, uint8_t const *f, uint8_t const *b, int n)
+{
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((__m128i const *)(f + i));
+        __m128i w = _mm_loadu_si128((__m128i const *)(b + i));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_subs_epu8(v, w));
+    }
+    sc_sub8(out + i, f + i, b + i, n - i);
+}
+
+static void sse_sub16(uint16_t *out, uint16_t const *f, uint16_t const *b, int n)
+{
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((__m128i const *)(f + i));
+        __m128i w = _mm_loadu_si128((__m128i const *)(b + i));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_subs_epu16(v, w));
+    }
+    sc_sub16(out + i, f + i, b + i, n - i);
+}
+
+static void sse_range8(uint8_t const *f, int n, rs_range_t *r)
+{
+    __m128i     lo = _mm_set1_epi8((char)0xFF);
+    __m128i     hi = _mm_setzero_si128();
+    __m128i     sum = _mm_setzero_si128();
+    __m128i     zero = _mm_setzero_si128();
+    rs_range_t  tail;
+    int         i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((__m128i const *)(f + i));
+        lo  = _mm_min_epu8(lo, v);
+        hi  = _mm_max_epu8(hi, v);
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(v, zero));
+    }
+    sc_range8(f + i, n - i, &tail);
+
+    r->min = sse_hmin8(lo);
+    r->max = sse_hmax8(hi);
+    r->sum = sse_hsum64(sum) + tail.sum;
+    if (tail.min < r->min) r->min = tail.min;
+    if (tail.max > r->max) r->max = tail.max;
+}
+
+static void sse_range16(uint16_t const *f, int n, rs_range_t *r)
+{
+    __m128i     bias = _mm_set1_epi16((short)0x8000);
+    __m128i     lo = _mm_set1_epi16(0x7FFF);
+    __m128i     hi = _mm_set1_epi16((short)0x8000);
+    __m128i     sum = _mm_setzero_si128();
+    __m128i     zero = _mm_setzero_si128();
+    rs_range_t  tail;
+    int         i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((__m128i const *)(f + i));
+        __m128i b = _mm_xor_si128(v, bias);
+        lo  = _mm_min_epi16(lo, b);
+        hi  = _mm_max_epi16(hi, b);
+        sum = _mm_add_epi32(sum, _mm_unpacklo_epi16(v, zero));
+        sum = _mm_add_epi32(sum, _mm_unpackhi_epi16(v, zero));
+    }
+    sc_range16(f + i, n - i, &tail);
+
+    r->min = sse_hmin16b(lo);
+    r->max = sse_hmax16b(hi);
+    r->sum = sse_hsum32(sum) + tail.sum;
+    if (tail.min < r->min) r->min = tail.min;
+    if (tail.max > r->max) r->max = tail.max;
+}
+
+static int sse_count8(uint8_t const *f, int n, uint8_t t)
+{
+    __m128i     thr = _mm_set1_epi8((char)t);
+    __m128i     one = _mm_set1_epi8(1);
+    __m128i     zero = _mm_setzero_si128();
+    __m128i     acc = _mm_setzero_si128();
+    int         i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v  = _mm_loadu_si128((__m128i const *)(f + i));
+        __m128i ge = _mm_cmpeq_epi8(_mm_max_epu8(v, thr), v);
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_and_si128(ge, one), zero));
+    }
+    return (int)sse_hsum64(acc) + sc_count8(f + i, n - i, t);
+}
+
+static int sse_count16(uint16_t const *f, int n, uint16_t t)
+{
+    __m128i     bias = _mm_set1_epi16((short)0x8000);
+    __m128i     thr = _mm_set1_epi16((short)(t ^ 0x8000));
+    __m128i     ones = _mm_set1_epi16(1);
+    __m128i     below = _mm_setzero_si128();
+    int         i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i v  = _mm_xor_si128(_mm_loadu_si128((__m128i const *)(f + i)), bias);
+        __m128i lt = _mm_srli_epi16(_mm_cmpgt_epi16(thr, v), 15);
+        below = _mm_add_epi32(below, _mm_madd_epi16(lt, ones));
+    }
+    return (i - (int)sse_hsum32(below)) + sc_count16(f + i, n - i, t);
+}
+
+static inline void sse_ewmaLanes(int32_t *mean, int32_t *var, __m128i x,
+                                                                __m128i k)
+{
+    __m128i low16 = _mm_set1_epi32(0xFFFF);
+    __m128i m  = _mm_loadu_si128((__m128i const *)mean);
+    __m128i w  = _mm_loadu_si128((__m128i const *)var);
+    __m128i d  = _mm_sub_epi32(_mm_slli_epi32(x, 8), m);
+    __m128i s  = _mm_and_si128(_mm_srai_epi32(d, 4), low16);
+    __m128i sq = _mm_madd_epi16(s, s);      // |s| < 2^12: s^2, exactly
+
+    m = _mm_add_epi32(m, _mm_sra_epi32(d, k));
+    w = _mm_add_epi32(w, _mm_sra_epi32(_mm_sub_epi32(sq, w), k));
+    _mm_storeu_si128((__m128i *)mean, m);
+    _mm_storeu_si128((__m128i *)var, w);
+}
+
+static void sse_ewma8(int32_t *mean, int32_t *var, uint8_t const *x, int n,
+                                                                    int shift)
+{
+    __m128i     k = _mm_cvtsi32_si128(shift);
+    __m128i     zero = _mm_setzero_si128();
+    int         i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v  = _mm_loadu_si128((__m128i const *)(x + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+
+        sse_ewmaLanes(mean + i,      var + i,      _mm_unpacklo_epi16(lo, zero), k);
+        sse_ewmaLanes(mean + i + 4,  var + i + 4,  _mm_unpackhi_epi16(lo, zero), k);
+        sse_ewmaLanes(mean + i + 8,  var + i + 8,  _mm_unpacklo_epi16(hi, zero), k);
+        sse_ewmaLanes(mean + i + 12, var + i + 12, _mm_unpackhi_epi16(hi, zero), k);
+    }
+    sc_ewma8(mean + i, var + i, x + i, n - i, shift);
+}
+
+static rs_kernels_t const   msv_sse2 =
+{
+    "sse2", sse_sub8, sse_sub16, sse_range8, sse_range16, sse_count8,
+    sse_count16, sse_ewma8
+};
+#endif // RS_SSE2
+
+
+#ifdef RS_AVX2
+// ============================================================================
+// --- AVX2 Kernels, for the 8 bit kernels; the others as SSE2 ---
+// ============================================================================
+
+AVX2_FN static void avx_sub8(uint8_t *out, uint8_t const *f, uint8_t const *b,
+                                                                        int n)
+{
+    int i = 0;
+
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((__m256i const *)(f + i));
+        __m256i w = _mm256_loadu_si256((__m256i const *)(b + i));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_subs_epu8(v, w));
+    }
+    sse_sub8(out + i, f + i, b + i, n - i);
+}
+
+AVX2_FN static void avx_sub16(uint16_t *out, uint16_t const *f,
+                                                    uint16_t const *b, int n)
+{
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i v = _mm256_loadu_si256((__m256i const *)(f + i));
+        __m256i w = _mm256_loadu_si256((__m256i const *)(b + i));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_subs_epu16(v, w));
+    }
+    sse_sub16(out + i, f + i, b + i, n - i);
+}
+
+AVX2_FN static void avx_range8(uint8_t const *f, int n, rs_range_t *r)
+{
+    __m256i     lo = _mm256_set1_epi8((char)0xFF);
+    __m256i     hi = _mm256_setzero_si256();
+    __m256i     sum = _mm256_setzero_si256();
+    __m256i     zero = _mm256_setzero_si256();
+    rs_range_t  tail;
+    int         i = 0;
+
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((__m256i const *)(f + i));
+        lo  = _mm256_min_epu8(lo, v);
+        hi  = _mm256_max_epu8(hi, v);
+        sum = _mm256_add_epi64(sum, _mm256_sad_epu8(v, zero));
+    }
+    sse_range8(f + i, n - i, &tail);
+
+    r->min = sse_hmin8(_mm_min_epu8(_mm256_castsi256_si128(lo),
+                                    _mm256_extracti128_si256(lo, 1)));
+    r->max = sse_hmax8(_mm_max_epu8(_mm256_castsi256_si128(hi),
+                                    _mm256_extracti128_si256(hi, 1)));
+    r->sum = sse_hsum64(_mm_add_epi64(_mm256_castsi256_si128(sum),
+                                      _mm256_extracti128_si256(sum, 1)));
+    r->sum += tail.sum;
+    if (tail.min < r->min) r->min = tail.min;
+    if (tail.max > r->max) r->max = tail.max;
+}
+
+AVX2_FN static int avx_count8(uint8_t const *f, int n, uint8_t t)
+{
+    __m256i     thr = _mm256_set1_epi8((char)t);
+    __m256i     one = _mm256_set1_epi8(1);
+    __m256i     zero = _mm256_setzero_si256();
+    __m256i     acc = _mm256_setzero_si256();
+    int         i = 0;
+
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i v  = _mm256_loadu_si256((__m256i const *)(f + i));
+        __m256i ge = _mm256_cmpeq_epi8(_mm256_max_epu8(v, thr), v);
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_and_si256(ge, one), zero));
+    }
+    return (int)sse_hsum64(_mm_add_epi64(_mm256_castsi256_si128(acc),
+                                         _mm256_extracti128_si256(acc, 1)))
+                + sse_count8(f + i, n - i, t);
+}
+
+static rs_kernels_t const   msv_avx2 =
+{
+    "avx2", avx_sub8, avx_sub16, avx_range8, sse_range16, avx_count8,
+    sse_count16, sse_ewma8
+};
+#endif // RS_AVX2
+
+
+#ifdef RS_NEON
+// ============================================================================
+// --- NEON Kernels (ARMv7 and AArch64) ---
+// ============================================================================
+
+static inline uint32_t neon_hmin8(uint8x16_t v)
+{
+    uint8x8_t m = vmin_u8(vget_low_u8(v), vget_high_u8(v));
+    m = vpmin_u8(m, m);
+    m = vpmin_u8(m, m);
+    m = vpmin_u8(m, m);
+    return vget_lane_u8(m, 0);
+}
+
+static inline uint32_t neon_hmax8(uint8x16_t v)
+{
+    uint8x8_t m = vmax_u8(vget_low_u8(v), vget_high_u8(v));
+    m = vpmax_u8(m, m);
+    m = vpmax_u8(m, m);
+    m = vpmax_u8(m, m);
+    return vget_lane_u8(m, 0);
+}
+
+static inline uint32_t neon_hmin16(uint16x8_t v)
+{
+    uint16x4_t m = vmin_u16(vget_low_u16(v), vget_high_u16(v));
+    m = vpmin_u16(m, m);
+    m = vpmin_u16(m, m);
+    return vget_lane_u16(m, 0);
+}
+
+static inline uint32_t neon_hmax16(uint16x8_t v)
+{
+    uint16x4_t m = vmax_u16(vget_low_u16(v), vget_high_u16(v));
+    m = vpmax_u16(m, m);
+    m = vpmax_u16(m, m);
+    return vget_lane_u16(m, 0);
+}
+
+static inline uint64_t neon_hsum32(uint32x4_t s)
+{
+    uint64x2_t w = vpaddlq_u32(s);
+    return vgetq_lane_u64(w, 0) + vgetq_lane_u64(w, 1);
+}
+
+static void neon_sub8(uint8_t *out, uint8_t const *f, uint8_t const *b, int n)
+{
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        vst1q_u8(out + i, vqsubq_u8(vld1q_u8(f + i), vld1q_u8(b + i)));
+    }
+    sc_sub8(out + i, f + i, b + i, n - i);
+}
+
+static void neon_sub16(uint16_t *out, uint16_t const *f, uint16_t const *b,
+                                                                        int n)
+{
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        vst1q_u16(out + i, vqsubq_u16(vld1q_u16(f + i), vld1q_u16(b + i)));
+    }
+    sc_sub16(out + i, f + i, b + i, n - i);
+}
+
+static void neon_range8(uint8_t const *f, int n, rs_range_t *r)
+{
+    uint8x16_t  lo = vdupq_n_u8(0xFF);
+    uint8x16_t  hi = vdupq_n_u8(0);
+    uint32x4_t  sum = vdupq_n_u32(0);
+    rs_range_t  tail;
+    int         i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x16_t v = vld1q_u8(f + i);
+        lo  = vminq_u8(lo, v);
+        hi  = vmaxq_u8(hi, v);
+        sum = vpadalq_u16(sum, vpaddlq_u8(v));
+    }
+    sc_range8(f + i, n - i, &tail);
+
+    r->min = neon_hmin8(lo);
+    r->max = neon_hmax8(hi);
+    r->sum = neon_hsum32(sum) + tail.sum;
+    if (tail.min < r->min) r->min = tail.min;
+    if (tail.max > r->max) r->max = tail.max;
+}
+
+static void neon_range16(uint16_t const *f, int n, rs_range_t *r)
+{
+    uint16x8_t  lo = vdupq_n_u16(0xFFFF);
+    uint16x8_t  hi = vdupq_n_u16(0);
+    uint32x4_t  sum = vdupq_n_u32(0);
+    rs_range_t  tail;
+    int         i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        uint16x8_t v = vld1q_u16(f + i);
+        lo  = vminq_u16(lo, v);
+        hi  = vmaxq_u16(hi, v);
+        sum = vpadalq_u16(sum, v);
+    }
+    sc_range16(f + i, n - i, &tail);
+
+    r->min = neon_hmin16(lo);
+    r->max = neon_hmax16(hi);
+    r->sum = neon_hsum32(sum) + tail.sum;
+    if (tail.min < r->min) r->min = tail.min;
+    if (tail.max > r->max) r->max = tail.max;
+}
+
+static int neon_count8(uint8_t const *f, int n, uint8_t t)
+{
+    uint8x16_t  thr = vdupq_n_u8(t);
+    uint16x8_t  acc = vdupq_n_u16(0);
+    int         i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x16_t ge = vshrq_n_u8(vcgeq_u8(vld1q_u8(f + i), thr), 7);
+        acc = vpadalq_u8(acc, ge);
+    }
+    return (int)neon_hsum32(vpaddlq_u16(acc)) + sc_count8(f + i, n - i, t);
+}
+
+static int neon_count16(uint16_t const *f, int n, uint16_t t)
+{
+    uint16x8_t  thr = vdupq_n_u16(t);
+    uint32x4_t  acc = vdupq_n_u32(0);
+    int         i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        uint16x8_t ge = vshrq_n_u16(vcgeq_u16(vld1q_u16(f + i), thr), 15);
+        acc = vpadalq_u16(acc, ge);
+    }
+    return (int)neon_hsum32(acc) + sc_count16(f + i, n - i, t);
+}
+
+static inline void neon_ewmaLanes(int32_t *mean, int32_t *var, uint16x4_t x,
+                                                                int32x4_t k)
+{
+    int32x4_t m  = vld1q_s32(mean);
+    int32x4_t w  = vld1q_s32(var);
+    int32x4_t d  = vsubq_s32(vreinterpretq_s32_u32(vshll_n_u16(x, 8)), m);
+    int32x4_t s  = vshrq_n_s32(d, 4);
+    int32x4_t sq = vmulq_s32(s, s);
+
+    // a left shift by -shift is an arithmetic right shift
+    m = vaddq_s32(m, vshlq_s32(d, k));
+    w = vaddq_s32(w, vshlq_s32(vsubq_s32(sq, w), k));
+    vst1q_s32(mean, m);
+    vst1q_s32(var, w);
+}
+
+static void neon_ewma8(int32_t *mean, int32_t *var, uint8_t const *x, int n,
+                                                                    int shift)
+{
+    int32x4_t   k = vdupq_n_s32(-shift);
+    int         i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x16_t v  = vld1q_u8(x + i);
+        uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+        uint16x8_t hi = vmovl_u8(vget_high_u8(v));
+
+        neon_ewmaLanes(mean + i,      var + i,      vget_low_u16(lo), k);
+        neon_ewmaLanes(mean + i + 4,  var + i + 4,  vget_high_u16(lo), k);
+        neon_ewmaLanes(mean + i + 8,  var + i + 8,  vget_low_u16(hi), k);
+        neon_ewmaLanes(mean + i + 12, var + i + 12, vget_high_u16(hi), k);
+    }
+    sc_ewma8(mean + i, var + i, x + i, n - i, shift);
+}
+
+static rs_kernels_t const   msv_neon =
+{
+    "neon", neon_sub8, neon_sub16, neon_range8, neon_range16, neon_count8,
+    neon_count16, neon_ewma8
+};
+#endif // RS_NEON
+
+
+// ============================================================================
+// --- Public Services ---
+// ============================================================================
+
+// the kernels built for this processor family
+static rs_kernels_t const * const msv_available[] =
+{
+#if defined(RS_NEON)
+    &msv_neon,
+#endif
+#if defined(RS_AVX2)
+    &msv_avx2,
+#endif
+#if defined(RS_SSE2)
+    &msv_sse2,
+#endif
+    &msv_scalar
+};
+
+/**
+ * The kernels in use
+ */
+static rs_kernels_t const * rs_kernels(void)
+{
+    rs_kernels_t const *forced = msv_forced;
+
+    (void)pthread_once(&msv_selectOnce, rs_select);
+    return (forced != NULL) ? forced : msv_vector;
+}
+
+char const * rs_implName(void)
+{
+    return rs_kernels()->name;
+}
+
+void rs_useScalar(bool scalar)
+{
+    msv_forced = (scalar) ? &msv_scalar : NULL;
+}
+
+bool rs_useKernels(char const *name)
+{
+    size_t i;
+
+    (void)pthread_once(&msv_selectOnce, rs_select);
+    if (name == NULL)
+    {
+        msv_forced = NULL;
+        return true;
+    }
+
+    for (i = 0; i < sizeof(msv_available) / sizeof(msv_available[0]); i++)
+    {
+        if (strcmp(name, msv_available[i]->name) != 0) continue;
+
+#if defined(RS_AVX2)
+        if ((msv_available[i] == &msv_avx2) && !__builtin_cpu_supports("avx2"))
+        {
+            return false;
+        }
+#endif
+        msv_forced = msv_available[i];
+        return true;
+    }
+    return false;
+}
+
+void rs_subBaseline8(uint8_t *out, uint8_t const *frame,
+                                            uint8_t const *baseline, int n)
+{
+    if ((out == NULL) || (frame == NULL) || (baseline == NULL)) return;
+    rs_kernels()->sub8(out, frame, baseline, n);
+}
+
+void rs_subBaseline16(uint16_t *out, uint16_t const *frame,
+                                            uint16_t const *baseline, int n)
+{
+    if ((out == NULL) || (frame == NULL) || (baseline == NULL)) return;
+    rs_kernels()->sub16(out, frame, baseline, n);
+}
+
+void rs_range8(uint8_t const *frame, int n, rs_range_t *range)
+{
+    rs_kernels_t const *    k = rs_kernels();
+    rs_range_t              part;
+    int                     i;
+
+    if (range == NULL) return;
+    memset(range, 0, sizeof(*range));
+    if ((frame == NULL) || (n <= 0)) return;
+
+    range->min = 0xFF;
+    for (i = 0; i < n; i += BLOCK)
+    {
+        k->range8(frame + i, (n - i < BLOCK) ? n - i : BLOCK, &part);
+        if (part.min < range->min) range->min = part.min;
+        if (part.max > range->max) range->max = part.max;
+        range->sum += part.sum;
+    }
+}
+
+void rs_range16(uint16_t const *frame, int n, rs_range_t *range)
+{
+    rs_kernels_t const *    k = rs_kernels();
+    rs_range_t              part;
+    int                     i;
+
+    if (range == NULL) return;
+    memset(range, 0, sizeof(*range));
+    if ((frame == NULL) || (n <= 0)) return;
+
+    range->min = 0xFFFF;
+    for (i = 0; i < n; i += BLOCK)
+    {
+        k->range16(frame + i, (n - i < BLOCK) ? n - i : BLOCK, &part);
+        if (part.min < range->min) range->min = part.min;
+        if (part.max > range->max) range->max = part.max;
+        range->sum += part.sum;
+    }
+}
+
+int rs_countActive8(uint8_t const *frame, int n, uint8_t threshold)
+{
+    rs_kernels_t const *    k = rs_kernels();
+    int                     i, count = 0;
+
+    if (frame == NULL) return 0;
+    for (i = 0; i < n; i += BLOCK)
+    {
+        count += k->count8(frame + i, (n - i < BLOCK) ? n - i : BLOCK, threshold);
+    }
+    return count;
+}
+
+int rs_countActive16(uint16_t const *frame, int n, uint16_t threshold)
+{
+    rs_kernels_t const *    k = rs_kernels();
+    int                     i, count = 0;
+
+    if (frame == NULL) return 0;
+    for (i = 0; i < n; i += BLOCK)
+    {
+        count += k->count16(frame + i, (n - i < BLOCK) ? n - i : BLOCK, threshold);
+    }
+    return count;
+}
+
+rs_cellStats_t * rs_createCellStats(int numCells, int shift)
+{
+    rs_cellStats_t *    st;
+    void *              mem = NULL;
+    size_t              len;
+
+    if ((numCells <= 0) || (shift < 1) || (shift > RS_MAX_SHIFT)) return NULL;
+
+    st = (rs_cellStats_t *)calloc(1, sizeof(rs_cellStats_t));
+    if (st == NULL) return NULL;
+
+    // one block: the means, then the variances, each aligned
+    len = ((size_t)numCells * sizeof(int32_t) + STATS_ALIGN - 1) &
+                                                ~(size_t)(STATS_ALIGN - 1);
+    if (posix_memalign(&mem, STATS_ALIGN, 2 * len) != 0)
+    {
+        free(st);
+        return NULL;
+    }
+    st->numCells = numCells;
+    st->shift    = shift;
+    st->mean     = (int32_t *)mem;
+    st->var      = (int32_t *)((uint8_t *)mem + len);
+    rs_resetCellStats(st);
+    return st;
+}
+
+void rs_destroyCellStats(rs_cellStats_t *st)
+{
+    if (st == NULL) return;
+    free(st->mean);
+    free(st);
+}
+
+void rs_resetCellStats(rs_cellStats_t *st)
+{
+    if (st == NULL) return;
+    st->frames = 0;
+    memset(st->mean, 0, (size_t)st->numCells * sizeof(int32_t));
+    memset(st->var,  0, (size_t)st->numCells * sizeof(int32_t));
+}
+
+void rs_accumulate8(rs_cellStats_t *st, uint8_t const *frame)
+{
+    int i;
+
+    if ((st == NULL) || (frame == NULL)) return;
+
+    if (st->frames++ == 0)
+    {
+        for (i = 0; i < st->numCells; i++)
+        {
+            st->mean[i] = (int32_t)frame[i] << 8;
+            st->var[i]  = 0;
+        }
+        return;
+    }
+    rs_kernels()->ewma8(st->mean, st->var, frame, st->numCells, st->shift);
+}
+
+
+// ============================================================================
+// --- Private Functions ---
+// ============================================================================
+
+/**
+ * Choose the vector kernels for this processor
+ */
+static void rs_select(void)
+{
+#if defined(RS_NEON)
+    msv_vector = &msv_neon;
+#elif defined(RS_AVX2)
+    __builtin_cpu_init();
+    msv_vector = (__builtin_cpu_supports("avx2")) ? &msv_avx2 : &msv_sse2;
+#elif defined(RS_SSE2)
+    msv_vector = &msv_sse2;
+#endif
+    zul_logf(3, "%s: %s kernels", __FUNCTION__, msv_vector->name);
+}
@@ -0,0 +1,151 @@
+/*
+ *  Copyright (c) 2019 Zytronic Displays Limited. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact Zytronic, you can do so either via the
+ * website <www.zytronic.co.uk> or by paper mail:
+ * Zytronic, Whiteley Road, Blaydon on Tyne, Tyne & Wear, NE21 5NJ, UK
+ */
+
+
+
+
+
+
+
+
+
+/* Module Overview
+   ===============
+   This code provides the per-frame analysis kernels of the raw sensor data
+   (see rawframe.h), over frames of 8 or 16 bit cells:
+
+        rs_subBaseline      frame - baseline, per cell, saturating at zero
+        rs_range            min, max and sum of the cells
+        rs_countActive      the cells at or above a threshold
+        rs_accumulate       per cell running mean and variance
+
+   Each kernel has a scalar version, the reference, and a vector version:
+   NEON on ARM, SSE2 on x86 (AVX2 where the processor has it, for some of
+   the kernels).  The version is chosen once, when first used; the vector
+   versions give the same results as the scalar ones, bit for bit, and
+   rs_useScalar() or rs_useKernels() select others, to compare them.  See
+   rawstatsTest.c and rawstatsBench.c.
+
+   Running statistics (8 bit cells) are exponentially weighted, with a
+   weight of 1/2^shift for the newest frame, in fixed point:
+        mean    cell value * 256
+        var     cell value^2 * 256
+   The first frame sets the mean, with a variance of zero.
+
+   Buffers need not be aligned; those of rs_createCellStats() are.
+
+ */
+
+#ifndef _ZY_RAWSTATS_H
+#define _ZY_RAWSTATS_H
+
+#include "zytypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define  RS_MAX_SHIFT               (15)
+
+// the range of a frame
+typedef struct rs_range
+{
+    uint32_t    min;
+    uint32_t    max;
+    uint64_t    sum;
+} rs_range_t;
+
+// per cell running statistics, see the overview
+typedef struct rs_cellStats
+{
+    int         numCells;
+    int         shift;
+    uint32_t    frames;             // accumulated
+    int32_t *   mean;
+    int32_t *   var;
+} rs_cellStats_t;
+
+
+/**
+ * The name of the kernels in use: "neon", "avx2", "sse2" or "scalar"
+ */
+char const *        rs_implName             (void);
+
+/**
+ * Use the scalar (reference) kernels, or the vector kernels again
+ */
+void                rs_useScalar            (bool scalar);
+
+/**
+ * Use the named kernels ("neon", "avx2", "sse2" or "scalar") in place of
+ * those chosen, to compare or time them; NULL restores the choice.  Return
+ * false if this build or processor does not have them.
+ */
+bool                rs_useKernels           (/*@null@*/ char const *name);
+
+/**
+ * out = frame - baseline, or zero where the baseline is the greater.
+ * out may be frame.
+ */
+void                rs_subBaseline8         (uint8_t *out, uint8_t const *frame,
+                                                uint8_t const *baseline, int n);
+void                rs_subBaseline16        (uint16_t *out,
+                                                uint16_t const *frame,
+                                                uint16_t const *baseline, int n);
+
+/**
+ * The min, max and sum of the cells (all zero if n is zero)
+ */
+void                rs_range8               (uint8_t const *frame, int n,
+                                                rs_range_t *range);
+void                rs_range16              (uint16_t const *frame, int n,
+                                                rs_range_t *range);
+
+/**
+ * The number of cells at or above threshold
+ */
+int                 rs_countActive8         (uint8_t const *frame, int n,
+                                                uint8_t threshold);
+int                 rs_countActive16        (uint16_t const *frame, int n,
+                                                uint16_t threshold);
+
+/**
+ * Running statistics of numCells cells, with a weight of 1/2^shift
+ * (1..RS_MAX_SHIFT) for each new frame.  Return NULL on failure.
+ */
+/*@null@*/
+rs_cellStats_t *    rs_createCellStats      (int numCells, int shift);
+void                rs_destroyCellStats     (/*@null@*/ rs_cellStats_t *st);
+void                rs_resetCellStats       (rs_cellStats_t *st);
+
+/**
+ * Add a frame of st->numCells cells to the statistics
+ */
+void                rs_accumulate8          (rs_cellStats_t *st,
+                                                uint8_t const *frame);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ZY_RAWSTATS_H
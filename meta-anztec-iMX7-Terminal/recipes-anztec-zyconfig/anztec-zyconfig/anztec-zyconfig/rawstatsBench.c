@@ -0,0 +1,205 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* This program times the raw frame analysis kernels, see rawstats.h, with
+ * each kernel version available here, on frames of a given size.  The
+ * figures are the mean time per frame, and the speed up on the scalar
+ * kernels.
+ *
+ * Usage: rawstatsBench [cells [frames]]
+ *   cells      cells per frame, default 12288 (128 x 96 wires)
+ *   frames     frames timed per kernel, default 2000
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "zytypes.h"
+#include "rawstats.h"
+
+#define NUM_KERNELS         (8)
+
+static char const * const   g_impls[]   = { "scalar", "neon", "avx2", "sse2" };
+static char const * const   g_kernels[NUM_KERNELS] =
+{
+    "rs_subBaseline8", "rs_subBaseline16", "rs_range8", "rs_range16",
+    "rs_countActive8", "rs_countActive16", "rs_accumulate8", "all"
+};
+
+int             g_cells     = 128 * 96;
+int             g_frames    = 2000;
+uint8_t *       g_frame8;
+uint8_t *       g_base8;
+uint8_t *       g_out8;
+uint16_t *      g_frame16;
+uint16_t *      g_base16;
+uint16_t *      g_out16;
+volatile int    g_sink;                 // keeps the results alive
+
+
+// ----------------------------------------------------------------------------
+
+uint64_t nowNs(void)
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Run kernel k on one frame
+ */
+void runKernel(int k, rs_cellStats_t *st)
+{
+    rs_range_t  range;
+
+    switch (k)
+    {
+        case 0:
+            rs_subBaseline8(g_out8, g_frame8, g_base8, g_cells);
+            break;
+        case 1:
+            rs_subBaseline16(g_out16, g_frame16, g_base16, g_cells);
+            break;
+        case 2:
+            rs_range8(g_frame8, g_cells, &range);
+            g_sink += (int)range.sum;
+            break;
+        case 3:
+            rs_range16(g_frame16, g_cells, &range);
+            g_sink += (int)range.sum;
+            break;
+        case 4:
+            g_sink += rs_countActive8(g_frame8, g_cells, 100);
+            break;
+        case 5:
+            g_sink += rs_countActive16(g_frame16, g_cells, 40000);
+            break;
+        case 6:
+            rs_accumulate8(st, g_frame8);
+            break;
+        default:
+            // a frame as rawFrameServer -m analyses it
+            rs_subBaseline8(g_out8, g_frame8, g_base8, g_cells);
+            rs_range8(g_out8, g_cells, &range);
+            g_sink += (int)range.sum + rs_countActive8(g_out8, g_cells, 100);
+            rs_accumulate8(st, g_out8);
+            break;
+    }
+}
+
+/**
+ * Mean ns per frame of kernel k
+ */
+double timeKernel(int k, rs_cellStats_t *st)
+{
+    uint64_t    start;
+    int         f;
+
+    runKernel(k, st);                   // warm the caches
+    start = nowNs();
+    for (f = 0; f < g_frames; f++)
+    {
+        g_frame8[f % g_cells]++;        // a new frame, as far as the compiler knows
+        runKernel(k, st);
+    }
+    return (double)(nowNs() - start) / g_frames;
+}
+
+// ----------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    double              scalarNs[NUM_KERNELS];
+    rs_cellStats_t *    st;
+    int                 impl, k, i;
+
+    if (argc > 1) g_cells  = atoi(argv[1]);
+    if (argc > 2) g_frames = atoi(argv[2]);
+    if ((g_cells <= 0) || (g_frames <= 0))
+    {
+        printf("usage: %s [cells [frames]]\n", argv[0]);
+        return 1;
+    }
+
+    g_frame8    = malloc((size_t)g_cells);
+    g_base8     = malloc((size_t)g_cells);
+    g_out8      = malloc((size_t)g_cells);
+    g_frame16   = malloc(sizeof(uint16_t) * (size_t)g_cells);
+    g_base16    = malloc(sizeof(uint16_t) * (size_t)g_cells);
+    g_out16     = malloc(sizeof(uint16_t) * (size_t)g_cells);
+    st          = rs_createCellStats(g_cells, 4);
+    if ( (g_frame8 == NULL) || (g_base8 == NULL) || (g_out8 == NULL) ||
+         (g_frame16 == NULL) || (g_base16 == NULL) || (g_out16 == NULL) || (st == NULL) )
+    {
+        printf("out of memory\n");
+        return 1;
+    }
+
+    srand(1);
+    for (i = 0; i < g_cells; i++)
+    {
+        g_base8[i]      = (uint8_t)(rand() & 0x3F);
+        g_frame8[i]     = (uint8_t)(g_base8[i] + (rand() & 0x7F));
+        g_base16[i]     = (uint16_t)(rand() & 0x3FFF);
+        g_frame16[i]    = (uint16_t)(g_base16[i] + (rand() & 0x7FFF));
+    }
+
+    printf("default kernels: %s, %d cells, %d frames\n", rs_implName(), g_cells, g_frames);
+    printf("%-8s", "");
+    for (k = 0; k < NUM_KERNELS; k++) printf(" %17s", g_kernels[k]);
+    printf("\n");
+
+    for (impl = 0; impl < (int)(sizeof(g_impls) / sizeof(g_impls[0])); impl++)
+    {
+        if (!rs_useKernels(g_impls[impl])) continue;
+
+        printf("%-8s", g_impls[impl]);
+        for (k = 0; k < NUM_KERNELS; k++)
+        {
+            double ns = timeKernel(k, st);
+
+            if (impl == 0) scalarNs[k] = ns;
+            printf(" %9.0fns x%5.1f", ns, scalarNs[k] / ns);
+        }
+        printf("\n");
+    }
+    rs_useKernels(NULL);
+
+    rs_destroyCellStats(st);
+    free(g_frame8);
+    free(g_base8);
+    free(g_out8);
+    free(g_frame16);
+    free(g_base16);
+    free(g_out16);
+    return 0;
+}
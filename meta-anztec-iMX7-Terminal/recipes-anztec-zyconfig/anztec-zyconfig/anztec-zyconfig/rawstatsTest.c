@@ -0,0 +1,276 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* This program tests the raw frame analysis kernels, see rawstats.h.  Each
+ * kernel of each vector version available here is compared, bit for bit,
+ * with the scalar reference: on random frames, on frames of all 0 and all
+ * 255 (65535) cells, on cell counts that are not a multiple of the vector
+ * width, and on unaligned buffers.
+ *
+ * Usage: rawstatsTest [seed]
+ * Exit status: 0 passed, 1 failed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "zytypes.h"
+#include "rawstats.h"
+
+#define MAX_CELLS           (70000)
+#define NUM_FRAMES          (40)        // accumulated per statistics test
+
+// frame contents
+typedef enum { FILL_RANDOM, FILL_ZERO, FILL_FULL, FILL_SPARSE } Fill_t;
+
+static char const * const   g_impls[]   = { "neon", "avx2", "sse2" };
+static int const            g_sizes[]   =
+{
+    0, 1, 2, 7, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 129, 255, 1000,
+    128 * 96, 16383, 65535, 65536, 65537, MAX_CELLS
+};
+
+// one spare cell at the start of each buffer, so they may be misaligned
+uint8_t     g_frame8[MAX_CELLS + 1],    g_base8[MAX_CELLS + 1];
+uint8_t     g_ref8[MAX_CELLS + 1],      g_out8[MAX_CELLS + 1];
+uint16_t    g_frame16[MAX_CELLS + 1],   g_base16[MAX_CELLS + 1];
+uint16_t    g_ref16[MAX_CELLS + 1],     g_out16[MAX_CELLS + 1];
+
+char const *    g_impl      = "";
+int             g_failures  = 0;
+int             g_checks    = 0;
+
+
+// ----------------------------------------------------------------------------
+
+void fail(char const *kernel, int n, char const *detail)
+{
+    printf("FAIL: %s %s, %d cells: %s\n", g_impl, kernel, n, detail);
+    g_failures++;
+}
+
+uint16_t fillValue16(Fill_t fill)
+{
+    switch (fill)
+    {
+        case FILL_ZERO:     return 0;
+        case FILL_FULL:     return 0xFFFF;
+        case FILL_SPARSE:   return (rand() % 16 == 0) ? (uint16_t)rand() : 0;
+        default:            return (uint16_t)((rand() << 1) ^ rand());
+    }
+}
+
+void fillFrames(int n, Fill_t frame, Fill_t base)
+{
+    int i;
+
+    for (i = 0; i <= n; i++)
+    {
+        g_frame16[i]    = fillValue16(frame);
+        g_base16[i]     = fillValue16(base);
+        g_frame8[i]     = (uint8_t)g_frame16[i];
+        g_base8[i]      = (uint8_t)(g_base16[i] >> 3);
+        if (base == FILL_FULL) g_base8[i] = 0xFF;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+/**
+ * Compare the frame kernels over n cells, starting at offset (0 or 1)
+ */
+void compareFrameKernels(int n, int offset)
+{
+    static uint8_t const    thresholds8[]   = { 0, 1, 100, 254, 255 };
+    static uint16_t const   thresholds16[]  = { 0, 1, 40000, 65534, 65535 };
+    uint8_t const  *f8  = g_frame8 + offset;
+    uint8_t const  *b8  = g_base8 + offset;
+    uint16_t const *f16 = g_frame16 + offset;
+    uint16_t const *b16 = g_base16 + offset;
+    rs_range_t      ref, out;
+    int             t, refCount, outCount;
+
+    g_checks++;
+
+    rs_useScalar(true);
+    rs_subBaseline8(g_ref8 + offset, f8, b8, n);
+    rs_subBaseline16(g_ref16 + offset, f16, b16, n);
+    (void)rs_useKernels(g_impl);
+    rs_subBaseline8(g_out8 + offset, f8, b8, n);
+    rs_subBaseline16(g_out16 + offset, f16, b16, n);
+
+    if (memcmp(g_ref8 + offset, g_out8 + offset, (size_t)n) != 0)
+        fail("rs_subBaseline8", n, "cells differ");
+    if (memcmp(g_ref16 + offset, g_out16 + offset, sizeof(uint16_t) * (size_t)n) != 0)
+        fail("rs_subBaseline16", n, "cells differ");
+
+    // in place
+    memcpy(g_out8, g_frame8, sizeof(g_out8));
+    rs_subBaseline8(g_out8 + offset, g_out8 + offset, b8, n);
+    if (memcmp(g_ref8 + offset, g_out8 + offset, (size_t)n) != 0)
+        fail("rs_subBaseline8", n, "in place, cells differ");
+
+    rs_useScalar(true);
+    rs_range8(f8, n, &ref);
+    (void)rs_useKernels(g_impl);
+    rs_range8(f8, n, &out);
+    if ((ref.min != out.min) || (ref.max != out.max) || (ref.sum != out.sum))
+        fail("rs_range8", n, "range differs");
+
+    rs_useScalar(true);
+    rs_range16(f16, n, &ref);
+    (void)rs_useKernels(g_impl);
+    rs_range16(f16, n, &out);
+    if ((ref.min != out.min) || (ref.max != out.max) || (ref.sum != out.sum))
+        fail("rs_range16", n, "range differs");
+
+    for (t = 0; t < (int)sizeof(thresholds8); t++)
+    {
+        rs_useScalar(true);
+        refCount = rs_countActive8(f8, n, thresholds8[t]);
+        (void)rs_useKernels(g_impl);
+        outCount = rs_countActive8(f8, n, thresholds8[t]);
+        if (refCount != outCount) fail("rs_countActive8", n, "count differs");
+
+        rs_useScalar(true);
+        refCount = rs_countActive16(f16, n, thresholds16[t]);
+        (void)rs_useKernels(g_impl);
+        outCount = rs_countActive16(f16, n, thresholds16[t]);
+        if (refCount != outCount) fail("rs_countActive16", n, "count differs");
+    }
+}
+
+/**
+ * Compare the running statistics over a series of frames
+ */
+void compareStats(int n, int shift, Fill_t fill)
+{
+    rs_cellStats_t *ref = rs_createCellStats(n, shift);
+    rs_cellStats_t *out = rs_createCellStats(n, shift);
+    int             f, i;
+
+    g_checks++;
+
+    if ((ref == NULL) || (out == NULL))
+    {
+        fail("rs_createCellStats", n, "no statistics");
+    }
+    else
+    {
+        for (f = 0; f < NUM_FRAMES; f++)
+        {
+            // a steady frame with noise, and now and then a jump
+            for (i = 0; i < n; i++)
+            {
+                g_frame8[i] = (fill != FILL_RANDOM) ? (uint8_t)fillValue16(fill) :
+                              (f % 7 == 3) ? (uint8_t)rand() :
+                                             (uint8_t)((i & 0xFF) ^ (rand() & 0x0F));
+            }
+
+            rs_useScalar(true);
+            rs_accumulate8(ref, g_frame8);
+            (void)rs_useKernels(g_impl);
+            rs_accumulate8(out, g_frame8);
+        }
+
+        if ( (ref->frames != out->frames) ||
+             (memcmp(ref->mean, out->mean, sizeof(int32_t) * (size_t)n) != 0) ||
+             (memcmp(ref->var,  out->var,  sizeof(int32_t) * (size_t)n) != 0) )
+        {
+            char detail[40];
+            snprintf(detail, sizeof(detail), "shift %d, statistics differ", shift);
+            fail("rs_accumulate8", n, detail);
+        }
+    }
+
+    rs_destroyCellStats(ref);
+    rs_destroyCellStats(out);
+}
+
+// ----------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    static Fill_t const fills[][2] =
+    {
+        { FILL_RANDOM,  FILL_RANDOM },
+        { FILL_ZERO,    FILL_ZERO   },
+        { FILL_FULL,    FILL_FULL   },
+        { FILL_FULL,    FILL_ZERO   },
+        { FILL_ZERO,    FILL_FULL   },
+        { FILL_SPARSE,  FILL_RANDOM },
+    };
+    unsigned int    seed = (argc > 1) ? (unsigned int)strtoul(argv[1], NULL, 0) : 1;
+    int             impl, s, fl, shift, tested = 0;
+
+    printf("default kernels: %s, seed %u\n", rs_implName(), seed);
+    srand(seed);
+
+    for (impl = 0; impl < (int)(sizeof(g_impls) / sizeof(g_impls[0])); impl++)
+    {
+        int before = g_failures;
+
+        g_impl = g_impls[impl];
+        if (!rs_useKernels(g_impl))
+        {
+            printf("%s: not available\n", g_impl);
+            continue;
+        }
+        tested++;
+
+        for (s = 0; s < (int)(sizeof(g_sizes) / sizeof(g_sizes[0])); s++)
+        {
+            for (fl = 0; fl < (int)(sizeof(fills) / sizeof(fills[0])); fl++)
+            {
+                fillFrames(g_sizes[s], fills[fl][0], fills[fl][1]);
+                compareFrameKernels(g_sizes[s], 0);
+                compareFrameKernels(g_sizes[s] - ((g_sizes[s] > 0) ? 1 : 0), 1);
+            }
+        }
+
+        for (shift = 1; shift <= RS_MAX_SHIFT; shift++)
+        {
+            compareStats(1000 + shift, shift, FILL_RANDOM);
+        }
+        compareStats(17,      4, FILL_ZERO);
+        compareStats(17,      4, FILL_FULL);
+        compareStats(128 * 96, 1, FILL_FULL);
+        compareStats(128 * 96, RS_MAX_SHIFT, FILL_FULL);
+        compareStats(128 * 96 + 5, 3, FILL_SPARSE);
+
+        printf("%s: %s\n", g_impl, (g_failures == before) ? "PASS" : "FAIL");
+    }
+    rs_useKernels(NULL);
+
+    if (tested == 0) printf("no vector kernels, only the scalar ones\n");
+    printf("%s, %d checks, %d failure(s)\n",
+                (g_failures == 0) ? "PASSED" : "FAILED", g_checks, g_failures);
+    return (g_failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,217 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* For a module overview, see the header file
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "debug.h"
+#include "reportring.h"
+
+// keep the indices written by each side on separate cache lines
+#define CACHE_LINE                  (64)
+
+struct report_ring
+{
+    // written by the producer
+    _Atomic uint32_t            head            __attribute__((aligned(CACHE_LINE)));
+    _Atomic uint64_t            pushed;
+    _Atomic uint64_t            dropped;
+    _Atomic uint64_t            overflows;
+    _Atomic uint32_t            highWater;
+    uint32_t                    seq;
+    bool                        full;
+
+    // written by the consumer
+    _Atomic uint32_t            tail            __attribute__((aligned(CACHE_LINE)));
+    _Atomic uint64_t            consumed;
+
+    uint32_t                    mask            __attribute__((aligned(CACHE_LINE)));
+    rr_report_t *               slot;
+};
+
+
+// ============================================================================
+// --- Public Implementation ---
+// ============================================================================
+
+report_ring_t * rr_create(int slots)
+{
+    report_ring_t  *ring;
+    uint32_t        size = 2;
+
+    if (slots < 2) slots = RR_DEFAULT_SLOTS;
+    while (size < (uint32_t)slots) size <<= 1;
+
+    ring = (report_ring_t *)aligned_alloc(CACHE_LINE,
+            (sizeof(report_ring_t) + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1));
+    if (ring == NULL) return NULL;
+    memset(ring, 0, sizeof(report_ring_t));
+
+    ring->slot = (rr_report_t *)calloc(size, sizeof(rr_report_t));
+    if (ring->slot == NULL)
+    {
+        free(ring);
+        return NULL;
+    }
+    ring->mask = size - 1;
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    return ring;
+}
+
+void rr_destroy(report_ring_t *ring)
+{
+    if (ring == NULL) return;
+    free(ring->slot);
+    free(ring);
+}
+
+bool rr_push(report_ring_t *ring, uint8_t const *data, int len)
+{
+    uint32_t        head, tail, used;
+    rr_report_t    *r;
+
+    if ((ring == NULL) || (data == NULL)) return false;
+    if (len > RR_REPORT_LEN) len = RR_REPORT_LEN;
+    if (len < 0) len = 0;
+
+    ring->seq++;
+    head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    used = head - tail;
+
+    if (used > ring->mask)
+    {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        if (!ring->full)
+        {
+            ring->full = true;
+            atomic_fetch_add_explicit(&ring->overflows, 1, memory_order_relaxed);
+        }
+        return false;
+    }
+    ring->full = false;
+
+    r = &ring->slot[head & ring->mask];
+    r->timeUs   = zul_monotonicUs();
+    r->seq      = ring->seq;
+    r->len      = (uint16_t)len;
+    memcpy(r->data, data, (size_t)len);
+    if (len < RR_REPORT_LEN) memset(r->data + len, 0, (size_t)(RR_REPORT_LEN - len));
+
+    // publish the slot
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    atomic_fetch_add_explicit(&ring->pushed, 1, memory_order_relaxed);
+
+    if (used + 1 > atomic_load_explicit(&ring->highWater, memory_order_relaxed))
+    {
+        atomic_store_explicit(&ring->highWater, used + 1, memory_order_relaxed);
+    }
+    return true;
+}
+
+rr_report_t const * rr_borrow(report_ring_t *ring)
+{
+    uint32_t tail;
+
+    if (ring == NULL) return NULL;
+
+    tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail == atomic_load_explicit(&ring->head, memory_order_acquire))
+    {
+        return NULL;
+    }
+    return &ring->slot[tail & ring->mask];
+}
+
+void rr_release(report_ring_t *ring)
+{
+    uint32_t tail;
+
+    if (ring == NULL) return;
+
+    tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail == atomic_load_explicit(&ring->head, memory_order_acquire))
+    {
+        return;     // nothing borrowed
+    }
+
+    // hand the slot back to the producer
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    atomic_fetch_add_explicit(&ring->consumed, 1, memory_order_relaxed);
+}
+
+bool rr_pop(report_ring_t *ring, rr_report_t *report)
+{
+    rr_report_t const *r = rr_borrow(ring);
+
+    if (r == NULL) return false;
+    if (report != NULL) *report = *r;
+    rr_release(ring);
+    return true;
+}
+
+void rr_flush(report_ring_t *ring)
+{
+    uint32_t head, tail;
+
+    if (ring == NULL) return;
+
+    head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, head, memory_order_release);
+    atomic_fetch_add_explicit(&ring->consumed, head - tail, memory_order_relaxed);
+}
+
+int rr_count(report_ring_t *ring)
+{
+    if (ring == NULL) return 0;
+    return (int)(atomic_load_explicit(&ring->head, memory_order_acquire) -
+                 atomic_load_explicit(&ring->tail, memory_order_acquire));
+}
+
+void rr_getStats(report_ring_t *ring, rr_stats_t *stats)
+{
+    if (stats == NULL) return;
+    memset(stats, 0, sizeof(rr_stats_t));
+    if (ring == NULL) return;
+
+    stats->pushed    = atomic_load_explicit(&ring->pushed,    memory_order_relaxed);
+    stats->consumed  = atomic_load_explicit(&ring->consumed,  memory_order_relaxed);
+    stats->dropped   = atomic_load_explicit(&ring->dropped,   memory_order_relaxed);
+    stats->overflows = atomic_load_explicit(&ring->overflows, memory_order_relaxed);
+    stats->highWater = atomic_load_explicit(&ring->highWater, memory_order_relaxed);
+    stats->slots     = ring->mask + 1;
+}
@@ -0,0 +1,133 @@
+/*
+ *  Copyright (c) 2019 Zytronic Displays Limited. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact Zytronic, you can do so either via the
+ * website <www.zytronic.co.uk> or by paper mail:
+ * Zytronic, Whiteley Road, Blaydon on Tyne, Tyne & Wear, NE21 5NJ, UK
+ */
+
+
+
+
+
+/* Module Overview
+   ===============
+   This code provides a queue of timestamped IN reports, between the thread
+   that receives them (the producer - the transport's input thread or event
+   loop) and the application (the consumer).
+
+   The ring is single-producer, single-consumer and lock free: the producer
+   only writes the head index, and the consumer only writes the tail index.
+   The consumer may borrow the oldest report in place, without a copy, and
+   releases it when done; the producer never writes a slot that is borrowed.
+
+   When the ring is full, the arriving report is dropped, so reports already
+   queued are never overwritten while being read.  The drop counters show
+   whether the consumer keeps up: 'dropped' counts each report lost, and
+   'overflows' each occasion the ring became full.
+
+   Each ring must have exactly one producer thread and one consumer thread.
+
+ */
+
+#ifndef _ZY_REPORTRING_H
+#define _ZY_REPORTRING_H
+
+#include "zytypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define  RR_REPORT_LEN              (64)
+#define  RR_DEFAULT_SLOTS           (64)
+
+// a queued report
+typedef struct rr_report
+{
+    uint64_t    timeUs;             // arrival, CLOCK_MONOTONIC microseconds
+    uint32_t    seq;                // arrival count, including drops
+    uint16_t    len;
+    uint8_t     data[RR_REPORT_LEN];
+} rr_report_t;
+
+// ring counters
+typedef struct rr_stats
+{
+    uint64_t    pushed;             // reports queued
+    uint64_t    consumed;           // reports released by the consumer
+    uint64_t    dropped;            // reports lost, ring full
+    uint64_t    overflows;          // occasions the ring became full
+    uint32_t    highWater;          // most reports queued at once
+    uint32_t    slots;
+} rr_stats_t;
+
+typedef struct report_ring report_ring_t;
+
+
+/**
+ * Create a ring of at least 'slots' reports (rounded up to a power of two).
+ * A value below 2 selects RR_DEFAULT_SLOTS.  NULL is returned if there is
+ * no memory.
+ */
+/*@null@*/
+report_ring_t * rr_create                   (int slots);
+void            rr_destroy                  (/*@null@*/ report_ring_t *ring);
+
+/**
+ * Producer: queue a copy of a report, of up to RR_REPORT_LEN bytes, stamped
+ * with its arrival time.  Return false if the ring is full, and the report
+ * was dropped.
+ */
+bool            rr_push                     (report_ring_t *ring,
+                                                uint8_t const *data, int len);
+
+/**
+ * Consumer: return the oldest report, in place, or NULL if the ring is
+ * empty.  The report remains valid, and is returned again, until
+ * rr_release() is called.
+ */
+/*@null@*/
+rr_report_t const * rr_borrow               (report_ring_t *ring);
+void            rr_release                  (report_ring_t *ring);
+
+/**
+ * Consumer: copy out, and release, the oldest report.  Return false if the
+ * ring is empty.
+ */
+bool            rr_pop                      (report_ring_t *ring,
+                                                rr_report_t *report);
+
+/**
+ * Consumer: discard all queued reports
+ */
+void            rr_flush                    (report_ring_t *ring);
+
+/**
+ * The number of reports queued, and the counters of the ring.  May be
+ * called from any thread.
+ */
+int             rr_count                    (report_ring_t *ring);
+void            rr_getStats                 (report_ring_t *ring,
+                                                rr_stats_t *stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ZY_REPORTRING_H
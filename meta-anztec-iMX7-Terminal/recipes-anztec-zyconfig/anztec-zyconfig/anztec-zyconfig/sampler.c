@@ -0,0 +1,337 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* For a module overview, see the header file
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "zytypes.h"
+#include "protocol.h"
+#include "sampler.h"
+#include "debug.h"
+
+//
+// --- Module Types ---
+//
+
+// the samples of one status index
+typedef struct
+{
+    uint8_t         index;
+    uint32_t        count;          // samples taken, the next is at count % depth
+    uint32_t        errors;
+    smp_sample_t *  ring;
+} smp_series_t;
+
+struct zul_sampler
+{
+    tp_device_t *       dev;
+    int                 periodMs;
+    int                 depth;
+    int                 num;
+    smp_series_t        series[SMP_MAX_INDICES];
+
+    // held while the rings are read or written, never during a request
+    pthread_mutex_t     lock;
+
+    pthread_mutex_t     runLock;
+    pthread_cond_t      runCond;
+    bool                stop;
+    bool                running;
+    pthread_t           thread;
+};
+
+
+//
+// --- Private Prototypes ---
+//
+
+static void *           smp_worker      (void *arg);
+static void             smp_sampleAll   (zul_sampler_t *smp);
+/*@null@*/
+static smp_series_t *   smp_find        (zul_sampler_t *smp, uint8_t index);
+
+
+// ============================================================================
+// --- Public Implementation ---
+// ============================================================================
+
+zul_sampler_t * smp_start(tp_device_t *dev, uint8_t const *indices, int num,
+                                                    int periodMs, int depth)
+{
+    zul_sampler_t      *smp;
+    pthread_condattr_t  attr;
+    int                 size = 2;
+    int                 i;
+
+    if ((dev == NULL) || (indices == NULL)) return NULL;
+    if ((num < 1) || (num > SMP_MAX_INDICES)) return NULL;
+    if (periodMs < SMP_MIN_PERIOD_MS) periodMs = SMP_MIN_PERIOD_MS;
+    if (depth < 2) depth = SMP_DEFAULT_DEPTH;
+    if (depth > 65536) depth = 65536;
+
+    // a power of two, so the ring positions stay in step as the count wraps
+    while (size < depth) size <<= 1;
+    depth = size;
+
+    smp = (zul_sampler_t *)calloc(1, sizeof(zul_sampler_t));
+    if (smp == NULL) return NULL;
+
+    smp->dev      = dev;
+    smp->periodMs = periodMs;
+    smp->depth    = depth;
+    smp->num      = num;
+    for (i = 0; i < num; i++)
+    {
+        smp->series[i].index = indices[i];
+        smp->series[i].ring  = (smp_sample_t *)calloc((size_t)depth,
+                                                    sizeof(smp_sample_t));
+        if (smp->series[i].ring == NULL)
+        {
+            while (i-- > 0) free(smp->series[i].ring);
+            free(smp);
+            return NULL;
+        }
+    }
+
+    (void)pthread_mutex_init(&smp->lock, NULL);
+    (void)pthread_mutex_init(&smp->runLock, NULL);
+    (void)pthread_condattr_init(&attr);
+    (void)pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    (void)pthread_cond_init(&smp->runCond, &attr);
+    (void)pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&smp->thread, NULL, smp_worker, smp) != 0)
+    {
+        zul_logf(1, "%s: no sampler thread", __FUNCTION__);
+        smp_stop(smp);
+        return NULL;
+    }
+
+    smp->running = true;
+
+    zul_logf(3, "%s: %d values every %d ms", __FUNCTION__, num, periodMs);
+    return smp;
+}
+
+void smp_stop(zul_sampler_t *smp)
+{
+    int i;
+
+    if (smp == NULL) return;
+
+    if (smp->running)
+    {
+        (void)pthread_mutex_lock(&smp->runLock);
+        smp->stop = true;
+        (void)pthread_cond_signal(&smp->runCond);
+        (void)pthread_mutex_unlock(&smp->runLock);
+        (void)pthread_join(smp->thread, NULL);
+    }
+
+    (void)pthread_cond_destroy(&smp->runCond);
+    (void)pthread_mutex_destroy(&smp->runLock);
+    (void)pthread_mutex_destroy(&smp->lock);
+    for (i = 0; i < smp->num; i++) free(smp->series[i].ring);
+    free(smp);
+}
+
+bool smp_getSummary(zul_sampler_t *smp, uint8_t index, uint32_t windowMs,
+                                                    smp_summary_t *summary)
+{
+    smp_series_t   *s;
+    uint64_t        now = zul_monotonicMs();
+    uint64_t        sum = 0;
+    uint32_t        held, n;
+
+    if ((smp == NULL) || (summary == NULL)) return false;
+    s = smp_find(smp, index);
+    if (s == NULL) return false;
+
+    memset(summary, 0, sizeof(smp_summary_t));
+
+    (void)pthread_mutex_lock(&smp->lock);
+    summary->errors = s->errors;
+    held = (s->count < (uint32_t)smp->depth) ? s->count : (uint32_t)smp->depth;
+
+    // newest first, until the window is passed
+    for (n = 0; n < held; n++)
+    {
+        smp_sample_t const *p = &s->ring[(s->count - 1 - n) % (uint32_t)smp->depth];
+
+        if ((windowMs != 0) && (now - p->timeMs > windowMs)) break;
+
+        if (n == 0)
+        {
+            summary->last       = p->value;
+            summary->lastTimeMs = p->timeMs;
+            summary->min        = p->value;
+            summary->max        = p->value;
+        }
+        if (p->value < summary->min) summary->min = p->value;
+        if (p->value > summary->max) summary->max = p->value;
+        sum += p->value;
+    }
+    (void)pthread_mutex_unlock(&smp->lock);
+
+    summary->count = (int)n;
+    if (n > 0) summary->mean = (double)sum / (double)n;
+    return true;
+}
+
+int smp_getSamples(zul_sampler_t *smp, uint8_t index, smp_sample_t *samples,
+                                                                    int max)
+{
+    smp_series_t   *s;
+    uint32_t        held, n, first;
+
+    if ((smp == NULL) || (samples == NULL)) return -1;
+    s = smp_find(smp, index);
+    if (s == NULL) return -1;
+    if (max <= 0) return 0;
+
+    (void)pthread_mutex_lock(&smp->lock);
+    held = (s->count < (uint32_t)smp->depth) ? s->count : (uint32_t)smp->depth;
+    if (held > (uint32_t)max) held = (uint32_t)max;
+    first = s->count - held;
+    for (n = 0; n < held; n++)
+    {
+        samples[n] = s->ring[(first + n) % (uint32_t)smp->depth];
+    }
+    (void)pthread_mutex_unlock(&smp->lock);
+
+    return (int)held;
+}
+
+
+// ============================================================================
+// --- Private Implementation ---
+// ============================================================================
+
+static void * smp_worker(void *arg)
+{
+    zul_sampler_t  *smp = (zul_sampler_t *)arg;
+    struct timespec next;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &next);
+
+    (void)pthread_mutex_lock(&smp->runLock);
+    while (!smp->stop)
+    {
+        (void)pthread_mutex_unlock(&smp->runLock);
+        smp_sampleAll(smp);
+        (void)pthread_mutex_lock(&smp->runLock);
+
+        // the next period, from the last start: a slow round does not
+        // shift the ones that follow, but missed periods are not made up
+        next.tv_nsec += (long)(smp->periodMs % 1000) * 1000000L;
+        next.tv_sec  += smp->periodMs / 1000;
+        if (next.tv_nsec >= 1000000000L)
+        {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        {
+            struct timespec now;
+
+            (void)clock_gettime(CLOCK_MONOTONIC, &now);
+            if ( (now.tv_sec > next.tv_sec) ||
+                 ((now.tv_sec == next.tv_sec) && (now.tv_nsec > next.tv_nsec)) )
+            {
+                next = now;
+            }
+        }
+
+        while (!smp->stop &&
+               (pthread_cond_timedwait(&smp->runCond, &smp->runLock, &next) == 0))
+        {
+            ;   // spurious wake, or stop
+        }
+    }
+    (void)pthread_mutex_unlock(&smp->runLock);
+    return NULL;
+}
+
+/**
+ * One round: each value in turn, one request in the queue at a time
+ */
+static void smp_sampleAll(zul_sampler_t *smp)
+{
+    tp_request_t    req;
+    uint8_t         msgBuf[DUAL_BYTE_MSG_LEN];
+    int             i;
+
+    for (i = 0; i < smp->num; i++)
+    {
+        smp_series_t   *s  = &smp->series[i];
+        uint16_t        value;
+        bool            ok = false;
+
+        bzero(msgBuf, DUAL_BYTE_MSG_LEN);
+        if ( zul_encodeGetStatus(msgBuf, DUAL_BYTE_MSG_LEN, s->index) &&
+             tp_prepareRequest(&req, smp->dev, msgBuf, DUAL_BYTE_MSG_LEN, 1) &&
+             (tp_submitRequest(&req) == 0) )
+        {
+            ok = (tp_waitRequest(&req) > 0) &&
+                 zul_decodeValueReply(req.reply, &value);
+        }
+
+        (void)pthread_mutex_lock(&smp->lock);
+        if (ok)
+        {
+            smp_sample_t *p = &s->ring[s->count % (uint32_t)smp->depth];
+
+            p->timeMs = zul_monotonicMs();
+            p->value  = value;
+            s->count++;
+        }
+        else
+        {
+            s->errors++;
+        }
+        (void)pthread_mutex_unlock(&smp->lock);
+    }
+}
+
+static smp_series_t * smp_find(zul_sampler_t *smp, uint8_t index)
+{
+    int i;
+
+    for (i = 0; i < smp->num; i++)
+    {
+        if (smp->series[i].index == index) return &smp->series[i];
+    }
+    return NULL;
+}
@@ -0,0 +1,115 @@
+/*
+ *  Copyright (c) 2019 Zytronic Displays Limited. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact Zytronic, you can do so either via the
+ * website <www.zytronic.co.uk> or by paper mail:
+ * Zytronic, Whiteley Road, Blaydon on Tyne, Tyne & Wear, NE21 5NJ, UK
+ */
+
+
+
+
+
+
+/* Module Overview
+   ===============
+   This code samples a set of status values of a device, from a thread of
+   its own, at a fixed rate, and keeps the most recent samples of each value
+   in a ring.  The application queries the rings - the latest sample, the
+   samples themselves, or the min/max/mean over a recent window - without
+   waiting for the device.
+
+   The sampler's requests go through the request queue of transport.h one
+   at a time: each is submitted only when the previous one has completed,
+   so a foreground request waits behind at most one sampler request.
+
+   A sampler is stopped before its device is closed.
+
+ */
+
+#ifndef _ZY_SAMPLER_H
+#define _ZY_SAMPLER_H
+
+#include "zytypes.h"
+#include "transport.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define  SMP_MAX_INDICES            (32)
+#define  SMP_DEFAULT_DEPTH          (256)
+#define  SMP_MIN_PERIOD_MS          (10)
+
+// one sample of a status value
+typedef struct smp_sample
+{
+    uint64_t    timeMs;             // CLOCK_MONOTONIC milliseconds
+    uint16_t    value;
+} smp_sample_t;
+
+// a summary of the samples of one status value within a window
+typedef struct smp_summary
+{
+    int         count;              // samples in the window
+    uint16_t    min, max;
+    double      mean;
+    uint16_t    last;               // the most recent sample
+    uint64_t    lastTimeMs;
+    uint32_t    errors;             // failed reads, since the start
+} smp_summary_t;
+
+typedef struct zul_sampler zul_sampler_t;
+
+
+/**
+ * Start sampling the status values at 'indices' of a device, every periodMs
+ * (at least SMP_MIN_PERIOD_MS), keeping the latest 'depth' samples of each
+ * (rounded up to a power of two, SMP_DEFAULT_DEPTH if depth is below 2).  NULL is returned if the
+ * parameters are invalid, or the thread could not be started.
+ */
+/*@null@*/
+zul_sampler_t * smp_start                   (tp_device_t *dev,
+                                                uint8_t const *indices, int num,
+                                                int periodMs, int depth);
+/**
+ * Stop the thread, and free the sampler, after any request in progress
+ */
+void            smp_stop                    (/*@null@*/ zul_sampler_t *smp);
+
+/**
+ * Summarise the samples of a status index taken in the last windowMs, or
+ * all the samples held, if windowMs is zero.  Return false if the index is
+ * not sampled.  The summary count is zero if there are no samples.
+ */
+bool            smp_getSummary              (zul_sampler_t *smp, uint8_t index,
+                                                uint32_t windowMs,
+                                                smp_summary_t *summary);
+
+/**
+ * Copy up to max of the most recent samples of a status index, oldest
+ * first.  Return the number copied, or -1 if the index is not sampled.
+ */
+int             smp_getSamples              (zul_sampler_t *smp, uint8_t index,
+                                                smp_sample_t *samples, int max);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ZY_SAMPLER_H
@@ -127,99 +127,94 @@ int main_get_str_response(uint8_t *data)
 
 // ----------------------------------------------------------------------------
 
-void             saveConfig100()
-{
-
-    uint8_t     index;
-    uint16_t    numStatus, numConfig, tempVal;
-
-    // printf("%s\n", __FUNCTION__);
-
-    zul_getStatusByID(ZXY100_SI_NUM_STATUS_VALUES, &numStatus);
-    zul_getStatusByID(ZXY100_SI_NUM_CONFIG_PARAMS, &numConfig);
+/**
+ * Read a range of status ('S') or config ('C') values, by
+ * zul_getStatusRange() etc, and write them to the file and to the console.
+ * They are read a chunk at a time, so the console shows the progress.
+ */
+#define SAVE_CHUNK  (32)
 
-    uint8_t     numSV8 = (uint8_t)numStatus;
-    uint8_t     numCI8 = (uint8_t)numConfig;
+void saveRange(char kind, char const *tag, uint8_t first, int count)
+{
+    uint16_t    values[SAVE_CHUNK];
+    uint8_t     okMap[ZUL_BITMAP_LEN(SAVE_CHUNK)];
+    int         done, n, i;
 
-    for (index = 0; index<numSV8; index++)
+    for (done = 0; done < count; done += n)
     {
-        if (SUCCESS == zul_getStatusByID(index, &tempVal))
+        uint8_t at = (uint8_t)(first + done);
+
+        n = (count - done < SAVE_CHUNK) ? count - done : SAVE_CHUNK;
+        if (kind == 'S')
         {
-            fprintf(stdout, "STATUS %02X %04X\n", index, tempVal);
-            fprintf(fp,     "STATUS %02X %04X\r\n", index, tempVal);
-            zul_CursorUp(1);
+            (void)zul_getStatusRange(at, n, values, okMap);
         }
         else
         {
-            fprintf(stdout, "STATUS %02X ----\n", index);
+            (void)zul_getConfigRange(at, n, values, okMap);
         }
-    }
-    fprintf(stdout,"\n");
-    for (index = 0; index<numCI8; index++)
-    {
-        if (SUCCESS == zul_getConfigParamByID(index, &tempVal))
-        {
-            fprintf(stdout, "CONFIG %02X %04X\n", index, tempVal);
-            fprintf(fp,     "CONFIG %02X %04X\r\n", index, tempVal);
-            zul_CursorUp(1);
-        }
-        else
+
+        for (i = 0; i < n; i++)
         {
-            fprintf(stdout, "CONFIG %02X ----\n", index);
+            uint8_t index = (uint8_t)(at + i);
+
+            if (ZUL_BITMAP_TEST(okMap, i))
+            {
+                fprintf(stdout, "%s %02X %04X\n", tag, index, values[i]);
+                fprintf(fp,     "%s %02X %04X\r\n", tag, index, values[i]);
+                zul_CursorUp(1);
+            }
+            else
+            {
+                fprintf(stdout, "%s %02X ----\n", tag, index);
+            }
         }
     }
+}
+
+void             saveConfig100()
+{
+    uint16_t    numStatus = 0, numConfig = 0;
+
+    // printf("%s\n", __FUNCTION__);
+
+    zul_getStatusByID(ZXY100_SI_NUM_STATUS_VALUES, &numStatus);
+    zul_getStatusByID(ZXY100_SI_NUM_CONFIG_PARAMS, &numConfig);
+
+    numStatus &= 0xff;
+    numConfig &= 0xff;
+
+    saveRange('S', "STATUS", 0, numStatus);
+    fprintf(stdout,"\n");
+
+    saveRange('C', "CONFIG", 0, numConfig);
     fprintf(stdout,"\n");
 }
 
 
 void             saveConfigMT()
 {
-
-    uint16_t numStatus, numConfig, tempVal;
-    uint8_t index, privateBase;
-    uint8_t numSV8, numCI8, spiDevIndex;
+    uint16_t    num;
+    uint16_t    values[6];
+    uint8_t     okMap[ZUL_BITMAP_LEN(6)];
+    uint8_t     spiDevIndex;
 
     // printf("%s\n", __FUNCTION__);
 
     // there are "public" and "private" values for status and config
 
     // public status values
-    if (SUCCESS == zul_getStatusByID(ZXYMT_SI_NUM_STATUS_VALUES, &numStatus))
+    if (SUCCESS == zul_getStatusByID(ZXYMT_SI_NUM_STATUS_VALUES, &num))
     {
-        numSV8 = (uint8_t)numStatus;
-        for (index = 0; index<numSV8; index++)
-        {
-            if (SUCCESS == zul_getStatusByID(index, &tempVal))
-            {
-                fprintf(stdout, "STATUS %02X %04X\n", index, tempVal);
-                fprintf(fp,     "STATUS %02X %04X\r\n", index, tempVal);
-                zul_CursorUp(1);
-            }
-            else
-            {
-                fprintf(stdout, "STATUS %02X ----\n", index);
-            }
-        }
+        num &= 0xff;
+        saveRange('S', "STATUS", 0, num);
     }
 
     // now the private status values ...
-    if (SUCCESS == zul_getStatusByID(ZXYMT_SI_NUM_PRIVATE_STATUS_VALUES, &numStatus))
+    if ( (SUCCESS == zul_getStatusByID(ZXYMT_SI_NUM_PRIVATE_STATUS_VALUES, &num)) &&
+         (num > 0) && (num <= 256) )
     {
-        privateBase = (uint8_t)(256 - numStatus);
-        index = privateBase;
-        do {
-            if (SUCCESS == zul_getStatusByID(index, &tempVal))
-            {
-                fprintf(stdout, "STATUS %02X %04X\n", index, tempVal);
-                fprintf(fp,     "STATUS %02X %04X\r\n", index, tempVal);
-                zul_CursorUp(1);
-            }
-            else
-            {
-                fprintf(stdout, "STATUS %02X ----\n", index);
-            }
-            index++;
-        } while (index != 0);
+        saveRange('S', "STATUS", (uint8_t)(256 - num), num);
     }
     fprintf(stdout,"\n");
 
@@ -227,14 +222,15 @@ void             saveConfigMT()
     for (spiDevIndex=0; spiDevIndex<g_numSpiDevs; spiDevIndex++)
     {
         uint8_t reg;
+
+        (void)zul_getSpiRegisterRange(spiDevIndex, 0, 6, values, okMap);
         for (reg = 0; reg < 6; reg++)
         {
-            uint16_t value;
-            if ( SUCCESS == zul_getSpiRegister( spiDevIndex, reg, &value ))
+            if (ZUL_BITMAP_TEST(okMap, reg))
             {
                 uint16_t address = (spiDevIndex << 4) + (reg);
-                fprintf(stdout, "#ARVAL %02X %04X\n", address, value );
-                fprintf(fp,     "#ARVAL %02X %04X\r\n", address, value );
+                fprintf(stdout, "#ARVAL %02X %04X\n", address, values[reg] );
+                fprintf(fp,     "#ARVAL %02X %04X\r\n", address, values[reg] );
                 zul_CursorUp(1);
             }
             else
@@ -246,42 +242,17 @@ void             saveConfigMT()
     fprintf(stdout,"\n");
 
     // public config values
-    if (SUCCESS == zul_getStatusByID(ZXYMT_SI_NUM_CONFIG_PARAMS, &numConfig))
+    if (SUCCESS == zul_getStatusByID(ZXYMT_SI_NUM_CONFIG_PARAMS, &num))
     {
-        numCI8 = (uint8_t)numConfig;
-        for (index = 0; index<numCI8; index++)
-        {
-            if (SUCCESS == zul_getConfigParamByID(index, &tempVal))
-            {
-                fprintf(stdout, "CONFIG %02X %04X\n", index, tempVal);
-                fprintf(fp,     "CONFIG %02X %04X\r\n", index, tempVal);
-                zul_CursorUp(1);
-            }
-            else
-            {
-                fprintf(stdout, "CONFIG %02X ----\n", index);
-            }
-        }
+        num &= 0xff;
+        saveRange('C', "CONFIG", 0, num);
     }
 
     // now the private config values ...
-    if (SUCCESS == zul_getStatusByID(ZXYMT_SI_NUM_PRIVATE_CONFIG_PARAMS, &numConfig))
+    if ( (SUCCESS == zul_getStatusByID(ZXYMT_SI_NUM_PRIVATE_CONFIG_PARAMS, &num)) &&
+         (num > 0) && (num <= 256) )
     {
-        privateBase = (uint8_t)(256 - numConfig);
-        index = privateBase;
-        do {
-            if (SUCCESS == zul_getConfigParamByID(index, &tempVal))
-            {
-                fprintf(stdout, "CONFIG %02X %04X\n", index, tempVal);
-                fprintf(fp,     "CONFIG %02X %04X\r\n", index, tempVal);
-                zul_CursorUp(1);
-            }
-            else
-            {
-                fprintf(stdout, "CONFIG %02X ----\n", index);
-            }
-            index++;
-        } while (index != 0);
+        saveRange('C', "CONFIG", (uint8_t)(256 - num), num);
     }
     fprintf(stdout,"\n");
 }
@@ -389,15 +360,12 @@ void saveConfig()
                     }
                     if (strstr(versionData, "ZXY500") != NULL)
                     {
+                        ZXY_identity    id;
+
                         saveMT = true;
-                        g_numSpiDevs = 1;
-                        if (strstr(versionData, "-128-") != NULL)
-                        {
-                            g_numSpiDevs = 2;
-                        }
-                        if (strstr(versionData, "-256-") != NULL)
+                        if (SUCCESS == zul_getIdentity(&id))
                         {
-                            g_numSpiDevs = 4;
+                            g_numSpiDevs = id.numSpiDevs;
                         }
                     }
                 }
@@ -51,6 +51,14 @@
 #include "zytypes.h"
 #include "protocol.h"
 #include "usb.h"
+#include "transport.h"
+#include "reportring.h"
+#include "shadow.h"
+#include "sampler.h"
+#include "tracker.h"
+#include "tuio.h"
+#include "rawframe.h"
+#include "rawdecode.h"
 #include "services.h"
 #include "services_sc.h"
 //#include "comms.h"
@@ -60,23 +68,17 @@
 // --- Module Global Variables/Consts ---
 //
 
-/*   --- NB: the library is not designed to be multi-thread safe ---  */
+/*   --- NB: the device requests, and their replies, are safe to make from
+ *       several threads (see the request queue of transport.h); the other
+ *       module state below is not  ---  */
 
 
 // msv => module static variable
 
-static uint8_t              msv_xfrIndex;
-static uint16_t             msv_getConfigParam;
-static uint16_t             msv_getStatusVal;
 static bool                 msv_flashWriteDisabled = false;
-static char                 msv_resp_string[80];
-
-static uint8_t              msv_privateTouches[64];
 
 static bool                 msv_showNoSensor;
 
-/*@null@*/          // for splint
-static uint8_t         *    msv_pvtTouchUserBuf = NULL;
 static uint8_t              msv_BL_reply[BL_REPLY_BUF_LEN];
 static uint16_t             msv_xWires = 0, msv_yWires = 0;
 static bool                 msv_privateTouchMode = false;
@@ -90,13 +92,62 @@ static void             *   msv_image = 0;
 static uint8_t              msv_rawDataStatus[64];
 static uint8_t              msv_heartBeatData[64];
 static uint8_t              msv_touchData[64];
-static Contact              msv_lastTouchLocation;
+
+// IN reports queued by the handlers, per report ID, see reportring.h
+/*@null@*/
+static report_ring_t    *   msv_inRing[MAX_REPORT_ID];
+
+// all the contacts of the touch reports, see tracker.h
+/*@null@*/
+static zul_tracker_t    *   msv_tracker = NULL;
+
+// TUIO publisher of the private touches, see tuio.h.  Kept until the
+// services end, as the input thread may be using it.
+/*@null@*/
+static zul_tuio_t       *   msv_tuio = NULL;
+
+// complete frames of the Multitouch raw data, see rawframe.h.  Kept until
+// the services end, as the tuio publisher is.
+/*@null@*/
+static zul_rawframe_t   *   msv_rawFrames = NULL;
+
+// raw data recording and replay, see rawrec.h
+/*@null@*/
+static zul_recwriter_t  *   msv_recorder = NULL;
+/*@null@*/
+static zul_recreader_t  *   msv_replayReader = NULL;
+/*@null@*/
+static zul_recplay_t    *   msv_replay = NULL;
+
+// host copy of the values of the open device, see shadow.h
+/*@null@*/
+static zul_shadow_t     *   msv_shadow = NULL;
+static ZXY_sensorSize       msv_sensorSize;
+static bool                 msv_sensorSizeKnown = false;
+
+// background status sampling, see sampler.h
+/*@null@*/
+static zul_sampler_t    *   msv_sampler = NULL;
+
+// identity of the open device, see zul_getIdentity()
+static ZXY_identity         msv_identity;
+static bool                 msv_identityKnown = false;
+static uint8_t              msv_iface = 0;
 
 
 //
 // --- Private Prototypes ---
 //
 void            zul_initFwData                  (void);
+static bool     zul_initReportRings             (void);
+static void     zul_resetDeviceState            (void);
+static void     zul_findRelease                 (Contact *c);
+static int      zul_readVersionStr              (VerIndex verType, char *v,
+                                                    int len);
+static void     zul_gatherIdentity              (ZXY_identity *id);
+static void     zul_enduranceParams             (Endurance endurance,
+                                                    int *delay, int *retries,
+                                                    int *timeout);
 
 
 /**
@@ -113,17 +164,40 @@ void            handle_privateTouches           (uint8_t *data);
  * CTRL tansaction reply handlers
  */
 int             default_CTRL_handler            (uint8_t *data);
-int             get_response                    (uint8_t *data);
-int             status_response                 (uint8_t *data);
 int             set_response                    (uint8_t *data);
-int             get_str_response                (uint8_t *data);
 int             handle_BL_response              (uint8_t *data);
 
+static int      zul_requestValue                (uint8_t *msgBuf, int len,
+                                                    char const *tag, int index,
+                                                    uint16_t *value);
+static int      zul_submitGet                   (uint8_t *msgBuf,
+                                                    tp_request_t *req);
+static int      zul_writeConfigOrder            (int num, uint8_t const *order,
+                                                    uint16_t const *target,
+                                                    uint8_t const *which);
+static int      zul_readConfigMap               (uint8_t const *wanted,
+                                                    uint16_t *values,
+                                                    uint8_t *okMap);
+static int      zul_readValue                   (char kind, uint8_t device,
+                                                    uint8_t idx, uint16_t *value);
+static int      zul_getRange                    (char kind, uint8_t device,
+                                                    uint8_t first, int count,
+                                                    uint16_t *values,
+                                                    uint8_t *okMap);
+
 // ============================================================================
 // --- Public Implementation ---
 // ============================================================================
 
 
+/**
+ * Select the transport used by the services, see tp_select()
+ */
+int zul_selectTransport(char const *name)
+{
+    return tp_select(name);
+}
+
 /**
  * Reset all internal state, ready for first use
  * return zero on success, else a negative error code
@@ -133,7 +207,12 @@ int zul_InitServices(void)
     zul_logf(3, "%s", __FUNCTION__);
     zul_InitServSelfCap();
     zul_initFwData();
-    return usb_openLib();
+    if (!zul_initReportRings()) return -11;
+    if (msv_shadow == NULL) msv_shadow = shadow_create(0);
+    if (msv_shadow == NULL) return -11;
+    if (msv_tracker == NULL) msv_tracker = trk_create();
+    if (msv_tracker == NULL) return -11;
+    return tp_openLib();
 }
 
 /**
@@ -141,7 +220,65 @@ int zul_InitServices(void)
  */
 void zul_EndServices(void)
 {
-    usb_closeLib();
+    int i;
+
+    zul_stopStatusSampler();
+    (void)zul_stopRawRecording();
+    zul_stopRawReplay();
+    tp_closeLib();
+    for (i = 0; i < MAX_REPORT_ID; i++)
+    {
+        rr_destroy(msv_inRing[i]);
+        msv_inRing[i] = NULL;
+    }
+    shadow_destroy(msv_shadow);
+    msv_shadow = NULL;
+    tuio_destroy(msv_tuio);
+    msv_tuio = NULL;
+    rf_destroy(msv_rawFrames);
+    msv_rawFrames = NULL;
+    trk_destroy(msv_tracker);
+    msv_tracker = NULL;
+}
+
+/**
+ * Create the queues of the IN reports stored by the default handlers
+ */
+static bool zul_initReportRings(void)
+{
+    static UsbReportID_t const queued[] =
+                        { TOUCH_OS, RAW_DATA, HEARTBEAT_REPORT };
+    int i;
+
+    for (i = 0; i < (int)(sizeof(queued) / sizeof(queued[0])); i++)
+    {
+        if (msv_inRing[queued[i]] == NULL)
+        {
+            msv_inRing[queued[i]] = rr_create(RR_DEFAULT_SLOTS);
+            if (msv_inRing[queued[i]] == NULL) return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Forget the values and contacts of the previous device, and select the
+ * shadow policy of the device now open, if any
+ */
+static void zul_resetDeviceState(void)
+{
+    int16_t pid = 0;
+
+    (void)tp_getDevicePID(&pid);
+    shadow_reset(msv_shadow, pid);
+    trk_reset(msv_tracker);
+    tuio_releaseAll(msv_tuio);
+    (void)zul_stopRawRecording();
+    zul_stopRawReplay();
+    if (msv_rawFrames != NULL) (void)rf_configure(msv_rawFrames, 0, 0);
+    msv_sensorSizeKnown = false;
+    msv_identityKnown   = false;
+    msv_iface           = 0;
 }
 
 /**
@@ -155,7 +292,7 @@ int zul_getDeviceList(char *buf, int len)
     char *  bufPtr = buf;
     int16_t pid = 0;
 
-    int     numZyDevices = usb_getDeviceList(buf, len);
+    int     numZyDevices = tp_getDeviceList(buf, len);
 
     if ( numZyDevices > 0 )
     {
@@ -231,7 +368,7 @@ void zul_getVersion(char *buffer, int len)
  */
 char *      zul_usbLibStr(void)
 {
-    return usb_usbLibStr();
+    return tp_libStr();
 }
 
 
@@ -613,18 +750,18 @@ char * zul_removeDeviceTargetAddr(int *pNumArgs, char *argv[])
 void zul_setRawDataHandler(void)
 {
     int16_t pid;
-    if (usb_getDevicePID(&pid))
+    if (tp_getDevicePID(&pid))
     {
         switch (pid)
         {
             case ZXY100_PRODUCT_ID:
-                usb_RegisterHandler( RAW_DATA, handle_IN_rawdata_100 );
+                tp_RegisterHandler( RAW_DATA, handle_IN_rawdata_100 );
                 break;
             case ZXY110_PRODUCT_ID:
-                usb_RegisterHandler( RAW_DATA, handle_IN_rawdata_110 );
+                tp_RegisterHandler( RAW_DATA, handle_IN_rawdata_110 );
                 break;
             default:
-                usb_RegisterHandler( RAW_DATA, handle_IN_rawdata_mt );
+                tp_RegisterHandler( RAW_DATA, handle_IN_rawdata_mt );
                 break;
         }
     }
@@ -636,7 +773,31 @@ void zul_setRawDataHandler(void)
  */
 int zul_getAddrStr(char * addrStr)
 {
-    return usb_getAddrStr(addrStr);
+    return tp_getAddrStr(addrStr);
+}
+
+/**
+ * Discard the cached enumeration, see tp_rescanDevices()
+ */
+int zul_rescanDevices(void)
+{
+    return tp_rescanDevices();
+}
+
+/**
+ * Wait for a device of the given PID to attach, see tp_waitForDevice()
+ */
+int zul_waitForDevice(int16_t pid, int timeoutMs, char *addrStr)
+{
+    return (0 == tp_waitForDevice(pid, timeoutMs, addrStr)) ? SUCCESS : FAILURE;
+}
+
+/**
+ * Wait for a device to detach, see tp_waitForDeviceLeft()
+ */
+int zul_waitForDeviceLeft(char const *addrStr, int timeoutMs)
+{
+    return (0 == tp_waitForDeviceLeft(addrStr, timeoutMs)) ? SUCCESS : FAILURE;
 }
 
 /**
@@ -646,8 +807,10 @@ int zul_getAddrStr(char * addrStr)
 int zul_openDeviceByAddr(char *portAddr)
 {
     msv_showNoSensor = true;
-    int retVal = usb_openDeviceByAddr(portAddr);
+    int retVal = tp_openDeviceByAddr(portAddr);
+    zul_resetDeviceState();
     zul_setRawDataHandler();
+    if (retVal == 0) (void)zul_refreshIdentity();
     return retVal;
 }
 
@@ -658,8 +821,10 @@ int zul_openDeviceByAddr(char *portAddr)
 int zul_openDevice(int index)
 {
     msv_showNoSensor = true;
-    int retVal = usb_openDevice(index);
+    int retVal = tp_openDevice(index);
+    zul_resetDeviceState();
     zul_setRawDataHandler();
+    if (retVal == 0) (void)zul_refreshIdentity();
     return retVal;
 }
 
@@ -668,8 +833,10 @@ int zul_openDevice(int index)
  */
 int zul_reOpenLastDevice(void)
 {
-    int retVal = usb_reOpenLastDevice();
+    int retVal = tp_reOpenLastDevice();
+    zul_resetDeviceState();
     zul_setRawDataHandler();
+    if (retVal == 0) (void)zul_refreshIdentity();
     return retVal;
 }
 
@@ -679,20 +846,27 @@ int zul_reOpenLastDevice(void)
  */
 bool zul_getDevicePID(int16_t *pid)
 {
-    return usb_getDevicePID(pid);
+    return tp_getDevicePID(pid);
 }
 
 /**
  * If a device is open, set the supplied sensor size struct and return true
  * Else, return false
+ * The size is read once per connection.
  */
 bool zul_getSensorSize (ZXY_sensorSize *sz)
 {
     int16_t     PID;
     uint16_t    cellCountX,cellCountY;
 
-    if (usb_getDevicePID(&PID))
+    if (tp_getDevicePID(&PID))
     {
+        if (msv_sensorSizeKnown)
+        {
+            *sz = msv_sensorSize;
+            return true;
+        }
+
         switch (PID)
         {
             case ZXY100_PRODUCT_ID:
@@ -707,6 +881,13 @@ bool zul_getSensorSize (ZXY_sensorSize *sz)
         }
         sz->xWires = cellCountX;
         sz->yWires = cellCountY;
+
+        // the ZXY100 fall-back count is not valid
+        if (cellCountX < 256)
+        {
+            msv_sensorSize      = *sz;
+            msv_sensorSizeKnown = true;
+        }
         return true;
     }
     return false;
@@ -715,40 +896,32 @@ bool zul_getSensorSize (ZXY_sensorSize *sz)
 /**
  * Control the "robustness" of the communications
  * see
-        void        usb_setCtrlDelay            (int delay);
-        void        usb_defaultCtrlDelay        (void);
+        void        tp_setCtrlDelay            (int delay);
+        void        tp_defaultCtrlDelay        (void);
 
     TODO - clean this up
  */
 static Endurance   msv_commEndurance = COM_ENDUR_NORM;
 void  zul_setCommsEndurance(Endurance endurance)
 {
-    msv_commEndurance = endurance;
+    int delay, retries, timeout;
 
     switch (endurance)
     {
         case COM_ENDUR_MEDIUM:
-            usb_setCtrlDelay(40);       // ms
-            usb_setCtrlRetry(50);
-            usb_setCtrlTimeout(10000);   // ms
-            break;
-
         case COM_ENDUR_HIGH:
-            usb_setCtrlDelay(40);       // ms
-            usb_setCtrlRetry(200);
-            usb_setCtrlTimeout(10000);  // ms
+            msv_commEndurance = endurance;
             break;
 
         default:
             msv_commEndurance = COM_ENDUR_NORM;
-            /*@fallthrough@*/   // intended fallthrough
-
-        case COM_ENDUR_NORM:
-            usb_defaultCtrlDelay();
-            usb_defaultCtrlRetry();
-            usb_defaultCtrlTimeout();
             break;
     }
+
+    zul_enduranceParams(msv_commEndurance, &delay, &retries, &timeout);
+    tp_setCtrlDelay(delay);
+    tp_setCtrlRetry(retries);
+    tp_setCtrlTimeout(timeout);
 }
 
 Endurance zul_getCommsEndurance(void)
@@ -756,6 +929,35 @@ Endurance zul_getCommsEndurance(void)
     return msv_commEndurance;
 }
 
+/**
+ * The control comms delay (ms), retries and timeout (ms) of an endurance
+ * level, -1 being the transport default
+ */
+static void zul_enduranceParams(Endurance endurance, int *delay, int *retries,
+                                                                int *timeout)
+{
+    switch (endurance)
+    {
+        case COM_ENDUR_MEDIUM:
+            *delay      = 40;
+            *retries    = 50;
+            *timeout    = 10000;
+            break;
+
+        case COM_ENDUR_HIGH:
+            *delay      = 40;
+            *retries    = 200;
+            *timeout    = 10000;
+            break;
+
+        default:
+            *delay      = -1;
+            *retries    = -1;
+            *timeout    = -1;
+            break;
+    }
+}
+
 /**
  * Set the connected interface to #0 with parameter 'true' or to the auxilliary
  * interface with parameter 'false'.
@@ -766,13 +968,17 @@ int zul_useKernelIFace(bool kernel)
 {
     int16_t     PID;
     // if connected,
-    if (usb_getDevicePID(&PID))
+    if (tp_getDevicePID(&PID))
     {
         // if connected to a ZXY500 Application device
         if ( zul_isZXY500AppPID(&PID) )
         {
             // switch to interface ZERO if main is true
-            usb_switchIFace( (uint8_t) ( kernel ? 0 : 1 ) );
+            if (tp_switchIFace( (uint8_t) ( kernel ? 0 : 1 ) ))
+            {
+                msv_iface = (uint8_t) ( kernel ? 0 : 1 );
+                msv_identity.iface = msv_iface;
+            }
             return SUCCESS;
         }
     }
@@ -784,8 +990,20 @@ int zul_useKernelIFace(bool kernel)
  */
 int zul_closeDevice(void)
 {
+    shadow_stats_t  st;
+    int             retVal;
+
+    if (zul_getShadowStats(&st) && (st.dirty > 0))
+    {
+        zul_logf(1, "%s: %u deferred config values not written", __FUNCTION__,
+                                                            (unsigned)st.dirty);
+    }
+
+    zul_stopStatusSampler();
     zul_ResetSelfCapData();
-    return usb_closeDevice();
+    retVal = tp_closeDevice();
+    zul_resetDeviceState();
+    return retVal;
 }
 
 
@@ -796,74 +1014,170 @@ int zul_closeDevice(void)
 
 int zul_getStatusByID(uint8_t ID, uint16_t *status)
 {
-    bool    ok;
-    uint8_t msgBuf[DUAL_BYTE_MSG_LEN];
-    int     retVal;
+    if (shadow_get(msv_shadow, SHADOW_STATUS, ID, status)) return SUCCESS;
+    return zul_readValue('S', 0, ID, status);
+}
 
-    bzero(msgBuf, DUAL_BYTE_MSG_LEN);
-    ok = zul_encodeGetStatus(msgBuf, DUAL_BYTE_MSG_LEN, ID);
-    msv_xfrIndex = ID;
-    if (ok)
-    {
-        retVal = usb_ControlRequest(msgBuf, DUAL_BYTE_MSG_LEN, status_response);
-        if (retVal > 0) *status = msv_getStatusVal;
-        retVal = (retVal > 0) ? SUCCESS : FAILURE;
-    }
-    else
+int zul_getSpiRegister(uint8_t device, uint8_t reg, uint16_t *value)
+{
+    return zul_readValue('R', device, reg, value);
+}
+
+int zul_getConfigParamByID(uint8_t ID, uint16_t *value)
+{
+    if (shadow_get(msv_shadow, SHADOW_CONFIG, ID, value)) return SUCCESS;
+    return zul_readValue('C', 0, ID, value);
+}
+
+/**
+ * Shadow services, see shadow.h
+ */
+void zul_invalidateShadow(void)
+{
+    shadow_invalidate(msv_shadow);
+    msv_sensorSizeKnown = false;
+}
+
+void zul_setShadowPolicy(ShadowKind kind, uint8_t ID, int32_t ttlMs)
+{
+    shadow_setPolicy(msv_shadow, kind, ID, ttlMs);
+}
+
+bool zul_getShadowStats(shadow_stats_t *stats)
+{
+    if ((msv_shadow == NULL) || (stats == NULL)) return false;
+    shadow_getStats(msv_shadow, stats);
+    return true;
+}
+
+/**
+ * Background status sampling, see sampler.h
+ */
+int zul_startStatusSampler(uint8_t const *indices, int num, int periodMs,
+                                                                    int depth)
+{
+    tp_device_t *dev = tp_getDefaultDevice();
+
+    zul_stopStatusSampler();
+    if (dev == NULL) return FAILURE;
+
+    msv_sampler = smp_start(dev, indices, num, periodMs, depth);
+    return (msv_sampler != NULL) ? SUCCESS : FAILURE;
+}
+
+void zul_stopStatusSampler(void)
+{
+    smp_stop(msv_sampler);
+    msv_sampler = NULL;
+}
+
+int zul_getStatusSummary(uint8_t ID, uint32_t windowMs, smp_summary_t *summary)
+{
+    if (msv_sampler == NULL) return FAILURE;
+    return smp_getSummary(msv_sampler, ID, windowMs, summary) ? SUCCESS : FAILURE;
+}
+
+int zul_getStatusSamples(uint8_t ID, smp_sample_t *samples, int max)
+{
+    if (msv_sampler == NULL) return -1;
+    return smp_getSamples(msv_sampler, ID, samples, max);
+}
+
+/**
+ * Bulk accessors, see zul_getRange()
+ */
+int zul_getConfigRange(uint8_t first, int count, uint16_t *values, uint8_t *okMap)
+{
+    return zul_getRange('C', 0, first, count, values, okMap);
+}
+
+int zul_getStatusRange(uint8_t first, int count, uint16_t *values, uint8_t *okMap)
+{
+    return zul_getRange('S', 0, first, count, values, okMap);
+}
+
+int zul_getSpiRegisterRange(uint8_t device, uint8_t first, int count,
+                                            uint16_t *values, uint8_t *okMap)
+{
+    return zul_getRange('R', device, first, count, values, okMap);
+}
+
+/**
+ * Queue get requests, for completion by the caller
+ */
+static int zul_submitGet(uint8_t *msgBuf, tp_request_t *req)
+{
+    tp_done_t   done;
+    void       *context;
+
+    if (req == NULL) return FAILURE;
+
+    // keep any callback set by the caller
+    done    = req->done;
+    context = req->context;
+    if (!tp_prepareRequest(req, tp_getDefaultDevice(), msgBuf,
+                                                    DUAL_BYTE_MSG_LEN, 1))
     {
-        retVal = FAILURE;
+        return FAILURE;
     }
-    return retVal;
+    req->done       = done;
+    req->context    = context;
+
+    return (tp_submitRequest(req) == 0) ? SUCCESS : FAILURE;
 }
 
-int zul_getSpiRegister(uint8_t device, uint8_t reg, uint16_t *value)
+int zul_submitGetConfigParam(uint8_t ID, tp_request_t *req)
 {
-    bool    ok;
     uint8_t msgBuf[DUAL_BYTE_MSG_LEN];
-    int     retVal;
 
     bzero(msgBuf, DUAL_BYTE_MSG_LEN);
-    ok = zul_encodeGetSpiRegister(msgBuf, DUAL_BYTE_MSG_LEN, device, reg);
-    msv_xfrIndex = reg;
-    if (ok)
-    {
-        retVal = usb_ControlRequest(msgBuf, DUAL_BYTE_MSG_LEN, get_response);
-        if (retVal > 0)
-        {
-            *value = msv_getConfigParam;
-            retVal = SUCCESS;
-        } else {
-            retVal = FAILURE;
-        }
-    }
-    else
-    {
-        retVal = FAILURE;
-    }
-    return retVal;
+    if (!zul_encodeGetRequest(msgBuf, DUAL_BYTE_MSG_LEN, ID)) return FAILURE;
+    return zul_submitGet(msgBuf, req);
 }
 
-int zul_getConfigParamByID(uint8_t ID, uint16_t *value)
+int zul_submitGetStatus(uint8_t ID, tp_request_t *req)
 {
-    bool    ok;
     uint8_t msgBuf[DUAL_BYTE_MSG_LEN];
-    int     retVal;
 
     bzero(msgBuf, DUAL_BYTE_MSG_LEN);
-    ok = zul_encodeGetRequest(msgBuf, DUAL_BYTE_MSG_LEN, ID);
-    msv_xfrIndex = ID;
+    if (!zul_encodeGetStatus(msgBuf, DUAL_BYTE_MSG_LEN, ID)) return FAILURE;
+    return zul_submitGet(msgBuf, req);
+}
+
+int zul_setConfigParamByID(uint8_t ID, uint16_t value)
+{
+    bool                ok;
+    uint8_t             msgBuf[DUAL_BYTE_MSG_LEN + 2];
+    int                 retVal;
+    int16_t             pid = -1;
+    usb_ctrl_latency_t  lat;
+    int                 delay, retries, timeout;
+
+    bzero(msgBuf, DUAL_BYTE_MSG_LEN + 2);
+    ok = zul_encodeSetRequest(msgBuf, DUAL_BYTE_MSG_LEN + 2, ID, value);
     if (ok)
     {
-        retVal = usb_ControlRequest(msgBuf, DUAL_BYTE_MSG_LEN, get_response);
-        if (retVal > 0)
+        // writes may take a flash cycle to answer; until the turnaround of
+        // this controller's writes is learned, allow for the slowest (ZXY100)
+        // No flash cycle is made while flash writes are inhibited.
+        if ( (msv_commEndurance == COM_ENDUR_NORM) && !msv_flashWriteDisabled &&
+             tp_getDevicePID(&pid) &&
+             !( usb_getCtrlLatency(pid, zul_requestMessageCode(msgBuf), &lat)
+                && lat.learned ) )
         {
-            *value = msv_getConfigParam;
-            retVal = SUCCESS;
+            // for this request only - the I/O thread may be serving others
+            zul_enduranceParams(COM_ENDUR_MEDIUM, &delay, &retries, &timeout);
+            retVal = tp_ControlRequestCP(msgBuf, DUAL_BYTE_MSG_LEN + 2,
+                            default_CTRL_handler, delay, retries, timeout);
         }
         else
         {
-            retVal = FAILURE;
+            retVal = tp_ControlRequest(msgBuf, DUAL_BYTE_MSG_LEN + 2,
+                                                    default_CTRL_handler);
         }
+        retVal = (retVal > 0) ? SUCCESS : FAILURE;
+
+        if (retVal == SUCCESS) shadow_written(msv_shadow, ID, value);
     }
     else
     {
@@ -872,41 +1186,31 @@ int zul_getConfigParamByID(uint8_t ID, uint16_t *value)
     return retVal;
 }
 
-int zul_setConfigParamByID(uint8_t ID, uint16_t value)
+/**
+ * Standard device version string accessors
+ */
+int zul_getVersionStr(VerIndex verType, char *v, int len)
 {
-    bool    ok;
-    uint8_t msgBuf[DUAL_BYTE_MSG_LEN + 2];
-    int     retVal;
-    Endurance e = zul_getCommsEndurance();
+    zul_logf(3, "%s %d", __FUNCTION__, verType);
 
-    zul_setCommsEndurance(COM_ENDUR_MEDIUM);
-    bzero(msgBuf, DUAL_BYTE_MSG_LEN + 2);
-    ok = zul_encodeSetRequest(msgBuf, DUAL_BYTE_MSG_LEN + 2, ID, value);
-    msv_xfrIndex = ID;
-    if (ok)
-    {
-        retVal = usb_ControlRequest(msgBuf, DUAL_BYTE_MSG_LEN + 2, default_CTRL_handler);
-        retVal = (retVal > 0) ? SUCCESS : FAILURE;
-    }
-    else
+    if ( msv_identityKnown && (verType <= STR_CPUID) &&
+         (msv_identity.version[verType][0] != '\0') )
     {
-        retVal = FAILURE;
+        snprintf(v, len, "%s", msv_identity.version[verType]);
+        return SUCCESS;
     }
-    zul_setCommsEndurance(e);
-    return retVal;
+    return zul_readVersionStr(verType, v, len);
 }
 
 /**
- * Standard device version string accessors
+ * Device version string request, without reference to the identity
  */
-int zul_getVersionStr(VerIndex verType, char *v, int len)
+static int zul_readVersionStr(VerIndex verType, char *v, int len)
 {
     bool        ok;
     int16_t     pid;
     uint8_t     msgBuf[DUAL_BYTE_MSG_LEN];
 
-    zul_logf(3, "%s %d", __FUNCTION__, verType);
-
     if ( zul_getDevicePID(&pid))
     {
         if (pid == ZXY100_PRODUCT_ID)
@@ -944,12 +1248,17 @@ int zul_getVersionStr(VerIndex verType, char *v, int len)
 
         if (ok)
         {
-            msv_resp_string[0] = '\0';
-            (void)usb_ControlRequest(msgBuf, DUAL_BYTE_MSG_LEN, get_str_response);
-            if (msv_resp_string[0] != '\0')
+            uint8_t reply[USB_PACKET_LEN];
+
+            if ( (tp_devControlRequest(tp_getDefaultDevice(), msgBuf,
+                                        DUAL_BYTE_MSG_LEN, reply) > 0) &&
+                 zul_decodeVerStrReply(reply, v, len) && (v[0] != '\0') )
             {
-                strncpy (v, msv_resp_string, (size_t)len);
-                v[len-1] = '\0';    // force string termination
+                if (PROTOCOL_DEBUG)
+                {
+                    zul_logf(1, "%s:\t%s\n\t%s\n", __FUNCTION__,
+                                                v, zul_hex2String(reply, 16));
+                }
                 return SUCCESS;
             }
         }
@@ -983,6 +1292,50 @@ int zul_CpuID(char *v, int len)
     return zul_getVersionStr(STR_CPUID, v, len);
 }
 
+/**
+ * Device identity
+ */
+int zul_getIdentity(ZXY_identity *id)
+{
+    if (id == NULL) return FAILURE;
+    if (!msv_identityKnown && (zul_refreshIdentity() != SUCCESS))
+    {
+        return FAILURE;
+    }
+    *id = msv_identity;
+    return SUCCESS;
+}
+
+int zul_refreshIdentity(void)
+{
+    int16_t pid;
+
+    msv_identityKnown = false;
+    if (!tp_getDevicePID(&pid)) return FAILURE;
+
+    zul_gatherIdentity(&msv_identity);
+    msv_identityKnown = true;
+
+    // the ZXY100/110 wire counts come from the version data, now known
+    if ((pid == ZXY100_PRODUCT_ID) || (pid == ZXY110_PRODUCT_ID))
+    {
+        uint16_t x, y;
+
+        if (zul_getOldZxy100WireCnt(&x, &y) == SUCCESS)
+        {
+            msv_identity.xWires = x;
+            msv_identity.yWires = y;
+        }
+    }
+
+    zul_logf(3, "%s: PID:%04x %s HW:%s FW:%s CPU:%s %dx%d", __FUNCTION__,
+                msv_identity.pid, msv_identity.addrStr,
+                msv_identity.version[STR_HW], msv_identity.version[STR_FW],
+                msv_identity.version[STR_CPUID],
+                msv_identity.xWires, msv_identity.yWires);
+    return SUCCESS;
+}
+
 
 bool getShowNoSensor(void)
 {
@@ -1050,13 +1403,13 @@ void zul_inhibitFlashWrites(bool inhibit)
         {
             // NB: there is a logic inversion here: inhibited <=> not enabled
             zul_encodeSetFlashWrite(msgBuf, DUAL_BYTE_MSG_LEN, !msv_flashWriteDisabled);
-            retVal = usb_ControlRequest(msgBuf, DUAL_BYTE_MSG_LEN, default_CTRL_handler);
+            retVal = tp_ControlRequest(msgBuf, DUAL_BYTE_MSG_LEN, default_CTRL_handler);
             retVal = (retVal > 0) ? SUCCESS : FAILURE;
         }
         else
         {
             zul_encodeForceFlashWrite(msgBuf, SINGLE_BYTE_MSG_LEN);
-            retVal = usb_ControlRequest(msgBuf, SINGLE_BYTE_MSG_LEN, default_CTRL_handler);
+            retVal = tp_ControlRequest(msgBuf, SINGLE_BYTE_MSG_LEN, default_CTRL_handler);
             retVal = (retVal > 0) ? SUCCESS : FAILURE;
         }
     }
@@ -1064,28 +1417,256 @@ void zul_inhibitFlashWrites(bool inhibit)
 
 
 /**
- * MSGCODE_SET_SILENT_TOUCH_DATA_MODE is available on some devices
- * When enabled, the HID touch events are NOT generated, but the touch data
- * is relayed (in the same format) to USB Report ID #6.
- * This 'disables' normal touch operation on most systems, and makes the touch
- * data available to a single receiving application. One use of this is for a
- * TUIO server */
-void zul_SetPrivateTouchMode(bool enabled)
+ * Load a set of configuration values, writing only those that differ.  The
+ * writes are made in the order of the entries, as a value may depend on one
+ * written before it; an index given more than once is written at its last
+ * entry.
+ */
+int zul_loadConfigSet(int count, uint8_t const *index, uint16_t const *value,
+                                                    ConfigLoadResult *result)
 {
-    int     retVal;
-    uint8_t msgBuf[DUAL_BYTE_MSG_LEN];
+    ConfigLoadResult    res;
+    uint16_t            target[256];
+    uint16_t            current[256];
+    uint8_t             order[256];
+    int                 last[256];
+    uint8_t             wanted[ZUL_BITMAP_LEN(256)];
+    uint8_t             readOk[ZUL_BITMAP_LEN(256)];
+    uint8_t             moved[ZUL_BITMAP_LEN(256)];
+    bool                wasInhibited = msv_flashWriteDisabled;
+    int                 numOrder = 0, numMoved = 0;
+    int                 i;
 
-    // if no change - return! ToDo : error message?
-    if (msv_privateTouchMode == enabled) return;
+    memset(&res, 0, sizeof(res));
+    memset(wanted, 0, sizeof(wanted));
+    if ((count < 0) || ((count > 0) && ((index == NULL) || (value == NULL))))
+    {
+        return FAILURE;
+    }
+    res.requested = count;
 
-    msv_privateTouchMode = enabled;
+    // a later entry for the same index takes precedence, as when written
+    for (i = 0; i < count; i++)
+    {
+        target[index[i]] = value[i];
+        wanted[index[i] / 8] |= (uint8_t)(1 << (index[i] % 8));
+        last[index[i]] = i;
+    }
+    for (i = 0; i < count; i++)
+    {
+        if (last[index[i]] == i) order[numOrder++] = index[i];
+    }
 
-    bzero(msgBuf, DUAL_BYTE_MSG_LEN);
+    // read the current values, and find those to be changed
+    (void)zul_readConfigMap(wanted, current, readOk);
+    for (i = 0; i < 256; i++)
+    {
+        if (!ZUL_BITMAP_TEST(wanted, i)) continue;
+        if (ZUL_BITMAP_TEST(readOk, i) && (current[i] == target[i]))
+        {
+            res.unchanged++;
+            continue;
+        }
+        res.changed[i / 8] |= (uint8_t)(1 << (i % 8));
+    }
 
-    zul_encodePrivateTouchModeRequest( msgBuf, DUAL_BYTE_MSG_LEN, msv_privateTouchMode );
+    zul_logf(3, "%s: %d entries, %d unchanged", __FUNCTION__,
+                                                count, res.unchanged);
 
-    retVal = usb_ControlRequest(msgBuf, DUAL_BYTE_MSG_LEN, default_CTRL_handler);
-    retVal = (retVal > 0) ? SUCCESS : FAILURE;
+    for (i = 0; (i < 256) && !ZUL_BITMAP_TEST(res.changed, i); i++) ;
+    if (i < 256)
+    {
+        res.flashInhibited = wasInhibited ||
+                    zul_optionAvailable(ZXYMT_OPT_BIT_DISABLE_FLASH_WRITE);
+        if (res.flashInhibited) zul_inhibitFlashWrites(true);
+
+        res.written += zul_writeConfigOrder(numOrder, order, target,
+                                                            res.changed);
+
+        // a write may have changed a value that was already right, which
+        // must then be written again, in order
+        memset(moved, 0, sizeof(moved));
+        (void)zul_readConfigMap(wanted, current, readOk);
+        for (i = 0; i < 256; i++)
+        {
+            if (!ZUL_BITMAP_TEST(wanted, i) ||
+                ZUL_BITMAP_TEST(res.changed, i)) continue;
+            if (ZUL_BITMAP_TEST(readOk, i) && (current[i] != target[i]))
+            {
+                moved[i / 8] |= (uint8_t)(1 << (i % 8));
+                res.changed[i / 8] |= (uint8_t)(1 << (i % 8));
+                res.unchanged--;
+                numMoved++;
+            }
+        }
+        if (numMoved > 0)
+        {
+            zul_logf(2, "%s: %d values changed by other writes", __FUNCTION__,
+                                                                numMoved);
+            res.written += zul_writeConfigOrder(numOrder, order, target, moved);
+        }
+
+        // commit all the changes to flash with one write
+        if (res.flashInhibited && !wasInhibited) zul_inhibitFlashWrites(false);
+
+        // verify
+        (void)zul_readConfigMap(res.changed, current, readOk);
+        for (i = 0; i < 256; i++)
+        {
+            if (!ZUL_BITMAP_TEST(res.changed, i)) continue;
+            if (!ZUL_BITMAP_TEST(readOk, i) || (current[i] != target[i]))
+            {
+                res.failures[i / 8] |= (uint8_t)(1 << (i % 8));
+                res.failed++;
+                zul_logf(1, "%s: config %03d not verified", __FUNCTION__, i);
+            }
+        }
+    }
+
+    if (result != NULL) *result = res;
+    return (res.failed == 0) ? SUCCESS : FAILURE;
+}
+
+/**
+ * Deferred config writes
+ */
+int zul_setConfigDeferred(uint8_t ID, uint16_t value)
+{
+    if (msv_shadow == NULL) return FAILURE;
+    shadow_markDirty(msv_shadow, ID, value);
+    return SUCCESS;
+}
+
+int zul_flushConfig(ConfigLoadResult *result)
+{
+    ConfigLoadResult    res;
+    uint8_t             index[256];
+    uint16_t            value[256];
+    int                 count, retVal;
+    int                 i;
+
+    memset(&res, 0, sizeof(res));
+    count = shadow_getDirty(msv_shadow, index, value, 256);
+    if (count == 0)
+    {
+        if (result != NULL) *result = res;
+        return SUCCESS;
+    }
+
+    retVal = zul_loadConfigSet(count, index, value, &res);
+
+    // entries written were cleaned by zul_setConfigParamByID(), this cleans
+    // those found to be already at the value; failures remain dirty
+    for (i = 0; i < count; i++)
+    {
+        if (!ZUL_BITMAP_TEST(res.failures, index[i]))
+        {
+            shadow_clearDirty(msv_shadow, index[i], value[i]);
+        }
+        else
+        {
+            shadow_markDirty(msv_shadow, index[i], value[i]);
+        }
+    }
+
+    zul_logf(3, "%s: %d deferred, %d written, %d failed", __FUNCTION__,
+                                            count, res.written, res.failed);
+    if (result != NULL) *result = res;
+    return retVal;
+}
+
+/**
+ * Write the config values of the indices in order[] that are flagged in
+ * the which bitmap, in that order.  Return the number written.
+ */
+static int zul_writeConfigOrder(int num, uint8_t const *order,
+                                uint16_t const *target, uint8_t const *which)
+{
+    int written = 0;
+    int i;
+
+    for (i = 0; i < num; i++)
+    {
+        if (!ZUL_BITMAP_TEST(which, order[i])) continue;
+        if (zul_setConfigParamByID(order[i], target[order[i]]) == SUCCESS)
+        {
+            written++;
+        }
+    }
+    return written;
+}
+
+/**
+ * Read the config values flagged in the wanted bitmap, by index, one bulk
+ * read per run of consecutive indices.  Return the number read.
+ */
+static int zul_readConfigMap(uint8_t const *wanted, uint16_t *values,
+                                                            uint8_t *okMap)
+{
+    uint8_t runOk[ZUL_BITMAP_LEN(256)];
+    int     first = 0, numRead = 0;
+    int     i;
+
+    memset(okMap, 0, ZUL_BITMAP_LEN(256));
+
+    while (first < 256)
+    {
+        int len = 0;
+
+        if (!ZUL_BITMAP_TEST(wanted, first))
+        {
+            first++;
+            continue;
+        }
+        while ((first + len < 256) && ZUL_BITMAP_TEST(wanted, first + len))
+        {
+            len++;
+        }
+
+        numRead += zul_getConfigRange((uint8_t)first, len, values + first, runOk);
+        for (i = 0; i < len; i++)
+        {
+            if (ZUL_BITMAP_TEST(runOk, i))
+            {
+                okMap[(first + i) / 8] |= (uint8_t)(1 << ((first + i) % 8));
+            }
+        }
+        first += len;
+    }
+    return numRead;
+}
+
+
+/**
+ * MSGCODE_SET_SILENT_TOUCH_DATA_MODE is available on some devices
+ * When enabled, the HID touch events are NOT generated, but the touch data
+ * is relayed (in the same format) to USB Report ID #6.
+ * This 'disables' normal touch operation on most systems, and makes the touch
+ * data available to a single receiving application. One use of this is for a
+ * TUIO server */
+void zul_SetPrivateTouchMode(bool enabled)
+{
+    int     retVal;
+    uint8_t msgBuf[DUAL_BYTE_MSG_LEN];
+
+    // if no change - return! ToDo : error message?
+    if (msv_privateTouchMode == enabled) return;
+
+    msv_privateTouchMode = enabled;
+
+    // the private touches are queued by the RAW_DATA handler
+    rr_flush(msv_inRing[RAW_DATA]);
+    tp_RegisterHandler(RAW_DATA, (enabled) ? handle_privateTouches
+                                           : handle_IN_rawdata_mt);
+
+    bzero(msgBuf, DUAL_BYTE_MSG_LEN);
+
+    zul_encodePrivateTouchModeRequest( msgBuf, DUAL_BYTE_MSG_LEN, msv_privateTouchMode );
+
+    retVal = tp_ControlRequest(msgBuf, DUAL_BYTE_MSG_LEN, default_CTRL_handler);
+    retVal = (retVal > 0) ? SUCCESS : FAILURE;
+    // the touch mode is held in the config values
+    zul_invalidateShadow();
 }
 
 
@@ -1103,7 +1684,9 @@ void zul_sendMessageCode (uint8_t msgCode)
 
     if (ok)
     {
-        (void)usb_ControlRequest(msgBuf, SINGLE_BYTE_MSG_LEN, default_CTRL_handler);
+        (void)tp_ControlRequest(msgBuf, SINGLE_BYTE_MSG_LEN, default_CTRL_handler);
+        // the message may restore the defaults, or reset the controller
+        zul_invalidateShadow();
     }
 }
 
@@ -1122,8 +1705,9 @@ void zul_restoreDefaults (void)
     if (ok)
     {
         zul_setCommsEndurance(COM_ENDUR_HIGH);
-        (void)usb_ControlRequest(msgBuf, SINGLE_BYTE_MSG_LEN, default_CTRL_handler);
-        usb_defaultCtrlDelay();
+        (void)tp_ControlRequest(msgBuf, SINGLE_BYTE_MSG_LEN, default_CTRL_handler);
+        tp_defaultCtrlDelay();
+        zul_invalidateShadow();
     }
 }
 
@@ -1142,7 +1726,8 @@ void zul_resetController (void)
 
     if (ok)
     {
-        (void)usb_ControlRequest(msgBuf, SINGLE_BYTE_MSG_LEN, default_CTRL_handler);
+        (void)tp_ControlRequest(msgBuf, SINGLE_BYTE_MSG_LEN, default_CTRL_handler);
+        zul_invalidateShadow();
     }
 }
 
@@ -1160,7 +1745,7 @@ void zul_forceEqualisation (void)
 
     if (ok)
     {
-        (void)usb_ControlRequest(msgBuf, SINGLE_BYTE_MSG_LEN, default_CTRL_handler);
+        (void)tp_ControlRequest(msgBuf, SINGLE_BYTE_MSG_LEN, default_CTRL_handler);
     }
 }
 
@@ -1186,7 +1771,9 @@ void zul_StartBootLoader (void)
             // a reply is not always sent, and even if it is, it is not used
             handFunc = NULL;
         }
-        (void)usb_ControlRequest(msgBuf, SINGLE_BYTE_MSG_LEN, handFunc);
+        (void)tp_ControlRequest(msgBuf, SINGLE_BYTE_MSG_LEN, handFunc);
+        zul_invalidateShadow();
+        msv_identityKnown = false;
     }
 }
 
@@ -1359,7 +1946,9 @@ void            zul_clearVirtKey                (int index)
 
         if (ok)
         {
-            (void)usb_ControlRequest(msgBuf, DUAL_BYTE_MSG_LEN, handFunc);
+            (void)tp_ControlRequest(msgBuf, DUAL_BYTE_MSG_LEN, handFunc);
+            // the key definitions are held in the config values
+            zul_invalidateShadow();
         }
     }
 }
@@ -1382,7 +1971,8 @@ void            zul_setVirtKey                  (VirtualKey *vk)
 
         if (ok)
         {
-            (void)usb_ControlRequest(msgBuf, DUAL_BYTE_MSG_LEN, handFunc);
+            (void)tp_ControlRequest(msgBuf, DUAL_BYTE_MSG_LEN, handFunc);
+            zul_invalidateShadow();
         }
     }
 }
@@ -1406,7 +1996,7 @@ void            zul_getVirtKey                  (int index, VirtualKey *vk)
 
         if (ok)
         {
-            (void)usb_ControlRequest(msgBuf, DUAL_BYTE_MSG_LEN, handFunc);
+            (void)tp_ControlRequest(msgBuf, DUAL_BYTE_MSG_LEN, handFunc);
         }
     }
 }
@@ -1417,21 +2007,23 @@ void            zul_getVirtKey                  (int index, VirtualKey *vk)
 
 
 /**
- * get touch data (from Report ID 6)
- *  Not currently used - but could be useful in future ... TBD
+ * get the oldest queued private touch report (from Report ID 6)
  */
 int zul_GetPrivateTouchData(uint8_t *buffer, int bufSize)
 {
-    int retVal = -1;
+    rr_report_t const *r;
+    int len;
 
-    if (!msv_privateTouchMode) return FAILURE;
+    if (!msv_privateTouchMode) return -1;
+    if ((buffer == NULL) || (bufSize <= 0)) return -1;
 
-    if (bufSize >= 64) msv_pvtTouchUserBuf = buffer;
-    // ToDo carp on failure wrt above
+    r = rr_borrow(msv_inRing[RAW_DATA]);
+    if (r == NULL) return 0;
 
-    // retVal = zul_InterruptCheck(handle_privateTouches);
-    msv_pvtTouchUserBuf = NULL;
-    return retVal;
+    len = (bufSize < (int)r->len) ? bufSize : (int)r->len;
+    memcpy(buffer, r->data, (size_t)len);
+    rr_release(msv_inRing[RAW_DATA]);
+    return len;
 }
 
 
@@ -1496,96 +2088,198 @@ bool zul_Get1TouchFromData (uint8_t *data, Contact *c)
     return touched;
 }
 
-// return true if a touch is available, and set the supplied contact
-bool zul_TouchAvailable(Contact *c)
+/**
+ * Touch event waits, see trk_waitEvent()
+ */
+int zul_waitTouchEvent(int timeoutMs, int mask)
 {
-    static bool touched = false;
+    if (msv_tracker == NULL) return 0;
+    return trk_waitEvent(msv_tracker, timeoutMs, mask);
+}
 
-    uint8_t *tch = zul_GetTouchData();
+int zul_getTouchEventFd(void)
+{
+    return trk_getEventFd(msv_tracker);
+}
 
-    if (tch == NULL)
+int zul_ackTouchEvents(void)
+{
+    return trk_ackEvents(msv_tracker);
+}
+
+/**
+ * TUIO publishing of the private touches, see tuio.h
+ */
+int zul_startTuioServer(char const *host, int port)
+{
+    zul_logf(3, "%s %s:%d", __FUNCTION__, (host != NULL) ? host : "-", port);
+
+    if (msv_tuio == NULL)
     {
-        // use data from from last reading - no update has been received
-        return touched;
+        msv_tuio = tuio_create(host, port);
+        if (msv_tuio == NULL) return FAILURE;
     }
+    else
+    {
+        if (tuio_setTarget(msv_tuio, host, port) != SUCCESS) return FAILURE;
+        tuio_enable(msv_tuio, true);
+    }
+    zul_SetPrivateTouchMode(true);
+    return SUCCESS;
+}
 
-    touched = zul_Get1TouchFromData (tch, c);
+void zul_stopTuioServer(void)
+{
+    if (msv_tuio == NULL) return;
+    zul_logf(3, "%s", __FUNCTION__);
+    tuio_enable(msv_tuio, false);
+    zul_SetPrivateTouchMode(false);
+}
 
-    return touched;
+void zul_serviceTuio(void)
+{
+    if (msv_tuio != NULL) (void)tuio_update(msv_tuio, msv_tracker, 0);
+}
+
+bool zul_getTuioStats(tuio_stats_t *stats, bool clear)
+{
+    if ((msv_tuio == NULL) || (stats == NULL)) return false;
+    tuio_getStats(msv_tuio, stats, clear);
+    return true;
 }
 
 /**
- * Assume that there is a touch down ...
- * Wait for a touch-up event, or a time-out
+ * Wait for a contact to go down, and set c to it.  Return false on timeout.
  */
-bool zul_GetTouchUp(int timeout_ms, Contact *c)
+bool zul_waitTouchDown(int timeoutMs, Contact *c)
 {
-    bool            timeUp = false, touchUp=false;
+    trk_snapshot_t          snap;
+    trk_contact_t const    *newest = NULL;
+    int                     i;
 
-    struct timeval  tStart, tNow, tDiff, tAllowed;
-    int             result;
+    if (zul_waitTouchEvent(timeoutMs, TRK_EV_DOWN) == 0) return false;
 
-    result = ftime(&tStart);
+    // the newest contact down
+    trk_snapshot(msv_tracker, &snap);
+    for (i = 0; i < snap.count; i++)
+    {
+        trk_contact_t const *tc = &snap.contact[i];
 
-    if (result != 0) return false;
+        if ((tc->state != TRK_DOWN) && (tc->state != TRK_MOVE)) continue;
+        if ((newest == NULL) || (tc->downUs > newest->downUs)) newest = tc;
+    }
+    if (newest == NULL) return false;   // already released
 
-    c->flags = 0x7;
+    c->flags = 3;
+    c->ID    = newest->ID;
+    c->x     = newest->x;
+    c->y     = newest->y;
+    return true;
+}
 
-    timerclear(&tAllowed);
-    tAllowed.tv_sec = timeout_ms/1000;
-    timeout_ms %= 1000;
-    tAllowed.tv_usec = timeout_ms*1000;
+/**
+ * Set the position of a released contact: c->ID if it was released, else
+ * any contact just released
+ */
+static void zul_findRelease(Contact *c)
+{
+    trk_snapshot_t  snap;
+    trk_contact_t   tc;
+    int             i;
 
-    #ifdef __APPLE__
-    zul_logf(4, "T1 %ld  %d --\n", tAllowed.tv_sec, tAllowed.tv_usec);
-    #else
-    zul_logf(4, "T1:: %03ld %06ld  --\n", tAllowed.tv_sec, tAllowed.tv_usec);
-    #endif
+    if ( trk_getContact(msv_tracker, c->ID, &tc) && (tc.histLen > 0) &&
+         ((tc.state == TRK_UP) || (tc.state == TRK_IDLE)) )
+    {
+        c->x = tc.x;
+        c->y = tc.y;
+        return;
+    }
 
-    while (!timeUp)
+    trk_snapshot(msv_tracker, &snap);
+    for (i = 0; i < snap.count; i++)
     {
-        // set contact flags, only if a new touch report is available
-        zul_TouchAvailable(c);
+        if (snap.contact[i].state == TRK_UP)
+        {
+            c->ID = snap.contact[i].ID;
+            c->x  = snap.contact[i].x;
+            c->y  = snap.contact[i].y;
+            return;
+        }
+    }
+}
 
-        result = ftime(&tNow);
-        if (result !=0) return false;
-        timersub(&tNow, &tStart, &tDiff);
+/**
+ * All the contacts of the touch reports, see tracker.h
+ */
+void zul_GetContacts(trk_snapshot_t *snap)
+{
+    trk_snapshot(msv_tracker, snap);
+}
 
-        #ifdef __APPLE__
-        zul_logf(4, "T2 %ld  %d --\n", tDiff.tv_sec, tDiff.tv_usec);
-        #else
-        zul_logf(4, "T2:: %03ld %06ld --\n", tDiff.tv_sec, tDiff.tv_usec);
-        #endif
+bool zul_GetContact(uint8_t ID, trk_contact_t *contact)
+{
+    return trk_getContact(msv_tracker, ID, contact);
+}
 
+// return true if a touch is available, and set the supplied contact
+bool zul_TouchAvailable(Contact *c)
+{
+    static bool touched = false;
 
-#ifndef S_SPLINT_S
-        timeUp = timercmp(&tDiff, &tAllowed, >);
-#endif
+    uint8_t *tch = zul_GetTouchData();
 
-        // only return on timeout or touch lift-off
+    if (tch == NULL)
+    {
+        // use data from from last reading - no update has been received
+        return touched;
+    }
 
-        // consider:        ZXY100      &     ZXY110/MT
-        //               -------------      -------------
-        touchUp =       (c->flags == 4) || (c->flags == 0);
+    touched = zul_Get1TouchFromData (tch, c);
 
-        if (touchUp)
-        {
-            /* kloodge -- works well enough for single touches
-             * which is all that is needed for calibration/clicks */
-            c->x = msv_lastTouchLocation.x;
-            c->y = msv_lastTouchLocation.y;
-            return true;
-        }
+    return touched;
+}
+
+/**
+ * Assume that there is a touch down ...
+ * Sleep until the contact c->ID (as set by zul_waitTouchDown()) is released,
+ * or a time-out.  A contact already released returns at once.  Where c->ID
+ * is not a contact that has been down, the first contact released is used.
+ * The contact is the one released, with its last position.
+ */
+bool zul_GetTouchUp(int timeout_ms, Contact *c)
+{
+    trk_contact_t   tc;
+    int16_t         pid = 0;
+
+    c->flags = 0x7;
+
+    if ( trk_getContact(msv_tracker, c->ID, &tc) && (tc.histLen > 0) )
+    {
+        zul_logf(4, "%s: contact %d, %d ms", __FUNCTION__, c->ID, timeout_ms);
+        if (!trk_waitRelease(msv_tracker, c->ID, timeout_ms, &tc)) return false;
+        c->x = tc.x;
+        c->y = tc.y;
+    }
+    else
+    {
+        if (zul_waitTouchEvent(timeout_ms, TRK_EV_UP) == 0) return false;
+        zul_findRelease(c);
     }
 
-    return false;
+    // the touch reports up to the release have been used
+    zul_FlushReports((msv_privateTouchMode) ? RAW_DATA : TOUCH_OS);
+
+    // consider:        ZXY100      &     ZXY110/MT
+    (void)tp_getDevicePID(&pid);
+    c->flags = (uint8_t)((pid == ZXY100_PRODUCT_ID) ? 4 : 0);
+    return true;
 }
 
 static struct timeb    rawInTimeMs = {0, 0, 0, 0};
 void zul_SetRawDataBuffer(void *buffer)
 {
     int16_t pid;
-    if (usb_getDevicePID(&pid))
+    if (tp_getDevicePID(&pid))
     {
         switch (pid)
         {
@@ -1606,6 +2300,160 @@ void zul_SetRawDataBuffer(void *buffer)
     }
 }
 
+/**
+ * Complete raw data frames, see rawframe.h
+ */
+int zul_startRawFrames(void)
+{
+    uint16_t    xWires = 0, yWires = 0;
+    int16_t     pid;
+
+    if ( (!tp_getDevicePID(&pid)) ||
+         (pid == ZXY100_PRODUCT_ID) || (pid == ZXY110_PRODUCT_ID) )
+    {
+        return FAILURE;
+    }
+    if ( (zul_getStatusByID(ZXYMT_SI_NUM_X_WIRES, &xWires) != SUCCESS) ||
+         (zul_getStatusByID(ZXYMT_SI_NUM_Y_WIRES, &yWires) != SUCCESS) )
+    {
+        return FAILURE;
+    }
+
+    if (msv_rawFrames == NULL)
+    {
+        msv_rawFrames = rf_create();
+        if (msv_rawFrames == NULL) return FAILURE;
+    }
+    return rf_configure(msv_rawFrames, xWires, yWires);
+}
+
+void zul_stopRawFrames(void)
+{
+    (void)rf_configure(msv_rawFrames, 0, 0);
+}
+
+int zul_waitRawFrame(uint32_t after, int timeoutMs, rf_frame_t *info,
+                        uint8_t *cells, uint8_t *missing, int cellsLen)
+{
+    if (msv_rawFrames == NULL) return 0;
+    return rf_waitFrame(msv_rawFrames, after, timeoutMs, info, cells,
+                                                        missing, cellsLen);
+}
+
+bool zul_getRawFrameStats(rf_stats_t *stats)
+{
+    if ((msv_rawFrames == NULL) || (stats == NULL)) return false;
+    rf_getStats(msv_rawFrames, stats);
+    return true;
+}
+
+/**
+ * Raw data recordings, see rawrec.h
+ */
+int zul_startRawRecording(char const *path)
+{
+    ZXY_identity    id;
+    rec_info_t      info;
+
+    if ((path == NULL) || (msv_recorder != NULL)) return FAILURE;
+    if ( (zul_startRawFrames() != SUCCESS) ||
+         (zul_getIdentity(&id) != SUCCESS) )
+    {
+        return FAILURE;
+    }
+
+    memset(&info, 0, sizeof(info));
+    info.pid    = id.pid;
+    info.xWires = id.xWires;
+    info.yWires = id.yWires;
+    memcpy(info.version, id.version, sizeof(info.version));
+
+    msv_recorder = rec_create(path, &info, 0);
+    if (msv_recorder == NULL) return FAILURE;
+    if (rec_startCapture(msv_recorder, msv_rawFrames) != SUCCESS)
+    {
+        (void)rec_close(msv_recorder);
+        msv_recorder = NULL;
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+int zul_stopRawRecording(void)
+{
+    int rc;
+
+    if (msv_recorder == NULL) return FAILURE;
+    rc = rec_close(msv_recorder);
+    msv_recorder = NULL;
+    return rc;
+}
+
+bool zul_getRawRecordingStats(rec_stats_t *stats)
+{
+    if ((msv_recorder == NULL) || (stats == NULL)) return false;
+    rec_getStats(msv_recorder, stats);
+    return true;
+}
+
+int zul_startRawReplay(char const *path, uint32_t first, double speed)
+{
+    rec_header_t h;
+
+    if ((path == NULL) || (msv_replay != NULL)) return FAILURE;
+    if ((msv_RawDataMode != 0) || (msv_privateTouchMode))
+    {
+        zul_logf(1, "%s: not in raw or private touch mode", __FUNCTION__);
+        return FAILURE;
+    }
+
+    msv_replayReader = rec_open(path);
+    if (msv_replayReader == NULL) return FAILURE;
+    rec_getInfo(msv_replayReader, &h);
+
+    if (msv_rawFrames == NULL) msv_rawFrames = rf_create();
+    if ( (msv_rawFrames == NULL) ||
+         (rf_configure(msv_rawFrames, h.xWires, h.yWires) != SUCCESS) )
+    {
+        rec_closeReader(msv_replayReader);
+        msv_replayReader = NULL;
+        return FAILURE;
+    }
+
+    // the reports take the device's path: the RAW_DATA handler, in raw mode
+    msv_xWires      = h.xWires;
+    msv_yWires      = h.yWires;
+    msv_RawDataMode = 1;
+    tp_RegisterHandler(RAW_DATA, handle_IN_rawdata_mt);
+
+    msv_replay = rec_startReplay(msv_replayReader, first, speed,
+                                                        tp_injectInReport);
+    if (msv_replay == NULL)
+    {
+        zul_stopRawReplay();
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+bool zul_rawReplayDone(void)
+{
+    return rec_replayDone(msv_replay);
+}
+
+void zul_stopRawReplay(void)
+{
+    if (msv_replayReader == NULL) return;
+
+    rec_stopReplay(msv_replay);
+    msv_replay = NULL;
+    rec_closeReader(msv_replayReader);
+    msv_replayReader = NULL;
+
+    msv_RawDataMode = 0;
+    zul_setRawDataHandler();
+}
+
 uint8_t *zul_GetSpecialRawData(void)
 {
     return msv_rawDataStatus;
@@ -1615,35 +2463,66 @@ uint8_t *zul_GetHeartBeatData(void)
 {
     /*@null@*/
     uint8_t *retVal = NULL;
-    if (msv_heartBeatData[0] == HEARTBEAT_REPORT)
-    {
-        // mark report as read. Don't re-read same report.
-        msv_heartBeatData[0] = 0xFF;
+    rr_report_t const *r = rr_borrow(msv_inRing[HEARTBEAT_REPORT]);
 
+    if (r != NULL)
+    {
+        memcpy(msv_heartBeatData, r->data, 64);
+        rr_release(msv_inRing[HEARTBEAT_REPORT]);
         retVal = msv_heartBeatData;
     }
     return retVal;
 }
 
 /**
- * Return a pointer to the raw data buffer.
- * Mark the buffer as read when supplied,
- * and if not updated return NULL
+ * Return a pointer to a copy of the oldest touch report not yet read,
+ * or NULL if there is none.
  */
 uint8_t *zul_GetTouchData(void)
 {
     uint8_t *retVal = NULL;
-    if (msv_touchData[0] != 0xFF)
-    {
-        // mark report as read. Don't re-read same report.
-        msv_touchData[0] = 0xFF;
+    UsbReportID_t id = (msv_privateTouchMode) ? RAW_DATA : TOUCH_OS;
+    rr_report_t const *r = rr_borrow(msv_inRing[id]);
 
+    if (r != NULL)
+    {
+        memcpy(msv_touchData, r->data, 64);
+        rr_release(msv_inRing[id]);
         retVal = msv_touchData;
     }
 
     return retVal;
 }
 
+/**
+ * Zero-copy access to the queued IN reports
+ */
+rr_report_t const *zul_BorrowReport(UsbReportID_t ReportID)
+{
+    if ((int)ReportID >= MAX_REPORT_ID) return NULL;
+    return rr_borrow(msv_inRing[ReportID]);
+}
+
+void zul_ReleaseReport(UsbReportID_t ReportID)
+{
+    if ((int)ReportID >= MAX_REPORT_ID) return;
+    rr_release(msv_inRing[ReportID]);
+}
+
+void zul_FlushReports(UsbReportID_t ReportID)
+{
+    if ((int)ReportID >= MAX_REPORT_ID) return;
+    rr_flush(msv_inRing[ReportID]);
+}
+
+bool zul_GetReportStats(UsbReportID_t ReportID, rr_stats_t *stats)
+{
+    if ((int)ReportID >= MAX_REPORT_ID) return false;
+    if (msv_inRing[ReportID] == NULL) return false;
+    rr_getStats(msv_inRing[ReportID], stats);
+    return true;
+}
+
 
 /**
  * set the device mode - normal or raw data
@@ -1656,7 +2535,7 @@ void zul_SetRawMode(int newMode)
 
     zul_logf(3, "%s %d", __FUNCTION__, newMode);
 
-    if (usb_getDevicePID(&pid))
+    if (tp_getDevicePID(&pid))
     {
         switch (pid)
         {
@@ -1673,8 +2552,10 @@ void zul_SetRawMode(int newMode)
 
         if (ok)
         {
-            (void)usb_ControlRequest(msgBuf, SINGLE_BYTE_MSG_LEN + 1, default_CTRL_handler);
+            (void)tp_ControlRequest(msgBuf, SINGLE_BYTE_MSG_LEN + 1, default_CTRL_handler);
             zul_logf(4, "   RawMode=%d command sent", newMode );
+            // the mode change may change config values
+            zul_invalidateShadow();
         }
     }
 }
@@ -1696,14 +2577,15 @@ void zul_SetTouchMode(int newMode)
     {
         if (newMode != 0)
         {
-            usb_RegisterHandler(RAW_DATA, handle_privateTouches);
+            tp_RegisterHandler(RAW_DATA, handle_privateTouches);
         }
         else
         {
             // revert the raw-data handler to normal
-            usb_RegisterHandler(RAW_DATA, handle_IN_rawdata_mt);
+            tp_RegisterHandler(RAW_DATA, handle_IN_rawdata_mt);
         }
-        (void)usb_ControlRequest(msgBuf, SINGLE_BYTE_MSG_LEN + 1, default_CTRL_handler);
+        (void)tp_ControlRequest(msgBuf, SINGLE_BYTE_MSG_LEN + 1, default_CTRL_handler);
+        zul_invalidateShadow();
     }
 }
 
@@ -1895,7 +2777,7 @@ int zul_testProgDataBlock(void)
     zul_encode_BL_ProgDataBlock(txBuffer, 64, msv_fwInfo.byteCount, msv_fwInfo.pinfo);
 
     if (TIMING_DEBUG) zul_log_ts(2, "Start application transfer ...");
-    (void)usb_ControlRequest(txBuffer, reqLen, handle_BL_response);
+    (void)tp_ControlRequest(txBuffer, reqLen, handle_BL_response);
 
     if (TIMING_DEBUG) zul_log_ts(2, "reply..");
     if (msv_BL_reply[0] != BL_RSP_Acknowledge)
@@ -1936,7 +2818,7 @@ int zul_transferFirmware(bool track)
         if (BL_DEBUG) printf("  FW Data: %s\t... \n",
             zul_hex2String(msv_fwInfo.content + block_start,16));
 
-        ctrlReqStatus = usb_ControlRequest((uint8_t*)(msv_fwInfo.content + block_start),
+        ctrlReqStatus = tp_ControlRequest((uint8_t*)(msv_fwInfo.content + block_start),
                                     ZY_BL_MAX_DATA, handle_BL_response);
 
 
@@ -2073,7 +2955,7 @@ bool zul_BLPingOK(void)
 
     if (ok)
     {
-        (void)usb_ControlRequest(msgBuf, 2, handle_BL_response);
+        (void)tp_ControlRequest(msgBuf, 2, handle_BL_response);
         // .. ?
         retVal = (msv_BL_reply[0] == BLPing) ? true : false;
     }
@@ -2099,7 +2981,7 @@ bool zul_BLgetVersion(char *VerStr, int len, VerIndex index)
 
     if (ok)
     {
-        (void)usb_ControlRequest(msgBuf, 2, handle_BL_response);
+        (void)tp_ControlRequest(msgBuf, 2, handle_BL_response);
 
         retVal = (msv_BL_reply[0] == BLGetVersionStr) ? true : false;
     }
@@ -2131,7 +3013,7 @@ bool zul_BL_RebootToApp (void)
     if (!ok) return false;
 
     // a reply is not always sent, and even if it is, it is not used
-    retVal = usb_ControlRequest(msgBuf, 2, NULL); // not handle_BL_response!
+    retVal = tp_ControlRequest(msgBuf, 2, NULL); // not handle_BL_response!
 
     return retVal > 0;
 }
@@ -2150,7 +3032,7 @@ bool zul_BL_RebootToBL (void)
     if (!ok) return false;
 
     // a reply is not always sent, and even if it is, it is not used
-    retVal = usb_ControlRequest(msgBuf, 2, NULL);  // not handle_BL_response!
+    retVal = tp_ControlRequest(msgBuf, 2, NULL);  // not handle_BL_response!
 
     return retVal > 0;
 }
@@ -2192,13 +3074,13 @@ void zul_SetupStandardInHandlers  (void)
     zul_logf(3, "%s", __FUNCTION__);
     for (i = 0; i < MAX_REPORT_ID; i++)
     {
-        usb_RegisterHandler( i, NULL );
+        tp_RegisterHandler( i, NULL );
     }
 
     // as of 2017, IN data is only expected on the following ReportIDs
-    usb_RegisterHandler( TOUCH_OS,          handle_IN_touchdata );
-    usb_RegisterHandler( RAW_DATA,          handle_IN_rawdata_mt );
-    usb_RegisterHandler( HEARTBEAT_REPORT,  handle_IN_heartbeat );
+    tp_RegisterHandler( TOUCH_OS,          handle_IN_touchdata );
+    tp_RegisterHandler( RAW_DATA,          handle_IN_rawdata_mt );
+    tp_RegisterHandler( HEARTBEAT_REPORT,  handle_IN_heartbeat );
 }
 
 void zul_ResetDefaultInHandlers(void)
@@ -2206,7 +3088,7 @@ void zul_ResetDefaultInHandlers(void)
     // To explain: this is a debug service. Nothing else happens.
     // Users can be informed of the data arriving, see default_IN_handler()
     zul_logf(3, "%s", __FUNCTION__);
-    usb_ResetDefaultInHandlers();
+    tp_ResetDefaultInHandlers();
 }
 
 /**
@@ -2216,7 +3098,7 @@ void zul_SetSpecialHandler ( UsbReportID_t ReportID, interrupt_handler_t handler
 {
     if (ReportID != RAW_DATA) return;
     zul_logf(3, "Special IN Handler ReportID:%d", ReportID);
-    usb_RegisterHandler( ReportID, handler );
+    tp_RegisterHandler( ReportID, handler );
 }
 
 
@@ -2225,14 +3107,17 @@ void zul_SetSpecialHandler ( UsbReportID_t ReportID, interrupt_handler_t handler
  */
 void handle_privateTouches(uint8_t *data)
 {
-    uint8_t * destination = msv_privateTouches;
+    uint64_t rxUs = zul_monotonicUs();
 
-    if (msv_pvtTouchUserBuf != NULL)
+    if (*data != RAW_DATA) return;
+
+    zul_log_hex(3 - TOUCH_DEBUG, "PVT Raw Touch: ", data, 16);
+    if (!rr_push(msv_inRing[RAW_DATA], data, 64))
     {
-        destination = msv_pvtTouchUserBuf;
+        zul_log(4, "PVT touch dropped");
     }
-    memcpy(destination, data, 64);
-    zul_log_hex(3 - TOUCH_DEBUG, "PVT Raw Touch: ", destination, 16);
+    (void)trk_update(msv_tracker, data, 64);
+    if (msv_tuio != NULL) (void)tuio_update(msv_tuio, msv_tracker, rxUs);
 }
 
 // static struct timeb    rawInTimeMs = {0, 0, 0, 0};
@@ -2262,10 +3147,6 @@ long  zul_getRawInAgeMS(void)
  */
 void handle_IN_rawdata_mt(uint8_t *data)
 {
-    uint8_t *p;
-    uint8_t colIndex, rowIndex, numCells;
-    uint8_t i;
-
     zul_log_ts(4, "RAW_MT_IN" );
 
     if (PROTOCOL_DEBUG)
@@ -2281,35 +3162,18 @@ void handle_IN_rawdata_mt(uint8_t *data)
     // if not in raw mode return!   ToDo: error message?
     if (msv_RawDataMode == 0) return;
 
+    if (msv_rawFrames != NULL) (void)rf_feed(msv_rawFrames, data, 64);
+
     // validate the buffer has been set by the application
     if (msv_image == 0) return;
 
     (void)ftime(&rawInTimeMs);
 
-    p = data + 1;
-    colIndex = *p++;
-    rowIndex = *p++;
-    numCells = *p++;
-
-    // there are invalid FF values for row and col coming from the controller!
-    if ((colIndex >= msv_xWires) && (rowIndex >= msv_yWires))
+    // see rawdecode.h
+    if (rdec_decodeMT(data, (uint8_t *)msv_image, msv_xWires, msv_yWires) < 0)
     {
         memcpy(msv_rawDataStatus, data, 64);
-        return;
     }
-
-    for (i=0; i<numCells; i++)
-    {
-        * (uint8_t*) (msv_image + (msv_yWires*colIndex+rowIndex)) = *p++;
-        rowIndex++;
-        if (rowIndex == msv_yWires)
-        {
-            rowIndex = 0; colIndex ++;
-            if (colIndex == msv_xWires) return;
-        }
-    }
-
-    return;
 }
 
 
@@ -2327,7 +3191,7 @@ void handle_IN_heartbeat(uint8_t *data)
 
     if (*data == HEARTBEAT_REPORT)
     {
-        memcpy(msv_heartBeatData, data, 64);
+        (void)rr_push(msv_inRing[HEARTBEAT_REPORT], data, 64);
         return;
     }
 
@@ -2353,7 +3217,7 @@ int default_CTRL_handler(uint8_t *data)
 
 /**
  * general Bootloader message reply handler, this is called from within the
- * 'usb_ControlRequest()' service normally.
+ * 'tp_ControlRequest()' service normally.
  */
 int handle_BL_response(uint8_t *data)
 {
@@ -2413,66 +3277,323 @@ int handle_BL_response(uint8_t *data)
 }
 
 /**
- * get reply message handler -
- * store answer in a module-global
- * ToDo - check the CRC before making the value available !!
+ * Make a request expecting a 16 bit value in reply, and decode the value
+ * into the caller's storage.  The reply is the caller's own, so requests
+ * may be made from several threads.
  */
-int get_response(uint8_t *data)
+static int zul_requestValue(uint8_t *msgBuf, int len, char const *tag,
+                                                int index, uint16_t *value)
 {
-    uint16_t val = (uint16_t)data[5];
-    val += (uint16_t)data[6]*0x100;
+    uint8_t reply[USB_PACKET_LEN];
+    int     retVal;
 
-    msv_getConfigParam = val;
+    retVal = tp_devControlRequest(tp_getDefaultDevice(), msgBuf,
+                                                    (uint16_t)len, reply);
+    if ((retVal <= 0) || !zul_decodeValueReply(reply, value))
+    {
+        return FAILURE;
+    }
 
     if (PROTOCOL_DEBUG)
     {
-        zul_logf(1, "%s: %s\n", __FUNCTION__, zul_hex2String(data, 16));
-        zul_logf(1, "     Get CI %03d: %d (0x%04x)\n", (int)msv_xfrIndex, (int)val, (uint)val );
+        zul_logf(1, "%s: %s\n", __FUNCTION__, zul_hex2String(reply, 16));
+        zul_logf(1, "   Get %s %03d: %d (0x%04x)\n", tag, index,
+                                                (int)*value, (uint)*value );
     }
-    return SUCCESS;   // OK
+    return SUCCESS;
 }
 
 /**
- * get reply message handler
- * store answer in a module-global
- * ToDo - check the CRC before making the value available !!
+ * Read a config ('C'), status ('S') or SPI register ('R') value from the
+ * device, without reference to the shadow, which is refreshed.
  */
-int status_response(uint8_t *data)
+static int zul_readValue(char kind, uint8_t device, uint8_t idx,
+                                                            uint16_t *value)
 {
-    uint16_t val = (uint16_t)data[5];
-    val += (uint16_t)data[6]*0x100;
+    uint8_t msgBuf[DUAL_BYTE_MSG_LEN];
+    bool    ok = false;
+    int     retVal;
 
-    msv_getStatusVal = val;
+    bzero(msgBuf, DUAL_BYTE_MSG_LEN);
+    switch (kind)
+    {
+        case 'C':
+            ok = zul_encodeGetRequest(msgBuf, DUAL_BYTE_MSG_LEN, idx);
+            break;
+        case 'S':
+            ok = zul_encodeGetStatus(msgBuf, DUAL_BYTE_MSG_LEN, idx);
+            break;
+        case 'R':
+            ok = zul_encodeGetSpiRegister(msgBuf, DUAL_BYTE_MSG_LEN, device, idx);
+            break;
+    }
+    if (!ok) return FAILURE;
 
-    if (PROTOCOL_DEBUG)  // zul_hex2String
+    retVal = zul_requestValue(msgBuf, DUAL_BYTE_MSG_LEN,
+                    (kind == 'C') ? "CI" : (kind == 'S') ? "SV" : "SPI",
+                    idx, value);
+    if ((retVal == SUCCESS) && (kind != 'R'))
     {
-        zul_logf(1, "%s: %s\n", __FUNCTION__, zul_hex2String(data, 16));
-        zul_logf(1, "   Get SV %03d: %d (0x%04x)\n", (int)msv_xfrIndex, (int)val, (uint)val );
+        shadow_put(msv_shadow, (kind == 'C') ? SHADOW_CONFIG : SHADOW_STATUS,
+                                                                idx, *value);
     }
-    return SUCCESS;
+    return retVal;
 }
 
 /**
- * get reply message handler
- * store answer in a module-global
- * ToDo - check the CRC before making the value available !!
+ * Read a range of config ('C'), status ('S') or SPI register ('R') values.
+ * Up to RANGE_IN_FLIGHT requests are kept queued, so the I/O thread moves
+ * from one to the next without waiting for this thread.  Any that fail are
+ * retried once, individually, at the end.
  */
-int get_str_response(uint8_t *data)
+#define RANGE_IN_FLIGHT             (16)
+
+static int zul_getRange(char kind, uint8_t device, uint8_t first, int count,
+                                            uint16_t *values, uint8_t *okMap)
 {
-    if (data[0] != 0x02) return FAILURE;
-    if (data[1] != 0x3e) return FAILURE;
-    if (data[2] != 0x6a) return FAILURE;
-    if (data[3] != 0x4f) return FAILURE;
+    tp_request_t    req[RANGE_IN_FLIGHT];
+    uint8_t         msgBuf[DUAL_BYTE_MSG_LEN];
+    tp_device_t    *dev = tp_getDefaultDevice();
+    int             next = 0, done = 0, numRead = 0;
+    int             i;
+
+    if ((values == NULL) || (okMap == NULL)) return -1;
+    if ((count < 0) || ((int)first + count > 256)) return -1;
 
-    strcpy( msv_resp_string, (char*)data + 5 );
+    memset(okMap, 0, (size_t)ZUL_BITMAP_LEN(count));
+    if (dev == NULL) return 0;
 
-    if (PROTOCOL_DEBUG)  // zul_hex2String
+    while (done < count)
     {
-        zul_logf(1, "%s:\t%s\n\t%s\n", __FUNCTION__,
-                msv_resp_string, zul_hex2String(data, 16));
+        // keep the queue full
+        while ((next < count) && (next - done < RANGE_IN_FLIGHT))
+        {
+            tp_request_t   *r   = &req[next % RANGE_IN_FLIGHT];
+            uint8_t         idx = (uint8_t)(first + next);
+            bool            ok  = false;
+
+            bzero(msgBuf, DUAL_BYTE_MSG_LEN);
+            switch (kind)
+            {
+                case 'C':
+                    ok = zul_encodeGetRequest(msgBuf, DUAL_BYTE_MSG_LEN, idx);
+                    break;
+                case 'S':
+                    ok = zul_encodeGetStatus(msgBuf, DUAL_BYTE_MSG_LEN, idx);
+                    break;
+                case 'R':
+                    ok = zul_encodeGetSpiRegister(msgBuf, DUAL_BYTE_MSG_LEN,
+                                                                device, idx);
+                    break;
+            }
+
+            // a request that is not queued has no result, and fails below
+            if (ok && tp_prepareRequest(r, dev, msgBuf, DUAL_BYTE_MSG_LEN, 1))
+            {
+                (void)tp_submitRequest(r);
+            }
+            else
+            {
+                memset(r, 0, sizeof(tp_request_t));
+            }
+            next++;
+        }
+
+        // collect the oldest
+        {
+            tp_request_t *r = &req[done % RANGE_IN_FLIGHT];
+
+            if ( (tp_waitRequest(r) > 0) &&
+                 zul_decodeValueReply(r->reply, &values[done]) )
+            {
+                okMap[done / 8] |= (uint8_t)(1 << (done % 8));
+                numRead++;
+                if (kind != 'R')
+                {
+                    shadow_put(msv_shadow,
+                               (kind == 'C') ? SHADOW_CONFIG : SHADOW_STATUS,
+                               (uint8_t)(first + done), values[done]);
+                }
+            }
+        }
+        done++;
     }
 
-    return SUCCESS;
+    // a second chance for any that failed
+    for (i = 0; i < count; i++)
+    {
+        uint8_t idx = (uint8_t)(first + i);
+        int     res = FAILURE;
+
+        if (ZUL_BITMAP_TEST(okMap, i)) continue;
+
+        res = zul_readValue(kind, device, idx, &values[i]);
+        if (res == SUCCESS)
+        {
+            okMap[i / 8] |= (uint8_t)(1 << (i % 8));
+            numRead++;
+        }
+    }
+
+    zul_logf(3, "%s %c %d..%d: %d read", __FUNCTION__, kind,
+                                        (int)first, (int)first + count - 1, numRead);
+    return numRead;
+}
+
+/**
+ * Gather the identity of the open device.  The version strings and the
+ * status values are requested together, all queued at once, then collected.
+ * The ZXY100 version protocol (services_sc.c) is not queued.
+ */
+#define ID_MAX_REQUESTS             (16)
+
+static void zul_gatherIdentity(ZXY_identity *id)
+{
+    tp_request_t    req[ID_MAX_REQUESTS];
+    char            tag[ID_MAX_REQUESTS];       // 'V'ersion or 'S'tatus
+    uint8_t         item[ID_MAX_REQUESTS];      // VerIndex, or status index
+    uint8_t         msgBuf[DUAL_BYTE_MSG_LEN];
+    tp_device_t    *dev = tp_getDefaultDevice();
+    uint16_t        cpuID[6];
+    uint8_t         cpuBase, optIndex;
+    bool            cpuOk = true, isMT = false;
+    int             num = 0;
+    int             i;
+
+    memset(id, 0, sizeof(ZXY_identity));
+    (void)tp_getDevicePID(&id->pid);
+    (void)tp_getAddrStr(id->addrStr);
+    id->iface = msv_iface;
+
+    if (usb_isBLDevicePID(id->pid)) return;
+
+    switch (id->pid)
+    {
+        case ZXY100_PRODUCT_ID:
+            cpuBase  = 0;                       // by the version protocol
+            optIndex = ZXY100_SI_OPTION_BITS;
+            break;
+        case ZXY110_PRODUCT_ID:
+            cpuBase  = ZXY110_SI_PROCESSOR_ID_0;
+            optIndex = ZXY110_SI_OPTION_BITS;
+            break;
+        default:
+            cpuBase  = ZXYMT_SI_PROCESSOR_ID_BASE;
+            optIndex = ZXYMT_SI_OPTION_BITS;
+            isMT     = true;
+            break;
+    }
+
+    // the request list
+    if (id->pid != ZXY100_PRODUCT_ID)
+    {
+        VerIndex v;
+
+        for (v = STR_BL; v <= STR_AFC; v++)
+        {
+            tag[num] = 'V'; item[num++] = (uint8_t)v;
+        }
+        for (i = 0; i < 6; i++)
+        {
+            tag[num] = 'S'; item[num++] = (uint8_t)(cpuBase + i);
+        }
+    }
+    tag[num] = 'S'; item[num++] = optIndex;
+    if (isMT)
+    {
+        tag[num] = 'S'; item[num++] = ZXYMT_SI_NUM_X_WIRES;
+        tag[num] = 'S'; item[num++] = ZXYMT_SI_NUM_Y_WIRES;
+    }
+
+    // queue them all
+    for (i = 0; i < num; i++)
+    {
+        bool ok;
+
+        bzero(msgBuf, DUAL_BYTE_MSG_LEN);
+        if (tag[i] == 'V')
+            ok = zul_encodeVerStrRequest(msgBuf, DUAL_BYTE_MSG_LEN, (VerIndex)item[i]);
+        else
+            ok = zul_encodeGetStatus(msgBuf, DUAL_BYTE_MSG_LEN, item[i]);
+
+        if ( ok && (dev != NULL) &&
+             tp_prepareRequest(&req[i], dev, msgBuf, DUAL_BYTE_MSG_LEN, 1) )
+        {
+            (void)tp_submitRequest(&req[i]);
+        }
+        else
+        {
+            memset(&req[i], 0, sizeof(tp_request_t));
+        }
+    }
+
+    // collect them
+    for (i = 0; i < num; i++)
+    {
+        uint16_t    value = 0;
+        bool        ok    = (tp_waitRequest(&req[i]) > 0);
+
+        if (tag[i] == 'V')
+        {
+            char *v = id->version[item[i]];
+
+            if (!ok || !zul_decodeVerStrReply(req[i].reply, v, ZUL_VERSTR_LEN))
+            {
+                v[0] = '\0';
+            }
+            continue;
+        }
+
+        ok = ok && zul_decodeValueReply(req[i].reply, &value);
+        if (ok) shadow_put(msv_shadow, SHADOW_STATUS, item[i], value);
+
+        if ((item[i] >= cpuBase) && (item[i] < cpuBase + 6) && (cpuBase != 0))
+        {
+            cpuID[item[i] - cpuBase] = value;
+            cpuOk = cpuOk && ok;
+        }
+        else if (item[i] == optIndex)
+        {
+            id->optionBits      = value;
+            id->optionBitsKnown = ok;
+        }
+        else if (item[i] == ZXYMT_SI_NUM_X_WIRES)
+        {
+            id->xWires = ok ? value : 0;
+        }
+        else if (item[i] == ZXYMT_SI_NUM_Y_WIRES)
+        {
+            id->yWires = ok ? value : 0;
+        }
+    }
+
+    // the CPU ID string, as zul_readVersionStr()
+    if ((cpuBase != 0) && cpuOk)
+    {
+        for (i = 0; i < 6; i++)
+        {
+            zul_byteSwap(&cpuID[i]);
+            sprintf(id->version[STR_CPUID] + (i * 4), "%04X", cpuID[i]);
+        }
+    }
+
+    // anything the burst did not supply, one by one
+    for (i = STR_BL; i <= STR_CPUID; i++)
+    {
+        if (id->version[i][0] != '\0') continue;
+        if (zul_readVersionStr((VerIndex)i, id->version[i], ZUL_VERSTR_LEN) != SUCCESS)
+        {
+            id->version[i][0] = '\0';
+        }
+    }
+
+    // the SPI devices of a ZXY500 are given by the hardware version
+    if (strstr(id->version[STR_HW], "ZXY500") != NULL)
+    {
+        id->numSpiDevs = 1;
+        if (strstr(id->version[STR_HW], "-128-") != NULL) id->numSpiDevs = 2;
+        if (strstr(id->version[STR_HW], "-256-") != NULL) id->numSpiDevs = 4;
+    }
 }
 
 
@@ -2483,18 +3604,16 @@ int get_str_response(uint8_t *data)
  */
 void handle_IN_touchdata(uint8_t *data)
 {
-    Contact tempC;
     uint8_t expectedCollection = (uint8_t) ( (msv_privateTouchMode) ? RAW_DATA : TOUCH_OS );
 
     zul_log_ts(3, "DEF_TCH_IN" );
     if (*data != expectedCollection) return;
 
-    memcpy(msv_touchData, data, 64);
-
-    if (zul_Get1TouchFromData (data, &tempC))
+    if (!rr_push(msv_inRing[expectedCollection], data, 64))
     {
-        msv_lastTouchLocation = tempC;
+        zul_log(4, "Touch report dropped");
     }
+    (void)trk_update(msv_tracker, data, 64);
 
     return ;
 }
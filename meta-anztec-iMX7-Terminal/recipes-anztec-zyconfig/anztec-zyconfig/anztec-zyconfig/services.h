@@ -55,6 +55,13 @@ extern "C" {
 #include "zxy100.h"
 #include "zxy110.h"
 #include "zxymt.h"
+#include "reportring.h"
+#include "shadow.h"
+#include "sampler.h"
+#include "tracker.h"
+#include "tuio.h"
+#include "rawframe.h"
+#include "rawrec.h"
 
 #define BL_RESET_DELAY_MS       (4000)
 
@@ -98,6 +105,14 @@ typedef struct ZXY_sensorSize_t
 
 // === Services ===============================================================
 
+/**
+ * Select the device transport ("libusb", "hidraw", "hidapi" or "mock") by
+ * name, before zul_InitServices().  Without a selection, the ZUL_TRANSPORT
+ * environment variable, or else the first available transport, is used.
+ * Return SUCCESS or FAILURE
+ */
+int             zul_selectTransport             (char const *name);
+
 /**
  * Reset all internal state, ready for first use
  */
@@ -156,12 +171,33 @@ char const *    zul_getZYFFilter                (void);
  */
 int             zul_getDeviceList               (char *buf, int len);
 
+/**
+ * Force the next device list/open to re-read the USB bus, rather than using
+ * the enumeration cached since the last hotplug event.
+ * Return the number of Zytronic devices, or a negative error code.
+ */
+int             zul_rescanDevices               (void);
+
 
 /**
  * if the list contains a particular PID, then return the index
  */
 int             zul_selectPIDFromList           (int16_t pid, char * list);
 
+/**
+ * Wait up to timeoutMs for a device of the given PID (0 => any) to attach,
+ * returning SUCCESS as soon as it does, and copying its USB address string
+ * to addrStr if not NULL.  Else return FAILURE.
+ */
+int             zul_waitForDevice               (int16_t pid, int timeoutMs,
+                                                            char *addrStr);
+
+/**
+ * Wait up to timeoutMs for the device at the USB address to detach
+ * Return SUCCESS as soon as it does, else FAILURE.
+ */
+int             zul_waitForDeviceLeft           (char const *addrStr, int timeoutMs);
+
 
 /**
  * if the args list contains a "deviceKey=" option, remove it and return the key
@@ -223,6 +259,9 @@ int             zul_closeDevice                 (void);
 
 // -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -
 //  Control the "robustness" of the communications
+//  At COM_ENDUR_NORM the reply polling of each request is tuned to the
+//  measured turnaround of the controller (see usb_getCtrlLatency()); the
+//  higher levels set a minimum for operations known to be slow.
 // -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -
 
 typedef enum    commsEnduranceCode
@@ -242,6 +281,69 @@ int             zul_getStatusByID               (uint8_t ID, uint16_t *status);
 int             zul_getSpiRegister              (uint8_t device, uint8_t reg, uint16_t *value);
 int             zul_getConfigParamByID          (uint8_t ID, uint16_t *config);
 int             zul_setConfigParamByID          (uint8_t ID, uint16_t config);
+
+/**
+ * The get and set accessors above keep a copy (a shadow, see shadow.h) of
+ * the values of the open device.  Config values, and the status values that
+ * describe the controller, are then answered from the shadow rather than by
+ * a request, for up to SHADOW_CONFIG_TTL_MS in the case of config values.  The bulk reads below always make the requests, and refresh
+ * the shadow.
+ *
+ * zul_setShadowPolicy() sets how long the values of an index are kept, see
+ * shadow_setPolicy() -- SHADOW_TTL_FOREVER suits a device held exclusively --
+ * and zul_invalidateShadow() forgets all values, should the device be changed
+ * by other means.
+ */
+void            zul_invalidateShadow            (void);
+void            zul_setShadowPolicy             (ShadowKind kind, uint8_t ID,
+                                                    int32_t ttlMs);
+bool            zul_getShadowStats              (shadow_stats_t *stats);
+
+/**
+ * Sample a set of status values in the background, see sampler.h, and query
+ * the samples without waiting for the device.  One set is sampled at a time;
+ * a new start replaces it.  Sampling stops when the device is closed.
+ * Return SUCCESS or FAILURE
+ */
+int             zul_startStatusSampler          (uint8_t const *indices, int num,
+                                                    int periodMs, int depth);
+void            zul_stopStatusSampler           (void);
+int             zul_getStatusSummary            (uint8_t ID, uint32_t windowMs,
+                                                    smp_summary_t *summary);
+int             zul_getStatusSamples            (uint8_t ID, smp_sample_t *samples,
+                                                    int max);
+
+/**
+ * Bulk reads of the 'count' values from index 'first' (first + count must
+ * not exceed 256) into values[0..count-1].  The requests are queued back to
+ * back, several in flight at once, rather than made one at a time.  Bit i
+ * of okMap, of ZUL_BITMAP_LEN(count) bytes, is set if values[i] was read.
+ * Return the number of values read, or -1 on a parameter error.
+ */
+#define ZUL_BITMAP_LEN(n)           (((n) + 7) / 8)
+#define ZUL_BITMAP_TEST(map, i)     (((map)[(i) / 8] >> ((i) % 8)) & 1)
+
+int             zul_getConfigRange              (uint8_t first, int count,
+                                                    uint16_t *values,
+                                                    uint8_t *okMap);
+int             zul_getStatusRange              (uint8_t first, int count,
+                                                    uint16_t *values,
+                                                    uint8_t *okMap);
+int             zul_getSpiRegisterRange         (uint8_t device, uint8_t first,
+                                                    int count, uint16_t *values,
+                                                    uint8_t *okMap);
+
+/**
+ * Queue a get request without waiting for it, see tp_submitRequest().  The
+ * request storage is the caller's; the reply is decoded, once the request
+ * is complete (tp_waitRequest(), or a callback set in req->done before the
+ * call), by zul_decodeValueReply(req->reply, &value).
+ * Return SUCCESS or FAILURE
+ */
+struct tp_request;
+int             zul_submitGetConfigParam        (uint8_t ID, struct tp_request *req);
+int             zul_submitGetStatus             (uint8_t ID, struct tp_request *req);
+
 // test the setting of an option bit
 bool            zul_optionAvailable             (uint16_t optionBit);
 
@@ -255,6 +357,31 @@ int             zul_Hardware                    (char *v, int len);
 int             zul_Customization               (char *v, int len);
 int             zul_CpuID                       (char *v, int len);
 
+/**
+ * The identity of the open device, gathered with one burst of queued
+ * requests when the device is opened.  The version accessors above are
+ * then answered from memory.  zul_refreshIdentity() gathers it again, and
+ * zul_getIdentity() gathers it if it is not yet known.
+ * Return SUCCESS or FAILURE (no device open)
+ */
+#define ZUL_VERSTR_LEN              (64)
+
+typedef struct ZXY_identity_t
+{
+    int16_t         pid;
+    uint8_t         iface;                      // see zul_useKernelIFace()
+    char            addrStr[20];
+    char            version[STR_CPUID + 1][ZUL_VERSTR_LEN];     // by VerIndex,
+                                                                // "" if unknown
+    uint16_t        xWires, yWires;
+    uint16_t        optionBits;
+    bool            optionBitsKnown;
+    int             numSpiDevs;                 // ZXY500 sensor SPI devices
+} ZXY_identity;
+
+int             zul_getIdentity                 (ZXY_identity *id);
+int             zul_refreshIdentity             (void);
+
 /*
  * The ZXY500 Failsafe mode has a number of different reason codes but the No sensor
  * reason code is dealt with differently by the ZyConfig Tool displaying a message
@@ -276,6 +403,46 @@ void            setShowNoSensor                (bool b);
  */
 void            zul_inhibitFlashWrites          (bool inhibit);
 
+/**
+ * Load a set of configuration values (e.g. the CONFIG lines of a ZYS file).
+ * The current values are bulk read, and only those that differ are written.
+ * The writes are made in the order of the entries (file order), as the value
+ * of one parameter may depend on another written before it; an index given
+ * more than once is written once, at its last entry, with its last value.
+ * The values are then read again, and any already right before the writes,
+ * but changed by them, are written again, in the same order.
+ * If the controller supports ZXYMT_OPT_BIT_DISABLE_FLASH_WRITE, the writes
+ * are made with flash writing inhibited, followed by one forced flash write.
+ * The values written are then read back to verify them.
+ * Return SUCCESS if every value is verified, else FAILURE; the detail is in
+ * the result, which may be NULL.
+ */
+typedef struct ConfigLoadResult_t
+{
+    int             requested;          // entries supplied
+    int             unchanged;          // already at the required value
+    int             written;            // values written
+    int             failed;             // not written, or failed verification
+    bool            flashInhibited;     // writes bracketed by a flash inhibit
+    uint8_t         changed[ZUL_BITMAP_LEN(256)];   // by config index
+    uint8_t         failures[ZUL_BITMAP_LEN(256)];
+} ConfigLoadResult;
+
+int             zul_loadConfigSet               (int count, uint8_t const *index,
+                                                    uint16_t const *value,
+                                                    /*@null@*/
+                                                    ConfigLoadResult *result);
+
+/**
+ * Record a config value, to be written with any others by zul_flushConfig(),
+ * as one zul_loadConfigSet().  Until then zul_getConfigParamByID() answers
+ * with the deferred value.  Deferred values not flushed are lost when the
+ * device is closed.
+ */
+int             zul_setConfigDeferred           (uint8_t ID, uint16_t config);
+int             zul_flushConfig                 (/*@null@*/
+                                                    ConfigLoadResult *result);
+
 /**
  * General service to send a single byte message holding only the message-code.
  */
@@ -370,15 +537,23 @@ void            zul_SetSpecialHandler           (UsbReportID_t ReportID,
 
 /**
  * Some basic routines to access touch event packets
- *   latest info only available, if not serviced often enough,
- *   packets may be missed.
+ *   reports are queued as they arrive, and returned oldest first; if not
+ *   serviced often enough the queue fills and packets are dropped, see
+ *   zul_GetReportStats().
  */
 /*@null@*/
 uint8_t *       zul_GetTouchData                (void);
 bool            zul_Get1TouchFromData           (uint8_t *data, Contact *c);
-/* Ideally, the library would maintain up to 100 touch histories, updating them
- * as the data is received, and making the current touch state available to the
- * program on demand.    - CFM 05/10/2017  -- ToDo -- */
+
+/**
+ * Every contact of the touch reports is followed as the reports arrive, see
+ * tracker.h.  zul_GetContacts() copies the contacts currently down (or just
+ * released) and zul_GetContact() one contact, by ID, with its recent
+ * positions.  Neither waits on the input thread, nor consumes the queued
+ * reports.
+ */
+void            zul_GetContacts                 (trk_snapshot_t *snap);
+bool            zul_GetContact                  (uint8_t ID, trk_contact_t *contact);
 
 /**
  * Return true if a touch is available.
@@ -387,11 +562,28 @@ bool            zul_Get1TouchFromData           (uint8_t *data, Contact *c);
 bool            zul_TouchAvailable              (Contact *c);
 
 /**
- * Wait for a touch-release event, or the supplied timeout
- * Both private/silent or HID mode are catered for here.
+ * Wait for the release of the contact c->ID, or the supplied timeout.  A
+ * contact released before the call returns at once, and the releases of
+ * other contacts are ignored.  Both private/silent or HID mode are catered
+ * for here.  The thread sleeps while waiting, see trk_waitRelease().
  */
 bool            zul_GetTouchUp                  (int timeout_ms, Contact *c);
 
+/**
+ * Touch event waits, woken by the touch reports as they arrive:
+ *  - zul_waitTouchEvent() sleeps until one of the TRK_EV_ events of mask
+ *    occurs (return the events), or timeoutMs passes (return zero); a
+ *    negative timeout waits indefinitely
+ *  - zul_waitTouchDown() also sets c to the newest contact down
+ *  - zul_getTouchEventFd() is readable once an event occurs, for use in a
+ *    select()/poll() loop; zul_ackTouchEvents() makes it unreadable again,
+ *    and returns the events since it was last called
+ */
+int             zul_waitTouchEvent              (int timeoutMs, int mask);
+bool            zul_waitTouchDown               (int timeoutMs, Contact *c);
+int             zul_getTouchEventFd             (void);
+int             zul_ackTouchEvents              (void);
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 /**
@@ -404,10 +596,49 @@ bool            zul_GetTouchUp                  (int timeout_ms, Contact *c);
 void            zul_SetPrivateTouchMode         (bool enabled);
 
 /**
- * Get any touch data into a user supplied buffer
+ * Get the oldest queued private touch report into a user supplied buffer.
+ * Return the number of bytes copied, zero if none is queued, or -1 if not
+ * in private touch mode.
  */
 int             zul_GetPrivateTouchData         (uint8_t *buffer, int bufSize);
 
+/**
+ * A TUIO server: the private touches are published, as TUIO 1.1 2D cursors,
+ * to a UDP client (host NULL and port 0 for 127.0.0.1:3333), from the input
+ * thread as each report arrives, see tuio.h.
+ *  - zul_startTuioServer() enables private touch mode, and
+ *    zul_stopTuioServer() restores normal touch
+ *  - zul_serviceTuio() repeats the alive message and releases lost contacts
+ *    while no reports arrive; call it every few hundred ms
+ *  - zul_getTuioStats() copies the frame, byte and latency counts
+ */
+int             zul_startTuioServer             (/*@null@*/ char const *host,
+                                                    int port);
+void            zul_stopTuioServer              (void);
+void            zul_serviceTuio                 (void);
+bool            zul_getTuioStats                (tuio_stats_t *stats, bool clear);
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+/**
+ * The touch (TOUCH_OS, or RAW_DATA in private touch mode) and heartbeat
+ * reports received by the default handlers are queued per report ID, see
+ * reportring.h.  zul_BorrowReport() returns the oldest, in place, or NULL;
+ * it stays valid until zul_ReleaseReport().  The zul_Get..Data() services
+ * consume the same queues, so an application should use one or the other.
+ */
+/*@null@*/
+rr_report_t const * zul_BorrowReport            (UsbReportID_t ReportID);
+void            zul_ReleaseReport               (UsbReportID_t ReportID);
+void            zul_FlushReports                (UsbReportID_t ReportID);
+
+/**
+ * Get the queue counters for a report ID, to see whether the application
+ * keeps up.  Return false if the report ID is not queued.
+ */
+bool            zul_GetReportStats              (UsbReportID_t ReportID,
+                                                    rr_stats_t *stats);
+
 
 // ============================================================================
 // --- Raw Data Mode services ---
@@ -415,9 +646,49 @@ int             zul_GetPrivateTouchData         (uint8_t *buffer, int bufSize);
 
 /**
  *  set the application image buffer to receive interrupt data
+ *  The cells are written as they arrive, so a reader of the buffer may see
+ *  parts of two scans; see zul_waitRawFrame() for whole frames.
  */
 void            zul_SetRawDataBuffer            (void *buffer);
 
+/**
+ * Complete raw data frames, Multitouch devices only, see rawframe.h
+ *  - zul_startRawFrames() assembles the raw data reports of the open device
+ *    (in raw mode) into frames, and zul_stopRawFrames() stops; assembly
+ *    stops when a device is opened or re-opened
+ *  - zul_waitRawFrame() waits for a frame later than 'after' (the frame
+ *    number last returned, or zero) and copies it, see rf_waitFrame()
+ */
+int             zul_startRawFrames              (void);
+void            zul_stopRawFrames               (void);
+int             zul_waitRawFrame                (uint32_t after, int timeoutMs,
+                                                    rf_frame_t *info,
+                                                    /*@null@*/ uint8_t *cells,
+                                                    /*@null@*/ uint8_t *missing,
+                                                    int cellsLen);
+bool            zul_getRawFrameStats            (rf_stats_t *stats);
+
+/**
+ * Raw data recordings, Multitouch devices only, see rawrec.h
+ *  - zul_startRawRecording() records the complete frames of the open device
+ *    (in raw mode) to path, restarting the frame assembly, until
+ *    zul_stopRawRecording(); recording stops when a device is opened or
+ *    re-opened
+ *  - zul_startRawReplay() passes the frames of a recording, from position
+ *    first, to the RAW_DATA handler as the device's raw data reports, at
+ *    speed times the recorded rate (0: as fast as possible), with the frame
+ *    assembly set to the recording's size, so that the raw data buffer and
+ *    zul_waitRawFrame() receive them as they would the device's.  Not while
+ *    the device is in raw or private touch mode.
+ */
+int             zul_startRawRecording           (char const *path);
+int             zul_stopRawRecording            (void);
+bool            zul_getRawRecordingStats        (rec_stats_t *stats);
+int             zul_startRawReplay              (char const *path, uint32_t first,
+                                                    double speed);
+bool            zul_rawReplayDone               (void);
+void            zul_stopRawReplay               (void);
+
 /**
  * set the device mode - normal or raw data
  */
@@ -0,0 +1,1092 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+/* For a module overview, see the header file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "dbg2console.h"
+#include "zytypes.h"
+#include "protocol.h"
+#include "usb.h"
+#include "transport.h"
+#include "reportring.h"
+#include "shadow.h"
+#include "sampler.h"
+#include "tracker.h"
+#include "rawframe.h"
+#include "rawdecode.h"
+#include "services.h"
+#include "services_dev.h"
+#include "debug.h"
+
+//
+// --- Module Types ---
+//
+
+/**
+ * All the service state of one device.  The equivalent module statics of
+ * services.c belong to the device opened by zul_openDevice().
+ */
+struct zul_device
+{
+    tp_device_t            *link;
+    int16_t                 pid;
+    Endurance               endurance;
+    bool                    flashWriteDisabled;
+
+    // the CPU Unique ID string, once read, as it cannot change while open
+    char                    cpuId[6*4+1];
+
+    // host copy of the device's values, see shadow.h
+    /*@null@*/
+    zul_shadow_t           *shadow;
+
+    // background status sampling, see sampler.h
+    /*@null@*/
+    zul_sampler_t          *sampler;
+
+    // raw data (Multitouch)
+    /*@null@*/
+    void                   *image;
+    uint16_t                xWires, yWires;
+    int                     rawDataMode;
+    uint64_t                rawInUs;
+
+    // whole raw data frames, see rawframe.h (Multitouch)
+    /*@null@*/
+    zul_rawframe_t         *rawFrames;
+
+    // data buffers for interrupt data storage
+    uint8_t                 rawDataStatus[64];
+    uint8_t                 heartBeatData[64];
+    uint8_t                 touchData[64];
+
+    // IN reports queued by the device's handlers
+    /*@null@*/
+    report_ring_t          *touchRing;
+    /*@null@*/
+    report_ring_t          *heartBeatRing;
+    /*@null@*/
+    zul_tracker_t          *tracker;
+};
+
+
+//
+// --- Private Prototypes ---
+//
+static int      dev_finishOpen                  (zul_device_t **dev,
+                                                    tp_device_t *link);
+static int      dev_getValue                    (zul_device_t *dev,
+                                                    uint8_t *msgBuf, int len,
+                                                    uint16_t *value);
+static int      dev_getRange                    (zul_device_t *dev, char kind,
+                                                    uint8_t device, uint8_t first,
+                                                    int count, uint16_t *values,
+                                                    uint8_t *okMap);
+static int      dev_sendRequest                 (zul_device_t *dev,
+                                                    uint8_t *msgBuf, int len);
+static int      dev_sendRequestAt               (zul_device_t *dev,
+                                                    uint8_t *msgBuf, int len,
+                                                    Endurance endurance);
+static void     dev_applyEndurance              (zul_device_t *dev,
+                                                    Endurance endurance);
+static void     dev_enduranceParams             (Endurance endurance,
+                                                    int *delay, int *retries,
+                                                    int *timeout);
+/*@null@*/
+static report_ring_t * dev_ring                 (zul_device_t *dev,
+                                                    UsbReportID_t ReportID);
+
+/**
+ * INterrupt transfer handlers, context is the zul_device_t
+ */
+static void     dev_IN_touchdata                (void *context, uint8_t *data);
+static void     dev_IN_heartbeat                (void *context, uint8_t *data);
+static void     dev_IN_rawdata_mt               (void *context, uint8_t *data);
+
+
+// ============================================================================
+// --- Public Implementation ---
+// ============================================================================
+
+/**
+ * Open a device, based on the indices provided by zul_getDeviceList()
+ * Return zero on success, else a negative error code
+ */
+int zul_devOpen(int index, zul_device_t **dev)
+{
+    tp_device_t    *link = NULL;
+    int             retVal;
+
+    if (dev == NULL) return -20;
+
+    retVal = tp_devOpen(index, &link);
+    if (retVal != 0) return retVal;
+
+    return dev_finishOpen(dev, link);
+}
+
+/**
+ * Open a device, based on the supplied usb bus address string
+ * Return zero on success, else a negative error code
+ */
+int zul_devOpenByAddr(char const *addrStr, zul_device_t **dev)
+{
+    tp_device_t    *link = NULL;
+    int             retVal;
+
+    if (dev == NULL) return -20;
+
+    retVal = tp_devOpenByAddr(addrStr, &link);
+    if (retVal != 0) return retVal;
+
+    return dev_finishOpen(dev, link);
+}
+
+/**
+ * Close a device and free the handle.
+ */
+int zul_devClose(zul_device_t *dev)
+{
+    int retVal;
+
+    if (dev == NULL) return -2;
+
+    smp_stop(dev->sampler);
+    retVal = tp_devClose(dev->link);
+    shadow_destroy(dev->shadow);
+    trk_destroy(dev->tracker);
+    rf_destroy(dev->rawFrames);
+    rr_destroy(dev->touchRing);
+    rr_destroy(dev->heartBeatRing);
+    free(dev);
+    return retVal;
+}
+
+bool zul_devGetPID(zul_device_t *dev, int16_t *pid)
+{
+    if (dev == NULL) return false;
+    return tp_devGetPID(dev->link, pid);
+}
+
+int zul_devGetAddrStr(zul_device_t *dev, char *addrStr)
+{
+    if (dev == NULL) return -1;
+    return tp_devGetAddrStr(dev->link, addrStr);
+}
+
+/**
+ * Fetch the number of wires, for Multitouch devices only
+ */
+bool zul_devGetSensorSize(zul_device_t *dev, ZXY_sensorSize *sz)
+{
+    uint16_t    cellCountX = 0, cellCountY = 0;
+
+    if ((dev == NULL) || (sz == NULL)) return false;
+
+    switch (dev->pid)
+    {
+        case ZXY100_PRODUCT_ID:
+        case ZXY110_PRODUCT_ID:
+            return false;
+
+        default:
+            if (zul_devGetStatusByID(dev, ZXYMT_SI_NUM_X_WIRES, &cellCountX) != SUCCESS)
+                return false;
+            if (zul_devGetStatusByID(dev, ZXYMT_SI_NUM_Y_WIRES, &cellCountY) != SUCCESS)
+                return false;
+            break;
+    }
+    sz->xWires = cellCountX;
+    sz->yWires = cellCountY;
+    return true;
+}
+
+/**
+ * Control the "robustness" of the communications, see zul_setCommsEndurance()
+ */
+void zul_devSetCommsEndurance(zul_device_t *dev, Endurance endurance)
+{
+    if (dev == NULL) return;
+
+    switch (endurance)
+    {
+        case COM_ENDUR_MEDIUM:
+        case COM_ENDUR_HIGH:
+            dev->endurance = endurance;
+            break;
+        default:
+            dev->endurance = COM_ENDUR_NORM;
+            break;
+    }
+    dev_applyEndurance(dev, dev->endurance);
+}
+
+Endurance zul_devGetCommsEndurance(zul_device_t *dev)
+{
+    if (dev == NULL) return COM_ENDUR_NORM;
+    return dev->endurance;
+}
+
+
+// -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -
+// -  Standard get/set/status accessors
+// -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -
+
+int zul_devGetStatusByID(zul_device_t *dev, uint8_t ID, uint16_t *status)
+{
+    uint8_t msgBuf[DUAL_BYTE_MSG_LEN];
+
+    if (dev == NULL) return FAILURE;
+    if (shadow_get(dev->shadow, SHADOW_STATUS, ID, status)) return SUCCESS;
+
+    bzero(msgBuf, DUAL_BYTE_MSG_LEN);
+    if (!zul_encodeGetStatus(msgBuf, DUAL_BYTE_MSG_LEN, ID)) return FAILURE;
+
+    if (dev_getValue(dev, msgBuf, DUAL_BYTE_MSG_LEN, status) != SUCCESS)
+        return FAILURE;
+    shadow_put(dev->shadow, SHADOW_STATUS, ID, *status);
+    return SUCCESS;
+}
+
+int zul_devGetSpiRegister(zul_device_t *dev, uint8_t device, uint8_t reg,
+                                                            uint16_t *value)
+{
+    uint8_t msgBuf[DUAL_BYTE_MSG_LEN];
+
+    bzero(msgBuf, DUAL_BYTE_MSG_LEN);
+    if (!zul_encodeGetSpiRegister(msgBuf, DUAL_BYTE_MSG_LEN, device, reg))
+        return FAILURE;
+
+    return dev_getValue(dev, msgBuf, DUAL_BYTE_MSG_LEN, value);
+}
+
+int zul_devGetConfigParamByID(zul_device_t *dev, uint8_t ID, uint16_t *value)
+{
+    uint8_t msgBuf[DUAL_BYTE_MSG_LEN];
+
+    if (dev == NULL) return FAILURE;
+    if (shadow_get(dev->shadow, SHADOW_CONFIG, ID, value)) return SUCCESS;
+
+    bzero(msgBuf, DUAL_BYTE_MSG_LEN);
+    if (!zul_encodeGetRequest(msgBuf, DUAL_BYTE_MSG_LEN, ID)) return FAILURE;
+
+    if (dev_getValue(dev, msgBuf, DUAL_BYTE_MSG_LEN, value) != SUCCESS)
+        return FAILURE;
+    shadow_put(dev->shadow, SHADOW_CONFIG, ID, *value);
+    return SUCCESS;
+}
+
+int zul_devSetConfigParamByID(zul_device_t *dev, uint8_t ID, uint16_t value)
+{
+    uint8_t             msgBuf[DUAL_BYTE_MSG_LEN + 2];
+    int                 retVal;
+    usb_ctrl_latency_t  lat;
+
+    if (dev == NULL) return FAILURE;
+
+    bzero(msgBuf, DUAL_BYTE_MSG_LEN + 2);
+    if (!zul_encodeSetRequest(msgBuf, DUAL_BYTE_MSG_LEN + 2, ID, value))
+        return FAILURE;
+
+    // as zul_setConfigParamByID(), writes may take a flash cycle to answer
+    // until the turnaround of this controller's writes is learned
+    if ( (dev->endurance == COM_ENDUR_NORM) &&
+         !( usb_getCtrlLatency(dev->pid, zul_requestMessageCode(msgBuf), &lat)
+            && lat.learned ) )
+    {
+        retVal = dev_sendRequestAt(dev, msgBuf, DUAL_BYTE_MSG_LEN + 2,
+                                                        COM_ENDUR_MEDIUM);
+    }
+    else
+    {
+        retVal = dev_sendRequest(dev, msgBuf, DUAL_BYTE_MSG_LEN + 2);
+    }
+
+    if (retVal == SUCCESS) shadow_written(dev->shadow, ID, value);
+    return retVal;
+}
+
+/**
+ * Bulk accessors, see zul_getConfigRange()
+ */
+int zul_devGetConfigRange(zul_device_t *dev, uint8_t first, int count,
+                                            uint16_t *values, uint8_t *okMap)
+{
+    return dev_getRange(dev, 'C', 0, first, count, values, okMap);
+}
+
+int zul_devGetStatusRange(zul_device_t *dev, uint8_t first, int count,
+                                            uint16_t *values, uint8_t *okMap)
+{
+    return dev_getRange(dev, 'S', 0, first, count, values, okMap);
+}
+
+int zul_devGetSpiRegisterRange(zul_device_t *dev, uint8_t device,
+                                            uint8_t first, int count,
+                                            uint16_t *values, uint8_t *okMap)
+{
+    return dev_getRange(dev, 'R', device, first, count, values, okMap);
+}
+
+/**
+ * Forget the values held for the device, see zul_invalidateShadow()
+ */
+void zul_devInvalidateShadow(zul_device_t *dev)
+{
+    if (dev == NULL) return;
+    shadow_invalidate(dev->shadow);
+}
+
+/**
+ * Background status sampling, see zul_startStatusSampler()
+ */
+int zul_devStartStatusSampler(zul_device_t *dev, uint8_t const *indices,
+                                            int num, int periodMs, int depth)
+{
+    if (dev == NULL) return FAILURE;
+
+    zul_devStopStatusSampler(dev);
+    dev->sampler = smp_start(dev->link, indices, num, periodMs, depth);
+    return (dev->sampler != NULL) ? SUCCESS : FAILURE;
+}
+
+void zul_devStopStatusSampler(zul_device_t *dev)
+{
+    if (dev == NULL) return;
+    smp_stop(dev->sampler);
+    dev->sampler = NULL;
+}
+
+int zul_devGetStatusSummary(zul_device_t *dev, uint8_t ID, uint32_t windowMs,
+                                                    smp_summary_t *summary)
+{
+    if ((dev == NULL) || (dev->sampler == NULL)) return FAILURE;
+    return smp_getSummary(dev->sampler, ID, windowMs, summary) ?
+                                                        SUCCESS : FAILURE;
+}
+
+/**
+ * Test if an option bit is set in the STATUS_BITS value of the device.
+ */
+bool zul_devOptionAvailable(zul_device_t *dev, uint16_t requestedBit)
+{
+    uint16_t    optionBits;
+    uint8_t     optionsIndex;
+
+    if (dev == NULL) return false;
+
+    switch (dev->pid)
+    {
+        case ZXY100_PRODUCT_ID:
+            optionsIndex = ZXY100_SI_OPTION_BITS;
+            break;
+        case ZXY110_PRODUCT_ID:
+            optionsIndex = ZXY110_SI_OPTION_BITS;
+            break;
+        default:
+            optionsIndex = ZXYMT_SI_OPTION_BITS;
+    }
+
+    if (zul_devGetStatusByID(dev, optionsIndex, &optionBits) == SUCCESS)
+    {
+        zul_logf(3, "PID:%04x OptionIndex:%d BITS:%04X",
+            dev->pid, optionsIndex, optionBits);
+        return (optionBits & requestedBit) > 0;
+    }
+    return false;
+}
+
+/**
+ * Device version string accessor.
+ * NB: the ZXY100 fall-back to the older version protocol (services_sc.c) is
+ * only available on the zul_openDevice() device.
+ */
+int zul_devGetVersionStr(zul_device_t *dev, VerIndex verType, char *v, int len)
+{
+    uint8_t     msgBuf[DUAL_BYTE_MSG_LEN];
+    uint8_t     reply[USB_PACKET_LEN];
+    int         retVal;
+
+    if ((dev == NULL) || (v == NULL) || (len < 1)) return FAILURE;
+
+    zul_logf(3, "%s %d", __FUNCTION__, verType);
+
+    // fake a string of the hex CPU Unique ID
+    if (verType == STR_CPUID)
+    {
+        char hxStr[6*4+1];
+        bool complete = true;
+        int x;
+        int baseCI = ZXY110_SI_PROCESSOR_ID_0;
+
+        if (dev->cpuId[0] != '\0')
+        {
+            snprintf(v, len, "%s", dev->cpuId);
+            return SUCCESS;
+        }
+
+        if (dev->pid != ZXY110_PRODUCT_ID)
+        {
+            baseCI = ZXYMT_SI_PROCESSOR_ID_BASE;
+        }
+
+        for (x=0; x<6; x++)
+        {
+            uint16_t status = 0;
+            if (zul_devGetStatusByID(dev, (uint8_t)(baseCI+x), &status) != SUCCESS)
+            {
+                complete = false;
+            }
+            status = (uint16_t)((status << 8) | (status >> 8));
+            sprintf(hxStr+(x*4), "%04X", status); // case is important
+        }
+        hxStr[6*4] = '\0';
+        if (complete)
+        {
+            memcpy(dev->cpuId, hxStr, sizeof(dev->cpuId));
+        }
+        snprintf(v, len, "%s", hxStr);
+        return SUCCESS;
+    }
+
+    bzero(msgBuf, DUAL_BYTE_MSG_LEN);
+    if (!zul_encodeVerStrRequest(msgBuf, DUAL_BYTE_MSG_LEN, verType))
+        return FAILURE;
+
+    retVal = tp_devControlRequest(dev->link, msgBuf, DUAL_BYTE_MSG_LEN, reply);
+    if ((retVal > 0) && zul_decodeVerStrReply(reply, v, len))
+    {
+        return SUCCESS;
+    }
+    return FAILURE;
+}
+
+/**
+ * Inhibit flash writes during a set of configuration writes, see
+ * zul_inhibitFlashWrites()
+ */
+void zul_devInhibitFlashWrites(zul_device_t *dev, bool inhibit)
+{
+    uint8_t msgBuf[DUAL_BYTE_MSG_LEN];
+
+    if (dev == NULL) return;
+    zul_logf(3, "%s %d", __FUNCTION__, inhibit);
+    if (dev->flashWriteDisabled == inhibit) return;
+
+    dev->flashWriteDisabled = inhibit;
+
+    bzero(msgBuf, DUAL_BYTE_MSG_LEN);
+    if (dev->flashWriteDisabled)
+    {
+        // NB: there is a logic inversion here: inhibited <=> not enabled
+        zul_encodeSetFlashWrite(msgBuf, DUAL_BYTE_MSG_LEN, !dev->flashWriteDisabled);
+        (void)dev_sendRequest(dev, msgBuf, DUAL_BYTE_MSG_LEN);
+    }
+    else
+    {
+        zul_encodeForceFlashWrite(msgBuf, SINGLE_BYTE_MSG_LEN);
+        (void)dev_sendRequest(dev, msgBuf, SINGLE_BYTE_MSG_LEN);
+    }
+}
+
+/**
+ * General service to send a single byte message holding only the message-code.
+ */
+void zul_devSendMessageCode(zul_device_t *dev, uint8_t msgCode)
+{
+    uint8_t msgBuf[SINGLE_BYTE_MSG_LEN];
+
+    bzero(msgBuf, SINGLE_BYTE_MSG_LEN);
+    if (zul_encodeSingleByteMessage(msgBuf, SINGLE_BYTE_MSG_LEN, msgCode))
+    {
+        (void)dev_sendRequest(dev, msgBuf, SINGLE_BYTE_MSG_LEN);
+        // the message may restore the defaults, or reset the controller
+        if (dev != NULL) shadow_invalidate(dev->shadow);
+    }
+}
+
+void zul_devResetController(zul_device_t *dev)
+{
+    uint8_t msgBuf[SINGLE_BYTE_MSG_LEN];
+    zul_logf(3, "%s", __FUNCTION__);
+
+    bzero(msgBuf, SINGLE_BYTE_MSG_LEN);
+    if (zul_encodeResetController(msgBuf, SINGLE_BYTE_MSG_LEN))
+    {
+        (void)dev_sendRequest(dev, msgBuf, SINGLE_BYTE_MSG_LEN);
+        if (dev != NULL) shadow_invalidate(dev->shadow);
+    }
+}
+
+void zul_devForceEqualisation(zul_device_t *dev)
+{
+    uint8_t msgBuf[SINGLE_BYTE_MSG_LEN];
+    zul_logf(3, "%s", __FUNCTION__);
+
+    bzero(msgBuf, SINGLE_BYTE_MSG_LEN);
+    if (zul_encodeForceEqualisation(msgBuf, SINGLE_BYTE_MSG_LEN))
+    {
+        (void)dev_sendRequest(dev, msgBuf, SINGLE_BYTE_MSG_LEN);
+    }
+}
+
+
+// -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -
+// -  Interrupt data access
+// -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -  -
+
+/**
+ * Register a handler function for the RAW_DATA reportID
+ */
+void zul_devSetSpecialHandler(zul_device_t *dev, UsbReportID_t ReportID,
+                                    usb_in_handler_t handler, void *context)
+{
+    if ((dev == NULL) || (ReportID != RAW_DATA)) return;
+    zul_logf(3, "Special IN Handler ReportID:%d", ReportID);
+    tp_devRegisterHandler(dev->link, ReportID, handler, context);
+}
+
+uint8_t *zul_devGetTouchData(zul_device_t *dev)
+{
+    rr_report_t const *r;
+
+    if (dev == NULL) return NULL;
+    r = rr_borrow(dev->touchRing);
+    if (r == NULL) return NULL;
+
+    memcpy(dev->touchData, r->data, 64);
+    rr_release(dev->touchRing);
+    return dev->touchData;
+}
+
+uint8_t *zul_devGetHeartBeatData(zul_device_t *dev)
+{
+    rr_report_t const *r;
+
+    if (dev == NULL) return NULL;
+    r = rr_borrow(dev->heartBeatRing);
+    if (r == NULL) return NULL;
+
+    memcpy(dev->heartBeatData, r->data, 64);
+    rr_release(dev->heartBeatRing);
+    return dev->heartBeatData;
+}
+
+void zul_devGetContacts(zul_device_t *dev, trk_snapshot_t *snap)
+{
+    trk_snapshot((dev != NULL) ? dev->tracker : NULL, snap);
+}
+
+int zul_devWaitTouchEvent(zul_device_t *dev, int timeoutMs, int mask)
+{
+    if (dev == NULL) return 0;
+    return trk_waitEvent(dev->tracker, timeoutMs, mask);
+}
+
+int zul_devGetTouchEventFd(zul_device_t *dev)
+{
+    if (dev == NULL) return -1;
+    return trk_getEventFd(dev->tracker);
+}
+
+int zul_devAckTouchEvents(zul_device_t *dev)
+{
+    if (dev == NULL) return 0;
+    return trk_ackEvents(dev->tracker);
+}
+
+rr_report_t const *zul_devBorrowReport(zul_device_t *dev, UsbReportID_t ReportID)
+{
+    return rr_borrow(dev_ring(dev, ReportID));
+}
+
+void zul_devReleaseReport(zul_device_t *dev, UsbReportID_t ReportID)
+{
+    rr_release(dev_ring(dev, ReportID));
+}
+
+bool zul_devGetReportStats(zul_device_t *dev, UsbReportID_t ReportID,
+                                                        rr_stats_t *stats)
+{
+    report_ring_t *ring = dev_ring(dev, ReportID);
+
+    if (ring == NULL) return false;
+    rr_getStats(ring, stats);
+    return true;
+}
+
+uint8_t *zul_devGetSpecialRawData(zul_device_t *dev)
+{
+    if (dev == NULL) return NULL;
+    return dev->rawDataStatus;
+}
+
+/**
+ * Set the buffer to receive the raw data image (Multitouch only)
+ */
+int zul_devSetRawDataBuffer(zul_device_t *dev, void *buffer)
+{
+    if (dev == NULL) return FAILURE;
+
+    switch (dev->pid)
+    {
+        case ZXY100_PRODUCT_ID:
+        case ZXY110_PRODUCT_ID:
+            zul_log(1, "Per-device raw data is only supported by MT devices");
+            return FAILURE;
+
+        default:
+            (void)zul_devGetStatusByID(dev, ZXYMT_SI_NUM_X_WIRES, &dev->xWires);
+            (void)zul_devGetStatusByID(dev, ZXYMT_SI_NUM_Y_WIRES, &dev->yWires);
+            dev->image = buffer;
+
+            dev->rawInUs = zul_monotonicUs();
+            zul_logf(3, "MT Raw Buffer setup %d %d\n", dev->xWires, dev->yWires);
+            break;
+    }
+    return SUCCESS;
+}
+
+/**
+ * set the device mode - normal or raw data (Multitouch only)
+ */
+int zul_devSetRawMode(zul_device_t *dev, int newMode)
+{
+    uint8_t msgBuf[SINGLE_BYTE_MSG_LEN + 1];
+    int     ok;
+
+    if (dev == NULL) return FAILURE;
+    zul_logf(3, "%s %d", __FUNCTION__, newMode);
+
+    if ((dev->pid == ZXY100_PRODUCT_ID) || (dev->pid == ZXY110_PRODUCT_ID))
+    {
+        return FAILURE;
+    }
+
+    dev->rawDataMode = newMode;
+
+    bzero(msgBuf, SINGLE_BYTE_MSG_LEN + 1);
+    if (!zul_encodeRawModeRequest(msgBuf, SINGLE_BYTE_MSG_LEN + 1, newMode))
+        return FAILURE;
+
+    ok = dev_sendRequest(dev, msgBuf, SINGLE_BYTE_MSG_LEN + 1);
+    // the mode change may change config values, see zul_SetRawMode()
+    shadow_invalidate(dev->shadow);
+    return ok;
+}
+
+long zul_devGetRawInAgeMS(zul_device_t *dev)
+{
+    if (dev == NULL) return 0;
+
+    return (long)((zul_monotonicUs() - dev->rawInUs) / 1000u);
+}
+
+/**
+ * Complete raw data frames of a device, see zul_startRawFrames()
+ */
+int zul_devStartRawFrames(zul_device_t *dev)
+{
+    uint16_t    xWires = 0, yWires = 0;
+
+    if ((dev == NULL) || (dev->rawFrames == NULL)) return FAILURE;
+
+    if ( (zul_devGetStatusByID(dev, ZXYMT_SI_NUM_X_WIRES, &xWires) != SUCCESS) ||
+         (zul_devGetStatusByID(dev, ZXYMT_SI_NUM_Y_WIRES, &yWires) != SUCCESS) )
+    {
+        return FAILURE;
+    }
+    return rf_configure(dev->rawFrames, xWires, yWires);
+}
+
+void zul_devStopRawFrames(zul_device_t *dev)
+{
+    if (dev != NULL) (void)rf_configure(dev->rawFrames, 0, 0);
+}
+
+int zul_devWaitRawFrame(zul_device_t *dev, uint32_t after, int timeoutMs,
+                            rf_frame_t *info, uint8_t *cells, uint8_t *missing,
+                            int cellsLen)
+{
+    if (dev == NULL) return 0;
+    return rf_waitFrame(dev->rawFrames, after, timeoutMs, info, cells,
+                                                        missing, cellsLen);
+}
+
+bool zul_devGetRawFrameStats(zul_device_t *dev, rf_stats_t *stats)
+{
+    if ((dev == NULL) || (dev->rawFrames == NULL) || (stats == NULL)) return false;
+    rf_getStats(dev->rawFrames, stats);
+    return true;
+}
+
+
+// ============================================================================
+// --- Private Implementation ---
+// ============================================================================
+
+/**
+ * Create the service state for a newly opened usb device, and install the
+ * standard IN data handlers.
+ */
+static int dev_finishOpen(zul_device_t **pdev, tp_device_t *link)
+{
+    zul_device_t   *dev = (zul_device_t *)calloc(1, sizeof(zul_device_t));
+
+    if (dev == NULL)
+    {
+        (void)tp_devClose(link);
+        return -4;
+    }
+
+    dev->touchRing      = rr_create(RR_DEFAULT_SLOTS);
+    dev->heartBeatRing  = rr_create(RR_DEFAULT_SLOTS);
+    if ((dev->touchRing == NULL) || (dev->heartBeatRing == NULL))
+    {
+        rr_destroy(dev->touchRing);
+        rr_destroy(dev->heartBeatRing);
+        free(dev);
+        (void)tp_devClose(link);
+        return -4;
+    }
+
+    dev->link = link;
+    (void)tp_devGetPID(link, &dev->pid);
+    dev->endurance = COM_ENDUR_NORM;
+
+    // without a shadow, every value is read from the device
+    dev->shadow = shadow_create(dev->pid);
+    dev->tracker = trk_create();
+
+    // created now, as the raw data handler reads it without a lock
+    if ((dev->pid != ZXY100_PRODUCT_ID) && (dev->pid != ZXY110_PRODUCT_ID))
+    {
+        dev->rawFrames = rf_create();
+    }
+
+    tp_devRegisterHandler(link, TOUCH_OS,         dev_IN_touchdata,  dev);
+    tp_devRegisterHandler(link, RAW_DATA,         dev_IN_rawdata_mt, dev);
+    tp_devRegisterHandler(link, HEARTBEAT_REPORT, dev_IN_heartbeat,  dev);
+
+    *pdev = dev;
+    return 0;
+}
+
+/**
+ * The queue of a device's IN reports of the given ID, if there is one
+ */
+static report_ring_t * dev_ring(zul_device_t *dev, UsbReportID_t ReportID)
+{
+    if (dev == NULL) return NULL;
+
+    switch (ReportID)
+    {
+        case TOUCH_OS:          return dev->touchRing;
+        case HEARTBEAT_REPORT:  return dev->heartBeatRing;
+        default:                return NULL;
+    }
+}
+
+/**
+ * Send a request expecting a 16 bit value in reply, and decode it.
+ */
+static int dev_getValue(zul_device_t *dev, uint8_t *msgBuf, int len,
+                                                            uint16_t *value)
+{
+    uint8_t     reply[USB_PACKET_LEN];
+    int         retVal;
+
+    if ((dev == NULL) || (value == NULL)) return FAILURE;
+
+    retVal = tp_devControlRequest(dev->link, msgBuf, (uint16_t)len, reply);
+    if ((retVal > 0) && zul_decodeValueReply(reply, value))
+    {
+        if (PROTOCOL_DEBUG)
+        {
+            zul_logf(1, "%s: %s\n", __FUNCTION__, zul_hex2String(reply, 16));
+        }
+        return SUCCESS;
+    }
+    return FAILURE;
+}
+
+/**
+ * Read a range of config ('C'), status ('S') or SPI register ('R') values,
+ * as zul_getRange() does for the zul_openDevice() device: up to
+ * RANGE_IN_FLIGHT requests are kept queued, and any that fail are retried
+ * once, individually, at the end.
+ */
+#define RANGE_IN_FLIGHT             (16)
+
+static int dev_getRange(zul_device_t *dev, char kind, uint8_t device,
+                                uint8_t first, int count, uint16_t *values,
+                                uint8_t *okMap)
+{
+    tp_request_t    req[RANGE_IN_FLIGHT];
+    uint8_t         msgBuf[DUAL_BYTE_MSG_LEN];
+    int             next = 0, done = 0, numRead = 0;
+    int             i;
+
+    if ((values == NULL) || (okMap == NULL)) return -1;
+    if ((count < 0) || ((int)first + count > 256)) return -1;
+
+    memset(okMap, 0, (size_t)ZUL_BITMAP_LEN(count));
+    if (dev == NULL) return 0;
+
+    while (done < count)
+    {
+        // keep the device's queue full
+        while ((next < count) && (next - done < RANGE_IN_FLIGHT))
+        {
+            tp_request_t   *r   = &req[next % RANGE_IN_FLIGHT];
+            uint8_t         idx = (uint8_t)(first + next);
+            bool            ok  = false;
+
+            bzero(msgBuf, DUAL_BYTE_MSG_LEN);
+            switch (kind)
+            {
+                case 'C':
+                    ok = zul_encodeGetRequest(msgBuf, DUAL_BYTE_MSG_LEN, idx);
+                    break;
+                case 'S':
+                    ok = zul_encodeGetStatus(msgBuf, DUAL_BYTE_MSG_LEN, idx);
+                    break;
+                case 'R':
+                    ok = zul_encodeGetSpiRegister(msgBuf, DUAL_BYTE_MSG_LEN,
+                                                                device, idx);
+                    break;
+            }
+
+            // a request that is not queued has no result, and fails below
+            if ( ok && tp_prepareRequest(r, dev->link, msgBuf,
+                                                    DUAL_BYTE_MSG_LEN, 1) )
+            {
+                (void)tp_submitRequest(r);
+            }
+            else
+            {
+                memset(r, 0, sizeof(tp_request_t));
+            }
+            next++;
+        }
+
+        // collect the oldest
+        {
+            tp_request_t *r = &req[done % RANGE_IN_FLIGHT];
+
+            if ( (tp_waitRequest(r) > 0) &&
+                 zul_decodeValueReply(r->reply, &values[done]) )
+            {
+                okMap[done / 8] |= (uint8_t)(1 << (done % 8));
+                numRead++;
+                if (kind != 'R')
+                {
+                    shadow_put(dev->shadow,
+                               (kind == 'C') ? SHADOW_CONFIG : SHADOW_STATUS,
+                               (uint8_t)(first + done), values[done]);
+                }
+            }
+        }
+        done++;
+    }
+
+    // a second chance for any that failed
+    for (i = 0; i < count; i++)
+    {
+        uint8_t idx = (uint8_t)(first + i);
+        int     res = FAILURE;
+
+        if (ZUL_BITMAP_TEST(okMap, i)) continue;
+
+        switch (kind)
+        {
+            case 'C': res = zul_devGetConfigParamByID(dev, idx, &values[i]);    break;
+            case 'S': res = zul_devGetStatusByID(dev, idx, &values[i]);         break;
+            case 'R': res = zul_devGetSpiRegister(dev, device, idx, &values[i]); break;
+        }
+        if (res == SUCCESS)
+        {
+            okMap[i / 8] |= (uint8_t)(1 << (i % 8));
+            numRead++;
+        }
+    }
+
+    zul_logf(3, "%s %c %d..%d: %d read", __FUNCTION__, kind,
+                                    (int)first, (int)first + count - 1, numRead);
+    return numRead;
+}
+
+/**
+ * Send a request, collecting (and ignoring) any reply
+ */
+static int dev_sendRequest(zul_device_t *dev, uint8_t *msgBuf, int len)
+{
+    uint8_t     reply[USB_PACKET_LEN];
+    int         retVal;
+
+    if (dev == NULL) return FAILURE;
+
+    retVal = tp_devControlRequest(dev->link, msgBuf, (uint16_t)len, reply);
+    if ((retVal > 0) && PROTOCOL_DEBUG)
+    {
+        zul_logf(1, "%s: %s\n", __FUNCTION__, zul_hex2String(reply, 24));
+    }
+    return (retVal > 0) ? SUCCESS : FAILURE;
+}
+
+/**
+ * As dev_sendRequest(), with the control transfer parameters of an
+ * endurance level for this request alone; the device's are not changed
+ */
+static int dev_sendRequestAt(zul_device_t *dev, uint8_t *msgBuf, int len,
+                                                        Endurance endurance)
+{
+    uint8_t     reply[USB_PACKET_LEN];
+    int         retVal;
+    int         delay, retries, timeout;
+
+    if (dev == NULL) return FAILURE;
+
+    dev_enduranceParams(endurance, &delay, &retries, &timeout);
+    retVal = tp_devControlRequestCP(dev->link, msgBuf, (uint16_t)len, reply,
+                                                    delay, retries, timeout);
+    if ((retVal > 0) && PROTOCOL_DEBUG)
+    {
+        zul_logf(1, "%s: %s\n", __FUNCTION__, zul_hex2String(reply, 24));
+    }
+    return (retVal > 0) ? SUCCESS : FAILURE;
+}
+
+/**
+ * Set the control transfer parameters for an endurance level
+ */
+static void dev_applyEndurance(zul_device_t *dev, Endurance endurance)
+{
+    int delay, retries, timeout;
+
+    dev_enduranceParams(endurance, &delay, &retries, &timeout);
+    tp_devSetCtrlParams(dev->link, delay, retries, timeout);
+}
+
+/**
+ * The control transfer parameters of an endurance level, matching
+ * zul_setCommsEndurance()
+ */
+static void dev_enduranceParams(Endurance endurance, int *delay, int *retries,
+                                                                int *timeout)
+{
+    switch (endurance)
+    {
+        case COM_ENDUR_MEDIUM:
+            *delay      = 40;
+            *retries    = 50;
+            *timeout    = 10000;
+            break;
+
+        case COM_ENDUR_HIGH:
+            *delay      = 40;
+            *retries    = 200;
+            *timeout    = 10000;
+            break;
+
+        default:
+            *delay      = -1;
+            *retries    = -1;
+            *timeout    = -1;
+            break;
+    }
+}
+
+
+// ============================================================================
+// --- Interrupt Data Handler Implementation ---
+// ============================================================================
+
+/**
+ * Store touch data from a HID transfer
+ */
+static void dev_IN_touchdata(void *context, uint8_t *data)
+{
+    zul_device_t   *dev = (zul_device_t *)context;
+
+    zul_log_ts(4, "DEV_TCH_IN" );
+    if (*data != TOUCH_OS) return;
+
+    (void)rr_push(dev->touchRing, data, 64);
+    (void)trk_update(dev->tracker, data, 64);
+}
+
+/**
+ * Store the heartbeat reports
+ */
+static void dev_IN_heartbeat(void *context, uint8_t *data)
+{
+    zul_device_t   *dev = (zul_device_t *)context;
+
+    zul_log_ts(4, "DEV_HBR_IN" );
+    if (*data == HEARTBEAT_REPORT)
+    {
+        (void)rr_push(dev->heartBeatRing, data, 64);
+    }
+}
+
+/**
+ * Extract the raw sensor data, see handle_IN_rawdata_mt()
+ */
+static void dev_IN_rawdata_mt(void *context, uint8_t *data)
+{
+    zul_device_t   *dev = (zul_device_t *)context;
+
+    if (*data != RAW_DATA) return;
+
+    // if not in raw mode discard
+    if (dev->rawDataMode == 0) return;
+
+    if (dev->rawFrames != NULL) (void)rf_feed(dev->rawFrames, data, 64);
+
+    // validate the buffer has been set by the application
+    if (dev->image == NULL) return;
+
+    dev->rawInUs = zul_monotonicUs();
+
+    // invalid FF values for row and col mark a status report
+    if (rdec_decodeMT(data, (uint8_t *)dev->image,
+                                        dev->xWires, dev->yWires) < 0)
+    {
+        memcpy(dev->rawDataStatus, data, 64);
+    }
+}
@@ -0,0 +1,221 @@
+/*
+ *  Copyright (c) 2019 Zytronic Displays Limited. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact Zytronic, you can do so either via the
+ * website <www.zytronic.co.uk> or by paper mail:
+ * Zytronic, Whiteley Road, Blaydon on Tyne, Tyne & Wear, NE21 5NJ, UK
+ */
+
+
+/* Module Overview
+   ===============
+   This code provides user services for Zytronic USB Touchscreen devices,
+   where more than one device is to be driven by the same process.
+
+   The general services (see services.h) act upon the single device opened
+   by zul_openDevice().  The services here take a device handle, which
+   holds all the transport and service state of one device, so several
+   controllers may be opened, configured and streamed at the same time.
+
+   zul_InitServices() must be called before the first zul_devOpen().
+
+   The services offered are:
+
+        - device connection & disconnection
+
+        - Get and Set configuration Parameters
+        - Get status values
+        - Get version data
+
+        - Touch, heartbeat and raw data fetch (Multitouch devices)
+ */
+
+#ifndef _ZY_SERVICES_DEV_H
+#define _ZY_SERVICES_DEV_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "zytypes.h"
+#include "protocol.h"
+#include "usb.h"
+#include "services.h"
+
+
+// === Useful Datatypes =======================================================
+
+/**
+ * An open device, and the service state held for it
+ */
+typedef struct zul_device zul_device_t;
+
+
+// === Services ===============================================================
+
+/**
+ * Open a device, based on the indices provided by zul_getDeviceList(), or on
+ * the supplied usb bus address string.  The standard IN data handlers are
+ * installed for the device.
+ * Return zero and set *dev on success, else a negative error code.
+ */
+int             zul_devOpen                     (int index, zul_device_t **dev);
+int             zul_devOpenByAddr               (char const *addrStr,
+                                                            zul_device_t **dev);
+/**
+ * Close a device and free the handle.
+ */
+int             zul_devClose                    (zul_device_t *dev);
+
+bool            zul_devGetPID                   (zul_device_t *dev, int16_t *pid);
+int             zul_devGetAddrStr               (zul_device_t *dev, char *addrStr);
+bool            zul_devGetSensorSize            (zul_device_t *dev, ZXY_sensorSize *sz);
+
+/**
+ * Control the "robustness" of the communications with one device
+ */
+void            zul_devSetCommsEndurance        (zul_device_t *dev, Endurance code);
+Endurance       zul_devGetCommsEndurance        (zul_device_t *dev);
+
+/**
+ * Standard get/set/status accessors - return SUCCESS or FAILURE
+ */
+int             zul_devGetStatusByID            (zul_device_t *dev, uint8_t ID,
+                                                            uint16_t *status);
+int             zul_devGetSpiRegister           (zul_device_t *dev, uint8_t device,
+                                                    uint8_t reg, uint16_t *value);
+int             zul_devGetConfigParamByID       (zul_device_t *dev, uint8_t ID,
+                                                            uint16_t *config);
+int             zul_devSetConfigParamByID       (zul_device_t *dev, uint8_t ID,
+                                                            uint16_t config);
+
+/**
+ * Bulk reads of a range of values, see zul_getConfigRange()
+ */
+int             zul_devGetConfigRange           (zul_device_t *dev, uint8_t first,
+                                                    int count, uint16_t *values,
+                                                    uint8_t *okMap);
+int             zul_devGetStatusRange           (zul_device_t *dev, uint8_t first,
+                                                    int count, uint16_t *values,
+                                                    uint8_t *okMap);
+int             zul_devGetSpiRegisterRange      (zul_device_t *dev, uint8_t device,
+                                                    uint8_t first, int count,
+                                                    uint16_t *values,
+                                                    uint8_t *okMap);
+
+bool            zul_devOptionAvailable          (zul_device_t *dev, uint16_t optionBit);
+
+/**
+ * Config values, and the status values that describe the controller, are
+ * held by the host once read, as for zul_openDevice(), see services.h
+ */
+void            zul_devInvalidateShadow         (zul_device_t *dev);
+
+/**
+ * Background status sampling of one device, see zul_startStatusSampler()
+ */
+int             zul_devStartStatusSampler       (zul_device_t *dev,
+                                                    uint8_t const *indices, int num,
+                                                    int periodMs, int depth);
+void            zul_devStopStatusSampler        (zul_device_t *dev);
+int             zul_devGetStatusSummary         (zul_device_t *dev, uint8_t ID,
+                                                    uint32_t windowMs,
+                                                    smp_summary_t *summary);
+
+/**
+ * Device version string accessor - return SUCCESS or FAILURE
+ */
+int             zul_devGetVersionStr            (zul_device_t *dev, VerIndex verType,
+                                                            char *v, int len);
+
+void            zul_devInhibitFlashWrites       (zul_device_t *dev, bool inhibit);
+void            zul_devSendMessageCode          (zul_device_t *dev, uint8_t msgCode);
+void            zul_devResetController          (zul_device_t *dev);
+void            zul_devForceEqualisation        (zul_device_t *dev);
+
+/**
+ * Replace the handler for RAW_DATA IN transfers of one device.  The handler
+ * is called with the supplied context, from the device's transfer thread,
+ * and must not make requests of the device.
+ */
+void            zul_devSetSpecialHandler        (zul_device_t *dev,
+                                                    UsbReportID_t ReportID,
+                                                    usb_in_handler_t handler,
+                                                    void *context);
+
+/**
+ * Return a pointer to a copy of the oldest touch report queued by the
+ * device, or NULL if there is none.
+ */
+uint8_t *       zul_devGetTouchData             (zul_device_t *dev);
+uint8_t *       zul_devGetHeartBeatData         (zul_device_t *dev);
+uint8_t *       zul_devGetSpecialRawData        (zul_device_t *dev);
+
+/**
+ * The contacts of a device's touch reports, and waits for touch events, as
+ * zul_GetContacts() and zul_waitTouchEvent()
+ */
+void            zul_devGetContacts              (zul_device_t *dev,
+                                                    trk_snapshot_t *snap);
+int             zul_devWaitTouchEvent           (zul_device_t *dev, int timeoutMs,
+                                                    int mask);
+int             zul_devGetTouchEventFd          (zul_device_t *dev);
+int             zul_devAckTouchEvents           (zul_device_t *dev);
+
+/**
+ * Zero-copy access to the TOUCH_OS and HEARTBEAT_REPORT queues of a device,
+ * and their counters, as zul_BorrowReport() and zul_GetReportStats().
+ */
+/*@null@*/
+rr_report_t const * zul_devBorrowReport         (zul_device_t *dev,
+                                                    UsbReportID_t ReportID);
+void            zul_devReleaseReport            (zul_device_t *dev,
+                                                    UsbReportID_t ReportID);
+bool            zul_devGetReportStats           (zul_device_t *dev,
+                                                    UsbReportID_t ReportID,
+                                                    rr_stats_t *stats);
+
+/**
+ * Raw data services, for Multitouch devices only.  The buffer supplied
+ * must hold (xWires * yWires) bytes.
+ * Return SUCCESS or FAILURE (no device, or a ZXY100/ZXY110)
+ */
+int             zul_devSetRawDataBuffer         (zul_device_t *dev, void *buffer);
+int             zul_devSetRawMode               (zul_device_t *dev, int rawMode);
+long            zul_devGetRawInAgeMS            (zul_device_t *dev);
+
+/**
+ * Complete raw data frames of a device (in raw mode), as zul_startRawFrames()
+ * and its companions, for Multitouch devices only, see rawframe.h
+ */
+int             zul_devStartRawFrames           (zul_device_t *dev);
+void            zul_devStopRawFrames            (zul_device_t *dev);
+int             zul_devWaitRawFrame             (zul_device_t *dev,
+                                                    uint32_t after, int timeoutMs,
+                                                    rf_frame_t *info,
+                                                    /*@null@*/ uint8_t *cells,
+                                                    /*@null@*/ uint8_t *missing,
+                                                    int cellsLen);
+bool            zul_devGetRawFrameStats         (zul_device_t *dev,
+                                                    rf_stats_t *stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ZY_SERVICES_DEV_H
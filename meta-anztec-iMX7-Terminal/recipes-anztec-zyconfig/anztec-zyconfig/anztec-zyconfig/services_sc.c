@@ -44,8 +44,10 @@
 #include "zxy100.h"
 #include "zxy110.h"
 #include "usb.h"
+#include "transport.h"
 #include "services.h"
 #include "services_sc.h"
+#include "rawdecode.h"
 #include "debug.h"
 
 
@@ -119,7 +121,7 @@ bool zul_old_BLgetVersion(void)
 
     if (!ok) return false;
 
-    retVal = usb_ControlRequest(msgBuf, 2, handle_BL100_response);
+    retVal = tp_ControlRequest(msgBuf, 2, handle_BL100_response);
     return retVal > 0;
 }
 
@@ -330,7 +332,7 @@ int zul_getOldZxy100VerInfo(Zxy100VersionData *d)
     if (ok)
     {
         msv_oldVerInfo[0] = (uint8_t)'\0';
-        (void)usb_ControlRequest(msgBuf, SINGLE_BYTE_MSG_LEN, handle_oldVerResponse);
+        (void)tp_ControlRequest(msgBuf, SINGLE_BYTE_MSG_LEN, handle_oldVerResponse);
 
         if (msv_oldVerInfo[0] != '\0')
         {
@@ -362,7 +364,7 @@ int zul_getOldZxy100WireCnt(uint16_t *xWC, uint16_t *yWC)
     Zxy100VersionData   d;
 
     *xWC = *yWC = 299;         // obviously invalid value
-    if (usb_getDevicePID(&PID))
+    if (tp_getDevicePID(&PID))
     {
         switch (PID)
         {
@@ -446,7 +448,7 @@ int zul_getSingleRawData (Zxy100RawData *d)
         ok = zul_encodeGetSingleRawData(msgBuf, SINGLE_BYTE_MSG_LEN);
         if (ok)
         {
-            (void)usb_ControlRequestMR(msgBuf, SINGLE_BYTE_MSG_LEN,
+            (void)tp_ControlRequestMR(msgBuf, SINGLE_BYTE_MSG_LEN,
                                             handle_singleRawData, 2);
         }
 
@@ -481,7 +483,7 @@ int zul_getOldSysReport (Zxy100SysReport *d)
     if (ok)
     {
         msv_zxy100SystemReport.uptime = 0;
-        (void)usb_ControlRequest(msgBuf, SINGLE_BYTE_MSG_LEN, handle_sysReportResponse);
+        (void)tp_ControlRequest(msgBuf, SINGLE_BYTE_MSG_LEN, handle_sysReportResponse);
 
         // rough check that some data was fetched
         if (msv_zxy100SystemReport.uptime != '\0')
@@ -535,7 +537,7 @@ int zul_getOldTouchReport (Zxy100TouchReport *tr)
     if (ok)
     {
         msv_zxy100SystemReport.uptime = 0;
-        (void)usb_ControlRequest(msgBuf, SINGLE_BYTE_MSG_LEN, handle_sysTouchReport);
+        (void)tp_ControlRequest(msgBuf, SINGLE_BYTE_MSG_LEN, handle_sysTouchReport);
 
         // rough check that some data was fetched
         if (msv_zxy100TouchReport.x != 0)
@@ -791,88 +793,47 @@ struct timeb *zul_zxy100RawInTime(void)
 }
 
 /**
- * Handler to extract the ZXY100 raw sensor data
- * ZXY100 Only - one data byte per wire - different to ZXY110
+ * The application's raw data buffer, if data is a raw data report to be
+ * stored in it, else NULL.  The reports are decoded by rawdecode.h.
  */
-void handle_IN_rawdata_100(uint8_t *data)
+static void *zul_rawBuffer100(uint8_t *data, char const *caller)
 {
-    uint8_t             *p;
-    uint8_t             *wire;
-    ZXY100_rawImage     *rawImg;
-
-    int                 wiresInPacket;
-    int                 i;
-
-    zul_log_ts(5, "\tRAW_100_IN 1" );
-
     if (PROTOCOL_DEBUG)
     {
-        zul_logf(1, "%s:\n%s\n", __FUNCTION__, zul_hex2String(data, 24));
+        zul_logf(1, "%s:\n%s\n", caller, zul_hex2String(data, 24));
     }
 
     if (*data != RAW_DATA)
     {
-        return;
+        return NULL;
     }
 
-    zul_log_ts(5, "\tRAW_100_IN 2" );
     // if not in raw mode return!   ToDo: error message?
-    if (msv_RawDataMode100 == 0) return;
-    zul_log_ts(5, "\tRAW_100_IN 3" );
+    if (msv_RawDataMode100 == 0) return NULL;
 
     // validate the buffer has been set by the application
-    if (msv_image100 == 0) return;
-
-    rawImg = (ZXY100_rawImage *)msv_image100;
-    zul_logf(3, "\tRAW_100_IN 4: %d", rawImg->sensorSz.xWires );
+    if (msv_image100 == 0) return NULL;
 
     (void)ftime(&rawInTimeMs100);
+    return msv_image100;
+}
 
-    p = data + 1;   // packet offset byte
-
-    switch (*p)
-    {
-        case 0:
-            wire = &(rawImg->wireSig[0]);
-            wiresInPacket = 62;
-            if (rawImg->sensorSz.xWires == 16)
-            {
-                rawImg->allValid = true; // no missing wire values
-            }
-            break;
-        case 1:
-            wire = &(rawImg->wireSig[62]);
-            wiresInPacket = 62;
-            if (rawImg->sensorSz.xWires == 32)
-            {
-                rawImg->allValid = true; // no missing wire values
-            }
-            break;
-        case 2:
-            wire = &(rawImg->wireSig[124]);
-            wiresInPacket = 4;
-            if (rawImg->sensorSz.xWires == 64)
-            {
-                rawImg->allValid = true; // no missing wire values
-            }
-            break;
-        default:
-            // error case - take no data
-            wire = &(rawImg->wireSig[0]);
-            wiresInPacket = 0;
-            break;
-    }
+/**
+ * Handler to extract the ZXY100 raw sensor data
+ * ZXY100 Only - one data byte per wire - different to ZXY110
+ */
+void handle_IN_rawdata_100(uint8_t *data)
+{
+    ZXY100_rawImage     *rawImg;
 
-    p++;            // advance to wire data
+    zul_log_ts(5, "\tRAW_100_IN" );
 
-    // copy the wire data into the ZXY110 raw data struct
-    // NB: memcpy option here
-    for (i=0; i<wiresInPacket; i++)
-    {
-        *wire++ = *p++;
-    }
+    rawImg = (ZXY100_rawImage *)zul_rawBuffer100(data, __FUNCTION__);
+    if (rawImg == NULL) return;
 
-    return;
+    zul_logf(3, "\tRAW_100_IN: %d", rawImg->sensorSz.xWires );
+    rdec_decode100(data, rawImg->wireSig, rawImg->sensorSz.xWires,
+                                                        &rawImg->allValid);
 }
 
 /**
@@ -882,82 +843,15 @@ void handle_IN_rawdata_100(uint8_t *data)
  */
 void handle_IN_rawdata_110(uint8_t *data)
 {
-    uint8_t             *p;
-    uint16_t            *wire;
     ZXY110_rawImage     *rawImg;
 
-    int                 wiresInPacket;
-    int                 i;
-
     zul_log_ts(4, "RAW_110_IN" );
 
-    if (PROTOCOL_DEBUG)
-    {
-        zul_logf(1, "%s:\n%s\n", __FUNCTION__, zul_hex2String(data, 24));
-    }
-
-    if (*data != RAW_DATA)
-    {
-        return;
-    }
-
-    // if not in raw mode return!   ToDo: error message?
-    if (msv_RawDataMode100 == 0) return;
-
-    // validate the buffer has been set by the application
-    if (msv_image100 == 0) return;
-
-    rawImg = (ZXY110_rawImage *)msv_image100;
-
-    (void)ftime(&rawInTimeMs100);
-
-    p = data + 1;   // packet offset byte
-
-    switch (*p)
-    {
-        case 0:
-            wire = &(rawImg->wireSig[0]);
-            wiresInPacket = 31;
-            break;
-        case 1:
-            wire = &(rawImg->wireSig[31]);
-            wiresInPacket = 31;
-            if (rawImg->sensorSz.xWires == 16)
-            {
-                rawImg->allValid = true; // no missing wire values
-            }
-            break;
-        case 2:
-            wire = &(rawImg->wireSig[62]);
-            wiresInPacket = 2;
-            if (rawImg->sensorSz.xWires == 32)
-            {
-                rawImg->allValid = true; // no missing wire values
-            }
-            break;
-        default:
-            // error case - take no data - (128 wire ZXY110 non-existant 2018)
-            wire = &(rawImg->wireSig[0]);
-            wiresInPacket = 0;
-            break;
-    }
-
-    p++;            // advance to wire data
-
-    // copy the wire data into the ZXY110 raw data struct
-    for (i=0; i<wiresInPacket; i++)
-    {
-        // byte order important - on some systems memcpy would be OK
-        uint16_t v = (*p++);    // first byte of value is LSB
-        v += (0x100 * (*p++));
-        if (v > 100)    // sanity check
-        {
-            zul_logf(0, "ODD WIRE-VALUE %05d %04d\n", v, v);
-        }
-        *wire++ = v;
-    }
+    rawImg = (ZXY110_rawImage *)zul_rawBuffer100(data, __FUNCTION__);
+    if (rawImg == NULL) return;
 
-    return;
+    rdec_decode110(data, rawImg->wireSig, rawImg->sensorSz.xWires,
+                                                        &rawImg->allValid);
 }
 
 
@@ -965,90 +859,19 @@ void handle_IN_rawdata_110(uint8_t *data)
  * Handler to extract the ZXY110 raw sensor data - into zxy100 data store with
  * only 8-bit wire values. This allows the same Integration Test code to be run
  * for ZXY110 devices as for ZXY100.
- *
- * ToDo - too much code duplication with handle_IN_rawdata_110 - refactor.
  */
 void handle_IN_rawdata_110_Clipped(uint8_t *data)
 {
-    uint8_t             *p;
-    uint8_t             *wire;
     ZXY100_rawImage     *rawImg;
 
-    int                 wiresInPacket;
-    int                 i;
-
     zul_log_ts(4, "RAW_110_IN_CLIP" );
 
-    if (PROTOCOL_DEBUG)
-    {
-        zul_logf(1, "%s:\n%s\n", __FUNCTION__, zul_hex2String(data, 24));
-    }
-
-    if (*data != RAW_DATA)
-    {
-        return;
-    }
-
-    // if not in raw mode return!   ToDo: error message?
-    if (msv_RawDataMode100 == 0) return;
-
-    // validate the buffer has been set by the application
-    if (msv_image100 == 0) return;
-
-
     // NB: storing the ZXY110 u16 values as u8  !!
+    rawImg = (ZXY100_rawImage *)zul_rawBuffer100(data, __FUNCTION__);
+    if (rawImg == NULL) return;
 
-    rawImg = (ZXY100_rawImage *)msv_image100;           // was rawImg = (ZXY110_rawImage *)msv_image100;
-
-    (void)ftime(&rawInTimeMs100);
-
-    p = data + 1;   // packet offset byte
-
-    switch (*p)
-    {
-        case 0:
-            wire = &(rawImg->wireSig[0]);
-            wiresInPacket = 31;
-            break;
-        case 1:
-            wire = &(rawImg->wireSig[31]);
-            wiresInPacket = 31;
-            if (rawImg->sensorSz.xWires == 16)
-            {
-                rawImg->allValid = true; // no missing wire values
-            }
-            break;
-        case 2:
-            wire = &(rawImg->wireSig[62]);
-            wiresInPacket = 2;
-            if (rawImg->sensorSz.xWires == 32)
-            {
-                rawImg->allValid = true; // no missing wire values
-            }
-            break;
-        default:
-            // error case - take no data - (128 wire ZXY110 non-existant 2018)
-            wire = &(rawImg->wireSig[0]);
-            wiresInPacket = 0;
-            break;
-    }
-
-    p++;            // advance to wire data
-
-    // copy the wire data into the ZXY110 raw data struct
-    for (i=0; i<wiresInPacket; i++)
-    {
-        uint16_t v = (*p++);            // first byte of value is LSB
-        v += (0x100 * (*p++));
-        if (v > 100)    // sanity check
-        {
-            zul_logf(0, "ODD WIRE-VALUE %05d %04d\n", v, v);
-        }
-
-        *wire++ = (v > 255) ? 255 : v;    // CLIPPING
-    }
-
-    return;
+    rdec_decode110Clipped(data, rawImg->wireSig, rawImg->sensorSz.xWires,
+                                                        &rawImg->allValid);
 }
 
 
@@ -0,0 +1,375 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* For a module overview, see the header file
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "zytypes.h"
+#include "zxy100.h"
+#include "zxy110.h"
+#include "zxymt.h"
+#include "debug.h"
+#include "shadow.h"
+
+//
+// --- Module Types ---
+//
+
+// entry states
+#define ENTRY_STALE                 (0)
+#define ENTRY_VALID                 (1)
+#define ENTRY_DIRTY                 (2)
+
+typedef struct
+{
+    uint16_t    value[SHADOW_NUM_INDEX];
+    uint8_t     state[SHADOW_NUM_INDEX];
+    uint64_t    timeMs[SHADOW_NUM_INDEX];   // when last valid
+    int32_t     ttlMs[SHADOW_NUM_INDEX];
+} shadow_table_t;
+
+struct zul_shadow
+{
+    pthread_mutex_t     lock;
+    shadow_table_t      table[SHADOW_NUM_KINDS];
+    shadow_stats_t      stats;
+};
+
+//
+// --- Module Global Variables/Consts ---
+//
+
+// status values that describe the controller, and do not change while open
+
+static uint8_t const        msv_constZxy100[] =
+{
+    ZXY100_SI_NUM_STATUS_VALUES,
+    ZXY100_SI_NUM_CONFIG_PARAMS,
+    ZXY100_SI_OPTION_BITS,
+};
+
+static uint8_t const        msv_constZxy110[] =
+{
+    ZXY110_SI_NUM_STATUS_VALUES,
+    ZXY110_SI_NUM_CONFIG_PARAMS,
+    ZXY110_SI_PROCESSOR_ID_0,
+    ZXY110_SI_PROCESSOR_ID_1,
+    ZXY110_SI_PROCESSOR_ID_2,
+    ZXY110_SI_PROCESSOR_ID_3,
+    ZXY110_SI_PROCESSOR_ID_4,
+    ZXY110_SI_PROCESSOR_ID_5,
+    ZXY110_SI_OPTION_BITS,
+};
+
+static uint8_t const        msv_constZxyMT[] =
+{
+    ZXYMT_SI_NUM_CONFIG_PARAMS,
+    ZXYMT_SI_NUM_STATUS_VALUES,
+    ZXYMT_SI_PROCESSOR_ID_BASE + 0,
+    ZXYMT_SI_PROCESSOR_ID_BASE + 1,
+    ZXYMT_SI_PROCESSOR_ID_BASE + 2,
+    ZXYMT_SI_PROCESSOR_ID_BASE + 3,
+    ZXYMT_SI_PROCESSOR_ID_BASE + 4,
+    ZXYMT_SI_PROCESSOR_ID_BASE + 5,
+    ZXYMT_SI_OPTION_BITS,
+    ZXYMT_SI_NUM_Y_WIRES,
+    ZXYMT_SI_NUM_X_WIRES,
+    ZXYMT_SI_NUM_PRIVATE_CONFIG_PARAMS,
+    ZXYMT_SI_NUM_PRIVATE_STATUS_VALUES,
+};
+
+
+//
+// --- Private Prototypes ---
+//
+
+static void     shadow_defaultPolicy    (zul_shadow_t *sh, int16_t pid);
+static bool     shadow_current          (shadow_table_t const *t, int index,
+                                            uint64_t now);
+
+
+// ============================================================================
+// --- Public Implementation ---
+// ============================================================================
+
+zul_shadow_t * shadow_create(int16_t pid)
+{
+    zul_shadow_t *sh = (zul_shadow_t *)calloc(1, sizeof(zul_shadow_t));
+
+    if (sh == NULL) return NULL;
+    if (pthread_mutex_init(&sh->lock, NULL) != 0)
+    {
+        free(sh);
+        return NULL;
+    }
+    shadow_defaultPolicy(sh, pid);
+    return sh;
+}
+
+void shadow_destroy(zul_shadow_t *sh)
+{
+    if (sh == NULL) return;
+    pthread_mutex_destroy(&sh->lock);
+    free(sh);
+}
+
+void shadow_reset(zul_shadow_t *sh, int16_t pid)
+{
+    if (sh == NULL) return;
+
+    pthread_mutex_lock(&sh->lock);
+    memset(sh->table, 0, sizeof(sh->table));
+    sh->stats.dirty = 0;
+    shadow_defaultPolicy(sh, pid);
+    pthread_mutex_unlock(&sh->lock);
+}
+
+void shadow_invalidate(zul_shadow_t *sh)
+{
+    int k, i;
+
+    if (sh == NULL) return;
+
+    pthread_mutex_lock(&sh->lock);
+    for (k = 0; k < SHADOW_NUM_KINDS; k++)
+    {
+        for (i = 0; i < SHADOW_NUM_INDEX; i++)
+        {
+            if (sh->table[k].state[i] == ENTRY_VALID)
+            {
+                sh->table[k].state[i] = ENTRY_STALE;
+            }
+        }
+    }
+    pthread_mutex_unlock(&sh->lock);
+}
+
+void shadow_setPolicy(zul_shadow_t *sh, ShadowKind kind, uint8_t index,
+                                                            int32_t ttlMs)
+{
+    if ((sh == NULL) || (kind >= SHADOW_NUM_KINDS)) return;
+
+    pthread_mutex_lock(&sh->lock);
+    sh->table[kind].ttlMs[index] = ttlMs;
+    pthread_mutex_unlock(&sh->lock);
+}
+
+bool shadow_get(zul_shadow_t *sh, ShadowKind kind, uint8_t index,
+                                                            uint16_t *value)
+{
+    bool found;
+
+    if ((sh == NULL) || (kind >= SHADOW_NUM_KINDS) || (value == NULL))
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&sh->lock);
+    found = shadow_current(&sh->table[kind], index, zul_monotonicMs());
+    if (found)
+    {
+        *value = sh->table[kind].value[index];
+        sh->stats.hits++;
+    }
+    else
+    {
+        sh->stats.misses++;
+    }
+    pthread_mutex_unlock(&sh->lock);
+    return found;
+}
+
+void shadow_put(zul_shadow_t *sh, ShadowKind kind, uint8_t index,
+                                                            uint16_t value)
+{
+    shadow_table_t *t;
+
+    if ((sh == NULL) || (kind >= SHADOW_NUM_KINDS)) return;
+    t = &sh->table[kind];
+
+    pthread_mutex_lock(&sh->lock);
+    if ((t->state[index] != ENTRY_DIRTY) && (t->ttlMs[index] != SHADOW_TTL_NEVER))
+    {
+        t->value[index]  = value;
+        t->state[index]  = ENTRY_VALID;
+        t->timeMs[index] = zul_monotonicMs();
+    }
+    pthread_mutex_unlock(&sh->lock);
+}
+
+void shadow_written(zul_shadow_t *sh, uint8_t index, uint16_t value)
+{
+    shadow_table_t *t;
+
+    if (sh == NULL) return;
+    t = &sh->table[SHADOW_CONFIG];
+
+    pthread_mutex_lock(&sh->lock);
+    if (t->state[index] == ENTRY_DIRTY)
+    {
+        sh->stats.dirty--;
+        t->state[index] = ENTRY_STALE;
+    }
+    if (t->ttlMs[index] != SHADOW_TTL_NEVER)
+    {
+        t->value[index]  = value;
+        t->state[index]  = ENTRY_VALID;
+        t->timeMs[index] = zul_monotonicMs();
+    }
+    pthread_mutex_unlock(&sh->lock);
+}
+
+void shadow_markDirty(zul_shadow_t *sh, uint8_t index, uint16_t value)
+{
+    shadow_table_t *t;
+
+    if (sh == NULL) return;
+    t = &sh->table[SHADOW_CONFIG];
+
+    pthread_mutex_lock(&sh->lock);
+    if (t->state[index] != ENTRY_DIRTY) sh->stats.dirty++;
+    t->value[index] = value;
+    t->state[index] = ENTRY_DIRTY;
+    pthread_mutex_unlock(&sh->lock);
+}
+
+void shadow_clearDirty(zul_shadow_t *sh, uint8_t index, uint16_t value)
+{
+    shadow_table_t *t;
+
+    if (sh == NULL) return;
+    t = &sh->table[SHADOW_CONFIG];
+
+    pthread_mutex_lock(&sh->lock);
+    if ((t->state[index] == ENTRY_DIRTY) && (t->value[index] == value))
+    {
+        sh->stats.dirty--;
+        t->state[index]  = (t->ttlMs[index] != SHADOW_TTL_NEVER) ?
+                                                ENTRY_VALID : ENTRY_STALE;
+        t->timeMs[index] = zul_monotonicMs();
+    }
+    pthread_mutex_unlock(&sh->lock);
+}
+
+int shadow_getDirty(zul_shadow_t *sh, uint8_t *index, uint16_t *value, int max)
+{
+    shadow_table_t *t;
+    int             n = 0;
+    int             i;
+
+    if ((sh == NULL) || (index == NULL) || (value == NULL)) return 0;
+    t = &sh->table[SHADOW_CONFIG];
+
+    pthread_mutex_lock(&sh->lock);
+    for (i = 0; (i < SHADOW_NUM_INDEX) && (n < max); i++)
+    {
+        if (t->state[i] != ENTRY_DIRTY) continue;
+        index[n] = (uint8_t)i;
+        value[n] = t->value[i];
+        n++;
+    }
+    pthread_mutex_unlock(&sh->lock);
+    return n;
+}
+
+void shadow_getStats(zul_shadow_t *sh, shadow_stats_t *stats)
+{
+    if ((sh == NULL) || (stats == NULL)) return;
+
+    pthread_mutex_lock(&sh->lock);
+    *stats = sh->stats;
+    pthread_mutex_unlock(&sh->lock);
+}
+
+
+// ============================================================================
+// --- Private Implementation ---
+// ============================================================================
+
+/**
+ * Config values are kept for a while, status values are not kept,
+ * except for those constant for the product.  Called with the lock held.
+ */
+static void shadow_defaultPolicy(zul_shadow_t *sh, int16_t pid)
+{
+    uint8_t const  *constant;
+    int             numConst;
+    int             i;
+
+    switch (pid)
+    {
+        case ZXY100_PRODUCT_ID:
+            constant = msv_constZxy100;
+            numConst = (int)sizeof(msv_constZxy100);
+            break;
+        case ZXY110_PRODUCT_ID:
+            constant = msv_constZxy110;
+            numConst = (int)sizeof(msv_constZxy110);
+            break;
+        default:
+            constant = msv_constZxyMT;
+            numConst = (int)sizeof(msv_constZxyMT);
+            break;
+    }
+
+    for (i = 0; i < SHADOW_NUM_INDEX; i++)
+    {
+        sh->table[SHADOW_CONFIG].ttlMs[i] = SHADOW_CONFIG_TTL_MS;
+        sh->table[SHADOW_STATUS].ttlMs[i] = SHADOW_TTL_NEVER;
+    }
+    for (i = 0; i < numConst; i++)
+    {
+        sh->table[SHADOW_STATUS].ttlMs[constant[i]] = SHADOW_TTL_FOREVER;
+    }
+}
+
+/**
+ * Test if an entry may be used, under its policy
+ */
+static bool shadow_current(shadow_table_t const *t, int index, uint64_t now)
+{
+    switch (t->state[index])
+    {
+        case ENTRY_DIRTY:
+            return true;
+
+        case ENTRY_VALID:
+            if (t->ttlMs[index] < 0) return true;           // forever
+            if (t->ttlMs[index] == SHADOW_TTL_NEVER) return false;
+            return (now - t->timeMs[index]) < (uint64_t)t->ttlMs[index];
+
+        default:
+            return false;
+    }
+}
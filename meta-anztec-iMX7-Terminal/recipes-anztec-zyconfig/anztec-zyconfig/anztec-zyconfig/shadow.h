@@ -0,0 +1,165 @@
+/*
+ *  Copyright (c) 2019 Zytronic Displays Limited. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact Zytronic, you can do so either via the
+ * website <www.zytronic.co.uk> or by paper mail:
+ * Zytronic, Whiteley Road, Blaydon on Tyne, Tyne & Wear, NE21 5NJ, UK
+ */
+
+
+
+
+
+
+/* Module Overview
+   ===============
+   This code keeps a host side copy (a shadow) of the configuration and
+   status values of a controller, so read-mostly code does not spend a
+   control transfer on each value that cannot have changed.
+
+   Each entry is valid, stale or dirty:
+    - valid entries were read from, or written to, the device, and are
+      returned by shadow_get() until they expire or are invalidated
+    - stale entries are read from the device on their next use
+    - dirty entries hold a configuration value that is still to be written
+      to the device, see shadow_markDirty() and shadow_getDirty()
+
+   How long an entry stays valid is a per-index policy.  Configuration
+   values change when written, or when a command (a reset, a restore of
+   defaults, a mode change, ...) invalidates them, but may also be changed by
+   another process sharing the device (most easily over hidraw), so they are
+   kept for SHADOW_CONFIG_TTL_MS at most.  Status values are volatile, and
+   are not kept, with the exception of those that describe the controller
+   itself (the number of wires, the option bits, the processor ID, ...),
+   which are kept as long as the device is open.
+
+   All services may be called from any thread.
+
+ */
+
+#ifndef _ZY_SHADOW_H
+#define _ZY_SHADOW_H
+
+#include "zytypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define  SHADOW_NUM_INDEX           (256)
+
+// entry lifetimes, in ms, for shadow_setPolicy()
+#define  SHADOW_TTL_NEVER           (0)     // not kept, always read
+#define  SHADOW_TTL_FOREVER         (-1)    // kept until invalidated
+
+// default lifetime of config values, see above
+#define  SHADOW_CONFIG_TTL_MS       (2000)
+
+typedef enum
+{
+    SHADOW_CONFIG,
+    SHADOW_STATUS,
+    SHADOW_NUM_KINDS
+} ShadowKind;
+
+// shadow counters
+typedef struct shadow_stats
+{
+    uint32_t    hits;               // values answered from the shadow
+    uint32_t    misses;             // values that had to be read
+    uint32_t    dirty;              // config values waiting to be written
+} shadow_stats_t;
+
+typedef struct zul_shadow zul_shadow_t;
+
+
+/**
+ * Create an empty shadow, with the default policy of the product ID (which
+ * may be zero, if no device is yet open).  NULL is returned if there is no
+ * memory.
+ */
+/*@null@*/
+zul_shadow_t *  shadow_create               (int16_t pid);
+void            shadow_destroy              (/*@null@*/ zul_shadow_t *sh);
+
+/**
+ * Forget all entries, including any dirty entries, and select the default
+ * policy of the product ID.  Call when the device is opened or closed.
+ */
+void            shadow_reset                (zul_shadow_t *sh, int16_t pid);
+
+/**
+ * Mark all entries stale.  Dirty entries are kept, as they have not yet
+ * reached the device.
+ */
+void            shadow_invalidate           (zul_shadow_t *sh);
+
+/**
+ * Set how long entries of an index are kept, in ms, or one of the
+ * SHADOW_TTL_ values.
+ */
+void            shadow_setPolicy            (zul_shadow_t *sh, ShadowKind kind,
+                                                uint8_t index, int32_t ttlMs);
+
+/**
+ * If the shadow holds a current value (valid or dirty) of an index, set
+ * *value and return true.  Else return false: the value must be read.
+ */
+bool            shadow_get                  (zul_shadow_t *sh, ShadowKind kind,
+                                                uint8_t index, uint16_t *value);
+
+/**
+ * Record a value read from, or written to, the device.  A dirty entry is
+ * not changed, as the value waiting to be written takes precedence.
+ */
+void            shadow_put                  (zul_shadow_t *sh, ShadowKind kind,
+                                                uint8_t index, uint16_t value);
+
+/**
+ * Record a config value written to the device.  Any dirty mark is cleared,
+ * as the value written takes the place of the one waiting.
+ */
+void            shadow_written              (zul_shadow_t *sh, uint8_t index,
+                                                uint16_t value);
+
+/**
+ * Record a config value to be written to the device later, and clear the
+ * dirty mark once the device is known to hold it.  The mark is only cleared
+ * if the entry still holds that value, so a value deferred again meanwhile
+ * is not lost.
+ */
+void            shadow_markDirty            (zul_shadow_t *sh, uint8_t index,
+                                                uint16_t value);
+void            shadow_clearDirty           (zul_shadow_t *sh, uint8_t index,
+                                                uint16_t value);
+
+/**
+ * Copy the dirty config entries, up to max of them, in index order.
+ * Return the number copied.
+ */
+int             shadow_getDirty             (zul_shadow_t *sh, uint8_t *index,
+                                                uint16_t *value, int max);
+
+void            shadow_getStats             (zul_shadow_t *sh,
+                                                shadow_stats_t *stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ZY_SHADOW_H
@@ -0,0 +1,426 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* This code is provided as an example only.
+ * It puts a touchscreen controller into private (silent) touch mode, and
+ * relays its touches to the desktop through a uinput multitouch device, so
+ * that they may be processed on the host first, see mtbridge.h.
+ *
+ * A recorded report stream (see -R) may be replayed through the bridge, with
+ * no controller attached, to a uinput node or to a capture file.  Each line
+ * of a recording holds the microseconds since the first report, and the 64
+ * bytes of the report in hex.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <ctype.h>
+
+#include "zytypes.h"
+#include "debug.h"
+#include "usb.h"
+#include "protocol.h"
+#include "services.h"
+#include "mtbridge.h"
+
+#define TEMP_BUF_LEN        (1000)
+#define REPORT_LEN          (64)
+#define EXPIRE_MS           (200)
+
+int                 g_deviceIndex   = -1;
+char                g_node[200+1]   = MTB_DEFAULT_NODE;
+char                g_replay[200+1] = "";
+char                g_record[200+1] = "";
+bool                g_fastReplay    = false;
+int                 g_statsPeriod   = 10;       // seconds, 0 => at exit only
+mtb_transform_t     g_xf;
+
+zul_mtbridge_t *    g_bridge        = NULL;
+bool                g_deviceOpen    = false;
+FILE *              g_recordFp      = NULL;
+uint64_t            g_recordStartUs = 0;
+
+
+// ----------------------------------------------------------------------------
+
+void printLatency(char const *title)
+{
+    mtb_latency_t       lat;
+    lat_hist_t const *  h = &lat.latency;
+
+    mtb_getLatency(g_bridge, &lat, false);
+    printf("%s: %u reports, latency us min %u mean %u p50 %u p99 %u max %u",
+                title, h->count, h->minUs,
+                (h->count > 0) ? (unsigned)(h->totalUs / h->count) : 0u,
+                lat_percentile(h, 50),
+                lat_percentile(h, 99), h->maxUs );
+    if ((lat.dropped > 0) || (lat.writeErrors > 0))
+    {
+        printf(", %u contacts dropped, %u write errors",
+                                                lat.dropped, lat.writeErrors);
+    }
+    printf("\n");
+}
+
+/**
+ * RAW_DATA handler, on the input thread: bridge, then record, the report
+ */
+void handle_bridgeReport(uint8_t *data)
+{
+    uint64_t rxUs = zul_monotonicUs();
+    int      i;
+
+    if (*data != RAW_DATA) return;
+
+    (void)mtb_report(g_bridge, data, REPORT_LEN, rxUs);
+
+    if (g_recordFp != NULL)
+    {
+        if (g_recordStartUs == 0) g_recordStartUs = rxUs;
+        fprintf(g_recordFp, "%llu", (unsigned long long)(rxUs - g_recordStartUs));
+        for (i = 0; i < REPORT_LEN; i++) fprintf(g_recordFp, " %02x", data[i]);
+        fprintf(g_recordFp, "\n");
+    }
+}
+
+/**
+ * Replay a recording through the bridge.  Return the reports replayed, or
+ * -1 if the file cannot be read.
+ */
+int replayRecording(char const *fileName)
+{
+    FILE *      fp;
+    char        lineBuffer[400+1];
+    uint8_t     report[REPORT_LEN];
+    uint64_t    startUs = zul_monotonicUs();
+    int         lineNum = 0, count = 0;
+
+    fp = fopen(fileName, "r");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "cannot open %s: %s\n", fileName, strerror(errno));
+        return -1;
+    }
+
+    while (fgets(lineBuffer, sizeof(lineBuffer), fp) != NULL)
+    {
+        unsigned long long  offsetUs;
+        char *              p = lineBuffer;
+        char *              end;
+        int                 i;
+
+        lineNum++;
+        while (isspace((unsigned char)*p)) p++;
+        if ((*p == '#') || (*p == '\0')) continue;
+
+        offsetUs = strtoull(p, &end, 10);
+        memset(report, 0, sizeof(report));
+        for (i = 0; i < REPORT_LEN; i++)
+        {
+            unsigned long value;
+
+            p = end;
+            value = strtoul(p, &end, 16);
+            if (end == p) break;
+            report[i] = (uint8_t)value;
+        }
+        if (i < 2)
+        {
+            fprintf(stderr, "%s:%d: no report\n", fileName, lineNum);
+            continue;
+        }
+
+        if (!g_fastReplay)
+        {
+            uint64_t dueUs = startUs + offsetUs;
+            uint64_t nowUs = zul_monotonicUs();
+
+            if (dueUs > nowUs) (void)usleep((useconds_t)(dueUs - nowUs));
+        }
+        if (report[0] == RAW_DATA)
+        {
+            (void)mtb_report(g_bridge, report, REPORT_LEN, zul_monotonicUs());
+            count++;
+        }
+    }
+    (void)fclose(fp);
+    return count;
+}
+
+// ----------------------------------------------------------------------------
+
+void cleanup(void)
+{
+    printf("CleanUp .. \n");
+    if (g_bridge != NULL)
+    {
+        printLatency("bridge");
+    }
+    if (g_deviceOpen)
+    {
+        zul_SetPrivateTouchMode(false);
+        (void)zul_closeDevice();
+        g_deviceOpen = false;
+    }
+    mtb_destroy(g_bridge);
+    g_bridge = NULL;
+    if (g_recordFp != NULL) (void)fclose(g_recordFp);
+    g_recordFp = NULL;
+    zul_EndServices();
+    printf("Done !\n");
+}
+
+void sigHandler( int sig)
+{
+    printf("handling signal %d\n", sig);
+    exit(0);
+}
+
+void setupHandlers(void)
+{
+    if (atexit(cleanup) != 0)
+    {
+        fprintf(stderr, "cannot set exit function\n");
+        exit(-1);
+    }
+
+    if (SIG_ERR == signal( SIGHUP, sigHandler))
+        printf ("Error loading signal handler SIGHUP\n");
+
+    if (SIG_ERR == signal( SIGINT, sigHandler))
+        printf ("Error loading signal handler SIGINT\n");
+
+    if (SIG_ERR == signal( SIGQUIT, sigHandler))
+        printf ("Error loading signal handler SIGQUIT\n");
+
+    if (SIG_ERR == signal( SIGTERM, sigHandler))
+        printf ("Error loading signal handler SIGTERM\n");
+}
+
+// ----------------------------------------------------------------------------
+
+
+void handleCommandLineOptions(int argCount, char **argStrings)
+{
+    int c;
+    opterr = 0;
+
+    while ((c = getopt (argCount, argStrings, "hd:n:r:R:fsxyX:Y:p:v:")) != -1)
+    {
+        switch (c)
+        {
+            case 'h':
+                fprintf(stderr, "This console program relays the touches of a Zytronic Touchscreen controller, in\nprivate touch mode, to a uinput multitouch device.\n");
+                fprintf(stderr, "The following options are accepted:\n");
+                fprintf(stderr, "-d\ta device index\n");
+                fprintf(stderr, "-n\tthe uinput node, or a capture file (default %s)\n", MTB_DEFAULT_NODE);
+                fprintf(stderr, "-r\treplay a recording, rather than relay a device\n");
+                fprintf(stderr, "-f\treplay as fast as possible, rather than at the recorded pace\n");
+                fprintf(stderr, "-R\trecord the reports of the device to a file\n");
+                fprintf(stderr, "-s\tswap the X and Y axes\n");
+                fprintf(stderr, "-x\tinvert the X axis\n");
+                fprintf(stderr, "-y\tinvert the Y axis\n");
+                fprintf(stderr, "-X\tthe X range of the input device (default 0..%d)\n", MTB_IN_MAX);
+                fprintf(stderr, "-Y\tthe Y range of the input device (default 0..%d)\n", MTB_IN_MAX);
+                fprintf(stderr, "-p\tthe latency report period in seconds, 0 for at exit only (default %d)\n", g_statsPeriod);
+                fprintf(stderr, "-v\tthe log level\n");
+                fprintf(stderr, "Usage : %s <options>\n", argStrings[0] );
+
+                exit(0);
+
+            case 'd':
+                g_deviceIndex = abs(atoi(optarg));
+                break;
+
+            case 'n':
+                strncpy(g_node, optarg, 200);
+                g_node[200] = '\0';
+                break;
+
+            case 'r':
+                strncpy(g_replay, optarg, 200);
+                g_replay[200] = '\0';
+                break;
+
+            case 'R':
+                strncpy(g_record, optarg, 200);
+                g_record[200] = '\0';
+                break;
+
+            case 'f':
+                g_fastReplay = true;
+                break;
+
+            case 's':
+                g_xf.swapXY = true;
+                break;
+
+            case 'x':
+                g_xf.invertX = true;
+                break;
+
+            case 'y':
+                g_xf.invertY = true;
+                break;
+
+            case 'X':
+                g_xf.outMaxX = abs(atoi(optarg));
+                break;
+
+            case 'Y':
+                g_xf.outMaxY = abs(atoi(optarg));
+                break;
+
+            case 'p':
+                g_statsPeriod = abs(atoi(optarg));
+                break;
+
+            case 'v':
+                zul_setLogLevel(atoi(optarg));
+                break;
+
+            case '?':
+                if (strchr("dnrRXYpv", optopt) != NULL)
+                    fprintf (stderr, "Option -%c requires an argument.\n", optopt);
+                else if (isprint (optopt))
+                    fprintf (stderr, "Unknown option `-%c'.\n", optopt);
+                else
+                    fprintf (stderr,
+                        "Unknown option character `\\x%x'.\n",
+                        optopt);
+                exit(1);
+            default:
+                abort();
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+int main(int numArgs, char ** argv)
+{
+    int         i;
+    int         numDevs;
+    char        tempBuffer[TEMP_BUF_LEN +1];
+    uint64_t    lastStatsUs;
+
+    handleCommandLineOptions(numArgs, argv);
+
+    i = zul_InitServices();
+    if (i!=0)
+    {
+        printf("zylibUSB open fail %d\n", i);
+        exit(EXIT_FAILURE);
+    }
+    setupHandlers();    // auto close library if interrupted
+
+    g_bridge = mtb_create(g_node, NULL, &g_xf);
+    if (g_bridge == NULL)
+    {
+        fprintf(stderr, "cannot create the bridge on %s\n", g_node);
+        exit(EXIT_FAILURE);
+    }
+
+    if (strlen(g_replay) > 0)
+    {
+        i = replayRecording(g_replay);
+        if (i < 0) exit(EXIT_FAILURE);
+        printf("replayed %d reports from %s\n", i, g_replay);
+        exit(0);
+    }
+
+    numDevs = zul_getDeviceList(tempBuffer, TEMP_BUF_LEN);
+    if (numDevs > 0)
+    {
+        printf("Found Zytronic touchscreen devices:\n%s", tempBuffer);
+        if (g_deviceIndex == -1)
+        {
+            g_deviceIndex = atoi(tempBuffer);
+        }
+    }
+    if (numDevs == 0)
+    {
+        printf("No Zytronic devices found\n");
+        exit(EXIT_FAILURE);
+    }
+    if (numDevs < 0)
+    {
+        printf("ERROR %d\n", numDevs);
+        exit(EXIT_FAILURE);
+    }
+
+    if (strlen(g_record) > 0)
+    {
+        g_recordFp = fopen(g_record, "w");
+        if (g_recordFp == NULL)
+        {
+            fprintf(stderr, "cannot create %s: %s\n", g_record, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        fprintf(g_recordFp, "# us, report\n");
+    }
+
+    printf( "Open device #%d ... ", g_deviceIndex );
+    i = zul_openDevice(g_deviceIndex);
+    if (i != 0)
+    {
+        printf( "Error [%d] opening device index %d.\n", i, g_deviceIndex );
+        exit(EXIT_FAILURE);
+    }
+    printf( "OPENED\n" );
+    g_deviceOpen = true;
+
+    // the bridge takes the private touches in place of the library's queue
+    zul_SetPrivateTouchMode(true);
+    zul_SetSpecialHandler(RAW_DATA, handle_bridgeReport);
+
+    printf("relaying touches to %s, ^C to stop\n", g_node);
+    lastStatsUs = zul_monotonicUs();
+    while (true)
+    {
+        (void)usleep(EXPIRE_MS * 1000);
+
+        // release the contacts whose release was lost
+        (void)mtb_report(g_bridge, NULL, 0, 0);
+
+        if ( (g_statsPeriod > 0) &&
+             (zul_monotonicUs() - lastStatsUs >= (uint64_t)g_statsPeriod * 1000000u) )
+        {
+            printLatency("bridge");
+            lastStatsUs = zul_monotonicUs();
+        }
+    }
+
+    //     zul_EndServices();   // see atexit(cleanup) !
+    return 0;
+}
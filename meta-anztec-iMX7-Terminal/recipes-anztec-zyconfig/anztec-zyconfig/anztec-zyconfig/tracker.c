@@ -0,0 +1,558 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* For a module overview, see the header file
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#include "tracker.h"
+#include "debug.h"
+
+//
+// --- Module Types ---
+//
+
+#define RECORD_LEN_MT               (6)
+#define RECORD_LEN_100              (5)
+#define MAX_RECORDS                 (10)
+
+/**
+ * The contact table, one array per field, indexed by contact ID, so the
+ * scan of a field touches as few cache lines as possible.
+ */
+struct zul_tracker
+{
+    // odd while the writer is updating the table
+    _Atomic uint32_t    seq;
+    _Atomic bool        resetPending;
+
+    uint32_t            frame;
+    uint32_t            touches;
+    uint32_t            releases;
+
+    uint8_t             state   [TRK_MAX_CONTACTS];
+    uint16_t            x       [TRK_MAX_CONTACTS];
+    uint16_t            y       [TRK_MAX_CONTACTS];
+    uint64_t            downUs  [TRK_MAX_CONTACTS];
+    uint64_t            lastUs  [TRK_MAX_CONTACTS];
+
+    // position histories, each a ring of TRK_HISTORY
+    uint8_t             histHead[TRK_MAX_CONTACTS];     // the next to write
+    uint8_t             histLen [TRK_MAX_CONTACTS];
+    uint16_t            histX   [TRK_MAX_CONTACTS][TRK_HISTORY];
+    uint16_t            histY   [TRK_MAX_CONTACTS][TRK_HISTORY];
+
+    // event signalling, see trk_waitEvent()
+    pthread_mutex_t     evLock;
+    pthread_cond_t      evCond;
+    uint32_t            evCount[3];     // by event bit: down, move, up
+    int                 evPending;      // events since trk_ackEvents()
+    int                 evFd[2];        // read, write: an eventfd, or a pipe
+};
+
+
+//
+// --- Private Prototypes ---
+//
+
+static void     trk_clear               (zul_tracker_t *trk);
+static int      trk_apply               (zul_tracker_t *trk, uint8_t ID,
+                                            bool down, uint16_t x, uint16_t y,
+                                            uint64_t now);
+static void     trk_copySlot            (zul_tracker_t const *trk, int ID,
+                                            uint64_t now, trk_contact_t *c);
+static void     trk_signal              (zul_tracker_t *trk, int events);
+static bool     trk_openEventFd         (zul_tracker_t *trk);
+static uint32_t trk_readBegin           (zul_tracker_t *trk);
+static bool     trk_readRetry           (zul_tracker_t *trk, uint32_t seq);
+
+
+// ============================================================================
+// --- Public Implementation ---
+// ============================================================================
+
+zul_tracker_t * trk_create(void)
+{
+    zul_tracker_t      *trk = (zul_tracker_t *)calloc(1, sizeof(zul_tracker_t));
+    pthread_condattr_t  attr;
+
+    if (trk == NULL) return NULL;
+    atomic_init(&trk->seq, 0);
+    atomic_init(&trk->resetPending, false);
+
+    if (!trk_openEventFd(trk))
+    {
+        free(trk);
+        return NULL;
+    }
+    (void)pthread_mutex_init(&trk->evLock, NULL);
+    (void)pthread_condattr_init(&attr);
+    (void)pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    (void)pthread_cond_init(&trk->evCond, &attr);
+    (void)pthread_condattr_destroy(&attr);
+    return trk;
+}
+
+void trk_destroy(zul_tracker_t *trk)
+{
+    if (trk == NULL) return;
+
+    (void)pthread_cond_destroy(&trk->evCond);
+    (void)pthread_mutex_destroy(&trk->evLock);
+    (void)close(trk->evFd[0]);
+    if (trk->evFd[1] != trk->evFd[0]) (void)close(trk->evFd[1]);
+    free(trk);
+}
+
+void trk_reset(zul_tracker_t *trk)
+{
+    if (trk == NULL) return;
+    atomic_store_explicit(&trk->resetPending, true, memory_order_release);
+}
+
+int trk_update(zul_tracker_t *trk, uint8_t const *data, int len)
+{
+    uint64_t        now = zul_monotonicUs();
+    uint32_t        seq;
+    uint8_t const  *p;
+    int             num = 0, events = 0;
+    int             i;
+
+    if ((trk == NULL) || (data == NULL) || (len < 1 + RECORD_LEN_100)) return 0;
+
+    seq = atomic_load_explicit(&trk->seq, memory_order_relaxed);
+    atomic_store_explicit(&trk->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    if (atomic_exchange_explicit(&trk->resetPending, false, memory_order_acquire))
+    {
+        trk_clear(trk);
+    }
+    trk->frame++;
+
+    // contacts released by the previous report are now idle
+    for (i = 0; i < TRK_MAX_CONTACTS; i++)
+    {
+        if (trk->state[i] == TRK_UP) trk->state[i] = TRK_IDLE;
+    }
+
+    p = data + 1;
+    while ((num < MAX_RECORDS) && (p + RECORD_LEN_MT <= data + len))
+    {
+        uint8_t flags = p[0] & 0x07;
+
+        if ((flags == 7) || (flags == 4))
+        {
+            // ZXY100: a single contact, without an ID
+            events |= trk_apply(trk, 0, (flags == 7),
+                        (uint16_t)(p[1] | (p[2] << 8)),
+                        (uint16_t)(p[3] | (p[4] << 8)), now);
+            num++;
+            break;
+        }
+        if ((flags != 3) && (flags != 0)) break;
+
+        // an empty record ends the list
+        if ( (num > 0) && (p[0] == 0) && (p[1] == 0) &&
+             (p[2] == 0) && (p[3] == 0) && (p[4] == 0) && (p[5] == 0) )
+        {
+            break;
+        }
+
+        if (p[1] < TRK_MAX_CONTACTS)
+        {
+            events |= trk_apply(trk, p[1], (flags == 3),
+                        (uint16_t)(p[2] | (p[3] << 8)),
+                        (uint16_t)(p[4] | (p[5] << 8)), now);
+        }
+        else
+        {
+            zul_logf(4, "%s: contact ID %d out of range", __FUNCTION__, p[1]);
+        }
+        num++;
+        p += RECORD_LEN_MT;
+    }
+
+    // contacts whose release was lost
+    for (i = 0; i < TRK_MAX_CONTACTS; i++)
+    {
+        if ( ((trk->state[i] == TRK_DOWN) || (trk->state[i] == TRK_MOVE)) &&
+             (now - trk->lastUs[i] > (uint64_t)TRK_LOST_MS * 1000u) )
+        {
+            trk->state[i] = TRK_UP;
+            trk->releases++;
+            events |= TRK_EV_UP;
+        }
+    }
+
+    atomic_store_explicit(&trk->seq, seq + 2, memory_order_release);
+
+    if (events != 0) trk_signal(trk, events);
+    return num;
+}
+
+void trk_snapshot(zul_tracker_t *trk, trk_snapshot_t *snap)
+{
+    uint64_t    now = zul_monotonicUs();
+    uint32_t    seq;
+    int         i;
+
+    if (snap == NULL) return;
+    snap->frame = snap->touches = snap->releases = 0;
+    snap->count = 0;
+    if (trk == NULL) return;
+
+    do
+    {
+        seq = trk_readBegin(trk);
+
+        snap->frame     = trk->frame;
+        snap->touches   = trk->touches;
+        snap->releases  = trk->releases;
+        snap->count     = 0;
+        if (!atomic_load_explicit(&trk->resetPending, memory_order_relaxed))
+        {
+            for (i = 0; i < TRK_MAX_CONTACTS; i++)
+            {
+                if (trk->state[i] == TRK_IDLE) continue;
+                trk_copySlot(trk, i, now, &snap->contact[snap->count++]);
+            }
+        }
+    } while (trk_readRetry(trk, seq));
+}
+
+int trk_waitEvent(zul_tracker_t *trk, int timeoutMs, int mask)
+{
+    struct timespec deadline;
+    uint32_t        start[3];
+    int             seen = 0;
+    int             b;
+
+    if ((trk == NULL) || ((mask & TRK_EV_ANY) == 0)) return 0;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &deadline);
+    if (timeoutMs >= 0)
+    {
+        deadline.tv_sec  += timeoutMs / 1000;
+        deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_nsec -= 1000000000L;
+            deadline.tv_sec++;
+        }
+    }
+
+    (void)pthread_mutex_lock(&trk->evLock);
+    memcpy(start, trk->evCount, sizeof(start));
+    for (;;)
+    {
+        int rc;
+
+        for (b = 0; b < 3; b++)
+        {
+            if ((mask & (1 << b)) && (trk->evCount[b] != start[b])) seen |= 1 << b;
+        }
+        if (seen != 0) break;
+
+        if (timeoutMs < 0)
+        {
+            rc = pthread_cond_wait(&trk->evCond, &trk->evLock);
+        }
+        else
+        {
+            rc = pthread_cond_timedwait(&trk->evCond, &trk->evLock, &deadline);
+        }
+        if (rc == ETIMEDOUT) break;
+    }
+    (void)pthread_mutex_unlock(&trk->evLock);
+
+    return seen;
+}
+
+int trk_getEventFd(zul_tracker_t *trk)
+{
+    return (trk != NULL) ? trk->evFd[0] : -1;
+}
+
+int trk_ackEvents(zul_tracker_t *trk)
+{
+    uint64_t    drain;
+    int         events;
+
+    if (trk == NULL) return 0;
+
+    (void)pthread_mutex_lock(&trk->evLock);
+    while (read(trk->evFd[0], &drain, sizeof(drain)) > 0)
+    {
+        ;   // empty the eventfd, or the pipe
+    }
+    events = trk->evPending;
+    trk->evPending = 0;
+    (void)pthread_mutex_unlock(&trk->evLock);
+
+    return events;
+}
+
+/**
+ * The contact is read under the event lock, which trk_signal() takes after
+ * each update, so a release between the read and the wait is not missed.
+ * A contact whose release is lost is up TRK_LOST_MS after it was last
+ * reported, without an event, so the wait is also cut short then.
+ */
+bool trk_waitRelease(zul_tracker_t *trk, uint8_t ID, int timeoutMs,
+                                                    trk_contact_t *contact)
+{
+    uint64_t    deadlineUs  = UINT64_MAX;
+    uint64_t    downUs      = 0;
+    bool        released    = false;
+
+    if ((trk == NULL) || (contact == NULL) || (ID >= TRK_MAX_CONTACTS))
+    {
+        return false;
+    }
+    if (timeoutMs >= 0)
+    {
+        deadlineUs = zul_monotonicUs() + (uint64_t)timeoutMs * 1000u;
+    }
+
+    (void)pthread_mutex_lock(&trk->evLock);
+    for (;;)
+    {
+        struct timespec until;
+        uint64_t        nowUs, waitUs;
+
+        (void)trk_getContact(trk, ID, contact);
+        if ((contact->state == TRK_DOWN) || (contact->state == TRK_MOVE))
+        {
+            // down since the call, or else released and down again
+            if (downUs == 0) downUs = contact->downUs;
+            released = (contact->downUs != downUs);
+        }
+        else
+        {
+            released = true;
+        }
+        if (released) break;
+
+        nowUs = zul_monotonicUs();
+        if (nowUs >= deadlineUs) break;
+
+        waitUs = contact->lastUs + (uint64_t)TRK_LOST_MS * 1000u + 1000u;
+        if ((waitUs <= nowUs) || (waitUs > deadlineUs)) waitUs = deadlineUs;
+        if (waitUs == UINT64_MAX)
+        {
+            (void)pthread_cond_wait(&trk->evCond, &trk->evLock);
+            continue;
+        }
+        until.tv_sec  = (time_t)(waitUs / 1000000u);
+        until.tv_nsec = (long)(waitUs % 1000000u) * 1000L;
+        (void)pthread_cond_timedwait(&trk->evCond, &trk->evLock, &until);
+    }
+    (void)pthread_mutex_unlock(&trk->evLock);
+
+    return released;
+}
+
+bool trk_getContact(zul_tracker_t *trk, uint8_t ID, trk_contact_t *contact)
+{
+    uint64_t now = zul_monotonicUs();
+    uint32_t seq;
+
+    if ((trk == NULL) || (contact == NULL) || (ID >= TRK_MAX_CONTACTS))
+    {
+        return false;
+    }
+
+    do
+    {
+        seq = trk_readBegin(trk);
+        trk_copySlot(trk, ID, now, contact);
+    } while (trk_readRetry(trk, seq));
+    return true;
+}
+
+
+// ============================================================================
+// --- Private Implementation ---
+// ============================================================================
+
+static void trk_clear(zul_tracker_t *trk)
+{
+    memset(trk->state,    0, sizeof(trk->state));
+    memset(trk->histLen,  0, sizeof(trk->histLen));
+    memset(trk->histHead, 0, sizeof(trk->histHead));
+}
+
+/**
+ * Apply one contact record.  Called by the writer, within the update.
+ */
+static int trk_apply(zul_tracker_t *trk, uint8_t ID, bool down,
+                                    uint16_t x, uint16_t y, uint64_t now)
+{
+    uint8_t s = trk->state[ID];
+    int     event;
+
+    if (!down)
+    {
+        // a release of a contact not down is repeated, or stale: ignore it
+        if ((s != TRK_DOWN) && (s != TRK_MOVE)) return 0;
+        trk->state[ID] = TRK_UP;
+        trk->releases++;
+        event = TRK_EV_UP;
+    }
+    else if ((s == TRK_DOWN) || (s == TRK_MOVE))
+    {
+        trk->state[ID] = TRK_MOVE;
+        event = TRK_EV_MOVE;
+    }
+    else
+    {
+        trk->state[ID]    = TRK_DOWN;
+        trk->downUs[ID]   = now;
+        trk->histLen[ID]  = 0;
+        trk->histHead[ID] = 0;
+        trk->touches++;
+        event = TRK_EV_DOWN;
+    }
+
+    trk->x[ID]      = x;
+    trk->y[ID]      = y;
+    trk->lastUs[ID] = now;
+
+    trk->histX[ID][trk->histHead[ID]] = x;
+    trk->histY[ID][trk->histHead[ID]] = y;
+    trk->histHead[ID] = (uint8_t)((trk->histHead[ID] + 1) % TRK_HISTORY);
+    if (trk->histLen[ID] < TRK_HISTORY) trk->histLen[ID]++;
+    return event;
+}
+
+/**
+ * Wake the waiters, and make the event fd readable.  Called by the writer.
+ */
+static void trk_signal(zul_tracker_t *trk, int events)
+{
+    uint64_t    one = 1;
+    bool        wasPending;
+    int         b;
+
+    (void)pthread_mutex_lock(&trk->evLock);
+    for (b = 0; b < 3; b++)
+    {
+        if (events & (1 << b)) trk->evCount[b]++;
+    }
+    wasPending = (trk->evPending != 0);
+    trk->evPending |= events;
+    (void)pthread_cond_broadcast(&trk->evCond);
+    (void)pthread_mutex_unlock(&trk->evLock);
+
+    // one write until acknowledged, so a pipe cannot fill
+    if (!wasPending && (write(trk->evFd[1], &one, sizeof(one)) < 0))
+    {
+        zul_logf(4, "%s: %s", __FUNCTION__, strerror(errno));
+    }
+}
+
+/**
+ * A non-blocking eventfd where there is one, else a pipe
+ */
+static bool trk_openEventFd(zul_tracker_t *trk)
+{
+#ifdef __linux__
+    trk->evFd[0] = trk->evFd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return (trk->evFd[0] >= 0);
+#else
+    if (pipe(trk->evFd) != 0) return false;
+    (void)fcntl(trk->evFd[0], F_SETFL, O_NONBLOCK);
+    (void)fcntl(trk->evFd[1], F_SETFL, O_NONBLOCK);
+    return true;
+#endif
+}
+
+/**
+ * Copy a contact.  A contact not reported for TRK_LOST_MS is shown as up,
+ * as the reports may have stopped before its release was seen.
+ */
+static void trk_copySlot(zul_tracker_t const *trk, int ID, uint64_t now,
+                                                        trk_contact_t *c)
+{
+    int n   = trk->histLen[ID];
+    int src = (trk->histHead[ID] + TRK_HISTORY - n) % TRK_HISTORY;
+    int i;
+
+    c->ID       = (uint8_t)ID;
+    c->state    = trk->state[ID];
+    c->x        = trk->x[ID];
+    c->y        = trk->y[ID];
+    c->downUs   = trk->downUs[ID];
+    c->lastUs   = trk->lastUs[ID];
+    c->histLen  = n;
+    if ( ((c->state == TRK_DOWN) || (c->state == TRK_MOVE)) &&
+         (now > c->lastUs) && (now - c->lastUs > (uint64_t)TRK_LOST_MS * 1000u) )
+    {
+        c->state = TRK_UP;
+    }
+    for (i = 0; i < n; i++)
+    {
+        c->histX[i] = trk->histX[ID][(src + i) % TRK_HISTORY];
+        c->histY[i] = trk->histY[ID][(src + i) % TRK_HISTORY];
+    }
+}
+
+/**
+ * Sequence count read: wait out an update in progress
+ */
+static uint32_t trk_readBegin(zul_tracker_t *trk)
+{
+    uint32_t seq;
+
+    while ((seq = atomic_load_explicit(&trk->seq, memory_order_acquire)) & 1)
+    {
+        (void)sched_yield();
+    }
+    return seq;
+}
+
+static bool trk_readRetry(zul_tracker_t *trk, uint32_t seq)
+{
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&trk->seq, memory_order_relaxed) != seq;
+}
@@ -0,0 +1,170 @@
+/*
+ *  Copyright (c) 2019 Zytronic Displays Limited. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact Zytronic, you can do so either via the
+ * website <www.zytronic.co.uk> or by paper mail:
+ * Zytronic, Whiteley Road, Blaydon on Tyne, Tyne & Wear, NE21 5NJ, UK
+ */
+
+
+
+
+
+
+/* Module Overview
+   ===============
+   This code follows every contact of the touch reports of a device (the
+   TOUCH_OS reports, or the RAW_DATA reports of private touch mode), rather
+   than the first alone, and keeps a table of the contacts, by contact ID:
+   their down/move/up state, the time they went down and were last seen, and
+   their most recent positions.
+
+   The table is updated by the thread that receives the reports (the single
+   writer), and read by the application through a snapshot.  Readers never
+   take a lock: the table is guarded by a sequence count, and a reader that
+   overlaps an update simply copies it again.
+
+   Report format:
+    - ZXY100 reports hold one contact, without an ID (flags 7 down, 4 up)
+    - ZXY110 and Multitouch reports hold up to 10 six byte contact records
+      (flags 3 down, 0 up; contact ID; X; Y), ended by an empty record
+
+   A contact that goes up stays in the TRK_UP state until the next report.
+   A contact not reported for TRK_LOST_MS (its release was lost) goes up.
+
+   Each report that brings a contact down, moves it or releases it signals
+   the touch events: trk_waitEvent() sleeps until one occurs, and the fd of
+   trk_getEventFd() becomes readable, for select()/poll()/epoll loops.
+
+ */
+
+#ifndef _ZY_TRACKER_H
+#define _ZY_TRACKER_H
+
+#include "zytypes.h"
+#include "zxymt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define  TRK_MAX_CONTACTS           (ZXY500_MAX_TOUCH)
+#define  TRK_HISTORY                (8)
+#define  TRK_LOST_MS                (1000)
+
+typedef enum
+{
+    TRK_IDLE,                       // no contact with this ID
+    TRK_DOWN,                       // first reported by the latest report
+    TRK_MOVE,                       // down, and reported again
+    TRK_UP                          // released by the latest report
+} TrackState;
+
+// one contact
+typedef struct trk_contact
+{
+    uint8_t     ID;
+    uint8_t     state;              // TrackState
+    int         x, y;
+    uint64_t    downUs;             // CLOCK_MONOTONIC microseconds
+    uint64_t    lastUs;
+    int         histLen;
+    int         histX[TRK_HISTORY]; // recent positions, oldest first,
+    int         histY[TRK_HISTORY]; // the last is x,y
+} trk_contact_t;
+
+// the contacts of the table that are not idle, in ID order
+typedef struct trk_snapshot
+{
+    uint32_t        frame;          // reports processed
+    uint32_t        touches;        // contacts gone down, since the start
+    uint32_t        releases;       // contacts gone up, since the start
+    int             count;
+    trk_contact_t   contact[TRK_MAX_CONTACTS];
+} trk_snapshot_t;
+
+// touch events, for trk_waitEvent()
+#define  TRK_EV_DOWN                (0x01)
+#define  TRK_EV_MOVE                (0x02)
+#define  TRK_EV_UP                  (0x04)
+#define  TRK_EV_ANY                 (TRK_EV_DOWN | TRK_EV_MOVE | TRK_EV_UP)
+
+typedef struct zul_tracker zul_tracker_t;
+
+
+/*@null@*/
+zul_tracker_t * trk_create                  (void);
+void            trk_destroy                 (/*@null@*/ zul_tracker_t *trk);
+
+/**
+ * Forget all contacts, e.g. when the device changes.  May be called from
+ * any thread; the table is cleared by the next trk_update().
+ */
+void            trk_reset                   (zul_tracker_t *trk);
+
+/**
+ * Writer: apply a touch report.  Only one thread may call this.
+ * Return the number of contact records decoded.
+ */
+int             trk_update                  (zul_tracker_t *trk,
+                                                uint8_t const *data, int len);
+
+/**
+ * Reader: copy the contacts that are not idle.  Any thread may call this.
+ */
+void            trk_snapshot                (zul_tracker_t *trk,
+                                                trk_snapshot_t *snap);
+
+/**
+ * Sleep until one of the events in mask occurs, or timeoutMs passes (wait
+ * indefinitely if negative).  Only events after the call are considered.
+ * Return the events of mask that occurred, or zero on timeout.
+ */
+int             trk_waitEvent               (zul_tracker_t *trk, int timeoutMs,
+                                                int mask);
+
+/**
+ * A non-blocking fd that is readable once an event occurs, until
+ * trk_ackEvents() is called.  The tracker owns the fd: do not read or close
+ * it.  trk_ackEvents() returns the events since it was last called.
+ */
+int             trk_getEventFd              (zul_tracker_t *trk);
+int             trk_ackEvents               (zul_tracker_t *trk);
+
+/**
+ * Reader: copy one contact, in any state.  The position of an idle contact
+ * is where it was last released.  Return false if the ID is out of range.
+ */
+bool            trk_getContact              (zul_tracker_t *trk, uint8_t ID,
+                                                trk_contact_t *contact);
+
+/**
+ * Sleep until the contact ID, down at the call, is released, or timeoutMs
+ * passes (wait indefinitely if negative).  A contact already up, or idle,
+ * counts as released at once, as does one released and down again.
+ * *contact is set to the contact as last read.  Return false on timeout.
+ */
+bool            trk_waitRelease             (zul_tracker_t *trk, uint8_t ID,
+                                                int timeoutMs,
+                                                trk_contact_t *contact);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ZY_TRACKER_H
@@ -0,0 +1,1226 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* For a module overview, see the header file
+ */
+
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "dbg2console.h"
+#include "transport.h"
+#include "debug.h"
+
+#define TP_ERROR_NOT_FOUND          (-5)    // as LIBUSB_ERROR_NOT_FOUND
+#define TP_ERROR_INVALID_PARAM      (-2)
+#define TP_ERROR_NO_DEVICE          (-4)
+#define TP_ERROR_BUSY               (-6)    // as LIBUSB_ERROR_BUSY
+#define TP_ERROR_NO_MEM             (-11)
+#define TP_ERROR_NOT_SUPPORTED      (-12)
+#define TP_POLL_INTERVAL_MS         (100)
+#define TP_LIST_LEN                 (2000)
+
+struct tp_device
+{
+    zul_transport_t const *     ops;
+    void *                      dev;
+
+    // as set by tp_devSetCtrlParams(), under qMutex
+    int                         ctrlDelay, ctrlRetry, ctrlTimeout;
+
+    // those last given to the transport, by the I/O thread alone
+    bool                        ctrlApplied;
+    int                         appDelay, appRetry, appTimeout;
+
+    // as set by tp_devRegisterHandler(), called through tp_devIN_dispatch()
+    usb_in_handler_t            IN_handler[MAX_REPORT_ID];
+    void *                      IN_context[MAX_REPORT_ID];
+
+    // the device's request queue, and its I/O thread, started at open
+    pthread_mutex_t             qMutex;
+    pthread_cond_t              qWork;
+    pthread_cond_t              qDone;
+    /*@null@*/
+    tp_request_t *              qHead;
+    /*@null@*/
+    tp_request_t *              qTail;
+    /*@null@*/
+    tp_request_t *              qActive;
+    pthread_t                   ioThread;
+    bool                        ioStop;
+};
+
+//
+// --- Module Global Variables ---
+//
+
+// the transports available for selection, the built in ones first
+static zul_transport_t const *  msv_transports[TP_MAX_TRANSPORTS] =
+{
+#ifdef __linux__
+    &usb_transport,
+    &hidraw_transport,
+#endif
+#if defined(__APPLE__) || defined(ZUL_HIDAPI)
+    &hidapi_transport,
+#endif
+    &mock_transport,
+};
+
+// selected by tp_select(), or else chosen at tp_openLib()
+/*@null@*/
+static zul_transport_t const *  msv_selected            = NULL;
+/*@null@*/
+static zul_transport_t const *  msv_tp                  = NULL;     // library open
+
+// the single device services' device, and its state
+/*@null@*/
+static tp_device_t *            msv_dev                 = NULL;
+static char                     msv_lastAddr[20]        = "";
+static interrupt_handler_t      msv_IN_handler[MAX_REPORT_ID];
+static int                      msv_CtrlDelay           = -1;       // -1 => default
+static int                      msv_CtrlRetry           = -1;
+static int                      msv_CtrlTimeout         = -1;
+
+// the states of a request
+enum { TP_REQ_IDLE, TP_REQ_QUEUED, TP_REQ_ACTIVE, TP_REQ_DONE };
+
+// the device whose I/O thread this is, if any
+/*@null@*/
+static __thread tp_device_t *   msv_ioDevice            = NULL;
+
+// set while this thread is running an IN handler
+static __thread bool            msv_inHandler           = false;
+
+//
+// --- Private Prototypes ---
+//
+
+static zul_transport_t const *  tp_find         (char const *name);
+static zul_transport_t const *  tp_choose       (void);
+static tp_device_t *            tp_devWrap      (zul_transport_t const *ops,
+                                                    void *dev);
+static void         tp_applyDefaults            (void);
+static int          tp_runRequest               (tp_request_t *req,
+                                                    /*@null@*/ uint8_t *reply);
+static bool         tp_listFind                 (char const *list, int16_t pid,
+                                                    char const *addr,
+                                                    char *addrOut);
+static int          tp_pollForDevice            (int16_t pid, char const *addr,
+                                                    bool arrive, int timeoutMs,
+                                                    char *addrOut);
+static void         tp_IN_dispatch              (void *context, uint8_t *data);
+static void         tp_devIN_dispatch           (void *context, uint8_t *data);
+static void         tp_default_IN_handler       (uint8_t *data);
+static bool         tp_startIOThread            (tp_device_t *dev);
+static void         tp_stopIOThread             (tp_device_t *dev);
+static void *       tp_ioWorker                 (void *arg);
+static void         tp_execute                  (tp_request_t *req);
+static void         tp_complete                 (tp_request_t *req);
+
+
+// ============================================================================
+// --- Transport Selection ---
+// ============================================================================
+
+/**
+ * Add a transport to the table, if there is room and the name is unused
+ */
+int tp_register(zul_transport_t const *transport)
+{
+    int i;
+
+    if ((transport == NULL) || (transport->name == NULL)) return FAILURE;
+    if (tp_find(transport->name) != NULL) return FAILURE;
+
+    for (i = 0; i < TP_MAX_TRANSPORTS; i++)
+    {
+        if (msv_transports[i] == NULL)
+        {
+            msv_transports[i] = transport;
+            return SUCCESS;
+        }
+    }
+    return FAILURE;
+}
+
+/**
+ * Select the transport to be used at the next tp_openLib()
+ */
+int tp_select(char const *name)
+{
+    zul_transport_t const *tp;
+
+    if (msv_tp != NULL)
+    {
+        zul_logf(0, "%s - close the library first", __FUNCTION__);
+        return FAILURE;
+    }
+
+    tp = tp_find(name);
+    if (tp == NULL)
+    {
+        zul_logf(0, "%s - unknown transport '%s'", __FUNCTION__, name);
+        return FAILURE;
+    }
+
+    msv_selected = tp;
+    return SUCCESS;
+}
+
+char const * tp_name(void)
+{
+    zul_transport_t const *tp = (msv_tp != NULL) ? msv_tp : tp_choose();
+    return (tp != NULL) ? tp->name : "none";
+}
+
+void tp_listTransports(char *buf, int len)
+{
+    int i;
+
+    if ((buf == NULL) || (len < 1)) return;
+
+    buf[0] = '\0';
+    for (i = 0; i < TP_MAX_TRANSPORTS; i++)
+    {
+        if (msv_transports[i] == NULL) continue;
+        if (buf[0] != '\0') strncat(buf, " ", (size_t)len - strlen(buf) - 1);
+        strncat(buf, msv_transports[i]->name, (size_t)len - strlen(buf) - 1);
+    }
+}
+
+
+// ============================================================================
+// --- Single Device Services ---
+// ============================================================================
+
+/**
+ * Open the chosen transport.  Zero returned on success.
+ */
+int tp_openLib(void)
+{
+    int i, retVal;
+    zul_transport_t const *tp;
+
+    if (msv_tp != NULL) return 0;
+
+    tp = tp_choose();
+    if (tp == NULL)
+    {
+        zul_logf(0, "%s - no transport '%s'", __FUNCTION__, getenv(TP_ENV_VAR));
+        return -1;
+    }
+
+    zul_logf(3, "Transport: %s", tp->name);
+    retVal = tp->openLib();
+    if (retVal < 0)
+    {
+        return retVal;
+    }
+
+    for (i = 0; i < MAX_REPORT_ID; i++)
+    {
+        msv_IN_handler[i] = NULL;
+    }
+
+    msv_tp = tp;
+    return retVal;
+}
+
+void tp_closeLib(void)
+{
+    if (msv_tp == NULL) return;
+
+    if (msv_dev != NULL)
+    {
+        (void)tp_closeDevice();
+    }
+
+    msv_tp->closeLib();
+    msv_tp = NULL;
+}
+
+char * tp_libStr(void)
+{
+    static char unopened[] = "unopened";
+
+    if (msv_tp == NULL) return unopened;
+    return msv_tp->libStr();
+}
+
+int tp_getDeviceList(char *buf, int len)
+{
+    if (msv_tp == NULL) return -11;
+    return msv_tp->getDeviceList(buf, len);
+}
+
+/**
+ * Re-read the bus.  A transport without a cache simply re-lists its devices.
+ */
+int tp_rescanDevices(void)
+{
+    char list[TP_LIST_LEN + 1];
+
+    if (msv_tp == NULL) return -11;
+    if (msv_tp->rescan != NULL) return msv_tp->rescan();
+
+    return msv_tp->getDeviceList(list, TP_LIST_LEN);
+}
+
+int tp_waitForDevice(int16_t pid, int timeoutMs, char *addrStr)
+{
+    if (msv_tp == NULL) return -11;
+    if (msv_tp->waitForDevice != NULL)
+    {
+        return msv_tp->waitForDevice(pid, timeoutMs, addrStr);
+    }
+    return tp_pollForDevice(pid, NULL, true, timeoutMs, addrStr);
+}
+
+int tp_waitForDeviceLeft(char const *addrStr, int timeoutMs)
+{
+    if (msv_tp == NULL) return -11;
+    if (addrStr == NULL) return TP_ERROR_NOT_FOUND;
+    if (msv_tp->waitForDeviceLeft != NULL)
+    {
+        return msv_tp->waitForDeviceLeft(addrStr, timeoutMs);
+    }
+    return tp_pollForDevice(0, addrStr, false, timeoutMs, NULL);
+}
+
+/**
+ * Open a device, by index or address, for the single device services.
+ * Return 0 to indicate success, else a negative error code.
+ */
+int tp_openDevice(int index)
+{
+    int retVal;
+
+    if (msv_dev != NULL)
+    {
+        return -1;                      // busy !! one connection at a time
+    }
+
+    retVal = tp_devOpen(index, &msv_dev);
+    if (retVal == 0)
+    {
+        tp_applyDefaults();
+        (void)tp_devGetAddrStr(msv_dev, msv_lastAddr);
+    }
+    return retVal;
+}
+
+int tp_openDeviceByAddr(char const *addrStr)
+{
+    int retVal;
+
+    if (msv_dev != NULL)
+    {
+        return -1;                      // busy !! one connection at a time
+    }
+
+    retVal = tp_devOpenByAddr(addrStr, &msv_dev);
+    if (retVal == 0)
+    {
+        tp_applyDefaults();
+        (void)tp_devGetAddrStr(msv_dev, msv_lastAddr);
+    }
+    return retVal;
+}
+
+int tp_reOpenLastDevice(void)
+{
+    if (msv_lastAddr[0] == '\0') return -1;
+    return tp_openDeviceByAddr(msv_lastAddr);
+}
+
+int tp_closeDevice(void)
+{
+    int retVal;
+
+    if (msv_tp == NULL) return -11;
+    if (msv_dev == NULL) return -2;     // error - not open!
+
+    retVal = tp_devClose(msv_dev);
+    msv_dev = NULL;
+    return retVal;
+}
+
+int tp_getAddrStr(char *addrStr)
+{
+    if (msv_dev == NULL) return -1;
+    return tp_devGetAddrStr(msv_dev, addrStr);
+}
+
+bool tp_getDevicePID(int16_t *pid)
+{
+    if (msv_dev == NULL) return false;
+    return tp_devGetPID(msv_dev, pid);
+}
+
+bool tp_switchIFace(uint8_t iface)
+{
+    if (msv_dev == NULL) return false;
+    return tp_devSwitchIFace(msv_dev, iface);
+}
+
+/**
+ * The request of reqLen bytes is sent to the device, and if the handle_reply
+ * pointer-to-function is not null, the supplied function is called to handle
+ * the response.  Returns the number of bytes transferred, or a negative code.
+ */
+int tp_ControlRequest(uint8_t *request, uint16_t reqLen,
+                                            response_handler_t handle_reply)
+{
+    uint8_t reply[USB_PACKET_LEN];
+    int     res;
+
+    if (msv_dev == NULL) return TP_ERROR_NO_DEVICE;
+
+    res = tp_devControlRequest(msv_dev, request, reqLen,
+                                    (handle_reply != NULL) ? reply : NULL);
+
+    if ((res >= 0) && (handle_reply != NULL))
+    {
+        (void)handle_reply(reply);
+    }
+    return res;
+}
+
+int tp_ControlRequestCP(uint8_t *request, uint16_t reqLen,
+                                response_handler_t handle_reply,
+                                int delay, int retries, int timeout)
+{
+    uint8_t reply[USB_PACKET_LEN];
+    int     res;
+
+    if (msv_dev == NULL) return TP_ERROR_NO_DEVICE;
+
+    res = tp_devControlRequestCP(msv_dev, request, reqLen,
+                                    (handle_reply != NULL) ? reply : NULL,
+                                    delay, retries, timeout);
+
+    if ((res >= 0) && (handle_reply != NULL))
+    {
+        (void)handle_reply(reply);
+    }
+    return res;
+}
+
+/**
+ * As tp_ControlRequest(), where more than one reply is expected
+ * [see ZXY100 get single raw data].  The request and its replies are made
+ * as one queued request, so the replies are not interleaved with others.
+ */
+int tp_ControlRequestMR(uint8_t *request, uint16_t reqLen,
+                                response_handler_t handle_reply, int replies)
+{
+    tp_request_t req;
+    int          res;
+
+    if (replies < 1) return -1;
+    if (msv_dev == NULL) return TP_ERROR_NO_DEVICE;
+
+    if (!tp_prepareRequest(&req, msv_dev, request, reqLen, replies))
+    {
+        return TP_ERROR_INVALID_PARAM;
+    }
+    req.handler = handle_reply;
+
+    res = tp_submitRequest(&req);
+    if (res < 0) return res;
+    return tp_waitRequest(&req);
+}
+
+/**
+ * The control comms parameters are kept here, and applied to the device as
+ * it is opened.  See usb_setCtrlDelay() for their meaning.
+ */
+void tp_setCtrlDelay(int delay)
+{
+    msv_CtrlDelay = delay;
+    zul_logf (4, "%s - TX-RX Delay %d (ms)", __FUNCTION__, msv_CtrlDelay );
+    tp_applyDefaults();
+}
+
+void tp_defaultCtrlDelay(void)
+{
+    tp_setCtrlDelay(-1);
+}
+
+void tp_setCtrlRetry(int retries)
+{
+    msv_CtrlRetry = retries;
+    zul_logf (4, "%s %d Retries ", __FUNCTION__, msv_CtrlRetry );
+    tp_applyDefaults();
+}
+
+void tp_defaultCtrlRetry(void)
+{
+    tp_setCtrlRetry(-1);
+}
+
+void tp_setCtrlTimeout(int timeout)
+{
+    msv_CtrlTimeout = timeout;
+    zul_logf (4, "%s  %d(ms)", __FUNCTION__, msv_CtrlTimeout );
+    tp_applyDefaults();
+}
+
+void tp_defaultCtrlTimeout(void)
+{
+    tp_setCtrlTimeout(-1);
+}
+
+/**
+ * Handlers registered here survive the closing and re-opening of the single
+ * device, as those of usb_RegisterHandler().
+ */
+void tp_RegisterHandler(UsbReportID_t ReportID, interrupt_handler_t handler)
+{
+    if ((int)ReportID < MAX_REPORT_ID)
+    {
+        msv_IN_handler[ReportID] = handler;
+    }
+}
+
+void tp_ResetDefaultInHandlers(void)
+{
+    int i;
+    for (i = 0; i < MAX_REPORT_ID; i++)
+    {
+        tp_RegisterHandler( (UsbReportID_t)i, NULL );
+    }
+
+    // as of 2017, IN data is only expected on the following ReportIDs
+    tp_RegisterHandler( TOUCH_OS,          tp_default_IN_handler );
+    tp_RegisterHandler( RAW_DATA,          tp_default_IN_handler );
+    tp_RegisterHandler( HEARTBEAT_REPORT,  tp_default_IN_handler );
+}
+
+bool tp_getInStats(usb_in_stats_t *stats)
+{
+    if (msv_dev == NULL) return false;
+    return tp_devGetInStats(msv_dev, stats);
+}
+
+tp_device_t * tp_getDefaultDevice(void)
+{
+    return msv_dev;
+}
+
+
+// ============================================================================
+// --- Multiple Device Support ---
+// ============================================================================
+
+int tp_devOpen(int index, tp_device_t **dev)
+{
+    void   *handle = NULL;
+    int     retVal;
+
+    if (dev == NULL) return -20;
+    if (msv_tp == NULL) return -11;
+
+    retVal = msv_tp->devOpen(index, &handle);
+    if (retVal != 0) return retVal;
+
+    *dev = tp_devWrap(msv_tp, handle);
+    return (*dev != NULL) ? 0 : -11;
+}
+
+int tp_devOpenByAddr(char const *addrStr, tp_device_t **dev)
+{
+    void   *handle = NULL;
+    int     retVal;
+
+    if ((dev == NULL) || (addrStr == NULL)) return -20;
+    if (msv_tp == NULL) return -11;
+
+    retVal = msv_tp->devOpenByAddr(addrStr, &handle);
+    if (retVal != 0) return retVal;
+
+    *dev = tp_devWrap(msv_tp, handle);
+    return (*dev != NULL) ? 0 : -11;
+}
+
+int tp_devClose(tp_device_t *dev)
+{
+    int retVal;
+
+    if (dev == NULL) return -2;
+
+    // from the device's own I/O thread - it cannot wait for itself
+    if (msv_ioDevice == dev)
+    {
+        zul_logf(1, "%s - refused, from the device's I/O thread", __FUNCTION__);
+        return TP_ERROR_BUSY;
+    }
+    if (dev == msv_dev) msv_dev = NULL;
+
+    // let the requests already queued for the device complete
+    tp_syncRequests(dev);
+    tp_stopIOThread(dev);
+
+    retVal = dev->ops->devClose(dev->dev);
+    (void)pthread_cond_destroy(&dev->qDone);
+    (void)pthread_cond_destroy(&dev->qWork);
+    (void)pthread_mutex_destroy(&dev->qMutex);
+    free(dev);
+    return retVal;
+}
+
+bool tp_devGetPID(tp_device_t *dev, int16_t *pid)
+{
+    if ((dev == NULL) || (pid == NULL)) return false;
+    return dev->ops->devGetPID(dev->dev, pid);
+}
+
+int tp_devGetAddrStr(tp_device_t *dev, char *addrStr)
+{
+    if ((dev == NULL) || (addrStr == NULL)) return -1;
+    return dev->ops->devGetAddrStr(dev->dev, addrStr);
+}
+
+bool tp_devSwitchIFace(tp_device_t *dev, uint8_t iface)
+{
+    if (dev == NULL) return false;
+    return dev->ops->devSwitchIFace(dev->dev, iface);
+}
+
+void tp_devSetCtrlParams(tp_device_t *dev, int delay, int retries, int timeout)
+{
+    if (dev == NULL) return;
+
+    // applied by the I/O thread, see tp_execute()
+    (void)pthread_mutex_lock(&dev->qMutex);
+    dev->ctrlDelay      = delay;
+    dev->ctrlRetry      = retries;
+    dev->ctrlTimeout    = timeout;
+    (void)pthread_mutex_unlock(&dev->qMutex);
+}
+
+int tp_devControlRequest(tp_device_t *dev, uint8_t *request, uint16_t reqLen,
+                                                /*@null@*/ uint8_t *reply)
+{
+    tp_request_t req;
+
+    if (dev == NULL) return TP_ERROR_NO_DEVICE;
+    if ((request == NULL) || (reqLen == 0)) return TP_ERROR_INVALID_PARAM;
+
+    if (!tp_prepareRequest(&req, dev, request, reqLen, (reply != NULL) ? 1 : 0))
+    {
+        return TP_ERROR_INVALID_PARAM;
+    }
+    return tp_runRequest(&req, reply);
+}
+
+int tp_devControlRequestCP(tp_device_t *dev, uint8_t *request, uint16_t reqLen,
+                                /*@null@*/ uint8_t *reply,
+                                int delay, int retries, int timeout)
+{
+    tp_request_t req;
+
+    if (dev == NULL) return TP_ERROR_NO_DEVICE;
+    if ((request == NULL) || (reqLen == 0)) return TP_ERROR_INVALID_PARAM;
+
+    if (!tp_prepareRequest(&req, dev, request, reqLen, (reply != NULL) ? 1 : 0))
+    {
+        return TP_ERROR_INVALID_PARAM;
+    }
+    tp_setRequestCtrlParams(&req, delay, retries, timeout);
+    return tp_runRequest(&req, reply);
+}
+
+int tp_devControlReply(tp_device_t *dev, uint8_t *reply)
+{
+    tp_request_t req;
+
+    if (dev == NULL) return TP_ERROR_NO_DEVICE;
+    if (reply == NULL) return TP_ERROR_INVALID_PARAM;
+    if (dev->ops->devControlReply == NULL) return TP_ERROR_NOT_SUPPORTED;
+
+    (void)tp_prepareRequest(&req, dev, NULL, 0, 1);
+    return tp_runRequest(&req, reply);
+}
+
+/**
+ * The handler is called through tp_devIN_dispatch(), so that requests made
+ * from it can be refused.  It is detached from the transport while it is
+ * replaced, so a report is never passed to one handler with another's
+ * context.
+ */
+void tp_devRegisterHandler(tp_device_t *dev, UsbReportID_t ReportID,
+                                    usb_in_handler_t handler, void *context)
+{
+    if (dev == NULL) return;
+    if ((int)ReportID >= MAX_REPORT_ID) return;
+
+    dev->ops->devRegisterHandler(dev->dev, ReportID, NULL, NULL);
+    dev->IN_handler[ReportID] = handler;
+    dev->IN_context[ReportID] = context;
+    if (handler != NULL)
+    {
+        dev->ops->devRegisterHandler(dev->dev, ReportID, tp_devIN_dispatch, dev);
+    }
+}
+
+bool tp_devGetInStats(tp_device_t *dev, usb_in_stats_t *stats)
+{
+    if ((dev == NULL) || (stats == NULL)) return false;
+    if (dev->ops->devGetInStats == NULL) return false;
+    return dev->ops->devGetInStats(dev->dev, stats);
+}
+
+
+// ============================================================================
+// --- Request Queue ---
+// ============================================================================
+
+bool tp_prepareRequest(tp_request_t *req, tp_device_t *dev,
+                    uint8_t const *request, uint16_t reqLen, int replies)
+{
+    if (req == NULL) return false;
+
+    memset(req, 0, sizeof(tp_request_t));
+    if ((reqLen > USB_PACKET_LEN) || ((reqLen > 0) && (request == NULL)))
+    {
+        return false;
+    }
+
+    req->dev        = dev;
+    req->reqLen     = reqLen;
+    req->replies    = (replies < 0) ? 0 : replies;
+    req->state      = TP_REQ_IDLE;
+    if (reqLen > 0) memcpy(req->request, request, reqLen);
+    return true;
+}
+
+void tp_setRequestCtrlParams(tp_request_t *req, int delay, int retries, int timeout)
+{
+    if (req == NULL) return;
+
+    req->ctrlSet        = true;
+    req->ctrlDelay      = delay;
+    req->ctrlRetry      = retries;
+    req->ctrlTimeout    = timeout;
+}
+
+int tp_submitRequest(tp_request_t *req)
+{
+    tp_device_t *dev;
+
+    if (req == NULL) return TP_ERROR_INVALID_PARAM;
+    if (req->dev == NULL) return TP_ERROR_NO_DEVICE;
+    dev = req->dev;
+
+    // from an IN handler - the transport's event thread may be needed to
+    // complete the request, so waiting for it could deadlock
+    if (msv_inHandler)
+    {
+        zul_logf(1, "%s - refused, from an IN handler", __FUNCTION__);
+        return TP_ERROR_BUSY;
+    }
+
+    // from a handler or callback on the device's I/O thread - waiting would
+    // deadlock
+    if (msv_ioDevice == dev)
+    {
+        req->state = TP_REQ_ACTIVE;
+        tp_execute(req);
+        tp_complete(req);
+        return 0;
+    }
+
+    (void)pthread_mutex_lock(&dev->qMutex);
+
+    req->state  = TP_REQ_QUEUED;
+    req->next   = NULL;
+    if (dev->qTail != NULL)
+    {
+        dev->qTail->next = req;
+    }
+    else
+    {
+        dev->qHead = req;
+    }
+    dev->qTail = req;
+
+    (void)pthread_cond_signal(&dev->qWork);
+    (void)pthread_mutex_unlock(&dev->qMutex);
+    return 0;
+}
+
+int tp_waitRequest(tp_request_t *req)
+{
+    tp_device_t *dev;
+
+    if (req == NULL) return TP_ERROR_INVALID_PARAM;
+    dev = req->dev;
+    if (dev == NULL) return req->result;        // never submitted
+
+    (void)pthread_mutex_lock(&dev->qMutex);
+    while ((req->state == TP_REQ_QUEUED) || (req->state == TP_REQ_ACTIVE))
+    {
+        (void)pthread_cond_wait(&dev->qDone, &dev->qMutex);
+    }
+    (void)pthread_mutex_unlock(&dev->qMutex);
+
+    return req->result;
+}
+
+bool tp_requestDone(tp_request_t *req)
+{
+    tp_device_t *dev;
+    bool         done;
+
+    if (req == NULL) return false;
+    dev = req->dev;
+    if (dev == NULL) return (req->state == TP_REQ_DONE);
+
+    (void)pthread_mutex_lock(&dev->qMutex);
+    done = (req->state == TP_REQ_DONE);
+    (void)pthread_mutex_unlock(&dev->qMutex);
+    return done;
+}
+
+void tp_syncRequests(tp_device_t *dev)
+{
+    if (dev == NULL) dev = msv_dev;
+    if (dev == NULL) return;
+    if (msv_ioDevice == dev) return;
+
+    (void)pthread_mutex_lock(&dev->qMutex);
+    while ((dev->qActive != NULL) || (dev->qHead != NULL))
+    {
+        (void)pthread_cond_wait(&dev->qDone, &dev->qMutex);
+    }
+    (void)pthread_mutex_unlock(&dev->qMutex);
+}
+
+
+// ============================================================================
+// --- Private Implementation ---
+// ============================================================================
+
+static zul_transport_t const * tp_find(char const *name)
+{
+    int i;
+
+    if (name == NULL) return NULL;
+
+    for (i = 0; i < TP_MAX_TRANSPORTS; i++)
+    {
+        if ( (msv_transports[i] != NULL) &&
+             (strcmp(msv_transports[i]->name, name) == 0) )
+        {
+            return msv_transports[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * The transport selected by tp_select(), else by the environment, else the
+ * first in the table.  NULL if the environment names an unknown transport.
+ */
+static zul_transport_t const * tp_choose(void)
+{
+    char const *env;
+
+    if (msv_selected != NULL) return msv_selected;
+
+    env = getenv(TP_ENV_VAR);
+    if ((env != NULL) && (env[0] != '\0'))
+    {
+        return tp_find(env);
+    }
+
+    return msv_transports[0];
+}
+
+/**
+ * Wrap a device opened by a transport, and start its I/O thread.  On failure
+ * the device is closed, and NULL returned.
+ */
+static tp_device_t * tp_devWrap(zul_transport_t const *ops, void *dev)
+{
+    tp_device_t *tpd = (tp_device_t *)calloc(1, sizeof(tp_device_t));
+
+    if (tpd == NULL)
+    {
+        (void)ops->devClose(dev);
+        return NULL;
+    }
+    tpd->ops            = ops;
+    tpd->dev            = dev;
+    tpd->ctrlDelay      = -1;
+    tpd->ctrlRetry      = -1;
+    tpd->ctrlTimeout    = -1;
+
+    (void)pthread_mutex_init(&tpd->qMutex, NULL);
+    (void)pthread_cond_init(&tpd->qWork, NULL);
+    (void)pthread_cond_init(&tpd->qDone, NULL);
+
+    if (!tp_startIOThread(tpd))
+    {
+        (void)ops->devClose(dev);
+        (void)pthread_cond_destroy(&tpd->qDone);
+        (void)pthread_cond_destroy(&tpd->qWork);
+        (void)pthread_mutex_destroy(&tpd->qMutex);
+        free(tpd);
+        return NULL;
+    }
+    return tpd;
+}
+
+/**
+ * Submit a request, wait for it, and copy its reply
+ */
+static int tp_runRequest(tp_request_t *req, /*@null@*/ uint8_t *reply)
+{
+    int res;
+
+    res = tp_submitRequest(req);
+    if (res < 0) return res;
+
+    res = tp_waitRequest(req);
+    if ((res >= 0) && (reply != NULL))
+    {
+        memcpy(reply, req->reply, USB_PACKET_LEN);
+    }
+    return res;
+}
+
+/**
+ * Apply the single device services' control parameters and handler table
+ * to the device
+ */
+static void tp_applyDefaults(void)
+{
+    int i;
+
+    if (msv_dev == NULL) return;
+
+    tp_devSetCtrlParams(msv_dev, msv_CtrlDelay, msv_CtrlRetry, msv_CtrlTimeout);
+
+    for (i = 0; i < MAX_REPORT_ID; i++)
+    {
+        tp_devRegisterHandler(msv_dev, (UsbReportID_t)i, tp_IN_dispatch, NULL);
+    }
+}
+
+/**
+ * Search a device list for a device of a PID (0 => any) or at an address
+ */
+static bool tp_listFind(char const *list, int16_t pid, char const *addr,
+                                                            char *addrOut)
+{
+    char const *line = list;
+
+    while ((line != NULL) && (*line != '\0'))
+    {
+        char const *pidStr  = strstr(line, "PID:");
+        char const *addrStr = strstr(line, "Addr=");
+        char const *eol     = strchr(line, '\n');
+        char        lineAddr[8] = "";
+        int16_t     linePid = 0;
+
+        if ((pidStr != NULL) && ((eol == NULL) || (pidStr < eol)))
+        {
+            linePid = (int16_t)strtol(pidStr + 4, NULL, 16);
+        }
+        if ((addrStr != NULL) && ((eol == NULL) || (addrStr < eol)))
+        {
+            (void)sscanf(addrStr + 5, "%7s", lineAddr);
+        }
+
+        if ( ( (addr != NULL) && (strcmp(addr, lineAddr) == 0) ) ||
+             ( (addr == NULL) && ((pid == 0) || (pid == linePid)) ) )
+        {
+            if (addrOut != NULL) strcpy(addrOut, lineAddr);
+            return true;
+        }
+
+        line = (eol != NULL) ? eol + 1 : NULL;
+    }
+    return false;
+}
+
+/**
+ * For a transport without device arrival notification, poll the device list
+ * until the device arrives (or leaves).  Return 0, or -1 on timeout.
+ */
+static int tp_pollForDevice(int16_t pid, char const *addr, bool arrive,
+                                            int timeoutMs, char *addrOut)
+{
+    char        list[TP_LIST_LEN + 1];
+    uint64_t    limit = zul_monotonicMs();
+
+    if (timeoutMs > 0) limit += (uint64_t)timeoutMs;
+
+    do
+    {
+        int cnt = msv_tp->getDeviceList(list, TP_LIST_LEN);
+
+        if (cnt < 0) list[0] = '\0';
+        if (tp_listFind(list, pid, addr, addrOut) == arrive)
+        {
+            return 0;
+        }
+        (void)usleep(TP_POLL_INTERVAL_MS * 1000);
+    }
+    while (zul_monotonicMs() < limit);
+
+    return -1;
+}
+
+/**
+ * Pass IN data of the single device services' device to the handlers
+ * registered with tp_RegisterHandler()
+ */
+static void tp_IN_dispatch(void *context, uint8_t *data)
+{
+    interrupt_handler_t handler = NULL;
+    bool                inHandler;
+
+    (void)context;
+    if (data[0] < MAX_REPORT_ID) handler = msv_IN_handler[data[0]];
+
+    if (handler == NULL)
+    {
+        zul_log_hex(3, "IntXfr", data, 16);
+        return;
+    }
+
+    inHandler       = msv_inHandler;
+    msv_inHandler   = true;
+    handler(data);
+    msv_inHandler   = inHandler;
+}
+
+/**
+ * Pass IN data of a device to the handler registered with
+ * tp_devRegisterHandler(), marking this thread as running an IN handler
+ */
+static void tp_devIN_dispatch(void *context, uint8_t *data)
+{
+    tp_device_t        *dev     = (tp_device_t *)context;
+    usb_in_handler_t    handler = NULL;
+    bool                inHandler;
+
+    if (data[0] < MAX_REPORT_ID) handler = dev->IN_handler[data[0]];
+    if (handler == NULL) return;
+
+    inHandler       = msv_inHandler;
+    msv_inHandler   = true;
+    handler(dev->IN_context[data[0]], data);
+    msv_inHandler   = inHandler;
+}
+
+void tp_injectInReport(uint8_t *data)
+{
+    if (data != NULL) tp_IN_dispatch(NULL, data);
+}
+
+/**
+ * Start the device's I/O thread.  Return false if it could not be started.
+ */
+static bool tp_startIOThread(tp_device_t *dev)
+{
+    dev->ioStop = false;
+    if (pthread_create(&dev->ioThread, NULL, tp_ioWorker, dev) != 0)
+    {
+        zul_log(0, "Request I/O thread not started");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Stop the device's I/O thread, once its queue is empty
+ */
+static void tp_stopIOThread(tp_device_t *dev)
+{
+    (void)pthread_mutex_lock(&dev->qMutex);
+    dev->ioStop = true;
+    (void)pthread_cond_signal(&dev->qWork);
+    (void)pthread_mutex_unlock(&dev->qMutex);
+
+    (void)pthread_join(dev->ioThread, NULL);
+}
+
+/**
+ * Carry out the queued requests of a device, one at a time, in order
+ */
+static void *tp_ioWorker(void *arg)
+{
+    tp_device_t *dev = (tp_device_t *)arg;
+
+    msv_ioDevice = dev;
+
+    (void)pthread_mutex_lock(&dev->qMutex);
+    for (;;)
+    {
+        tp_request_t *req;
+
+        while ((dev->qHead == NULL) && !dev->ioStop)
+        {
+            (void)pthread_cond_wait(&dev->qWork, &dev->qMutex);
+        }
+        if (dev->qHead == NULL) break;      // stopping, and nothing queued
+
+        req         = dev->qHead;
+        dev->qHead  = req->next;
+        if (dev->qHead == NULL) dev->qTail = NULL;
+        req->state  = TP_REQ_ACTIVE;
+        dev->qActive = req;
+        (void)pthread_mutex_unlock(&dev->qMutex);
+
+        tp_execute(req);
+        tp_complete(req);
+
+        (void)pthread_mutex_lock(&dev->qMutex);
+    }
+    (void)pthread_mutex_unlock(&dev->qMutex);
+
+    return NULL;
+}
+
+/**
+ * Make the request of the device, and fetch each of the replies expected.
+ * Called on the device's I/O thread alone, which gives the transport the
+ * control parameters of each request (its own, or else the device's) as
+ * they change, so no other thread changes them during a request.
+ */
+static void tp_execute(tp_request_t *req)
+{
+    tp_device_t    *dev     = req->dev;
+    uint8_t        *reply   = (req->replies > 0) ? req->reply : NULL;
+    int             res;
+    int             n       = 1;
+    int             delay, retries, timeout;
+
+    (void)pthread_mutex_lock(&dev->qMutex);
+    delay   = (req->ctrlSet) ? req->ctrlDelay   : dev->ctrlDelay;
+    retries = (req->ctrlSet) ? req->ctrlRetry   : dev->ctrlRetry;
+    timeout = (req->ctrlSet) ? req->ctrlTimeout : dev->ctrlTimeout;
+    (void)pthread_mutex_unlock(&dev->qMutex);
+
+    if ( !dev->ctrlApplied || (delay != dev->appDelay) ||
+         (retries != dev->appRetry) || (timeout != dev->appTimeout) )
+    {
+        dev->ops->devSetCtrlParams(dev->dev, delay, retries, timeout);
+        dev->ctrlApplied    = true;
+        dev->appDelay       = delay;
+        dev->appRetry       = retries;
+        dev->appTimeout     = timeout;
+    }
+
+    if (req->reqLen > 0)
+    {
+        res = dev->ops->devControlRequest(dev->dev, req->request, req->reqLen,
+                                                                        reply);
+    }
+    else if (dev->ops->devControlReply != NULL)
+    {
+        res = dev->ops->devControlReply(dev->dev, req->reply);
+    }
+    else
+    {
+        res = TP_ERROR_NOT_SUPPORTED;
+    }
+
+    if ((res >= 0) && (reply != NULL) && (req->handler != NULL))
+    {
+        (void)req->handler(reply);
+    }
+
+    while ((res >= 0) && (n < req->replies))
+    {
+        zul_logf(4, "Multi-Reply expected [%d]", req->replies - n);
+        n++;
+
+        if (dev->ops->devControlReply == NULL)
+        {
+            res = TP_ERROR_NOT_SUPPORTED;
+            break;
+        }
+        res = dev->ops->devControlReply(dev->dev, req->reply);
+        if ((res >= 0) && (req->handler != NULL))
+        {
+            (void)req->handler(req->reply);
+        }
+    }
+
+    req->result = res;
+}
+
+/**
+ * Mark the request complete and release any thread waiting for it, then
+ * call its callback.  The queue is done with the request before the
+ * callback is called, so the callback may free or re-submit it.
+ */
+static void tp_complete(tp_request_t *req)
+{
+    tp_device_t *dev    = req->dev;
+    tp_done_t   done    = req->done;
+    void *      context = req->context;
+
+    (void)pthread_mutex_lock(&dev->qMutex);
+    req->state = TP_REQ_DONE;
+    if (dev->qActive == req) dev->qActive = NULL;
+    (void)pthread_cond_broadcast(&dev->qDone);
+    (void)pthread_mutex_unlock(&dev->qMutex);
+
+    if (done != NULL)
+    {
+        done(req, context);
+    }
+}
+
+/**
+ * Dummy handler, as default_IN_handler() of usb.c
+ */
+static void tp_default_IN_handler(uint8_t *data)
+{
+    if (PROTOCOL_DEBUG)
+    {
+        zul_logf(1, "%s: %s\n", __FUNCTION__, zul_hex2String(data, 24));
+    }
+
+    // do nothing
+}
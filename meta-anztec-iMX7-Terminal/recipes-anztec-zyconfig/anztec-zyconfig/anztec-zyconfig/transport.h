@@ -0,0 +1,367 @@
+/*
+ *  Copyright (c) 2019 Zytronic Displays Limited. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact Zytronic, you can do so either via the
+ * website <www.zytronic.co.uk> or by paper mail:
+ * Zytronic, Whiteley Road, Blaydon on Tyne, Tyne & Wear, NE21 5NJ, UK
+ */
+
+
+
+
+
+
+/* Module Overview
+   ===============
+   This code lets the device communication services be provided by one of
+   several transports, selected at run time rather than at build time:
+
+        libusb      usb.c       the default on Linux
+        hidraw      hidraw.c    Linux hidraw nodes; the kernel driver stays bound
+        hidapi      comms.c     HID-API, the default on Apple hosts
+        mock        mock.c      simulated controllers, for use without hardware
+
+   Each transport supplies a table of operations (zul_transport_t).  The
+   transport is chosen by tp_select(), or else by the ZUL_TRANSPORT
+   environment variable, when tp_openLib() is called.
+
+   The tp_dev* services act upon any device of the transport.  The remaining
+   services act upon one device, opened by tp_openDevice(), and are used by
+   services.c in place of the usb_* single device services.
+
+   Control requests are queued, and made by an I/O thread of the device,
+   started as it is opened, in order of submission.  Each request carries
+   its own reply buffer, so threads may share a device: their requests are
+   carried out one after the other, and each caller receives its own reply.
+   The requests of different devices do not wait for each other.  tp_devControlRequest() and the
+   single device services wait for completion; tp_submitRequest() does not.
+
+ */
+
+#ifndef _ZY_TRANSPORT_H
+#define _ZY_TRANSPORT_H
+
+#include "zytypes.h"
+#include "usb.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define  TP_ENV_VAR                 "ZUL_TRANSPORT"
+#define  TP_MAX_TRANSPORTS          (8)
+
+/**
+ * The operations of a transport.  Device handles are opaque to the caller.
+ * Entries marked optional may be NULL, and a generic substitute is used.
+ * Error codes are negative, with the values used by the libusb backend.
+ */
+typedef struct zul_transport
+{
+    char const *    name;
+
+    int     (*openLib)              (void);
+    void    (*closeLib)             (void);
+    char *  (*libStr)               (void);
+
+    // device listing, in the format of usb_getDeviceList()
+    int     (*getDeviceList)        (char *buf, int len);
+    int     (*rescan)               (void);                             // optional
+    int     (*waitForDevice)        (int16_t pid, int timeoutMs,        // optional
+                                        /*@null@*/ char *addrStr);
+    int     (*waitForDeviceLeft)    (char const *addrStr, int timeoutMs);   // optional
+
+    int     (*devOpen)              (int index, void **dev);
+    int     (*devOpenByAddr)        (char const *addrStr, void **dev);
+    int     (*devClose)             (void *dev);
+    bool    (*devGetPID)            (void *dev, int16_t *pid);
+    int     (*devGetAddrStr)        (void *dev, char *addrStr);
+    bool    (*devSwitchIFace)       (void *dev, uint8_t iface);
+    void    (*devSetCtrlParams)     (void *dev, int delay, int retries,
+                                                            int timeout);
+
+    // a request, with the reply copied to reply (USB_PACKET_LEN) if not NULL
+    int     (*devControlRequest)    (void *dev, uint8_t *request,
+                                        uint16_t reqLen,
+                                        /*@null@*/ uint8_t *reply);
+    // a further reply to the last request [ZXY100 multi-reply]        optional
+    int     (*devControlReply)      (void *dev, uint8_t *reply);
+
+    // interrupt IN data subscription
+    void    (*devRegisterHandler)   (void *dev, UsbReportID_t ReportID,
+                                        /*@null@*/ usb_in_handler_t handler,
+                                        void *context);
+    bool    (*devGetInStats)        (void *dev, usb_in_stats_t *stats); // optional
+} zul_transport_t;
+
+// the built in transports
+extern zul_transport_t const        usb_transport;
+extern zul_transport_t const        hidraw_transport;
+extern zul_transport_t const        hidapi_transport;
+extern zul_transport_t const        mock_transport;
+
+// a device opened through a transport
+typedef struct tp_device tp_device_t;
+
+
+// ============================================================================
+// --- Transport Selection ---
+// ============================================================================
+
+/**
+ * Add a transport to those that may be selected. Return SUCCESS or FAILURE.
+ */
+int         tp_register                 (zul_transport_t const *transport);
+
+/**
+ * Select a transport by name.  Must be called while the library is closed.
+ * Return SUCCESS or FAILURE (unknown name, or library open)
+ */
+int         tp_select                   (char const *name);
+
+/**
+ * The name of the selected transport, or of the one that will be used
+ */
+char const *tp_name                     (void);
+
+/**
+ * Copy the names of the available transports, separated by spaces
+ */
+void        tp_listTransports           (char *buf, int len);
+
+
+// ============================================================================
+// --- Single Device Services ---
+//     As the usb_* services of the same names, upon the selected transport
+// ============================================================================
+
+int         tp_openLib                  (void);
+void        tp_closeLib                 (void);
+char *      tp_libStr                   (void);
+
+int         tp_getDeviceList            (char *buf, int len);
+int         tp_rescanDevices            (void);
+int         tp_waitForDevice            (int16_t pid, int timeoutMs,
+                                            /*@null@*/ char *addrStr);
+int         tp_waitForDeviceLeft        (char const *addrStr, int timeoutMs);
+
+int         tp_openDevice               (int index);
+int         tp_openDeviceByAddr         (char const *addrStr);
+int         tp_reOpenLastDevice         (void);
+int         tp_closeDevice              (void);
+int         tp_getAddrStr               (char *addrStr);
+bool        tp_getDevicePID             (int16_t *pid);
+bool        tp_switchIFace              (uint8_t iface);
+
+/**
+ * Make a queued control request of the device, as usb_ControlRequest().
+ * handle_reply is called on the calling thread, except for the replies of
+ * tp_ControlRequestMR(), which are handled on the device's I/O thread.
+ */
+int         tp_ControlRequest           (uint8_t *request, uint16_t reqLen,
+                                            /*@null@*/
+                                            response_handler_t handle_reply);
+int         tp_ControlRequestMR         (uint8_t *request, uint16_t reqLen,
+                                            /*@null@*/
+                                            response_handler_t handle_reply,
+                                            int replyCount);
+
+/**
+ * As tp_ControlRequest(), with control parameters (as tp_setCtrlDelay()
+ * etc) for this request alone, see tp_setRequestCtrlParams()
+ */
+int         tp_ControlRequestCP         (uint8_t *request, uint16_t reqLen,
+                                            /*@null@*/
+                                            response_handler_t handle_reply,
+                                            int delay, int retries,
+                                            int timeout);
+
+void        tp_setCtrlDelay             (int delay);
+void        tp_defaultCtrlDelay         (void);
+void        tp_setCtrlRetry             (int retries);
+void        tp_defaultCtrlRetry         (void);
+void        tp_setCtrlTimeout           (int timeout);
+void        tp_defaultCtrlTimeout       (void);
+
+/**
+ * IN handlers, here and for tp_devRegisterHandler(), must not make control
+ * requests, see tp_submitRequest()
+ */
+void        tp_RegisterHandler          (UsbReportID_t ReportID,
+                                            /*@null@*/
+                                            interrupt_handler_t handler);
+void        tp_ResetDefaultInHandlers   (void);
+
+/**
+ * Pass a report (64 bytes) to the handler registered for its report ID, as
+ * if the device had sent it (replay).  Not to be mixed with the device's
+ * own reports of that ID.
+ */
+void        tp_injectInReport           (uint8_t *data);
+
+bool        tp_getInStats               (usb_in_stats_t *stats);
+
+/**
+ * Return the device opened by tp_openDevice(), or NULL
+ */
+tp_device_t *   tp_getDefaultDevice     (void);
+
+
+// ============================================================================
+// --- Request Queue ---
+// ============================================================================
+
+typedef struct tp_request tp_request_t;
+
+/**
+ * Completion callback, called on the device's I/O thread once the request
+ * has been marked complete and has left the queue.  From then on the request
+ * belongs to the caller: the callback may free it, or prepare and submit it
+ * again.
+ */
+typedef void (*tp_done_t)(tp_request_t *req, void *context);
+
+/**
+ * A queued control request, in caller storage.  It must remain valid until
+ * it has completed (tp_waitRequest() has returned, or tp_requestDone() is
+ * true), and if it has a done callback, until that has been called.
+ */
+struct tp_request
+{
+    // set by tp_prepareRequest()
+    tp_device_t *           dev;
+    uint8_t                 request[USB_PACKET_LEN];
+    uint16_t                reqLen;         // zero => fetch a further reply
+    int                     replies;        // replies expected, zero if none
+
+    // optional: called on the I/O thread with each reply, and on completion
+    /*@null@*/
+    response_handler_t      handler;
+    /*@null@*/
+    tp_done_t               done;
+    void *                  context;
+
+    // optional: set by tp_setRequestCtrlParams()
+    bool                    ctrlSet;
+    int                     ctrlDelay, ctrlRetry, ctrlTimeout;
+
+    // results
+    uint8_t                 reply[USB_PACKET_LEN];  // the last reply
+    int                     result;         // bytes transferred, or an error
+
+    // private to the queue
+    int                     state;
+    /*@null@*/
+    tp_request_t *          next;
+};
+
+/**
+ * Fill in a request for a device.  Return false if the request is too long.
+ */
+bool        tp_prepareRequest           (tp_request_t *req, tp_device_t *dev,
+                                            uint8_t const *request,
+                                            uint16_t reqLen, int replies);
+
+/**
+ * Give a prepared request its own control comms delay (ms), retry count and
+ * timeout (ms), as tp_devSetCtrlParams(), in place of those of its device.
+ * They are applied by the device's I/O thread for this request alone, so
+ * the device parameters seen by other requests are not changed.
+ */
+void        tp_setRequestCtrlParams     (tp_request_t *req, int delay,
+                                            int retries, int timeout);
+
+/**
+ * Queue a request.  Zero is returned, or a negative error code if it could
+ * not be queued.  A request submitted from the device's I/O thread (by a
+ * reply handler or done callback) is carried out at once.
+ *
+ * IN handlers run on the transport's event thread, which may be needed to
+ * complete the request, so they must not make requests: one submitted from
+ * an IN handler is refused with LIBUSB_ERROR_BUSY.
+ */
+int         tp_submitRequest            (tp_request_t *req);
+
+/**
+ * Wait for a submitted request to complete, and return its result
+ */
+int         tp_waitRequest              (tp_request_t *req);
+bool        tp_requestDone              (tp_request_t *req);
+
+/**
+ * Wait until no request of the device (of the single device services'
+ * device, if NULL) is queued or in progress
+ */
+void        tp_syncRequests             (/*@null@*/ tp_device_t *dev);
+
+
+// ============================================================================
+// --- Multiple Device Support ---
+// ============================================================================
+
+int         tp_devOpen                  (int index, tp_device_t **dev);
+int         tp_devOpenByAddr            (char const *addrStr, tp_device_t **dev);
+/**
+ * Closing a device waits for its queued requests, and stops its I/O thread,
+ * so it is refused (LIBUSB_ERROR_BUSY) from that thread.
+ */
+int         tp_devClose                 (tp_device_t *dev);
+
+bool        tp_devGetPID                (tp_device_t *dev, int16_t *pid);
+int         tp_devGetAddrStr            (tp_device_t *dev, char *addrStr);
+bool        tp_devSwitchIFace           (tp_device_t *dev, uint8_t iface);
+
+/**
+ * Set the control comms delay (ms), retry count and timeout (ms) of the
+ * device's requests, or -1 for the default.  They are given to the transport
+ * by the device's I/O thread before its next request, never during one.
+ */
+void        tp_devSetCtrlParams         (tp_device_t *dev, int delay,
+                                            int retries, int timeout);
+
+/**
+ * Queue a control request, or a fetch of a further reply, and wait for it
+ * to complete, see usb_devControlRequest()
+ */
+int         tp_devControlRequest        (tp_device_t *dev,
+                                            uint8_t *request, uint16_t reqLen,
+                                            /*@null@*/ uint8_t *reply);
+int         tp_devControlReply          (tp_device_t *dev, uint8_t *reply);
+
+/**
+ * As tp_devControlRequest(), with control parameters for this request
+ * alone, see tp_setRequestCtrlParams()
+ */
+int         tp_devControlRequestCP      (tp_device_t *dev,
+                                            uint8_t *request, uint16_t reqLen,
+                                            /*@null@*/ uint8_t *reply,
+                                            int delay, int retries,
+                                            int timeout);
+void        tp_devRegisterHandler       (tp_device_t *dev,
+                                            UsbReportID_t ReportID,
+                                            /*@null@*/
+                                            usb_in_handler_t handler,
+                                            void *context);
+bool        tp_devGetInStats            (tp_device_t *dev,
+                                            usb_in_stats_t *stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ZY_TRANSPORT_H
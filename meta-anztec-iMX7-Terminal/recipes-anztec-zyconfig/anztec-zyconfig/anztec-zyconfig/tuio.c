@@ -0,0 +1,505 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* For a module overview, see the header file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "tuio.h"
+#include "debug.h"
+
+//
+// --- Module Types ---
+//
+
+#define TUIO_SOURCE                 "zytronic"
+#define TUIO_ADDR                   "/tuio/2Dcur"
+
+// the space kept for the fseq message, that ends every bundle
+#define FSEQ_MSG_LEN                (4 + 12 + 4 + 8 + 4)
+
+#define NO_SESSION                  (-1)
+
+struct zul_tuio
+{
+    int                 sock;
+    struct sockaddr_in  addr;
+    char                source      [sizeof(TUIO_SOURCE) + 1 + HOST_NAME_MAX];
+
+    pthread_mutex_t     lock;
+    bool                enabled;
+
+    int32_t             nextSession;
+    int32_t             fseq;
+    uint64_t            lastSendUs;
+
+    // per contact ID
+    int32_t             session     [TRK_MAX_CONTACTS];
+    uint64_t            downUs      [TRK_MAX_CONTACTS];
+    uint64_t            lastUs      [TRK_MAX_CONTACTS];
+    int                 lastX       [TRK_MAX_CONTACTS];
+    int                 lastY       [TRK_MAX_CONTACTS];
+    float               velX        [TRK_MAX_CONTACTS];
+    float               velY        [TRK_MAX_CONTACTS];
+    float               accel       [TRK_MAX_CONTACTS];
+    bool                updated     [TRK_MAX_CONTACTS];
+
+    tuio_stats_t        stats;
+
+    trk_snapshot_t      snap;
+    uint8_t             buf         [TUIO_MAX_PACKET];
+    int                 len;
+    int                 limit;          // the end of the space for messages
+    int                 msgStart;       // of the element being encoded
+    bool                full;
+};
+
+
+//
+// --- Module Prototypes ---
+//
+
+static void     osc_putBytes            (zul_tuio_t *t, void const *p, int n);
+static void     osc_putString           (zul_tuio_t *t, char const *s);
+static void     osc_putInt              (zul_tuio_t *t, int32_t value);
+static void     osc_putFloat            (zul_tuio_t *t, float value);
+static void     osc_beginMsg            (zul_tuio_t *t, char const *cmd,
+                                            char const *typeTag);
+static bool     osc_endMsg              (zul_tuio_t *t);
+static void     tuio_track              (zul_tuio_t *t, bool *changed);
+static void     tuio_encode             (zul_tuio_t *t);
+static int      tuio_send               (zul_tuio_t *t, uint64_t rxUs);
+static void     tuio_clearSessions      (zul_tuio_t *t);
+
+
+// ============================================================================
+// --- Public Services ---
+// ============================================================================
+
+zul_tuio_t * tuio_create(char const *host, int port)
+{
+    zul_tuio_t *    t;
+    char            hostName[HOST_NAME_MAX + 1];
+
+    t = (zul_tuio_t *)calloc(1, sizeof(zul_tuio_t));
+    if (t == NULL) return NULL;
+
+    (void)pthread_mutex_init(&t->lock, NULL);
+    tuio_clearSessions(t);
+
+    // <name>@<host>, or the name alone if the host name is not known
+    if (gethostname(hostName, sizeof(hostName)) == 0)
+    {
+        hostName[sizeof(hostName) - 1] = '\0';
+        (void)snprintf(t->source, sizeof(t->source), "%s@%s",
+                                                    TUIO_SOURCE, hostName);
+    }
+    else
+    {
+        (void)snprintf(t->source, sizeof(t->source), "%s", TUIO_SOURCE);
+    }
+
+    t->sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (t->sock < 0)
+    {
+        zul_logf(1, "%s: socket: %s", __FUNCTION__, strerror(errno));
+        (void)pthread_mutex_destroy(&t->lock);
+        free(t);
+        return NULL;
+    }
+    if (tuio_setTarget(t, host, port) != SUCCESS)
+    {
+        tuio_destroy(t);
+        return NULL;
+    }
+    t->enabled = true;
+    return t;
+}
+
+void tuio_destroy(zul_tuio_t *tuio)
+{
+    if (tuio == NULL) return;
+
+    tuio_enable(tuio, false);
+    (void)close(tuio->sock);
+    (void)pthread_mutex_destroy(&tuio->lock);
+    free(tuio);
+}
+
+int tuio_setTarget(zul_tuio_t *tuio, char const *host, int port)
+{
+    struct sockaddr_in  addr;
+
+    if (tuio == NULL) return FAILURE;
+    if (host == NULL) host = TUIO_DEFAULT_HOST;
+    if (port <= 0)    port = TUIO_DEFAULT_PORT;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons((uint16_t)port);
+    if ((port > 65535) || (inet_pton(AF_INET, host, &addr.sin_addr) != 1))
+    {
+        zul_logf(1, "%s: bad address %s:%d", __FUNCTION__, host, port);
+        return FAILURE;
+    }
+
+    (void)pthread_mutex_lock(&tuio->lock);
+    tuio->addr = addr;
+    (void)pthread_mutex_unlock(&tuio->lock);
+
+    zul_logf(3, "%s: %s:%d", __FUNCTION__, host, port);
+    return SUCCESS;
+}
+
+void tuio_enable(zul_tuio_t *tuio, bool enabled)
+{
+    if (tuio == NULL) return;
+
+    (void)pthread_mutex_lock(&tuio->lock);
+    if (tuio->enabled && !enabled)
+    {
+        tuio_clearSessions(tuio);
+        tuio_encode(tuio);
+        (void)tuio_send(tuio, 0);
+    }
+    tuio->enabled = enabled;
+    (void)pthread_mutex_unlock(&tuio->lock);
+}
+
+int tuio_update(zul_tuio_t *tuio, zul_tracker_t *trk, uint64_t rxUs)
+{
+    bool    changed = false;
+    int     sent = 0;
+
+    if ((tuio == NULL) || (trk == NULL)) return -1;
+
+    (void)pthread_mutex_lock(&tuio->lock);
+    if (tuio->enabled)
+    {
+        trk_snapshot(trk, &tuio->snap);
+        tuio_track(tuio, &changed);
+
+        if ( (rxUs != 0) || changed ||
+             (zul_monotonicUs() - tuio->lastSendUs >=
+                                            TUIO_KEEPALIVE_MS * 1000u) )
+        {
+            tuio_encode(tuio);
+            sent = tuio_send(tuio, rxUs);
+        }
+    }
+    (void)pthread_mutex_unlock(&tuio->lock);
+    return sent;
+}
+
+void tuio_releaseAll(zul_tuio_t *tuio)
+{
+    if (tuio == NULL) return;
+
+    (void)pthread_mutex_lock(&tuio->lock);
+    tuio_clearSessions(tuio);
+    if (tuio->enabled)
+    {
+        tuio_encode(tuio);
+        (void)tuio_send(tuio, 0);
+    }
+    (void)pthread_mutex_unlock(&tuio->lock);
+}
+
+void tuio_getStats(zul_tuio_t *tuio, tuio_stats_t *stats, bool clear)
+{
+    if ((tuio == NULL) || (stats == NULL)) return;
+
+    (void)pthread_mutex_lock(&tuio->lock);
+    *stats = tuio->stats;
+    if (clear)
+    {
+        memset(&tuio->stats, 0, sizeof(tuio->stats));
+    }
+    (void)pthread_mutex_unlock(&tuio->lock);
+}
+
+
+// ============================================================================
+// --- Private Functions ---
+// ============================================================================
+
+// --- OSC encoding: big-endian, every item padded to a multiple of 4 bytes ---
+
+static void osc_putBytes(zul_tuio_t *t, void const *p, int n)
+{
+    if (t->len + n > t->limit)
+    {
+        t->full = true;
+        return;
+    }
+    memcpy(t->buf + t->len, p, (size_t)n);
+    t->len += n;
+}
+
+static void osc_putString(zul_tuio_t *t, char const *s)
+{
+    static uint8_t const    zeros[4] = { 0, 0, 0, 0 };
+    int                     n = (int)strlen(s);
+
+    osc_putBytes(t, s, n);
+    osc_putBytes(t, zeros, 4 - (n & 3));
+}
+
+static void osc_putInt(zul_tuio_t *t, int32_t value)
+{
+    uint32_t be = htonl((uint32_t)value);
+
+    osc_putBytes(t, &be, 4);
+}
+
+static void osc_putFloat(zul_tuio_t *t, float value)
+{
+    uint32_t bits;
+
+    memcpy(&bits, &value, 4);
+    bits = htonl(bits);
+    osc_putBytes(t, &bits, 4);
+}
+
+/**
+ * Start a bundle element: its size (filled in by osc_endMsg()), the address
+ * pattern, the type tag, and the command, the first argument of each
+ * /tuio/2Dcur message
+ */
+static void osc_beginMsg(zul_tuio_t *t, char const *cmd, char const *typeTag)
+{
+    t->msgStart = t->len;
+    osc_putInt(t, 0);
+    osc_putString(t, TUIO_ADDR);
+    osc_putString(t, typeTag);
+    osc_putString(t, cmd);
+}
+
+/**
+ * Complete the element, or remove it if it did not fit.  Return false if not.
+ */
+static bool osc_endMsg(zul_tuio_t *t)
+{
+    uint32_t be;
+
+    if (t->full)
+    {
+        t->len  = t->msgStart;
+        t->full = false;
+        return false;
+    }
+    be = htonl((uint32_t)(t->len - t->msgStart - 4));
+    memcpy(t->buf + t->msgStart, &be, 4);
+    return true;
+}
+
+// --- cursors ---
+
+/**
+ * Follow the contacts of the snapshot: new sessions, positions and motion.
+ * Set changed if a cursor appeared, moved or went.
+ */
+static void tuio_track(zul_tuio_t *t, bool *changed)
+{
+    bool    alive[TRK_MAX_CONTACTS];
+    int     i;
+
+    memset(alive, 0, sizeof(alive));
+    memset(t->updated, 0, sizeof(t->updated));
+
+    for (i = 0; i < t->snap.count; i++)
+    {
+        trk_contact_t const *   c = &t->snap.contact[i];
+        uint8_t                 id = c->ID;
+
+        if ((c->state != TRK_DOWN) && (c->state != TRK_MOVE)) continue;
+        alive[id] = true;
+
+        if ((t->session[id] == NO_SESSION) || (t->downUs[id] != c->downUs))
+        {
+            t->session[id] = t->nextSession++;
+            if (t->nextSession < 0) t->nextSession = 0;
+            t->downUs[id] = c->downUs;
+            t->velX[id]   = 0.0f;
+            t->velY[id]   = 0.0f;
+            t->accel[id]  = 0.0f;
+        }
+        else if ((c->x != t->lastX[id]) || (c->y != t->lastY[id]))
+        {
+            float dt = (float)(c->lastUs - t->lastUs[id]) / 1.0e6f;
+
+            if (dt > 0.0f)
+            {
+                float vx = (float)(c->x - t->lastX[id]) / TUIO_IN_MAX / dt;
+                float vy = (float)(c->y - t->lastY[id]) / TUIO_IN_MAX / dt;
+                float speed = sqrtf(vx * vx + vy * vy);
+                float prev  = sqrtf(t->velX[id] * t->velX[id] +
+                                    t->velY[id] * t->velY[id]);
+
+                t->accel[id] = (speed - prev) / dt;
+                t->velX[id]  = vx;
+                t->velY[id]  = vy;
+            }
+        }
+        else
+        {
+            continue;
+        }
+
+        t->lastX[id]   = c->x;
+        t->lastY[id]   = c->y;
+        t->lastUs[id]  = c->lastUs;
+        t->updated[id] = true;
+        *changed = true;
+    }
+
+    for (i = 0; i < TRK_MAX_CONTACTS; i++)
+    {
+        if ((t->session[i] != NO_SESSION) && !alive[i])
+        {
+            t->session[i] = NO_SESSION;
+            *changed = true;
+        }
+    }
+}
+
+/**
+ * Encode the bundle of a frame: source, alive, set (the updated cursors)
+ * and fseq
+ */
+static void tuio_encode(zul_tuio_t *t)
+{
+    static uint8_t const    header[16] =
+                            { '#', 'b', 'u', 'n', 'd', 'l', 'e', 0,
+                              0, 0, 0, 0, 0, 0, 0, 1 };  // time: immediately
+    char                    typeTag[2 + TRK_MAX_CONTACTS + 1];
+    int                     i, n = 0;
+
+    t->len   = 0;
+    t->full  = false;
+    t->limit = TUIO_MAX_PACKET - FSEQ_MSG_LEN;
+    osc_putBytes(t, header, sizeof(header));
+
+    osc_beginMsg(t, "source", ",ss");
+    osc_putString(t, t->source);
+    (void)osc_endMsg(t);
+
+    typeTag[n++] = ',';
+    typeTag[n++] = 's';
+    for (i = 0; i < TRK_MAX_CONTACTS; i++)
+    {
+        if (t->session[i] != NO_SESSION) typeTag[n++] = 'i';
+    }
+    typeTag[n] = '\0';
+    osc_beginMsg(t, "alive", typeTag);
+    for (i = 0; i < TRK_MAX_CONTACTS; i++)
+    {
+        if (t->session[i] != NO_SESSION) osc_putInt(t, t->session[i]);
+    }
+    (void)osc_endMsg(t);
+
+    for (i = 0; i < TRK_MAX_CONTACTS; i++)
+    {
+        if ((t->session[i] == NO_SESSION) || !t->updated[i]) continue;
+
+        osc_beginMsg(t, "set", ",sifffff");
+        osc_putInt(t, t->session[i]);
+        osc_putFloat(t, (float)t->lastX[i] / TUIO_IN_MAX);
+        osc_putFloat(t, (float)t->lastY[i] / TUIO_IN_MAX);
+        osc_putFloat(t, t->velX[i]);
+        osc_putFloat(t, t->velY[i]);
+        osc_putFloat(t, t->accel[i]);
+        if (osc_endMsg(t))
+        {
+            t->stats.cursorUpdates++;
+        }
+        else
+        {
+            t->stats.truncated++;
+        }
+    }
+
+    t->limit = TUIO_MAX_PACKET;
+    osc_beginMsg(t, "fseq", ",si");
+    osc_putInt(t, ++t->fseq);
+    (void)osc_endMsg(t);
+}
+
+/**
+ * Send the encoded bundle, and account it.  Return the bytes sent, or -1.
+ */
+static int tuio_send(zul_tuio_t *t, uint64_t rxUs)
+{
+    ssize_t     sent;
+
+    sent = sendto(t->sock, t->buf, (size_t)t->len, MSG_DONTWAIT,
+                    (struct sockaddr const *)&t->addr, sizeof(t->addr));
+    t->lastSendUs = zul_monotonicUs();
+
+    if (sent != (ssize_t)t->len)
+    {
+        // e.g. ECONNREFUSED, while no client is listening
+        if (t->stats.sendErrors++ == 0)
+        {
+            zul_logf(2, "%s: %s", __FUNCTION__,
+                            (sent < 0) ? strerror(errno) : "short send");
+        }
+        return -1;
+    }
+
+    t->stats.frames++;
+    t->stats.bytes += (uint64_t)sent;
+
+    if (rxUs != 0)
+    {
+        lat_add(&t->stats.latency,
+                (t->lastSendUs > rxUs) ? t->lastSendUs - rxUs : 0);
+    }
+    return (int)sent;
+}
+
+static void tuio_clearSessions(zul_tuio_t *t)
+{
+    int i;
+
+    for (i = 0; i < TRK_MAX_CONTACTS; i++) t->session[i] = NO_SESSION;
+    memset(t->updated, 0, sizeof(t->updated));
+}
@@ -0,0 +1,148 @@
+/*
+ *  Copyright (c) 2019 Zytronic Displays Limited. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * Should you need to contact Zytronic, you can do so either via the
+ * website <www.zytronic.co.uk> or by paper mail:
+ * Zytronic, Whiteley Road, Blaydon on Tyne, Tyne & Wear, NE21 5NJ, UK
+ */
+
+
+
+
+
+
+
+
+
+/* Module Overview
+   ===============
+   This code publishes the contacts of a tracker (see tracker.h) as TUIO 1.1
+   2D cursors, to one UDP client - by default a TUIO application on the same
+   host (127.0.0.1, port 3333).  It is intended for private touch mode, see
+   zul_SetPrivateTouchMode(), and is fed from the report handler itself, so
+   no separate input device or process stands between the controller and
+   the TUIO client.
+
+   Each touch report gives one OSC bundle, holding the /tuio/2Dcur messages:
+
+        source  <name>@<host>
+        alive   <session IDs of the cursors down>
+        set     <session ID> x y X Y m          per cursor moved or down
+        fseq    <frame>
+
+   The source is zytronic@<the host name, from gethostname()>.
+   Positions are normalised to 0..1, velocities are in normalised units per
+   second, and m is the change in speed per second.  A contact is given a
+   new session ID each time it goes down.
+
+   Bundles are encoded into a buffer of the publisher's own: no memory is
+   allocated once it is created.  When the bundle is full, the remaining set
+   messages are left out (and counted); the cursors stay alive.
+
+   tuio_update() is called with the time the report arrived, and the time
+   from then to the return of sendto() is kept as the latency of the frame.
+   When no report has arrived for TUIO_KEEPALIVE_MS, tuio_update() with no
+   arrival time sends the alive/fseq messages again, and releases contacts
+   whose release was lost.
+
+ */
+
+#ifndef _ZY_TUIO_H
+#define _ZY_TUIO_H
+
+#include "zytypes.h"
+#include "tracker.h"
+#include "latency.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define  TUIO_DEFAULT_HOST          "127.0.0.1"
+#define  TUIO_DEFAULT_PORT          (3333)
+#define  TUIO_MAX_PACKET            (8192)
+#define  TUIO_KEEPALIVE_MS          (1000)
+#define  TUIO_IN_MAX                (4095)      // report coordinate range
+
+// publisher counts, since the start or since last cleared
+typedef struct tuio_stats
+{
+    uint32_t    frames;             // bundles sent
+    uint64_t    bytes;
+    uint32_t    cursorUpdates;      // set messages sent
+    uint32_t    truncated;          // set messages left out of full bundles
+    uint32_t    sendErrors;
+
+    // from report arrival to the return of sendto()
+    lat_hist_t  latency;
+} tuio_stats_t;
+
+typedef struct zul_tuio zul_tuio_t;
+
+
+/**
+ * Create a publisher sending to host:port (TUIO_DEFAULT_HOST, and
+ * TUIO_DEFAULT_PORT, if NULL or zero).  host is a numeric IPv4 address.
+ * The publisher starts enabled.  Return NULL on failure.
+ */
+/*@null@*/
+zul_tuio_t *    tuio_create                 (/*@null@*/ char const *host,
+                                                int port);
+void            tuio_destroy                (/*@null@*/ zul_tuio_t *tuio);
+
+/**
+ * Send to another client.  Return SUCCESS or FAILURE (bad address).
+ */
+int             tuio_setTarget              (zul_tuio_t *tuio,
+                                                /*@null@*/ char const *host,
+                                                int port);
+
+/**
+ * Start or stop publishing.  When stopped, an empty alive message tells the
+ * client that every cursor is gone.
+ */
+void            tuio_enable                 (zul_tuio_t *tuio, bool enabled);
+
+/**
+ * Publish the contacts of the tracker, just updated by a report that
+ * arrived at rxUs (microseconds, from zul_monotonicUs()).  With rxUs zero,
+ * publish only if something changed, or the keepalive is due.
+ * Return the bytes sent, zero if nothing was, or -1 on error.
+ */
+int             tuio_update                 (zul_tuio_t *tuio,
+                                                zul_tracker_t *trk,
+                                                uint64_t rxUs);
+
+/**
+ * Forget every cursor, e.g. when the device changes
+ */
+void            tuio_releaseAll             (zul_tuio_t *tuio);
+
+/**
+ * Copy the counts, and optionally clear them.  Any thread may call this.
+ * lat_percentile() estimates a latency percentile (0..100) from them.
+ */
+void            tuio_getStats               (zul_tuio_t *tuio,
+                                                tuio_stats_t *stats,
+                                                bool clear);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ZY_TUIO_H
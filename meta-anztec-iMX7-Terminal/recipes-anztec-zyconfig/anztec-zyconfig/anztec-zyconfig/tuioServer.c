@@ -0,0 +1,258 @@
+/*
+ * Copyright 2019 Zytronic Displays Limited, UK.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* This code is provided as an example only.
+ * It puts a touchscreen controller into private (silent) touch mode, and
+ * publishes its touches as TUIO 1.1 2D cursors over UDP, by default to a
+ * TUIO application on the same host, see tuio.h.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <ctype.h>
+
+#include "zytypes.h"
+#include "debug.h"
+#include "usb.h"
+#include "protocol.h"
+#include "services.h"
+
+#define TEMP_BUF_LEN        (1000)
+#define SERVICE_MS          (200)
+
+int     g_deviceIndex   = -1;
+char    g_host[100+1]   = TUIO_DEFAULT_HOST;
+int     g_port          = TUIO_DEFAULT_PORT;
+int     g_statsPeriod   = 10;       // seconds, 0 => at exit only
+bool    g_deviceOpen    = false;
+
+
+// ----------------------------------------------------------------------------
+
+void printStats(char const *title)
+{
+    tuio_stats_t        st;
+    lat_hist_t const *  lat = &st.latency;
+
+    if (!zul_getTuioStats(&st, false)) return;
+    printf("%s: %u frames, %llu bytes, %u cursor updates, latency us min %u mean %u p50 %u p99 %u max %u",
+                title, st.frames, (unsigned long long)st.bytes, st.cursorUpdates,
+                lat->minUs,
+                (lat->count > 0) ? (unsigned)(lat->totalUs / lat->count) : 0u,
+                lat_percentile(lat, 50),
+                lat_percentile(lat, 99), lat->maxUs );
+    if ((st.truncated > 0) || (st.sendErrors > 0))
+    {
+        printf(", %u updates truncated, %u send errors",
+                                                st.truncated, st.sendErrors);
+    }
+    printf("\n");
+}
+
+// ----------------------------------------------------------------------------
+
+void cleanup(void)
+{
+    printf("CleanUp .. \n");
+    printStats("tuio");
+    if (g_deviceOpen)
+    {
+        zul_stopTuioServer();
+        (void)zul_closeDevice();
+        g_deviceOpen = false;
+    }
+    zul_EndServices();
+    printf("Done !\n");
+}
+
+void sigHandler( int sig)
+{
+    printf("handling signal %d\n", sig);
+    exit(0);
+}
+
+void setupHandlers(void)
+{
+    if (atexit(cleanup) != 0)
+    {
+        fprintf(stderr, "cannot set exit function\n");
+        exit(-1);
+    }
+
+    if (SIG_ERR == signal( SIGHUP, sigHandler))
+        printf ("Error loading signal handler SIGHUP\n");
+
+    if (SIG_ERR == signal( SIGINT, sigHandler))
+        printf ("Error loading signal handler SIGINT\n");
+
+    if (SIG_ERR == signal( SIGQUIT, sigHandler))
+        printf ("Error loading signal handler SIGQUIT\n");
+
+    if (SIG_ERR == signal( SIGTERM, sigHandler))
+        printf ("Error loading signal handler SIGTERM\n");
+}
+
+// ----------------------------------------------------------------------------
+
+
+void handleCommandLineOptions(int argCount, char **argStrings)
+{
+    int c;
+    opterr = 0;
+
+    while ((c = getopt (argCount, argStrings, "hd:a:p:s:v:")) != -1)
+    {
+        switch (c)
+        {
+            case 'h':
+                fprintf(stderr, "This console program publishes the touches of a Zytronic Touchscreen controller,\nin private touch mode, as TUIO 1.1 cursors.\n");
+                fprintf(stderr, "The following options are accepted:\n");
+                fprintf(stderr, "-d\ta device index\n");
+                fprintf(stderr, "-a\tthe IPv4 address of the TUIO client (default %s)\n", TUIO_DEFAULT_HOST);
+                fprintf(stderr, "-p\tthe UDP port of the TUIO client (default %d)\n", TUIO_DEFAULT_PORT);
+                fprintf(stderr, "-s\tthe statistics period in seconds, 0 for at exit only (default %d)\n", g_statsPeriod);
+                fprintf(stderr, "-v\tthe log level\n");
+                fprintf(stderr, "Usage : %s <options>\n", argStrings[0] );
+
+                exit(0);
+
+            case 'd':
+                g_deviceIndex = abs(atoi(optarg));
+                break;
+
+            case 'a':
+                strncpy(g_host, optarg, 100);
+                g_host[100] = '\0';
+                break;
+
+            case 'p':
+                g_port = abs(atoi(optarg));
+                break;
+
+            case 's':
+                g_statsPeriod = abs(atoi(optarg));
+                break;
+
+            case 'v':
+                zul_setLogLevel(atoi(optarg));
+                break;
+
+            case '?':
+                if (strchr("dapsv", optopt) != NULL)
+                    fprintf (stderr, "Option -%c requires an argument.\n", optopt);
+                else if (isprint (optopt))
+                    fprintf (stderr, "Unknown option `-%c'.\n", optopt);
+                else
+                    fprintf (stderr,
+                        "Unknown option character `\\x%x'.\n",
+                        optopt);
+                exit(1);
+            default:
+                abort();
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+int main(int numArgs, char ** argv)
+{
+    int     i;
+    int     numDevs;
+    char    tempBuffer[TEMP_BUF_LEN +1];
+    int     sinceStatsMs = 0;
+
+    handleCommandLineOptions(numArgs, argv);
+
+    i = zul_InitServices();
+    if (i!=0)
+    {
+        printf("zylibUSB open fail %d\n", i);
+        exit(EXIT_FAILURE);
+    }
+    setupHandlers();    // auto close library if interrupted
+
+    numDevs = zul_getDeviceList(tempBuffer, TEMP_BUF_LEN);
+    if (numDevs > 0)
+    {
+        printf("Found Zytronic touchscreen devices:\n%s", tempBuffer);
+        if (g_deviceIndex == -1)
+        {
+            g_deviceIndex = atoi(tempBuffer);
+        }
+    }
+    if (numDevs == 0)
+    {
+        printf("No Zytronic devices found\n");
+        exit(EXIT_FAILURE);
+    }
+    if (numDevs < 0)
+    {
+        printf("ERROR %d\n", numDevs);
+        exit(EXIT_FAILURE);
+    }
+
+    printf( "Open device #%d ... ", g_deviceIndex );
+    i = zul_openDevice(g_deviceIndex);
+    if (i != 0)
+    {
+        printf( "Error [%d] opening device index %d.\n", i, g_deviceIndex );
+        exit(EXIT_FAILURE);
+    }
+    printf( "OPENED\n" );
+    g_deviceOpen = true;
+
+    if (zul_startTuioServer(g_host, g_port) != SUCCESS)
+    {
+        fprintf(stderr, "cannot publish to %s:%d\n", g_host, g_port);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("publishing TUIO to %s:%d, ^C to stop\n", g_host, g_port);
+    while (true)
+    {
+        (void)usleep(SERVICE_MS * 1000);
+        zul_serviceTuio();
+
+        sinceStatsMs += SERVICE_MS;
+        if ((g_statsPeriod > 0) && (sinceStatsMs >= g_statsPeriod * 1000))
+        {
+            printStats("tuio");
+            sinceStatsMs = 0;
+        }
+    }
+
+    //     zul_EndServices();   // see atexit(cleanup) !
+    return 0;
+}
@@ -42,15 +42,83 @@
 #include <string.h>
 #include <pthread.h>
 #include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 #include "dbg2console.h"
 #include "usb.h"
+#include "transport.h"
 #include "debug.h"
 
 #ifdef __linux__
 #include <libusb.h>
 #endif
 
+#define IN_BUF_SZ                   (64)
+
+/**
+ * Typically the defaults work well - providing for fast get/set/status
+ * transfers.  However, more persistent efforts are required to handle certain
+ * operations:
+ *    - ZXY100 devices
+ *    - handling NACKs (should we ever need to handle a NACK?)
+ *    - Firmware Upgrade (APP -> BL & BL -> APP ..?)
+ */
+#define     DEF_CTRL_DELAY      (5)
+#define     DEF_CTRL_RETRY      (10)
+#define     DEF_CTRL_TIMEOUT    (1000)
+
+/**
+ * Interrupt IN transfers kept queued on endpoint 0x81.  ZXYdd0 devices send
+ * up to 1 report per ms (2017).
+ */
+#define     DEF_IN_XFR_POOL     (4)
+#define     IN_XFR_POOL_MAX     (16)
+#define     IN_REPORT_PERIOD_US (1000)
+
+/**
+ * All the state of one open Zytronic device.  Each device has its own
+ * interrupt IN service, handler table and control parameters, so any number
+ * may be open at once.
+ */
+struct usb_device
+{
+    /*@null@*/
+    struct usb_device *         next;           // list of open devices
+    libusb_device_handle *      handle;
+    int                         index;
+    char                        addr[7];        // "BB_AA" - values in HEX
+    int16_t                     pid;
+    uint8_t                     activeInterface;
+
+    bool                        bootloader;     // device connected is a BOOTLOADER
+    bool                        reattach;       // device was dettached from kernel
+    bool                        claimed;
+
+    // control request parameters
+    int                         ctrlDelay;
+    int                         ctrlRetry;
+    unsigned int                ctrlTimeout;
+    int                         ctrlInFlight;
+
+    // interrupt IN transfer service
+    usb_in_handler_t            IN_handler[MAX_REPORT_ID];
+    void *                      IN_context[MAX_REPORT_ID];
+    bool                        inServiceRunning;
+    volatile bool               closeInService; // stop resubmitting IN transfers
+    int                         inPoolSize;     // transfers kept queued
+    int                         inXfrAllocated;
+    int                         inXfrQueued;
+    /*@null@*/
+    struct libusb_transfer *    pIntXfr[IN_XFR_POOL_MAX];
+    unsigned char               IntXfrBuffer[IN_XFR_POOL_MAX][IN_BUF_SZ];
+    usb_in_stats_t              inStats;
+    long int                    lastIntCallbackTS;
+    int                         INXfrTimeout;   // milliseconds
+};
+
 //
 // --- Module Global Variables ---
 //
@@ -59,58 +127,174 @@ static char                     msv_usbLibStr[40 + 1] = "unopened";
 
 /*@null@*/
 static libusb_context          *msv_libusb_ctx        = NULL;
-static int                      msv_device_index      = -1;
+
+/**
+ * The device opened by the single-device API, usb_openDevice() etc. */
+/*@null@*/
+static usb_device_t            *msv_dev               = NULL;
 
 // format "bb_pp"; i.e. bus 3, address 2:  "03_02"  - values in HEX
 static char                     msv_last_device_addr[7] = "";
 
+/**
+ * All devices currently open, guarded by msv_devListMutex */
 /*@null@*/
-static libusb_device_handle    *msv_dev_handle        = NULL;
-static int16_t                  msv_device_pid        = -1;
-static uint8_t                  msv_activeInterface   = 0xff;
+static usb_device_t            *msv_openDevices       = NULL;
+static pthread_mutex_t          msv_devListMutex      = PTHREAD_MUTEX_INITIALIZER;
 
 /**
- * Boolean to indicate device connected is a BOOTLOADER */
-static bool                     msv_bootloader        = false;
+ * Holder for user supplied IN data handlers, single-device API */
+static interrupt_handler_t      msv_IN_handler[MAX_REPORT_ID];
 
 /**
- * Boolean to indicate device was dettached from kernel    */
-static bool                     msv_reattach          = false;
+ * Control parameters applied to the single-device API device */
+static int                      msv_CtrlDelay           = DEF_CTRL_DELAY;
+static int                      msv_CtrlRetry           = DEF_CTRL_RETRY;
+static unsigned int             msv_CtrlTimeout         = DEF_CTRL_TIMEOUT;
 
 /**
- * Boolean to indicate various states                      */
-static bool                     msv_dev_claimed       = false;
+ * Control latency tuning - the turnaround of each message code, per PID, is
+ * measured from SET_REPORT submission to the first non-empty reply.  Once
+ * LATENCY_MIN_SAMPLES are held, the reply polling budget and the transfer
+ * timeout of that message code are derived from them.  Each reply timeout
+ * doubles them, up to LATENCY_MAX_WIDEN times, and each LATENCY_MIN_SAMPLES
+ * replies since then halve them again.  Guarded by msv_latencyMutex, as
+ * replies complete on the event handling thread. */
+#define LATENCY_TABLE_LEN           (64)
+#define LATENCY_BUCKETS             (24)    // log2(us) - up to ~16 s
+#define LATENCY_MIN_SAMPLES         (16)
+#define LATENCY_DECAY_SAMPLES       (1024)  // halve the histogram when reached
+#define LATENCY_MIN_BUDGET_MS       (10)
+#define LATENCY_MIN_TIMEOUT_MS      (250)
+#define LATENCY_MAX_MS              (10000)
+#define LATENCY_MIN_RETRY           (3)
+#define LATENCY_MAX_WIDEN           (3)     // budget doubled at most 3 times
+#define LATENCY_RELEARN_MIN_MS      (10000) // between discards of an entry
+
+typedef struct
+{
+    bool                        used;
+    int16_t                     pid;
+    uint8_t                     msgCode;
+    uint32_t                    samples;        // since last (re)learn
+    uint32_t                    timeouts;
+    uint32_t                    relearns;       // learned values discarded
+    uint32_t                    sinceTimeout;   // replies since a timeout
+    int                         widen;          // log2 budget multiplier
+    uint64_t                    relearnMs;      // monotonic, last discard
+    uint32_t                    ewmaUs;
+    uint32_t                    maxUs;
+    uint32_t                    histogram[LATENCY_BUCKETS];
+} LatencyEntry_t;
+
+static LatencyEntry_t           msv_latencyTable[LATENCY_TABLE_LEN];
+static bool                     msv_latencyAdaptive     = true;
+static pthread_mutex_t          msv_latencyMutex        = PTHREAD_MUTEX_INITIALIZER;
 
+/**
+ * Event loop - epoll set of the libusb fds, and an eventfd to wake the
+ * event thread.  msv_externalEvents => the host application's loop calls
+ * usb_handleEvents() instead of the event thread.  While another thread
+ * holds libusb's event lock, the epoll set stays readable; usb_handleEvents()
+ * then waits (up to EVENT_BACKOFF_MS) for that thread to finish, rather than
+ * returning at once to a loop that would wake again immediately. */
+#define EVENT_BACKOFF_MS            (10)
+static int                      msv_epollFd             = -1;
+static int                      msv_wakeFd              = -1;
+static pthread_t                msv_eventThread;
+static bool                     msv_eventThreadRunning  = false;
+static volatile bool            msv_stopEvents          = false;
+static bool                     msv_externalEvents      = false;
 
 /**
- * Holder for user supplied IN data handlers */
-static interrupt_handler_t      msv_IN_handler[MAX_REPORT_ID];
+ * Enumeration cache - a referenced snapshot of the libusb device list, and
+ * the details of the Zytronic devices in it.  Guarded by msv_enumMutex. */
+#define ENUM_TABLE_LEN              (16)
+
+typedef struct
+{
+    libusb_device *             ldev;           // held by msv_enumList
+    int                         index;          // position in msv_enumList
+    uint8_t                     bus, address;
+    char                        addr[7];        // "BB_AA" - values in HEX
+    uint16_t                    vid;
+    int16_t                     pid;
+    uint8_t                     numInterfaces;
+    uint8_t                     mgmtInterface;
+} EnumEntry_t;
+
+/*@null@*/
+static libusb_device **         msv_enumList            = NULL;
+static int                      msv_enumListCount       = 0;
+static EnumEntry_t              msv_enumTable[ENUM_TABLE_LEN];
+static int                      msv_enumCount           = 0;
+static bool                     msv_enumValid           = false;
+static pthread_mutex_t          msv_enumMutex           = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Hotplug - live table of the attached Zytronic devices, guarded by
+ * msv_hotplugMutex.  msv_hotplugCond is signalled on each change. */
+#define HOTPLUG_TABLE_LEN           (16)
+
+typedef struct
+{
+    bool                        present;
+    char                        addr[7];        // "BB_AA" - values in HEX
+    int16_t                     pid;
+} HotplugEntry_t;
+
+static bool                     msv_hotplugActive       = false;
+static libusb_hotplug_callback_handle   msv_hotplugHandle;
+static HotplugEntry_t           msv_hotplugTable[HOTPLUG_TABLE_LEN];
+static pthread_mutex_t          msv_hotplugMutex        = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t           msv_hotplugCond         = PTHREAD_COND_INITIALIZER;
 
 /**
- * Set this to terminate the IN handler thread during device closure */
-static bool                     msv_closeInThread     = false;
+ * Interrupt IN transfer pool size, applied as devices are opened */
+static int                      msv_InXfrPoolSize       = DEF_IN_XFR_POOL;
 
 
 //
 // --- Private Prototypes ---
 //
 
-static bool dev_match                   (libusb_device *dev,
-                                         const uint16_t vendor,
-                                         const uint16_t product);
+static int  usb_openByIndex             (int index, bool legacy,
+                                         usb_device_t **dev);
+static int  usb_openByAddr              (char const *addrStr, bool legacy,
+                                         usb_device_t **dev);
+static int  usb_devPrepare              (EnumEntry_t const *entry,
+                                         bool legacy, usb_device_t **pdev);
+static bool usb_devIsOpen               (char const *addr);
 
-static int  usb_claimInterface          (uint8_t iface);
-static int  usb_releaseInterface        (uint8_t iface);
+static int  usb_claimInterface          (usb_device_t *dev, uint8_t iface);
+static int  usb_releaseInterface        (usb_device_t *dev, uint8_t iface);
 
 
 // test if data holds non-zero bytes
 static bool nonZeroData                 (uint8_t *data, int len);
 
-int         usb_BeginInterruptTransfer  (int timeoutMs);
+static int  usb_BeginInterruptTransfer  (usb_device_t *dev, int timeoutMs);
+static int  usb_submitInXfr             (usb_device_t *dev,
+                                         struct libusb_transfer *transfer);
+static void usb_freeInXfr               (usb_device_t *dev,
+                                         struct libusb_transfer *transfer);
 
-void        usb_stopInXfrService(void);
+static void usb_stopInXfrService        (usb_device_t *dev);
 
-void        *interruptXfrWorker         (void *arg);
+static int  usb_initEventLoop           (void);
+static void usb_endEventLoop            (void);
+static void usb_startEventThread        (void);
+static void usb_stopEventThread         (void);
+static void *usb_eventWorker            (void *arg);
+
+static void usb_enumInvalidate          (void);
+static void usb_enumRelease             (void);
+static int  usb_enumRefresh             (void);
+static bool usb_enumLookup              (int index, char const *addrStr,
+                                         EnumEntry_t *out);
+
+static void usb_initHotplug             (void);
+static void usb_endHotplug              (void);
 
 
 // --- Default interrupt data handlers --
@@ -123,6 +307,9 @@ void        *interruptXfrWorker         (void *arg);
 
 void        default_IN_handler          (uint8_t *data);
 
+// route IN data of the single-device API device to msv_IN_handler[]
+static void legacy_IN_dispatch          (void *context, uint8_t *data);
+
 
 // ============================================================================
 // --- Public Implementation ---
@@ -164,6 +351,12 @@ int usb_openLib(void)
 
     libusb_set_debug(msv_libusb_ctx, LIBUSB_LOG_LEVEL_ERROR );
 
+    if (usb_initEventLoop() != 0)
+    {
+        return -2;
+    }
+    usb_initHotplug();
+
     for (i = 0; i < MAX_REPORT_ID; i++)
     {
         msv_IN_handler[i] = NULL;
@@ -188,11 +381,24 @@ void usb_closeLib(void)
 {
     if (msv_libusb_ctx==NULL) return;
 
-    if (msv_dev_handle != NULL)
+    if (msv_dev != NULL)
     {
         usb_closeDevice();
     }
 
+    // close any devices opened via the multi-device API
+    while (msv_openDevices != NULL)
+    {
+        (void)usb_devClose(msv_openDevices);
+    }
+
+    usb_endHotplug();
+    usb_endEventLoop();
+
+    (void)pthread_mutex_lock(&msv_enumMutex);
+    usb_enumRelease();
+    (void)pthread_mutex_unlock(&msv_enumMutex);
+
     libusb_exit(msv_libusb_ctx); //close the session
     msv_libusb_ctx = NULL;
 }
@@ -209,11 +415,9 @@ int usb_getDeviceList(char *buf, int len)
     int             numFound = 0;
     int             i, cnt;       // list handling
 
-    libusb_device   **list;       // pointer to hold list of devices
-
     if (msv_libusb_ctx==NULL) return -11;
 
-    cnt = (int) libusb_get_device_list(msv_libusb_ctx, &list);
+    cnt = usb_enumRefresh();
 
     if(cnt < 0)
     {
@@ -229,41 +433,28 @@ int usb_getDeviceList(char *buf, int len)
 
     zul_logf ( 3, "%d Devices in list", cnt);
 
-    for (i = 0; i < cnt; i++)
+    (void)pthread_mutex_lock(&msv_enumMutex);
+    for (i = 0; i < msv_enumCount; i++)
     {
-        if (dev_match(list[i], ZYTRONIC_VENDOR_ID, 0))
-        {
-            char newDevice[120];
-            uint16_t idProduct;
-            int ok = -1;
-            uint8_t     busNo  = libusb_get_bus_number ( list[i] );
-            uint8_t     addr = libusb_get_device_address( list[i] );
-
-            zul_logf(3, " >> Instance:%d. Zytronic! Addr=%02X_%02X", i, busNo, addr );
-
-            struct libusb_device_descriptor desc;
-            idProduct = 0;
-            ok =  libusb_get_device_descriptor( list[i], &desc );
-            if (ok == 0)
-            {
-                idProduct = desc.idProduct;
-            }
-
-            /* below we leave room at end of strings for device name string, and APP/BL marker
-             * which is filled in by zul_getDeviceList() */
-            (void)snprintf(newDevice, 120,
-                         "  %d. VID:%04X PID:%04X Addr=%02X_%02X NNNNNN MMM\n",
-                            i, ZYTRONIC_VENDOR_ID, (uint)idProduct, (uint)busNo, (uint)addr
-                          );
-            strncat(result, newDevice, 2000);
-            numFound ++;
-        }
+        EnumEntry_t    *entry = &msv_enumTable[i];
+        char            newDevice[120];
+
+        zul_logf(3, " >> Instance:%d. Zytronic! Addr=%s", entry->index, entry->addr );
+
+        /* below we leave room at end of strings for device name string, and APP/BL marker
+         * which is filled in by zul_getDeviceList() */
+        (void)snprintf(newDevice, 120,
+                     "  %d. VID:%04X PID:%04X Addr=%s NNNNNN MMM\n",
+                        entry->index, ZYTRONIC_VENDOR_ID,
+                        (uint)(uint16_t)entry->pid, entry->addr
+                      );
+        strncat(result, newDevice, 2000);
+        numFound ++;
     }
+    (void)pthread_mutex_unlock(&msv_enumMutex);
 
     zul_logf ( 3, " >> Found %d Zytronic devices\n", numFound);
 
-    libusb_free_device_list( list, 1); //free the list, unref the devices in it
-
     strncpy(buf, result, (size_t)len);
     buf[len] = '\0';
     return numFound;
@@ -310,21 +501,11 @@ int usb_reOpenLastDevice(void)
  */
 int usb_getAddrStr(char * addrStr)
 {
-    if (msv_device_index == -1)
-    {
-        return -1;                      // busy !! one connection at a time
-    }
-    if (msv_dev_handle == NULL)
-    {
-        return -2;                      // busy !! error ?
-    }
-    if (strlen(msv_last_device_addr) != 5)
+    if (msv_dev == NULL)
     {
-        return -3;
+        return -1;
     }
-
-    strcpy( addrStr, msv_last_device_addr );
-    return SUCCESS;
+    return usb_devGetAddrStr(msv_dev, addrStr);
 }
 
 /**
@@ -350,116 +531,19 @@ uint8_t usb_getManagementIface(int16_t idProduct)
  */
 int usb_openDeviceByAddr(char *addrStr)
 {
-    ssize_t         cnt;                // list handling
-    libusb_device   **list;             // pointer to hold list of devices
-    char            newDevice[7] = "";  // device USB Address String
-
-    int16_t         idProduct;
-    int             ok = -1;
-    struct libusb_device_descriptor desc;
+    int retVal;
 
-    if (msv_device_index != -1)
+    if (msv_dev != NULL)
     {
         return -1;                      // busy !! one connection at a time
     }
-    if (msv_dev_handle != NULL)
-    {
-        return -2;                      // busy !! error ?
-    }
-
-    if (msv_libusb_ctx==NULL)
-    {
-        return -11;
-    }
-
-    cnt = libusb_get_device_list(msv_libusb_ctx, &list);
-
-    if (cnt < 0)
-    {
-        zul_log(0, "Get Device Error");
-        return -12;
-    }
-
-    if (cnt == 0)
-    {
-        zul_log(0, "No Devices");
-        return -13;
-    }
-
-    zul_logf( 4, "OPENING, %d Devices Available.\n", cnt);
-
-    // search device list (of Zytronic devices) for supplied address
-    int index = -1,i;
-    for (i = 0; (i < cnt) && (index < 0); i++)
-    {
-        if (dev_match(list[i], ZYTRONIC_VENDOR_ID, 0))
-        {
-            uint8_t     busNo = libusb_get_bus_number ( list[i] );
-            uint8_t     addr  = libusb_get_device_address ( list[i] );
-            snprintf(newDevice, 7, "%02X_%02X", (uint)busNo, (uint)addr );
-            zul_logf(3, " >> Instance:%03d. Zytronic Device Addr=%s",
-                            i, newDevice );
-            if ( 0 == strcmp (newDevice, addrStr))
-            {
-                index = i;
-                strcpy ( msv_last_device_addr, newDevice );
-            }
-        }
-    }
-
-    idProduct = 0;
-    ok =  libusb_get_device_descriptor( list[index], &desc );
-    if (ok == 0)
-    {
-        idProduct = desc.idProduct;
-        zul_logf ( 3, " >> Instance:%d. Zytronic PID %d!\n",
-                        index, (int)idProduct);
-    }
-
-    if (idProduct <= USB32C_PRODUCT_ID)
-    {
-        zul_logf ( 0, " Device is too old for this library!\n");
-        return -5;
-    }
-
-    ok = libusb_open( list[index], &msv_dev_handle);
-    zul_logf( 3, " >> libusb_open: %d\n", ok );
-    if (ok == 0)
-    {
-        zul_log_ts ( 3, "Device Opened" );
-        msv_device_index = index;
-        msv_device_pid = idProduct;
-
-        // set Bootloader Mode for BL devices
-        msv_bootloader = usb_isBLDevicePID(msv_device_pid);
-        // get the preferred interface
-        msv_activeInterface = usb_getManagementIface(idProduct);
-
-        zul_logf(3, "Device Handle : %p PID:%04x BL:%d IF:%d\n",
-                 msv_dev_handle, msv_device_pid,
-                 msv_bootloader, msv_activeInterface );
 
-        // prepare device
-        ok = usb_claimInterface(msv_activeInterface);
-        if ( ok != 0 )  // failed to prepare device
-        {
-            zul_log(0, "failed to prepare touchcontroller device");
-            (void)usb_closeDevice();
-            return -3;
-        }
-    }
-    else
+    retVal = usb_openByAddr(addrStr, true, &msv_dev);
+    if (retVal == 0)
     {
-        msv_dev_handle = NULL;
+        strcpy ( msv_last_device_addr, msv_dev->addr );
     }
-
-    //free the list, unref the devices in it
-    libusb_free_device_list( list, 1);
-
-    if (msv_dev_handle == NULL)
-        return -4;
-
-    return 0;
+    return retVal;
 }
 
 
@@ -471,101 +555,19 @@ int usb_openDeviceByAddr(char *addrStr)
  */
 int usb_openDevice(int index)
 {
-    ssize_t         cnt;            // list handling
-    libusb_device   **list;         // pointer to hold list of devices
-
-    if (msv_device_index != -1)
-        return -1;                  // busy !! one connection at a time
-    if (msv_dev_handle != NULL)
-        return -2;                  // busy !! error ?
-
-    // setup ?
-    if (msv_libusb_ctx==NULL)
-        return -11;
-
-    cnt = libusb_get_device_list(msv_libusb_ctx, &list);
-
-    if(cnt < 0)
-    {
-        zul_log(0, "Get Device Error");
-        return -12;
-    }
+    int retVal;
 
-    if(cnt == 0)
+    if (msv_dev != NULL)
     {
-        zul_log(0, "No Devices");
-        return -13;
+        return -1;                      // busy !! one connection at a time
     }
 
-    zul_logf( 4, "OPENING, %d Devices Available.\n", cnt);
-
-    if (dev_match(list[index], ZYTRONIC_VENDOR_ID, 0))
+    retVal = usb_openByIndex(index, true, &msv_dev);
+    if (retVal == 0)
     {
-        int16_t                         idProduct;
-        int                             ok = -1;
-        uint8_t                         busNo, addr;
-        struct libusb_device_descriptor desc;
-
-        idProduct = 0;
-        ok =  libusb_get_device_descriptor( list[index], &desc );
-        if (ok == 0)
-        {
-            idProduct = desc.idProduct;
-            zul_logf ( 3, " >> Instance:%d. Zytronic PID %d!\n",
-                index, (int)idProduct);
-        }
-
-        if (idProduct <= USB32C_PRODUCT_ID)
-        {
-            zul_logf ( 0, " Device is too old for this library!\n");
-            return -5;
-        }
-
-        ok = libusb_open( list[index], &msv_dev_handle);
-
-        busNo   = libusb_get_bus_number ( list[index] );
-        addr = libusb_get_device_address( list[index] );
-        snprintf(msv_last_device_addr, 7, "%02X_%02X",
-                                    (uint)busNo, (uint)addr );
-
-        zul_logf( 3, " >> libusb_open: %d\n", ok );
-        if (ok == 0)
-        {
-            zul_log_ts ( 3, "Device Opened" );
-            msv_device_index = index;
-            msv_device_pid = idProduct;
-
-            // set Bootloader Mode for BL devices
-            msv_bootloader = usb_isBLDevicePID(msv_device_pid);
-            // get the preferred interface
-            msv_activeInterface = usb_getManagementIface(idProduct);
-
-            zul_logf(3, "Device Handle : %p PID:%04x BL:%d IF:%d\n",
-                     msv_dev_handle, msv_device_pid,
-                     msv_bootloader, msv_activeInterface);
-
-            // prepare device
-            ok = usb_claimInterface(msv_activeInterface);
-            if ( ok != 0 )  // failed to prepare device
-            {
-                zul_log(0, "failed to prepare touchcontroller device");
-                (void)usb_closeDevice();
-                return -3;
-            }
-        }
-        else
-        {
-            msv_dev_handle = NULL;
-        }
+        strcpy ( msv_last_device_addr, msv_dev->addr );
     }
-
-    //free the list, unref the devices in it
-    libusb_free_device_list( list, 1);
-
-    if (msv_dev_handle == NULL)
-        return -4;
-
-    return 0;
+    return retVal;
 }
 
 /**
@@ -574,10 +576,9 @@ int usb_openDevice(int index)
  */
 bool usb_getDevicePID(int16_t *pid)
 {
-    if (msv_device_pid < 0) return false;
+    if (msv_dev == NULL) return false;
 
-    *pid = msv_device_pid;
-    return true;
+    return usb_devGetPID(msv_dev, pid);
 }
 
 /* All pre-2018 devices use interface 0 which also carries the touch
@@ -601,18 +602,9 @@ bool usb_getDevicePID(int16_t *pid)
  */
 bool usb_switchIFace (uint8_t iface)
 {
-    zul_logf(3, "%s to %d\n", __FUNCTION__, iface );
-    usb_releaseInterface(msv_activeInterface);
-
-    if (0 == usb_claimInterface(iface))
-    {
-        msv_activeInterface = iface;
-        return true;
-    }
+    if (msv_dev == NULL) return false;
 
-    // restore initial interface
-    usb_claimInterface(msv_activeInterface);
-    return false;
+    return usb_devSwitchIFace(msv_dev, iface);
 }
 
 
@@ -622,355 +614,2023 @@ bool usb_switchIFace (uint8_t iface)
  */
 int usb_closeDevice(void)
 {
+    int retVal;
+
     if (msv_libusb_ctx==NULL)
         return -11;
 
-    if (msv_dev_handle == NULL)
+    if (msv_dev == NULL)
         return -2;      // error - not open!
 
-    usb_releaseInterface(msv_activeInterface);
-
-    libusb_close(msv_dev_handle);
-
-    msv_dev_handle          = NULL;
-
-    msv_device_index        = -1;
-    msv_device_pid          = -1;
+    retVal = usb_devClose(msv_dev);
+    msv_dev = NULL;
 
-    return 0;
+    return retVal;
 }
 
 
 // ----------------------------------------------------------------------------
-// --- Control of Communications Parameters ---
+// --- Multiple Device Support ---
 // ----------------------------------------------------------------------------
 
-
 /**
- * Typically the defaults work well - providing for fast get/set/status
- * transfers.  However, more persistent efforts are required to handle certain
- * operations:
- *    - ZXY100 devices
- *    - handling NACKs (should we ever need to handle a NACK?)
- *    - Firmware Upgrade (APP -> BL & BL -> APP ..?)
+ * Open a device by the indices provided by zul_getDeviceList(), returning
+ * a new device context in *dev.
+ * Return 0 to indicate success, else a negative error code.
  */
-#define     DEF_CTRL_DELAY      (5)
-static int                      msv_CtrlDelay           = DEF_CTRL_DELAY;
-
-#define     DEF_CTRL_RETRY      (10)
-static int                      msv_CtrlRetry           = DEF_CTRL_RETRY;
-
-#define     DEF_CTRL_TIMEOUT    (1000)
-static unsigned int             msv_CtrlTimeout         = DEF_CTRL_TIMEOUT;
-
-void usb_setCtrlDelay(int delay)
-{
-    msv_CtrlDelay = delay;
-    zul_logf (4, "%s - TX-RX Delay %d (ms)", __FUNCTION__, msv_CtrlDelay );
-}
-
-void usb_defaultCtrlDelay(void)
-{
-    usb_setCtrlDelay ( DEF_CTRL_DELAY );
-}
-
-void usb_setCtrlRetry(int retries)
+int usb_devOpen(int index, usb_device_t **dev)
 {
-    msv_CtrlRetry = retries;
-    zul_logf (4, "%s %d Retries ", __FUNCTION__, msv_CtrlRetry );
-}
-
-void usb_defaultCtrlRetry(void)
-{
-    usb_setCtrlRetry ( DEF_CTRL_RETRY );
-}
-
-void usb_setCtrlTimeout(int delay)
-{
-    msv_CtrlTimeout = delay;
-    zul_logf (4, "%s  %d(ms)", __FUNCTION__, msv_CtrlDelay );
+    return usb_openByIndex(index, false, dev);
 }
 
-void usb_defaultCtrlTimeout(void)
+/**
+ * Open a device by its usb bus address string, returning a new device
+ * context in *dev.
+ * Return 0 to indicate success, else a negative error code.
+ */
+int usb_devOpenByAddr(char const *addrStr, usb_device_t **dev)
 {
-    usb_setCtrlTimeout ( DEF_CTRL_TIMEOUT );
+    return usb_openByAddr(addrStr, false, dev);
 }
 
-#define BUF_LEN                     (64)
 /**
- * The request of reqLen bytes is sent to the Zytronic USB device, and if
- * the handle_reply pointer-to-function is not null, the supplied function is
- * called to handle the response.
+ * Open a device by list index. legacy selects the handler table of the
+ * single-device API.
  */
-int usb_ControlRequest(uint8_t *request, uint16_t reqLen,
-                                            response_handler_t handle_reply)
+static int usb_openByIndex(int index, bool legacy, usb_device_t **dev)
 {
-    const uint8_t   txRmReqType     = 0x21;     // 00=>ENDPOINT_OUT;  20 => CLASS; 01 => INTERFACE
-    const uint8_t   txBReq          = 0x09;     // HID_SET_REPORT
+    EnumEntry_t     entry;
+    int             cnt;
+    int             retVal = -4;
 
-    const uint8_t   rxRmReqType     = 0xA1;     // 80=>ENDPOINT_IN; 20 => CLASS; 01 => INTERFACE
-    const uint8_t   rxBReq          = 0x01;     // HID_GET_REPORT
-
-    const uint16_t  wIndex          = msv_activeInterface; // see USB Complete Ed.3 P331.
-    const uint16_t  wLength         = BUF_LEN;
+    if (dev == NULL)
+        return -20;
 
-    // msv_CtrlTimeout: BL Program DataBlock takes > 2500 mS
+    // setup ?
+    if (msv_libusb_ctx==NULL)
+        return -11;
 
-    uint8_t data[BUF_LEN+1];
-    int res = 0;
+    cnt = usb_enumRefresh();
 
-    // bootloader or application comms
-    uint16_t wValue;
-    if(msv_bootloader)
+    if(cnt < 0)
     {
-        wValue = 0x0300;    // 03 = ReportType
+        zul_log(0, "Get Device Error");
+        return -12;
     }
-    else
+
+    if(cnt == 0)
     {
-        wValue = 0x0305;    // 03 = ReportType; 05 = ReportID
+        zul_log(0, "No Devices");
+        return -13;
     }
 
-    zul_log_hex(4, "  CTRL req : ", request, (int)reqLen);
+    zul_logf( 4, "OPENING, %d Devices Available.\n", cnt);
 
-    if (msv_dev_handle == NULL)
+    if ( (index >= 0) && usb_enumLookup(index, NULL, &entry) )
     {
-        zul_logf (0, "%s - no device", __FUNCTION__);
-        return LIBUSB_ERROR_NO_DEVICE;
+        retVal = usb_devPrepare(&entry, legacy, dev);
+        libusb_unref_device(entry.ldev);
     }
 
-    if (request == NULL)
-    {
-        return -20;
+    return retVal;
+}
+
+/**
+ * Open a device by usb bus address string. legacy selects the handler table
+ * of the single-device API.
+ */
+static int usb_openByAddr(char const *addrStr, bool legacy, usb_device_t **dev)
+{
+    EnumEntry_t     entry;
+    int             cnt;
+    int             retVal = -4;
+
+    if ((dev == NULL) || (addrStr == NULL))
+    {
+        return -20;
+    }
+
+    if (msv_libusb_ctx==NULL)
+    {
+        return -11;
+    }
+
+    cnt = usb_enumRefresh();
+
+    if (cnt < 0)
+    {
+        zul_log(0, "Get Device Error");
+        return -12;
+    }
+
+    if (cnt == 0)
+    {
+        zul_log(0, "No Devices");
+        return -13;
+    }
+
+    zul_logf( 4, "OPENING, %d Devices Available.\n", cnt);
+
+    // search the cached Zytronic devices for supplied address
+    if (usb_enumLookup(-1, addrStr, &entry))
+    {
+        zul_logf(3, " >> Instance:%03d. Zytronic Device Addr=%s",
+                        entry.index, entry.addr );
+        retVal = usb_devPrepare(&entry, legacy, dev);
+        libusb_unref_device(entry.ldev);
+    }
+
+    return retVal;
+}
+
+/**
+ * Close a device opened by usb_devOpen() or usb_devOpenByAddr(), and free
+ * the context.  The context pointer is invalid after this call.
+ */
+int usb_devClose(usb_device_t *dev)
+{
+    usb_device_t  **pp;
+
+    if (msv_libusb_ctx==NULL)
+        return -11;
+
+    if ((dev == NULL) || (dev->handle == NULL))
+        return -2;      // error - not open!
+
+    usb_releaseInterface(dev, dev->activeInterface);
+
+    // let any control request in flight complete before the handle goes
+    while (__atomic_load_n(&dev->ctrlInFlight, __ATOMIC_ACQUIRE) > 0)
+    {
+        struct timeval tv = { 0, 10000 };
+        (void)libusb_handle_events_timeout(msv_libusb_ctx, &tv);
+    }
+
+    libusb_close(dev->handle);
+    dev->handle = NULL;
+
+    (void)pthread_mutex_lock(&msv_devListMutex);
+    for (pp = &msv_openDevices; *pp != NULL; pp = &(*pp)->next)
+    {
+        if (*pp == dev)
+        {
+            *pp = dev->next;
+            break;
+        }
+    }
+    (void)pthread_mutex_unlock(&msv_devListMutex);
+
+    if (dev == msv_dev)
+    {
+        msv_dev = NULL;
+    }
+    free(dev);
+
+    return 0;
+}
+
+/**
+ * Provide the device context used by the single-device API, NULL if closed
+ */
+usb_device_t * usb_getDefaultDevice(void)
+{
+    return msv_dev;
+}
+
+/**
+ * If the device is open, set the supplied pid and return true
+ * else, return false
+ */
+bool usb_devGetPID(usb_device_t *dev, int16_t *pid)
+{
+    if ((dev == NULL) || (dev->pid < 0)) return false;
+
+    *pid = dev->pid;
+    return true;
+}
+
+/**
+ * Copy the device address string to the supplied buffer if available.
+ * If supplied, return zero, else return a negative error number.
+ */
+int usb_devGetAddrStr(usb_device_t *dev, char * addrStr)
+{
+    if (dev == NULL)
+    {
+        return -1;
+    }
+    if (dev->handle == NULL)
+    {
+        return -2;
+    }
+    if (strlen(dev->addr) != 5)
+    {
+        return -3;
+    }
+
+    strcpy( addrStr, dev->addr );
+    return SUCCESS;
+}
+
+/**
+ * Close the current interface of the device, and attempt to open the
+ * requested interface.  Return true if requested interface was available.
+ * If requested interface can't be opened, reconnect to the previous interface
+ *  and return false.
+ */
+bool usb_devSwitchIFace(usb_device_t *dev, uint8_t iface)
+{
+    zul_logf(3, "%s to %d\n", __FUNCTION__, iface );
+    if (dev == NULL) return false;
+
+    usb_releaseInterface(dev, dev->activeInterface);
+
+    if (0 == usb_claimInterface(dev, iface))
+    {
+        dev->activeInterface = iface;
+        return true;
+    }
+
+    // restore initial interface
+    usb_claimInterface(dev, dev->activeInterface);
+    return false;
+}
+
+
+// ----------------------------------------------------------------------------
+// --- Control of Communications Parameters ---
+// ----------------------------------------------------------------------------
+
+/**
+ * The single-device API setters alter the parameters of the device opened by
+ * usb_openDevice(), and those applied when it is next opened.
+ */
+void usb_setCtrlDelay(int delay)
+{
+    msv_CtrlDelay = delay;
+    if (msv_dev != NULL) msv_dev->ctrlDelay = delay;
+    zul_logf (4, "%s - TX-RX Delay %d (ms)", __FUNCTION__, msv_CtrlDelay );
+}
+
+void usb_defaultCtrlDelay(void)
+{
+    usb_setCtrlDelay ( DEF_CTRL_DELAY );
+}
+
+void usb_setCtrlRetry(int retries)
+{
+    msv_CtrlRetry = retries;
+    if (msv_dev != NULL) msv_dev->ctrlRetry = retries;
+    zul_logf (4, "%s %d Retries ", __FUNCTION__, msv_CtrlRetry );
+}
+
+void usb_defaultCtrlRetry(void)
+{
+    usb_setCtrlRetry ( DEF_CTRL_RETRY );
+}
+
+void usb_setCtrlTimeout(int delay)
+{
+    msv_CtrlTimeout = delay;
+    if (msv_dev != NULL) msv_dev->ctrlTimeout = delay;
+    zul_logf (4, "%s  %d(ms)", __FUNCTION__, msv_CtrlDelay );
+}
+
+void usb_defaultCtrlTimeout(void)
+{
+    usb_setCtrlTimeout ( DEF_CTRL_TIMEOUT );
+}
+
+/**
+ * Set the control request parameters of one device. A negative value
+ * restores the default for that parameter.
+ */
+void usb_devSetCtrlParams(usb_device_t *dev, int delay, int retries, int timeout)
+{
+    if (dev == NULL) return;
+
+    dev->ctrlDelay   = (delay   < 0) ? DEF_CTRL_DELAY   : delay;
+    dev->ctrlRetry   = (retries < 0) ? DEF_CTRL_RETRY   : retries;
+    dev->ctrlTimeout = (timeout < 0) ? DEF_CTRL_TIMEOUT : (unsigned int)timeout;
+
+    zul_logf (4, "%s %s - %d(ms) %d Retries %u(ms)", __FUNCTION__, dev->addr,
+                            dev->ctrlDelay, dev->ctrlRetry, dev->ctrlTimeout );
+}
+
+/**
+ * Set the number of interrupt IN transfers kept queued, for devices opened
+ * after this call.  Values are limited to 1..IN_XFR_POOL_MAX
+ */
+void usb_setInXfrPoolSize(int count)
+{
+    if (count < 1) count = 1;
+    if (count > IN_XFR_POOL_MAX) count = IN_XFR_POOL_MAX;
+    msv_InXfrPoolSize = count;
+    zul_logf (4, "%s  %d", __FUNCTION__, msv_InXfrPoolSize );
+}
+
+/**
+ * Copy the interrupt IN counters of a device. Return false if not open.
+ */
+bool usb_devGetInStats(usb_device_t *dev, usb_in_stats_t *stats)
+{
+    if ((dev == NULL) || (stats == NULL)) return false;
+
+    *stats = dev->inStats;
+    return true;
+}
+
+bool usb_getInStats(usb_in_stats_t *stats)
+{
+    return usb_devGetInStats(msv_dev, stats);
+}
+
+#define BUF_LEN                     (64)
+
+// HID class requests, carried on the default control pipe
+#define HID_SET_REPORT_REQ_TYPE     (0x21)  // 00=>ENDPOINT_OUT;  20 => CLASS; 01 => INTERFACE
+#define HID_SET_REPORT              (0x09)
+#define HID_GET_REPORT_REQ_TYPE     (0xA1)  // 80=>ENDPOINT_IN; 20 => CLASS; 01 => INTERFACE
+#define HID_GET_REPORT              (0x01)
+
+/**
+ * One control request, as it moves from the SET_REPORT (TX) phase to the
+ * GET_REPORT (RX) phase.  The GET_REPORT is submitted from the completion of
+ * the SET_REPORT, and resubmitted from the completion of each empty reply, so
+ * the controller is polled as fast as it can turn a request around.
+ */
+typedef struct
+{
+    usb_device_t *              dev;
+    struct libusb_transfer *    xfr;
+    uint8_t                     buffer[LIBUSB_CONTROL_SETUP_SIZE + BUF_LEN];
+    uint8_t                     request[BUF_LEN];
+    uint16_t                    wValue;
+    uint16_t                    wIndex;
+    uint8_t                     msgCode;        // latency table key
+    bool                        expectReply;
+    bool                        rxPhase;
+    int                         rxAttempts;
+    int                         rxRetryLimit;
+    long int                    rxBudgetMs;     // reply polling time allowed
+    uint64_t                    rxDeadline;     // monotonic, milliseconds
+    uint64_t                    startUs;        // submitted; 0 => not measured
+    unsigned int                xfrTimeout;     // ms, per transfer
+    usb_ctrl_done_t             done;
+    void *                      user;
+} CtrlXfr_t;
+
+/**
+ * Completion record used by the synchronous wrappers
+ */
+typedef struct
+{
+    int                         completed;
+    int                         result;
+    bool                        replied;
+    uint8_t                     reply[BUF_LEN];
+} CtrlSync_t;
+
+static int          usb_xfrStatusToError(struct libusb_transfer *transfer);
+static void         usb_logCtrlError    (const char *dir, int res);
+static int          ctrlSubmit          (CtrlXfr_t *cx);
+static void         ctrlRelease         (CtrlXfr_t *cx);
+static void         ctrlComplete        (CtrlXfr_t *cx, int res, uint8_t *reply);
+static void         ctrlXfrCallback     (struct libusb_transfer *transfer);
+static CtrlXfr_t *  ctrlAlloc           (usb_device_t *dev,
+                                         uint8_t *request, uint16_t reqLen,
+                                         usb_ctrl_done_t done, void *user);
+static int          ctrlSyncRequest     (usb_device_t *dev,
+                                         uint8_t *request, uint16_t reqLen,
+                                         bool expectReply, CtrlSync_t *sync);
+static void         ctrlSyncDone        (int result, uint8_t *reply, void *user);
+static void         ctrlSyncAwait       (CtrlSync_t *sync);
+
+static LatencyEntry_t * latencyFind     (int16_t pid, uint8_t msgCode, bool add);
+static void         latencyRecord       (int16_t pid, uint8_t msgCode, long int us);
+static void         latencyTimeout      (int16_t pid, uint8_t msgCode);
+static uint32_t     latencyPercentile   (LatencyEntry_t const *e, int percent);
+static void         latencyParams       (LatencyEntry_t const *e, long int *budgetMs,
+                                         int *retries, unsigned int *timeoutMs);
+static void         latencyTune         (CtrlXfr_t *cx);
+static void         latencyExport       (LatencyEntry_t const *e,
+                                         usb_ctrl_latency_t *out);
+
+
+/**
+ * Submit a control request, returning as soon as the SET_REPORT is queued.
+ * When expectReply is set, a GET_REPORT follows the SET_REPORT completion and
+ * is repeated on each all-zero reply.  Polling continues while fewer than
+ * ctrlRetry replies have been seen, or while the legacy worst case of
+ * (ctrlRetry * ctrlDelay) ms has not yet elapsed.
+ * done() is called from libusb event handling, once, with the result.
+ */
+int usb_devControlRequestAsync(usb_device_t *dev,
+                               uint8_t *request, uint16_t reqLen,
+                               bool expectReply,
+                               usb_ctrl_done_t done, void *user)
+{
+    CtrlXfr_t  *cx;
+    int         res;
+
+    zul_log_hex(4, "  CTRL req : ", request, (int)reqLen);
+
+    if ((dev == NULL) || (dev->handle == NULL))
+    {
+        zul_logf (0, "%s - no device", __FUNCTION__);
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+
+    if (request == NULL)
+    {
+        return -20;
+    }
+
+    if ((reqLen == 0) || (reqLen > BUF_LEN))
+    {
+        return -21;
+    }
+
+    cx = ctrlAlloc(dev, request, reqLen, done, user);
+    if (cx == NULL)
+    {
+        return LIBUSB_ERROR_NO_MEM;
+    }
+    cx->expectReply = expectReply;
+
+    zul_log_hex(4, "  CTRL req (padded) : ", cx->request, USB_PACKET_LEN);
+
+    cx->startUs = zul_monotonicUs();
+    res = ctrlSubmit(cx);
+    if (res < 0)
+    {
+        usb_logCtrlError("TX", res);
+        zul_log_hex (3, "TXReq:", request, 8 );
+        ctrlRelease(cx);
+    }
+    return res;
+}
+
+/**
+ * Send a request of reqLen bytes to the device and wait for it to complete.
+ * If reply is not NULL, a reply is expected and copied there (64 bytes).
+ * Returns the number of bytes transferred, or a negative error code.
+ * LIBUSB_ERROR_TIMEOUT is returned if only empty replies were received.
+ */
+int usb_devControlRequest(usb_device_t *dev, uint8_t *request, uint16_t reqLen,
+                                                /*@null@*/ uint8_t *reply)
+{
+    CtrlSync_t  sync;
+    int         res;
+
+    res = ctrlSyncRequest(dev, request, reqLen, (reply != NULL), &sync);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    if (reply != NULL)
+    {
+        if (!sync.replied)
+        {
+            return (sync.result < 0) ? sync.result : LIBUSB_ERROR_TIMEOUT;
+        }
+        memcpy(reply, sync.reply, BUF_LEN);
+    }
+
+    return sync.result;
+}
+
+/**
+ * Submit a control request to the single-device API device
+ */
+int usb_ControlRequestAsync(uint8_t *request, uint16_t reqLen, bool expectReply,
+                                            usb_ctrl_done_t done, void *user)
+{
+    return usb_devControlRequestAsync(msv_dev, request, reqLen, expectReply,
+                                                                done, user);
+}
+
+/**
+ * The request of reqLen bytes is sent to the Zytronic USB device, and if
+ * the handle_reply pointer-to-function is not null, the supplied function is
+ * called to handle the response.
+ * This is a synchronous wrapper over usb_ControlRequestAsync().
+ */
+int usb_ControlRequest(uint8_t *request, uint16_t reqLen,
+                                            response_handler_t handle_reply)
+{
+    CtrlSync_t  sync;
+    int         res;
+
+    res = ctrlSyncRequest(msv_dev, request, reqLen, (handle_reply != NULL),
+                                                                    &sync);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    if (sync.replied && (handle_reply != NULL))
+    {
+        (void)handle_reply(sync.reply);
+    }
+
+    return sync.result;
+}
+
+/*
+ * The request of reqLen bytes is sent to the Zytronic USB device, and
+ * multiple replies are expected!  [see ZXY100 get single raw data]
+ *
+ * This is not used, typically!
+ *
+ * If the handle_reply pointer-to-function is not null, the supplied function is
+ * called to handle the response.
+ */
+int usb_ControlRequestMR(uint8_t *request, uint16_t reqLen,
+                                response_handler_t handle_reply, int replies)
+{
+    // general result var
+    int res = -1;
+
+    if (replies < 1) return -1;
+
+    if (msv_dev == NULL) return LIBUSB_ERROR_NO_DEVICE;
+
+    res = usb_ControlRequest(request, reqLen, handle_reply);
+
+    if (replies == 1) return res;
+
+    while (--replies>0)
+    {
+        uint8_t reply[BUF_LEN];
+
+        zul_logf(4, "Multi-Reply expected [%d]", replies);
+
+        res = usb_devControlReply(msv_dev, reply);
+        if (res < 0)
+        {
+            // no point in continuing
+            break;
+        }
+
+        if (handle_reply != NULL)
+        {
+            (void)handle_reply(reply);
+        }
+    }
+
+    return res;
+}
+
+/**
+ * Run only the GET_REPORT phase of a control request, fetching a further
+ * reply to the last request sent.  [see ZXY100 get single raw data]
+ * Returns the number of bytes received (64 copied to reply), or a negative
+ * error code.
+ */
+int usb_devControlReply(usb_device_t *dev, uint8_t *reply)
+{
+    uint8_t     none[BUF_LEN];
+    CtrlSync_t  sync;
+    CtrlXfr_t  *cx;
+    int         res;
+
+    if (dev == NULL) return LIBUSB_ERROR_NO_DEVICE;
+    if (reply == NULL) return LIBUSB_ERROR_INVALID_PARAM;
+
+    // no further request is sent
+    memset(none, 0, sizeof(none));
+    cx = ctrlAlloc(dev, none, BUF_LEN, ctrlSyncDone, &sync);
+    if (cx == NULL)
+    {
+        return LIBUSB_ERROR_NO_MEM;
+    }
+    memset(&sync, 0, sizeof(sync));
+    cx->wIndex          = 0x0000;       // as the firmware has always seen it
+    cx->expectReply     = true;
+    cx->rxPhase         = true;
+    cx->rxRetryLimit    = 2;
+    cx->rxDeadline      = zul_monotonicMs() + 2 * dev->ctrlDelay;
+
+    zul_log(4, "  CTRL M-RX attempt...");
+    res = ctrlSubmit(cx);
+    if (res < 0)
+    {
+        zul_logf(1, "CTRL-RX unknown error %d", res);
+        ctrlRelease(cx);
+        return res;
+    }
+
+    ctrlSyncAwait(&sync);
+    if (!sync.replied)
+    {
+        return (sync.result < 0) ? sync.result : LIBUSB_ERROR_TIMEOUT;
+    }
+
+    zul_log_hex(4, "    CTRL resp: ", sync.reply, sync.result);
+    memcpy(reply, sync.reply, BUF_LEN);
+    return sync.result;
+}
+
+// ----------------------------------------------------------------------------
+// --- Asynchronous Control Transfer Engine ---
+// ----------------------------------------------------------------------------
+
+/**
+ * Map the status of a completed transfer onto the libusb error codes
+ * returned by the synchronous API.  Non-negative values are byte counts.
+ */
+static int usb_xfrStatusToError(struct libusb_transfer *transfer)
+{
+    switch (transfer->status)
+    {
+        case LIBUSB_TRANSFER_COMPLETED:     return transfer->actual_length;
+        case LIBUSB_TRANSFER_TIMED_OUT:     return LIBUSB_ERROR_TIMEOUT;
+        case LIBUSB_TRANSFER_STALL:         return LIBUSB_ERROR_PIPE;
+        case LIBUSB_TRANSFER_NO_DEVICE:     return LIBUSB_ERROR_NO_DEVICE;
+        case LIBUSB_TRANSFER_CANCELLED:     return LIBUSB_ERROR_INTERRUPTED;
+        case LIBUSB_TRANSFER_OVERFLOW:      return LIBUSB_ERROR_OVERFLOW;
+        case LIBUSB_TRANSFER_ERROR:
+        default:                            return LIBUSB_ERROR_IO;
+    }
+}
+
+static void usb_logCtrlError(const char *dir, int res)
+{
+    switch (res)
+    {
+    case LIBUSB_ERROR_TIMEOUT:
+        zul_logf(2, "\n\nControl %s timeout", dir);
+        break;
+    case LIBUSB_ERROR_PIPE:
+        zul_logf(1, "Control %s pipe error", dir);
+        break;
+    case LIBUSB_ERROR_NO_DEVICE:
+        zul_logf(1, "Control %s No Device", dir);
+        break;
+    case LIBUSB_ERROR_BUSY:
+        zul_logf(1, "Control %s Busy", dir);
+        break;
+    case LIBUSB_ERROR_INVALID_PARAM:
+        zul_logf(1, "Control %s Invalid parameter", dir);
+        break;
+    default:
+        zul_logf(1, "Control %s unknown error %d", dir, res);
+    }
+}
+
+/**
+ * Allocate and pre-fill the state for one control request.
+ * The request is copied into a zero padded, 64 byte packet.
+ */
+static CtrlXfr_t * ctrlAlloc(usb_device_t *dev, uint8_t *request,
+                    uint16_t reqLen, usb_ctrl_done_t done, void *user)
+{
+    CtrlXfr_t *cx = (CtrlXfr_t *)calloc(1, sizeof(CtrlXfr_t));
+    if (cx == NULL)
+    {
+        return NULL;
+    }
+
+    cx->xfr = libusb_alloc_transfer(0);
+    if (cx->xfr == NULL)
+    {
+        free(cx);
+        return NULL;
+    }
+
+    // always send 64 byte usb packets, the rest of the packet is zero
+    memcpy(cx->request, request, reqLen);
+
+    // bootloader or application comms; 03 = ReportType, 05 = ReportID
+    cx->dev             = dev;
+    cx->wValue          = (uint16_t)((dev->bootloader) ? 0x0300 : 0x0305);
+    cx->wIndex          = dev->activeInterface; // see USB Complete Ed.3 P331.
+    cx->rxRetryLimit    = dev->ctrlRetry;
+    cx->rxBudgetMs      = (long int)dev->ctrlRetry * dev->ctrlDelay;
+    cx->xfrTimeout      = dev->ctrlTimeout;
+    cx->done            = done;
+    cx->user            = user;
+
+    // bootloader commands lead with the message code, application messages
+    // are framed: ZCC, STX, length, MasterRequest, message code ...
+    cx->msgCode         = (dev->bootloader) ? cx->request[0] : cx->request[4];
+    latencyTune(cx);
+
+    __atomic_add_fetch(&dev->ctrlInFlight, 1, __ATOMIC_ACQ_REL);
+    return cx;
+}
+
+/**
+ * Submit the transfer for the current phase of the request.
+ * ctrlTimeout: BL Program DataBlock takes > 2500 mS
+ */
+static int ctrlSubmit(CtrlXfr_t *cx)
+{
+    uint8_t *data = cx->buffer + LIBUSB_CONTROL_SETUP_SIZE;
+
+    if (cx->rxPhase)
+    {
+        libusb_fill_control_setup(cx->buffer, HID_GET_REPORT_REQ_TYPE,
+                            HID_GET_REPORT, cx->wValue, cx->wIndex, BUF_LEN);
+        memset(data, 0, BUF_LEN);
+    }
+    else
+    {
+        libusb_fill_control_setup(cx->buffer, HID_SET_REPORT_REQ_TYPE,
+                            HID_SET_REPORT, cx->wValue, cx->wIndex, BUF_LEN);
+        memcpy(data, cx->request, BUF_LEN);
+    }
+
+    libusb_fill_control_transfer(cx->xfr, cx->dev->handle, cx->buffer,
+                                ctrlXfrCallback, cx, cx->xfrTimeout);
+
+    return libusb_submit_transfer(cx->xfr);
+}
+
+/**
+ * Free a request, and the device's count of requests in flight
+ */
+static void ctrlRelease(CtrlXfr_t *cx)
+{
+    __atomic_sub_fetch(&cx->dev->ctrlInFlight, 1, __ATOMIC_ACQ_REL);
+    libusb_free_transfer(cx->xfr);
+    free(cx);
+}
+
+/**
+ * Report the outcome of a request to its owner and release it
+ */
+static void ctrlComplete(CtrlXfr_t *cx, int res, uint8_t *reply)
+{
+    if (cx->done != NULL)
+    {
+        cx->done(res, reply, cx->user);
+    }
+    ctrlRelease(cx);
+}
+
+/**
+ * Drive a control request through its phases.  Called by libusb, from
+ * whichever thread is currently handling events.
+ */
+static void ctrlXfrCallback(struct libusb_transfer *transfer)
+{
+    CtrlXfr_t  *cx      = (CtrlXfr_t *)transfer->user_data;
+    uint8_t    *data    = libusb_control_transfer_get_data(transfer);
+    int         res     = usb_xfrStatusToError(transfer);
+    bool        retry   = true;
+
+    if (!cx->rxPhase)
+    {
+        if (res < 0)
+        {
+            usb_logCtrlError("TX", res);
+            zul_log_hex (3, "TXReq:", cx->request, 8 );
+            ctrlComplete(cx, res, NULL);    // can't trust any received message
+            return;
+        }
+
+        // when no reply expected, return result
+        if (!cx->expectReply)
+        {
+            ctrlComplete(cx, res, NULL);
+            return;
+        }
+
+        zul_log(5, "Reply expected");
+        cx->rxPhase     = true;
+        cx->rxDeadline  = zul_monotonicMs() + cx->rxBudgetMs;
+    }
+    else
+    {
+        cx->rxAttempts++;
+
+        if (res > 0)
+        {
+            zul_log_ts (4, "REPLIED");
+            zul_logf   (4, "       attempt %d/%d",
+                                        cx->rxAttempts, cx->rxRetryLimit);
+            zul_log_hex(4, "  CTRL resp: ", data, res);
+            if (nonZeroData(data, res))
+            {
+                if (cx->startUs != 0)
+                {
+                    latencyRecord(cx->dev->pid, cx->msgCode,
+                                (long int)(zul_monotonicUs() - cx->startUs));
+                }
+                ctrlComplete(cx, res, data);
+                return;
+            }
+        }
+
+        if (res < 0)
+        {
+            usb_logCtrlError("RX", res);
+            zul_log_hex (2, "TXReq:", cx->request, 8 );
+            switch (res)
+            {
+                case LIBUSB_ERROR_TIMEOUT:
+                case LIBUSB_ERROR_BUSY:
+                case LIBUSB_ERROR_INVALID_PARAM:
+                    break;
+                default:
+                    retry = false;      // no point in continuing
+            }
+        }
+
+        if ( (cx->rxAttempts >= cx->rxRetryLimit) &&
+             (zul_monotonicMs() >= cx->rxDeadline) )
+        {
+            retry = false;
+        }
+
+        if (!retry)
+        {
+            zul_logf(1, "\n\nControl RX retries failed\n");
+            if ( (cx->startUs != 0) &&
+                 ((res >= 0) || (res == LIBUSB_ERROR_TIMEOUT)) )
+            {
+                latencyTimeout(cx->dev->pid, cx->msgCode);
+            }
+            ctrlComplete(cx, res, NULL);
+            return;
+        }
+    }
+
+    res = ctrlSubmit(cx);
+    if (res < 0)
+    {
+        usb_logCtrlError("RX", res);
+        ctrlComplete(cx, res, NULL);
+    }
+}
+
+/**
+ * Submit a request and wait for its completion record to be filled in.
+ * Returns a negative code if the request could not be submitted.
+ */
+static int ctrlSyncRequest(usb_device_t *dev, uint8_t *request, uint16_t reqLen,
+                                        bool expectReply, CtrlSync_t *sync)
+{
+    int res;
+
+    memset(sync, 0, sizeof(CtrlSync_t));
+
+    res = usb_devControlRequestAsync(dev, request, reqLen, expectReply,
+                                                        ctrlSyncDone, sync);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    ctrlSyncAwait(sync);
+    return 0;
+}
+
+static void ctrlSyncDone(int result, uint8_t *reply, void *user)
+{
+    CtrlSync_t *sync = (CtrlSync_t *)user;
+
+    sync->result = result;
+    if (reply != NULL)
+    {
+        memcpy(sync->reply, reply, BUF_LEN);
+        sync->replied = true;
+    }
+    sync->completed = 1;
+}
+
+/**
+ * Run libusb event handling until the request completes.  If the interrupt
+ * worker thread is already handling events, libusb lets this thread sleep
+ * until an event completes, and then re-checks the completed flag.
+ */
+static void ctrlSyncAwait(CtrlSync_t *sync)
+{
+    while (!sync->completed)
+    {
+        struct timeval  tv = { 0, 100000 };
+        int             retVal;
+
+        retVal = libusb_handle_events_timeout_completed(msv_libusb_ctx, &tv,
+                                                        &sync->completed);
+        if ((retVal != 0) && (retVal != LIBUSB_ERROR_INTERRUPTED))
+        {
+            zul_logf (0, "ERROR @ %s %d %s", __FUNCTION__, __LINE__,
+                                                libusb_error_name(retVal) );
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// --- Control Latency Tuning ---
+//     Each (PID, message code) keeps an EWMA of its turnaround and a log2
+//     histogram, from which a high percentile is read.  Once enough replies
+//     are seen, requests of that code poll for their reply for a few times
+//     the 99th percentile, rather than for the (delay * retries) worst case
+//     set for the slowest controllers.  A reply timeout widens the learned
+//     values, rather than discarding them; only when timeouts persist at the
+//     widest are they discarded (at most once per LATENCY_RELEARN_MIN_MS), so
+//     the configured parameters apply until they are re-learned.
+// ----------------------------------------------------------------------------
+
+/**
+ * Find the entry for pid & msgCode, optionally adding it.  Call with
+ * msv_latencyMutex held.  Returns NULL if absent, or the table is full.
+ */
+static LatencyEntry_t * latencyFind(int16_t pid, uint8_t msgCode, bool add)
+{
+    int i;
+
+    for (i = 0; i < LATENCY_TABLE_LEN; i++)
+    {
+        LatencyEntry_t *e = &msv_latencyTable[i];
+        if (e->used && (e->pid == pid) && (e->msgCode == msgCode))
+        {
+            return e;
+        }
+    }
+
+    if (!add) return NULL;
+
+    for (i = 0; i < LATENCY_TABLE_LEN; i++)
+    {
+        LatencyEntry_t *e = &msv_latencyTable[i];
+        if (!e->used)
+        {
+            memset(e, 0, sizeof(LatencyEntry_t));
+            e->used     = true;
+            e->pid      = pid;
+            e->msgCode  = msgCode;
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Add a turnaround measurement, in microseconds
+ */
+static void latencyRecord(int16_t pid, uint8_t msgCode, long int us)
+{
+    LatencyEntry_t *e;
+    uint32_t        sample  = (us < 1) ? 1U : (uint32_t)us;
+    int             bucket  = 0;
+
+    while ((bucket < LATENCY_BUCKETS - 1) && ((sample >> (bucket + 1)) != 0))
+    {
+        bucket++;
+    }
+
+    pthread_mutex_lock(&msv_latencyMutex);
+    e = latencyFind(pid, msgCode, true);
+    if (e != NULL)
+    {
+        // alpha = 1/8, as the TCP round trip estimator
+        if (e->samples == 0)
+        {
+            e->ewmaUs = sample;
+        }
+        else
+        {
+            e->ewmaUs = (uint32_t)((int64_t)e->ewmaUs +
+                            ((int64_t)sample - (int64_t)e->ewmaUs) / 8);
+        }
+        if (sample > e->maxUs) e->maxUs = sample;
+
+        e->histogram[bucket]++;
+        e->samples++;
+
+        // the device answers in time again; narrow a widened estimate
+        if ((e->widen > 0) && (++e->sinceTimeout >= LATENCY_MIN_SAMPLES))
+        {
+            e->widen--;
+            e->sinceTimeout = 0;
+        }
+
+        if (e->samples == LATENCY_MIN_SAMPLES)
+        {
+            zul_logf(3, "%s PID:%04x code:%02x learned - %u us, P99 %u us",
+                            __FUNCTION__, (unsigned)pid, msgCode, e->ewmaUs,
+                            latencyPercentile(e, 99));
+        }
+
+        // older measurements fade, so a change of behaviour is tracked
+        if (e->samples >= LATENCY_DECAY_SAMPLES)
+        {
+            int i;
+            e->samples = 0;
+            for (i = 0; i < LATENCY_BUCKETS; i++)
+            {
+                e->histogram[i] /= 2;
+                e->samples += e->histogram[i];
+            }
+        }
+    }
+    pthread_mutex_unlock(&msv_latencyMutex);
+}
+
+/**
+ * A request went unanswered - widen the learned turnaround of its code, or
+ * if already at the widest, forget it (unless it was forgotten just now)
+ */
+static void latencyTimeout(int16_t pid, uint8_t msgCode)
+{
+    LatencyEntry_t *e;
+    uint64_t        now = zul_monotonicMs();
+
+    pthread_mutex_lock(&msv_latencyMutex);
+    e = latencyFind(pid, msgCode, true);
+    if (e != NULL)
+    {
+        e->timeouts++;
+        e->sinceTimeout = 0;
+        if (e->widen < LATENCY_MAX_WIDEN)
+        {
+            e->widen++;
+        }
+        else if ( (e->relearns == 0) ||
+                  (now - e->relearnMs >= LATENCY_RELEARN_MIN_MS) )
+        {
+            zul_logf(3, "%s PID:%04x code:%02x - relearning", __FUNCTION__,
+                                                    (unsigned)pid, msgCode);
+            e->relearns++;
+            e->relearnMs    = now;
+            e->widen        = 0;
+            e->samples      = 0;
+            memset(e->histogram, 0, sizeof(e->histogram));
+        }
+    }
+    pthread_mutex_unlock(&msv_latencyMutex);
+}
+
+/**
+ * The upper bound, in us, of the histogram bucket holding the percentile.
+ * The estimate is high by up to a factor of two, which errs on the safe side.
+ */
+static uint32_t latencyPercentile(LatencyEntry_t const *e, int percent)
+{
+    uint64_t    target;
+    uint64_t    count   = 0;
+    int         i;
+
+    if (e->samples == 0) return 0;
+
+    target = ((uint64_t)e->samples * (uint64_t)percent + 99U) / 100U;
+    for (i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        count += e->histogram[i];
+        if (count >= target) break;
+    }
+    if (i >= LATENCY_BUCKETS) i = LATENCY_BUCKETS - 1;
+
+    return (uint32_t)(2UL << i);
+}
+
+/**
+ * The request parameters derived from a learned entry
+ */
+static void latencyParams(LatencyEntry_t const *e, long int *budgetMs,
+                                        int *retries, unsigned int *timeoutMs)
+{
+    long int    budget  = ((long int)latencyPercentile(e, 99) * 3 + 999) / 1000;
+    long int    timeout;
+
+    if (budget < LATENCY_MIN_BUDGET_MS) budget = LATENCY_MIN_BUDGET_MS;
+    budget <<= e->widen;
+    if (budget > LATENCY_MAX_MS)        budget = LATENCY_MAX_MS;
+
+    timeout = 2 * budget;
+    if (timeout < LATENCY_MIN_TIMEOUT_MS) timeout = LATENCY_MIN_TIMEOUT_MS;
+    if (timeout > LATENCY_MAX_MS)         timeout = LATENCY_MAX_MS;
+
+    *budgetMs   = budget;
+    *retries    = LATENCY_MIN_RETRY;
+    *timeoutMs  = (unsigned int)timeout;
+}
+
+/**
+ * Apply the learned parameters of the request's message code, if any.  While
+ * a device runs with the default parameters the learned ones replace them;
+ * parameters set explicitly (see zul_setCommsEndurance) remain a minimum.
+ */
+static void latencyTune(CtrlXfr_t *cx)
+{
+    usb_device_t   *dev         = cx->dev;
+    LatencyEntry_t *e;
+    long int        budgetMs    = 0;
+    int             retries     = 0;
+    unsigned int    timeoutMs   = 0;
+    bool            learned     = false;
+
+    if (!msv_latencyAdaptive) return;
+
+    pthread_mutex_lock(&msv_latencyMutex);
+    e = latencyFind(dev->pid, cx->msgCode, false);
+    if ((e != NULL) && (e->samples >= LATENCY_MIN_SAMPLES))
+    {
+        latencyParams(e, &budgetMs, &retries, &timeoutMs);
+        learned = true;
+    }
+    pthread_mutex_unlock(&msv_latencyMutex);
+
+    if (!learned) return;
+
+    if ( (dev->ctrlDelay   == DEF_CTRL_DELAY) &&
+         (dev->ctrlRetry   == DEF_CTRL_RETRY) &&
+         (dev->ctrlTimeout == DEF_CTRL_TIMEOUT) )
+    {
+        cx->rxBudgetMs      = budgetMs;
+        cx->rxRetryLimit    = retries;
+        cx->xfrTimeout      = timeoutMs;
+    }
+    else
+    {
+        if (budgetMs  > cx->rxBudgetMs)     cx->rxBudgetMs   = budgetMs;
+        if (retries   > cx->rxRetryLimit)   cx->rxRetryLimit = retries;
+        if (timeoutMs > cx->xfrTimeout)     cx->xfrTimeout   = timeoutMs;
+    }
+}
+
+/**
+ * Enable (default) or disable the use of learned control parameters
+ */
+void usb_setCtrlAdaptive(bool enable)
+{
+    msv_latencyAdaptive = enable;
+    zul_logf (4, "%s %d", __FUNCTION__, (int)enable );
+}
+
+/**
+ * Discard all turnaround measurements
+ */
+void usb_resetCtrlLatency(void)
+{
+    pthread_mutex_lock(&msv_latencyMutex);
+    memset(msv_latencyTable, 0, sizeof(msv_latencyTable));
+    pthread_mutex_unlock(&msv_latencyMutex);
+}
+
+static void latencyExport(LatencyEntry_t const *e, usb_ctrl_latency_t *out)
+{
+    memset(out, 0, sizeof(usb_ctrl_latency_t));
+    out->pid        = e->pid;
+    out->msgCode    = e->msgCode;
+    out->samples    = e->samples;
+    out->timeouts   = e->timeouts;
+    out->relearns   = e->relearns;
+    out->ewmaUs     = e->ewmaUs;
+    out->p99Us      = latencyPercentile(e, 99);
+    out->maxUs      = e->maxUs;
+    out->learned    = (e->samples >= LATENCY_MIN_SAMPLES);
+
+    if (out->learned)
+    {
+        long int        budgetMs;
+        int             retries;
+        unsigned int    timeoutMs;
+
+        latencyParams(e, &budgetMs, &retries, &timeoutMs);
+        out->pollDelayMs    = (int)((budgetMs + retries - 1) / retries);
+        out->retries        = retries;
+        out->timeoutMs      = (int)timeoutMs;
+    }
+}
+
+/**
+ * Copy the measurements of one message code of a product
+ */
+bool usb_getCtrlLatency(int16_t pid, uint8_t msgCode, usb_ctrl_latency_t *stats)
+{
+    LatencyEntry_t *e;
+
+    if (stats == NULL) return false;
+
+    pthread_mutex_lock(&msv_latencyMutex);
+    e = latencyFind(pid, msgCode, false);
+    if (e != NULL)
+    {
+        latencyExport(e, stats);
+    }
+    pthread_mutex_unlock(&msv_latencyMutex);
+
+    return (e != NULL);
+}
+
+/**
+ * Copy up to maxEntries measurement records, returning the number copied
+ */
+int usb_getCtrlLatencyTable(usb_ctrl_latency_t *table, int maxEntries)
+{
+    int i, count = 0;
+
+    if (table == NULL) return 0;
+
+    pthread_mutex_lock(&msv_latencyMutex);
+    for (i = 0; (i < LATENCY_TABLE_LEN) && (count < maxEntries); i++)
+    {
+        if (msv_latencyTable[i].used)
+        {
+            latencyExport(&msv_latencyTable[i], &table[count++]);
+        }
+    }
+    pthread_mutex_unlock(&msv_latencyMutex);
+
+    return count;
+}
+
+// ----------------------------------------------------------------------------
+// --- Event Loop ---
+//     libusb's file descriptors are watched by one epoll set, along with an
+//     eventfd used to wake the event thread for shutdown.  The thread sleeps
+//     in epoll_wait() until there is USB activity (or a libusb timeout is
+//     due), instead of spinning on libusb_handle_events().
+// ----------------------------------------------------------------------------
+
+/**
+ * Map poll() event flags, as reported by libusb, to epoll flags
+ */
+static uint32_t usb_pollToEpoll(short events)
+{
+    uint32_t    ev = 0;
+
+    if (events & POLLIN)  ev |= EPOLLIN;
+    if (events & POLLOUT) ev |= EPOLLOUT;
+    return ev;
+}
+
+/**
+ * libusb notifier - a file descriptor is to be watched
+ */
+static void usb_pollfdAdded(int fd, short events, void *user_data)
+{
+    struct epoll_event  ev;
+
+    (void)user_data;
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = usb_pollToEpoll(events);
+    ev.data.fd  = fd;
+
+    if (epoll_ctl(msv_epollFd, EPOLL_CTL_ADD, fd, &ev) != 0)
+    {
+        if ((errno != EEXIST) ||
+            (epoll_ctl(msv_epollFd, EPOLL_CTL_MOD, fd, &ev) != 0))
+        {
+            zul_logf(0, "ERROR @ %s %d %s", __FUNCTION__, __LINE__, strerror(errno));
+        }
+    }
+}
+
+/**
+ * libusb notifier - a file descriptor is no longer used
+ */
+static void usb_pollfdRemoved(int fd, void *user_data)
+{
+    (void)user_data;
+    (void)epoll_ctl(msv_epollFd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+/**
+ * Create the epoll set and shutdown eventfd, and register for changes to
+ * libusb's file descriptors.  Return zero on success.
+ */
+static int usb_initEventLoop(void)
+{
+    const struct libusb_pollfd **pollfds;
+    struct epoll_event  ev;
+    int                 i;
+
+    if (msv_epollFd >= 0) return 0;
+
+    msv_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    msv_wakeFd  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((msv_epollFd < 0) || (msv_wakeFd < 0))
+    {
+        zul_logf(0, "ERROR @ %s %d %s", __FUNCTION__, __LINE__, strerror(errno));
+        usb_endEventLoop();
+        return -1;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = EPOLLIN;
+    ev.data.fd  = msv_wakeFd;
+    (void)epoll_ctl(msv_epollFd, EPOLL_CTL_ADD, msv_wakeFd, &ev);
+
+    libusb_set_pollfd_notifiers(msv_libusb_ctx,
+                                usb_pollfdAdded, usb_pollfdRemoved, NULL);
+
+    pollfds = libusb_get_pollfds(msv_libusb_ctx);
+    if (pollfds != NULL)
+    {
+        for (i = 0; pollfds[i] != NULL; i++)
+        {
+            usb_pollfdAdded(pollfds[i]->fd, pollfds[i]->events, NULL);
+        }
+        libusb_free_pollfds(pollfds);
+    }
+
+    if (libusb_pollfds_handle_timeouts(msv_libusb_ctx) == 0)
+    {
+        zul_log(3, "libusb timeouts require libusb_get_next_timeout()");
+    }
+    return 0;
+}
+
+/**
+ * Stop the event thread and release the epoll set
+ */
+static void usb_endEventLoop(void)
+{
+    usb_stopEventThread();
+
+    if (msv_libusb_ctx != NULL)
+    {
+        libusb_set_pollfd_notifiers(msv_libusb_ctx, NULL, NULL, NULL);
+    }
+    if (msv_wakeFd >= 0)  (void)close(msv_wakeFd);
+    if (msv_epollFd >= 0) (void)close(msv_epollFd);
+    msv_wakeFd  = -1;
+    msv_epollFd = -1;
+}
+
+/**
+ * Start the event thread, unless the host application drives the events
+ */
+static void usb_startEventThread(void)
+{
+    (void)pthread_mutex_lock(&msv_devListMutex);
+    if (!msv_externalEvents && !msv_eventThreadRunning && (msv_epollFd >= 0))
+    {
+        msv_stopEvents = false;
+        errno = pthread_create(&msv_eventThread, NULL, usb_eventWorker, NULL);
+        if (errno)
+        {
+            zul_logf(1, "ERROR: from pthread_create() is %s\n", strerror(errno));
+            perror("Create USB Event Thread");
+            exit(-1);
+        }
+        msv_eventThreadRunning = true;
+        zul_log_ts ( 3, "usb_eventWorker is running");
+    }
+    (void)pthread_mutex_unlock(&msv_devListMutex);
+}
+
+/**
+ * Wake and join the event thread
+ */
+static void usb_stopEventThread(void)
+{
+    uint64_t    one = 1;
+
+    if (!msv_eventThreadRunning) return;
+
+    msv_stopEvents = true;
+    if (write(msv_wakeFd, &one, sizeof(one)) != sizeof(one))
+    {
+        zul_logf(0, "ERROR @ %s %d %s", __FUNCTION__, __LINE__, strerror(errno));
+    }
+    (void)pthread_join(msv_eventThread, NULL);
+    msv_eventThreadRunning = false;
+}
+
+/**
+ * Handle USB events for all open devices, sleeping until there is activity
+ */
+static void *usb_eventWorker(void *arg)
+{
+    struct epoll_event  ev[8];
+    int                 n;
+
+    (void)arg;
+    while (!msv_stopEvents)
+    {
+        n = epoll_wait(msv_epollFd, ev, 8, usb_getEventTimeout());
+        if ((n < 0) && (errno != EINTR))
+        {
+            zul_logf (0, "ERROR @ %s %d %s", __FUNCTION__, __LINE__, strerror(errno));
+            break;
+        }
+        if (msv_stopEvents) break;
+
+        (void)usb_handleEvents();
+    }
+    zul_log(3, "USB Event Worker - Terminating");
+
+    pthread_exit(NULL);
+}
+
+/**
+ * Provide a file descriptor that becomes readable when USB events need to be
+ * handled by usb_handleEvents(). Return -1 if the library is not open.
+ */
+int usb_getEventFd(void)
+{
+    return msv_epollFd;
+}
+
+/**
+ * Provide the longest time, in ms, to wait on usb_getEventFd() before
+ * calling usb_handleEvents(); -1 if there is no libusb timeout pending.
+ */
+int usb_getEventTimeout(void)
+{
+    struct timeval  tv;
+
+    if (msv_libusb_ctx == NULL) return -1;
+    if (libusb_pollfds_handle_timeouts(msv_libusb_ctx) != 0) return -1;
+
+    if (libusb_get_next_timeout(msv_libusb_ctx, &tv) == 1)
+    {
+        // round up, so the timeout has expired when handled
+        return (int)(tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000);
+    }
+    return -1;
+}
+
+/**
+ * Handle any pending USB events, without blocking.  If another thread is
+ * handling events, wait briefly for it instead.
+ * Return zero on success, else a libusb error code.
+ */
+int usb_handleEvents(void)
+{
+    struct timeval  zero = { 0, 0 };
+    struct timeval  backoff = { 0, EVENT_BACKOFF_MS * 1000 };
+    uint64_t        count;
+    int             retVal = 0;
+
+    if (msv_libusb_ctx == NULL) return LIBUSB_ERROR_NO_DEVICE;
+
+    // clear any wake-up, the eventfd is non-blocking
+    if (msv_wakeFd >= 0)
+    {
+        (void)read(msv_wakeFd, &count, sizeof(count));
+    }
+
+    if (libusb_try_lock_events(msv_libusb_ctx) == 0)
+    {
+        if (libusb_event_handling_ok(msv_libusb_ctx))
+        {
+            retVal = libusb_handle_events_locked(msv_libusb_ctx, &zero);
+        }
+        libusb_unlock_events(msv_libusb_ctx);
+    }
+    else
+    {
+        // the other thread handles these events, so sleep until it is done
+        // (or a while has passed), rather than spin on the readable fds
+        libusb_lock_event_waiters(msv_libusb_ctx);
+        if (libusb_event_handler_active(msv_libusb_ctx))
+        {
+            (void)libusb_wait_for_event(msv_libusb_ctx, &backoff);
+        }
+        libusb_unlock_event_waiters(msv_libusb_ctx);
+    }
+
+    if ((retVal != 0) && (retVal != LIBUSB_ERROR_INTERRUPTED))
+    {
+        zul_logf (0, "ERROR @ %s %d %s", __FUNCTION__, __LINE__, libusb_error_name(retVal) );
+    }
+    return retVal;
+}
+
+/**
+ * Select whether the host application drives USB events from its own main
+ * loop (usb_getEventFd/usb_handleEvents), or the library runs an event thread.
+ */
+void usb_useExternalEventLoop(bool external)
+{
+    msv_externalEvents = external;
+
+    if (external)
+    {
+        usb_stopEventThread();
+    }
+    else if (msv_openDevices != NULL)
+    {
+        usb_startEventThread();
+    }
+}
+
+
+// ----------------------------------------------------------------------------
+// --- Enumeration Cache ---
+//     One snapshot of the libusb device list is held, with the descriptor
+//     details of each Zytronic device, so listing and opening devices need
+//     not re-read the bus.  The snapshot is replaced after a hotplug event or
+//     an explicit rescan; without hotplug support every use rescans.
+// ----------------------------------------------------------------------------
+
+/**
+ * Mark the snapshot out of date; it is replaced on next use
+ */
+static void usb_enumInvalidate(void)
+{
+    (void)pthread_mutex_lock(&msv_enumMutex);
+    msv_enumValid = false;
+    (void)pthread_mutex_unlock(&msv_enumMutex);
+}
+
+/**
+ * Release the snapshot.  Call with msv_enumMutex held.
+ */
+static void usb_enumRelease(void)
+{
+    if (msv_enumList != NULL)
+    {
+        libusb_free_device_list(msv_enumList, 1);   // unref the devices
+    }
+    msv_enumList        = NULL;
+    msv_enumListCount   = 0;
+    msv_enumCount       = 0;
+    msv_enumValid       = false;
+}
+
+/**
+ * Ensure the snapshot is current.
+ * Return the number of USB devices on the system, or a negative error code.
+ */
+static int usb_enumRefresh(void)
+{
+    struct timeval  zero = { 0, 0 };
+    ssize_t         cnt;
+    int             i;
+
+    if (msv_libusb_ctx == NULL) return -11;
+
+    if (msv_hotplugActive)
+    {
+        // deliver any hotplug events pending, which may invalidate
+        (void)libusb_handle_events_timeout_completed(msv_libusb_ctx, &zero, NULL);
+    }
+
+    (void)pthread_mutex_lock(&msv_enumMutex);
+    if (msv_enumValid && msv_hotplugActive)
+    {
+        cnt = msv_enumListCount;
+        (void)pthread_mutex_unlock(&msv_enumMutex);
+        return (int)cnt;
+    }
+
+    usb_enumRelease();
+
+    cnt = libusb_get_device_list(msv_libusb_ctx, &msv_enumList);
+    if (cnt < 0)
+    {
+        msv_enumList = NULL;
+        (void)pthread_mutex_unlock(&msv_enumMutex);
+        return (int)cnt;
+    }
+    msv_enumListCount = (int)cnt;
+
+    for (i = 0; (i < cnt) && (msv_enumCount < ENUM_TABLE_LEN); i++)
+    {
+        struct libusb_device_descriptor     desc;
+        struct libusb_config_descriptor    *cfg = NULL;
+        EnumEntry_t                        *entry;
+
+        // one descriptor read per device, per snapshot
+        if (libusb_get_device_descriptor(msv_enumList[i], &desc) != 0) continue;
+        if (desc.idVendor != ZYTRONIC_VENDOR_ID) continue;
+
+        entry = &msv_enumTable[msv_enumCount++];
+        entry->ldev     = msv_enumList[i];
+        entry->index    = i;
+        entry->bus      = libusb_get_bus_number(msv_enumList[i]);
+        entry->address  = libusb_get_device_address(msv_enumList[i]);
+        entry->vid      = desc.idVendor;
+        entry->pid      = (int16_t)desc.idProduct;
+        snprintf(entry->addr, 7, "%02X_%02X", (uint)entry->bus, (uint)entry->address);
+
+        entry->numInterfaces = 0;
+        if (libusb_get_active_config_descriptor(msv_enumList[i], &cfg) == 0)
+        {
+            entry->numInterfaces = cfg->bNumInterfaces;
+            libusb_free_config_descriptor(cfg);
+        }
+        entry->mgmtInterface = usb_getManagementIface(entry->pid);
+        if (entry->mgmtInterface >= entry->numInterfaces)
+        {
+            entry->mgmtInterface = 0;
+        }
+
+        zul_logf(4, " >> Cached %d. PID:%04X Addr=%s IFs:%d", i,
+                    (uint)(uint16_t)entry->pid, entry->addr, entry->numInterfaces);
+    }
+    msv_enumValid = true;
+    (void)pthread_mutex_unlock(&msv_enumMutex);
+
+    zul_logf(3, "%d Devices enumerated, %d Zytronic", (int)cnt, msv_enumCount);
+    return (int)cnt;
+}
+
+/**
+ * Copy the cached entry of a Zytronic device, by enumeration index (when
+ * index >= 0) or else by usb bus address string.  The copy holds a reference
+ * to the libusb device, which the caller must unref.
+ */
+static bool usb_enumLookup(int index, char const *addrStr, EnumEntry_t *out)
+{
+    unsigned int    bus = 0, address = 0;
+    bool            found = false;
+    int             i;
+
+    if ((index < 0) &&
+        ((addrStr == NULL) || (sscanf(addrStr, "%x_%x", &bus, &address) != 2)))
+    {
+        return false;
+    }
+
+    (void)pthread_mutex_lock(&msv_enumMutex);
+    for (i = 0; (i < msv_enumCount) && !found; i++)
+    {
+        EnumEntry_t *entry = &msv_enumTable[i];
+
+        if (index >= 0)
+        {
+            found = (entry->index == index);
+        }
+        else
+        {
+            found = (entry->bus == bus) && (entry->address == address);
+        }
+
+        if (found)
+        {
+            *out = *entry;
+            (void)libusb_ref_device(out->ldev);
+        }
+    }
+    (void)pthread_mutex_unlock(&msv_enumMutex);
+
+    return found;
+}
+
+/**
+ * Discard the enumeration cache and re-read the bus.
+ * Return the number of Zytronic devices, or a negative error code.
+ */
+int usb_rescanDevices(void)
+{
+    int retVal;
+
+    usb_enumInvalidate();
+    retVal = usb_enumRefresh();
+    if (retVal < 0) return retVal;
+
+    return msv_enumCount;
+}
+
+// ----------------------------------------------------------------------------
+// --- Hotplug Device Table ---
+//     A live table of the Zytronic devices attached, maintained from libusb
+//     hotplug events.  Waiters are woken as soon as a device arrives or
+//     leaves, rather than polling the enumeration.
+// ----------------------------------------------------------------------------
+
+/**
+ * Record a device arrival or departure, and wake any waiters
+ */
+static int usb_hotplugCallback(libusb_context *ctx, libusb_device *ldev,
+                                libusb_hotplug_event event, void *user_data)
+{
+    struct libusb_device_descriptor desc;
+    HotplugEntry_t     *entry = NULL;
+    char                addr[7];
+    int16_t             pid = 0;
+    int                 i;
+
+    (void)ctx; (void)user_data;
+
+    snprintf(addr, 7, "%02X_%02X", (uint)libusb_get_bus_number(ldev),
+                                   (uint)libusb_get_device_address(ldev));
+    if (libusb_get_device_descriptor(ldev, &desc) == 0)
+    {
+        pid = (int16_t)desc.idProduct;
+    }
+
+    (void)pthread_mutex_lock(&msv_hotplugMutex);
+    for (i = 0; i < HOTPLUG_TABLE_LEN; i++)
+    {
+        if (msv_hotplugTable[i].present &&
+                (0 == strcmp(msv_hotplugTable[i].addr, addr)))
+        {
+            entry = &msv_hotplugTable[i];
+            break;
+        }
+        if ((entry == NULL) && !msv_hotplugTable[i].present)
+        {
+            entry = &msv_hotplugTable[i];   // first free slot
+        }
+    }
+
+    if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED)
+    {
+        if (entry != NULL)
+        {
+            entry->present = true;
+            entry->pid     = pid;
+            memcpy(entry->addr, addr, 7);
+        }
+    }
+    else if ((entry != NULL) && entry->present &&
+                (0 == strcmp(entry->addr, addr)))
+    {
+        entry->present = false;
+    }
+    (void)pthread_cond_broadcast(&msv_hotplugCond);
+    (void)pthread_mutex_unlock(&msv_hotplugMutex);
+
+    usb_enumInvalidate();
+
+    zul_logf(3, "Hotplug: %s PID:%04x %s", addr, (uint)(uint16_t)pid,
+            (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED) ? "arrived" : "left");
+
+    return 0;   // stay registered
+}
+
+/**
+ * Register for hotplug events of Zytronic devices, if available.
+ * The table is filled with the devices already attached.
+ */
+static void usb_initHotplug(void)
+{
+    int     retVal;
+
+    if (msv_hotplugActive) return;
+
+    if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG))
+    {
+        zul_log(3, "libusb hotplug not supported, devices will be polled");
+        return;
+    }
+
+    (void)pthread_mutex_lock(&msv_hotplugMutex);
+    memset(msv_hotplugTable, 0, sizeof(msv_hotplugTable));
+    (void)pthread_mutex_unlock(&msv_hotplugMutex);
+
+    retVal = libusb_hotplug_register_callback(msv_libusb_ctx,
+                LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+                LIBUSB_HOTPLUG_ENUMERATE, ZYTRONIC_VENDOR_ID,
+                LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY,
+                usb_hotplugCallback, NULL, &msv_hotplugHandle);
+    if (retVal != 0)
+    {
+        zul_logf(0, "ERROR @ %s %d %s", __FUNCTION__, __LINE__, libusb_error_name(retVal) );
+        return;
+    }
+    msv_hotplugActive = true;
+}
+
+static void usb_endHotplug(void)
+{
+    if (!msv_hotplugActive) return;
+
+    libusb_hotplug_deregister_callback(msv_libusb_ctx, msv_hotplugHandle);
+    msv_hotplugActive = false;
+}
+
+/**
+ * Test whether a device matching pid (0 => any) is attached, or whether
+ * the device at addr is attached.  The matching address is copied to addrOut.
+ * Call with msv_hotplugMutex held.
+ */
+static bool usb_hotplugFind(int16_t pid, char const *addr, char *addrOut)
+{
+    int i;
+
+    for (i = 0; i < HOTPLUG_TABLE_LEN; i++)
+    {
+        HotplugEntry_t *entry = &msv_hotplugTable[i];
+
+        if (!entry->present) continue;
+        if ((addr != NULL) && (0 != strcmp(entry->addr, addr))) continue;
+        if ((addr == NULL) && (pid != 0) && (entry->pid != pid)) continue;
+
+        if (addrOut != NULL) memcpy(addrOut, entry->addr, 7);
+        return true;
     }
+    return false;
+}
 
-    if (reqLen == 0)
-    {
-        return -21;
-    }
+/**
+ * Without hotplug support, scan the device list for the same test.
+ * (the enumeration cache is re-read on each use without hotplug support)
+ */
+static bool usb_scanFind(int16_t pid, char const *addr, char *addrOut)
+{
+    bool    found = false;
+    int     i;
 
-    // always send 64 byte usb packets
-    uint8_t txBuffer[64];
-    // copy the usb message into a 64 byte buffer
-    memcpy(txBuffer, request, reqLen);
+    if (usb_enumRefresh() < 0) return false;
 
-    int i;
-    // make sure the rest of the packet is zero
-    for( i = reqLen; i < 64; i++)
+    (void)pthread_mutex_lock(&msv_enumMutex);
+    for (i = 0; (i < msv_enumCount) && !found; i++)
     {
-        txBuffer[i] = 0;
+        EnumEntry_t *entry = &msv_enumTable[i];
+
+        if ((addr != NULL) && (0 != strcmp(entry->addr, addr))) continue;
+        if ((addr == NULL) && (pid != 0) && (entry->pid != pid)) continue;
+
+        if (addrOut != NULL) memcpy(addrOut, entry->addr, 7);
+        found = true;
     }
+    (void)pthread_mutex_unlock(&msv_enumMutex);
 
-    zul_log_hex(4, "  CTRL req (padded) : ", txBuffer, USB_PACKET_LEN);
+    return found;
+}
 
+/**
+ * Wait until a matching device is attached (arrive) or detached (!arrive)
+ * Return 0 on success, -1 on timeout, or -11 if the library is not open.
+ */
+static int usb_hotplugAwait(int16_t pid, char const *addr, bool arrive,
+                                                int timeoutMs, char *addrOut)
+{
+    uint64_t    deadline;
+    bool        done = false;
 
-    res = libusb_control_transfer ( msv_dev_handle,  txRmReqType, txBReq,
-            wValue, wIndex,       (unsigned char*)txBuffer, USB_PACKET_LEN, msv_CtrlTimeout);
+    if (msv_libusb_ctx == NULL) return -11;
 
-    if (res < 0)
+    deadline = zul_monotonicMs() + timeoutMs;
+
+    if (!msv_hotplugActive)
     {
-        switch (res)
+        // poll the enumeration, as before hotplug support
+        while (!done)
         {
-        case LIBUSB_ERROR_TIMEOUT:
-            zul_log(2, "\n\nControl TX timeout");
-            break;
-        case LIBUSB_ERROR_PIPE:
-            zul_log(1, "Control TX pipe error");
-            break;
-        case LIBUSB_ERROR_NO_DEVICE:
-            zul_log(1, "Control TX No Device");
-            break;
-        case LIBUSB_ERROR_BUSY:
-            zul_log(1, "Control TX Busy");
-            break;
-        case LIBUSB_ERROR_INVALID_PARAM:
-            zul_log(1, "Control TX Invalid parameter");
-            break;
-        default:
-            zul_logf(1, "Control TX unknown error %d", res);
+            done = (arrive == usb_scanFind(pid, addr, addrOut));
+            if (done || (zul_monotonicMs() >= deadline)) break;
+            (void)usleep(250000);
         }
-        zul_log_hex (3, "TXReq:", request, 8 );
-        return res;     // can't trust any received message
-    }
-
-    // when no reply handler provided, return result
-    if (NULL == handle_reply)
-    {
-      return res;
+        return done ? 0 : -1;
     }
 
-    zul_log(5, "Reply expected");
-
-    bool validResp = false;
-    int rxTransferAttempts = msv_CtrlRetry;
+    usb_startEventThread();
 
-    while ((!validResp) && (rxTransferAttempts-- > 0))
+    (void)pthread_mutex_lock(&msv_hotplugMutex);
+    while (!done)
     {
-        (void)usleep(msv_CtrlDelay * 1000);
+        uint64_t    now = zul_monotonicMs();
+        long int    remaining;
 
-        res =  libusb_control_transfer ( msv_dev_handle,
-                                            rxRmReqType, rxBReq,
-                                            wValue, wIndex,
-                                            data, wLength, msv_CtrlTimeout );
+        done = (arrive == usb_hotplugFind(pid, addr, addrOut));
+        if (done || (now >= deadline)) break;
+        remaining = (long int)(deadline - now);
+        if (remaining > 50) remaining = 50;
 
-        if (res > 0)
+        if (msv_eventThreadRunning)
         {
-            zul_log_ts (4, "REPLIED");
-            zul_logf   (4, "       attempt %d/%d",
-                          msv_CtrlRetry-rxTransferAttempts, msv_CtrlRetry);
-            zul_log_hex(4, "  CTRL resp: ", data, res);
-            if (nonZeroData(data, res))
-            {
-                (void)handle_reply(data);
-                validResp = true;
-            }
+            // the event thread runs the callback, which signals
+            struct timespec ts;
+            (void)clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += remaining * 1000000L;
+            ts.tv_sec  += ts.tv_nsec / 1000000000L;
+            ts.tv_nsec %= 1000000000L;
+            (void)pthread_cond_timedwait(&msv_hotplugCond, &msv_hotplugMutex, &ts);
         }
-
-        if (res < 0)
+        else
         {
-            switch (res)
-            {
-            case LIBUSB_ERROR_TIMEOUT:
-                zul_logf(2, "\n\nControl RX timeout\n");
-                break;
-            case LIBUSB_ERROR_PIPE:
-                zul_logf(1, "Control RX pipe error");
-                rxTransferAttempts = 0;     // no point in continuing
-                break;
-            case LIBUSB_ERROR_NO_DEVICE:
-                zul_logf(1, "Control RX No Device");
-                rxTransferAttempts = 0;     // no point in continuing
-                break;
-            case LIBUSB_ERROR_BUSY:
-                zul_logf(1, "Control RX Busy");
-                break;
-            case LIBUSB_ERROR_INVALID_PARAM:
-                zul_logf(1, "Control RX Invalid parameter");
-                break;
-            default:
-                rxTransferAttempts = 0;     // no point in continuing
-                zul_logf(1, "Control RX unknown error %d", res);
-            }
-            zul_log_hex (2, "TXReq:", request, 8 );
+            // the host application drives events - handle them here meanwhile
+            struct timeval tv = { 0, remaining * 1000L };
+            (void)pthread_mutex_unlock(&msv_hotplugMutex);
+            (void)libusb_handle_events_timeout_completed(msv_libusb_ctx, &tv, NULL);
+            (void)pthread_mutex_lock(&msv_hotplugMutex);
         }
     }
-    if (rxTransferAttempts == 0)
-    {
-        zul_logf(1, "\n\nControl RX retries failed\n");
-    }
+    (void)pthread_mutex_unlock(&msv_hotplugMutex);
 
-    return res;
+    return done ? 0 : -1;
 }
 
-/*
- * The request of reqLen bytes is sent to the Zytronic USB device, and
- * multiple replies are expected!  [see ZXY100 get single raw data]
- *
- * This is not used, typically!
- *
- * If the handle_reply pointer-to-function is not null, the supplied function is
- * called to handle the response.
+/**
+ * Wait for a device of the given PID (0 => any Zytronic device) to attach.
+ * addrStr, if not NULL, receives its usb bus address string (7 chars).
+ * Return 0 when found, -1 on timeout, else a negative error code.
  */
-int usb_ControlRequestMR(uint8_t *request, uint16_t reqLen,
-                                response_handler_t handle_reply, int replies)
+int usb_waitForDevice(int16_t pid, int timeoutMs, char *addrStr)
 {
-    // general result var
-    int res = -1;
-
-    if (replies < 1) return -1;
-
-    res = usb_ControlRequest(request, reqLen, handle_reply);
+    return usb_hotplugAwait(pid, NULL, true, timeoutMs, addrStr);
+}
 
-    if (replies == 1) return res;
+/**
+ * Wait for the device at the supplied usb bus address to detach.
+ * Return 0 when gone, -1 on timeout, else a negative error code.
+ */
+int usb_waitForDeviceLeft(char const *addrStr, int timeoutMs)
+{
+    if (addrStr == NULL) return -20;
+    return usb_hotplugAwait(0, addrStr, false, timeoutMs, NULL);
+}
 
-    while (--replies>0)
-    {
-        zul_logf(4, "Multi-Reply expected [%d]", replies);
 
-        {
-            bool validResp = false;
-            int rxTransferAttempts = 2;
+// ============================================================================
+// --- Private Implementation ---
+// ============================================================================
 
-            // buffer to hold possible replies
-            uint8_t data[BUF_LEN];
-            memset (data, 0, BUF_LEN);
+/**
+ * return true if the device at the supplied address is already open
+ */
+static bool usb_devIsOpen(char const *addr)
+{
+    usb_device_t   *dev;
+    bool            found = false;
 
-            while ((!validResp) && (rxTransferAttempts-- > 0))
-            {
-                data[0] = 0x05;
-                (void)usleep(msv_CtrlDelay * 1000);
+    (void)pthread_mutex_lock(&msv_devListMutex);
+    for (dev = msv_openDevices; (dev != NULL) && !found; dev = dev->next)
+    {
+        found = (0 == strcmp(dev->addr, addr));
+    }
+    (void)pthread_mutex_unlock(&msv_devListMutex);
 
-                zul_log(4, "  CTRL M-RX attempt...");
+    return found;
+}
 
-                const uint8_t   rxRmReqType     = 0xA1;
-                const uint8_t   rxBReq          = 0x01;
-                const uint16_t  wIndex          = 0x0000;
-                const uint16_t  wLength         = BUF_LEN;
-                // const unsigned  timeout         = msv_CtrlTimeout;
+/**
+ * Open the libusb device, create its context and claim the management
+ * interface.  Return 0 to indicate success, else a negative error code.
+ */
+static int usb_devPrepare(EnumEntry_t const *entry, bool legacy,
+                                                        usb_device_t **pdev)
+{
+    int16_t                         idProduct = entry->pid;
+    int                             ok = -1;
+    int                             i;
+    usb_device_t                   *dev;
 
-                uint16_t        wValue          =
-                    (uint16_t)((msv_bootloader) ? 0x0300 : 0x0305);
+    zul_logf ( 3, " >> Instance:%d. Zytronic PID %d!\n",
+            entry->index, (int)idProduct);
 
-                res =  libusb_control_transfer ( msv_dev_handle,
-                        rxRmReqType, rxBReq,
-                        wValue, wIndex, data, wLength, msv_CtrlTimeout );
+    if (idProduct <= USB32C_PRODUCT_ID)
+    {
+        zul_logf ( 0, " Device is too old for this library!\n");
+        return -5;
+    }
 
-                if (res > 0)
-                {
-                    zul_log_hex(4, "    CTRL resp: ", data, res);
-                    if (nonZeroData(data, res))
-                    {
-                        (void)handle_reply(data);
-                        validResp = true;
-                    }
-                }
+    if (usb_devIsOpen(entry->addr))
+    {
+        return -1;                  // busy !! one connection per device
+    }
 
-                if (res < 0)
-                {
-                    zul_logf(1, "CTRL-RX unknown error %d", res);
-                    // no point in continuing
-                    rxTransferAttempts = 0;
-                    replies = 0;
-                }
-            }
-            if (rxTransferAttempts == 0)
-            {
-                zul_logf(1, "\n\nControl RX retries failed\n");
-            }
-        }
+    dev = (usb_device_t *)calloc(1, sizeof(usb_device_t));
+    if (dev == NULL)
+    {
+        return -4;
     }
+    memcpy(dev->addr, entry->addr, 7);
 
-    return res;
-}
+    ok = libusb_open( entry->ldev, &dev->handle);
+    zul_logf( 3, " >> libusb_open: %d\n", ok );
+    if (ok != 0)
+    {
+        free(dev);
+        return -4;
+    }
 
-// ============================================================================
-// --- Private Implementation ---
-// ============================================================================
+    zul_log_ts ( 3, "Device Opened" );
+    dev->index          = entry->index;
+    dev->pid            = idProduct;
 
-/**
- * return false if device fails to match the VendorID/ProductID supplied.
- * a productID of 0 indicates any product for that vendor
- */
-static bool dev_match(libusb_device *dev,
-                                const uint16_t vendor, const uint16_t product)
-{
-    struct libusb_device_descriptor desc;
+    // set Bootloader Mode for BL devices
+    dev->bootloader     = usb_isBLDevicePID(idProduct);
+    // get the preferred interface
+    dev->activeInterface = entry->mgmtInterface;
 
-    int r = libusb_get_device_descriptor(dev, &desc);
+    dev->ctrlDelay      = (legacy) ? msv_CtrlDelay   : DEF_CTRL_DELAY;
+    dev->ctrlRetry      = (legacy) ? msv_CtrlRetry   : DEF_CTRL_RETRY;
+    dev->ctrlTimeout    = (legacy) ? msv_CtrlTimeout : DEF_CTRL_TIMEOUT;
+    dev->INXfrTimeout   = 200;
+    dev->inPoolSize     = msv_InXfrPoolSize;
 
-    if (r < 0)
+    for (i = 0; i < MAX_REPORT_ID; i++)
     {
-        zul_log( 1, "failed to get device descriptor\n");
-        return false;
+        dev->IN_handler[i] = (legacy) ? legacy_IN_dispatch : NULL;
+        dev->IN_context[i] = NULL;
     }
 
-    if (desc.idVendor != vendor)  return false;
+    zul_logf(3, "Device Handle : %p PID:%04x BL:%d IF:%d\n",
+             dev->handle, dev->pid, dev->bootloader, dev->activeInterface);
+
+    (void)pthread_mutex_lock(&msv_devListMutex);
+    dev->next = msv_openDevices;
+    msv_openDevices = dev;
+    (void)pthread_mutex_unlock(&msv_devListMutex);
 
-    if (product != 0)
+    *pdev = dev;
+
+    // prepare device
+    ok = usb_claimInterface(dev, dev->activeInterface);
+    if ( ok != 0 )  // failed to prepare device
     {
-        if (desc.idProduct != product) return false;
+        zul_log(0, "failed to prepare touchcontroller device");
+        (void)usb_devClose(dev);
+        *pdev = NULL;
+        return -3;
     }
 
-    return true;
+    return 0;
 }
 
 
@@ -979,26 +2639,26 @@ static bool dev_match(libusb_device *dev,
  * Return 0 on success
  * Return a negative int on failure
  */
-static int usb_claimInterface(uint8_t iface)
+static int usb_claimInterface(usb_device_t *dev, uint8_t iface)
 {
     int     retVal;
     int     r;
 
-    if (msv_dev_handle == NULL)
+    if (dev->handle == NULL)
     {
         // zul_log(0, "can't prepare a null device");
         return -20;
     }
 
     zul_logf( 4, "Check Kernel isn't driving interface %d", iface);
-    if ( libusb_kernel_driver_active(msv_dev_handle, iface) == 1 )
+    if ( libusb_kernel_driver_active(dev->handle, iface) == 1 )
     {
         zul_logf( 3, "Attempt to detach interface %d from kernel", iface);
-        if ( libusb_detach_kernel_driver(msv_dev_handle, iface) == 0 )
+        if ( libusb_detach_kernel_driver(dev->handle, iface) == 0 )
         {
             // extra space to overwrite previous line
             zul_log( 3, "    ... detach done           " );
-            msv_reattach = true;     // NB: module global
+            dev->reattach = true;
             retVal = 0;
         }
         else
@@ -1010,7 +2670,7 @@ static int usb_claimInterface(uint8_t iface)
     }
 
     zul_logf( 3, "Claim interface %d", iface);
-    r = libusb_claim_interface(msv_dev_handle, iface);
+    r = libusb_claim_interface(dev->handle, iface);
     if (r != 0) // returns zero on success
     {
         zul_logf (0, "Claimed interface %d retval %d", iface, r);
@@ -1036,26 +2696,20 @@ static int usb_claimInterface(uint8_t iface)
     }
 
     // start the interrupt transfer managment service
-    if ( (! msv_bootloader) && (iface == 0))
+    if ( (! dev->bootloader) && (iface == 0))
     {
-        msv_closeInThread = false;
-        pthread_t myThread;
-        errno = 0;
-        errno = pthread_create(&myThread, NULL, interruptXfrWorker, NULL);
-        if (errno)
-        {
-            zul_logf(1, "ERROR: from pthread_create() is %s\n", strerror(errno));
-            perror("Create Interrupt Rx Thread");
-            exit(-1);
-        }
-        else
-        {
-            zul_log_ts ( 3, "interruptXfrWorker is running");
-        }
+        dev->closeInService = false;
+        (void)usleep(87711);        // let the device settle after the claim
+        (void)usb_BeginInterruptTransfer(dev, 200);      // timeout in ms
+        dev->inServiceRunning = true;
+        zul_log_ts ( 3, "interrupt IN service is running");
     }
     zul_logf( 3, "Interface %d Claimed\n", iface);
 
-    msv_dev_claimed = true;
+    // events are handled by the event thread, or the host application
+    usb_startEventThread();
+
+    dev->claimed = true;
     retVal = 0;
 
 exit:
@@ -1068,29 +2722,29 @@ exit:
  * Release a claimed interface
  * NB: the device is NOT closed here - so that another interface may be opened/claimed
  */
-static int usb_releaseInterface(uint8_t iface)
+static int usb_releaseInterface(usb_device_t *dev, uint8_t iface)
 {
     if (msv_libusb_ctx==NULL)
         return -11;
 
-    if (msv_dev_handle == NULL)
+    if (dev->handle == NULL)
         return -2;      // error - not open!
 
-    if (msv_dev_claimed)
+    if (dev->claimed)
     {
         zul_log( 3, "Terminate the interrupt transfer monitor" );
-        usb_stopInXfrService();
+        usb_stopInXfrService(dev);
 
         zul_log( 3, "Release interface" );
-        (void)libusb_release_interface(msv_dev_handle, iface);
-        msv_dev_claimed = false;
+        (void)libusb_release_interface(dev->handle, iface);
+        dev->claimed = false;
     }
 
-    if (msv_reattach)
+    if (dev->reattach)
     {
         zul_log_ts( 3, "Attempt to re-attach to kernel" );
-        (void)libusb_attach_kernel_driver(msv_dev_handle, iface);
-        msv_reattach = false;
+        (void)libusb_attach_kernel_driver(dev->handle, iface);
+        dev->reattach = false;
     }
 
     return SUCCESS;
@@ -1112,15 +2766,6 @@ bool nonZeroData(uint8_t *data, int len)
 // --- Private asynchronous USB INterrupt Transfer Support ---
 // ============================================================================
 
-#define IN_BUF_SZ (64)
-
-static struct libusb_transfer * msv_pIntXfr = NULL;
-//static bool                   msv_intXfrRunning = false;
-static unsigned char            msv_IntXfrBuffer[IN_BUF_SZ];
-static long int                 msv_lastIntCallbackTS = 0;
-static int                      msv_INXfrTimeout = 200;     // milliseconds
-
-
 /**
  * By default, interrupt transfers received are printed. This keeps the user
  * in the loop, provides a view of the transfer data and encourages the user
@@ -1135,6 +2780,20 @@ void usb_RegisterHandler (UsbReportID_t ReportID, interrupt_handler_t handler)
     }
 }
 
+/**
+ * Register a handler, and the context passed to it, for a reportID of one
+ * device.  A NULL handler restores the printing of the transfer data.
+ */
+void usb_devRegisterHandler (usb_device_t *dev, UsbReportID_t ReportID,
+                                    usb_in_handler_t handler, void *context)
+{
+    if ((dev != NULL) && (ReportID < MAX_REPORT_ID))
+    {
+        dev->IN_handler[ReportID] = handler;
+        dev->IN_context[ReportID] = context;
+    }
+}
+
 /**
  *  Assure that suitable handlers are in place for any
  *  interrupt transfers from the controller.
@@ -1155,113 +2814,131 @@ void usb_ResetDefaultInHandlers (void)
 }
 
 /**
- *  https://computing.llnl.gov/tutorials/pthreads/
+ * Release a transfer of the IN pool, once it can't be resubmitted
  */
-void *interruptXfrWorker(void *arg)
+static void usb_freeInXfr(usb_device_t *dev, struct libusb_transfer *transfer)
 {
-    (void)(arg);     // unused var - pthread signature
-    (void)usleep(87711);
-    usb_BeginInterruptTransfer(200);        // timeout in ms
+    int i;
 
-    while (!msv_closeInThread)
+    for (i = 0; i < IN_XFR_POOL_MAX; i++)
     {
-        int retVal;
-
-        // 1 packet per ms is the limit for IN packets from ZXYdd0 devices (2017)
-        (void)usleep(877);
-        retVal = libusb_handle_events(msv_libusb_ctx);
-        if (retVal != 0) zul_logf (0, "ERROR @ %s %d", __FUNCTION__, __LINE__ );
+        if (dev->pIntXfr[i] == transfer)
+        {
+            dev->pIntXfr[i] = NULL;
+            (void)__atomic_sub_fetch(&dev->inXfrAllocated, 1, __ATOMIC_RELEASE);
+            break;
+        }
     }
-    zul_log(3, "Interrupt Transfer Worker - Terminating");
-
-    pthread_exit(NULL);
+    libusb_free_transfer(transfer);
 }
 
 /**
  * myIntCallBack - handle all interrupt transfers from device:
  *  { Touches, RawData, HBR, ... }
+ *
+ * The report is copied out and the transfer re-queued before the handler is
+ * called, so the rest of the pool covers the endpoint while it runs.
  */
-void myIntCallBack(struct libusb_transfer *transfer)
+static void myIntCallBack(struct libusb_transfer *transfer)
 {
-    bool handleNewData = false;
+    usb_device_t   *dev = (usb_device_t *)transfer->user_data;
+    bool            handleNewData = false;
+    bool            resubmit = true;
+    uint8_t         data[IN_BUF_SZ];
+    uint64_t        entryUs = zul_monotonicUs();
+    int             queued;
+
+    queued = __atomic_sub_fetch(&dev->inXfrQueued, 1, __ATOMIC_ACQ_REL);
 
     int reportID = transfer->buffer[0];
     zul_log(4, __FUNCTION__ );
-    msv_lastIntCallbackTS = zul_getLongTS();
-
-    if (reportID >= MAX_REPORT_ID)
-    {
-        zul_logf(0, "Interrupt Transfer - Bad Report ID %d", reportID );
-        return;
-    }
+    dev->lastIntCallbackTS = zul_getLongTS();
 
     switch (transfer->status)
     {
         case LIBUSB_TRANSFER_COMPLETED:
             zul_logf(4, "IN Xfr Complete [ID:%02d]",reportID);
+            if (reportID >= MAX_REPORT_ID)
+            {
+                zul_logf(0, "Interrupt Transfer - Bad Report ID %d", reportID );
+                dev->inStats.errors++;
+                break;
+            }
+            memcpy(data, transfer->buffer, IN_BUF_SZ);
+            dev->inStats.received++;
             handleNewData = true;
         break;
 
         case LIBUSB_TRANSFER_ERROR:
             zul_logf(3, "Interrupt Transfer Error %d", errno);
-            //zul_log(0, strerror( errno ));
-            //zul_log(0, libusb_strerror( errno ));
+            dev->inStats.errors++;
         break;
         case LIBUSB_TRANSFER_TIMED_OUT:
             zul_logf(4, "Interrupt Transfer - TimeOut");
         break;
         case LIBUSB_TRANSFER_CANCELLED:
             zul_logf(3, "Interrupt Transfer Cancelled");
-            libusb_free_transfer(msv_pIntXfr);
-            msv_pIntXfr = NULL;
+            resubmit = false;
         break;
         case LIBUSB_TRANSFER_STALL:
             zul_logf(1, "Interrupt Transfer Stalled");
-            libusb_free_transfer(msv_pIntXfr);
-            msv_pIntXfr = NULL;
+            dev->inStats.errors++;
+            resubmit = false;
         break;
         case LIBUSB_TRANSFER_NO_DEVICE:
             zul_logf(1, "Interrupt NoDevice");
-            libusb_free_transfer(msv_pIntXfr);
-            msv_pIntXfr = NULL;
+            resubmit = false;
         break;
         case LIBUSB_TRANSFER_OVERFLOW:
             zul_logf(1, "Interrupt Too Much Data");
+            dev->inStats.errors++;
         break;
         default :
             zul_logf(0, "Unknown Inturrupt Transfer Status");
     }
 
-    if (handleNewData)
+    // if exiting, stop now
+    if (dev->closeInService)
     {
-        interrupt_handler_t handler = msv_IN_handler[reportID];
+        zul_logf( 3 , "%s -- don't restart IN transfer \n", __FUNCTION__ );
+        resubmit = false;
+    }
 
-        if (handler == NULL)
+    if (resubmit)
+    {
+        // a report arrived, and nothing was queued behind it until now
+        if ((queued == 0) && handleNewData) dev->inStats.gaps++;
+
+        if (usb_submitInXfr(dev, transfer) != SUCCESS)
         {
-            zul_logf(3, "Size: %d.  TS: %ld", transfer->actual_length,
-                                                    msv_lastIntCallbackTS);
-            zul_log_hex(3, "IntXfr",transfer->buffer, 16);
+            dev->inStats.errors++;
+            usb_freeInXfr(dev, transfer);
         }
-
-        if (handler != NULL)
+        else if (zul_monotonicUs() - entryUs > IN_REPORT_PERIOD_US)
         {
-            handler(transfer->buffer);
+            dev->inStats.lateResubmits++;
         }
     }
-
-    // if exiting, stop now
-    if (msv_closeInThread)
+    else
     {
-        int retVal = libusb_handle_events_completed (msv_libusb_ctx, NULL);
-        if (retVal != 0) zul_logf (0, "ERROR @ %s %d", __FUNCTION__, __LINE__ );
-        zul_logf( 3 , "%s -- don't restart IN transfer \n", __FUNCTION__ );
-        return;
+        usb_freeInXfr(dev, transfer);
     }
 
-    // otherwise, set up next interrupt transfer.
-    if (msv_pIntXfr != NULL)
+    if (handleNewData)
     {
-        usb_BeginInterruptTransfer(msv_INXfrTimeout);
+        usb_in_handler_t handler = dev->IN_handler[reportID];
+
+        if (handler == NULL)
+        {
+            zul_logf(3, "Size: %d.  TS: %ld", transfer->actual_length,
+                                                    dev->lastIntCallbackTS);
+            zul_log_hex(3, "IntXfr", data, 16);
+        }
+
+        if (handler != NULL)
+        {
+            handler(dev->IN_context[reportID], data);
+        }
     }
 
     return;
@@ -1269,29 +2946,56 @@ void myIntCallBack(struct libusb_transfer *transfer)
 
 
 /**
- * Start a thread to handle ANY interrupt transfer from controller
+ * Queue a pool of transfers to handle ANY interrupt transfer from controller
  *   This prevents the controller resetting, when a touch or other interrupt
  *   transfer is initiated by the controller, as otherwise it would be
- *   uncompleted, and timeout => reset.
+ *   uncompleted, and timeout => reset.  Each transfer is re-queued as it
+ *   completes, so the pool is serviced round-robin by the endpoint.
  */
-int usb_BeginInterruptTransfer(int timeoutMs)
+static int usb_BeginInterruptTransfer(usb_device_t *dev, int timeoutMs)
 {
-    void *  user_data = NULL;
-    int     retVal, errnoSave;
+    int     i;
+    int     retVal = FAILURE;
+
+    if (dev->closeInService) return 0;
 
-    if (msv_closeInThread) return 0;
+    dev->INXfrTimeout = timeoutMs;
 
-    if (msv_pIntXfr == NULL)
+    for (i = 0; i < dev->inPoolSize; i++)
     {
-        msv_pIntXfr = libusb_alloc_transfer(0);
-        zul_logf (3, "BUF_ALLOC @ %s %d", __FUNCTION__, __LINE__ );
+        if (dev->pIntXfr[i] != NULL) continue;
+
+        dev->pIntXfr[i] = libusb_alloc_transfer(0);
+        if (dev->pIntXfr[i] == NULL)
+        {
+            zul_logf (0, "ERROR @ %s %d", __FUNCTION__, __LINE__ );
+            break;
+        }
+        (void)__atomic_add_fetch(&dev->inXfrAllocated, 1, __ATOMIC_RELEASE);
+        zul_logf (3, "BUF_ALLOC @ %s %d [%d]", __FUNCTION__, __LINE__, i );
+
+        (void)libusb_fill_interrupt_transfer( dev->pIntXfr[i], dev->handle, 0x81,
+                                    dev->IntXfrBuffer[i], IN_BUF_SZ,
+                                    myIntCallBack, dev, timeoutMs );
+
+        if (usb_submitInXfr(dev, dev->pIntXfr[i]) != SUCCESS)
+        {
+            usb_freeInXfr(dev, dev->pIntXfr[i]);
+            break;
+        }
+        retVal = SUCCESS;
     }
-    msv_INXfrTimeout = timeoutMs;
-    (void)libusb_fill_interrupt_transfer( msv_pIntXfr, msv_dev_handle, 0x81,
-                                    msv_IntXfrBuffer, IN_BUF_SZ,
-                                    myIntCallBack, user_data, timeoutMs );
+    return retVal;
+}
+
+/**
+ * (Re)submit one transfer of the IN pool
+ */
+static int usb_submitInXfr(usb_device_t *dev, struct libusb_transfer *transfer)
+{
+    int     retVal, errnoSave;
 
-    retVal = libusb_submit_transfer(msv_pIntXfr);
+    retVal = libusb_submit_transfer(transfer);
     errnoSave = errno;
     switch (retVal)
     {
@@ -1301,6 +3005,7 @@ int usb_BeginInterruptTransfer(int timeoutMs)
             retVal = FAILURE;
             break;
         case     0:
+            (void)__atomic_add_fetch(&dev->inXfrQueued, 1, __ATOMIC_ACQ_REL);
             retVal = SUCCESS;
             // success
             break;
@@ -1322,19 +3027,23 @@ int usb_BeginInterruptTransfer(int timeoutMs)
 
 
 /**
- * If an interrupt transfer is in flight, cancel it and await
- * for the transfer to be freed, which occurs once the cancel action
- * is processed by libusb_handle_events.
+ * Cancel the interrupt transfers in flight, and await for the transfers to
+ * be freed, which occurs once the cancel actions are processed by
+ * libusb_handle_events.  Then stop the worker thread.
  */
-void usb_stopInXfrService(void)
+static void usb_stopInXfrService(usb_device_t *dev)
 {
     int retVal;
+    int i;
     zul_log_ts( 3 , __FUNCTION__ );
-    if (msv_closeInThread) return;
+    if (!dev->inServiceRunning) return;
 
-    if (msv_pIntXfr != NULL)
+    dev->closeInService = true;
+    for (i = 0; i < IN_XFR_POOL_MAX; i++)
     {
-        retVal = libusb_cancel_transfer(msv_pIntXfr);
+        if (dev->pIntXfr[i] == NULL) continue;
+
+        retVal = libusb_cancel_transfer(dev->pIntXfr[i]);
         if (retVal != 0)
         {
             zul_logf (3, "ERROR @ %s %d %s", __FUNCTION__, __LINE__, libusb_error_name(retVal) );
@@ -1342,18 +3051,17 @@ void usb_stopInXfrService(void)
         // above WILL call myIntCallBack() IF the transfer is active
     }
 
-    int countdown = 30;
-    // supervised shutdown - handle cancelled transfer
-    while ((msv_pIntXfr != NULL) && (countdown-- > 0))
+    int countdown = 100;
+    // supervised shutdown - handle cancelled transfers, which frees the pool.
+    // Events may be handled here, by the event thread or by the host loop.
+    while ((__atomic_load_n(&dev->inXfrAllocated, __ATOMIC_ACQUIRE) > 0) &&
+           (countdown-- > 0))
     {
-        (void)usleep(900);
-        // in thread calls libusb_handle_events(msv_libusb_ctx)
-        // which NULLs msv_pIntXfr
+        struct timeval tv = { 0, 10000 };
+        (void)libusb_handle_events_timeout(msv_libusb_ctx, &tv);
     }
-    msv_closeInThread = true;
 
-    (void)usleep(msv_INXfrTimeout * 1100);
-        // * 1100 => a little more than the INXfrTimeout in microseconds
+    dev->inServiceRunning = false;
 }
 
 
@@ -1376,4 +3084,107 @@ void default_IN_handler(uint8_t *data)
     // do nothing
 }
 
+/**
+ * Pass IN data of the single-device API device to the handlers registered
+ * with usb_RegisterHandler()
+ */
+static void legacy_IN_dispatch(void *context, uint8_t *data)
+{
+    interrupt_handler_t handler = msv_IN_handler[data[0]];
+
+    (void)context;
+    if (handler == NULL)
+    {
+        zul_log_hex(3, "IntXfr", data, 16);
+        return;
+    }
+    handler(data);
+}
+
+
+// ============================================================================
+// --- Transport Operations ---
+//     The libusb backend of transport.h
+// ============================================================================
+
+static int tpOpen(int index, void **dev)
+{
+    return usb_devOpen(index, (usb_device_t **)dev);
+}
+
+static int tpOpenByAddr(char const *addrStr, void **dev)
+{
+    return usb_devOpenByAddr(addrStr, (usb_device_t **)dev);
+}
+
+static int tpClose(void *dev)
+{
+    return usb_devClose((usb_device_t *)dev);
+}
+
+static bool tpGetPID(void *dev, int16_t *pid)
+{
+    return usb_devGetPID((usb_device_t *)dev, pid);
+}
+
+static int tpGetAddrStr(void *dev, char *addrStr)
+{
+    return usb_devGetAddrStr((usb_device_t *)dev, addrStr);
+}
+
+static bool tpSwitchIFace(void *dev, uint8_t iface)
+{
+    return usb_devSwitchIFace((usb_device_t *)dev, iface);
+}
+
+static void tpSetCtrlParams(void *dev, int delay, int retries, int timeout)
+{
+    usb_devSetCtrlParams((usb_device_t *)dev, delay, retries, timeout);
+}
+
+static int tpControlRequest(void *dev, uint8_t *request, uint16_t reqLen,
+                                                            uint8_t *reply)
+{
+    return usb_devControlRequest((usb_device_t *)dev, request, reqLen, reply);
+}
+
+static int tpControlReply(void *dev, uint8_t *reply)
+{
+    return usb_devControlReply((usb_device_t *)dev, reply);
+}
+
+static void tpRegisterHandler(void *dev, UsbReportID_t ReportID,
+                                    usb_in_handler_t handler, void *context)
+{
+    usb_devRegisterHandler((usb_device_t *)dev, ReportID, handler, context);
+}
+
+static bool tpGetInStats(void *dev, usb_in_stats_t *stats)
+{
+    return usb_devGetInStats((usb_device_t *)dev, stats);
+}
+
+zul_transport_t const usb_transport =
+{
+    .name               = "libusb",
+    .openLib            = usb_openLib,
+    .closeLib           = usb_closeLib,
+    .libStr             = usb_usbLibStr,
+    .getDeviceList      = usb_getDeviceList,
+    .rescan             = usb_rescanDevices,
+    .waitForDevice      = usb_waitForDevice,
+    .waitForDeviceLeft  = usb_waitForDeviceLeft,
+    .devOpen            = tpOpen,
+    .devOpenByAddr      = tpOpenByAddr,
+    .devClose           = tpClose,
+    .devGetPID          = tpGetPID,
+    .devGetAddrStr      = tpGetAddrStr,
+    .devSwitchIFace     = tpSwitchIFace,
+    .devSetCtrlParams   = tpSetCtrlParams,
+    .devControlRequest  = tpControlRequest,
+    .devControlReply    = tpControlReply,
+    .devRegisterHandler = tpRegisterHandler,
+    .devGetInStats      = tpGetInStats,
+};
+
 #endif // ifdef __linux__
@@ -50,6 +50,42 @@ extern "C" {
 // pointer to control data handler
 typedef int(*response_handler_t)(uint8_t *d);
 
+// completion of an asynchronous control request. reply is NULL if no
+// non-empty reply was received, and is only valid for the duration of the call
+typedef void(*usb_ctrl_done_t)(int result, uint8_t *reply, void *user);
+
+// an open device, for use by applications that manage more than one device
+typedef struct usb_device usb_device_t;
+
+// pointer to a per-device interrupt data handler, passed its registered context
+typedef void(*usb_in_handler_t)(void *context, uint8_t *data);
+
+// counters of the interrupt IN endpoint (0x81) of a device
+typedef struct usb_in_stats
+{
+    uint32_t    received;       // reports received
+    uint32_t    lateResubmits;  // transfers re-queued more than 1ms after completion
+    uint32_t    gaps;           // completions that left no transfer queued
+    uint32_t    errors;         // failed transfers/resubmissions, bad report IDs
+} usb_in_stats_t;
+
+// measured control request turnaround of one message code of a product
+typedef struct usb_ctrl_latency
+{
+    int16_t     pid;
+    uint8_t     msgCode;
+    bool        learned;        // enough samples for the values below to apply
+    uint32_t    samples;        // since learning (re)started
+    uint32_t    timeouts;       // requests that received no reply
+    uint32_t    relearns;       // times discarded after repeated timeouts
+    uint32_t    ewmaUs;         // moving average turnaround
+    uint32_t    p99Us;          // 99th percentile estimate (rounded up)
+    uint32_t    maxUs;
+    int         pollDelayMs;    // equivalent usb_setCtrlDelay() value
+    int         retries;
+    int         timeoutMs;
+} usb_ctrl_latency_t;
+
 
 /**
  * Call to initialise the library. Zero returned on success.
@@ -64,11 +100,28 @@ char *      usb_usbLibStr       (void);
  */
 int         usb_getDeviceList   (char *buf, int len);
 
+/**
+ * Device listing and opening use a cached enumeration of the bus, which is
+ * refreshed by hotplug events.  This discards the cache and re-reads the bus.
+ * Return the number of Zytronic devices, or a negative error code.
+ */
+int         usb_rescanDevices   (void);
+
 /**
  * return true if the connected device is a bootloader
  */
 bool        usb_isBLDevicePID(int16_t pid);
 
+/**
+ * Wait for a device of the given PID (0 => any) to attach, or for the device
+ * at a usb bus address to detach.  Waiters are woken by hotplug events where
+ * libusb supports them, else the enumeration is polled.
+ * Return 0 on success, -1 on timeout, else a negative error code.
+ */
+int         usb_waitForDevice           (int16_t pid, int timeoutMs,
+                                            /*@null@*/ char *addrStr);
+int         usb_waitForDeviceLeft       (char const *addrStr, int timeoutMs);
+
 
 
 
@@ -123,6 +176,16 @@ int         usb_closeDevice     (void);
  */
 int         usb_ControlRequest          (uint8_t *request, uint16_t reqLen,
                                  /*@null@*/ response_handler_t handle_reply);
+/**
+ * Submit a control request to the connected device without waiting.
+ * If expectReply is set, the reply is polled for as soon as the request
+ * transfer completes, and re-polled on each empty reply.  done() is called
+ * once, from libusb event handling, with the byte count or a negative code.
+ * Returns zero if the request was submitted, else a negative error code.
+ */
+int         usb_ControlRequestAsync     (uint8_t *request, uint16_t reqLen,
+                                            bool expectReply,
+                                            usb_ctrl_done_t done, void *user);
 /**
  * Make a control-request to the connected device, which expects more than
  * one control-response from the device.  [ZXY100 get single raw data]
@@ -133,10 +196,10 @@ int         usb_ControlRequestMR        (   uint8_t *request, uint16_t reqLen,
                                             int replyCount);
 
 /**
- * Alter the USB control comms delay, in microseconds. It has been useful to
- * lengthen the period between the TX and RX transfers in certain conditions.
- * The default is 5000 (see var msv_CtrlDelay) but if issues occur a value of
- * 50,000 has been seen to help.
+ * Alter the USB control comms delay, in milliseconds. The reply is polled for
+ * as soon as each transfer completes, so this no longer adds a sleep; instead
+ * (delay * retries) sets how long empty replies are re-polled before the
+ * request is abandoned.  The default is 5 (see var msv_CtrlDelay).
  */
 void        usb_setCtrlDelay            (int delay);
 void        usb_defaultCtrlDelay        (void);
@@ -147,6 +210,29 @@ void        usb_defaultCtrlRetry(void);
 void        usb_setCtrlTimeout          (int delay);
 void        usb_defaultCtrlTimeout      (void);
 
+/**
+ * The turnaround of each message code is measured, per PID.  Once learned,
+ * a request of that code is polled for a few times its 99th percentile
+ * turnaround, in place of the default parameters above; parameters set to
+ * other than the defaults remain a minimum.  A reply timeout widens these
+ * values for a while, rather than discarding them.  Adaptive tuning is on by
+ * default.
+ */
+void        usb_setCtrlAdaptive         (bool enable);
+void        usb_resetCtrlLatency        (void);
+
+/**
+ * Copy the measurements of one message code of a product.
+ * Return false if nothing has been measured.
+ */
+bool        usb_getCtrlLatency          (int16_t pid, uint8_t msgCode,
+                                            usb_ctrl_latency_t *stats);
+/**
+ * Copy up to maxEntries measurement records, returning the number copied
+ */
+int         usb_getCtrlLatencyTable     (usb_ctrl_latency_t *table,
+                                            int maxEntries);
+
 // ============================================================================
 // --- Asynchronous Interrupt Transfer Support ---
 // ============================================================================
@@ -167,6 +253,128 @@ void        usb_RegisterHandler         ( UsbReportID_t ReportID,
  */
 void        usb_ResetDefaultInHandlers  (void);
 
+/**
+ * Several interrupt IN transfers are kept queued on the device, each with its
+ * own buffer, so reports are not lost while a handler runs.  Set the number
+ * used for devices opened after this call (default 4, limit 16).
+ */
+void        usb_setInXfrPoolSize        (int count);
+
+/**
+ * Copy the interrupt IN counters of the connected device
+ * Return true => SUCCESS else no device is open
+ */
+bool        usb_getInStats              (usb_in_stats_t *stats);
+
+
+// ============================================================================
+// --- Event Loop Integration ---
+//     By default the library handles USB events in a thread of its own, which
+//     sleeps until there is USB activity.  Alternatively, the host application
+//     may watch usb_getEventFd() in its own poll/epoll/select loop, and call
+//     usb_handleEvents() when it is readable or usb_getEventTimeout() expires.
+// ============================================================================
+
+/**
+ * Select the host application's loop (true) or the library thread (false)
+ * to handle USB events.  Call after usb_openLib().
+ */
+void        usb_useExternalEventLoop    (bool external);
+
+/**
+ * Return a file descriptor that is readable when USB events are pending,
+ * or -1 if the library is not open.
+ */
+int         usb_getEventFd              (void);
+
+/**
+ * Return the longest wait, in ms, before usb_handleEvents() must be called,
+ * or -1 if there is no USB timeout pending.
+ */
+int         usb_getEventTimeout         (void);
+
+/**
+ * Handle any pending USB events without blocking, completing transfers and
+ * calling the registered handlers.  While a synchronous libusb call in
+ * another thread is handling events, this waits up to 10 ms for it instead.
+ * Return zero on success, else a negative libusb error code.
+ */
+int         usb_handleEvents            (void);
+
+
+// ============================================================================
+// --- Multiple Device Support ---
+//     The services above act upon one device, opened by usb_openDevice().
+//     These act upon any of the devices open at the same time; a device
+//     opened by usb_openDevice() is also available from usb_getDefaultDevice()
+// ============================================================================
+
+/**
+ * Open a particular device, based on the indices provided by zul_getDeviceList()
+ * Return zero and set *dev on success, else a negative error code.
+ */
+int         usb_devOpen                 (int index, usb_device_t **dev);
+/**
+ * Open a particular device, based on the supplied usb bus address string
+ * Return zero and set *dev on success, else a negative error code.
+ */
+int         usb_devOpenByAddr           (char const *addrStr, usb_device_t **dev);
+/**
+ * Close a device opened by any of the above open services.
+ */
+int         usb_devClose                (usb_device_t *dev);
+
+/**
+ * Return the device opened by usb_openDevice/usb_openDeviceByAddr, or NULL
+ */
+usb_device_t *  usb_getDefaultDevice    (void);
+
+bool        usb_devGetPID               (usb_device_t *dev, int16_t *pid);
+int         usb_devGetAddrStr           (usb_device_t *dev, char *addrStr);
+bool        usb_devSwitchIFace          (usb_device_t *dev, uint8_t iface);
+
+/**
+ * Set the control comms delay (ms), retry count and timeout (ms) of one
+ * device.  A negative value selects the library default for that item.
+ */
+void        usb_devSetCtrlParams        (usb_device_t *dev, int delay,
+                                            int retries, int timeout);
+
+/**
+ * As usb_ControlRequestAsync(), for a particular device
+ */
+int         usb_devControlRequestAsync  (usb_device_t *dev,
+                                            uint8_t *request, uint16_t reqLen,
+                                            bool expectReply,
+                                            usb_ctrl_done_t done, void *user);
+/**
+ * Make a control request to a particular device, waiting for completion.
+ * If reply is not NULL, a reply is expected and the USB_PACKET_LEN bytes
+ * received are copied to it.  Returns the number of bytes transferred or,
+ * on an error, a negative code.
+ */
+int         usb_devControlRequest       (usb_device_t *dev,
+                                            uint8_t *request, uint16_t reqLen,
+                                            /*@null@*/ uint8_t *reply);
+/**
+ * Fetch a further reply to the last request made to a device, without
+ * sending a request.  [ZXY100 get single raw data]  Returns as above.
+ */
+int         usb_devControlReply         (usb_device_t *dev, uint8_t *reply);
+
+/**
+ * Register a handler, and its context, for a reportID of a particular device.
+ * Handlers are called from the libusb event handling thread.
+ */
+void        usb_devRegisterHandler      (usb_device_t *dev,
+                                            UsbReportID_t ReportID,
+                                            /*@null@*/
+                                            usb_in_handler_t handler,
+                                            void *context);
+
+bool        usb_devGetInStats           (usb_device_t *dev,
+                                            usb_in_stats_t *stats);
+
 
 // ============================================================================
 // --- Interrupt Data Handlers ---